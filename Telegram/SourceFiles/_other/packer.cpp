@@ -137,7 +137,97 @@ int32 *hashSha1(const void *data, uint32 len, void *dest) {
 	return (int32*)sha1To;
 }
 
+namespace {
+
+constexpr auto kDeltaBlockSize = 64;
+constexpr auto kDeltaBlockCandidates = 16;
+
+enum class DeltaEntry : quint8 { // duplicated in autoupdater.cpp
+	Full = 0x00,
+	Patch = 0x01,
+};
+
+enum class PatchOp : quint8 { // duplicated in autoupdater.cpp
+	Copy = 0x00,
+	Insert = 0x01,
+};
+
+uint32 hashDeltaBlock(const uchar *data) {
+	auto result = uint32(0);
+	for (auto i = 0; i != kDeltaBlockSize; ++i) {
+		result = result * 257 + data[i];
+	}
+	return result;
+}
+
+// Copies of the blocks found in the base file and inserts of the rest,
+// base blocks are looked up by a rolling hash of the target data.
+QByteArray countPatch(const QByteArray &base, const QByteArray &target) {
+	QByteArray result;
+	QDataStream stream(&result, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto b = (const uchar*)base.constData();
+	auto t = (const uchar*)target.constData();
+	auto baseSize = base.size(), targetSize = target.size();
+
+	QMultiHash<uint32, int> blocks;
+	for (auto offset = 0; offset + kDeltaBlockSize <= baseSize; offset += kDeltaBlockSize) {
+		blocks.insert(hashDeltaBlock(b + offset), offset);
+	}
+	auto power = uint32(1);
+	for (auto i = 0; i != kDeltaBlockSize; ++i) {
+		power *= 257;
+	}
+
+	auto pending = 0;
+	auto flushInsert = [&](int till) {
+		if (till > pending) {
+			stream << quint8(PatchOp::Insert) << QByteArray(target.constData() + pending, till - pending);
+		}
+	};
+	auto position = 0;
+	auto hash = (targetSize >= kDeltaBlockSize) ? hashDeltaBlock(t) : uint32(0);
+	while (position + kDeltaBlockSize <= targetSize) {
+		auto best = -1, bestSize = 0, candidates = 0;
+		for (auto i = blocks.constFind(hash); i != blocks.cend() && i.key() == hash && candidates != kDeltaBlockCandidates; ++i, ++candidates) {
+			auto offset = i.value();
+			if (memcmp(b + offset, t + position, kDeltaBlockSize)) {
+				continue;
+			}
+			auto size = kDeltaBlockSize;
+			while (offset + size < baseSize && position + size < targetSize && b[offset + size] == t[position + size]) {
+				++size;
+			}
+			if (size > bestSize) {
+				best = offset;
+				bestSize = size;
+			}
+		}
+		if (best >= 0) {
+			flushInsert(position);
+			stream << quint8(PatchOp::Copy) << quint32(best) << quint32(bestSize);
+			position += bestSize;
+			pending = position;
+			if (position + kDeltaBlockSize <= targetSize) {
+				hash = hashDeltaBlock(t + position);
+			}
+		} else {
+			if (position + kDeltaBlockSize < targetSize) {
+				hash = hash * 257 + t[position + kDeltaBlockSize] - power * t[position];
+			}
+			++position;
+		}
+	}
+	flushInsert(targetSize);
+	return result;
+}
+
+} // namespace
+
 QString BetaSignature;
+QString DeltaPath;
+quint64 DeltaFrom = 0;
 
 int main(int argc, char *argv[])
 {
@@ -171,9 +261,18 @@ int main(int argc, char *argv[])
 				cout << "Bad -beta param value passed, should be for the same version: " << version << ", beta: " << BetaVersion << "\n";
 				return -1;
 			}
+		} else if (string("-delta") == argv[i] && i + 1 < argc) {
+			DeltaPath = QFileInfo(workDir + QString(argv[i + 1])).canonicalFilePath() + "/";
+		} else if (string("-deltafrom") == argv[i] && i + 1 < argc) {
+			DeltaFrom = QString(argv[i + 1]).toULongLong();
 		}
 	}
 
+	if (DeltaPath.isEmpty() != !DeltaFrom) {
+		cout << "Both -delta {previous version dir} and -deltafrom {previous version} should be passed for an update difference.\n";
+		return -1;
+	}
+
 	if (files.isEmpty() || remove.isEmpty() || version <= 1016 || version > 999999999) {
 #ifdef Q_OS_WIN
 		cout << "Usage: Packer.exe -path {file} -version {version} OR Packer.exe -path {dir} -version {version}\n";
@@ -182,6 +281,7 @@ int main(int argc, char *argv[])
 #else
 		cout << "Usage: Packer -path {file} -version {version} OR Packer -path {dir} -version {version}\n";
 #endif
+		cout << "Add -delta {previous version dir} -deltafrom {previous version} for an update difference.\n";
 		return -1;
 	}
 
@@ -231,7 +331,15 @@ int main(int argc, char *argv[])
 			stream << quint32(version);
 		}
 
-		stream << quint32(files.size());
+		if (DeltaFrom) {
+			stream << quint64(DeltaFrom);
+		}
+
+		QByteArray entries;
+		QDataStream entriesStream(&entries, QIODevice::WriteOnly);
+		entriesStream.setVersion(QDataStream::Qt_5_1);
+		auto entriesCount = 0;
+
 		cout << "Found " << files.size() << " file" << (files.size() == 1 ? "" : "s") << "..\n";
 		for (QFileInfoList::iterator i = files.begin(); i != files.end(); ++i) {
 			QFileInfo info(*i);
@@ -245,11 +353,45 @@ int main(int argc, char *argv[])
 				return -1;
 			}
 			QByteArray inner = f.readAll();
-			stream << name << quint32(inner.size()) << inner;
+			bool executable = QFileInfo(fullName).isExecutable();
+			if (!DeltaFrom) {
+				entriesStream << name << quint32(inner.size()) << inner;
+			} else {
+				QFile baseFile(DeltaPath + name);
+				if (!baseFile.open(QIODevice::ReadOnly)) {
+					cout << "Not found in the previous version, adding full.\n";
+					entriesStream << name << quint8(DeltaEntry::Full) << quint32(inner.size()) << inner;
+				} else {
+					QByteArray base = baseFile.readAll();
+					baseFile.close();
+					if (base == inner && QFileInfo(baseFile).isExecutable() == executable) {
+						cout << "Not changed, skipping.\n";
+						continue;
+					}
+					QByteArray patch = countPatch(base, inner);
+					if (patch.size() >= inner.size()) {
+						cout << "Patch is too large, adding full.\n";
+						entriesStream << name << quint8(DeltaEntry::Full) << quint32(inner.size()) << inner;
+					} else {
+						cout << "Patch size: " << patch.size() << "\n";
+						uchar baseHash[20], innerHash[20];
+						hashSha1(base.constData(), base.size(), baseHash);
+						hashSha1(inner.constData(), inner.size(), innerHash);
+						entriesStream << name << quint8(DeltaEntry::Patch) << QByteArray((const char*)baseHash, 20) << QByteArray((const char*)innerHash, 20) << quint32(inner.size()) << patch;
+					}
+				}
+			}
 #if defined Q_OS_MAC || defined Q_OS_LINUX
-			stream << (QFileInfo(fullName).isExecutable() ? true : false);
+			entriesStream << executable;
 #endif
+			++entriesCount;
+		}
+		if (entriesStream.status() != QDataStream::Ok) {
+			cout << "Entries stream status is bad: " << entriesStream.status() << "\n";
+			return -1;
 		}
+		stream << quint32(entriesCount);
+		stream.writeRawData(entries.constData(), entries.size());
 		if (stream.status() != QDataStream::Ok) {
 			cout << "Stream status is bad: " << stream.status() << "\n";
 			return -1;
@@ -469,6 +611,9 @@ int main(int argc, char *argv[])
 	if (BetaVersion) {
 		outName += "_" + BetaSignature;
 	}
+	if (DeltaFrom) {
+		outName += "_d" + QString::number(DeltaFrom);
+	}
 	QFile out(outName);
 	if (!out.open(QIODevice::WriteOnly)) {
 		cout << "Can't open '" << outName.toUtf8().constData() << "' for write..\n";
@@ -42,8 +42,9 @@ constexpr auto kReloadChannelMembersTimeout = 1000; // 1 second wait before relo
 constexpr auto kSaveCloudDraftTimeout = 1000; // save draft to the cloud with 1 sec extra delay
 constexpr auto kSaveDraftBeforeQuitTimeout = 1500; // give the app 1.5 secs to save drafts to cloud when quitting
 constexpr auto kSmallDelayMs = 5;
+constexpr auto kWebPagesFlushWindow = TimeId(2); // resolve pending web pages due in 2 secs together
 constexpr auto kStickersUpdateTimeout = 3600000; // update not more than once in an hour
-constexpr auto kUnreadMentionsPreloadIfLess = 5;
+constexpr auto kUnreadMentionsPreloadIfLess = 25; // request the next slice while jumping through the loaded ones
 constexpr auto kUnreadMentionsFirstRequestLimit = 10;
 constexpr auto kUnreadMentionsNextRequestLimit = 100;
 
@@ -121,7 +122,13 @@ void ApiWrap::applyUpdates(const MTPUpdates &updates, uint64 sentMessageRandomId
 }
 
 void ApiWrap::requestMessageData(ChannelData *channel, MsgId msgId, RequestMessageDataCallback callback) {
-	auto &req = (channel ? _channelMessageDataRequests[channel][msgId] : _messageDataRequests[msgId]);
+	auto &requests = (channel ? _channelMessageDataRequests[channel] : _messageDataRequests);
+	auto &counters = lookupCounters(Lookup::MessageData);
+	++counters.requested;
+	if (requests.contains(msgId)) {
+		++counters.deduplicated;
+	}
+	auto &req = requests[msgId];
 	if (callback) {
 		req.callbacks.append(callback);
 	}
@@ -157,7 +164,7 @@ void ApiWrap::resolveMessageDatas() {
 	if (!ids.isEmpty()) {
 		auto requestId = request(MTPmessages_GetMessages(MTP_vector<MTPint>(ids))).done([this](const MTPmessages_Messages &result, mtpRequestId requestId) {
 			gotMessageDatas(nullptr, result, requestId);
-		}).after(kSmallDelayMs).send();
+		}).canWait(kSmallDelayMs).send();
 		for (auto &request : _messageDataRequests) {
 			if (request.requestId > 0) continue;
 			request.requestId = requestId;
@@ -172,7 +179,7 @@ void ApiWrap::resolveMessageDatas() {
 		if (!ids.isEmpty()) {
 			auto requestId = request(MTPchannels_GetMessages(j.key()->inputChannel, MTP_vector<MTPint>(ids))).done([this, channel = j.key()](const MTPmessages_Messages &result, mtpRequestId requestId) {
 				gotMessageDatas(channel, result, requestId);
-			}).after(kSmallDelayMs).send();
+			}).canWait(kSmallDelayMs).send();
 
 			for (auto &request : *j) {
 				if (request.requestId > 0) continue;
@@ -230,7 +237,14 @@ void ApiWrap::gotMessageDatas(ChannelData *channel, const MTPmessages_Messages &
 }
 
 void ApiWrap::requestFullPeer(PeerData *peer) {
-	if (!peer || _fullPeerRequests.contains(peer)) return;
+	if (!peer) return;
+
+	auto &counters = lookupCounters(Lookup::FullPeer);
+	++counters.requested;
+	if (_fullPeerRequests.contains(peer)) {
+		++counters.deduplicated;
+		return;
+	}
 
 	auto sendRequest = [this, peer] {
 		auto failHandler = [this, peer](const RPCError &error) {
@@ -291,7 +305,7 @@ void ApiWrap::gotChatFull(PeerData *peer, const MTPmessages_ChatFull &result, mt
 				auto &b = item.c_botInfo();
 				if (auto user = App::userLoaded(b.vuser_id.v)) {
 					user->setBotInfo(item);
-					fullPeerUpdated().notify(user);
+					fullPeerUpdated().notifyCoalesced(user);
 				}
 			} break;
 			}
@@ -359,7 +373,7 @@ void ApiWrap::gotChatFull(PeerData *peer, const MTPmessages_ChatFull &result, mt
 				auto &b = item.c_botInfo();
 				if (auto user = App::userLoaded(b.vuser_id.v)) {
 					user->setBotInfo(item);
-					fullPeerUpdated().notify(user);
+					fullPeerUpdated().notifyCoalesced(user);
 				}
 			} break;
 			}
@@ -743,7 +757,7 @@ void ApiWrap::requestSelfParticipant(ChannelData *channel) {
 		if (error.type() == qstr("USER_NOT_PARTICIPANT")) {
 			channel->inviter = -1;
 		}
-	}).after(kSmallDelayMs).send();
+	}).canWait(kSmallDelayMs).send();
 
 	_selfParticipantRequests.insert(channel, requestId);
 }
@@ -792,8 +806,12 @@ void ApiWrap::unblockParticipant(PeerData *peer, UserData *user) {
 }
 
 void ApiWrap::scheduleStickerSetRequest(uint64 setId, uint64 access) {
+	auto &counters = lookupCounters(Lookup::StickerSet);
+	++counters.requested;
 	if (!_stickerSetRequests.contains(setId)) {
 		_stickerSetRequests.insert(setId, qMakePair(access, 0));
+	} else {
+		++counters.deduplicated;
 	}
 }
 
@@ -861,7 +879,7 @@ void ApiWrap::saveStickerSets(const Stickers::Order &localOrder, const Stickers:
 					stickerSetDisenabled(requestId);
 				}).fail([this](const RPCError &error, mtpRequestId requestId) {
 					stickerSetDisenabled(requestId);
-				}).after(kSmallDelayMs).send();
+				}).canWait(kSmallDelayMs).send();
 
 				_stickerSetDisenableRequests.insert(requestId);
 
@@ -898,7 +916,7 @@ void ApiWrap::saveStickerSets(const Stickers::Order &localOrder, const Stickers:
 					stickerSetDisenabled(requestId);
 				}).fail([this](const RPCError &error, mtpRequestId requestId) {
 					stickerSetDisenabled(requestId);
-				}).after(kSmallDelayMs).send();
+				}).canWait(kSmallDelayMs).send();
 
 				_stickerSetDisenableRequests.insert(requestId);
 
@@ -1276,8 +1294,18 @@ void ApiWrap::gotStickerSet(uint64 setId, const MTPmessages_StickerSet &result)
 
 void ApiWrap::requestWebPageDelayed(WebPageData *page) {
 	if (page->pendingTill <= 0) return;
-	_webPagesPending.insert(page, 0);
-	auto left = (page->pendingTill - unixtime()) * 1000;
+
+	auto &counters = lookupCounters(Lookup::WebPage);
+	++counters.requested;
+	auto i = _webPagesPending.constFind(page);
+	if (i != _webPagesPending.cend() && !i.value()) {
+		++counters.deduplicated;
+	} else {
+		_webPagesPending.insert(page, 0);
+	}
+
+	// The page may be resolved in one of the previous launches, apply it soon.
+	auto left = Local::hasWebPage(page->id) ? 0 : (page->pendingTill - unixtime()) * 1000;
 	if (!_webPagesTimer.isActive() || left <= _webPagesTimer.remainingTime()) {
 		_webPagesTimer.callOnce((left < 0 ? 0 : left) + 1);
 	}
@@ -1301,12 +1329,20 @@ void ApiWrap::resolveWebPages() {
 	using MessageIdsByChannel = QMap<ChannelData*, IndexAndMessageIds>;
 	MessageIdsByChannel idsByChannel; // temp_req_id = -index - 2
 
+	auto cached = QVector<MTPWebPage>();
 	auto &items = App::webPageItems();
 	ids.reserve(_webPagesPending.size());
 	int32 t = unixtime(), m = INT_MAX;
 	for (auto i = _webPagesPending.begin(); i != _webPagesPending.cend(); ++i) {
 		if (i.value() > 0) continue;
-		if (i.key()->pendingTill <= t) {
+		auto webpage = MTPWebPage();
+		if (Local::readWebPage(i.key()->id, &webpage)) {
+			cached.push_back(webpage);
+			continue;
+		}
+
+		// Pages of all peers due in the flush window are resolved together.
+		if (i.key()->pendingTill <= t + kWebPagesFlushWindow) {
 			auto j = items.constFind(i.key());
 			if (j != items.cend() && !j.value().isEmpty()) {
 				for_const (auto item, j.value()) {
@@ -1337,13 +1373,13 @@ void ApiWrap::resolveWebPages() {
 	if (!ids.isEmpty()) {
 		requestId = request(MTPmessages_GetMessages(MTP_vector<MTPint>(ids))).done([this](const MTPmessages_Messages &result, mtpRequestId requestId) {
 			gotWebPages(nullptr, result, requestId);
-		}).after(kSmallDelayMs).send();
+		}).canWait(kSmallDelayMs).send();
 	}
 	QVector<mtpRequestId> reqsByIndex(idsByChannel.size(), 0);
 	for (auto i = idsByChannel.cbegin(), e = idsByChannel.cend(); i != e; ++i) {
 		reqsByIndex[i.value().first] = request(MTPchannels_GetMessages(i.key()->inputChannel, MTP_vector<MTPint>(i.value().second))).done([this, channel = i.key()](const MTPmessages_Messages &result, mtpRequestId requestId) {
 			gotWebPages(channel, result, requestId);
-		}).after(kSmallDelayMs).send();
+		}).canWait(kSmallDelayMs).send();
 	}
 	if (requestId || !reqsByIndex.isEmpty()) {
 		for (auto &pendingRequestId : _webPagesPending) {
@@ -1361,6 +1397,12 @@ void ApiWrap::resolveWebPages() {
 	if (m < INT_MAX) {
 		_webPagesTimer.callOnce(m * 1000);
 	}
+
+	// Feeding removes the pages from _webPagesPending, so it is done last.
+	for_const (auto &webpage, cached) {
+		++lookupCounters(Lookup::WebPage).cached;
+		App::feedWebPage(webpage);
+	}
 }
 
 void ApiWrap::requestParticipantsCountDelayed(ChannelData *channel) {
@@ -1416,6 +1458,15 @@ void ApiWrap::gotWebPages(ChannelData *channel, const MTPmessages_Messages &msgs
 		}
 	}
 
+	for_const (auto &msg, *v) {
+		if (msg.type() == mtpc_message) {
+			auto &d = msg.c_message();
+			if (d.has_media() && d.vmedia.type() == mtpc_messageMediaWebPage) {
+				Local::writeWebPage(d.vmedia.c_messageMediaWebPage().vwebpage);
+			}
+		}
+	}
+
 	auto &items = App::webPageItems();
 	for (auto i = _webPagesPending.begin(); i != _webPagesPending.cend();) {
 		if (i.value() == req) {
@@ -1906,4 +1957,42 @@ void ApiWrap::sendSaveChatAdminsRequests(not_null<ChatData*> chat) {
 	requestSendDelayed();
 }
 
-ApiWrap::~ApiWrap() = default;
+void ApiWrap::countCachedLookup(Lookup lookup) {
+	auto &counters = lookupCounters(lookup);
+	++counters.requested;
+	++counters.cached;
+}
+
+ApiWrap::LookupCounters &ApiWrap::lookupCounters(Lookup lookup) {
+	Expects(lookup != Lookup::Count);
+	return _lookupCounters[static_cast<int>(lookup)];
+}
+
+void ApiWrap::logLookupCounters() const {
+	auto name = [](Lookup lookup) {
+		switch (lookup) {
+		case Lookup::FullPeer: return qsl("full peers");
+		case Lookup::MessageData: return qsl("message data");
+		case Lookup::StickerSet: return qsl("sticker sets");
+		case Lookup::WebPage: return qsl("web pages");
+		}
+		return QString();
+	};
+	for (auto i = 0; i != static_cast<int>(Lookup::Count); ++i) {
+		auto &counters = _lookupCounters[i];
+		if (!counters.requested) {
+			continue;
+		}
+		auto hits = counters.deduplicated + counters.cached;
+		DEBUG_LOG(("Api Lookups: %1 - %2 requested, %3 deduplicated, %4 cached, %5% hit rate."
+			).arg(name(static_cast<Lookup>(i))
+			).arg(counters.requested
+			).arg(counters.deduplicated
+			).arg(counters.cached
+			).arg((hits * 100) / counters.requested));
+	}
+}
+
+ApiWrap::~ApiWrap() {
+	logLookupCounters();
+}
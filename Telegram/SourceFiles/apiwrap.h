@@ -108,9 +108,26 @@ public:
 		bool adminsEnabled,
 		base::flat_set<not_null<UserData*>> &&admins);
 
+	// Keyed lookups that are deduplicated while in flight or answered
+	// from the recently received data, counted for the hit rates log.
+	enum class Lookup {
+		FullPeer,
+		MessageData,
+		StickerSet,
+		WebPage,
+
+		Count,
+	};
+	void countCachedLookup(Lookup lookup);
+
 	~ApiWrap();
 
 private:
+	struct LookupCounters {
+		int64 requested = 0;
+		int64 deduplicated = 0;
+		int64 cached = 0;
+	};
 	struct MessageDataRequest {
 		using Callbacks = QList<RequestMessageDataCallback>;
 		mtpRequestId requestId = 0;
@@ -149,6 +166,9 @@ private:
 	void requestFeaturedStickers(TimeId now);
 	void requestSavedGifs(TimeId now);
 
+	LookupCounters &lookupCounters(Lookup lookup);
+	void logLookupCounters() const;
+
 	void cancelEditChatAdmins(not_null<ChatData*> chat);
 	void saveChatAdmins(not_null<ChatData*> chat);
 	void sendSaveChatAdminsRequests(not_null<ChatData*> chat);
@@ -209,6 +229,8 @@ private:
 	base::flat_map<not_null<ChatData*>, base::flat_set<not_null<UserData*>>> _chatAdminsToSave;
 	base::flat_map<not_null<ChatData*>, base::flat_set<mtpRequestId>> _chatAdminsSaveRequests;
 
+	LookupCounters _lookupCounters[static_cast<int>(Lookup::Count)];
+
 	base::Observable<PeerData*> _fullPeerUpdated;
 
 };
@@ -30,7 +30,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "styles/style_history.h"
 #include "styles/style_boxes.h"
 #include "lang/lang_keys.h"
+#include "base/dense_id_map.h"
+#include "core/trace.h"
 #include "data/data_abstract_structure.h"
+#include "data/data_search_index.h"
 #include "history/history_service_layout.h"
 #include "history/history_location_manager.h"
 #include "history/history_media_types.h"
@@ -39,6 +42,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "messenger.h"
 #include "application.h"
 #include "storage/file_upload.h"
+#include "storage/file_download.h"
 #include "mainwindow.h"
 #include "mainwidget.h"
 #include "storage/localstorage.h"
@@ -49,13 +53,14 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "window/themes/window_theme.h"
 #include "window/notifications_manager.h"
 #include "platform/platform_notifications_manager.h"
+#include "ui/userpic_atlas.h"
 
 namespace {
 	App::LaunchState _launchState = App::Launched;
 
 	UserData *self = nullptr;
 
-	using PeersData = QHash<PeerId, PeerData*>;
+	using PeersData = base::flat_hash_map<PeerId, PeerData*>;
 	PeersData peersData;
 
 	using MutedPeers = QMap<PeerData*, bool>;
@@ -67,10 +72,10 @@ namespace {
 	using LocationsData = QHash<LocationCoords, LocationData*>;
 	LocationsData locationsData;
 
-	using WebPagesData = QHash<WebPageId, WebPageData*>;
+	using WebPagesData = base::flat_hash_map<WebPageId, WebPageData*>;
 	WebPagesData webPagesData;
 
-	using GamesData = QHash<GameId, GameData*>;
+	using GamesData = base::flat_hash_map<GameId, GameData*>;
 	GamesData gamesData;
 
 	PhotoItems photoItems;
@@ -86,9 +91,10 @@ namespace {
 
 	Histories histories;
 
-	using MsgsData = QHash<MsgId, HistoryItem*>;
+	// Message ids are mostly sequential, so they are kept in blocks.
+	using MsgsData = base::dense_id_map<MsgId, HistoryItem*>;
 	MsgsData msgsData;
-	using ChannelMsgsData = QMap<ChannelId, MsgsData>;
+	using ChannelMsgsData = base::flat_hash_map<ChannelId, MsgsData>;
 	ChannelMsgsData channelMsgsData;
 
 	using RandomData = QMap<uint64, FullMsgId>;
@@ -104,7 +110,13 @@ namespace {
 		*contextItem = nullptr,
 		*mousedItem = nullptr;
 
+	// The large emoji sheet is painted only in the emoji panel, suggestions
+	// and a few boxes, so it is loaded on the first use and is forgotten
+	// if nothing painted with it for a while.
+	constexpr auto kEmojiLargeUnusedTimeout = TimeMs(300 * 1000);
+
 	QPixmap *emoji = nullptr, *emojiLarge = nullptr;
+	TimeMs emojiLargeLastUsed = 0;
 	style::font monofont;
 
 	struct CornersPixmaps {
@@ -119,8 +131,6 @@ namespace {
 	EmojiImagesMap MainEmojiMap;
 	QMap<int, EmojiImagesMap> OtherEmojiMap;
 
-	int32 serviceImageCacheSize = 0;
-
 	using LastPhotosList = QLinkedList<PhotoData*>;
 	LastPhotosList lastPhotos;
 	using LastPhotosMap = QHash<PhotoData*, LastPhotosList::iterator>;
@@ -177,6 +187,12 @@ namespace App {
 	}
 
 namespace {
+	void prewarmMediaDc(MTP::DcId dcId) {
+		if (AuthSession::Exists()) {
+			Auth().downloader().prewarmDc(dcId);
+		}
+	}
+
 	bool loggedOut() {
 		if (Global::LocalPasscode()) {
 			Global::SetLocalPasscode(false);
@@ -1055,10 +1071,15 @@ namespace {
 			App::updateEditedMessage(m.c_message());
 		} else if (m.type() == mtpc_messageService) {
 			App::updateEditedMessage(m.c_messageService());
+		} else {
+			return;
 		}
+		Local::editHistoryMessage(peerFromMessage(m), m);
 	}
 
 	void addSavedGif(DocumentData *doc) {
+		Local::ensureStickersAndGifsRead();
+
 		SavedGifs &saved(cRefSavedGifs());
 		int32 index = saved.indexOf(doc);
 		if (index) {
@@ -1086,7 +1107,10 @@ namespace {
 	}
 
 	void feedMsgs(const QVector<MTPMessage> &msgs, NewMessageType type) {
-		QMap<uint64, int32> msgsIds;
+		TRACE_SCOPE("App::feedMsgs");
+		// Messages are added sorted by id, the sort key keeps the original order for equal ids.
+		auto msgsIds = std::vector<std::pair<uint64, int>>();
+		msgsIds.reserve(msgs.size());
 		for (int32 i = 0, l = msgs.size(); i < l; ++i) {
 			const auto &msg(msgs.at(i));
 			switch (msg.type()) {
@@ -1100,15 +1124,16 @@ namespace {
 					}
 				}
 				if (needToAdd) {
-					msgsIds.insert((uint64(uint32(d.vid.v)) << 32) | uint64(i), i);
+					msgsIds.push_back({ (uint64(uint32(d.vid.v)) << 32) | uint64(i), i });
 				}
 			} break;
-			case mtpc_messageEmpty: msgsIds.insert((uint64(uint32(msg.c_messageEmpty().vid.v)) << 32) | uint64(i), i); break;
-			case mtpc_messageService: msgsIds.insert((uint64(uint32(msg.c_messageService().vid.v)) << 32) | uint64(i), i); break;
+			case mtpc_messageEmpty: msgsIds.push_back({ (uint64(uint32(msg.c_messageEmpty().vid.v)) << 32) | uint64(i), i }); break;
+			case mtpc_messageService: msgsIds.push_back({ (uint64(uint32(msg.c_messageService().vid.v)) << 32) | uint64(i), i }); break;
 			}
 		}
-		for (QMap<uint64, int32>::const_iterator i = msgsIds.cbegin(), e = msgsIds.cend(); i != e; ++i) {
-			histories().addNewMessage(msgs.at(i.value()), type);
+		std::sort(msgsIds.begin(), msgsIds.end());
+		for (auto &msgId : msgsIds) {
+			histories().addNewMessage(msgs.at(msgId.second), type);
 		}
 	}
 
@@ -1184,15 +1209,15 @@ namespace {
 
 	inline MsgsData *fetchMsgsData(ChannelId channelId, bool insert = true) {
 		if (channelId == NoChannel) return &msgsData;
-		ChannelMsgsData::iterator i = channelMsgsData.find(channelId);
-		if (i == channelMsgsData.cend()) {
+		auto i = channelMsgsData.find(channelId);
+		if (i == channelMsgsData.end()) {
 			if (insert) {
-				i = channelMsgsData.insert(channelId, MsgsData());
+				i = channelMsgsData.emplace(channelId).first;
 			} else {
-				return 0;
+				return nullptr;
 			}
 		}
-		return &(*i);
+		return &i->second;
 	}
 
 	void feedWereDeleted(ChannelId channelId, const QVector<MTPint> &msgsIds) {
@@ -1203,10 +1228,9 @@ namespace {
 
 		QMap<History*, bool> historiesToCheck;
 		for (QVector<MTPint>::const_iterator i = msgsIds.cbegin(), e = msgsIds.cend(); i != e; ++i) {
-			MsgsData::const_iterator j = data->constFind(i->v);
-			if (j != data->cend()) {
-				History *h = (*j)->history();
-				(*j)->destroy();
+			if (auto item = data->value(i->v)) {
+				History *h = item->history();
+				item->destroy();
 				if (!h->lastMsg) historiesToCheck.insert(h, true);
 			} else {
 				if (channelHistory) {
@@ -1214,6 +1238,9 @@ namespace {
 						channelHistory->setUnreadCount(channelHistory->unreadCount() - 1);
 					}
 				}
+				if (channelId != NoChannel) {
+					Local::removeHistoryMessage(peerFromChannel(channelId), i->v);
+				}
 			}
 		}
 		if (main()) {
@@ -1370,6 +1397,12 @@ namespace {
 			}
 		}
 		if (thumb && medium && full) {
+			if (full->type() == mtpc_photoSize) {
+				auto &location = full->c_photoSize().vlocation;
+				if (location.type() == mtpc_fileLocation) {
+					prewarmMediaDc(location.c_fileLocation().vdc_id.v);
+				}
+			}
 			return App::photoSet(photo.vid.v, convert, photo.vaccess_hash.v, photo.vdate.v, App::image(*thumb), App::image(*medium), App::image(*full));
 		}
 		return App::photoSet(photo.vid.v, convert, 0, 0, ImagePtr(), ImagePtr(), ImagePtr());
@@ -1399,6 +1432,7 @@ namespace {
 	}
 
 	DocumentData *feedDocument(const MTPDdocument &document, DocumentData *convert) {
+		prewarmMediaDc(document.vdc_id.v);
 		return App::documentSet(document.vid.v, convert, document.vaccess_hash.v, document.vversion.v, document.vdate.v, document.vattributes.v, qs(document.vmime_type), App::image(document.vthumb), document.vdc_id.v, document.vsize.v, App::imageLocation(document.vthumb));
 	}
 
@@ -1442,7 +1476,7 @@ namespace {
 	PeerData *peer(const PeerId &id, PeerData::LoadedStatus restriction) {
 		if (!id) return nullptr;
 
-		auto i = peersData.constFind(id);
+		auto i = peersData.find(id);
 		if (i == peersData.cend()) {
 			PeerData *newData = nullptr;
 			if (peerIsUser(id)) {
@@ -1455,26 +1489,26 @@ namespace {
 			Assert(newData != nullptr);
 
 			newData->input = MTPinputPeer(MTP_inputPeerEmpty());
-			i = peersData.insert(id, newData);
+			i = peersData.emplace(id, newData).first;
 		}
 		switch (restriction) {
 		case PeerData::MinimalLoaded: {
-			if (i.value()->loadedStatus == PeerData::NotLoaded) {
+			if (i->second->loadedStatus == PeerData::NotLoaded) {
 				return nullptr;
 			}
 		} break;
 		case PeerData::FullLoaded: {
-			if (i.value()->loadedStatus != PeerData::FullLoaded) {
+			if (i->second->loadedStatus != PeerData::FullLoaded) {
 				return nullptr;
 			}
 		} break;
 		}
-		return i.value();
+		return i->second;
 	}
 
 	void enumerateUsers(base::lambda<void(UserData*)> action) {
-		for_const (auto peer, peersData) {
-			if (auto user = peer->asUser()) {
+		for (auto &entry : peersData) {
+			if (auto user = entry.second->asUser()) {
 				action(user);
 			}
 		}
@@ -1486,9 +1520,9 @@ namespace {
 
 	PeerData *peerByName(const QString &username) {
 		QString uname(username.trimmed());
-		for_const (PeerData *peer, peersData) {
-			if (!peer->userName().compare(uname, Qt::CaseInsensitive)) {
-				return peer;
+		for (auto &entry : peersData) {
+			if (!entry.second->userName().compare(uname, Qt::CaseInsensitive)) {
+				return entry.second;
 			}
 		}
 		return nullptr;
@@ -1507,18 +1541,18 @@ namespace {
 	}
 
 	PhotoData *photo(const PhotoId &photo) {
-		PhotosData::const_iterator i = ::photosData.constFind(photo);
+		PhotosData::const_iterator i = ::photosData.find(photo);
 		if (i == ::photosData.cend()) {
-			i = ::photosData.insert(photo, new PhotoData(photo));
+			i = ::photosData.emplace(photo, new PhotoData(photo)).first;
 		}
-		return i.value();
+		return i->second;
 	}
 
 	PhotoData *photoSet(const PhotoId &photo, PhotoData *convert, const uint64 &access, int32 date, const ImagePtr &thumb, const ImagePtr &medium, const ImagePtr &full) {
 		if (convert) {
 			if (convert->id != photo) {
 				PhotosData::iterator i = ::photosData.find(convert->id);
-				if (i != ::photosData.cend() && i.value() == convert) {
+				if (i != ::photosData.cend() && i->second == convert) {
 					::photosData.erase(i);
 				}
 				convert->id = photo;
@@ -1532,7 +1566,7 @@ namespace {
 				updateImage(convert->full, full);
 			}
 		}
-		PhotosData::const_iterator i = ::photosData.constFind(photo);
+		PhotosData::const_iterator i = ::photosData.find(photo);
 		PhotoData *result;
 		LastPhotosMap::iterator inLastIter = lastPhotosMap.end();
 		if (i == ::photosData.cend()) {
@@ -1541,9 +1575,9 @@ namespace {
 			} else {
 				result = new PhotoData(photo, access, date, thumb, medium, full);
 			}
-			::photosData.insert(photo, result);
+			::photosData.emplace(photo, result);
 		} else {
-			result = i.value();
+			result = i->second;
 			if (result != convert && date) {
 				result->access = access;
 				result->date = date;
@@ -1568,11 +1602,11 @@ namespace {
 	}
 
 	DocumentData *document(const DocumentId &document) {
-		DocumentsData::const_iterator i = ::documentsData.constFind(document);
+		DocumentsData::const_iterator i = ::documentsData.find(document);
 		if (i == ::documentsData.cend()) {
-			i = ::documentsData.insert(document, DocumentData::create(document));
+			i = ::documentsData.emplace(document, DocumentData::create(document)).first;
 		}
-		return i.value();
+		return i->second;
 	}
 
 	DocumentData *documentSet(const DocumentId &document, DocumentData *convert, const uint64 &access, int32 version, int32 date, const QVector<MTPDocumentAttribute> &attributes, const QString &mime, const ImagePtr &thumb, int32 dc, int32 size, const StorageImageLocation &thumbLocation) {
@@ -1583,7 +1617,7 @@ namespace {
 			bool idChanged = (convert->id != document);
 			if (idChanged) {
 				DocumentsData::iterator i = ::documentsData.find(convert->id);
-				if (i != ::documentsData.cend() && i.value() == convert) {
+				if (i != ::documentsData.cend() && i->second == convert) {
 					::documentsData.erase(i);
 				}
 
@@ -1595,6 +1629,9 @@ namespace {
 				convert->setattributes(attributes);
 				versionChanged = convert->setRemoteVersion(version);
 				convert->setRemoteLocation(dc, access);
+				if (idChanged && !convert->uploadContentHash.isEmpty()) {
+					Local::writeUploadedFile(base::take(convert->uploadContentHash), convert->name, document, access);
+				}
 				convert->date = date;
 				convert->mime = mime;
 				if (!thumb->isNull() && (convert->thumb->isNull() || convert->thumb->width() < thumb->width() || convert->thumb->height() < thumb->height() || versionChanged)) {
@@ -1620,7 +1657,7 @@ namespace {
 				Local::writeSavedGifs();
 			}
 		}
-		DocumentsData::const_iterator i = ::documentsData.constFind(document);
+		DocumentsData::const_iterator i = ::documentsData.find(document);
 		DocumentData *result;
 		if (i == ::documentsData.cend()) {
 			if (convert) {
@@ -1636,9 +1673,9 @@ namespace {
 					result->sticker()->loc = thumbLocation;
 				}
 			}
-			::documentsData.insert(document, result);
+			::documentsData.emplace(document, result);
 		} else {
-			result = i.value();
+			result = i->second;
 			if (result != convert && date) {
 				result->setattributes(attributes);
 				versionChanged = result->setRemoteVersion(version);
@@ -1690,18 +1727,18 @@ namespace {
 	}
 
 	WebPageData *webPage(const WebPageId &webPage) {
-		auto i = webPagesData.constFind(webPage);
+		auto i = webPagesData.find(webPage);
 		if (i == webPagesData.cend()) {
-			i = webPagesData.insert(webPage, new WebPageData(webPage));
+			i = webPagesData.emplace(webPage, new WebPageData(webPage)).first;
 		}
-		return i.value();
+		return i->second;
 	}
 
 	WebPageData *webPageSet(const WebPageId &webPage, WebPageData *convert, const QString &type, const QString &url, const QString &displayUrl, const QString &siteName, const QString &title, const TextWithEntities &description, PhotoData *photo, DocumentData *document, int32 duration, const QString &author, int32 pendingTill) {
 		if (convert) {
 			if (convert->id != webPage) {
 				auto i = webPagesData.find(convert->id);
-				if (i != webPagesData.cend() && i.value() == convert) {
+				if (i != webPagesData.cend() && i->second == convert) {
 					webPagesData.erase(i);
 				}
 				convert->id = webPage;
@@ -1724,7 +1761,7 @@ namespace {
 				if (App::main()) App::main()->webPageUpdated(convert);
 			}
 		}
-		auto i = webPagesData.constFind(webPage);
+		auto i = webPagesData.find(webPage);
 		WebPageData *result;
 		if (i == webPagesData.cend()) {
 			if (convert) {
@@ -1735,9 +1772,9 @@ namespace {
 					Auth().api().requestWebPageDelayed(result);
 				}
 			}
-			webPagesData.insert(webPage, result);
+			webPagesData.emplace(webPage, result);
 		} else {
-			result = i.value();
+			result = i->second;
 			if (result != convert) {
 				if ((result->url.isEmpty() && !url.isEmpty()) || (result->pendingTill && result->pendingTill != pendingTill && pendingTill >= -1)) {
 					result->type = toWebPageType(type);
@@ -1762,18 +1799,18 @@ namespace {
 	}
 
 	GameData *game(const GameId &game) {
-		auto i = gamesData.constFind(game);
+		auto i = gamesData.find(game);
 		if (i == gamesData.cend()) {
-			i = gamesData.insert(game, new GameData(game));
+			i = gamesData.emplace(game, new GameData(game)).first;
 		}
-		return i.value();
+		return i->second;
 	}
 
 	GameData *gameSet(const GameId &game, GameData *convert, const uint64 &accessHash, const QString &shortName, const QString &title, const QString &description, PhotoData *photo, DocumentData *document) {
 		if (convert) {
 			if (convert->id != game) {
 				auto i = gamesData.find(convert->id);
-				if (i != gamesData.cend() && i.value() == convert) {
+				if (i != gamesData.cend() && i->second == convert) {
 					gamesData.erase(i);
 				}
 				convert->id = game;
@@ -1789,7 +1826,7 @@ namespace {
 				if (App::main()) App::main()->gameUpdated(convert);
 			}
 		}
-		auto i = gamesData.constFind(game);
+		auto i = gamesData.find(game);
 		GameData *result;
 		if (i == gamesData.cend()) {
 			if (convert) {
@@ -1797,9 +1834,9 @@ namespace {
 			} else {
 				result = new GameData(game, accessHash, shortName, title, description, photo, document);
 			}
-			gamesData.insert(game, result);
+			gamesData.emplace(game, result);
 		} else {
-			result = i.value();
+			result = i->second;
 			if (result != convert) {
 				if (!result->accessHash && accessHash) {
 					result->accessHash = accessHash;
@@ -1826,11 +1863,11 @@ namespace {
 	void forgetMedia() {
 		lastPhotos.clear();
 		lastPhotosMap.clear();
-		for_const (auto photo, ::photosData) {
-			photo->forget();
+		for (auto &entry : ::photosData) {
+			entry.second->forget();
 		}
-		for_const (auto document, ::documentsData) {
-			document->forget();
+		for (auto &entry : ::documentsData) {
+			entry.second->forget();
 		}
 		for_const (auto location, ::locationsData) {
 			location->thumb->forget();
@@ -1876,22 +1913,16 @@ namespace {
 		auto data = fetchMsgsData(channelId, false);
 		if (!data) return nullptr;
 
-		auto i = data->constFind(itemId);
-		if (i != data->cend()) {
-			return i.value();
-		}
-		return nullptr;
+		return data->value(itemId);
 	}
 
 	void historyRegItem(HistoryItem *item) {
-		MsgsData *data = fetchMsgsData(item->channelId());
-		MsgsData::const_iterator i = data->constFind(item->id);
-		if (i == data->cend()) {
-			data->insert(item->id, item);
-		} else if (i.value() != item) {
+		auto data = fetchMsgsData(item->channelId());
+		auto registered = data->set(item->id, item);
+		if (registered && registered != item) {
 			LOG(("App Error: trying to historyRegItem() an already registered item"));
-			i.value()->destroy();
-			data->insert(item->id, item);
+			registered->destroy();
+			fetchMsgsData(item->channelId())->set(item->id, item);
 		}
 	}
 
@@ -1920,11 +1951,8 @@ namespace {
 		auto data = fetchMsgsData(item->channelId(), false);
 		if (!data) return;
 
-		auto i = data->find(item->id);
-		if (i != data->cend()) {
-			if (i.value() == item) {
-				data->erase(i);
-			}
+		if (data->value(item->id) == item) {
+			data->take(item->id);
 		}
 		historyItemDetached(item);
 		auto j = ::dependentItems.find(item);
@@ -1938,6 +1966,7 @@ namespace {
 			}
 		}
 		Auth().notifications().clearFromItem(item);
+		Auth().searchIndex().remove(item);
 		if (Global::started() && !App::quitting()) {
 			Global::RefItemRemoved().notify(item, true);
 		}
@@ -1959,17 +1988,14 @@ namespace {
 		::dependentItems.clear();
 
 		QVector<HistoryItem*> toDelete;
-		for_const (auto item, msgsData) {
+		auto collectDetached = [&toDelete](MsgId msgId, HistoryItem *item) {
 			if (item->detached()) {
 				toDelete.push_back(item);
 			}
-		}
+		};
+		msgsData.enumerate(collectDetached);
 		for_const (auto &chMsgsData, channelMsgsData) {
-			for_const (auto item, chMsgsData) {
-				if (item->detached()) {
-					toDelete.push_back(item);
-				}
-			}
+			chMsgsData.second.enumerate(collectDetached);
 		}
 		msgsData.clear();
 		channelMsgsData.clear();
@@ -1988,24 +2014,24 @@ namespace {
 		cSetSavedPeersByTime(SavedPeersByTime());
 		cSetRecentInlineBots(RecentInlineBots());
 
-		for_const (auto peer, ::peersData) {
-			delete peer;
+		for (auto &entry : ::peersData) {
+			delete entry.second;
 		}
 		::peersData.clear();
-		for_const (auto game, ::gamesData) {
-			delete game;
+		for (auto &entry : ::gamesData) {
+			delete entry.second;
 		}
 		::gamesData.clear();
-		for_const (auto webpage, ::webPagesData) {
-			delete webpage;
+		for (auto &entry : ::webPagesData) {
+			delete entry.second;
 		}
 		::webPagesData.clear();
-		for_const (auto photo, ::photosData) {
-			delete photo;
+		for (auto &entry : ::photosData) {
+			delete entry.second;
 		}
 		::photosData.clear();
-		for_const (auto document, ::documentsData) {
-			delete document;
+		for (auto &entry : ::documentsData) {
+			delete entry.second;
 		}
 		::documentsData.clear();
 
@@ -2205,10 +2231,6 @@ namespace {
 			::emoji = new QPixmap(Ui::Emoji::Filename(Ui::Emoji::Index()));
             if (cRetina()) ::emoji->setDevicePixelRatio(cRetinaFactor());
 		}
-		if (!::emojiLarge) {
-			::emojiLarge = new QPixmap(Ui::Emoji::Filename(Ui::Emoji::Index() + 1));
-			if (cRetina()) ::emojiLarge->setDevicePixelRatio(cRetinaFactor());
-		}
 
 		createCorners();
 
@@ -2245,9 +2267,8 @@ namespace {
 		histories().clear();
 
 		clearStorageImages();
+		Ui::ClearUserpicAtlases();
 		cSetServerBackgrounds(WallPapers());
-
-		serviceImageCacheSize = imageCacheSize();
 	}
 
 	void deinitMedia() {
@@ -2332,6 +2353,11 @@ namespace {
 	}
 
 	const QPixmap &emojiLarge() {
+		if (!::emojiLarge) {
+			::emojiLarge = new QPixmap(Ui::Emoji::Filename(Ui::Emoji::Index() + 1));
+			if (cRetina()) ::emojiLarge->setDevicePixelRatio(cRetinaFactor());
+		}
+		::emojiLargeLastUsed = getms(true);
 		return *::emojiLarge;
 	}
 
@@ -2352,10 +2378,20 @@ namespace {
 	}
 
 	void checkImageCacheSize() {
-		int64 nowImageCacheSize = imageCacheSize();
-		if (nowImageCacheSize > serviceImageCacheSize + MemoryForImageCache) {
-			App::forgetMedia();
-			serviceImageCacheSize = imageCacheSize();
+		if (::emojiLarge && ::emojiLargeLastUsed + kEmojiLargeUnusedTimeout <= getms(true)) {
+			DEBUG_LOG(("Emoji: forgetting the large emoji sheet."));
+			delete base::take(::emojiLarge);
+		}
+
+		auto was = Images::GetCacheCounters();
+		Images::CheckCacheSize();
+		auto now = Images::GetCacheCounters();
+		if (now.evicted != was.evicted || now.variantsEvicted != was.variantsEvicted) {
+			DEBUG_LOG(("Images: forgot %1 images and %2 variants, %3 bytes in images and %4 bytes in variants left."
+				).arg(now.evicted - was.evicted
+				).arg(now.variantsEvicted - was.variantsEvicted
+				).arg(now.imagesSize
+				).arg(now.variantsSize));
 		}
 	}
 
@@ -2375,6 +2411,7 @@ namespace {
 		}
 		if (auto mainwidget = main()) {
 			mainwidget->saveDraftToCloud();
+			mainwidget->writeDialogsSnapshot();
 		}
 		Messenger::QuitAttempt();
 	}
@@ -2407,6 +2444,7 @@ namespace {
 	}
 
 	QImage readImage(QByteArray data, QByteArray *format, bool opaque, bool *animated) {
+		TRACE_SCOPE("App::readImage");
         QByteArray tmpFormat;
 		QImage result;
 		QBuffer buffer(&data);
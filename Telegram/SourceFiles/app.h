@@ -24,6 +24,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "history/history.h"
 #include "history/history_item.h"
 #include "layout.h"
+#include "base/flat_hash_map.h"
 
 class Messenger;
 class MainWindow;
@@ -37,8 +38,8 @@ using GameItems = QHash<GameData*, HistoryItemsMap>;
 using SharedContactItems = QHash<int32, HistoryItemsMap>;
 using GifItems = QHash<Media::Clip::Reader*, HistoryItem*>;
 
-using PhotosData = QHash<PhotoId, PhotoData*>;
-using DocumentsData = QHash<DocumentId, DocumentData*>;
+using PhotosData = base::flat_hash_map<PhotoId, PhotoData*>;
+using DocumentsData = base::flat_hash_map<DocumentId, DocumentData*>;
 
 class LocationCoords;
 struct LocationData;
@@ -28,6 +28,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "window/notifications_manager.h"
 #include "messenger.h"
 #include "base/timer.h"
+#include "core/trace.h"
+#include "core/startup_timeline.h"
+#include "ui/frame_stats.h"
 
 namespace {
 
@@ -117,6 +120,18 @@ bool Application::event(QEvent *e) {
 	return QApplication::event(e);
 }
 
+bool Application::notify(QObject *receiver, QEvent *e) {
+	if (e->type() == QEvent::UpdateRequest) {
+		TRACE_SCOPE("Window paint");
+		Ui::FrameStats::FrameScope frame(receiver);
+		return QApplication::notify(receiver, e);
+	} else if (e->type() == QEvent::Paint) {
+		Ui::FrameStats::PaintScope paint(receiver, e);
+		return QApplication::notify(receiver, e);
+	}
+	return QApplication::notify(receiver, e);
+}
+
 void Application::socketConnected() {
 	LOG(("Socket connected, this is not the first application instance, sending show command..."));
 	_secondInstance = true;
@@ -313,6 +328,7 @@ void Application::startApplication() {
 
 void Application::createMessenger() {
 	Expects(!App::quitting());
+	StartupTimeline::Mark("Application and single instance check");
 	_messengerInstance = std::make_unique<Messenger>();
 }
 
@@ -377,7 +393,7 @@ void Application::updateGotCurrent() {
 		if (updates.exists()) {
 			QFileInfoList list = updates.entryInfoList(QDir::Files);
 			for (QFileInfoList::iterator i = list.begin(), e = list.end(); i != e; ++i) {
-                if (QRegularExpression("^(tupdate|tmacupd|tmac32upd|tlinuxupd|tlinux32upd)\\d+(_[a-z\\d]+)?$", QRegularExpression::CaseInsensitiveOption).match(i->fileName()).hasMatch()) {
+                if (QRegularExpression("^(tupdate|tmacupd|tmac32upd|tlinuxupd|tlinux32upd)\\d+(_[a-z\\d]+)*(\\.parts)?$", QRegularExpression::CaseInsensitiveOption).match(i->fileName()).hasMatch()) {
 					QFile(i->absoluteFilePath()).remove();
 				}
 			}
@@ -464,7 +480,7 @@ void Application::startUpdateCheck(bool forceWait) {
 		if (updates.exists()) {
 			QFileInfoList list = updates.entryInfoList(QDir::Files);
 			for (QFileInfoList::iterator i = list.begin(), e = list.end(); i != e; ++i) {
-				if (QRegularExpression("^(tupdate|tmacupd|tmac32upd|tlinuxupd|tlinux32upd)\\d+(_[a-z\\d]+)?$", QRegularExpression::CaseInsensitiveOption).match(i->fileName()).hasMatch()) {
+				if (QRegularExpression("^(tupdate|tmacupd|tmac32upd|tlinuxupd|tlinux32upd)\\d+(_[a-z\\d]+)*(\\.parts)?$", QRegularExpression::CaseInsensitiveOption).match(i->fileName()).hasMatch()) {
 					sendRequest = true;
 				}
 			}
@@ -28,6 +28,7 @@ public:
 	Application(int &argc, char **argv);
 
 	bool event(QEvent *e) override;
+	bool notify(QObject *receiver, QEvent *e) override;
 
 	void createMessenger();
 
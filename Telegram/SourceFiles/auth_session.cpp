@@ -31,6 +31,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "calls/calls_instance.h"
 #include "window/section_widget.h"
 #include "chat_helpers/tabbed_selector.h"
+#include "data/data_search_index.h"
 
 namespace {
 
@@ -174,7 +175,8 @@ AuthSession::AuthSession(UserId userId)
 , _calls(std::make_unique<Calls::Instance>())
 , _downloader(std::make_unique<Storage::Downloader>())
 , _uploader(std::make_unique<Storage::Uploader>())
-, _notifications(std::make_unique<Window::Notifications::System>(this)) {
+, _notifications(std::make_unique<Window::Notifications::System>(this))
+, _searchIndex(std::make_unique<Data::SearchIndex>()) {
 	Expects(_userId != 0);
 	_saveDataTimer.setCallback([this] {
 		Local::writeUserSettings();
@@ -42,6 +42,10 @@ namespace ChatHelpers {
 enum class SelectorTab;
 } // namespace ChatHelpers
 
+namespace Data {
+class SearchIndex;
+} // namespace Data
+
 class ApiWrap;
 
 class AuthSessionData final {
@@ -206,6 +210,10 @@ public:
 		return *_notifications;
 	}
 
+	Data::SearchIndex &searchIndex() {
+		return *_searchIndex;
+	}
+
 	AuthSessionData &data() {
 		return _data;
 	}
@@ -240,5 +248,6 @@ private:
 	const std::unique_ptr<Storage::Downloader> _downloader;
 	const std::unique_ptr<Storage::Uploader> _uploader;
 	const std::unique_ptr<Window::Notifications::System> _notifications;
+	const std::unique_ptr<Data::SearchIndex> _searchIndex;
 
 };
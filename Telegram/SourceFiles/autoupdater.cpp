@@ -45,8 +45,144 @@ typedef int VerInt;
 typedef wchar_t VerChar;
 #endif // Q_OS_WIN
 
-UpdateChecker::UpdateChecker(QThread *thread, const QString &url) : reply(0), already(0), full(0) {
-	updateUrl = url;
+namespace {
+
+constexpr auto kPartSize = 8 * UpdateChunk; // 800kb parts
+constexpr auto kPartsInParallel = 4;
+constexpr auto kPartRetries = 3;
+constexpr auto kMaxUpdateSize = 512 * 1024 * 1024;
+
+constexpr auto kSignatureSize = 128;
+constexpr auto kHashSize = 20;
+constexpr auto kHashedFrom = kSignatureSize + kHashSize;
+
+// Entries of a difference package, files not changed since the installed version are skipped.
+enum class DeltaEntry : quint8 {
+	Full = 0x00,
+	Patch = 0x01,
+};
+
+enum class PatchOp : quint8 {
+	Copy = 0x00, // quint32 offset, quint32 size in the installed file
+	Insert = 0x01, // QByteArray data
+};
+
+uint64 InstalledVersion() {
+	return cBetaVersion() ? cBetaVersion() : uint64(AppVersion);
+}
+
+QString PartsStatePath(const QString &outputPath) {
+	return outputPath + qsl(".parts");
+}
+
+bool VerifySignature(const char *signature, const char *hash, const char *key) {
+	auto pbKey = PEM_read_bio_RSAPublicKey(BIO_new_mem_buf(const_cast<char*>(key), -1), 0, 0, 0);
+	if (!pbKey) {
+		LOG(("Update Error: cant read public rsa key!"));
+		return false;
+	}
+	auto result = (RSA_verify(NID_sha1, (const uchar*)hash, kHashSize, (const uchar*)signature, kSignatureSize, pbKey) == 1);
+	RSA_free(pbKey);
+	return result;
+}
+
+bool VerifyUpdateSignature(const char *signature, const char *hash) {
+	if (VerifySignature(signature, hash, AppAlphaVersion ? UpdatesPublicAlphaKey : UpdatesPublicKey)) {
+		return true;
+	}
+	if (cAlphaVersion() || cBetaVersion()) { // try other public key, if we are in alpha or beta version
+		if (VerifySignature(signature, hash, AppAlphaVersion ? UpdatesPublicKey : UpdatesPublicAlphaKey)) {
+			return true;
+		}
+	}
+	LOG(("Update Error: bad RSA signature of update file!"));
+	return false;
+}
+
+bool ApplyPatch(const QByteArray &base, const QByteArray &patch, QByteArray &result) {
+	QDataStream stream(patch);
+	stream.setVersion(QDataStream::Qt_5_1);
+	while (!stream.atEnd()) {
+		quint8 op = 0;
+		stream >> op;
+		if (op == quint8(PatchOp::Copy)) {
+			quint32 offset = 0, size = 0;
+			stream >> offset >> size;
+			if (stream.status() != QDataStream::Ok || offset > quint32(base.size()) || size > quint32(base.size()) - offset) {
+				return false;
+			}
+			result.append(base.constData() + offset, size);
+		} else if (op == quint8(PatchOp::Insert)) {
+			QByteArray data;
+			stream >> data;
+			if (stream.status() != QDataStream::Ok) {
+				return false;
+			}
+			result.append(data);
+		} else {
+			return false;
+		}
+	}
+	return (stream.status() == QDataStream::Ok);
+}
+
+bool ReadDeltaFile(QDataStream &stream, const QString &relativeName, QByteArray &data) {
+	quint8 entry = 0;
+	stream >> entry;
+	if (entry == quint8(DeltaEntry::Full)) {
+		quint32 fileSize = 0;
+		stream >> fileSize >> data;
+		if (stream.status() != QDataStream::Ok || fileSize != quint32(data.size())) {
+			LOG(("Update Error: bad full entry for '%1' in the update difference").arg(relativeName));
+			return false;
+		}
+		return true;
+	} else if (entry != quint8(DeltaEntry::Patch)) {
+		LOG(("Update Error: bad entry type %1 for '%2' in the update difference").arg(entry).arg(relativeName));
+		return false;
+	}
+
+	QByteArray baseHash, resultHash, patch;
+	quint32 fileSize = 0;
+	stream >> baseHash >> resultHash >> fileSize >> patch;
+	if (stream.status() != QDataStream::Ok || baseHash.size() != kHashSize || resultHash.size() != kHashSize) {
+		LOG(("Update Error: bad patch entry for '%1' in the update difference").arg(relativeName));
+		return false;
+	}
+
+	QFile installed(cExeDir() + relativeName);
+	if (!installed.open(QIODevice::ReadOnly)) {
+		LOG(("Update Error: cant read installed file '%1'").arg(installed.fileName()));
+		return false;
+	}
+	auto base = installed.readAll();
+	installed.close();
+
+	auto hash = hashSha1(base.constData(), base.size());
+	if (memcmp(hash.data(), baseHash.constData(), kHashSize)) {
+		LOG(("Update Error: installed file '%1' differs from the update difference base").arg(installed.fileName()));
+		return false;
+	}
+	data.reserve(fileSize);
+	if (!ApplyPatch(base, patch, data) || quint32(data.size()) != fileSize) {
+		LOG(("Update Error: could not apply the patch for '%1'").arg(relativeName));
+		return false;
+	}
+	hash = hashSha1(data.constData(), data.size());
+	if (memcmp(hash.data(), resultHash.constData(), kHashSize)) {
+		LOG(("Update Error: bad SHA1 hash of the patched file '%1'").arg(relativeName));
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+UpdateChecker::UpdateChecker(QThread *thread, const QString &url) : fullUrl(url) {
+	// Try the difference from the installed version first, the full package is the fallback.
+	updateUrl = url + qsl("_d%1").arg(InstalledVersion());
+	delta = true;
+
 	moveToThread(thread);
 	manager.moveToThread(thread);
 	App::setProxySettings(manager);
@@ -66,13 +202,13 @@ void UpdateChecker::initOutput() {
 	}
 	QString dirStr = cWorkingDir() + qsl("tupdates/");
 	fileName = dirStr + fileName;
-	QFileInfo file(fileName);
+	QFileInfo file(fileName), state(PartsStatePath(fileName));
 
 	QDir dir(dirStr);
 	if (dir.exists()) {
 		QFileInfoList all = dir.entryInfoList(QDir::Files);
 		for (QFileInfoList::iterator i = all.begin(), e = all.end(); i != e; ++i) {
-			if (i->absoluteFilePath() != file.absoluteFilePath()) {
+			if (i->absoluteFilePath() != file.absoluteFilePath() && i->absoluteFilePath() != state.absoluteFilePath()) {
 				QFile::remove(i->absoluteFilePath());
 			}
 		}
@@ -80,140 +216,367 @@ void UpdateChecker::initOutput() {
 		dir.mkdir(dir.absolutePath());
 	}
 	outputFile.setFileName(fileName);
-	if (file.exists()) {
-		uint64 fullSize = file.size();
-		if (fullSize < INT_MAX) {
-			int32 goodSize = (int32)fullSize;
-			if (goodSize % UpdateChunk) {
-				goodSize = goodSize - (goodSize % UpdateChunk);
-				if (goodSize) {
-					if (outputFile.open(QIODevice::ReadOnly)) {
-						QByteArray goodData = outputFile.readAll().mid(0, goodSize);
-						outputFile.close();
-						if (outputFile.open(QIODevice::WriteOnly)) {
-							outputFile.write(goodData);
-							outputFile.close();
-
-							QMutexLocker lock(&mutex);
-							already = goodSize;
-						}
-					}
-				}
-			} else {
+	readPartsState();
+}
+
+void UpdateChecker::readPartsState() {
+	{
+		QMutexLocker lock(&mutex);
+		already = full = 0;
+	}
+	partSizeValue = 0;
+	partReceived.clear();
+	partFinishedFlags.clear();
+	partRetries = QVector<int>(1, 0);
+	SHA1_Init(&sha1);
+	hashedParts = 0;
+	headerHash = QByteArray();
+	headerChecked = hashChecked = false;
+
+	auto fileName = outputFile.fileName();
+	QFile state(PartsStatePath(fileName));
+	if (QFileInfo(fileName).exists() && state.open(QIODevice::ReadOnly)) {
+		QDataStream stream(&state);
+		stream.setVersion(QDataStream::Qt_5_1);
+
+		qint32 fullSize = 0, partSize = 0;
+		QVector<bool> finished;
+		stream >> fullSize >> partSize >> finished;
+		state.close();
+
+		auto count = (partSize > 0) ? ((fullSize + partSize - 1) / partSize) : 0;
+		if (stream.status() == QDataStream::Ok
+			&& fullSize > 0
+			&& fullSize <= kMaxUpdateSize
+			&& finished.size() == count
+			&& QFileInfo(fileName).size() == fullSize) {
+			{
 				QMutexLocker lock(&mutex);
-				already = goodSize;
+				full = fullSize;
 			}
+			partSizeValue = partSize;
+			partFinishedFlags = finished;
 		}
-		if (!already) {
-			QFile::remove(fileName);
+	}
+	if (!full) {
+		QFile::remove(fileName);
+		QFile::remove(PartsStatePath(fileName));
+		return;
+	}
+
+	auto count = partsCount();
+	auto received = 0;
+	partReceived = QVector<int32>(count, 0);
+	partRetries = QVector<int>(count, 0);
+	for (auto i = 0; i != count; ++i) {
+		if (partFinishedFlags[i]) {
+			partReceived[i] = partSize(i);
+			received += partReceived[i];
 		}
 	}
+	QMutexLocker lock(&mutex);
+	already = received;
+}
+
+void UpdateChecker::writePartsState() {
+	QFile state(PartsStatePath(outputFile.fileName()));
+	if (!state.open(QIODevice::WriteOnly)) {
+		LOG(("Update Error: could not write the download state to '%1'").arg(state.fileName()));
+		return;
+	}
+	QDataStream stream(&state);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream << qint32(full) << qint32(partSizeValue) << partFinishedFlags;
+}
+
+int UpdateChecker::partsCount() const {
+	return partSizeValue ? ((full + partSizeValue - 1) / partSizeValue) : 0;
+}
+
+int32 UpdateChecker::partStart(int index) const {
+	return index * partSizeValue;
+}
+
+int32 UpdateChecker::partSize(int index) const {
+	return qMin(partSizeValue, full - partStart(index));
 }
 
 void UpdateChecker::start() {
-	sendRequest();
+	if (!full) {
+		// The first part response tells us the full update size.
+		sendPartRequest(0);
+		return;
+	}
+	if (!outputFile.open(QIODevice::ReadWrite)) {
+		LOG(("Update Error: Could not open output file '%1' for writing").arg(outputFile.fileName()));
+		return fatalFail();
+	}
+	if (hashReadyParts()) {
+		Sandbox::updateProgress(ready(), size());
+		sendRequests();
+	}
 }
 
-void UpdateChecker::sendRequest() {
+void UpdateChecker::sendRequests() {
+	auto inFlight = [this](int index) {
+		for (auto &reply : replies) {
+			if (reply.second == index) {
+				return true;
+			}
+		}
+		return false;
+	};
+	for (auto i = 0, count = partsCount(); i != count && int(replies.size()) < kPartsInParallel; ++i) {
+		if (!partFinishedFlags[i] && !inFlight(i)) {
+			sendPartRequest(i);
+		}
+	}
+	if (replies.empty()) {
+		downloadFinished();
+	}
+}
+
+void UpdateChecker::sendPartRequest(int index) {
+	auto from = full ? partStart(index) : 0;
+	auto till = full ? (from + partSize(index) - 1) : (kPartSize - 1);
+	if (full && partReceived[index]) {
+		QMutexLocker lock(&mutex);
+		already -= base::take(partReceived[index]);
+	}
+
 	QNetworkRequest req(updateUrl);
-	QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(already) + "-";
+	QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(from) + "-" + QByteArray::number(till);
 	req.setRawHeader("Range", rangeHeaderValue);
 	req.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
-	if (reply) reply->deleteLater();
-	reply = manager.get(req);
-	connect(reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(partFinished(qint64,qint64)));
-	connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(partFailed(QNetworkReply::NetworkError)));
-	connect(reply, SIGNAL(metaDataChanged()), this, SLOT(partMetaGot()));
-}
-
-void UpdateChecker::partMetaGot() {
-	typedef QList<QNetworkReply::RawHeaderPair> Pairs;
-	Pairs pairs = reply->rawHeaderPairs();
-	for (Pairs::iterator i = pairs.begin(), e = pairs.end(); i != e; ++i) {
-		if (QString::fromUtf8(i->first).toLower() == "content-range") {
-			QRegularExpressionMatch m = QRegularExpression(qsl("/(\\d+)([^\\d]|$)")).match(QString::fromUtf8(i->second));
-			if (m.hasMatch()) {
-				{
-					QMutexLocker lock(&mutex);
-					full = m.captured(1).toInt();
-				}
+	auto reply = manager.get(req);
+	replies.emplace(reply, index);
+	connect(reply, SIGNAL(readyRead()), this, SLOT(partDataReady()));
+	connect(reply, SIGNAL(finished()), this, SLOT(partFinished()));
+}
 
-				Sandbox::updateProgress(already, full);
-			}
+bool UpdateChecker::initParts(QNetworkReply *reply, int status) {
+	auto total = 0;
+	if (status == 206) {
+		QRegularExpressionMatch m = QRegularExpression(qsl("/(\\d+)([^\\d]|$)")).match(QString::fromUtf8(reply->rawHeader("Content-Range")));
+		if (m.hasMatch()) {
+			total = m.captured(1).toInt();
 		}
+	} else { // the server ignored the range, the whole file is coming
+		total = reply->header(QNetworkRequest::ContentLengthHeader).toInt();
 	}
-}
+	if (total <= kHashedFrom || total > kMaxUpdateSize) {
+		LOG(("Update Error: bad update size received: %1").arg(total));
+		return false;
+	}
+	{
+		QMutexLocker lock(&mutex);
+		full = total;
+		already = 0;
+	}
+	partSizeValue = (status == 206) ? kPartSize : total;
 
-int32 UpdateChecker::ready() {
-	QMutexLocker lock(&mutex);
-	return already;
+	auto count = partsCount();
+	partReceived = QVector<int32>(count, 0);
+	partFinishedFlags = QVector<bool>(count, false);
+	partRetries.resize(count);
+	if (!outputFile.open(QIODevice::ReadWrite | QIODevice::Truncate) || !outputFile.resize(total)) {
+		LOG(("Update Error: Could not open output file '%1' for writing").arg(outputFile.fileName()));
+		return false;
+	}
+	writePartsState();
+	sendRequests();
+	return true;
 }
 
-int32 UpdateChecker::size() {
+bool UpdateChecker::receivePartData(QNetworkReply *reply, int index) {
+	QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+	if (!statusCode.isValid()) {
+		return true;
+	}
+	auto status = statusCode.toInt();
+	if (status != 200 && status != 206) {
+		LOG(("Update Error: Bad HTTP status received for part %1: %2").arg(index).arg(status));
+		return false;
+	}
+	if (!full && !initParts(reply, status)) {
+		return false;
+	}
+	if (status == 200 && partsCount() > 1) {
+		LOG(("Update Error: the server ignored the range request for part %1").arg(index));
+		return false;
+	}
+
+	auto data = reply->readAll();
+	if (data.isEmpty()) {
+		return true;
+	}
+	auto received = partReceived[index];
+	if (received + data.size() > partSize(index)) {
+		LOG(("Update Error: too much data received for part %1").arg(index));
+		return false;
+	}
+	if (!outputFile.seek(partStart(index) + received) || outputFile.write(data) != data.size()) {
+		LOG(("Update Error: Could not write to output file '%1'").arg(outputFile.fileName()));
+		return false;
+	}
+	partReceived[index] += data.size();
+
 	QMutexLocker lock(&mutex);
-	return full;
+	already += data.size();
+	return true;
 }
 
-void UpdateChecker::partFinished(qint64 got, qint64 total) {
-	if (!reply) return;
+void UpdateChecker::partDataReady() {
+	auto reply = qobject_cast<QNetworkReply*>(sender());
+	auto i = replies.find(reply);
+	if (i == replies.end()) return;
 
-	QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
-	if (statusCode.isValid()) {
-		int status = statusCode.toInt();
-		if (status != 200 && status != 206 && status != 416) {
-			LOG(("Update Error: Bad HTTP status received in partFinished(): %1").arg(status));
-			return fatalFail();
-		}
+	if (receivePartData(reply, i->second)) {
+		Sandbox::updateProgress(ready(), size());
+	} else {
+		reply->abort();
 	}
+}
 
-	if (!already && !full) {
-		QMutexLocker lock(&mutex);
-		full = total;
+void UpdateChecker::partFinished() {
+	auto reply = qobject_cast<QNetworkReply*>(sender());
+	auto i = replies.find(reply);
+	if (i == replies.end()) return;
+
+	auto index = i->second;
+	replies.erase(i);
+	reply->deleteLater();
+
+	if (reply->error() == QNetworkReply::NoError
+		&& receivePartData(reply, index)
+		&& full
+		&& partReceived[index] == partSize(index)) {
+		partDone(index);
+	} else {
+		partError(index, reply);
 	}
-	DEBUG_LOG(("Update Info: part %1 of %2").arg(got).arg(total));
+}
 
-	if (!outputFile.isOpen()) {
-		if (!outputFile.open(QIODevice::Append)) {
-			LOG(("Update Error: Could not open output file '%1' for appending").arg(outputFile.fileName()));
-			return fatalFail();
-		}
+void UpdateChecker::partDone(int index) {
+	DEBUG_LOG(("Update Info: part %1 of %2 done").arg(index + 1).arg(partsCount()));
+	partFinishedFlags[index] = true;
+	writePartsState();
+	if (hashReadyParts()) {
+		sendRequests();
 	}
-	QByteArray r = reply->readAll();
-	if (!r.isEmpty()) {
-		outputFile.write(r);
+}
 
-		QMutexLocker lock(&mutex);
-		already += r.size();
+void UpdateChecker::partError(int index, QNetworkReply *reply) {
+	QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+	auto status = statusCode.isValid() ? statusCode.toInt() : 0;
+	LOG(("Update Error: failed to download part %1, error %2, status %3").arg(index).arg(reply->error()).arg(status));
+
+	auto permanent = (status >= 400 && status < 500);
+	if (!permanent && ++partRetries[index] <= kPartRetries) {
+		sendPartRequest(index);
+		return;
 	}
-	if (got >= total) {
-		reply->deleteLater();
-		reply = 0;
-		outputFile.close();
-		unpackUpdate();
-	} else {
-		Sandbox::updateProgress(already, full);
+	if (delta) {
+		return fallbackToFull();
 	}
+	clearReplies();
+	outputFile.close();
+	Sandbox::updateFailed();
 }
 
-void UpdateChecker::partFailed(QNetworkReply::NetworkError e) {
-	if (!reply) return;
+void UpdateChecker::clearReplies() {
+	for (auto &reply : base::take(replies)) {
+		reply.first->disconnect(this);
+		reply.first->abort();
+		reply.first->deleteLater();
+	}
+}
 
-	QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
-	reply->deleteLater();
-	reply = 0;
-	if (statusCode.isValid()) {
-		int status = statusCode.toInt();
-		if (status == 416) { // Requested range not satisfiable
-			outputFile.close();
-			unpackUpdate();
-			return;
+bool UpdateChecker::checkHeader() {
+	if (!outputFile.seek(0)) {
+		LOG(("Update Error: cant read updates file!"));
+		return false;
+	}
+	auto header = outputFile.read(kHashedFrom);
+	if (header.size() != kHashedFrom) {
+		LOG(("Update Error: cant read the update header!"));
+		return false;
+	}
+	if (!VerifyUpdateSignature(header.constData(), header.constData() + kSignatureSize)) {
+		return false;
+	}
+	headerHash = header.mid(kSignatureSize, kHashSize);
+	headerChecked = true;
+	return true;
+}
+
+bool UpdateChecker::hashReadyParts() {
+	if (!headerChecked) {
+		if (!partFinishedFlags[0]) {
+			return true;
+		} else if (!checkHeader()) {
+			fatalFail();
+			return false;
 		}
 	}
-	LOG(("Update Error: failed to download part starting from %1, error %2").arg(already).arg(e));
-	Sandbox::updateFailed();
+	auto count = partsCount();
+	while (hashedParts < count && partFinishedFlags[hashedParts]) {
+		auto from = partStart(hashedParts) + (hashedParts ? 0 : kHashedFrom);
+		auto size = partStart(hashedParts) + partSize(hashedParts) - from;
+		auto data = outputFile.seek(from) ? outputFile.read(size) : QByteArray();
+		if (data.size() != size) {
+			LOG(("Update Error: cant read part %1 from the updates file!").arg(hashedParts));
+			fatalFail();
+			return false;
+		}
+		SHA1_Update(&sha1, data.constData(), data.size());
+		++hashedParts;
+	}
+	if (hashedParts == count && !hashChecked) {
+		uchar sha1Buffer[kHashSize];
+		SHA1_Final(sha1Buffer, &sha1);
+		if (memcmp(sha1Buffer, headerHash.constData(), kHashSize)) {
+			LOG(("Update Error: bad SHA1 hash of update file!"));
+			fatalFail();
+			return false;
+		}
+		hashChecked = true;
+	}
+	return true;
+}
+
+void UpdateChecker::downloadFinished() {
+	outputFile.close();
+	unpackUpdate();
+}
+
+int32 UpdateChecker::ready() {
+	QMutexLocker lock(&mutex);
+	return already;
+}
+
+int32 UpdateChecker::size() {
+	QMutexLocker lock(&mutex);
+	return full;
+}
+
+void UpdateChecker::fallbackToFull() {
+	LOG(("Update Info: could not use the update difference, downloading the full package."));
+	clearReplies();
+	outputFile.close();
+	delta = false;
+	updateUrl = fullUrl;
+	initOutput();
+	Sandbox::updateProgress(ready(), size());
+	start();
 }
 
 void UpdateChecker::fatalFail() {
+	if (delta) {
+		return fallbackToFull();
+	}
+	clearReplies();
+	outputFile.close();
 	clearAll();
 	Sandbox::updateFailed();
 }
@@ -267,37 +630,17 @@ void UpdateChecker::unpackUpdate() {
 		return fatalFail();
 	}
 
-	uchar sha1Buffer[20];
-	bool goodSha1 = !memcmp(compressed.constData() + hSigLen, hashSha1(compressed.constData() + hSigLen + hShaLen, compressedLen + hPropsLen + hOriginalSizeLen, sha1Buffer), hShaLen);
-	if (!goodSha1) {
-		LOG(("Update Error: bad SHA1 hash of update file!"));
-		return fatalFail();
-	}
-
-	RSA *pbKey = PEM_read_bio_RSAPublicKey(BIO_new_mem_buf(const_cast<char*>(AppAlphaVersion ? UpdatesPublicAlphaKey : UpdatesPublicKey), -1), 0, 0, 0);
-	if (!pbKey) {
-		LOG(("Update Error: cant read public rsa key!"));
-		return fatalFail();
-	}
-	if (RSA_verify(NID_sha1, (const uchar*)(compressed.constData() + hSigLen), hShaLen, (const uchar*)(compressed.constData()), hSigLen, pbKey) != 1) { // verify signature
-		RSA_free(pbKey);
-		if (cAlphaVersion() || cBetaVersion()) { // try other public key, if we are in alpha or beta version
-			pbKey = PEM_read_bio_RSAPublicKey(BIO_new_mem_buf(const_cast<char*>(AppAlphaVersion ? UpdatesPublicKey : UpdatesPublicAlphaKey), -1), 0, 0, 0);
-			if (!pbKey) {
-				LOG(("Update Error: cant read public rsa key!"));
-				return fatalFail();
-			}
-			if (RSA_verify(NID_sha1, (const uchar*)(compressed.constData() + hSigLen), hShaLen, (const uchar*)(compressed.constData()), hSigLen, pbKey) != 1) { // verify signature
-				RSA_free(pbKey);
-				LOG(("Update Error: bad RSA signature of update file!"));
-				return fatalFail();
-			}
-		} else {
-			LOG(("Update Error: bad RSA signature of update file!"));
+	if (!hashChecked) { // otherwise it was checked while downloading
+		uchar sha1Buffer[20];
+		bool goodSha1 = !memcmp(compressed.constData() + hSigLen, hashSha1(compressed.constData() + hSigLen + hShaLen, compressedLen + hPropsLen + hOriginalSizeLen, sha1Buffer), hShaLen);
+		if (!goodSha1) {
+			LOG(("Update Error: bad SHA1 hash of update file!"));
+			return fatalFail();
+		}
+		if (!VerifyUpdateSignature(compressed.constData(), compressed.constData() + hSigLen)) {
 			return fatalFail();
 		}
 	}
-	RSA_free(pbKey);
 
 	QByteArray uncompressed;
 
@@ -387,6 +730,15 @@ void UpdateChecker::unpackUpdate() {
 			return fatalFail();
 		}
 
+		if (delta) {
+			quint64 baseVersion = 0;
+			stream >> baseVersion;
+			if (stream.status() != QDataStream::Ok || baseVersion != InstalledVersion()) {
+				LOG(("Update Error: update difference base version %1 does not match mine %2").arg(baseVersion).arg(InstalledVersion()));
+				return fatalFail();
+			}
+		}
+
 		quint32 filesCount;
 		stream >> filesCount;
 		if (stream.status() != QDataStream::Ok) {
@@ -403,7 +755,15 @@ void UpdateChecker::unpackUpdate() {
 			QByteArray fileInnerData;
 			bool executable = false;
 
-			stream >> relativeName >> fileSize >> fileInnerData;
+			stream >> relativeName;
+			if (delta) {
+				if (!ReadDeltaFile(stream, relativeName, fileInnerData)) {
+					return fatalFail();
+				}
+				fileSize = fileInnerData.size();
+			} else {
+				stream >> fileSize >> fileInnerData;
+			}
 #if defined Q_OS_MAC || defined Q_OS_LINUX
 			stream >> executable;
 #endif // Q_OS_MAC || Q_OS_LINUX
@@ -475,13 +835,13 @@ void UpdateChecker::unpackUpdate() {
 		return fatalFail();
 	}
 	outputFile.remove();
+	QFile::remove(PartsStatePath(outputFile.fileName()));
 
 	Sandbox::updateReady();
 }
 
 UpdateChecker::~UpdateChecker() {
-	delete reply;
-	reply = 0;
+	clearReplies();
 }
 
 bool checkReadyUpdate() {
@@ -25,6 +25,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include <QtNetwork/QLocalSocket>
 #include <QtNetwork/QLocalServer>
 #include <QtNetwork/QNetworkReply>
+#include <openssl/sha.h>
 
 class UpdateChecker : public QObject {
 	Q_OBJECT
@@ -44,22 +45,56 @@ public:
 public slots:
 
 	void start();
-	void partMetaGot();
-	void partFinished(qint64 got, qint64 total);
-	void partFailed(QNetworkReply::NetworkError e);
-	void sendRequest();
+	void partDataReady();
+	void partFinished();
 
 private:
+	// The update is downloaded in parts, several parts at once.
+	// Finished parts are remembered in a state file near the output file,
+	// so an interrupted download continues from the missing parts only.
 	void initOutput();
-
+	void readPartsState();
+	void writePartsState();
+	int partsCount() const;
+	int32 partStart(int index) const;
+	int32 partSize(int index) const;
+
+	void sendRequests();
+	void sendPartRequest(int index);
+	bool initParts(QNetworkReply *reply, int status);
+	bool receivePartData(QNetworkReply *reply, int index);
+	void partDone(int index);
+	void partError(int index, QNetworkReply *reply);
+	void clearReplies();
+
+	// The header signature is checked as soon as the first part is here,
+	// the content hash is counted while the following parts arrive.
+	bool checkHeader();
+	bool hashReadyParts();
+	void downloadFinished();
+
+	void fallbackToFull();
 	void fatalFail();
 
 	QString updateUrl;
+	QString fullUrl;
+	bool delta = false;
 	QNetworkAccessManager manager;
-	QNetworkReply *reply;
-	int32 already, full;
+	std::map<QNetworkReply*, int> replies;
+	QVector<int32> partReceived;
+	QVector<bool> partFinishedFlags;
+	QVector<int> partRetries;
+	int32 partSizeValue = 0;
+	int32 already = 0;
+	int32 full = 0;
 	QFile outputFile;
 
+	SHA_CTX sha1;
+	int hashedParts = 0;
+	QByteArray headerHash;
+	bool headerChecked = false;
+	bool hashChecked = false;
+
 	QMutex mutex;
 
 };
@@ -20,6 +20,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #pragma once
 
+#include <algorithm>
+#include <iterator>
+
 namespace base {
 
 template <typename Range, typename Method>
@@ -37,4 +40,36 @@ decltype(auto) for_each_apply(Method &&method) {
 	};
 }
 
+// Same results as std::lower_bound / std::upper_bound for random access
+// iterators. The comparison result only moves the range start, so the
+// compiler emits a conditional move instead of a hard to predict branch.
+// It is faster for cheap to compare values like integers or pointers.
+template <typename Iterator, typename Value, typename Compare>
+Iterator branchless_lower_bound(Iterator first, Iterator last, const Value &value, Compare compare) {
+	auto length = last - first;
+	if (length <= 0) {
+		return first;
+	}
+	while (length > 1) {
+		const auto half = length / 2;
+		first += compare(first[half], value) ? half : 0;
+		length -= half;
+	}
+	return first + (compare(*first, value) ? 1 : 0);
+}
+
+template <typename Iterator, typename Value, typename Compare>
+Iterator branchless_upper_bound(Iterator first, Iterator last, const Value &value, Compare compare) {
+	auto length = last - first;
+	if (length <= 0) {
+		return first;
+	}
+	while (length > 1) {
+		const auto half = length / 2;
+		first += compare(value, first[half]) ? 0 : half;
+		length -= half;
+	}
+	return first + (compare(value, *first) ? 0 : 1);
+}
+
 } // namespace base
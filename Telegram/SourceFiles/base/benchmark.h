@@ -0,0 +1,102 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+namespace base {
+namespace benchmark {
+
+// All the times are in microseconds.
+struct Result {
+	std::string name;
+	int iterations = 0;
+	double min = 0.;
+	double median = 0.;
+	double p90 = 0.;
+	double p99 = 0.;
+	double max = 0.;
+	double mean = 0.;
+};
+
+// Nearest rank percentile of the sorted values, fraction is in [0, 1].
+inline double Percentile(const std::vector<double> &sorted, double fraction) {
+	if (sorted.empty()) {
+		return 0.;
+	}
+	const auto count = int(sorted.size());
+	const auto rank = int(fraction * count + 0.999999);
+	return sorted[std::min(std::max(rank, 1), count) - 1];
+}
+
+inline Result Summarize(const std::string &name, std::vector<double> times) {
+	auto result = Result();
+	result.name = name;
+	result.iterations = int(times.size());
+	if (times.empty()) {
+		return result;
+	}
+	std::sort(times.begin(), times.end());
+	result.min = times.front();
+	result.median = Percentile(times, 0.5);
+	result.p90 = Percentile(times, 0.9);
+	result.p99 = Percentile(times, 0.99);
+	result.max = times.back();
+	auto sum = 0.;
+	for (const auto time : times) {
+		sum += time;
+	}
+	result.mean = sum / times.size();
+	return result;
+}
+
+// Keeps the compiler from throwing away the computed value.
+template <typename Type>
+inline void keep(const Type &value) {
+	static volatile const void *sink = nullptr;
+	sink = &value;
+}
+
+// Calls method() "warmup" times without measuring and
+// then measures each of the next "iterations" calls.
+template <typename Method>
+Result Measure(const std::string &name, int warmup, int iterations, Method &&method) {
+	using namespace std::chrono;
+	for (auto i = 0; i != warmup; ++i) {
+		method();
+	}
+	auto times = std::vector<double>();
+	times.reserve(iterations);
+	for (auto i = 0; i != iterations; ++i) {
+		const auto start = steady_clock::now();
+		method();
+		const auto finish = steady_clock::now();
+		times.push_back(duration<double, std::micro>(finish - start).count());
+	}
+	return Summarize(name, std::move(times));
+}
+
+} // namespace benchmark
+} // namespace base
@@ -0,0 +1,62 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/benchmark.h"
+
+TEST_CASE("benchmark percentiles use the nearest rank", "[benchmark]") {
+	auto times = std::vector<double>();
+	for (auto i = 100; i != 0; --i) {
+		times.push_back(i);
+	}
+	auto result = base::benchmark::Summarize("test", times);
+	REQUIRE(result.iterations == 100);
+	REQUIRE(result.min == 1.);
+	REQUIRE(result.median == 50.);
+	REQUIRE(result.p90 == 90.);
+	REQUIRE(result.p99 == 99.);
+	REQUIRE(result.max == 100.);
+	REQUIRE(result.mean == 50.5);
+
+	SECTION("single value is every percentile") {
+		result = base::benchmark::Summarize("single", { 7. });
+		REQUIRE(result.min == 7.);
+		REQUIRE(result.median == 7.);
+		REQUIRE(result.p99 == 7.);
+	}
+
+	SECTION("no values give an empty result") {
+		result = base::benchmark::Summarize("empty", {});
+		REQUIRE(result.iterations == 0);
+		REQUIRE(result.median == 0.);
+	}
+}
+
+TEST_CASE("benchmark measures every iteration after warmup", "[benchmark]") {
+	auto calls = 0;
+	auto result = base::benchmark::Measure("calls", 3, 10, [&] {
+		++calls;
+	});
+	REQUIRE(calls == 13);
+	REQUIRE(result.iterations == 10);
+	REQUIRE(result.min <= result.median);
+	REQUIRE(result.median <= result.max);
+}
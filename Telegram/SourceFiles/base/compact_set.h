@@ -0,0 +1,399 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <cstdint>
+
+namespace base {
+
+template <typename Type>
+class compact_set;
+
+// Ordered set of 32 bit integers, compressed the same way roaring bitmaps are.
+//
+// The values are grouped by their high 16 bits into chunks, sorted by those
+// high bits. A chunk keeps the low 16 bits of its values in a sorted array of
+// uint16 while it has few of them and in a 65536 bit bitmap when the array
+// would take more space than that. So each value takes at most two bytes and
+// close values (like message ids of one chat) share the chunk overhead.
+//
+// Values are read through const iterators only, they are bidirectional.
+// Any insert or remove invalidates all the iterators.
+template <typename Type>
+class compact_set_iterator {
+public:
+	using iterator_category = std::bidirectional_iterator_tag;
+	using value_type = Type;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const Type*;
+	using reference = Type;
+
+	compact_set_iterator() = default;
+
+	Type operator*() const {
+		return _set->valueAt(_chunk, _position);
+	}
+	compact_set_iterator &operator++() {
+		_set->moveNext(_chunk, _position);
+		return *this;
+	}
+	compact_set_iterator operator++(int) {
+		auto result = *this;
+		++*this;
+		return result;
+	}
+	compact_set_iterator &operator--() {
+		_set->movePrevious(_chunk, _position);
+		return *this;
+	}
+	compact_set_iterator operator--(int) {
+		auto result = *this;
+		--*this;
+		return result;
+	}
+	bool operator==(const compact_set_iterator &other) const {
+		return (_chunk == other._chunk) && (_position == other._position);
+	}
+	bool operator!=(const compact_set_iterator &other) const {
+		return !(*this == other);
+	}
+
+private:
+	compact_set_iterator(const compact_set<Type> *set, int chunk, int position)
+	: _set(set)
+	, _chunk(chunk)
+	, _position(position) {
+	}
+
+	const compact_set<Type> *_set = nullptr;
+	int _chunk = 0;
+	int _position = 0; // Index in the array or bit number in the bitmap.
+
+	friend class compact_set<Type>;
+
+};
+
+template <typename Type>
+class compact_set {
+	static_assert(std::is_integral<Type>::value && sizeof(Type) == 4, "compact_set supports only 32 bit integers.");
+
+	using key_type = std::uint32_t;
+	using word_type = std::uint64_t;
+
+	static constexpr auto kChunkBits = 16;
+	static constexpr auto kWordBits = 64;
+	static constexpr auto kBitmapWords = (1 << kChunkBits) / kWordBits;
+
+	// A bitmap takes kBitmapWords * 8 bytes, an array value takes 2 bytes.
+	static constexpr auto kArrayLimit = kBitmapWords * 4;
+
+	struct chunk {
+		std::uint16_t high = 0;
+		int count = 0;
+		std::vector<std::uint16_t> values; // if count <= kArrayLimit
+		std::vector<word_type> bits; // if count > kArrayLimit
+	};
+
+public:
+	using value_type = Type;
+	using size_type = int;
+	using iterator = compact_set_iterator<Type>;
+	using const_iterator = compact_set_iterator<Type>;
+
+	compact_set() = default;
+	compact_set(const compact_set &other) = default;
+	compact_set(compact_set &&other) = default;
+	compact_set &operator=(const compact_set &other) = default;
+	compact_set &operator=(compact_set &&other) = default;
+
+	size_type size() const {
+		return _size;
+	}
+	bool empty() const {
+		return !_size;
+	}
+	void clear() {
+		_chunks.clear();
+		_size = 0;
+	}
+
+	const_iterator begin() const {
+		return firstIn(0);
+	}
+	const_iterator end() const {
+		return const_iterator(this, int(_chunks.size()), 0);
+	}
+	const_iterator cbegin() const {
+		return begin();
+	}
+	const_iterator cend() const {
+		return end();
+	}
+
+	// Both require a non-empty set.
+	Type front() const {
+		return *begin();
+	}
+	Type back() const {
+		return *--end();
+	}
+
+	// Returns true if the value was inserted (was not in the set before).
+	bool insert(Type value) {
+		auto key = encode(value);
+		auto i = findChunk(high(key));
+		if (i == _chunks.end() || i->high != high(key)) {
+			i = _chunks.insert(i, chunk());
+			i->high = high(key);
+		}
+		if (!insertToChunk(*i, low(key))) {
+			return false;
+		}
+		++_size;
+		return true;
+	}
+
+	// Returns true if the value was removed (was in the set before).
+	bool remove(Type value) {
+		auto key = encode(value);
+		auto i = findChunk(high(key));
+		if (i == _chunks.end() || i->high != high(key) || !removeFromChunk(*i, low(key))) {
+			return false;
+		}
+		if (!i->count) {
+			_chunks.erase(i);
+		}
+		--_size;
+		return true;
+	}
+
+	bool contains(Type value) const {
+		auto key = encode(value);
+		auto i = findChunk(high(key));
+		if (i == _chunks.end() || i->high != high(key)) {
+			return false;
+		} else if (!i->bits.empty()) {
+			return testBit(i->bits, low(key));
+		}
+		return std::binary_search(i->values.begin(), i->values.end(), low(key));
+	}
+
+	// The first value that is not less than the passed one.
+	const_iterator lower_bound(Type value) const {
+		auto key = encode(value);
+		auto i = findChunk(high(key));
+		auto index = int(i - _chunks.begin());
+		if (i == _chunks.end() || i->high != high(key)) {
+			return firstIn(index);
+		} else if (!i->bits.empty()) {
+			auto position = nextBit(i->bits, low(key));
+			return (position < 0) ? firstIn(index + 1) : const_iterator(this, index, position);
+		}
+		auto j = std::lower_bound(i->values.begin(), i->values.end(), low(key));
+		return (j == i->values.end())
+			? firstIn(index + 1)
+			: const_iterator(this, index, int(j - i->values.begin()));
+	}
+
+private:
+	static key_type encode(Type value) {
+		// Keep the order of signed values.
+		return std::is_signed<Type>::value
+			? (key_type(value) ^ 0x80000000U)
+			: key_type(value);
+	}
+	static Type decode(key_type key) {
+		return std::is_signed<Type>::value
+			? Type(key ^ 0x80000000U)
+			: Type(key);
+	}
+	static std::uint16_t high(key_type key) {
+		return std::uint16_t(key >> kChunkBits);
+	}
+	static std::uint16_t low(key_type key) {
+		return std::uint16_t(key & 0xFFFFU);
+	}
+
+	static bool testBit(const std::vector<word_type> &bits, int bit) {
+		return (bits[bit / kWordBits] >> (bit % kWordBits)) & 1;
+	}
+
+	// The first set bit not less than "from" or -1.
+	static int nextBit(const std::vector<word_type> &bits, int from) {
+		if (from >= (1 << kChunkBits)) {
+			return -1;
+		}
+		for (auto word = from / kWordBits; word != kBitmapWords; ++word) {
+			auto shift = (word == from / kWordBits) ? (from % kWordBits) : 0;
+			auto value = bits[word] >> shift;
+			if (value) {
+				while (!(value & 1)) {
+					value >>= 1;
+					++shift;
+				}
+				return word * kWordBits + shift;
+			}
+		}
+		return -1;
+	}
+
+	// The last set bit not greater than "from" or -1.
+	static int previousBit(const std::vector<word_type> &bits, int from) {
+		if (from < 0) {
+			return -1;
+		}
+		for (auto word = from / kWordBits; word >= 0; --word) {
+			auto shift = (word == from / kWordBits) ? (kWordBits - 1 - from % kWordBits) : 0;
+			auto value = bits[word] << shift;
+			if (value) {
+				auto bit = kWordBits - 1 - shift;
+				while (!(value & (word_type(1) << (kWordBits - 1)))) {
+					value <<= 1;
+					--bit;
+				}
+				return word * kWordBits + bit;
+			}
+		}
+		return -1;
+	}
+
+	typename std::vector<chunk>::iterator findChunk(std::uint16_t high) {
+		return std::lower_bound(_chunks.begin(), _chunks.end(), high, [](const chunk &a, std::uint16_t b) {
+			return a.high < b;
+		});
+	}
+	typename std::vector<chunk>::const_iterator findChunk(std::uint16_t high) const {
+		return std::lower_bound(_chunks.begin(), _chunks.end(), high, [](const chunk &a, std::uint16_t b) {
+			return a.high < b;
+		});
+	}
+
+	static bool insertToChunk(chunk &to, std::uint16_t low) {
+		if (!to.bits.empty()) {
+			auto &word = to.bits[low / kWordBits];
+			auto mask = word_type(1) << (low % kWordBits);
+			if (word & mask) {
+				return false;
+			}
+			word |= mask;
+			++to.count;
+			return true;
+		}
+		auto i = std::lower_bound(to.values.begin(), to.values.end(), low);
+		if (i != to.values.end() && *i == low) {
+			return false;
+		}
+		to.values.insert(i, low);
+		if (++to.count > kArrayLimit) {
+			to.bits.assign(kBitmapWords, 0);
+			for (auto value : to.values) {
+				to.bits[value / kWordBits] |= word_type(1) << (value % kWordBits);
+			}
+			to.values = std::vector<std::uint16_t>();
+		}
+		return true;
+	}
+
+	static bool removeFromChunk(chunk &from, std::uint16_t low) {
+		if (!from.bits.empty()) {
+			auto &word = from.bits[low / kWordBits];
+			auto mask = word_type(1) << (low % kWordBits);
+			if (!(word & mask)) {
+				return false;
+			}
+			word &= ~mask;
+			if (--from.count <= kArrayLimit / 2) {
+				// Keep some distance from kArrayLimit so that inserting and
+				// removing one value near the limit won't convert it each time.
+				from.values.reserve(from.count);
+				for (auto bit = nextBit(from.bits, 0); bit >= 0; bit = nextBit(from.bits, bit + 1)) {
+					from.values.push_back(std::uint16_t(bit));
+				}
+				from.bits = std::vector<word_type>();
+			}
+			return true;
+		}
+		auto i = std::lower_bound(from.values.begin(), from.values.end(), low);
+		if (i == from.values.end() || *i != low) {
+			return false;
+		}
+		from.values.erase(i);
+		--from.count;
+		return true;
+	}
+
+	// The first value in the chunk with the passed index or in the next ones.
+	const_iterator firstIn(int index) const {
+		if (index >= int(_chunks.size())) {
+			return end();
+		}
+		auto &bits = _chunks[index].bits;
+		return const_iterator(this, index, bits.empty() ? 0 : nextBit(bits, 0));
+	}
+	const_iterator lastIn(int index) const {
+		auto &from = _chunks[index];
+		return const_iterator(this, index, from.bits.empty()
+			? (from.count - 1)
+			: previousBit(from.bits, (1 << kChunkBits) - 1));
+	}
+
+	Type valueAt(int index, int position) const {
+		auto &from = _chunks[index];
+		auto low = from.bits.empty() ? from.values[position] : position;
+		return decode((key_type(from.high) << kChunkBits) | key_type(low));
+	}
+	void moveNext(int &index, int &position) const {
+		auto &from = _chunks[index];
+		auto next = from.bits.empty()
+			? ((position + 1 < from.count) ? (position + 1) : -1)
+			: nextBit(from.bits, position + 1);
+		auto result = (next < 0) ? firstIn(index + 1) : const_iterator(this, index, next);
+		index = result._chunk;
+		position = result._position;
+	}
+	void movePrevious(int &index, int &position) const {
+		auto previous = (index == int(_chunks.size()))
+			? -1
+			: _chunks[index].bits.empty()
+			? (position - 1)
+			: previousBit(_chunks[index].bits, position - 1);
+		if (previous < 0) {
+			auto result = lastIn(index - 1);
+			index = result._chunk;
+			position = result._position;
+		} else {
+			position = previous;
+		}
+	}
+
+	std::vector<chunk> _chunks;
+	size_type _size = 0;
+
+	friend class compact_set_iterator<Type>;
+
+};
+
+} // namespace base
@@ -0,0 +1,106 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/compact_set.h"
+#include <set>
+#include <vector>
+#include <random>
+
+using namespace std;
+
+TEST_CASE("compact_sets should keep items sorted", "[compact_set]") {
+	base::compact_set<int32_t> v;
+	REQUIRE(v.empty());
+	REQUIRE(v.begin() == v.end());
+
+	v.insert(0);
+	v.insert(5);
+	v.insert(-4);
+	v.insert(200000);
+	v.insert(2);
+
+	REQUIRE(v.size() == 5);
+	REQUIRE(!v.insert(5));
+	REQUIRE(v.size() == 5);
+	REQUIRE(v.front() == -4);
+	REQUIRE(v.back() == 200000);
+	REQUIRE(v.contains(2));
+	REQUIRE(!v.contains(3));
+
+	auto values = vector<int32_t>(v.begin(), v.end());
+	REQUIRE(values == vector<int32_t>({ -4, 0, 2, 5, 200000 }));
+
+	SECTION("iterating backwards") {
+		auto reversed = vector<int32_t>();
+		for (auto i = v.end(); i != v.begin();) {
+			reversed.push_back(*--i);
+		}
+		REQUIRE(reversed == vector<int32_t>({ 200000, 5, 2, 0, -4 }));
+	}
+	SECTION("removing items") {
+		REQUIRE(v.remove(0));
+		REQUIRE(!v.remove(0));
+		REQUIRE(v.remove(200000));
+		REQUIRE(v.size() == 3);
+		REQUIRE(v.back() == 5);
+		REQUIRE(vector<int32_t>(v.begin(), v.end()) == vector<int32_t>({ -4, 2, 5 }));
+	}
+	SECTION("lower bound") {
+		REQUIRE(*v.lower_bound(-10) == -4);
+		REQUIRE(*v.lower_bound(3) == 5);
+		REQUIRE(*v.lower_bound(5) == 5);
+		REQUIRE(*v.lower_bound(6) == 200000);
+		REQUIRE(v.lower_bound(200001) == v.end());
+	}
+}
+
+TEST_CASE("compact_sets should work like std::set with many items", "[compact_set]") {
+	base::compact_set<int32_t> v;
+	set<int32_t> check;
+
+	// Dense enough to switch some chunks to bitmaps.
+	auto engine = mt19937(42);
+	auto values = uniform_int_distribution<int32_t>(-30000, 300000);
+	for (auto i = 0; i != 100000; ++i) {
+		auto value = values(engine);
+		REQUIRE(v.insert(value) == check.insert(value).second);
+	}
+	REQUIRE(v.size() == int(check.size()));
+	REQUIRE(vector<int32_t>(v.begin(), v.end()) == vector<int32_t>(check.begin(), check.end()));
+	REQUIRE(vector<int32_t>(v.lower_bound(1000), v.end()) == vector<int32_t>(check.lower_bound(1000), check.end()));
+
+	auto reversed = vector<int32_t>();
+	for (auto i = v.end(); i != v.begin();) {
+		reversed.push_back(*--i);
+	}
+	REQUIRE(reversed == vector<int32_t>(check.rbegin(), check.rend()));
+
+	for (auto i = 0; i != 100000; ++i) {
+		auto value = values(engine);
+		REQUIRE(v.remove(value) == (check.erase(value) > 0));
+	}
+	REQUIRE(v.size() == int(check.size()));
+	REQUIRE(vector<int32_t>(v.begin(), v.end()) == vector<int32_t>(check.begin(), check.end()));
+	for (auto value : check) {
+		REQUIRE(v.contains(value));
+	}
+}
@@ -0,0 +1,236 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <type_traits>
+#include "base/flat_hash_map.h"
+
+namespace base {
+
+// Map from integer ids to pointers for ids that are allocated mostly
+// sequentially, like message ids in one channel.
+//
+// The ids are grouped in blocks of kBlockSize consecutive ids, each block
+// is a plain array of pointers and the blocks are kept in a vector covering
+// a continuous range of block numbers. An id that would make that vector
+// too sparse goes to a hash map instead. Null pointer values are not stored.
+template <typename Key, typename Type>
+class dense_id_map {
+	static_assert(std::is_integral<Key>::value, "dense_id_map keys must be integral.");
+	static_assert(std::is_pointer<Type>::value, "dense_id_map values must be pointers.");
+
+public:
+	static constexpr auto kBlockShift = 8;
+	static constexpr auto kBlockSize = (1 << kBlockShift);
+
+	size_t size() const {
+		return _size;
+	}
+	bool empty() const {
+		return !_size;
+	}
+
+	// Returns nullptr if there is no value for that id.
+	Type value(Key key) const {
+		if (auto block = findBlock(blockNumber(key))) {
+			if (auto result = block->values[blockIndex(key)]) {
+				return result;
+			}
+		}
+		if (_sparse.empty()) {
+			return nullptr;
+		}
+		auto i = _sparse.find(key);
+		return (i == _sparse.end()) ? nullptr : i->second;
+	}
+
+	// Returns the replaced value or nullptr if there was none.
+	Type set(Key key, Type value) {
+		if (!value) {
+			return take(key);
+		}
+		auto number = blockNumber(key);
+		if (auto block = findBlock(number)) {
+			auto &cell = block->values[blockIndex(key)];
+			if (auto result = cell) {
+				cell = value;
+				return result;
+			}
+			auto result = takeSparse(key);
+			cell = value;
+			++block->count;
+			if (!result) {
+				++_size;
+			}
+			return result;
+		} else if (auto block = createBlock(number)) {
+			auto result = takeSparse(key);
+			block->values[blockIndex(key)] = value;
+			++block->count;
+			if (!result) {
+				++_size;
+			}
+			return result;
+		}
+		auto i = _sparse.find(key);
+		if (i != _sparse.end()) {
+			auto result = i->second;
+			i->second = value;
+			return result;
+		}
+		_sparse.emplace(key, value);
+		++_size;
+		return nullptr;
+	}
+
+	// Returns the removed value or nullptr if there was none.
+	Type take(Key key) {
+		auto number = blockNumber(key);
+		if (auto block = findBlock(number)) {
+			auto &cell = block->values[blockIndex(key)];
+			if (auto result = cell) {
+				cell = nullptr;
+				--_size;
+				if (!--block->count) {
+					removeBlock(number);
+				}
+				return result;
+			}
+		}
+		if (auto result = takeSparse(key)) {
+			--_size;
+			return result;
+		}
+		return nullptr;
+	}
+
+	void clear() {
+		_blocks.clear();
+		_blocksCount = 0;
+		_firstBlock = 0;
+		_sparse.clear();
+		_size = 0;
+	}
+
+	// Callback is called as callback(Key key, Type value).
+	template <typename Callback>
+	void enumerate(Callback callback) const {
+		for (auto i = size_t(0), count = _blocks.size(); i != count; ++i) {
+			if (auto &block = _blocks[i]) {
+				auto first = (_firstBlock + int64_t(i)) * kBlockSize;
+				for (auto j = 0; j != kBlockSize; ++j) {
+					if (auto value = block->values[j]) {
+						callback(Key(first + j), value);
+					}
+				}
+			}
+		}
+		for (auto &entry : _sparse) {
+			callback(entry.first, entry.second);
+		}
+	}
+
+private:
+	// Blocks are added to the vector while it has at most kMaxHoleFactor
+	// block pointers for each existing block (or at most kMinRangeBlocks).
+	static constexpr auto kMaxHoleFactor = 4;
+	static constexpr auto kMinRangeBlocks = 64;
+
+	struct Block {
+		std::array<Type, kBlockSize> values = {};
+		int count = 0;
+	};
+
+	static int64_t blockNumber(Key key) {
+		return (int64_t(key) >> kBlockShift);
+	}
+	static int blockIndex(Key key) {
+		return int(int64_t(key) & (kBlockSize - 1));
+	}
+
+	Block *findBlock(int64_t number) const {
+		auto index = number - _firstBlock;
+		if (index < 0 || index >= int64_t(_blocks.size())) {
+			return nullptr;
+		}
+		return _blocks[size_t(index)].get();
+	}
+
+	Block *createBlock(int64_t number) {
+		if (_blocks.empty()) {
+			_firstBlock = number;
+			_blocks.push_back(std::make_unique<Block>());
+			++_blocksCount;
+			return _blocks.back().get();
+		}
+		auto from = std::min(_firstBlock, number);
+		auto till = std::max(_firstBlock + int64_t(_blocks.size()), number + 1);
+		auto range = till - from;
+		if (range > kMinRangeBlocks && range > kMaxHoleFactor * int64_t(_blocksCount + 1)) {
+			return nullptr;
+		}
+		if (from < _firstBlock) {
+			auto blocks = std::vector<std::unique_ptr<Block>>(size_t(range));
+			std::move(_blocks.begin(), _blocks.end(), blocks.begin() + size_t(_firstBlock - from));
+			_blocks = std::move(blocks);
+			_firstBlock = from;
+		} else if (till > _firstBlock + int64_t(_blocks.size())) {
+			_blocks.resize(size_t(range));
+		}
+		auto &result = _blocks[size_t(number - _firstBlock)];
+		result = std::make_unique<Block>();
+		++_blocksCount;
+		return result.get();
+	}
+
+	void removeBlock(int64_t number) {
+		_blocks[size_t(number - _firstBlock)] = nullptr;
+		if (!--_blocksCount) {
+			_blocks.clear();
+			_firstBlock = 0;
+		}
+	}
+
+	Type takeSparse(Key key) {
+		if (_sparse.empty()) {
+			return nullptr;
+		}
+		auto i = _sparse.find(key);
+		if (i == _sparse.end()) {
+			return nullptr;
+		}
+		auto result = i->second;
+		_sparse.erase(i);
+		return result;
+	}
+
+	std::vector<std::unique_ptr<Block>> _blocks;
+	int64_t _firstBlock = 0;
+	size_t _blocksCount = 0;
+	flat_hash_map<Key, Type> _sparse;
+	size_t _size = 0;
+
+};
+
+} // namespace base
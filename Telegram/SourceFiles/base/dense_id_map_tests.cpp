@@ -0,0 +1,117 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/dense_id_map.h"
+#include <map>
+
+using namespace std;
+
+TEST_CASE("dense_id_maps should find inserted items", "[dense_id_map]") {
+	int values[4] = { 0 };
+	base::dense_id_map<int32_t, int*> v;
+	REQUIRE(v.set(1000000, &values[0]) == nullptr);
+	REQUIRE(v.set(1000001, &values[1]) == nullptr);
+	REQUIRE(v.set(5, &values[2]) == nullptr);
+	REQUIRE(v.set(-2000000000, &values[3]) == nullptr);
+
+	REQUIRE(v.size() == 4);
+	REQUIRE(v.value(1000000) == &values[0]);
+	REQUIRE(v.value(1000001) == &values[1]);
+	REQUIRE(v.value(5) == &values[2]);
+	REQUIRE(v.value(-2000000000) == &values[3]);
+	REQUIRE(v.value(1000002) == nullptr);
+	REQUIRE(v.value(6) == nullptr);
+
+	SECTION("setting existing key returns the old value") {
+		REQUIRE(v.set(5, &values[0]) == &values[2]);
+		REQUIRE(v.value(5) == &values[0]);
+		REQUIRE(v.size() == 4);
+	}
+
+	SECTION("taking items keeps the other ones") {
+		REQUIRE(v.take(1000000) == &values[0]);
+		REQUIRE(v.take(1000000) == nullptr);
+		REQUIRE(v.take(-2000000000) == &values[3]);
+		REQUIRE(v.size() == 2);
+		REQUIRE(v.value(1000000) == nullptr);
+		REQUIRE(v.value(1000001) == &values[1]);
+		REQUIRE(v.value(5) == &values[2]);
+	}
+
+	SECTION("enumerating visits all items") {
+		auto found = map<int32_t, int*>();
+		v.enumerate([&found](int32_t key, int *value) {
+			found.emplace(key, value);
+		});
+		REQUIRE(found.size() == 4);
+		REQUIRE(found[1000000] == &values[0]);
+		REQUIRE(found[-2000000000] == &values[3]);
+	}
+
+	SECTION("clearing and inserting again") {
+		v.clear();
+		REQUIRE(v.empty());
+		REQUIRE(v.value(5) == nullptr);
+		REQUIRE(v.set(7, &values[1]) == nullptr);
+		REQUIRE(v.size() == 1);
+		REQUIRE(v.value(7) == &values[1]);
+	}
+}
+
+TEST_CASE("dense_id_maps should match std::map on mixed ids", "[dense_id_map]") {
+	int values[16] = { 0 };
+	base::dense_id_map<int32_t, int*> v;
+	map<int32_t, int*> expected;
+	auto seed = uint32_t(1);
+	auto next = [&seed] {
+		seed = seed * 1103515245U + 12345U;
+		return (seed >> 8);
+	};
+	for (auto i = 0; i != 50000; ++i) {
+		auto kind = next() % 10;
+		auto key = (kind < 7)
+			? int32_t(2000000 + next() % 4000) // sequential ids
+			: (kind < 8)
+			? int32_t(1999000 - i / 16 - next() % 1000) // loading older ids
+			: int32_t(next() * 257U); // sparse ids
+		auto value = &values[next() % 16];
+		auto j = expected.find(key);
+		auto old = (j == expected.end()) ? nullptr : j->second;
+		if (next() % 3) {
+			REQUIRE(v.set(key, value) == old);
+			expected[key] = value;
+		} else {
+			REQUIRE(v.take(key) == old);
+			expected.erase(key);
+		}
+		REQUIRE(v.size() == expected.size());
+	}
+	for (auto &entry : expected) {
+		REQUIRE(v.value(entry.first) == entry.second);
+	}
+	auto enumerated = size_t(0);
+	v.enumerate([&](int32_t key, int *value) {
+		REQUIRE(expected[key] == value);
+		++enumerated;
+	});
+	REQUIRE(enumerated == expected.size());
+}
@@ -0,0 +1,221 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#pragma once
+
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+
+namespace base {
+
+// Hash map with all the values kept in one vector and an open addressing
+// (linear probing) index of value positions. Iterating goes over the values
+// vector, lookup touches one or two index cells and then the value itself.
+//
+// Erasing moves the last value to the place of the erased one, so it
+// invalidates iterators to the last value and doesn't keep the order.
+// Keys must not be changed through the iterators.
+template <typename Key, typename Type, typename Hash = std::hash<Key>>
+class flat_hash_map {
+	using index_type = uint32_t;
+	static constexpr index_type kEmpty = index_type(-1);
+	using impl = std::vector<std::pair<Key, Type>>;
+
+public:
+	using value_type = typename impl::value_type;
+	using size_type = typename impl::size_type;
+	using iterator = typename impl::iterator;
+	using const_iterator = typename impl::const_iterator;
+
+	flat_hash_map() = default;
+	flat_hash_map(const flat_hash_map &other) = default;
+	flat_hash_map(flat_hash_map &&other) = default;
+	flat_hash_map &operator=(const flat_hash_map &other) = default;
+	flat_hash_map &operator=(flat_hash_map &&other) = default;
+
+	size_type size() const {
+		return _values.size();
+	}
+	bool empty() const {
+		return _values.empty();
+	}
+
+	iterator begin() {
+		return _values.begin();
+	}
+	iterator end() {
+		return _values.end();
+	}
+	const_iterator begin() const {
+		return _values.begin();
+	}
+	const_iterator end() const {
+		return _values.end();
+	}
+	const_iterator cbegin() const {
+		return _values.cbegin();
+	}
+	const_iterator cend() const {
+		return _values.cend();
+	}
+
+	void reserve(size_type count) {
+		_values.reserve(count);
+		if (count * 2 > _index.size()) {
+			rehash(count * 2);
+		}
+	}
+	void clear() {
+		_values.clear();
+		_index.clear();
+	}
+
+	iterator find(const Key &key) {
+		auto cell = findCell(key);
+		return (cell == kNotFound) ? end() : (begin() + _index[cell]);
+	}
+	const_iterator find(const Key &key) const {
+		auto cell = findCell(key);
+		return (cell == kNotFound) ? end() : (begin() + _index[cell]);
+	}
+	bool contains(const Key &key) const {
+		return findCell(key) != kNotFound;
+	}
+	size_type count(const Key &key) const {
+		return contains(key) ? 1 : 0;
+	}
+
+	// Returns the found or inserted value and true if it was inserted.
+	template <typename... Args>
+	std::pair<iterator, bool> emplace(const Key &key, Args&&... args) {
+		auto cell = findCell(key);
+		if (cell != kNotFound) {
+			return { begin() + _index[cell], false };
+		}
+		growIfNeeded();
+		_values.emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+		_index[freeCell(key)] = index_type(_values.size() - 1);
+		return { end() - 1, true };
+	}
+	std::pair<iterator, bool> insert(const value_type &value) {
+		return emplace(value.first, value.second);
+	}
+	std::pair<iterator, bool> insert(value_type &&value) {
+		return emplace(value.first, std::move(value.second));
+	}
+	Type &operator[](const Key &key) {
+		return emplace(key).first->second;
+	}
+
+	size_type erase(const Key &key) {
+		auto cell = findCell(key);
+		if (cell == kNotFound) {
+			return 0;
+		}
+		eraseCell(cell);
+		return 1;
+	}
+
+	// Returns the iterator to the value moved to the erased place (or end()).
+	iterator erase(const_iterator where) {
+		auto position = where - cbegin();
+		eraseCell(findCell(where->first));
+		return begin() + position;
+	}
+
+private:
+	static constexpr size_type kNotFound = size_type(-1);
+	static constexpr size_type kMinIndexSize = 16;
+
+	size_type mask() const {
+		return _index.size() - 1;
+	}
+	size_type startCell(const Key &key) const {
+		// Fibonacci hashing spreads the identity std::hash of integers.
+		auto hash = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ULL;
+		return static_cast<size_type>(hash >> 32) & mask();
+	}
+	size_type findCell(const Key &key) const {
+		if (_index.empty()) {
+			return kNotFound;
+		}
+		for (auto cell = startCell(key);; cell = (cell + 1) & mask()) {
+			auto position = _index[cell];
+			if (position == kEmpty) {
+				return kNotFound;
+			} else if (_values[position].first == key) {
+				return cell;
+			}
+		}
+	}
+	size_type freeCell(const Key &key) const {
+		auto cell = startCell(key);
+		while (_index[cell] != kEmpty) {
+			cell = (cell + 1) & mask();
+		}
+		return cell;
+	}
+	void growIfNeeded() {
+		// Keep the index at most half full.
+		if ((_values.size() + 1) * 2 > _index.size()) {
+			rehash(std::max(_index.size() * 2, size_type(kMinIndexSize)));
+		}
+	}
+	void rehash(size_type atLeast) {
+		auto size = kMinIndexSize;
+		while (size < atLeast) {
+			size *= 2;
+		}
+		_index.assign(size, index_type(kEmpty));
+		for (auto i = size_type(0), count = _values.size(); i != count; ++i) {
+			_index[freeCell(_values[i].first)] = index_type(i);
+		}
+	}
+	void eraseCell(size_type cell) {
+		auto position = _index[cell];
+		auto last = index_type(_values.size() - 1);
+		if (position != last) {
+			auto lastCell = findCell(_values[last].first);
+			_values[position] = std::move(_values[last]);
+			_index[lastCell] = position;
+		}
+		_values.pop_back();
+
+		// Backward shift deletion, no tombstones are left in the index.
+		for (auto next = (cell + 1) & mask(); _index[next] != kEmpty; next = (next + 1) & mask()) {
+			auto wanted = startCell(_values[_index[next]].first);
+			if (((next - wanted) & mask()) >= ((next - cell) & mask())) {
+				_index[cell] = _index[next];
+				cell = next;
+			}
+		}
+		_index[cell] = kEmpty;
+	}
+
+	impl _values;
+	std::vector<index_type> _index;
+
+};
+
+} // namespace base
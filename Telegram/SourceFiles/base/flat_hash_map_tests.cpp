@@ -0,0 +1,93 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/flat_hash_map.h"
+#include <string>
+
+using namespace std;
+
+TEST_CASE("flat_hash_maps should find inserted items", "[flat_hash_map]") {
+	base::flat_hash_map<uint64_t, string> v;
+	v.emplace(0, "a");
+	v.emplace(5, "b");
+	v.emplace(4, "d");
+	v.emplace(2, "e");
+
+	REQUIRE(v.size() == 4);
+	REQUIRE(v.find(5) != v.end());
+	REQUIRE(v.find(5)->second == "b");
+	REQUIRE(v.find(3) == v.end());
+
+	SECTION("adding existing key keeps the old value") {
+		auto result = v.emplace(4, "c");
+		REQUIRE(!result.second);
+		REQUIRE(result.first->second == "d");
+		REQUIRE(v.size() == 4);
+	}
+
+	SECTION("erasing items keeps the other ones") {
+		REQUIRE(v.erase(0) == 1);
+		REQUIRE(v.erase(3) == 0);
+		REQUIRE(v.size() == 3);
+		REQUIRE(v.find(0) == v.end());
+		REQUIRE(v.find(2)->second == "e");
+		REQUIRE(v.find(4)->second == "d");
+		REQUIRE(v.find(5)->second == "b");
+	}
+}
+
+TEST_CASE("flat_hash_maps should survive many inserts and erases", "[flat_hash_map]") {
+	base::flat_hash_map<uint64_t, int> v;
+	for (auto i = 0; i != 10000; ++i) {
+		v.emplace(uint64_t(i) << 32, i);
+	}
+	REQUIRE(v.size() == 10000);
+
+	SECTION("erasing while iterating") {
+		for (auto i = v.begin(); i != v.end();) {
+			if (i->second % 2) {
+				i = v.erase(i);
+			} else {
+				++i;
+			}
+		}
+		REQUIRE(v.size() == 5000);
+		for (auto i = 0; i != 10000; ++i) {
+			auto found = v.find(uint64_t(i) << 32);
+			if (i % 2) {
+				REQUIRE(found == v.end());
+			} else {
+				REQUIRE(found != v.end());
+				REQUIRE(found->second == i);
+			}
+		}
+	}
+
+	SECTION("clearing and inserting again") {
+		v.clear();
+		REQUIRE(v.empty());
+		REQUIRE(v.find(0) == v.end());
+		v[7] = 3;
+		REQUIRE(v.size() == 1);
+		REQUIRE(v.find(7)->second == 3);
+	}
+}
@@ -21,30 +21,39 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include <deque>
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+#include <type_traits>
+#include "base/algorithm.h"
 #include "base/optional.h"
 
 namespace base {
 
-template <typename Key, typename Type>
+// Storage is the random access container that keeps the sorted pairs.
+// std::deque (the default) gives cheap inserts at both ends and keeps
+// references valid on them, std::vector keeps all the pairs contiguous
+// which is faster to search for small maps that are rarely changed.
+template <typename Key, typename Type, template <typename...> class Storage = std::deque>
 class flat_map;
 
-template <typename Key, typename Type>
+template <typename Key, typename Type, template <typename...> class Storage = std::deque>
 class flat_multi_map;
 
-template <typename Key, typename Type, typename iterator_impl, typename pointer_impl, typename reference_impl>
+template <typename Key, typename Type, template <typename...> class Storage, typename iterator_impl, typename pointer_impl, typename reference_impl>
 class flat_multi_map_iterator_base_impl;
 
-template <typename Key, typename Type, typename iterator_impl, typename pointer_impl, typename reference_impl>
+template <typename Key, typename Type, template <typename...> class Storage, typename iterator_impl, typename pointer_impl, typename reference_impl>
 class flat_multi_map_iterator_base_impl {
 public:
 	using iterator_category = typename iterator_impl::iterator_category;
 
-	using value_type = typename flat_multi_map<Key, Type>::value_type;
+	using value_type = typename flat_multi_map<Key, Type, Storage>::value_type;
 	using difference_type = typename iterator_impl::difference_type;
 	using pointer = pointer_impl;
-	using const_pointer = typename flat_multi_map<Key, Type>::const_pointer;
+	using const_pointer = typename flat_multi_map<Key, Type, Storage>::const_pointer;
 	using reference = reference_impl;
-	using const_reference = typename flat_multi_map<Key, Type>::const_reference;
+	using const_reference = typename flat_multi_map<Key, Type, Storage>::const_reference;
 
 	flat_multi_map_iterator_base_impl(iterator_impl impl = iterator_impl()) : _impl(impl) {
 	}
@@ -111,13 +120,13 @@ public:
 
 private:
 	iterator_impl _impl;
-	friend class flat_multi_map<Key, Type>;
+	friend class flat_multi_map<Key, Type, Storage>;
 
 };
 
-template <typename Key, typename Type>
+template <typename Key, typename Type, template <typename...> class Storage>
 class flat_multi_map {
-	using self = flat_multi_map<Key, Type>;
+	using self = flat_multi_map<Key, Type, Storage>;
 	class key_const_wrap {
 	public:
 		key_const_wrap(const Key &value) : _value(value) {
@@ -144,12 +153,12 @@ class flat_multi_map {
 	};
 
 	using pair_type = std::pair<key_const_wrap, Type>;
-	using impl = std::deque<pair_type>;
+	using impl = Storage<pair_type>;
 
-	using iterator_base = flat_multi_map_iterator_base_impl<Key, Type, typename impl::iterator, pair_type*, pair_type&>;
-	using const_iterator_base = flat_multi_map_iterator_base_impl<Key, Type, typename impl::const_iterator, const pair_type*, const pair_type&>;
-	using reverse_iterator_base = flat_multi_map_iterator_base_impl<Key, Type, typename impl::reverse_iterator, pair_type*, pair_type&>;
-	using const_reverse_iterator_base = flat_multi_map_iterator_base_impl<Key, Type, typename impl::const_reverse_iterator, const pair_type*, const pair_type&>;
+	using iterator_base = flat_multi_map_iterator_base_impl<Key, Type, Storage, typename impl::iterator, pair_type*, pair_type&>;
+	using const_iterator_base = flat_multi_map_iterator_base_impl<Key, Type, Storage, typename impl::const_iterator, const pair_type*, const pair_type&>;
+	using reverse_iterator_base = flat_multi_map_iterator_base_impl<Key, Type, Storage, typename impl::reverse_iterator, pair_type*, pair_type&>;
+	using const_reverse_iterator_base = flat_multi_map_iterator_base_impl<Key, Type, Storage, typename impl::const_reverse_iterator, const pair_type*, const pair_type&>;
 
 public:
 	using value_type = pair_type;
@@ -197,6 +206,17 @@ public:
 
 	};
 
+	flat_multi_map() = default;
+
+	// Bulk construction sorts all the pairs once instead of inserting them
+	// one by one, pairs with equal keys keep their order.
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	flat_multi_map(Iterator first, Iterator last) : _impl(first, last) {
+		std::stable_sort(_impl.begin(), _impl.end(), Comparator());
+	}
+	flat_multi_map(std::initializer_list<pair_type> list) : flat_multi_map(list.begin(), list.end()) {
+	}
+
 	size_type size() const {
 		return _impl.size();
 	}
@@ -259,7 +279,7 @@ public:
 
 	iterator insert(const value_type &value) {
 		if (empty() || (value.first < front().first)) {
-			_impl.push_front(value);
+			_impl.insert(_impl.begin(), value);
 			return begin();
 		} else if (!(value.first < back().first)) {
 			_impl.push_back(value);
@@ -270,7 +290,7 @@ public:
 	}
 	iterator insert(value_type &&value) {
 		if (empty() || (value.first < front().first)) {
-			_impl.push_front(std::move(value));
+			_impl.insert(_impl.begin(), std::move(value));
 			return begin();
 		} else if (!(value.first < back().first)) {
 			_impl.push_back(std::move(value));
@@ -283,6 +303,12 @@ public:
 	iterator emplace(Args&&... args) {
 		return insert(value_type(std::forward<Args>(args)...));
 	}
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		const auto sorted = size();
+		_impl.insert(_impl.end(), first, last);
+		mergeAppended(sorted);
+	}
 
 	bool removeOne(const Key &key) {
 		if (empty() || (key < front().first) || (back().first < key)) {
@@ -343,51 +369,90 @@ public:
 
 private:
 	impl _impl;
-	friend class flat_map<Key, Type>;
+	friend class flat_map<Key, Type, Storage>;
+
+	// Cheap to compare keys are searched without a branch in the loop.
+	static constexpr bool kBranchlessSearch = std::is_arithmetic<Key>::value
+		|| std::is_pointer<Key>::value
+		|| std::is_enum<Key>::value;
 
 	struct Comparator {
-		inline bool operator()(const pair_type &a, const Key &b) {
+		inline bool operator()(const pair_type &a, const Key &b) const {
 			return a.first < b;
 		}
-		inline bool operator()(const Key &a, const pair_type &b) {
+		inline bool operator()(const Key &a, const pair_type &b) const {
 			return a < b.first;
 		}
+		inline bool operator()(const pair_type &a, const pair_type &b) const {
+			return a.first < b.first;
+		}
 	};
+	template <typename Iterator>
+	static Iterator lowerBound(Iterator first, Iterator last, const Key &key) {
+		return kBranchlessSearch
+			? branchless_lower_bound(first, last, key, Comparator())
+			: std::lower_bound(first, last, key, Comparator());
+	}
+	template <typename Iterator>
+	static Iterator upperBound(Iterator first, Iterator last, const Key &key) {
+		return kBranchlessSearch
+			? branchless_upper_bound(first, last, key, Comparator())
+			: std::upper_bound(first, last, key, Comparator());
+	}
 	typename impl::iterator getLowerBound(const Key &key) {
-		return std::lower_bound(_impl.begin(), _impl.end(), key, Comparator());
+		return lowerBound(_impl.begin(), _impl.end(), key);
 	}
 	typename impl::const_iterator getLowerBound(const Key &key) const {
-		return std::lower_bound(_impl.begin(), _impl.end(), key, Comparator());
+		return lowerBound(_impl.begin(), _impl.end(), key);
 	}
 	typename impl::iterator getUpperBound(const Key &key) {
-		return std::upper_bound(_impl.begin(), _impl.end(), key, Comparator());
+		return upperBound(_impl.begin(), _impl.end(), key);
 	}
 	typename impl::const_iterator getUpperBound(const Key &key) const {
-		return std::upper_bound(_impl.begin(), _impl.end(), key, Comparator());
+		return upperBound(_impl.begin(), _impl.end(), key);
 	}
 	std::pair<typename impl::iterator, typename impl::iterator> getEqualRange(const Key &key) {
-		return std::equal_range(_impl.begin(), _impl.end(), key, Comparator());
+		auto from = getLowerBound(key);
+		return { from, upperBound(from, _impl.end(), key) };
 	}
 	std::pair<typename impl::const_iterator, typename impl::const_iterator> getEqualRange(const Key &key) const {
-		return std::equal_range(_impl.begin(), _impl.end(), key, Comparator());
+		auto from = getLowerBound(key);
+		return { from, upperBound(from, _impl.end(), key) };
+	}
+
+	// Sorts the pairs appended after the first "sorted" ones and merges
+	// them in, the already present pairs go first among the equal keys.
+	void mergeAppended(size_type sorted) {
+		auto middle = _impl.begin() + sorted;
+		std::stable_sort(middle, _impl.end(), Comparator());
+		std::inplace_merge(_impl.begin(), middle, _impl.end(), Comparator());
 	}
 
 };
 
-template <typename Key, typename Type>
-class flat_map : public flat_multi_map<Key, Type> {
-	using parent = flat_multi_map<Key, Type>;
+template <typename Key, typename Type, template <typename...> class Storage>
+class flat_map : public flat_multi_map<Key, Type, Storage> {
+	using parent = flat_multi_map<Key, Type, Storage>;
 	using pair_type = typename parent::pair_type;
 
 public:
-	using parent::parent;
 	using iterator = typename parent::iterator;
 	using const_iterator = typename parent::const_iterator;
 	using value_type = typename parent::value_type;
 
+	flat_map() = default;
+
+	// Of the pairs with equal keys only the first one is kept.
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	flat_map(Iterator first, Iterator last) : parent(first, last) {
+		removeDuplicates();
+	}
+	flat_map(std::initializer_list<pair_type> list) : flat_map(list.begin(), list.end()) {
+	}
+
 	iterator insert(const value_type &value) {
 		if (this->empty() || (value.first < this->front().first)) {
-			this->_impl.push_front(value);
+			this->_impl.insert(this->_impl.begin(), value);
 			return this->begin();
 		} else if (this->back().first < value.first) {
 			this->_impl.push_back(value);
@@ -401,7 +466,7 @@ public:
 	}
 	iterator insert(value_type &&value) {
 		if (this->empty() || (value.first < this->front().first)) {
-			this->_impl.push_front(std::move(value));
+			this->_impl.insert(this->_impl.begin(), std::move(value));
 			return this->begin();
 		} else if (this->back().first < value.first) {
 			this->_impl.push_back(std::move(value));
@@ -417,6 +482,11 @@ public:
 	iterator emplace(Args&&... args) {
 		return this->insert(value_type(std::forward<Args>(args)...));
 	}
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		parent::insert(first, last);
+		removeDuplicates();
+	}
 
 	bool remove(const Key &key) {
 		return this->removeOne(key);
@@ -431,7 +501,7 @@ public:
 
 	Type &operator[](const Key &key) {
 		if (this->empty() || (key < this->front().first)) {
-			this->_impl.push_front({ key, Type() });
+			this->_impl.insert(this->_impl.begin(), { key, Type() });
 			return this->front().second;
 		} else if (this->back().first < key) {
 			this->_impl.push_back({ key, Type() });
@@ -454,6 +524,14 @@ public:
 		return std::move(result);
 	}
 
+private:
+	void removeDuplicates() {
+		auto &impl = this->_impl;
+		impl.erase(std::unique(impl.begin(), impl.end(), [](const pair_type &a, const pair_type &b) {
+			return !(a.first < b.first);
+		}), impl.end());
+	}
+
 };
 
 } // namespace base
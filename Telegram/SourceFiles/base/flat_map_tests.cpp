@@ -22,6 +22,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "base/flat_map.h"
 #include <string>
+#include <vector>
+#include <chrono>
 
 using namespace std;
 
@@ -49,3 +51,119 @@ TEST_CASE("flat_maps should keep items sorted by key", "[flat_map]") {
 		checkSorted();
 	}
 }
+
+TEST_CASE("flat_maps with vector storage keep items sorted by key", "[flat_map]") {
+	base::flat_map<int, string, std::vector> v;
+	v.emplace(0, "a");
+	v.emplace(5, "b");
+	v.emplace(4, "d");
+	v.emplace(2, "e");
+	v[3] = "c";
+
+	REQUIRE(v.size() == 5);
+	for (auto key : { 0, 2, 3, 4, 5 }) {
+		REQUIRE(v.find(key) != v.end());
+		REQUIRE(v.find(key)->first == key);
+	}
+	REQUIRE(v.find(-1) == v.end());
+	REQUIRE(v.find(1) == v.end());
+	REQUIRE(v.find(6) == v.end());
+	REQUIRE(v.take(4) == string("d"));
+	REQUIRE(v.size() == 4);
+	REQUIRE(!v.contains(4));
+}
+
+TEST_CASE("flat_maps can be constructed and extended in bulk", "[flat_map]") {
+	base::flat_map<int, string> v = {
+		{ 3, "a" },
+		{ 1, "b" },
+		{ 3, "c" },
+		{ 2, "d" },
+	};
+	REQUIRE(v.size() == 3);
+	REQUIRE(v.begin()->first == 1);
+	REQUIRE(v.find(3)->second == "a");
+
+	SECTION("bulk insert keeps existing values") {
+		auto added = std::vector<std::pair<int, string>>{
+			{ 5, "e" },
+			{ 2, "f" },
+			{ 0, "g" },
+			{ 5, "h" },
+		};
+		v.insert(added.begin(), added.end());
+		REQUIRE(v.size() == 5);
+		REQUIRE(v.find(2)->second == "d");
+		REQUIRE(v.find(5)->second == "e");
+		auto prev = v.begin();
+		for (auto i = prev + 1; i != v.end(); prev = i, ++i) {
+			REQUIRE(prev->first < i->first);
+		}
+	}
+}
+
+TEST_CASE("flat_multi_maps keep the order of equal keys", "[flat_map]") {
+	base::flat_multi_map<int, int, std::vector> v = {
+		{ 2, 0 },
+		{ 1, 1 },
+		{ 2, 2 },
+	};
+	v.emplace(2, 3);
+	auto added = std::vector<std::pair<int, int>>{ { 2, 4 }, { 1, 5 } };
+	v.insert(added.begin(), added.end());
+
+	REQUIRE(v.count(2) == 4);
+	REQUIRE(v.count(1) == 2);
+	auto i = v.findFirst(2);
+	for (auto expected : { 0, 2, 3, 4 }) {
+		REQUIRE(i->second == expected);
+		++i;
+	}
+	REQUIRE(v.removeAll(2) == 4);
+	REQUIRE(v.size() == 2);
+}
+
+TEST_CASE("branchless search matches std bounds", "[flat_map]") {
+	auto values = std::vector<int>();
+	for (auto size = 0; size != 40; ++size) {
+		for (auto value = -1; value <= size + 1; ++value) {
+			auto less = std::less<>();
+			REQUIRE(base::branchless_lower_bound(values.begin(), values.end(), value, less)
+				== std::lower_bound(values.begin(), values.end(), value));
+			REQUIRE(base::branchless_upper_bound(values.begin(), values.end(), value, less)
+				== std::upper_bound(values.begin(), values.end(), value));
+		}
+		values.push_back(size - (size % 3));
+	}
+}
+
+namespace {
+
+template <template <typename...> class Storage>
+double MeasureLookups(int count, int lookups) {
+	auto v = base::flat_map<int, int, Storage>();
+	for (auto i = 0; i != count; ++i) {
+		v.emplace((i * 7919) % count, i);
+	}
+	auto found = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (auto i = 0; i != lookups; ++i) {
+		found += v.contains((i * 31) % count) ? 1 : 0;
+	}
+	const auto finish = std::chrono::steady_clock::now();
+	REQUIRE(found == lookups);
+	return std::chrono::duration<double, std::micro>(finish - start).count();
+}
+
+} // namespace
+
+TEST_CASE("flat_map deque and vector storage lookup benchmark", "[.][benchmark]") {
+	constexpr auto kLookups = 1000000;
+	for (auto count : { 8, 64, 1024, 65536 }) {
+		const auto deque = MeasureLookups<std::deque>(count, kLookups);
+		const auto vector = MeasureLookups<std::vector>(count, kLookups);
+		WARN("size " << count
+			<< ": deque " << deque << "us"
+			<< ", vector " << vector << "us");
+	}
+}
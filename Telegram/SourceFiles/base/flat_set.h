@@ -21,27 +21,34 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include <deque>
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+#include <type_traits>
+#include "base/algorithm.h"
 
 namespace base {
 
-template <typename Type>
+// Storage is the random access container that keeps the sorted values,
+// see the flat_map Storage comment for the std::deque / std::vector choice.
+template <typename Type, template <typename...> class Storage = std::deque>
 class flat_set;
 
-template <typename Type>
+template <typename Type, template <typename...> class Storage = std::deque>
 class flat_multi_set;
 
-template <typename Type, typename iterator_impl>
+template <typename Type, template <typename...> class Storage, typename iterator_impl>
 class flat_multi_set_iterator_base_impl;
 
-template <typename Type, typename iterator_impl>
+template <typename Type, template <typename...> class Storage, typename iterator_impl>
 class flat_multi_set_iterator_base_impl {
 public:
 	using iterator_category = typename iterator_impl::iterator_category;
 
-	using value_type = typename flat_multi_set<Type>::value_type;
+	using value_type = typename flat_multi_set<Type, Storage>::value_type;
 	using difference_type = typename iterator_impl::difference_type;
-	using pointer = typename flat_multi_set<Type>::pointer;
-	using reference = typename flat_multi_set<Type>::reference;
+	using pointer = typename flat_multi_set<Type, Storage>::pointer;
+	using reference = typename flat_multi_set<Type, Storage>::reference;
 
 	flat_multi_set_iterator_base_impl(iterator_impl impl = iterator_impl()) : _impl(impl) {
 	}
@@ -99,13 +106,13 @@ public:
 
 private:
 	iterator_impl _impl;
-	friend class flat_multi_set<Type>;
+	friend class flat_multi_set<Type, Storage>;
 
 };
 
-template <typename Type>
+template <typename Type, template <typename...> class Storage>
 class flat_multi_set {
-	using self = flat_multi_set<Type>;
+	using self = flat_multi_set<Type, Storage>;
 	class const_wrap {
 	public:
 		const_wrap(const Type &value) : _value(value) {
@@ -131,12 +138,12 @@ class flat_multi_set {
 
 	};
 
-	using impl = std::deque<const_wrap>;
+	using impl = Storage<const_wrap>;
 
-	using iterator_base = flat_multi_set_iterator_base_impl<Type, typename impl::iterator>;
-	using const_iterator_base = flat_multi_set_iterator_base_impl<Type, typename impl::const_iterator>;
-	using reverse_iterator_base = flat_multi_set_iterator_base_impl<Type, typename impl::reverse_iterator>;
-	using const_reverse_iterator_base = flat_multi_set_iterator_base_impl<Type, typename impl::const_reverse_iterator>;
+	using iterator_base = flat_multi_set_iterator_base_impl<Type, Storage, typename impl::iterator>;
+	using const_iterator_base = flat_multi_set_iterator_base_impl<Type, Storage, typename impl::const_iterator>;
+	using reverse_iterator_base = flat_multi_set_iterator_base_impl<Type, Storage, typename impl::reverse_iterator>;
+	using const_reverse_iterator_base = flat_multi_set_iterator_base_impl<Type, Storage, typename impl::const_reverse_iterator>;
 
 public:
 	using value_type = Type;
@@ -186,7 +193,9 @@ public:
 
 	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
 	flat_multi_set(Iterator first, Iterator last) : _impl(first, last) {
-		std::sort(_impl.begin(), _impl.end());
+		std::stable_sort(_impl.begin(), _impl.end());
+	}
+	flat_multi_set(std::initializer_list<Type> list) : flat_multi_set(list.begin(), list.end()) {
 	}
 
 	size_type size() const {
@@ -245,7 +254,7 @@ public:
 
 	iterator insert(const Type &value) {
 		if (empty() || (value < front())) {
-			_impl.push_front(value);
+			_impl.insert(_impl.begin(), value);
 			return begin();
 		} else if (!(value < back())) {
 			_impl.push_back(value);
@@ -256,7 +265,7 @@ public:
 	}
 	iterator insert(Type &&value) {
 		if (empty() || (value < front())) {
-			_impl.push_front(std::move(value));
+			_impl.insert(_impl.begin(), std::move(value));
 			return begin();
 		} else if (!(value < back())) {
 			_impl.push_back(std::move(value));
@@ -269,6 +278,12 @@ public:
 	iterator emplace(Args&&... args) {
 		return insert(Type(std::forward<Args>(args)...));
 	}
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		const auto sorted = size();
+		_impl.insert(_impl.end(), first, last);
+		mergeAppended(sorted);
+	}
 
 	bool removeOne(const Type &value) {
 		if (empty() || (value < front()) || (back() < value)) {
@@ -329,32 +344,59 @@ public:
 
 private:
 	impl _impl;
-	friend class flat_set<Type>;
+	friend class flat_set<Type, Storage>;
+
+	// Cheap to compare values are searched without a branch in the loop.
+	static constexpr bool kBranchlessSearch = std::is_arithmetic<Type>::value
+		|| std::is_pointer<Type>::value
+		|| std::is_enum<Type>::value;
 
+	template <typename Iterator>
+	static Iterator lowerBound(Iterator first, Iterator last, const Type &value) {
+		return kBranchlessSearch
+			? branchless_lower_bound(first, last, value, std::less<>())
+			: std::lower_bound(first, last, value);
+	}
+	template <typename Iterator>
+	static Iterator upperBound(Iterator first, Iterator last, const Type &value) {
+		return kBranchlessSearch
+			? branchless_upper_bound(first, last, value, std::less<>())
+			: std::upper_bound(first, last, value);
+	}
 	typename impl::iterator getLowerBound(const Type &value) {
-		return std::lower_bound(_impl.begin(), _impl.end(), value);
+		return lowerBound(_impl.begin(), _impl.end(), value);
 	}
 	typename impl::const_iterator getLowerBound(const Type &value) const {
-		return std::lower_bound(_impl.begin(), _impl.end(), value);
+		return lowerBound(_impl.begin(), _impl.end(), value);
 	}
 	typename impl::iterator getUpperBound(const Type &value) {
-		return std::upper_bound(_impl.begin(), _impl.end(), value);
+		return upperBound(_impl.begin(), _impl.end(), value);
 	}
 	typename impl::const_iterator getUpperBound(const Type &value) const {
-		return std::upper_bound(_impl.begin(), _impl.end(), value);
+		return upperBound(_impl.begin(), _impl.end(), value);
 	}
 	std::pair<typename impl::iterator, typename impl::iterator> getEqualRange(const Type &value) {
-		return std::equal_range(_impl.begin(), _impl.end(), value);
+		auto from = getLowerBound(value);
+		return { from, upperBound(from, _impl.end(), value) };
 	}
 	std::pair<typename impl::const_iterator, typename impl::const_iterator> getEqualRange(const Type &value) const {
-		return std::equal_range(_impl.begin(), _impl.end(), value);
+		auto from = getLowerBound(value);
+		return { from, upperBound(from, _impl.end(), value) };
+	}
+
+	// Sorts the values appended after the first "sorted" ones and merges
+	// them in, the already present values go first among the equal ones.
+	void mergeAppended(size_type sorted) {
+		auto middle = _impl.begin() + sorted;
+		std::stable_sort(middle, _impl.end());
+		std::inplace_merge(_impl.begin(), middle, _impl.end());
 	}
 
 };
 
-template <typename Type>
-class flat_set : public flat_multi_set<Type> {
-	using parent = flat_multi_set<Type>;
+template <typename Type, template <typename...> class Storage>
+class flat_set : public flat_multi_set<Type, Storage> {
+	using parent = flat_multi_set<Type, Storage>;
 
 public:
 	using parent::parent;
@@ -365,14 +407,14 @@ public:
 
 	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
 	flat_set(Iterator first, Iterator last) : parent(first, last) {
-		this->_impl.erase(std::unique(this->_impl.begin(), this->_impl.end(), [](auto &&a, auto &&b) {
-			return !(a < b);
-		}), this->_impl.end());
+		removeDuplicates();
+	}
+	flat_set(std::initializer_list<Type> list) : flat_set(list.begin(), list.end()) {
 	}
 
 	iterator insert(const Type &value) {
 		if (this->empty() || (value < this->front())) {
-			this->_impl.push_front(value);
+			this->_impl.insert(this->_impl.begin(), value);
 			return this->begin();
 		} else if (this->back() < value) {
 			this->_impl.push_back(value);
@@ -386,7 +428,7 @@ public:
 	}
 	iterator insert(Type &&value) {
 		if (this->empty() || (value < this->front())) {
-			this->_impl.push_front(std::move(value));
+			this->_impl.insert(this->_impl.begin(), std::move(value));
 			return this->begin();
 		} else if (this->back() < value) {
 			this->_impl.push_back(std::move(value));
@@ -402,6 +444,11 @@ public:
 	iterator emplace(Args&&... args) {
 		return this->insert(Type(std::forward<Args>(args)...));
 	}
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		parent::insert(first, last);
+		removeDuplicates();
+	}
 
 	bool remove(const Type &value) {
 		return this->removeOne(value);
@@ -414,6 +461,14 @@ public:
 		return this->findFirst(value);
 	}
 
+private:
+	void removeDuplicates() {
+		auto &impl = this->_impl;
+		impl.erase(std::unique(impl.begin(), impl.end(), [](auto &&a, auto &&b) {
+			return !(a < b);
+		}), impl.end());
+	}
+
 };
 
 } // namespace base
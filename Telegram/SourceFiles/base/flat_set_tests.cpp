@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "catch.hpp"
 
 #include "base/flat_set.h"
+#include <vector>
 
 TEST_CASE("flat_sets should keep items sorted", "[flat_set]") {
 	base::flat_set<int> v;
@@ -46,3 +47,23 @@ TEST_CASE("flat_sets should keep items sorted", "[flat_set]") {
 		checkSorted();
 	}
 }
+
+TEST_CASE("flat_sets can be constructed and extended in bulk", "[flat_set]") {
+	base::flat_set<int, std::vector> v = { 5, 1, 3, 1, 4 };
+	REQUIRE(v.size() == 4);
+	REQUIRE(v.front() == 1);
+	REQUIRE(v.back() == 5);
+
+	auto added = { 6, 3, 0, 6 };
+	v.insert(added.begin(), added.end());
+	REQUIRE(v.size() == 6);
+	for (auto value : { 0, 1, 3, 4, 5, 6 }) {
+		REQUIRE(v.contains(value));
+	}
+	REQUIRE(!v.contains(2));
+
+	auto prev = v.begin();
+	for (auto i = prev + 1; i != v.end(); prev = i, ++i) {
+		REQUIRE(*prev < *i);
+	}
+}
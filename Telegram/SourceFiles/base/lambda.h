@@ -22,6 +22,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include <memory>
 
+#ifdef _DEBUG
+#include <atomic>
+#endif // _DEBUG
+
 #ifndef Assert
 #define LambdaAssertDefined
 #define Assert(v) ((v) ? ((void)0) : std::abort())
@@ -33,9 +37,17 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #endif // Unexpected
 
 namespace base {
+namespace lambda_internal {
+
+constexpr auto kFullStorageSize = 32U;
+static_assert(kFullStorageSize % sizeof(void*) == 0, "Invalid pointer size!");
+
+} // namespace lambda_internal
 
-template <typename Function> class lambda_once;
-template <typename Function> class lambda;
+// Size is the full object size, the captures that don't fit in it
+// without the vtable pointer are moved to the heap.
+template <typename Function, std::size_t Size = lambda_internal::kFullStorageSize> class lambda_once;
+template <typename Function, std::size_t Size = lambda_internal::kFullStorageSize> class lambda;
 
 // Get lambda type from a lambda template parameter.
 
@@ -72,14 +84,25 @@ constexpr bool lambda_is_mutable = lambda_internal::type_helper<std::decay_t<Lam
 
 namespace lambda_internal {
 
-constexpr auto kFullStorageSize = 32U;
-static_assert(kFullStorageSize % sizeof(void*) == 0, "Invalid pointer size!");
-
-constexpr auto kStorageSize = kFullStorageSize - sizeof(void*);
+template <std::size_t Size>
+constexpr std::size_t storage_size = Size - sizeof(void*);
 using alignment = std::max_align_t;
 
-template <typename Lambda>
-constexpr bool is_large = (sizeof(std::decay_t<Lambda>) > kStorageSize);
+template <typename Lambda, std::size_t Size>
+constexpr bool is_large = (sizeof(std::decay_t<Lambda>) > storage_size<Size>);
+
+#ifdef _DEBUG
+inline std::atomic<int> &allocations() {
+	static std::atomic<int> result = { 0 };
+	return result;
+}
+inline void count_allocation() {
+	++allocations();
+}
+#else // _DEBUG
+inline void count_allocation() {
+}
+#endif // _DEBUG
 
 [[noreturn]] inline void bad_construct_copy(void *lambda, const void *source) {
 	Unexpected("base::lambda bad_construct_copy() called!");
@@ -151,6 +174,7 @@ struct vtable_once_impl<Lambda, true, Return, Args...> : public vtable_base<Retu
 	// Used directly.
 	static void construct_move_lambda_method(void *storage, void *source) {
 		auto source_lambda = static_cast<JustLambda*>(source);
+		count_allocation();
 		new (storage) LambdaPtr(std::make_unique<JustLambda>(static_cast<JustLambda&&>(*source_lambda)));
 	}
 
@@ -210,13 +234,13 @@ protected:
 
 };
 
-template <typename Lambda, typename Return, typename ...Args>
-struct vtable_once : public vtable_once_impl<Lambda, is_large<Lambda>, Return, Args...> {
+template <typename Lambda, bool IsLarge, typename Return, typename ...Args>
+struct vtable_once : public vtable_once_impl<Lambda, IsLarge, Return, Args...> {
 	static const vtable_once instance;
 };
 
-template <typename Lambda, typename Return, typename ...Args>
-const vtable_once<Lambda, Return, Args...> vtable_once<Lambda, Return, Args...>::instance = {};
+template <typename Lambda, bool IsLarge, typename Return, typename ...Args>
+const vtable_once<Lambda, IsLarge, Return, Args...> vtable_once<Lambda, IsLarge, Return, Args...>::instance = {};
 
 template <typename Lambda, bool IsLarge, typename Return, typename ...Args> struct vtable_impl;
 
@@ -227,6 +251,7 @@ struct vtable_impl<Lambda, true, Return, Args...> : public vtable_once_impl<Lamb
 	using Parent = vtable_once_impl<Lambda, true, Return, Args...>;
 	static void construct_copy_other_method(void *storage, const void *source) {
 		auto source_lambda = static_cast<const LambdaPtr*>(source);
+		count_allocation();
 		new (storage) LambdaPtr(std::make_unique<JustLambda>(*source_lambda->get()));
 	}
 	static Return const_call_method(const void *storage, Args... args) {
@@ -260,19 +285,33 @@ struct vtable_impl<Lambda, false, Return, Args...> : public vtable_once_impl<Lam
 
 };
 
-template <typename Lambda, typename Return, typename ...Args>
-struct vtable : public vtable_impl<Lambda, is_large<Lambda>, Return, Args...> {
+template <typename Lambda, bool IsLarge, typename Return, typename ...Args>
+struct vtable : public vtable_impl<Lambda, IsLarge, Return, Args...> {
 	static const vtable instance;
 };
 
-template <typename Lambda, typename Return, typename ...Args>
-const vtable<Lambda, Return, Args...> vtable<Lambda, Return, Args...>::instance = {};
+template <typename Lambda, bool IsLarge, typename Return, typename ...Args>
+const vtable<Lambda, IsLarge, Return, Args...> vtable<Lambda, IsLarge, Return, Args...>::instance = {};
 
 } // namespace lambda_internal
 
-template <typename Return, typename ...Args>
-class lambda_once<Return(Args...)> {
+// Count of lambdas that didn't fit in their inline storage, debug only.
+inline int lambda_allocations_count() {
+#ifdef _DEBUG
+	return lambda_internal::allocations();
+#else // _DEBUG
+	return 0;
+#endif // _DEBUG
+}
+
+template <std::size_t Size, typename Return, typename ...Args>
+class lambda_once<Return(Args...), Size> {
+	static_assert(Size % sizeof(void*) == 0, "Invalid lambda storage size!");
+	static_assert(Size > sizeof(void*), "Too small lambda storage size!");
+
 	using VTable = lambda_internal::vtable_base<Return, Args...>;
+	template <typename Lambda>
+	using VTableOnce = lambda_internal::vtable_once<Lambda, lambda_internal::is_large<Lambda, Size>, Return, Args...>;
 
 public:
 	using return_type = Return;
@@ -304,14 +343,14 @@ public:
 	}
 
 	// Move construct / assign from a derived type.
-	lambda_once(lambda<Return(Args...)> &&other) {
+	lambda_once(lambda<Return(Args...), Size> &&other) {
 		if ((data_.vtable = other.data_.vtable)) {
 			data_.vtable->construct_move_other(data_.storage, other.data_.storage);
 			data_.vtable->destruct(other.data_.storage);
 			other.data_.vtable = nullptr;
 		}
 	}
-	lambda_once &operator=(lambda<Return(Args...)> &&other) {
+	lambda_once &operator=(lambda<Return(Args...), Size> &&other) {
 		if (this != &other) {
 			if (data_.vtable) {
 				data_.vtable->destruct(data_.storage);
@@ -326,12 +365,12 @@ public:
 	}
 
 	// Copy construct / assign from a derived type.
-	lambda_once(const lambda<Return(Args...)> &other) {
+	lambda_once(const lambda<Return(Args...), Size> &other) {
 		if ((data_.vtable = other.data_.vtable)) {
 			data_.vtable->construct_copy_other(data_.storage, other.data_.storage);
 		}
 	}
-	lambda_once &operator=(const lambda<Return(Args...)> &other) {
+	lambda_once &operator=(const lambda<Return(Args...), Size> &other) {
 		if (this != &other) {
 			if (data_.vtable) {
 				data_.vtable->destruct(data_.storage);
@@ -346,16 +385,16 @@ public:
 	// Copy / move construct / assign from an arbitrary type.
 	template <typename Lambda, typename = std::enable_if_t<std::is_convertible<decltype(std::declval<Lambda>()(std::declval<Args>()...)),Return>::value>>
 	lambda_once(Lambda other) {
-		data_.vtable = &lambda_internal::vtable_once<Lambda, Return, Args...>::instance;
-		lambda_internal::vtable_once<Lambda, Return, Args...>::construct_move_lambda_method(data_.storage, &other);
+		data_.vtable = &VTableOnce<Lambda>::instance;
+		VTableOnce<Lambda>::construct_move_lambda_method(data_.storage, &other);
 	}
 	template <typename Lambda, typename = std::enable_if_t<std::is_convertible<decltype(std::declval<Lambda>()(std::declval<Args>()...)),Return>::value>>
 	lambda_once &operator=(Lambda other) {
 		if (data_.vtable) {
 			data_.vtable->destruct(data_.storage);
 		}
-		data_.vtable = &lambda_internal::vtable_once<Lambda, Return, Args...>::instance;
-		lambda_internal::vtable_once<Lambda, Return, Args...>::construct_move_lambda_method(data_.storage, &other);
+		data_.vtable = &VTableOnce<Lambda>::instance;
+		VTableOnce<Lambda>::construct_move_lambda_method(data_.storage, &other);
 		return *this;
 	}
 
@@ -388,52 +427,54 @@ protected:
 	}
 
 	struct Data {
-		char storage[lambda_internal::kStorageSize];
+		char storage[lambda_internal::storage_size<Size>];
 		const VTable *vtable;
 	};
 	union {
 		lambda_internal::alignment alignment_;
-		char raw_[lambda_internal::kFullStorageSize];
+		char raw_[Size];
 		Data data_;
 	};
 
 };
 
-template <typename Return, typename ...Args>
-class lambda<Return(Args...)> final : public lambda_once<Return(Args...)> {
-	using Parent = lambda_once<Return(Args...)>;
+template <std::size_t Size, typename Return, typename ...Args>
+class lambda<Return(Args...), Size> final : public lambda_once<Return(Args...), Size> {
+	using Parent = lambda_once<Return(Args...), Size>;
+	template <typename Lambda>
+	using VTable = lambda_internal::vtable<Lambda, lambda_internal::is_large<Lambda, Size>, Return, Args...>;
 
 public:
 	lambda() = default;
 
 	// Move construct / assign from the same type.
-	lambda(lambda<Return(Args...)> &&other) : Parent(std::move(other)) {
+	lambda(lambda<Return(Args...), Size> &&other) : Parent(std::move(other)) {
 	}
-	lambda &operator=(lambda<Return(Args...)> &&other) {
+	lambda &operator=(lambda<Return(Args...), Size> &&other) {
 		Parent::operator=(std::move(other));
 		return *this;
 	}
 
 	// Copy construct / assign from the same type.
-	lambda(const lambda<Return(Args...)> &other) : Parent(other) {
+	lambda(const lambda<Return(Args...), Size> &other) : Parent(other) {
 	}
-	lambda &operator=(const lambda<Return(Args...)> &other) {
+	lambda &operator=(const lambda<Return(Args...), Size> &other) {
 		Parent::operator=(other);
 		return *this;
 	}
 
 	// Copy / move construct / assign from an arbitrary type.
 	template <typename Lambda, typename = std::enable_if_t<std::is_convertible<decltype(std::declval<Lambda>()(std::declval<Args>()...)),Return>::value>>
-	lambda(Lambda other) : Parent(&lambda_internal::vtable<Lambda, Return, Args...>::instance, typename Parent::Private()) {
-		lambda_internal::vtable<Lambda, Return, Args...>::construct_move_lambda_method(this->data_.storage, &other);
+	lambda(Lambda other) : Parent(&VTable<Lambda>::instance, typename Parent::Private()) {
+		VTable<Lambda>::construct_move_lambda_method(this->data_.storage, &other);
 	}
 	template <typename Lambda, typename = std::enable_if_t<std::is_convertible<decltype(std::declval<Lambda>()(std::declval<Args>()...)),Return>::value>>
 	lambda &operator=(Lambda other) {
 		if (this->data_.vtable) {
 			this->data_.vtable->destruct(this->data_.storage);
 		}
-		this->data_.vtable = &lambda_internal::vtable<Lambda, Return, Args...>::instance;
-		lambda_internal::vtable<Lambda, Return, Args...>::construct_move_lambda_method(this->data_.storage, &other);
+		this->data_.vtable = &VTable<Lambda>::instance;
+		VTable<Lambda>::construct_move_lambda_method(this->data_.storage, &other);
 		return *this;
 	}
 
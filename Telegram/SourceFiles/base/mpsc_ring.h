@@ -0,0 +1,147 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace base {
+
+// Fixed capacity queue for any number of producer threads and one consumer thread.
+//
+// Each slot has a sequence number telling whether it is free for the push
+// with the same position or filled for the pop with the next one, so the
+// producers only compete for the tail position with a compare-exchange.
+// pop() is safe to call from the producers as well, push_dropping_oldest()
+// relies on that to make room in a full ring. Capacity is rounded up to a
+// power of two.
+template <typename Type>
+class mpsc_ring {
+public:
+	explicit mpsc_ring(std::size_t capacity)
+	: _mask(ComputeMask(capacity))
+	, _cells(std::make_unique<Cell[]>(_mask + 1)) {
+		for (auto i = std::size_t(0); i != _mask + 1; ++i) {
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	mpsc_ring(const mpsc_ring &other) = delete;
+	mpsc_ring &operator=(const mpsc_ring &other) = delete;
+
+	// Any thread. Returns false if the ring is full, value is left untouched.
+	bool push(Type &&value) {
+		auto position = _tail.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = _cells[position & _mask];
+			const auto sequence = cell.sequence.load(std::memory_order_acquire);
+			const auto difference = std::intptr_t(sequence) - std::intptr_t(position);
+			if (difference == 0) {
+				if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					cell.value = std::move(value);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = _tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	bool push(const Type &value) {
+		auto copy = value;
+		return push(std::move(copy));
+	}
+
+	// Any thread. Pops the oldest items until the value fits.
+	// Returns the count of the dropped items.
+	std::size_t push_dropping_oldest(Type &&value) {
+		auto dropped = std::size_t(0);
+		while (!push(std::move(value))) {
+			auto oldest = Type();
+			if (pop(oldest)) {
+				++dropped;
+			}
+		}
+		return dropped;
+	}
+
+	// Consumer thread (or a producer dropping items).
+	// Returns false if the ring is empty.
+	bool pop(Type &value) {
+		auto position = _head.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = _cells[position & _mask];
+			const auto sequence = cell.sequence.load(std::memory_order_acquire);
+			const auto difference = std::intptr_t(sequence) - std::intptr_t(position + 1);
+			if (difference == 0) {
+				if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					value = std::move(cell.value);
+					cell.sequence.store(position + _mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = _head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Any thread, the result may be outdated at once.
+	std::size_t size() const {
+		auto head = _head.load(std::memory_order_acquire);
+		auto tail = _tail.load(std::memory_order_acquire);
+		return (tail > head) ? (tail - head) : 0;
+	}
+	bool empty() const {
+		return (size() == 0);
+	}
+	std::size_t capacity() const {
+		return _mask + 1;
+	}
+
+private:
+	struct Cell {
+		std::atomic<std::size_t> sequence;
+		Type value;
+	};
+
+	static std::size_t ComputeMask(std::size_t capacity) {
+		auto result = std::size_t(2);
+		while (result < capacity) {
+			result <<= 1;
+		}
+		return result - 1;
+	}
+
+	const std::size_t _mask;
+	const std::unique_ptr<Cell[]> _cells;
+
+	// Head is advanced by the poppers, tail by the pushers.
+	alignas(64) std::atomic<std::size_t> _head = { 0 };
+	alignas(64) std::atomic<std::size_t> _tail = { 0 };
+
+};
+
+} // namespace base
@@ -0,0 +1,103 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/mpsc_ring.h"
+#include <thread>
+#include <vector>
+
+TEST_CASE("mpsc_ring keeps items in order", "[mpsc_ring]") {
+	base::mpsc_ring<int> ring(4);
+	REQUIRE(ring.capacity() == 4);
+	REQUIRE(ring.empty());
+
+	auto value = 0;
+	REQUIRE(!ring.pop(value));
+
+	REQUIRE(ring.push(1));
+	REQUIRE(ring.push(2));
+	REQUIRE(ring.push(3));
+	REQUIRE(ring.push(4));
+	REQUIRE(ring.size() == 4);
+	REQUIRE(!ring.push(5));
+
+	REQUIRE(ring.pop(value));
+	REQUIRE(value == 1);
+	REQUIRE(ring.push(5));
+
+	SECTION("items wrap around the storage end") {
+		auto values = std::vector<int>();
+		while (ring.pop(value)) {
+			values.push_back(value);
+		}
+		REQUIRE(values == std::vector<int>({ 2, 3, 4, 5 }));
+		REQUIRE(ring.empty());
+	}
+
+	SECTION("full ring drops the oldest items") {
+		REQUIRE(ring.push_dropping_oldest(6) == 1);
+		REQUIRE(ring.push_dropping_oldest(7) == 1);
+		auto values = std::vector<int>();
+		while (ring.pop(value)) {
+			values.push_back(value);
+		}
+		REQUIRE(values == std::vector<int>({ 4, 5, 6, 7 }));
+	}
+}
+
+TEST_CASE("mpsc_ring moves items from many threads", "[mpsc_ring]") {
+	constexpr auto kThreads = 4;
+	constexpr auto kCount = 50000;
+	base::mpsc_ring<std::unique_ptr<int>> ring(64);
+
+	auto producers = std::vector<std::thread>();
+	for (auto thread = 0; thread != kThreads; ++thread) {
+		producers.emplace_back([&ring, thread] {
+			for (auto i = 0; i != kCount;) {
+				if (ring.push(std::make_unique<int>(thread * kCount + i))) {
+					++i;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	auto ordered = true;
+	auto expected = std::vector<int>(kThreads, 0);
+	for (auto received = 0; received != kThreads * kCount;) {
+		auto value = std::unique_ptr<int>();
+		if (ring.pop(value)) {
+			const auto thread = *value / kCount;
+			ordered = ordered && (*value % kCount == expected[thread]);
+			++expected[thread];
+			++received;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	for (auto &producer : producers) {
+		producer.join();
+	}
+
+	REQUIRE(ordered);
+	REQUIRE(ring.empty());
+}
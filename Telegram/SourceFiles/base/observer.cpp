@@ -43,6 +43,8 @@ ObservableListWrap &ActiveObservables() {
 	return result;
 }
 
+ObservableCounters Counters;
+
 } // namespace
 
 void RegisterPendingObservable(ObservableCallHandlers *handlers) {
@@ -62,8 +64,16 @@ void UnregisterObservable(ObservableCallHandlers *handlers) {
 	ActiveObservables().list.remove(handlers);
 }
 
+ObservableCounters &RefObservableCounters() {
+	return Counters;
+}
+
 } // namespace internal
 
+ObservableCounters GetObservableCounters() {
+	return internal::RefObservableCounters();
+}
+
 void HandleObservables() {
 	if (internal::CantUseObservables) return;
 	auto &active = internal::ActiveObservables().list;
@@ -22,15 +22,28 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include <vector>
 #include <deque>
+#include <algorithm>
 #include "base/type_traits.h"
 
 namespace base {
+
+// Events passed to notify() of observables that have subscriptions,
+// how many of them were merged with an already pending equal event
+// by notifyCoalesced() and how many were delivered to the handlers.
+struct ObservableCounters {
+	int64 notified = 0;
+	int64 coalesced = 0;
+	int64 delivered = 0;
+};
+ObservableCounters GetObservableCounters();
+
 namespace internal {
 
 using ObservableCallHandlers = base::lambda<void()>;
 void RegisterPendingObservable(ObservableCallHandlers *handlers);
 void UnregisterActiveObservable(ObservableCallHandlers *handlers);
 void UnregisterObservable(ObservableCallHandlers *handlers);
+ObservableCounters &RefObservableCounters();
 
 template <typename EventType>
 struct SubscriptionHandlerHelper {
@@ -136,6 +149,13 @@ public:
 		}
 	}
 
+	// Always asynchronous, skips the event if an equal one is already pending.
+	void notifyCoalesced(EventType event) {
+		if (this->_data) {
+			this->_data->notifyCoalesced(std::move(event));
+		}
+	}
+
 };
 
 template <typename EventType, typename Handler>
@@ -153,6 +173,14 @@ public:
 		}
 	}
 
+	// Always asynchronous, skips the event if an equal one is already pending.
+	void notifyCoalesced(const EventType &event) {
+		if (this->_data) {
+			auto event_copy = event;
+			this->_data->notifyCoalesced(std::move(event_copy));
+		}
+	}
+
 };
 
 } // namespace internal
@@ -254,6 +282,7 @@ public:
 	using CommonObservableData<EventType, Handler>::CommonObservableData;
 
 	void notify(EventType &&event, bool sync) {
+		++RefObservableCounters().notified;
 		if (_handling) {
 			sync = false;
 		}
@@ -273,6 +302,16 @@ public:
 		}
 	}
 
+	void notifyCoalesced(EventType &&event) {
+		if (std::find(_events.begin(), _events.end(), event) != _events.end()) {
+			auto &counters = RefObservableCounters();
+			++counters.notified;
+			++counters.coalesced;
+			return;
+		}
+		notify(std::move(event), false);
+	}
+
 	~ObservableData() {
 		UnregisterObservable(&this->_callHandlers);
 	}
@@ -281,6 +320,7 @@ private:
 	void callHandlers() {
 		_handling = true;
 		auto events = base::take(_events);
+		RefObservableCounters().delivered += events.size();
 		for (auto &event : events) {
 			this->notifyEnumerate([this, &event]() {
 				this->_current->handler(event);
@@ -304,6 +344,7 @@ public:
 	using CommonObservableData<void, Handler>::CommonObservableData;
 
 	void notify(bool sync) {
+		++RefObservableCounters().notified;
 		if (_handling) {
 			sync = false;
 		}
@@ -323,6 +364,16 @@ public:
 		}
 	}
 
+	void notifyCoalesced() {
+		if (_eventsCount) {
+			auto &counters = RefObservableCounters();
+			++counters.notified;
+			++counters.coalesced;
+			return;
+		}
+		notify(false);
+	}
+
 	~ObservableData() {
 		UnregisterObservable(&this->_callHandlers);
 	}
@@ -331,6 +382,7 @@ private:
 	void callHandlers() {
 		_handling = true;
 		auto eventsCount = base::take(_eventsCount);
+		RefObservableCounters().delivered += eventsCount;
 		for (int i = 0; i != eventsCount; ++i) {
 			this->notifyEnumerate([this]() {
 				this->_current->handler();
@@ -357,6 +409,13 @@ public:
 		}
 	}
 
+	// Always asynchronous, skips the event if one is already pending.
+	void notifyCoalesced() {
+		if (this->_data) {
+			this->_data->notifyCoalesced();
+		}
+	}
+
 };
 
 } // namespace internal
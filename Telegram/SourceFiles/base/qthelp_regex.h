@@ -70,17 +70,41 @@ enum class RegExOption {
 using RegExOptions = base::flags<RegExOption>;
 inline constexpr auto is_flag_type(RegExOption) { return true; };
 
+namespace internal {
+
+// Patterns passed to regex_match() are string literals, so the parsed and
+// optimized expressions are kept and shared (QRegularExpression copies
+// share the compiled pattern). Thread: Any.
+inline QRegularExpression CachedRegex(const QString &string, RegExOptions options) {
+	constexpr auto kCacheLimit = 256;
+
+	static QMutex Mutex;
+	static QHash<QPair<QString, int>, QRegularExpression> Cache;
+
+	auto key = qMakePair(string, static_cast<int>(options));
+	QMutexLocker lock(&Mutex);
+	auto i = Cache.constFind(key);
+	if (i == Cache.cend()) {
+		if (Cache.size() >= kCacheLimit) {
+			Cache.clear();
+		}
+		auto qtOptions = QRegularExpression::PatternOptions(static_cast<int>(options));
+		i = Cache.insert(key, QRegularExpression(string, qtOptions));
+	}
+	return i.value();
+}
+
+} // namespace internal
+
 inline RegularExpressionMatch regex_match(const QString &string, const QString &subject, RegExOptions options = 0) {
-	auto qtOptions = QRegularExpression::PatternOptions(static_cast<int>(options));
-	return RegularExpressionMatch(QRegularExpression(string, qtOptions).match(subject));
+	return RegularExpressionMatch(internal::CachedRegex(string, options).match(subject));
 }
 
 inline RegularExpressionMatch regex_match(const QString &string, const QStringRef &subjectRef, RegExOptions options = 0) {
-	auto qtOptions = QRegularExpression::PatternOptions(static_cast<int>(options));
 #ifndef OS_MAC_OLD
-	return RegularExpressionMatch(QRegularExpression(string, qtOptions).match(subjectRef));
+	return RegularExpressionMatch(internal::CachedRegex(string, options).match(subjectRef));
 #else // OS_MAC_OLD
-	return RegularExpressionMatch(QRegularExpression(string, qtOptions).match(subjectRef.toString()));
+	return RegularExpressionMatch(internal::CachedRegex(string, options).match(subjectRef.toString()));
 #endif // OS_MAC_OLD
 }
 
@@ -20,8 +20,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "base/runtime_composer.h"
 
+namespace {
+
+constexpr auto kComposerPageSize = 4096;
+
 struct RuntimeComposerMetadatasMap {
 	QMap<uint64, RuntimeComposerMetadata*> data;
+	QMutex mutex;
 	~RuntimeComposerMetadatasMap() {
 		for_const (const RuntimeComposerMetadata *p, data) {
 			delete p;
@@ -29,21 +34,122 @@ struct RuntimeComposerMetadatasMap {
 	}
 };
 
+RuntimeComposerMetadatasMap &RuntimeComposerMetadatas() {
+	static RuntimeComposerMetadatasMap result;
+	return result;
+}
+
+} // namespace
+
+std::size_t RuntimeComposerMetadata::chunkSize() const {
+	// Each chunk is aligned the same way as the page allocated by new char[].
+	constexpr auto kChunkAlign = alignof(std::max_align_t);
+	return ((size + kChunkAlign - 1) / kChunkAlign) * kChunkAlign;
+}
+
+int RuntimeComposerMetadata::chunksPerPage() const {
+	return qMax(int(kComposerPageSize / chunkSize()), 1);
+}
+
+void *RuntimeComposerMetadata::allocate() const {
+	QMutexLocker lock(&_poolMutex);
+	if (!_free) {
+		auto chunk = chunkSize();
+		auto count = chunksPerPage();
+		auto page = std::make_unique<char[]>(chunk * count);
+		for (auto i = count; i != 0;) {
+			auto result = page.get() + (--i) * chunk;
+			*reinterpret_cast<void**>(result) = _free;
+			_free = result;
+		}
+		_pages.push_back(std::move(page));
+	}
+	auto result = _free;
+	_free = *static_cast<void**>(result);
+	return result;
+}
+
+void RuntimeComposerMetadata::deallocate(void *data) const {
+	QMutexLocker lock(&_poolMutex);
+	*static_cast<void**>(data) = _free;
+	_free = data;
+}
+
+void RuntimeComposerMetadata::trim() const {
+	QMutexLocker lock(&_poolMutex);
+	if (!_free) {
+		return;
+	}
+
+	auto chunk = chunkSize();
+	auto count = chunksPerPage();
+	auto pageBytes = chunk * count;
+	std::sort(_pages.begin(), _pages.end(), [](const std::unique_ptr<char[]> &a, const std::unique_ptr<char[]> &b) {
+		return std::less<char*>()(a.get(), b.get());
+	});
+	auto findPage = [&](void *data) {
+		auto address = static_cast<char*>(data);
+		auto i = std::upper_bound(_pages.begin(), _pages.end(), address, [](char *address, const std::unique_ptr<char[]> &page) {
+			return std::less<char*>()(address, page.get());
+		});
+		Assert(i != _pages.begin());
+		--i;
+		Assert(address < i->get() + pageBytes);
+		return int(i - _pages.begin());
+	};
+
+	auto freeInPage = std::vector<int>(_pages.size(), 0);
+	for (auto i = _free; i != nullptr; i = *static_cast<void**>(i)) {
+		++freeInPage[findPage(i)];
+	}
+	if (std::find(freeInPage.begin(), freeInPage.end(), count) == freeInPage.end()) {
+		return;
+	}
+
+	// Rebuild the free list only from the chunks of the pages we keep.
+	void *kept = nullptr;
+	for (auto i = _free; i != nullptr;) {
+		auto next = *static_cast<void**>(i);
+		if (freeInPage[findPage(i)] != count) {
+			*static_cast<void**>(i) = kept;
+			kept = i;
+		}
+		i = next;
+	}
+	_free = kept;
+
+	auto to = _pages.begin();
+	for (auto from = _pages.begin(), end = _pages.end(); from != end; ++from) {
+		if (freeInPage[from - _pages.begin()] != count) {
+			*to++ = std::move(*from);
+		}
+	}
+	_pages.erase(to, _pages.end());
+}
+
 const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask) {
-	static RuntimeComposerMetadatasMap RuntimeComposerMetadatas;
-	static QMutex RuntimeComposerMetadatasMutex;
+	auto &metadatas = RuntimeComposerMetadatas();
 
-	QMutexLocker lock(&RuntimeComposerMetadatasMutex);
-	auto i = RuntimeComposerMetadatas.data.constFind(mask);
-	if (i == RuntimeComposerMetadatas.data.cend()) {
+	QMutexLocker lock(&metadatas.mutex);
+	auto i = metadatas.data.constFind(mask);
+	if (i == metadatas.data.cend()) {
 		RuntimeComposerMetadata *meta = new RuntimeComposerMetadata(mask);
 		Assert(meta != nullptr);
 
-		i = RuntimeComposerMetadatas.data.insert(mask, meta);
+		i = metadatas.data.insert(mask, meta);
 	}
 	return i.value();
 }
 
+void TrimRuntimeComposerData() {
+	auto &metadatas = RuntimeComposerMetadatas();
+
+	QMutexLocker lock(&metadatas.mutex);
+	for_const (const RuntimeComposerMetadata *meta, metadatas.data) {
+		meta->trim();
+	}
+}
+
 const RuntimeComposerMetadata *RuntimeComposer::ZeroRuntimeComposerMetadata = GetRuntimeComposerMetadata(0);
 
 RuntimeComponentWrapStruct RuntimeComponentWraps[64];
@@ -140,20 +140,38 @@ public:
 		return _mask & (~mask);
 	}
 
+	// Composer data of the same mask is taken from pages of equal chunks,
+	// so items are packed together and freed chunks are reused.
+	void *allocate() const;
+	void deallocate(void *data) const;
+
+	// Returns the pages without any used chunks to the heap.
+	void trim() const;
+
 private:
 	uint64 _mask;
 
+	std::size_t chunkSize() const;
+	int chunksPerPage() const;
+
+	mutable QMutex _poolMutex;
+	mutable std::vector<std::unique_ptr<char[]>> _pages;
+	mutable void *_free = nullptr;
+
 };
 
 const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask);
 
+// Gives the unused composer data pages of all masks back to the heap.
+void TrimRuntimeComposerData();
+
 class RuntimeComposer {
 public:
 	RuntimeComposer(uint64 mask = 0) : _data(zerodata()) {
 		if (mask) {
 			auto meta = GetRuntimeComposerMetadata(mask);
 
-			auto data = operator new(meta->size);
+			auto data = meta->allocate();
 			Assert(data != nullptr);
 
 			_data = data;
@@ -193,7 +211,7 @@ public:
 					RuntimeComponentWraps[i].Destruct(_dataptrunsafe(offset));
 				}
 			}
-			operator delete(_data);
+			meta->deallocate(_data);
 		}
 	}
 
@@ -0,0 +1,103 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace base {
+
+// Fixed capacity queue for exactly one producer thread and one consumer thread.
+//
+// The storage for all the items is allocated once, push() and pop() only
+// move the items and publish the new head / tail with acquire-release atomics.
+// Capacity is rounded up to a power of two, one slot is never used.
+template <typename Type>
+class spsc_ring {
+public:
+	explicit spsc_ring(std::size_t capacity)
+	: _mask(ComputeMask(capacity))
+	, _items(std::make_unique<Type[]>(_mask + 1)) {
+	}
+	spsc_ring(const spsc_ring &other) = delete;
+	spsc_ring &operator=(const spsc_ring &other) = delete;
+
+	// Producer thread. Returns false if the ring is full.
+	bool push(Type &&value) {
+		auto tail = _tail.load(std::memory_order_relaxed);
+		auto next = (tail + 1) & _mask;
+		if (next == _head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		_items[tail] = std::move(value);
+		_tail.store(next, std::memory_order_release);
+		return true;
+	}
+	bool push(const Type &value) {
+		auto copy = value;
+		return push(std::move(copy));
+	}
+
+	// Consumer thread. Returns false if the ring is empty.
+	bool pop(Type &value) {
+		auto head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = std::move(_items[head]);
+		_head.store((head + 1) & _mask, std::memory_order_release);
+		return true;
+	}
+
+	// Any thread, the result may be outdated at once.
+	std::size_t size() const {
+		auto head = _head.load(std::memory_order_acquire);
+		auto tail = _tail.load(std::memory_order_acquire);
+		return (tail - head) & _mask;
+	}
+	bool empty() const {
+		return (size() == 0);
+	}
+	std::size_t capacity() const {
+		return _mask;
+	}
+
+private:
+	static std::size_t ComputeMask(std::size_t capacity) {
+		auto result = std::size_t(1);
+		while (result < capacity + 1) {
+			result <<= 1;
+		}
+		return result - 1;
+	}
+
+	const std::size_t _mask;
+	const std::unique_ptr<Type[]> _items;
+
+	// Head is written only by the consumer, tail only by the producer.
+	alignas(64) std::atomic<std::size_t> _head = { 0 };
+	alignas(64) std::atomic<std::size_t> _tail = { 0 };
+
+};
+
+} // namespace base
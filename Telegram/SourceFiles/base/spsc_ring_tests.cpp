@@ -0,0 +1,83 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/spsc_ring.h"
+#include <thread>
+#include <vector>
+
+TEST_CASE("spsc_ring keeps items in order", "[spsc_ring]") {
+	base::spsc_ring<int> ring(3);
+	REQUIRE(ring.capacity() == 3);
+	REQUIRE(ring.empty());
+
+	auto value = 0;
+	REQUIRE(!ring.pop(value));
+
+	REQUIRE(ring.push(1));
+	REQUIRE(ring.push(2));
+	REQUIRE(ring.push(3));
+	REQUIRE(ring.size() == 3);
+	REQUIRE(!ring.push(4));
+
+	REQUIRE(ring.pop(value));
+	REQUIRE(value == 1);
+	REQUIRE(ring.push(4));
+
+	SECTION("items wrap around the storage end") {
+		auto values = std::vector<int>();
+		while (ring.pop(value)) {
+			values.push_back(value);
+		}
+		REQUIRE(values == std::vector<int>({ 2, 3, 4 }));
+		REQUIRE(ring.empty());
+	}
+}
+
+TEST_CASE("spsc_ring moves items between threads", "[spsc_ring]") {
+	constexpr auto kCount = 100000;
+	base::spsc_ring<std::unique_ptr<int>> ring(64);
+
+	std::thread producer([&ring] {
+		for (auto i = 0; i != kCount;) {
+			if (ring.push(std::make_unique<int>(i))) {
+				++i;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	auto ordered = true;
+	for (auto expected = 0; expected != kCount;) {
+		auto value = std::unique_ptr<int>();
+		if (ring.pop(value)) {
+			ordered = ordered && value && (*value == expected);
+			++expected;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+
+	REQUIRE(ordered);
+	REQUIRE(ring.empty());
+}
@@ -21,7 +21,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "base/task_queue.h"
 
 #include <thread>
+#include <atomic>
 #include <condition_variable>
+#include "core/trace.h"
 
 namespace base {
 namespace {
@@ -29,8 +31,81 @@ namespace {
 auto MainThreadId = std::this_thread::get_id();
 const auto MaxThreadsCount = qMax(std::thread::hardware_concurrency(), 2U);
 
+// Background tasks never take all the cores, so that the normal
+// tasks put after them don't wait for a thread to become vacant.
+const auto MaxBackgroundThreadsCount = qMax(MaxThreadsCount / 2, 1U);
+
 } // namespace
 
+struct TaskGroup::Data {
+	std::atomic<bool> cancelled = { false };
+
+	QMutex mutex;
+	int tasks_count = 0;
+	std::vector<Task> callbacks;
+};
+
+// Lives inside the task put in the group and is destroyed
+// with it, no matter was the task processed or dropped.
+class TaskGroup::Guard {
+public:
+	Guard(const std::shared_ptr<Data> &data) : data_(data) {
+		QMutexLocker lock(&data_->mutex);
+		++data_->tasks_count;
+	}
+	Guard(const Guard &other) = delete;
+	Guard &operator=(const Guard &other) = delete;
+	Guard(Guard &&other) : data_(base::take(other.data_)) {
+	}
+	Guard &operator=(Guard &&other) = delete;
+
+	bool Cancelled() const {
+		return data_->cancelled.load(std::memory_order_acquire);
+	}
+
+	~Guard() {
+		if (!data_) {
+			return;
+		}
+		auto callbacks = std::vector<Task>();
+		{
+			QMutexLocker lock(&data_->mutex);
+			if (!--data_->tasks_count) {
+				callbacks = base::take(data_->callbacks);
+			}
+		}
+		for (auto &callback : callbacks) {
+			TaskQueue::Main().Put(std::move(callback));
+		}
+	}
+
+private:
+	std::shared_ptr<Data> data_;
+
+};
+
+TaskGroup::TaskGroup() : data_(std::make_shared<Data>()) {
+}
+
+void TaskGroup::Cancel() {
+	data_->cancelled.store(true, std::memory_order_release);
+}
+
+bool TaskGroup::Cancelled() const {
+	return data_->cancelled.load(std::memory_order_acquire);
+}
+
+void TaskGroup::WhenFinished(Task &&callback) {
+	{
+		QMutexLocker lock(&data_->mutex);
+		if (data_->tasks_count > 0) {
+			data_->callbacks.push_back(std::move(callback));
+			return;
+		}
+	}
+	TaskQueue::Main().Put(std::move(callback));
+}
+
 class TaskQueue::TaskQueueList {
 public:
 	TaskQueueList();
@@ -64,6 +139,7 @@ public:
 
 	void AddQueueTask(TaskQueue *queue, Task &&task);
 	void RemoveQueue(TaskQueue *queue);
+	Counters GetQueueCounters(const TaskQueue *queue);
 
 	~TaskThreadPool();
 
@@ -175,9 +251,10 @@ TaskQueue *TaskQueue::TaskQueueList::TakeFirst(int list_index_) {
 }
 
 void TaskQueue::TaskThreadPool::AddQueueTask(TaskQueue *queue, Task &&task) {
+	auto put_time = getms();
 	QMutexLocker lock(&queues_mutex_);
 
-	queue->tasks_.push_back(std::move(task));
+	queue->tasks_.push_back({ std::move(task), put_time });
 	auto list_was_empty = queue_list_.Empty(kAllQueuesList);
 	auto threads_count = threads_.size();
 	auto all_threads_processing = (threads_count == tasks_in_process_);
@@ -193,8 +270,8 @@ void TaskQueue::TaskThreadPool::AddQueueTask(TaskQueue *queue, Task &&task) {
 		threads_.emplace_back([this]() {
 			ThreadFunction();
 		});
-	} else if (some_threads_are_vacant) {
-		Assert(threads_count > tasks_in_process_);
+	} else if (threads_count > tasks_in_process_) {
+		// Some vacant thread may wait because of the background tasks limit.
 		thread_condition_.wakeOne();
 	}
 }
@@ -209,6 +286,11 @@ void TaskQueue::TaskThreadPool::RemoveQueue(TaskQueue *queue) {
 	}
 }
 
+TaskQueue::Counters TaskQueue::TaskThreadPool::GetQueueCounters(const TaskQueue *queue) {
+	QMutexLocker lock(&queues_mutex_);
+	return queue->counters_;
+}
+
 TaskQueue::TaskThreadPool::~TaskThreadPool() {
 	{
 		QMutexLocker lock(&queues_mutex_);
@@ -238,6 +320,11 @@ void TaskQueue::TaskThreadPool::ThreadFunction() {
 	TaskQueue *serial_queue = nullptr;
 	bool serial_queue_destroyed = false;
 	bool task_was_processed = false;
+
+	// The queue of the previous processed task, for the counters.
+	// Concurrent queues are never destroyed while the pool is alive.
+	TaskQueue *processed_queue = nullptr;
+	TimeMs put_time = 0, start_time = 0, finish_time = 0;
 	while (true) {
 		Task task;
 		{
@@ -246,10 +333,18 @@ void TaskQueue::TaskThreadPool::ThreadFunction() {
 			// Finish the previous task processing.
 			if (task_was_processed) {
 				--tasks_in_process_;
+				if (processed_queue && !(processed_queue == serial_queue && serial_queue_destroyed)) {
+					processed_queue->CountProcessed(put_time, start_time, finish_time);
+				}
+				processed_queue = nullptr;
 			}
 			if (background_task) {
 				--background_tasks_in_process_;
 				background_task = false;
+				if (!queue_list_.Empty(kAllQueuesList)) {
+					// Some vacant thread may wait because of the background tasks limit.
+					thread_condition_.wakeOne();
+				}
 			}
 			if (serial_queue) {
 				if (!serial_queue_destroyed) {
@@ -263,7 +358,11 @@ void TaskQueue::TaskThreadPool::ThreadFunction() {
 			}
 
 			// Wait for a task to appear in the queues list.
-			while (queue_list_.Empty(kAllQueuesList)) {
+			auto background_limit_reached = [this] {
+				return (background_tasks_in_process_ >= int(MaxBackgroundThreadsCount));
+			};
+			while (queue_list_.Empty(kAllQueuesList)
+				|| (background_limit_reached() && queue_list_.Empty(kOnlyNormalQueuesList))) {
 				if (stopped_) {
 					return;
 				}
@@ -278,8 +377,10 @@ void TaskQueue::TaskThreadPool::ThreadFunction() {
 
 			Assert(!queue->tasks_.empty());
 
-			task = std::move(queue->tasks_.front());
+			task = std::move(queue->tasks_.front().task);
+			put_time = queue->tasks_.front().put_time;
 			queue->tasks_.pop_front();
+			processed_queue = queue;
 
 			if (queue->type_ == Type::Serial) {
 				// Serial queues are returned in the list for processing
@@ -299,7 +400,12 @@ void TaskQueue::TaskThreadPool::ThreadFunction() {
 			}
 		}
 
-		task();
+		start_time = getms();
+		{
+			TRACE_SCOPE("TaskQueue task");
+			task();
+		}
+		finish_time = getms();
 	}
 }
 
@@ -321,8 +427,9 @@ TaskQueue::~TaskQueue() {
 
 void TaskQueue::Put(Task &&task) {
 	if (type_ == Type::Main) {
+		auto put_time = getms();
 		QMutexLocker lock(&tasks_mutex_);
-		tasks_.push_back(std::move(task));
+		tasks_.push_back({ std::move(task), put_time });
 
 		Sandbox::MainThreadTaskAdded();
 	} else {
@@ -331,6 +438,34 @@ void TaskQueue::Put(Task &&task) {
 	}
 }
 
+void TaskQueue::Put(Task &&task, const TaskGroup &group) {
+	Put([task = std::move(task), guard = TaskGroup::Guard(group.data_)]() mutable {
+		if (!guard.Cancelled()) {
+			task();
+		}
+	});
+}
+
+TaskQueue::Counters TaskQueue::GetCounters() const {
+	if (type_ == Type::Main) {
+		QMutexLocker lock(&tasks_mutex_);
+		return counters_;
+	}
+	Assert(type_ != Type::Special);
+	if (auto thread_pool = weak_thread_pool_.lock()) {
+		return thread_pool->GetQueueCounters(this);
+	}
+	return counters_;
+}
+
+void TaskQueue::CountProcessed(TimeMs put_time, TimeMs start_time, TimeMs finish_time) {
+	auto waited = start_time - put_time;
+	++counters_.processed;
+	counters_.waited += waited;
+	accumulate_max(counters_.maxWaited, waited);
+	counters_.spent += finish_time - start_time;
+}
+
 void TaskQueue::ProcessMainTasks() { // static
 	Assert(std::this_thread::get_id() == MainThreadId);
 
@@ -351,6 +486,7 @@ void TaskQueue::ProcessMainTasks(TimeMs max_time_spent) { // static
 
 bool TaskQueue::ProcessOneMainTask() { // static
 	Task task;
+	auto put_time = TimeMs(0);
 	{
 		QMutexLocker lock(&Main().tasks_mutex_);
 		auto &tasks = Main().tasks_;
@@ -358,11 +494,17 @@ bool TaskQueue::ProcessOneMainTask() { // static
 			return false;
 		}
 
-		task = std::move(tasks.front());
+		task = std::move(tasks.front().task);
+		put_time = tasks.front().put_time;
 		tasks.pop_front();
 	}
 
+	auto start_time = getms();
 	task();
+	auto finish_time = getms();
+
+	QMutexLocker lock(&Main().tasks_mutex_);
+	Main().CountProcessed(put_time, start_time, finish_time);
 	return true;
 }
 
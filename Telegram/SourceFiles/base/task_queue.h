@@ -26,6 +26,31 @@ namespace base {
 
 using Task = lambda_once<void()>;
 
+class TaskQueue;
+
+// A set of tasks which can be cancelled together or waited for together.
+// Tasks may be put in the group to different queues.
+class TaskGroup {
+public:
+	TaskGroup();
+
+	// The tasks that were not started yet are dropped, the running ones finish.
+	void Cancel();
+	bool Cancelled() const;
+
+	// The callback is put to the main queue when all the tasks put in
+	// the group so far are finished or dropped (right away if there are none).
+	void WhenFinished(Task &&callback);
+
+private:
+	friend class TaskQueue;
+
+	struct Data;
+	class Guard;
+	std::shared_ptr<Data> data_;
+
+};
+
 // An attempt to create/use a TaskQueue or one of the default queues
 // after the main() has returned leads to an undefined behaviour.
 class TaskQueue {
@@ -52,6 +77,15 @@ public:
 	static TaskQueue &Background();
 
 	void Put(Task &&task);
+	void Put(Task &&task, const TaskGroup &group);
+
+	struct Counters {
+		int64 processed = 0;
+		TimeMs waited = 0; // Total time the tasks spent in the queue.
+		TimeMs maxWaited = 0;
+		TimeMs spent = 0; // Total time spent in the tasks.
+	};
+	Counters GetCounters() const;
 
 	static void ProcessMainTasks();
 	static void ProcessMainTasks(TimeMs max_time_spent);
@@ -71,8 +105,17 @@ private:
 	const Type type_;
 	const Priority priority_;
 
-	std::deque<Task> tasks_;
-	QMutex tasks_mutex_; // Only for the main queue.
+	struct QueuedTask {
+		Task task;
+		TimeMs put_time = 0;
+	};
+	std::deque<QueuedTask> tasks_;
+	mutable QMutex tasks_mutex_; // Only for the main queue.
+
+	// Guarded by the tasks_mutex_ for the main queue and by the
+	// thread pool queues mutex for the other queues.
+	Counters counters_;
+	void CountProcessed(TimeMs put_time, TimeMs start_time, TimeMs finish_time);
 
 	// Only for the other queues, not main.
 	class TaskThreadPool;
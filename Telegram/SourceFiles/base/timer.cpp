@@ -23,6 +23,18 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 namespace base {
 namespace {
 
+// The timer wheel resolution, all the coarse timers are fired at tick boundaries.
+constexpr auto kTickDuration = TimeMs(50);
+
+// Each level has kSlotsCount slots, a slot of the level N covers kSlotsCount ^ N ticks.
+constexpr auto kSlotsShift = 6;
+constexpr auto kSlotsCount = (1 << kSlotsShift);
+constexpr auto kSlotsMask = kSlotsCount - 1;
+constexpr auto kLevelsCount = 4;
+
+// A fake _timerId value for timers in the wheel.
+constexpr auto kWheelTimerId = -1;
+
 QObject *TimersAdjuster() {
 	static QObject adjuster;
 	return &adjuster;
@@ -30,6 +42,169 @@ QObject *TimersAdjuster() {
 
 } // namespace
 
+class TimerWheel final : public QObject {
+public:
+	static bool Available(QThread *thread) {
+		auto application = QCoreApplication::instance();
+		return application && (thread == application->thread());
+	}
+	static TimerWheel *Instance() {
+		// Not destroyed: Timers may be destroyed after the static objects.
+		static auto result = new TimerWheel();
+		return result;
+	}
+
+	void add(Timer *timer);
+	void remove(Timer *timer);
+
+protected:
+	void timerEvent(QTimerEvent *e) override;
+
+private:
+	void insert(Timer *timer, int64 minTick);
+	void processTick(int64 tick);
+	void cascade(int level, int64 tick);
+	void schedule();
+	int64 findNextTick() const;
+
+	std::vector<Timer*> &slot(int level, int64 index) {
+		return _slots[level * kSlotsCount + (index & kSlotsMask)];
+	}
+	const std::vector<Timer*> &slot(int level, int64 index) const {
+		return _slots[level * kSlotsCount + (index & kSlotsMask)];
+	}
+
+	std::array<std::vector<Timer*>, kLevelsCount * kSlotsCount> _slots;
+	int64 _currentTick = 0; // All the ticks up to this one are processed.
+	int _count = 0;
+
+	int _timerId = 0;
+	int64 _timerTick = 0;
+
+};
+
+void TimerWheel::add(Timer *timer) {
+	Expects(timer->_wheelSlot < 0);
+
+	if (!_count) {
+		_currentTick = getms(true) / kTickDuration;
+	}
+	insert(timer, _currentTick + 1);
+	++_count;
+	if (!_timerId || _timerTick > (timer->_next + kTickDuration - 1) / kTickDuration) {
+		schedule();
+	}
+}
+
+void TimerWheel::insert(Timer *timer, int64 minTick) {
+	auto tick = qMax((timer->_next + kTickDuration - 1) / kTickDuration, minTick);
+	auto delta = tick - _currentTick;
+	auto level = 0;
+	while (level + 1 < kLevelsCount && delta >= (int64(1) << (kSlotsShift * (level + 1)))) {
+		++level;
+	}
+	auto maxDelta = (int64(1) << (kSlotsShift * kLevelsCount)) - 1;
+	if (delta > maxDelta) {
+		// It will be inserted once again when its slot is cascaded.
+		tick = _currentTick + maxDelta;
+	}
+	auto index = (tick >> (kSlotsShift * level));
+	auto &list = slot(level, index);
+	timer->_wheelSlot = level * kSlotsCount + int(index & kSlotsMask);
+	timer->_wheelIndex = int(list.size());
+	list.push_back(timer);
+}
+
+void TimerWheel::remove(Timer *timer) {
+	if (timer->_wheelSlot < 0) {
+		return;
+	}
+	auto &list = _slots[timer->_wheelSlot];
+	Assert(timer->_wheelIndex < int(list.size()) && list[timer->_wheelIndex] == timer);
+	if (timer->_wheelIndex + 1 < int(list.size())) {
+		auto moved = list.back();
+		moved->_wheelIndex = timer->_wheelIndex;
+		list[timer->_wheelIndex] = moved;
+	}
+	list.pop_back();
+	timer->_wheelSlot = -1;
+	--_count;
+}
+
+void TimerWheel::timerEvent(QTimerEvent *e) {
+	killTimer(base::take(_timerId));
+
+	auto now = getms(true) / kTickDuration;
+	while (_currentTick < now) {
+		if (!_count) {
+			_currentTick = now;
+			break;
+		}
+		processTick(++_currentTick);
+	}
+	if (_count) {
+		schedule();
+	}
+}
+
+void TimerWheel::processTick(int64 tick) {
+	for (auto level = 1; level != kLevelsCount; ++level) {
+		if (tick & ((int64(1) << (kSlotsShift * level)) - 1)) {
+			break;
+		}
+		cascade(level, tick);
+	}
+
+	// Callbacks may cancel or restart timers, so take them one by one.
+	auto &list = slot(0, tick);
+	while (!list.empty()) {
+		auto timer = list.back();
+		list.pop_back();
+		timer->_wheelSlot = -1;
+		--_count;
+		timer->wheelTimeout();
+	}
+}
+
+void TimerWheel::cascade(int level, int64 tick) {
+	auto list = base::take(slot(level, tick >> (kSlotsShift * level)));
+	for (auto timer : list) {
+		// The timers due in this tick go to the level 0 slot processed right now.
+		insert(timer, _currentTick);
+	}
+}
+
+int64 TimerWheel::findNextTick() const {
+	auto result = int64(0);
+	for (auto level = 0; level != kLevelsCount; ++level) {
+		auto shift = kSlotsShift * level;
+		auto current = (_currentTick >> shift);
+		for (auto i = 1; i <= kSlotsCount; ++i) {
+			auto tick = (current + i) << shift;
+			if (result && tick >= result) {
+				break;
+			} else if (!slot(level, current + i).empty()) {
+				result = tick;
+				break;
+			}
+		}
+	}
+	return result;
+}
+
+void TimerWheel::schedule() {
+	if (_timerId) {
+		killTimer(base::take(_timerId));
+	}
+	if (!_count) {
+		return;
+	}
+	_timerTick = findNextTick();
+	Assert(_timerTick > 0);
+	auto timeout = qMax(_timerTick * kTickDuration - getms(true), TimeMs(0));
+	_timerId = startTimer(int(qMin(timeout, TimeMs(std::numeric_limits<int>::max()))), Qt::PreciseTimer);
+}
+
 Timer::Timer(base::lambda<void()> callback) : QObject(nullptr)
 , _callback(std::move(callback))
 , _type(Qt::PreciseTimer)
@@ -45,16 +220,29 @@ void Timer::start(TimeMs timeout, Qt::TimerType type, Repeat repeat) {
 	setRepeat(repeat);
 	_adjusted = false;
 	setTimeout(timeout);
-	_timerId = startTimer(_timeout, _type);
+	schedule(_timeout);
+}
+
+void Timer::schedule(TimeMs timeout) {
+	if (_type != Qt::PreciseTimer && TimerWheel::Available(thread())) {
+		_timerId = kWheelTimerId;
+		_next = getms(true) + timeout;
+		TimerWheel::Instance()->add(this);
+		return;
+	}
+	_timerId = startTimer(timeout, _type);
 	if (_timerId) {
-		_next = getms(true) + _timeout;
+		_next = getms(true) + timeout;
 	} else {
 		_next = 0;
 	}
 }
 
 void Timer::cancel() {
-	if (isActive()) {
+	if (_timerId == kWheelTimerId) {
+		_timerId = 0;
+		TimerWheel::Instance()->remove(this);
+	} else if (isActive()) {
 		killTimer(base::take(_timerId));
 	}
 }
@@ -76,7 +264,7 @@ void Timer::adjust() {
 	auto remaining = remainingTime();
 	if (remaining >= 0) {
 		cancel();
-		_timerId = startTimer(remaining, _type);
+		schedule(remaining);
 		_adjusted = true;
 	}
 }
@@ -106,6 +294,21 @@ void Timer::timerEvent(QTimerEvent *e) {
 	}
 }
 
+void Timer::wheelTimeout() {
+	_timerId = 0;
+	if (repeat() == Repeat::Interval) {
+		schedule(_timeout);
+	}
+
+	if (_callback) {
+		_callback();
+	}
+}
+
+Timer::~Timer() {
+	cancel();
+}
+
 int DelayedCallTimer::call(TimeMs timeout, lambda_once<void()> callback, Qt::TimerType type) {
 	Expects(timeout >= 0);
 	if (!callback) {
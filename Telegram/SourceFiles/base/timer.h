@@ -25,6 +25,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace base {
 
+class TimerWheel;
+
+// Coarse timers of the main thread are not registered in Qt one by one, they
+// all are put in one TimerWheel that wakes up once for all the timers due
+// in the same tick. Precise timers (animations, short timeouts) use Qt timers.
 class Timer final : private QObject {
 public:
 	Timer(base::lambda<void()> callback = base::lambda<void()>());
@@ -63,16 +68,22 @@ public:
 
 	static void Adjust();
 
+	~Timer();
+
 protected:
 	void timerEvent(QTimerEvent *e) override;
 
 private:
+	friend class TimerWheel;
+
 	enum class Repeat : unsigned {
 		Interval   = 0,
 		SingleShot = 1,
 	};
 	void start(TimeMs timeout, Qt::TimerType type, Repeat repeat);
+	void schedule(TimeMs timeout);
 	void adjust();
+	void wheelTimeout();
 
 	void setTimeout(TimeMs timeout);
 	int timeout() const;
@@ -88,6 +99,8 @@ private:
 	TimeMs _next = 0;
 	int _timeout = 0;
 	int _timerId = 0;
+	int _wheelSlot = -1;
+	int _wheelIndex = 0;
 
 	Qt::TimerType _type : 2;
 	bool _adjusted : 1;
@@ -181,6 +181,16 @@ void BackgroundBox::Inner::paintEvent(QPaintEvent *e) {
 	if (_rows) {
 		for (int i = 0; i < _rows; ++i) {
 			if ((st::backgroundSize.height() + st::backgroundPadding) * (i + 1) <= r.top()) continue;
+			if (st::backgroundPadding + (st::backgroundSize.height() + st::backgroundPadding) * i >= r.y() + r.height()) {
+				// Start loading the row below the visible area and stop.
+				for (int j = 0; j < BackgroundsInRow; ++j) {
+					int index = i * BackgroundsInRow + j;
+					if (index >= _bgCount) break;
+
+					App::cServerBackgrounds().at(index).thumb->load();
+				}
+				break;
+			}
 			for (int j = 0; j < BackgroundsInRow; ++j) {
 				int index = i * BackgroundsInRow + j;
 				if (index >= _bgCount) break;
@@ -28,7 +28,6 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/widgets/checkbox.h"
 #include "ui/widgets/buttons.h"
 #include "ui/widgets/input_fields.h"
-#include "history/history_location_manager.h"
 #include "styles/style_boxes.h"
 
 void ConnectionBox::ShowApplyProxyConfirmation(const QMap<QString, QString> &fields) {
@@ -48,7 +47,6 @@ void ConnectionBox::ShowApplyProxyConfirmation(const QMap<QString, QString> &fie
 			Local::writeSettings();
 			Global::RefConnectionTypeChanged().notify();
 			MTP::restart();
-			reinitLocationManager();
 			reinitWebLoadManager();
 			if (*weakBox) (*weakBox)->closeBox();
 		}), KeepOtherLayers);
@@ -250,7 +248,6 @@ void ConnectionBox::onSave() {
 		Global::RefConnectionTypeChanged().notify();
 
 		MTP::restart();
-		reinitLocationManager();
 		reinitWebLoadManager();
 		closeBox();
 	}
@@ -309,9 +306,8 @@ void AutoDownloadBox::onSave() {
 		bool enabledGroups = ((cAutoDownloadPhoto() & dbiadNoGroups) && !(autoDownloadPhoto & dbiadNoGroups));
 		cSetAutoDownloadPhoto(autoDownloadPhoto);
 		if (enabledPrivate || enabledGroups) {
-			const PhotosData &data(App::photosData());
-			for (PhotosData::const_iterator i = data.cbegin(), e = data.cend(); i != e; ++i) {
-				i.value()->automaticLoadSettingsChanged();
+			for (auto &entry : App::photosData()) {
+				entry.second->automaticLoadSettingsChanged();
 			}
 		}
 		changed = true;
@@ -322,9 +318,9 @@ void AutoDownloadBox::onSave() {
 		bool enabledGroups = ((cAutoDownloadAudio() & dbiadNoGroups) && !(autoDownloadAudio & dbiadNoGroups));
 		cSetAutoDownloadAudio(autoDownloadAudio);
 		if (enabledPrivate || enabledGroups) {
-			for (auto document : App::documentsData()) {
-				if (document->voice()) {
-					document->automaticLoadSettingsChanged();
+			for (auto &entry : App::documentsData()) {
+				if (entry.second->voice()) {
+					entry.second->automaticLoadSettingsChanged();
 				}
 			}
 		}
@@ -336,9 +332,9 @@ void AutoDownloadBox::onSave() {
 		bool enabledGroups = ((cAutoDownloadGif() & dbiadNoGroups) && !(autoDownloadGif & dbiadNoGroups));
 		cSetAutoDownloadGif(autoDownloadGif);
 		if (enabledPrivate || enabledGroups) {
-			for (auto document : App::documentsData()) {
-				if (document->isAnimation()) {
-					document->automaticLoadSettingsChanged();
+			for (auto &entry : App::documentsData()) {
+				if (entry.second->isAnimation()) {
+					entry.second->automaticLoadSettingsChanged();
 				}
 			}
 		}
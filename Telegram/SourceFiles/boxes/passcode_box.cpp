@@ -262,9 +262,8 @@ bool PasscodeBox::setPasswordFail(const RPCError &error) {
 }
 
 void PasscodeBox::onSave(bool force) {
-	if (_setRequest) return;
+	if (_setRequest || _localPasscodeRequest) return;
 
-	QString old = _oldPasscode->text(), pwd = _newPasscode->text(), conf = _reenterPasscode->text();
 	bool has = _cloudPwd ? (!_curSalt.isEmpty()) : Global::LocalPasscode();
 	if (!_cloudPwd && (_turningOff || has)) {
 		if (!passcodeCanTry()) {
@@ -275,15 +274,28 @@ void PasscodeBox::onSave(bool force) {
 			return;
 		}
 
-		if (Local::checkPasscode(old.toUtf8())) {
-			cSetPasscodeBadTries(0);
-			if (_turningOff) pwd = conf = QString();
-		} else {
-			cSetPasscodeBadTries(cPasscodeBadTries() + 1);
-			cSetPasscodeLastTry(getms(true));
-			onBadOldPasscode();
-			return;
-		}
+		_localPasscodeRequest = true;
+		Local::checkPasscode(_oldPasscode->text().toUtf8(), base::lambda_guarded(this, [this, force](bool correct) {
+			_localPasscodeRequest = false;
+			if (correct) {
+				cSetPasscodeBadTries(0);
+				save(force);
+			} else {
+				cSetPasscodeBadTries(cPasscodeBadTries() + 1);
+				cSetPasscodeLastTry(getms(true));
+				onBadOldPasscode();
+			}
+		}));
+		return;
+	}
+	save(force);
+}
+
+void PasscodeBox::save(bool force) {
+	QString old = _oldPasscode->text(), pwd = _newPasscode->text(), conf = _reenterPasscode->text();
+	bool has = _cloudPwd ? (!_curSalt.isEmpty()) : Global::LocalPasscode();
+	if (!_cloudPwd && _turningOff) {
+		pwd = conf = QString();
 	}
 	if (!_turningOff && pwd.isEmpty()) {
 		_newPasscode->setFocus();
@@ -344,9 +356,12 @@ void PasscodeBox::onSave(bool force) {
 		}
 	} else {
 		cSetPasscodeBadTries(0);
-		Local::setPasscode(pwd.toUtf8());
-		Auth().checkAutoLock();
-		closeBox();
+		_localPasscodeRequest = true;
+		Local::setPasscode(pwd.toUtf8(), base::lambda_guarded(this, [this] {
+			_localPasscodeRequest = false;
+			Auth().checkAutoLock();
+			closeBox();
+		}));
 	}
 }
 
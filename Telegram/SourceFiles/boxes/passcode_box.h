@@ -58,6 +58,9 @@ protected:
 private:
 	void closeReplacedBy();
 
+	// Called after the old local passcode was checked, if it was needed.
+	void save(bool force);
+
 	void setPasswordDone(const MTPBool &result);
 	bool setPasswordFail(const RPCError &error);
 
@@ -71,6 +74,7 @@ private:
 	bool _turningOff = false;
 	bool _cloudPwd = false;
 	mtpRequestId _setRequest = 0;
+	bool _localPasscodeRequest = false;
 
 	QByteArray _newSalt, _curSalt;
 	bool _hasRecovery = false;
@@ -29,6 +29,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/effects/round_checkbox.h"
 #include "ui/effects/ripple_animation.h"
 #include "ui/effects/widget_slide_wrap.h"
+#include "ui/userpic_atlas.h"
 #include "lang/lang_keys.h"
 #include "observer_peer.h"
 #include "storage/file_download.h"
@@ -455,7 +456,7 @@ void PeerListRow::paintUserpic(Painter &p, TimeMs ms, int x, int y, int outerWid
 	} else if (_checkbox) {
 		_checkbox->paint(p, ms, x, y, outerWidth);
 	} else {
-		peer()->paintUserpicLeft(p, x, y, outerWidth, st::contactsPhotoSize);
+		Ui::UserpicAtlas::ForSize(st::contactsPhotoSize).paint(p, peer(), x, y, outerWidth);
 	}
 }
 
@@ -566,8 +567,16 @@ void PeerListBox::Inner::appendSearchRow(std::unique_ptr<PeerListRow> row) {
 
 void PeerListBox::Inner::appendFoundRow(not_null<PeerListRow*> row) {
 	Expects(showingSearch());
-	auto index = findRowIndex(row);
-	if (index.value < 0) {
+	auto localResultsComplete = (_localResultsQuery == _normalizedSearchQuery);
+	if (localResultsComplete && !row->isSearchResult() && rowMatchesSearch(row)) {
+		// This row is already in the local results.
+		return;
+	}
+
+	// Rows from the server are appended after the local results,
+	// so we don't scan all the (possibly very long) local results.
+	auto from = _filterResults.begin() + (localResultsComplete ? _localResultsCount : 0);
+	if (std::find(from, _filterResults.end(), row) == _filterResults.end()) {
 		_filterResults.push_back(row);
 	}
 }
@@ -607,6 +616,7 @@ void PeerListBox::Inner::addToSearchIndex(not_null<PeerListRow*> row) {
 	}
 
 	removeFromSearchIndex(row);
+	_localResultsQuery = QString();
 	row->setNameFirstChars(row->peer()->chars);
 	for_const (auto ch, row->nameFirstChars()) {
 		_searchIndex[ch].push_back(row);
@@ -665,6 +675,20 @@ void PeerListBox::Inner::refreshIndices() {
 	}
 }
 
+void PeerListBox::Inner::restoreRowsSelection(PeerListRow *selected, PeerListRow *pressed) {
+	if (showingSearch()) {
+		// Filter results are not reordered, indices stay valid.
+		return;
+	}
+	if (selected) {
+		_selected.index = RowIndex(selected->absoluteIndex());
+	}
+	if (pressed) {
+		_pressed.index = RowIndex(pressed->absoluteIndex());
+	}
+	update();
+}
+
 void PeerListBox::Inner::removeRowAtIndex(std::vector<std::unique_ptr<PeerListRow>> &from, int index) {
 	from.erase(from.begin() + index);
 	for (auto i = index, count = int(from.size()); i != count; ++i) {
@@ -692,7 +716,13 @@ void PeerListBox::Inner::removeRow(not_null<PeerListRow*> row) {
 	auto &byPeer = _rowsByPeer[row->peer()];
 	byPeer.erase(std::remove(byPeer.begin(), byPeer.end(), row), byPeer.end());
 	removeFromSearchIndex(row);
-	_filterResults.erase(std::find(_filterResults.begin(), _filterResults.end(), row), _filterResults.end());
+	auto filtered = std::find(_filterResults.begin(), _filterResults.end(), row);
+	if (filtered != _filterResults.end()) {
+		if (filtered - _filterResults.begin() < _localResultsCount) {
+			--_localResultsCount;
+		}
+		_filterResults.erase(filtered);
+	}
 	removeRowAtIndex(eraseFrom, index);
 
 	restoreSelection();
@@ -1096,45 +1126,18 @@ void PeerListBox::Inner::searchQueryChanged(QString query) {
 	auto searchWordsList = TextUtilities::PrepareSearchWords(query);
 	auto normalizedQuery = searchWordsList.isEmpty() ? QString() : searchWordsList.join(' ');
 	if (_normalizedSearchQuery != normalizedQuery) {
+		// If the query was only extended by typing more characters every row
+		// matching the new query matched the previous one as well, so we can
+		// filter the previous local results instead of the whole index.
+		auto previousResults = std::vector<not_null<PeerListRow*>>();
+		if (!_normalizedSearchQuery.isEmpty()
+			&& _localResultsQuery == _normalizedSearchQuery
+			&& normalizedQuery.startsWith(_normalizedSearchQuery)) {
+			previousResults.assign(_filterResults.begin(), _filterResults.begin() + _localResultsCount);
+		}
 		setSearchQuery(query, normalizedQuery);
-		if (_controller->searchInLocal() && !searchWordsList.isEmpty()) {
-			auto minimalList = (const std::vector<not_null<PeerListRow*>>*)nullptr;
-			for_const (auto &searchWord, searchWordsList) {
-				auto searchWordStart = searchWord[0].toLower();
-				auto it = _searchIndex.find(searchWordStart);
-				if (it == _searchIndex.cend()) {
-					// Some word can't be found in any row.
-					minimalList = nullptr;
-					break;
-				} else if (!minimalList || minimalList->size() > it->second.size()) {
-					minimalList = &it->second;
-				}
-			}
-			if (minimalList) {
-				auto searchWordInNames = [](PeerData *peer, const QString &searchWord) {
-					for_const (auto &nameWord, peer->names) {
-						if (nameWord.startsWith(searchWord)) {
-							return true;
-						}
-					}
-					return false;
-				};
-				auto allSearchWordsInNames = [searchWordInNames, &searchWordsList](PeerData *peer) {
-					for_const (auto &searchWord, searchWordsList) {
-						if (!searchWordInNames(peer, searchWord)) {
-							return false;
-						}
-					}
-					return true;
-				};
-
-				_filterResults.reserve(minimalList->size());
-				for_const (auto row, *minimalList) {
-					if (allSearchWordsInNames(row->peer())) {
-						_filterResults.push_back(row);
-					}
-				}
-			}
+		if (_controller->searchInLocal() && !_searchWords.isEmpty()) {
+			searchInLocalIndex(std::move(previousResults));
 		}
 		if (_controller->hasComplexSearch()) {
 			_controller->search(_searchQuery);
@@ -1144,13 +1147,66 @@ void PeerListBox::Inner::searchQueryChanged(QString query) {
 	}
 }
 
+void PeerListBox::Inner::searchInLocalIndex(std::vector<not_null<PeerListRow*>> &&previousResults) {
+	auto narrowing = !previousResults.empty();
+	auto minimalList = narrowing ? &previousResults : nullptr;
+	if (!narrowing) {
+		for_const (auto &searchWord, _searchWords) {
+			auto searchWordStart = searchWord[0].toLower();
+			auto it = _searchIndex.find(searchWordStart);
+			if (it == _searchIndex.cend()) {
+				// Some word can't be found in any row.
+				minimalList = nullptr;
+				break;
+			} else if (!minimalList || minimalList->size() > it->second.size()) {
+				minimalList = &it->second;
+			}
+		}
+	}
+	if (minimalList) {
+		_filterResults.reserve(minimalList->size());
+		for_const (auto row, *minimalList) {
+			if (rowMatchesSearch(row)) {
+				_filterResults.push_back(row);
+			}
+		}
+		// Index entries are not kept in the rows order, see reorderRows().
+		std::sort(_filterResults.begin(), _filterResults.end(), [](not_null<PeerListRow*> a, not_null<PeerListRow*> b) {
+			return (a->absoluteIndex() < b->absoluteIndex());
+		});
+	}
+	_localResultsCount = _filterResults.size();
+	_localResultsQuery = _normalizedSearchQuery;
+}
+
+bool PeerListBox::Inner::rowMatchesSearch(not_null<PeerListRow*> row) const {
+	auto &names = row->peer()->names;
+	auto searchWordInNames = [&names](const QString &searchWord) {
+		for_const (auto &nameWord, names) {
+			if (nameWord.startsWith(searchWord)) {
+				return true;
+			}
+		}
+		return false;
+	};
+	for_const (auto &searchWord, _searchWords) {
+		if (!searchWordInNames(searchWord)) {
+			return false;
+		}
+	}
+	return true;
+}
+
 void PeerListBox::Inner::setSearchQuery(const QString &query, const QString &normalizedQuery) {
 	setSelected(Selected());
 	setPressed(Selected());
 	_searchQuery = query;
 	_normalizedSearchQuery = normalizedQuery;
+	_searchWords = normalizedQuery.isEmpty() ? QStringList() : normalizedQuery.split(' ');
 	_mentionHighlight = _searchQuery.startsWith('@') ? _searchQuery.mid(1) : _searchQuery;
 	_filterResults.clear();
+	_localResultsCount = 0;
+	_localResultsQuery = QString();
 	clearSearchRows();
 }
 
@@ -94,7 +94,7 @@ public:
 	}
 
 	void refreshName();
-	const Text &name() const {
+	const SingleLineText &name() const {
 		return _name;
 	}
 
@@ -166,7 +166,7 @@ private:
 	not_null<PeerData*> _peer;
 	std::unique_ptr<Ui::RippleAnimation> _ripple;
 	std::unique_ptr<Ui::RoundImageCheckbox> _checkbox;
-	Text _name;
+	SingleLineText _name;
 	Text _status;
 	StatusType _statusType = StatusType::Online;
 	OrderedSet<QChar> _nameFirstChars;
@@ -429,13 +429,15 @@ public:
 	void setSearchMode(PeerListSearchMode mode);
 	void changeCheckState(not_null<PeerListRow*> row, bool checked, PeerListRow::SetStyle style);
 
+	// Search index entries are not reordered, filter results are sorted
+	// by the absolute row index when the local search is performed.
 	template <typename ReorderCallback>
 	void reorderRows(ReorderCallback &&callback) {
+		auto selected = getRow(_selected.index);
+		auto pressed = getRow(_pressed.index);
 		callback(_rows.begin(), _rows.end());
-		for (auto &searchEntity : _searchIndex) {
-			callback(searchEntity.second.begin(), searchEntity.second.end());
-		}
 		refreshIndices();
+		restoreRowsSelection(selected, pressed);
 	}
 
 signals:
@@ -455,6 +457,7 @@ protected:
 
 private:
 	void refreshIndices();
+	void restoreRowsSelection(PeerListRow *selected, PeerListRow *pressed);
 	void removeRowAtIndex(std::vector<std::unique_ptr<PeerListRow>> &from, int index);
 	void handleNameChanged(const Notify::PeerUpdate &update);
 
@@ -513,6 +516,8 @@ private:
 	bool addingToSearchIndex() const;
 	void removeFromSearchIndex(not_null<PeerListRow*> row);
 	void setSearchQuery(const QString &query, const QString &normalizedQuery);
+	void searchInLocalIndex(std::vector<not_null<PeerListRow*>> &&previousResults);
+	bool rowMatchesSearch(not_null<PeerListRow*> row) const;
 	bool showingSearch() const {
 		return !_searchQuery.isEmpty();
 	}
@@ -547,9 +552,16 @@ private:
 	std::map<QChar, std::vector<not_null<PeerListRow*>>> _searchIndex;
 	QString _searchQuery;
 	QString _normalizedSearchQuery;
+	QStringList _searchWords;
 	QString _mentionHighlight;
 	std::vector<not_null<PeerListRow*>> _filterResults;
 
+	// First _localResultsCount of _filterResults are found in the local index.
+	// If _localResultsQuery is equal to _normalizedSearchQuery those are all
+	// the local rows matching the query, otherwise the index was changed since.
+	int _localResultsCount = 0;
+	QString _localResultsQuery;
+
 	int _aboveHeight = 0;
 	object_ptr<TWidget> _aboveWidget = { nullptr };
 	object_ptr<Ui::FlatLabel> _description = { nullptr };
@@ -566,7 +566,7 @@ void EditChatAdminsBoxController::prepare() {
 
 	rebuildRows();
 	if (!delegate()->peerListFullRowsCount()) {
-		Auth().api().requestFullPeer(_chat);
+		_chat->updateFull();
 		_adminsUpdatedSubscription = subscribe(Notify::PeerUpdated(), Notify::PeerUpdatedHandler(
 				Notify::PeerUpdate::Flag::AdminsChanged, [this](
 					const Notify::PeerUpdate &update) {
@@ -32,6 +32,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "styles/style_boxes.h"
 #include "media/media_clip_reader.h"
 #include "window/window_controller.h"
+#include "base/task_queue.h"
 
 namespace {
 
@@ -56,15 +57,50 @@ SendFilesBox::SendFilesBox(QWidget*, const QStringList &files, CompressConfirm c
 , _compressConfirm(compressed)
 , _caption(this, st::confirmCaptionArea, langFactory(_files.size() > 1 ? lng_photos_comment : lng_photo_caption)) {
 	if (_files.size() == 1) {
-		prepareSingleFileLayout();
+		if (_files.front().isEmpty()) {
+			prepareSingleFileLayout();
+		} else {
+			prepareDocumentLayout();
+			readSingleFileAsync();
+		}
+	}
+}
+
+void SendFilesBox::readSingleFileAsync() {
+	_reading = true;
+	auto ready = base::lambda_guarded(this, [this](std::unique_ptr<FileLoadTask::MediaInformation> &&information) {
+		singleFileRead(std::move(information));
+	});
+	base::TaskQueue::Normal().Put([ready = std::move(ready), filepath = _files.front()]() mutable {
+		auto filemime = mimeTypeForFile(QFileInfo(filepath)).name();
+		auto information = FileLoadTask::ReadMediaInformation(filepath, QByteArray(), filemime);
+		base::TaskQueue::Main().Put([ready = std::move(ready), information = std::move(information)]() mutable {
+			ready(std::move(information));
+		});
+	});
+}
+
+void SendFilesBox::singleFileRead(std::unique_ptr<FileLoadTask::MediaInformation> information) {
+	_reading = false;
+	_information = std::move(information);
+	applySingleFileInformation();
+	prepareSingleFileLayout();
+
+	// The box was prepared already, we need to refresh it.
+	if (_compressConfirm == CompressConfirm::None) {
+		_compressed.destroy();
+	}
+	if (_send) {
+		_send->setText(getSendButtonText());
+		updateButtonsGeometry();
 	}
+	updateBoxSize();
+	updateControlsGeometry();
+	update();
 }
 
 void SendFilesBox::prepareSingleFileLayout() {
 	Expects(_files.size() == 1);
-	if (!_files.front().isEmpty()) {
-		tryToReadSingleFile();
-	}
 
 	if (_image.isNull() || !ValidatePhotoDimensions(_image.width(), _image.height()) || _animated) {
 		_compressConfirm = CompressConfirm::None;
@@ -206,10 +242,7 @@ void SendFilesBox::prepareDocumentLayout() {
 	}
 }
 
-void SendFilesBox::tryToReadSingleFile() {
-	auto filepath = _files.front();
-	auto filemime = mimeTypeForFile(QFileInfo(filepath)).name();
-	_information = FileLoadTask::ReadMediaInformation(_files.front(), QByteArray(), filemime);
+void SendFilesBox::applySingleFileInformation() {
 	if (auto image = base::get_if<FileLoadTask::Image>(&_information->media)) {
 		_image = image->data;
 		_animated = image->animated;
@@ -436,6 +469,9 @@ void SendFilesBox::setInnerFocus() {
 }
 
 void SendFilesBox::onSend(bool ctrlShiftEnter) {
+	if (_reading) {
+		return;
+	}
 	if (_compressed && _compressConfirm == CompressConfirm::Auto && _compressed->checked() != cCompressPastedImage()) {
 		cSetCompressPastedImage(_compressed->checked());
 		Local::writeUserSettings();
@@ -63,7 +63,9 @@ private slots:
 private:
 	void prepareSingleFileLayout();
 	void prepareDocumentLayout();
-	void tryToReadSingleFile();
+	void readSingleFileAsync();
+	void singleFileRead(std::unique_ptr<FileLoadTask::MediaInformation> information);
+	void applySingleFileInformation();
 	void prepareGifPreview();
 	void clipCallback(Media::Clip::Notification notification);
 
@@ -80,6 +82,10 @@ private:
 	CompressConfirm _compressConfirm = CompressConfirm::None;
 	bool _animated = false;
 
+	// The single file is read and decoded in the background, until then
+	// we show the document layout and don't allow sending.
+	bool _reading = false;
+
 	QPixmap _preview;
 	int _previewLeft = 0;
 	int _previewWidth = 0;
@@ -347,6 +347,13 @@ void ShareBox::Inner::activateSkipPage(int pageHeight, int direction) {
 
 void ShareBox::Inner::notifyPeerUpdated(const Notify::PeerUpdate &update) {
 	if (update.flags & Notify::PeerUpdate::Flag::NameChanged) {
+		// Filtered rows of this peer may be destroyed in the index.
+		auto peer = update.peer;
+		_filtered.erase(std::remove_if(_filtered.begin(), _filtered.end(), [peer](Dialogs::Row *row) {
+			return (row->history()->peer == peer);
+		}), _filtered.end());
+		_filteredBy = QString();
+
 		_chatsIndexed->peerNameChanged(update.peer, update.oldNames, update.oldNameFirstChars);
 	}
 
@@ -399,11 +406,8 @@ void ShareBox::Inner::repaintChat(PeerData *peer) {
 int ShareBox::Inner::chatIndex(PeerData *peer) const {
 	int index = 0;
 	if (_filter.isEmpty()) {
-		for_const (auto row, _chatsIndexed->all()) {
-			if (row->history()->peer == peer) {
-				return index;
-			}
-			++index;
+		if (auto row = _chatsIndexed->getRow(peer->id)) {
+			return row->pos();
 		}
 	} else {
 		for_const (auto row, _filtered) {
@@ -430,7 +434,7 @@ void ShareBox::Inner::loadProfilePhotos(int yFrom) {
 	if (auto part = (yFrom % _rowHeight)) {
 		yFrom -= part;
 	}
-	int yTo = yFrom + parentWidget()->height() * 5 * _columnCount;
+	int yTo = yFrom + parentWidget()->height() * (PreloadHeightsCount + 1);
 	if (!yTo) {
 		return;
 	}
@@ -688,14 +692,45 @@ void ShareBox::Inner::updateFilter(QString filter) {
 		d_byUsernameFiltered.clear();
 
 		if (_filter.isEmpty()) {
+			_filteredBy = QString();
 			refresh();
 		} else {
 			QStringList::const_iterator fb = words.cbegin(), fe = words.cend(), fi;
 
+			// If the filter was only extended we check just the previous results.
+			auto narrowFrom = FilteredDialogs();
+			auto narrowing = !_filteredBy.isEmpty() && _filter.startsWith(_filteredBy);
+			if (narrowing) {
+				narrowFrom = std::move(_filtered);
+			}
 			_filtered.clear();
+			_filteredBy = _filter;
 			if (!words.isEmpty()) {
+				auto filterRow = [this, fb, fe](Dialogs::Row *row) {
+					auto &names = row->history()->peer->names;
+					PeerData::Names::const_iterator nb = names.cbegin(), ne = names.cend(), ni;
+					auto fi = fb;
+					for (; fi != fe; ++fi) {
+						for (ni = nb; ni != ne; ++ni) {
+							if (ni->startsWith(*fi)) {
+								break;
+							}
+						}
+						if (ni == ne) {
+							break;
+						}
+					}
+					if (fi == fe) {
+						_filtered.push_back(row);
+					}
+				};
 				const Dialogs::List *toFilter = nullptr;
-				if (!_chatsIndexed->isEmpty()) {
+				if (narrowing) {
+					_filtered.reserve(narrowFrom.size());
+					for_const (auto row, narrowFrom) {
+						filterRow(row);
+					}
+				} else if (!_chatsIndexed->isEmpty()) {
 					for (fi = fb; fi != fe; ++fi) {
 						auto found = _chatsIndexed->filtered(fi->at(0));
 						if (found->isEmpty()) {
@@ -710,22 +745,7 @@ void ShareBox::Inner::updateFilter(QString filter) {
 				if (toFilter) {
 					_filtered.reserve(toFilter->size());
 					for_const (auto row, *toFilter) {
-						auto &names = row->history()->peer->names;
-						PeerData::Names::const_iterator nb = names.cbegin(), ne = names.cend(), ni;
-						for (fi = fb; fi != fe; ++fi) {
-							auto filterName = *fi;
-							for (ni = nb; ni != ne; ++ni) {
-								if (ni->startsWith(*fi)) {
-									break;
-								}
-							}
-							if (ni == ne) {
-								break;
-							}
-						}
-						if (fi == fe) {
-							_filtered.push_back(row);
-						}
+						filterRow(row);
 					}
 				}
 			}
@@ -198,6 +198,10 @@ private:
 	using FilteredDialogs = QVector<Dialogs::Row*>;
 	FilteredDialogs _filtered;
 
+	// Filter that _filtered are the complete results for, it is cleared
+	// when some peer name changes and the results can't be narrowed down.
+	QString _filteredBy;
+
 	using DataMap = QMap<PeerData*, Chat*>;
 	DataMap _dataMap;
 	using SelectedChats = OrderedSet<PeerData*>;
@@ -236,6 +236,8 @@ void StickersBox::getArchivedDone(uint64 offsetId, const MTPmessages_ArchivedSti
 }
 
 void StickersBox::prepare() {
+	Local::ensureStickersAndGifsRead();
+
 	if (_section == Section::Installed) {
 		if (_tabs) {
 			Local::readArchivedStickers();
@@ -50,6 +50,7 @@ namespace {
 constexpr auto kMinLayer = 65;
 constexpr auto kMaxLayer = 65; // MTP::CurrentLayer?
 constexpr auto kHangupTimeoutMs = 5000;
+constexpr auto kStatisticsUpdateTimeoutMs = TimeMs(1000);
 
 using tgvoip::Endpoint;
 
@@ -82,6 +83,10 @@ Call::Call(not_null<Delegate*> delegate, not_null<UserData*> user, Type type)
 , _user(user)
 , _type(type) {
 	_discardByTimeoutTimer.setCallback([this] { hangup(); });
+	_statisticsTimer.setCallback([this] {
+		updateStatistics();
+		_statisticsUpdated.notify();
+	});
 
 	if (_type == Type::Outgoing) {
 		setState(State::Requesting);
@@ -259,6 +264,54 @@ QString Call::getDebugLog() const {
 	return QString::fromUtf8(reinterpret_cast<const char*>(bytes.data()), size);
 }
 
+void Call::updateStatistics() {
+	if (!_controller) {
+		return;
+	}
+	auto stats = voip_stats_t();
+	_controller->GetStats(&stats);
+	_statistics.bytesSent = int64(stats.bytesSentWifi + stats.bytesSentMobile);
+	_statistics.bytesReceived = int64(stats.bytesRecvdWifi + stats.bytesRecvdMobile);
+	_statistics.relayId = _controller->GetPreferredRelayID();
+
+	auto rtt = TimeMs(qRound(_controller->GetAverageRTT() * 1000.));
+	if (rtt > 0) {
+		_statistics.rtt = rtt;
+		_statistics.minRtt = _statistics.rttSamples ? qMin(_statistics.minRtt, rtt) : rtt;
+		_statistics.maxRtt = qMax(_statistics.maxRtt, rtt);
+		_statistics.rttSum += rtt;
+		++_statistics.rttSamples;
+	}
+
+	// Jitter, losses and the endpoint in use are available only in the debug string.
+	for (auto &line : getDebugLog().split('\n')) {
+		auto trimmed = line.trimmed();
+		if (trimmed.contains(qstr("IN USE"))) {
+			_statistics.endpoint = trimmed;
+		} else if (trimmed.startsWith(qstr("Jitter buffer"), Qt::CaseInsensitive)) {
+			_statistics.jitter = trimmed.mid(trimmed.indexOf(':') + 1).trimmed();
+		} else if (trimmed.contains(qstr("losses"), Qt::CaseInsensitive)) {
+			_statistics.losses = trimmed.mid(trimmed.indexOf(':') + 1).trimmed();
+		}
+	}
+}
+
+void Call::logStatistics() const {
+	auto averageRtt = _statistics.rttSamples ? (_statistics.rttSum / _statistics.rttSamples) : TimeMs(0);
+	LOG(("Call Stats: id %1, duration %2 s, rtt avg %3 ms (min %4, max %5), sent %6 KB, received %7 KB, relay %8, endpoint '%9', jitter '%10', losses '%11'"
+		).arg(_id
+		).arg(getDurationMs() / 1000
+		).arg(averageRtt
+		).arg(_statistics.minRtt
+		).arg(_statistics.maxRtt
+		).arg(_statistics.bytesSent / 1024
+		).arg(_statistics.bytesReceived / 1024
+		).arg(_statistics.relayId
+		).arg(_statistics.endpoint
+		).arg(_statistics.jitter
+		).arg(_statistics.losses));
+}
+
 void Call::startWaitingTrack() {
 	_waitingTrack = Media::Audio::Current().createTrack();
 	auto trackFileName = Auth().data().getSoundPath((_type == Type::Outgoing) ? qsl("call_outgoing") : qsl("call_incoming"));
@@ -488,6 +541,7 @@ void Call::createAndStartController(const MTPDphoneCall &call) {
 	});
 	_controller->Start();
 	_controller->Connect();
+	_statisticsTimer.callEach(kStatisticsUpdateTimeoutMs);
 }
 
 void Call::handleControllerStateChange(tgvoip::VoIPController *controller, int state) {
@@ -677,6 +731,10 @@ void Call::handleControllerError(int error) {
 
 void Call::destroyController() {
 	if (_controller) {
+		_statisticsTimer.cancel();
+		updateStatistics();
+		logStatistics();
+
 		DEBUG_LOG(("Call Info: Destroying call controller.."));
 		_controller.reset();
 		DEBUG_LOG(("Call Info: Call controller destroyed."));
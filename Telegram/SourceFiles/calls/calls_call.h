@@ -126,6 +126,29 @@ public:
 
 	QString getDebugLog() const;
 
+	// Polled from the controller while the call is active.
+	struct Statistics {
+		TimeMs rtt = 0;
+		TimeMs minRtt = 0;
+		TimeMs maxRtt = 0;
+		TimeMs rttSum = 0;
+		int rttSamples = 0;
+		int64 bytesSent = 0;
+		int64 bytesReceived = 0;
+		int64 relayId = 0;
+
+		// As reported in the controller debug string.
+		QString endpoint;
+		QString jitter;
+		QString losses;
+	};
+	const Statistics &statistics() const {
+		return _statistics;
+	}
+	base::Observable<void> &statisticsUpdated() {
+		return _statisticsUpdated;
+	}
+
 	~Call();
 
 private:
@@ -156,6 +179,8 @@ private:
 	void setStateQueued(State state);
 	void setFailedQueued(int error);
 	void destroyController();
+	void updateStatistics();
+	void logStatistics() const;
 
 	not_null<Delegate*> _delegate;
 	not_null<UserData*> _user;
@@ -171,6 +196,10 @@ private:
 	bool _mute = false;
 	base::Observable<bool> _muteChanged;
 
+	Statistics _statistics;
+	base::Observable<void> _statisticsUpdated;
+	base::Timer _statisticsTimer;
+
 	DhConfig _dhConfig;
 	std::vector<gsl::byte> _ga;
 	std::vector<gsl::byte> _gb;
@@ -348,6 +348,10 @@ void Panel::reinitControls() {
 	_stateChangedSubscription = subscribe(_call->stateChanged(), [this](State state) { stateChanged(state); });
 	stateChanged(_call->state());
 
+	unsubscribe(_statisticsUpdatedSubscription);
+	_statisticsUpdatedSubscription = subscribe(_call->statisticsUpdated(), [this] { updateStatisticsText(); });
+	updateStatisticsText();
+
 	_name->setText(App::peerName(_call->user()));
 	updateStatusText(_call->state());
 }
@@ -439,7 +443,7 @@ void Panel::processUserPhoto() {
 		photo->full->load(true);
 	} else {
 		if ((_user->photoId == UnknownPeerPhotoId) || (_user->photoId && (!photo || !photo->date))) {
-			Auth().api().requestFullPeer(_user);
+			_user->updateFull();
 		}
 	}
 	refreshUserPhoto();
@@ -644,6 +648,52 @@ void Panel::paintEvent(QPaintEvent *e) {
 			left += st::callFingerprintSkip + size;
 		}
 	}
+
+	paintStatistics(p);
+}
+
+void Panel::updateStatisticsText() {
+	auto lines = QStringList();
+	if (_call && cShowCallStatistics()) {
+		auto &stats = _call->statistics();
+		auto averageRtt = stats.rttSamples ? (stats.rttSum / stats.rttSamples) : TimeMs(0);
+		lines.push_back(qsl("RTT: %1 ms (avg %2, min %3, max %4)").arg(stats.rtt).arg(averageRtt).arg(stats.minRtt).arg(stats.maxRtt));
+		lines.push_back(qsl("Sent: %1 KB, received: %2 KB").arg(stats.bytesSent / 1024).arg(stats.bytesReceived / 1024));
+		if (!stats.jitter.isEmpty()) {
+			lines.push_back(qsl("Jitter: ") + stats.jitter);
+		}
+		if (!stats.losses.isEmpty()) {
+			lines.push_back(qsl("Losses: ") + stats.losses);
+		}
+		if (!stats.endpoint.isEmpty()) {
+			lines.push_back(qsl("Endpoint: ") + stats.endpoint);
+		}
+		lines.push_back(qsl("Relay: %1").arg(stats.relayId));
+	}
+	if (_statisticsLines != lines) {
+		_statisticsLines = lines;
+		update();
+	}
+}
+
+void Panel::paintStatistics(Painter &p) {
+	if (_statisticsLines.isEmpty()) {
+		return;
+	}
+	auto &font = st::callStatisticsFont;
+	auto padding = st::callStatisticsPadding;
+	auto outer = myrtlrect(_padding.left(), _padding.top(), st::callWidth, st::callWidth).marginsRemoved(QMargins(st::callStatisticsMargin, st::callStatisticsMargin, st::callStatisticsMargin, st::callStatisticsMargin));
+	auto textWidth = outer.width() - padding.left() - padding.right();
+	auto area = QRect(outer.x(), outer.y(), outer.width(), padding.top() + _statisticsLines.size() * font->height + padding.bottom());
+	App::roundRect(p, area, st::callFingerprintBg, ImageRoundRadius::Small);
+
+	p.setFont(font);
+	p.setPen(st::callStatisticsFg);
+	auto top = area.y() + padding.top();
+	for (auto &line : _statisticsLines) {
+		p.drawTextLeft(area.x() + padding.left(), top, width(), font->elided(line, textWidth));
+		top += font->height;
+	}
 }
 
 void Panel::closeEvent(QCloseEvent *e) {
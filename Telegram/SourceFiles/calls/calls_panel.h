@@ -84,6 +84,8 @@ private:
 	void updateStatusText(State state);
 	void startDurationUpdateTimer(TimeMs currentDuration);
 	void fillFingerprint();
+	void updateStatisticsText();
+	void paintStatistics(Painter &p);
 	void toggleOpacityAnimation(bool visible);
 	void finishAnimation();
 	void destroyDelayed();
@@ -100,6 +102,8 @@ private:
 	QPoint _dragStartMyPosition;
 
 	int _stateChangedSubscription = 0;
+	int _statisticsUpdatedSubscription = 0;
+	QStringList _statisticsLines;
 
 	class Button;
 	object_ptr<Button> _answerHangupRedial;
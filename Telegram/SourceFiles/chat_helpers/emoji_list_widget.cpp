@@ -30,6 +30,7 @@ namespace {
 
 constexpr auto kEmojiPanelPerRow = Ui::Emoji::kPanelPerRow;
 constexpr auto kEmojiPanelRowsPerPage = Ui::Emoji::kPanelRowsPerPage;
+constexpr auto kRowsCacheRowsCount = 8; // emoji rows are rendered to the cache in tiles of 8 rows
 
 } // namespace
 
@@ -325,6 +326,7 @@ EmojiListWidget::EmojiListWidget(QWidget *parent, not_null<Window::Controller*>
 
 void EmojiListWidget::setVisibleTopBottom(int visibleTop, int visibleBottom) {
 	Inner::setVisibleTopBottom(visibleTop, visibleBottom);
+	clearInvisibleRowsCache(visibleTop, visibleBottom);
 	if (_footer) {
 		_footer->setCurrentSectionIcon(currentSection(visibleTop));
 	}
@@ -411,15 +413,7 @@ void EmojiListWidget::paintEvent(QPaintEvent *e) {
 	}
 	p.fillRect(r, st::emojiPanBg);
 
-	auto fromColumn = floorclamp(r.x() - st::emojiPanPadding, st::emojiPanSize.width(), 0, kEmojiPanelPerRow);
-	auto toColumn = ceilclamp(r.x() + r.width() - st::emojiPanPadding, st::emojiPanSize.width(), 0, kEmojiPanelPerRow);
-	if (rtl()) {
-		qSwap(fromColumn, toColumn);
-		fromColumn = kEmojiPanelPerRow - fromColumn;
-		toColumn = kEmojiPanelPerRow - toColumn;
-	}
-
-	enumerateSections([this, &p, r, fromColumn, toColumn](const SectionInfo &info) {
+	enumerateSections([this, &p, r](const SectionInfo &info) {
 		if (r.top() >= info.rowsBottom) {
 			return true;
 		} else if (r.top() + r.height() <= info.top) {
@@ -434,23 +428,29 @@ void EmojiListWidget::paintEvent(QPaintEvent *e) {
 			ensureLoaded(info.section);
 			auto fromRow = floorclamp(r.y() - info.rowsTop, st::emojiPanSize.height(), 0, info.rowsCount);
 			auto toRow = ceilclamp(r.y() + r.height() - info.rowsTop, st::emojiPanSize.height(), 0, info.rowsCount);
-			for (auto i = fromRow; i < toRow; ++i) {
-				for (auto j = fromColumn; j < toColumn; ++j) {
-					auto index = i * kEmojiPanelPerRow + j;
-					if (index >= info.count) break;
-
-					auto selected = (!_picker->isHidden() && info.section * MatrixRowShift + index == _pickerSel) || (info.section * MatrixRowShift + index == _selected);
-
-					auto w = QPoint(st::emojiPanPadding + j * st::emojiPanSize.width(), info.rowsTop + i * st::emojiPanSize.height());
-					if (selected) {
-						auto tl = w;
-						if (rtl()) tl.setX(width() - tl.x() - st::emojiPanSize.width());
-						App::roundRect(p, QRect(tl, st::emojiPanSize), st::emojiPanHover, StickerHoverCorners);
-					}
-					auto sourceRect = QRect(_emoji[info.section][index]->x() * _esize, _emoji[info.section][index]->y() * _esize, _esize, _esize);
-					auto imageLeft = w.x() + (st::emojiPanSize.width() - (_esize / cIntRetinaFactor())) / 2;
-					auto imageTop = w.y() + (st::emojiPanSize.height() - (_esize / cIntRetinaFactor())) / 2;
-					p.drawPixmapLeft(imageLeft, imageTop, width(), App::emojiLarge(), sourceRect);
+			auto paintSelected = [&](int selected) {
+				if (selected < 0 || selected / MatrixRowShift != info.section) {
+					return;
+				}
+				auto index = selected % MatrixRowShift;
+				auto row = index / kEmojiPanelPerRow;
+				if (row >= fromRow && row < toRow) {
+					App::roundRect(p, myrtlrect(emojiRect(info.section, index)), st::emojiPanHover, StickerHoverCorners);
+				}
+			};
+			if (!_picker->isHidden()) {
+				paintSelected(_pickerSel);
+			}
+			if (_selected != _pickerSel || _picker->isHidden()) {
+				paintSelected(_selected);
+			}
+
+			// The emoji themselves don't depend on the hover state, they are
+			// blitted from the cached tiles instead of drawing each of them.
+			if (fromRow < toRow) {
+				for (auto tile = fromRow / kRowsCacheRowsCount, till = (toRow - 1) / kRowsCacheRowsCount; tile <= till; ++tile) {
+					auto &cache = rowsCache(info, tile);
+					p.drawPixmap(0, info.rowsTop + tile * kRowsCacheRowsCount * st::emojiPanSize.height(), cache);
 				}
 			}
 		}
@@ -458,6 +458,65 @@ void EmojiListWidget::paintEvent(QPaintEvent *e) {
 	});
 }
 
+const QPixmap &EmojiListWidget::rowsCache(const SectionInfo &info, int tile) {
+	auto key = info.section * MatrixRowShift + tile;
+	auto i = _rowsCache.find(key);
+	if (i != _rowsCache.cend() && i->width() == width() * cIntRetinaFactor()) {
+		return i.value();
+	}
+	auto fromRow = tile * kRowsCacheRowsCount;
+	auto toRow = qMin(fromRow + kRowsCacheRowsCount, info.rowsCount);
+	auto image = QImage(QSize(width(), (toRow - fromRow) * st::emojiPanSize.height()) * cIntRetinaFactor(), QImage::Format_ARGB32_Premultiplied);
+	image.setDevicePixelRatio(cRetinaFactor());
+	image.fill(Qt::transparent);
+	{
+		Painter p(&image);
+		for (auto row = fromRow; row < toRow; ++row) {
+			for (auto column = 0; column != kEmojiPanelPerRow; ++column) {
+				auto index = row * kEmojiPanelPerRow + column;
+				if (index >= info.count) break;
+
+				auto emoji = _emoji[info.section][index];
+				auto sourceRect = QRect(emoji->x() * _esize, emoji->y() * _esize, _esize, _esize);
+				auto imageLeft = st::emojiPanPadding + column * st::emojiPanSize.width() + (st::emojiPanSize.width() - (_esize / cIntRetinaFactor())) / 2;
+				auto imageTop = (row - fromRow) * st::emojiPanSize.height() + (st::emojiPanSize.height() - (_esize / cIntRetinaFactor())) / 2;
+				p.drawPixmapLeft(imageLeft, imageTop, width(), App::emojiLarge(), sourceRect);
+			}
+		}
+	}
+	return _rowsCache[key] = App::pixmapFromImageInPlace(std::move(image));
+}
+
+void EmojiListWidget::clearRowsCache(int section, int index) {
+	if (index >= 0) {
+		_rowsCache.remove(section * MatrixRowShift + (index / kEmojiPanelPerRow) / kRowsCacheRowsCount);
+		return;
+	}
+	for (auto i = _rowsCache.begin(); i != _rowsCache.end();) {
+		if (i.key() / MatrixRowShift == section) {
+			i = _rowsCache.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+void EmojiListWidget::clearInvisibleRowsCache(int visibleTop, int visibleBottom) {
+	// Keep the tiles up to a screen away from the visible area.
+	auto keepTop = visibleTop - (visibleBottom - visibleTop);
+	auto keepBottom = visibleBottom + (visibleBottom - visibleTop);
+	auto tileHeight = kRowsCacheRowsCount * st::emojiPanSize.height();
+	for (auto i = _rowsCache.begin(); i != _rowsCache.end();) {
+		auto info = sectionInfo(i.key() / MatrixRowShift);
+		auto tileTop = info.rowsTop + (i.key() % MatrixRowShift) * tileHeight;
+		if (tileTop >= keepBottom || tileTop + tileHeight <= keepTop) {
+			i = _rowsCache.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
 bool EmojiListWidget::checkPickerHide() {
 	if (!_picker->isHidden() && _pickerSel >= 0) {
 		_picker->hideAnimated();
@@ -588,6 +647,7 @@ void EmojiListWidget::onColorSelected(EmojiPtr emoji) {
 		auto sel = _pickerSel % MatrixRowShift;
 		if (section >= 0 && section < kEmojiSectionCount) {
 			_emoji[section][sel] = emoji;
+			clearRowsCache(section, sel);
 			rtlupdate(emojiRect(section, sel));
 		}
 	}
@@ -646,6 +706,7 @@ void EmojiListWidget::refreshRecent() {
 	clearSelection();
 	_emoji[0] = Ui::Emoji::GetSection(Section::Recent);
 	_counts[0] = _emoji[0].size();
+	clearRowsCache(0);
 	auto h = countHeight();
 	if (h != height()) {
 		resize(width(), h);
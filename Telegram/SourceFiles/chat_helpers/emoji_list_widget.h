@@ -142,6 +142,9 @@ private:
 	SectionInfo sectionInfoByOffset(int yOffset) const;
 
 	void ensureLoaded(int section);
+	const QPixmap &rowsCache(const SectionInfo &info, int tile);
+	void clearRowsCache(int section, int index = -1);
+	void clearInvisibleRowsCache(int visibleTop, int visibleBottom);
 	int countSectionTop(int section) const;
 	void updateSelected();
 	void setSelected(int newSelected);
@@ -157,6 +160,9 @@ private:
 
 	int32 _esize;
 
+	// Rendered emoji tiles, the key is section * MatrixRowShift + tile index.
+	QMap<int, QPixmap> _rowsCache;
+
 	int _selected = -1;
 	int _pressedSel = -1;
 	int _pickerSel = -1;
@@ -132,7 +132,7 @@ bool FieldAutocomplete::clearFilteredBotCommands() {
 namespace {
 template <typename T, typename U>
 inline int indexOfInFirstN(const T &v, const U &elem, int last) {
-	for (auto b = v.cbegin(), i = b, e = b + qMax(v.size(), last); i != e; ++i) {
+	for (auto b = v.cbegin(), i = b, e = b + qMin(v.size(), last); i != e; ++i) {
 		if (*i == elem) {
 			return (i - b);
 		}
@@ -193,7 +193,7 @@ void FieldAutocomplete::updateFiltered(bool resetScroll) {
 			QMultiMap<int32, UserData*> ordered;
 			mrows.reserve(mrows.size() + (_chat->participants.isEmpty() ? _chat->lastAuthors.size() : _chat->participants.size()));
 			if (_chat->noParticipantInfo()) {
-				Auth().api().requestFullPeer(_chat);
+				_chat->updateFull();
 			} else if (!_chat->participants.isEmpty()) {
 				for (auto i = _chat->participants.cbegin(), e = _chat->participants.cend(); i != e; ++i) {
 					auto user = i.key();
@@ -249,13 +249,13 @@ void FieldAutocomplete::updateFiltered(bool resetScroll) {
 		int32 cnt = 0;
 		if (_chat) {
 			if (_chat->noParticipantInfo()) {
-				Auth().api().requestFullPeer(_chat);
+				_chat->updateFull();
 			} else if (!_chat->participants.isEmpty()) {
 				for (auto i = _chat->participants.cbegin(), e = _chat->participants.cend(); i != e; ++i) {
 					auto user = i.key();
 					if (!user->botInfo) continue;
 					if (!user->botInfo->inited) {
-						Auth().api().requestFullPeer(user);
+						user->updateFull();
 					}
 					if (user->botInfo->commands.isEmpty()) continue;
 					bots.insert(user, true);
@@ -264,7 +264,7 @@ void FieldAutocomplete::updateFiltered(bool resetScroll) {
 			}
 		} else if (_user && _user->botInfo) {
 			if (!_user->botInfo->inited) {
-				Auth().api().requestFullPeer(_user);
+				_user->updateFull();
 			}
 			cnt = _user->botInfo->commands.size();
 			bots.insert(_user, true);
@@ -277,7 +277,7 @@ void FieldAutocomplete::updateFiltered(bool resetScroll) {
 				for_const (auto user, _channel->mgInfo->bots) {
 					if (!user->botInfo) continue;
 					if (!user->botInfo->inited) {
-						Auth().api().requestFullPeer(user);
+						user->updateFull();
 					}
 					if (user->botInfo->commands.isEmpty()) continue;
 					bots.insert(user, true);
@@ -294,7 +294,7 @@ void FieldAutocomplete::updateFiltered(bool resetScroll) {
 					if (!user->botInfo) continue;
 					if (!bots.contains(user)) continue;
 					if (!user->botInfo->inited) {
-						Auth().api().requestFullPeer(user);
+						user->updateFull();
 					}
 					if (user->botInfo->commands.isEmpty()) continue;
 					bots.remove(user);
@@ -178,10 +178,7 @@ int GifsListWidget::countHeight() {
 		visibleHeight = st::emojiPanMaxHeight - st::emojiCategory.height;
 	}
 	auto minimalLastHeight = (visibleHeight - st::stickerPanPadding);
-	auto result = st::stickerPanPadding;
-	for (int i = 0, l = _rows.count(); i < l; ++i) {
-		result += _rows[i].height;
-	}
+	auto result = st::stickerPanPadding + _rowTops.fullHeight();
 	return qMax(minimalLastHeight, result) + st::stickerPanPadding;
 }
 
@@ -262,34 +259,29 @@ void GifsListWidget::paintInlineItems(Painter &p, QRect clip) {
 	auto gifPaused = controller()->isGifPausedAtLeastFor(Window::GifPauseReason::SavedGifs);
 	InlineBots::Layout::PaintContext context(getms(), false, gifPaused, false);
 
-	auto top = st::stickerPanPadding;
 	auto fromx = rtl() ? (width() - clip.x() - clip.width()) : clip.x();
 	auto tox = rtl() ? (width() - clip.x()) : (clip.x() + clip.width());
-	for (auto row = 0, rows = _rows.size(); row != rows; ++row) {
+	auto range = _rowTops.findRange(clip.top() - st::stickerPanPadding, clip.top() + clip.height() - st::stickerPanPadding);
+	for (auto row = range.first, rows = _rows.size(); row != range.second; ++row) {
 		auto &inlineRow = _rows[row];
-		if (top >= clip.top() + clip.height()) {
-			break;
-		}
-		if (top + inlineRow.height > clip.top()) {
-			auto left = st::inlineResultsLeft - st::buttonRadius;
-			if (row == rows - 1) context.lastRow = true;
-			for (int col = 0, cols = inlineRow.items.size(); col < cols; ++col) {
-				if (left >= tox) break;
-
-				auto item = inlineRow.items.at(col);
-				auto w = item->width();
-				if (left + w > fromx) {
-					p.translate(left, top);
-					item->paint(p, clip.translated(-left, -top), &context);
-					p.translate(-left, -top);
-				}
-				left += w;
-				if (item->hasRightSkip()) {
-					left += st::inlineResultsSkip;
-				}
+		auto top = st::stickerPanPadding + _rowTops.top(row);
+		auto left = st::inlineResultsLeft - st::buttonRadius;
+		if (row == rows - 1) context.lastRow = true;
+		for (int col = 0, cols = inlineRow.items.size(); col < cols; ++col) {
+			if (left >= tox) break;
+
+			auto item = inlineRow.items.at(col);
+			auto w = item->width();
+			if (left + w > fromx) {
+				p.translate(left, top);
+				item->paint(p, clip.translated(-left, -top), &context);
+				p.translate(-left, -top);
+			}
+			left += w;
+			if (item->hasRightSkip()) {
+				left += st::inlineResultsSkip;
 			}
 		}
-		top += inlineRow.height;
 	}
 }
 
@@ -472,6 +464,7 @@ void GifsListWidget::refreshSavedGifs() {
 			inlineRowFinalize(row, sumWidth, true);
 		}
 		deleteUnusedGifLayouts();
+		refreshRowTops();
 
 		auto newHeight = countHeight();
 		if (newHeight != height()) {
@@ -500,6 +493,15 @@ void GifsListWidget::clearInlineRows(bool resultsDeleted) {
 		}
 	}
 	_rows.clear();
+	_rowTops.clear();
+}
+
+void GifsListWidget::refreshRowTops() {
+	_rowTops.clear();
+	_rowTops.reserve(_rows.size());
+	for_const (auto &row, _rows) {
+		_rowTops.push(row.height);
+	}
 }
 
 GifsListWidget::LayoutItem *GifsListWidget::layoutPrepareSavedGif(DocumentData *doc, int32 position) {
@@ -639,6 +641,7 @@ int GifsListWidget::refreshInlineRows(const InlineCacheEntry *entry, bool result
 		}
 		inlineRowFinalize(row, sumWidth, true);
 	}
+	refreshRowTops();
 
 	int32 h = countHeight();
 	if (h != height()) resize(width(), h);
@@ -742,12 +745,7 @@ bool GifsListWidget::inlineItemVisible(const InlineBots::Layout::ItemBase *layou
 	auto col = position % MatrixRowShift;
 	Assert((row < _rows.size()) && (col < _rows[row].items.size()));
 
-	auto &inlineItems = _rows[row].items;
-	auto top = 0;
-	for (auto i = 0; i != row; ++i) {
-		top += _rows[i].height;
-	}
-
+	auto top = st::stickerPanPadding + _rowTops.top(row);
 	return (top < getVisibleBottom()) && (top + _rows[row].items[col]->height() > getVisibleTop());
 }
 
@@ -877,12 +875,9 @@ void GifsListWidget::updateSelected() {
 	ClickHandlerHost *lnkhost = nullptr;
 	HistoryCursorState cursor = HistoryDefaultCursorState;
 	if (sy >= 0) {
-		row = 0;
-		for (int rows = _rows.size(); row < rows; ++row) {
-			if (sy < _rows[row].height) {
-				break;
-			}
-			sy -= _rows[row].height;
+		row = _rowTops.findByY(sy);
+		if (row < _rowTops.count()) {
+			sy -= _rowTops.top(row);
 		}
 	}
 	if (sx >= 0 && row >= 0 && row < _rows.size()) {
@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "chat_helpers/tabbed_selector.h"
 #include "inline_bots/inline_bot_layout_item.h"
+#include "ui/virtual_rows.h"
 
 namespace InlineBots {
 namespace Layout {
@@ -134,7 +135,9 @@ private:
 		QVector<LayoutItem*> items;
 	};
 	QVector<Row> _rows;
+	Ui::VirtualRows _rowTops;
 	void clearInlineRows(bool resultsDeleted);
+	void refreshRowTops();
 
 	std::map<DocumentData*, std::unique_ptr<LayoutItem>> _gifLayouts;
 	LayoutItem *layoutPrepareSavedGif(DocumentData *doc, int32 position);
@@ -49,6 +49,52 @@ public:
 
 };
 
+// Serializes the text tags only when a paste target asks for them.
+class TextWithEntitiesMimeData : public QMimeData {
+public:
+	TextWithEntitiesMimeData(const EntitiesInText &entities) : _entities(entities) {
+	}
+
+	bool hasFormat(const QString &mimeType) const override {
+		if (mimeType == Ui::FlatTextarea::tagsMimeType()) {
+			return hasTags();
+		}
+		return QMimeData::hasFormat(mimeType);
+	}
+	QStringList formats() const override {
+		auto result = QMimeData::formats();
+		if (hasTags()) {
+			result.push_back(Ui::FlatTextarea::tagsMimeType());
+		}
+		return result;
+	}
+
+protected:
+	QVariant retrieveData(const QString &mimeType, QVariant::Type type) const override {
+		if (mimeType == Ui::FlatTextarea::tagsMimeType()) {
+			auto tags = ConvertEntitiesToTextTags(_entities);
+			for (auto &tag : tags) {
+				tag.id = ConvertTagToMimeTag(tag.id);
+			}
+			return Ui::FlatTextarea::serializeTagsList(tags);
+		}
+		return QMimeData::retrieveData(mimeType, type);
+	}
+
+private:
+	bool hasTags() const {
+		for_const (auto &entity, _entities) {
+			if (entity.type() == EntityInTextMentionName) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	EntitiesInText _entities;
+
+};
+
 } // namespace
 
 QString ConvertTagToMimeTag(const QString &tagId) {
@@ -99,16 +145,9 @@ std::unique_ptr<QMimeData> MimeDataFromTextWithEntities(const TextWithEntities &
 		return nullptr;
 	}
 
-	auto result = std::make_unique<QMimeData>();
+	auto result = std::make_unique<TextWithEntitiesMimeData>(forClipboard.entities);
 	result->setText(forClipboard.text);
-	auto tags = ConvertEntitiesToTextTags(forClipboard.entities);
-	if (!tags.isEmpty()) {
-		for (auto &tag : tags) {
-			tag.id = ConvertTagToMimeTag(tag.id);
-		}
-		result->setData(Ui::FlatTextarea::tagsMimeType(), Ui::FlatTextarea::serializeTagsList(tags));
-	}
-	return result;
+	return std::move(result);
 }
 
 MessageField::MessageField(QWidget *parent, not_null<Window::Controller*> controller, const style::FlatTextarea &st, base::lambda<QString()> placeholderFactory, const QString &val) : Ui::FlatTextarea(parent, st, std::move(placeholderFactory), val)
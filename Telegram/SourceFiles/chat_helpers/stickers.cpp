@@ -28,6 +28,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mainwidget.h"
 #include "mainwindow.h"
 #include "ui/toast/toast.h"
+#include "base/flat_set.h"
 #include "styles/style_chat_helpers.h"
 
 namespace Stickers {
@@ -39,6 +40,8 @@ QPointer<internal::FeaturedReader> FeaturedReaderInstance;
 } // namespace
 
 void ApplyArchivedResult(const MTPDmessages_stickerSetInstallResultArchive &d) {
+	Local::ensureStickersAndGifsRead();
+
 	auto &v = d.vsets.v;
 	auto &order = Global::RefStickerSetsOrder();
 	Order archived;
@@ -109,6 +112,8 @@ bool ApplyArchivedResultFake() {
 }
 
 void InstallLocally(uint64 setId) {
+	Local::ensureStickersAndGifsRead();
+
 	auto &sets = Global::RefStickerSets();
 	auto it = sets.find(setId);
 	if (it == sets.end()) {
@@ -152,6 +157,8 @@ void InstallLocally(uint64 setId) {
 }
 
 void UndoInstallLocally(uint64 setId) {
+	Local::ensureStickersAndGifsRead();
+
 	auto &sets = Global::RefStickerSets();
 	auto it = sets.find(setId);
 	if (it == sets.end()) {
@@ -331,6 +338,8 @@ void SetIsNotFaved(not_null<DocumentData*> document) {
 }
 
 void SetFaved(not_null<DocumentData*> document, bool faved) {
+	Local::ensureStickersAndGifsRead();
+
 	if (faved) {
 		SetIsFaved(document);
 	} else {
@@ -339,6 +348,8 @@ void SetFaved(not_null<DocumentData*> document, bool faved) {
 }
 
 void SetsReceived(const QVector<MTPStickerSet> &data, int32 hash) {
+	Local::ensureStickersAndGifsRead();
+
 	auto &setsOrder = Global::RefStickerSetsOrder();
 	setsOrder.clear();
 
@@ -395,8 +406,9 @@ void SetsReceived(const QVector<MTPStickerSet> &data, int32 hash) {
 	Local::writeInstalledStickers();
 	if (writeRecent) Local::writeUserSettings();
 
-	if (Local::countStickersHash() != hash) {
-		LOG(("API Error: received stickers hash %1 while counted hash is %2").arg(hash).arg(Local::countStickersHash()));
+	auto counted = Local::countStickersHash();
+	if (counted != hash) {
+		LOG(("API Error: received stickers hash %1 while counted hash is %2").arg(hash).arg(counted));
 	}
 
 	Auth().data().stickersUpdated().notify(true);
@@ -426,6 +438,8 @@ void SetPackAndEmoji(Set &set, StickerPack &&pack, const QVector<MTPStickerPack>
 }
 
 void SpecialSetReceived(uint64 setId, const QString &setTitle, const QVector<MTPDocument> &items, int32 hash, const QVector<MTPStickerPack> &packs) {
+	Local::ensureStickersAndGifsRead();
+
 	auto &sets = Global::RefStickerSets();
 	auto it = sets.find(setId);
 
@@ -504,6 +518,8 @@ void SpecialSetReceived(uint64 setId, const QString &setTitle, const QVector<MTP
 }
 
 void FeaturedSetsReceived(const QVector<MTPStickerSetCovered> &data, const QVector<MTPlong> &unread, int32 hash) {
+	Local::ensureStickersAndGifsRead();
+
 	OrderedSet<uint64> unreadMap;
 	for_const (auto &unreadSetId, unread) {
 		unreadMap.insert(unreadSetId.v);
@@ -607,6 +623,8 @@ void FeaturedSetsReceived(const QVector<MTPStickerSetCovered> &data, const QVect
 }
 
 void GifsReceived(const QVector<MTPDocument> &items, int32 hash) {
+	Local::ensureStickersAndGifsRead();
+
 	auto &saved = cRefSavedGifs();
 	saved.clear();
 
@@ -630,18 +648,22 @@ void GifsReceived(const QVector<MTPDocument> &items, int32 hash) {
 }
 
 StickerPack GetListByEmoji(not_null<EmojiPtr> emoji) {
+	Local::ensureStickersAndGifsRead();
+
 	auto original = emoji->original();
 	auto result = StickerPack();
 	auto setsToRequest = QMap<uint64, uint64>();
 	auto &sets = Global::RefStickerSets();
 
-	auto faved = StickerPack();
+	auto faved = base::flat_set<DocumentData*>();
 	auto favedIt = sets.find(Stickers::FavedSetId);
 	if (favedIt != sets.cend()) {
 		auto i = favedIt->emoji.constFind(original);
 		if (i != favedIt->emoji.cend()) {
-			faved = *i;
-			result = faved;
+			result = *i;
+			for_const (auto sticker, *i) {
+				faved.insert(sticker);
+			}
 		}
 	}
 	auto &order = Global::StickerSetsOrder();
@@ -656,7 +678,7 @@ StickerPack GetListByEmoji(not_null<EmojiPtr> emoji) {
 				if (i != it->emoji.cend()) {
 					result.reserve(result.size() + i->size());
 					for_const (auto sticker, *i) {
-						if (!faved.contains(sticker)) {
+						if (faved.empty() || !faved.contains(sticker)) {
 							result.push_back(sticker);
 						}
 					}
@@ -700,6 +722,8 @@ base::optional<std::vector<not_null<EmojiPtr>>> GetEmojiListFromSet(
 }
 
 Set *FeedSet(const MTPDstickerSet &set) {
+	Local::ensureStickersAndGifsRead();
+
 	auto &sets = Global::RefStickerSets();
 	auto it = sets.find(set.vid.v);
 	auto title = GetSetTitle(set);
@@ -820,7 +844,8 @@ Set *FeedSetFull(const MTPmessages_StickerSet &data) {
 		}
 	}
 
-	Auth().data().stickersUpdated().notify(true);
+	// Changed sets after a sync arrive one by one, refresh the panels once.
+	Auth().data().stickersUpdated().notifyCoalesced();
 
 	return set;
 }
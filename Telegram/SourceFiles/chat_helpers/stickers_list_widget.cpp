@@ -36,6 +36,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "auth_session.h"
 #include "observer_peer.h"
 #include "apiwrap.h"
+#include "storage/file_download.h"
+#include "base/task_queue.h"
 
 namespace ChatHelpers {
 namespace {
@@ -471,6 +473,7 @@ object_ptr<TabbedSelector::InnerFooter> StickersListWidget::createFooter() {
 void StickersListWidget::setVisibleTopBottom(int visibleTop, int visibleBottom) {
 	auto top = getVisibleTop();
 	Inner::setVisibleTopBottom(visibleTop, visibleBottom);
+	Auth().downloader().clearPriorities();
 	if (_section == Section::Featured) {
 		readVisibleSets();
 	}
@@ -820,22 +823,27 @@ void StickersListWidget::paintSticker(Painter &p, Set &set, int y, int index, bo
 		App::roundRect(p, QRect(tl, st::stickerPanSize), st::emojiPanHover, StickerHoverCorners);
 	}
 
-	auto goodThumb = !sticker->thumb->isNull() && ((sticker->thumb->width() >= 128) || (sticker->thumb->height() >= 128));
-	if (goodThumb) {
-		sticker->thumb->load();
-	} else {
-		sticker->checkSticker();
-	}
-
 	auto coef = qMin((st::stickerPanSize.width() - st::buttonRadius * 2) / float64(sticker->dimensions.width()), (st::stickerPanSize.height() - st::buttonRadius * 2) / float64(sticker->dimensions.height()));
 	if (coef > 1) coef = 1;
 	auto w = qMax(qRound(coef * sticker->dimensions.width()), 1);
 	auto h = qMax(qRound(coef * sticker->dimensions.height()), 1);
 	auto ppos = pos + QPoint((st::stickerPanSize.width() - w) / 2, (st::stickerPanSize.height() - h) / 2);
+
+	auto goodThumb = !sticker->thumb->isNull() && ((sticker->thumb->width() >= 128) || (sticker->thumb->height() >= 128));
 	if (goodThumb) {
+		sticker->thumb->load();
 		p.drawPixmapLeft(ppos, width(), sticker->thumb->pix(w, h));
 	} else if (!sticker->sticker()->img->isNull()) {
-		p.drawPixmapLeft(ppos, width(), sticker->sticker()->img->pix(w, h));
+		auto &pix = sticker->sticker()->img->pix(w, h);
+		p.drawPixmapLeft(ppos, width(), pix);
+		auto key = Local::stickerRasterKey(sticker->id, QSize(w, h));
+		if (!Local::willStickerRasterLoad(key)) {
+			Local::writeStickerRaster(key, pix.toImage());
+		}
+		_stickerRasters.remove(sticker);
+	} else if (!paintStickerRaster(p, sticker, ppos, QSize(w, h))) {
+		sticker->automaticLoad(nullptr);
+		decodeSticker(sticker);
 	}
 
 	if (selected && stickerHasDeleteButton(set, index)) {
@@ -846,6 +854,97 @@ void StickersListWidget::paintSticker(Painter &p, Set &set, int y, int index, bo
 	}
 }
 
+bool StickersListWidget::paintStickerRaster(Painter &p, not_null<DocumentData*> document, QPoint position, QSize size) {
+	// After a restart the display-size bitmap from the local storage lets
+	// the panel skip loading and decoding the whole sticker image.
+	auto i = _stickerRasters.find(document);
+	if (i != _stickerRasters.end()) {
+		if (i->second.size == size && !i->second.pixmap.isNull()) {
+			p.drawPixmapLeft(position, width(), i->second.pixmap);
+			return true;
+		}
+		if (i->second.size == size && i->second.loading) {
+			return true;
+		}
+		if (i->second.size == size) {
+			return false;
+		}
+		_stickerRasters.erase(i);
+	}
+	auto key = Local::stickerRasterKey(document->id, size);
+	if (!Local::willStickerRasterLoad(key)) {
+		return false;
+	}
+	auto done = base::lambda_guarded(this, [this, document, size](QImage &&raster) {
+		auto i = _stickerRasters.find(document);
+		if (i == _stickerRasters.end() || i->second.size != size) {
+			return;
+		}
+		i->second.loading = false;
+		if (!raster.isNull()) {
+			i->second.pixmap = App::pixmapFromImageInPlace(std::move(raster));
+			i->second.pixmap.setDevicePixelRatio(cRetinaFactor());
+		}
+		update();
+	});
+	if (!Local::startStickerRasterLoad(key, std::move(done))) {
+		return false;
+	}
+	auto &raster = _stickerRasters[document];
+	raster.size = size;
+	raster.loading = true;
+	return true;
+}
+
+void StickersListWidget::decodeSticker(not_null<DocumentData*> document) {
+	auto sticker = document->sticker();
+	if (!sticker || !sticker->img->isNull() || !document->loaded()) {
+		return;
+	}
+	if (_decodingStickers.contains(document)) {
+		return;
+	}
+
+	// Decoding a webp sticker takes a noticeable time, when a whole set
+	// scrolls into view doing that in paintEvent() stalls the panel.
+	auto data = document->data();
+	auto path = QString();
+	if (data.isEmpty()) {
+		auto &location = document->location(true);
+		if (!location.accessEnable()) {
+			return;
+		}
+		path = location.name();
+	}
+	_decodingStickers.insert(document);
+	auto fromFile = !path.isEmpty();
+	auto ready = base::lambda_guarded(this, [this, document, fromFile](QByteArray &&data, QByteArray &&format, QImage &&image) {
+		_decodingStickers.remove(document);
+		if (fromFile) {
+			document->location(true).accessDisable();
+		}
+		auto sticker = document->sticker();
+		if (!sticker || !sticker->img->isNull() || image.isNull()) {
+			return;
+		}
+		sticker->img = ImagePtr(data, format, App::pixmapFromImageInPlace(std::move(image)));
+		update();
+	});
+	base::TaskQueue::Normal().Put([ready = std::move(ready), data = std::move(data), path]() mutable {
+		auto format = QByteArray();
+		auto content = QByteArray();
+		auto image = path.isEmpty()
+			? App::readImage(data, &format, false)
+			: App::readImage(path, &format, false, nullptr, &content);
+		if (!path.isEmpty()) {
+			data = std::move(content);
+		}
+		base::TaskQueue::Main().Put([ready = std::move(ready), data = std::move(data), format = std::move(format), image = std::move(image)]() mutable {
+			ready(std::move(data), std::move(format), std::move(image));
+		});
+	});
+}
+
 int StickersListWidget::stickersRight() const {
 	return stickersLeft() + (kStickersPanelPerRow * st::stickerPanSize.width());
 }
@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "chat_helpers/tabbed_selector.h"
 #include "base/variant.h"
+#include "base/flat_map.h"
 
 namespace Window {
 class Controller;
@@ -189,6 +190,8 @@ private:
 	void paintStickers(Painter &p, QRect clip);
 	void paintMegagroupEmptySet(Painter &p, int y, bool buttonSelected, TimeMs ms);
 	void paintSticker(Painter &p, Set &set, int y, int index, bool selected, bool deleteSelected);
+	bool paintStickerRaster(Painter &p, not_null<DocumentData*> document, QPoint position, QSize size);
+	void decodeSticker(not_null<DocumentData*> document);
 
 	int stickersRight() const;
 	bool featuredHasAddButton(int index) const;
@@ -219,6 +222,13 @@ private:
 	OrderedSet<uint64> _installedLocallySets;
 	QList<bool> _custom;
 	base::flat_set<not_null<DocumentData*>> _favedStickersMap;
+	base::flat_set<not_null<DocumentData*>> _decodingStickers;
+	struct StickerRaster {
+		QSize size;
+		QPixmap pixmap;
+		bool loading = false;
+	};
+	base::flat_map<not_null<DocumentData*>, StickerRaster> _stickerRasters;
 
 	Section _section = Section::Stickers;
 
@@ -296,6 +296,8 @@ TabbedSelector::TabbedSelector(QWidget *parent, not_null<Window::Controller*> co
 	Tab { SelectorTab::Gifs, object_ptr<GifsListWidget>(this, controller) },
 } }
 , _currentTabType(Auth().data().selectorTab()) {
+	Local::ensureStickersAndGifsRead();
+
 	resize(st::emojiPanWidth, st::emojiPanMaxHeight);
 
 	for (auto &tab : _tabs) {
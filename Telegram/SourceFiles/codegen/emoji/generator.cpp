@@ -636,6 +636,67 @@ int FindIndex(const QChar *start, const QChar *end, int *outLength) {\n\
 	return true;
 }
 
+bool Generator::writeFirstCharCheck(const std::map<int, int> &uniqueFirstChars) {
+	// Most of the chars in a text can't start an emoji, so before going into
+	// the switches we check the first char in a two-level bitmap: the upper
+	// byte of the char selects a 256-bit page, the lower byte a bit in it.
+	constexpr auto kPageBits = 256;
+	constexpr auto kWordBits = 32;
+	constexpr auto kWordsInPage = kPageBits / kWordBits;
+	auto pageIndices = std::map<int, int>();
+	auto pages = std::vector<std::array<uint32, kWordsInPage>>();
+	for (auto &item : uniqueFirstChars) {
+		auto pageKey = item.first / kPageBits;
+		auto i = pageIndices.find(pageKey);
+		if (i == pageIndices.cend()) {
+			pages.push_back({ { 0 } });
+			i = pageIndices.emplace(pageKey, int(pages.size())).first;
+		}
+		auto bit = item.first % kPageBits;
+		pages[i->second - 1][bit / kWordBits] |= (uint32(1) << (bit % kWordBits));
+	}
+	if (pages.size() > 255) {
+		logDataError() << "Too many first char pages.";
+		return false;
+	}
+
+	source_->stream() << "\
+	static const uchar kFirstCharPages[" << (65536 / kPageBits) << "] = {";
+	for (auto pageKey = 0; pageKey != 65536 / kPageBits; ++pageKey) {
+		auto i = pageIndices.find(pageKey);
+		if (pageKey % 32) {
+			source_->stream() << " ";
+		} else {
+			source_->stream() << "\n\t\t";
+		}
+		source_->stream() << ((i == pageIndices.cend()) ? 0 : i->second) << ",";
+	}
+	source_->stream() << "\n\
+	};\n\
+	static const uint32 kFirstCharBits[][" << kWordsInPage << "] = {\n";
+	for (auto &page : pages) {
+		source_->stream() << "\t\t{";
+		for (auto word : page) {
+			source_->stream() << " 0x" << QString::number(word, 16) << "U,";
+		}
+		source_->stream() << " },\n";
+	}
+	source_->stream() << "\
+	};\n\
+	if (ch == end) {\n\
+		return 0;\n\
+	} else if (auto page = kFirstCharPages[ch->unicode() / " << kPageBits << "]) {\n\
+		auto bit = ch->unicode() % " << kPageBits << ";\n\
+		if (!(kFirstCharBits[page - 1][bit / " << kWordBits << "] & (1U << (bit % " << kWordBits << ")))) {\n\
+			return 0;\n\
+		}\n\
+	} else {\n\
+		return 0;\n\
+	}\n\
+\n";
+	return true;
+}
+
 bool Generator::writeFindFromDictionary(const std::map<QString, int, std::greater<QString>> &dictionary, bool skipPostfixes) {
 	auto tabs = [](int size) {
 		return QString(size, '\t');
@@ -650,6 +711,10 @@ bool Generator::writeFindFromDictionary(const std::map<QString, int, std::greate
 		uniqueFirstChars[ch] = 0;
 	}
 
+	if (!writeFirstCharCheck(uniqueFirstChars)) {
+		return false;
+	}
+
 	enum class UsedCheckType {
 		Switch,
 		If,
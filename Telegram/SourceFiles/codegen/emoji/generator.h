@@ -21,6 +21,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include <memory>
+#include <array>
+#include <vector>
 #include <QtCore/QString>
 #include <QtCore/QSet>
 #include "codegen/common/cpp_file.h"
@@ -61,6 +63,7 @@ private:
 	bool writeGetSections();
 	bool writeFindReplace();
 	bool writeFind();
+	bool writeFirstCharCheck(const std::map<int, int> &uniqueFirstChars);
 	bool writeFindFromDictionary(const std::map<QString, int, std::greater<QString>> &dictionary, bool skipPostfixes = false);
 	bool writeGetReplacements();
 	void startBinary();
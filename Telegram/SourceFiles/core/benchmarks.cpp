@@ -0,0 +1,210 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/benchmarks.h"
+
+#include "base/benchmark.h"
+#include "base/dense_id_map.h"
+#include "base/qthelp_regex.h"
+#include "ui/emoji_config.h"
+#include "mtproto/auth_key.h"
+#include "layout.h"
+
+namespace Benchmarks {
+namespace {
+
+constexpr auto kWarmup = 10;
+constexpr auto kIterations = 200;
+constexpr auto kMessagesCount = 100;
+constexpr auto kDecryptSize = 128 * 1024;
+constexpr auto kIndexChannels = 16;
+constexpr auto kIndexMessagesPerChannel = 20000;
+
+TextWithEntities SampleText() {
+	auto paragraph = QString::fromUtf8("Hello @durov, look at https://telegram.org and #telegram \xF0\x9F\x98\x80\xF0\x9F\x91\x8D "
+		"this is **bold** and `code`, /start@bot or mail me at test@example.com.\n"
+		"\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82, \xE4\xBD\xA0\xE5\xA5\xBD \xE2\x9D\xA4\xEF\xB8\x8F t.me/telegram\n");
+	auto result = TextWithEntities();
+	for (auto i = 0; i != 16; ++i) {
+		result.text += paragraph;
+	}
+	return result;
+}
+
+TextWithEntities ParsedSampleText() {
+	auto result = SampleText();
+	TextUtilities::ParseEntities(result, TextParseLinks | TextParseMentions | TextParseHashtags | TextParseBotCommands | TextParseMarkdown);
+	return result;
+}
+
+mtpBuffer SampleMessages() {
+	auto messages = QVector<MTPMessage>();
+	messages.reserve(kMessagesCount);
+	const auto text = SampleText().text;
+	for (auto i = 0; i != kMessagesCount; ++i) {
+		const auto flags = MTPDmessage::Flag::f_from_id;
+		messages.push_back(MTP_message(MTP_flags(flags), MTP_int(i + 1), MTP_int(1), MTP_peerUser(MTP_int(2)), MTPnullFwdHeader, MTPint(), MTPint(), MTP_int(1500000000 + i), MTP_string(text), MTP_messageMediaEmpty(), MTPnullMarkup, MTPnullEntities, MTPint(), MTPint(), MTPstring()));
+	}
+	auto result = mtpBuffer();
+	MTP_messages_messages(MTP_vector<MTPMessage>(messages), MTP_vector<MTPChat>(0), MTP_vector<MTPUser>(0)).write(result);
+	return result;
+}
+
+QImage SampleImage() {
+	auto result = QImage(1280, 960, QImage::Format_ARGB32_Premultiplied);
+	{
+		Painter p(&result);
+		auto gradient = QLinearGradient(0, 0, result.width(), result.height());
+		gradient.setStops({ { 0., QColor(255, 0, 0) }, { 0.5, QColor(0, 255, 0) }, { 1., QColor(0, 0, 255) } });
+		p.fillRect(result.rect(), gradient);
+	}
+	return result;
+}
+
+QString Format(const base::benchmark::Result &result) {
+	return qsl("%1: median %2 mcs, p90 %3 mcs, p99 %4 mcs, min %5 mcs, max %6 mcs (%7 runs)"
+		).arg(QString::fromStdString(result.name)
+		).arg(result.median, 0, 'f', 1
+		).arg(result.p90, 0, 'f', 1
+		).arg(result.p99, 0, 'f', 1
+		).arg(result.min, 0, 'f', 1
+		).arg(result.max, 0, 'f', 1
+		).arg(result.iterations);
+}
+
+} // namespace
+
+QString Run() {
+	using base::benchmark::Measure;
+	using base::benchmark::keep;
+
+	auto results = std::vector<base::benchmark::Result>();
+
+	const auto parsed = ParsedSampleText();
+	results.push_back(Measure("Text::setMarkedText", kWarmup, kIterations, [&] {
+		auto text = Text(st::msgMinWidth);
+		text.setMarkedText(st::messageTextStyle, parsed, _historyTextOptions);
+		keep(text);
+	}));
+
+	const auto sample = SampleText();
+	results.push_back(Measure("Ui::Emoji::Find", kWarmup, kIterations, [&] {
+		auto found = 0;
+		for (auto ch = sample.text.constData(), end = ch + sample.text.size(); ch != end;) {
+			auto length = 0;
+			if (Ui::Emoji::Find(ch, end, &length)) {
+				++found;
+				ch += length;
+			} else {
+				++ch;
+			}
+		}
+		keep(found);
+	}));
+
+	results.push_back(Measure("TextUtilities::ParseEntities", kWarmup, kIterations, [&] {
+		auto text = sample;
+		TextUtilities::ParseEntities(text, TextParseLinks | TextParseMentions | TextParseHashtags | TextParseBotCommands | TextParseMarkdown);
+		keep(text);
+	}));
+
+	const auto url = qsl("https://t.me/joinchat/AAAAAEHbEkejzxUjAUCzYA");
+	results.push_back(Measure("qthelp::regex_match", kWarmup, kIterations, [&] {
+		auto match = qthelp::regex_match(qsl("^https?://(www\\.)?(telegram\\.(me|dog)|t\\.me)/(.+)$"), url, qthelp::RegExOption::CaseInsensitive);
+		keep(match->capturedStart(4));
+	}));
+
+	const auto messages = SampleMessages();
+	results.push_back(Measure("MTPmessages_Messages::read", kWarmup, kIterations, [&] {
+		auto from = messages.constData();
+		auto result = MTPmessages_Messages();
+		result.read(from, from + messages.size());
+		keep(result);
+	}));
+
+	// Items registry as App kept it before and as it keeps it now.
+	auto items = std::vector<int>(kIndexMessagesPerChannel);
+	auto oldIndex = QMap<ChannelId, QHash<MsgId, int*>>();
+	auto newIndex = base::flat_hash_map<ChannelId, base::dense_id_map<MsgId, int*>>();
+	for (auto channel = 1; channel <= kIndexChannels; ++channel) {
+		auto &oldMessages = oldIndex[channel];
+		auto &newMessages = newIndex[channel];
+		for (auto i = 0; i != kIndexMessagesPerChannel; ++i) {
+			auto msgId = MsgId(1000000 + i);
+			oldMessages.insert(msgId, &items[i]);
+			newMessages.set(msgId, &items[i]);
+		}
+	}
+	auto lookupStep = 7919; // prime, so the lookups jump over the whole range
+	results.push_back(Measure("QMap<QHash> MsgId lookup", kWarmup, kIterations, [&] {
+		auto found = 0;
+		for (auto i = 0; i != kIndexMessagesPerChannel; ++i) {
+			auto channel = ChannelId(1 + i % kIndexChannels);
+			auto msgId = MsgId(1000000 + (i * lookupStep) % kIndexMessagesPerChannel);
+			auto j = oldIndex.constFind(channel);
+			if (j != oldIndex.cend() && j->value(msgId)) {
+				++found;
+			}
+		}
+		keep(found);
+	}));
+	results.push_back(Measure("dense_id_map MsgId lookup", kWarmup, kIterations, [&] {
+		auto found = 0;
+		for (auto i = 0; i != kIndexMessagesPerChannel; ++i) {
+			auto channel = ChannelId(1 + i % kIndexChannels);
+			auto msgId = MsgId(1000000 + (i * lookupStep) % kIndexMessagesPerChannel);
+			auto j = newIndex.find(channel);
+			if (j != newIndex.end() && j->second.value(msgId)) {
+				++found;
+			}
+		}
+		keep(found);
+	}));
+
+	const auto image = SampleImage();
+	results.push_back(Measure("Images::prepare", kWarmup, kIterations / 4, [&] {
+		const auto options = Images::Option::Smooth
+			| Images::Option::RoundedLarge
+			| Images::Option::RoundedTopLeft
+			| Images::Option::RoundedTopRight
+			| Images::Option::RoundedBottomLeft
+			| Images::Option::RoundedBottomRight;
+		auto result = Images::prepare(image, 320 * cIntRetinaFactor(), 240 * cIntRetinaFactor(), options, 320, 240);
+		keep(result);
+	}));
+
+	auto key = QByteArray(32, 'k');
+	auto iv = QByteArray(32, 'i');
+	auto encrypted = QByteArray(kDecryptSize, 'e');
+	auto decrypted = QByteArray(kDecryptSize, Qt::Uninitialized);
+	results.push_back(Measure("MTP::aesIgeDecryptRaw 128KB", kWarmup, kIterations, [&] {
+		MTP::aesIgeDecryptRaw(encrypted.constData(), decrypted.data(), kDecryptSize, key.constData(), iv.constData());
+		keep(decrypted);
+	}));
+
+	auto lines = QStringList();
+	for (const auto &result : results) {
+		lines.push_back(Format(result));
+		LOG(("Benchmark: %1").arg(lines.back()));
+	}
+	return lines.join('\n');
+}
+
+} // namespace Benchmarks
@@ -0,0 +1,122 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/memory_stats.h"
+
+namespace MemoryStats {
+namespace {
+
+constexpr auto kKindsCount = static_cast<int>(Kind::KindsCount);
+
+struct Counters {
+	std::atomic<int64> count = { 0 };
+	std::atomic<int64> bytes = { 0 };
+};
+
+Counters Pushed[kKindsCount];
+base::lambda<Usage()> Providers[kKindsCount];
+
+Counters &CountersFor(Kind kind) {
+	Expects(kind != Kind::KindsCount);
+	return Pushed[static_cast<int>(kind)];
+}
+
+QString KindName(Kind kind) {
+	switch (kind) {
+	case Kind::Histories: return qsl("Histories");
+	case Kind::HistoryItems: return qsl("History items");
+	case Kind::TextLayouts: return qsl("Text layouts");
+	case Kind::ImageCache: return qsl("Image cache");
+	case Kind::ClipReaders: return qsl("Clip readers");
+	case Kind::AudioBuffers: return qsl("Audio buffers");
+	case Kind::MtpResponses: return qsl("MTP responses");
+	case Kind::LocalCaches: return qsl("Local caches");
+	case Kind::KindsCount: break;
+	}
+	Unexpected("Kind in MemoryStats::KindName.");
+}
+
+QString FormatBytes(int64 bytes) {
+	if (bytes >= 1024 * 1024) {
+		return QString::number(bytes / (1024. * 1024.), 'f', 1) + qsl(" MB");
+	} else if (bytes >= 1024) {
+		return QString::number(bytes / 1024.0, 'f', 1) + qsl(" KB");
+	}
+	return QString::number(bytes) + qsl(" B");
+}
+
+} // namespace
+
+namespace internal {
+
+void Change(Kind kind, int64 count, int64 bytes) {
+	auto &counters = CountersFor(kind);
+	if (count) {
+		counters.count.fetch_add(count, std::memory_order_relaxed);
+	}
+	if (bytes) {
+		counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+}
+
+} // namespace internal
+
+void Acquired(Kind kind, int64 bytes) {
+	internal::Change(kind, 1, bytes);
+}
+
+void Released(Kind kind, int64 bytes) {
+	internal::Change(kind, -1, -bytes);
+}
+
+void SetProvider(Kind kind, base::lambda<Usage()> provider) {
+	CountersFor(kind);
+	Providers[static_cast<int>(kind)] = std::move(provider);
+}
+
+void ClearProvider(Kind kind) {
+	SetProvider(kind, base::lambda<Usage()>());
+}
+
+Usage Get(Kind kind) {
+	auto &counters = CountersFor(kind);
+	if (auto &provider = Providers[static_cast<int>(kind)]) {
+		return provider();
+	}
+	auto result = Usage();
+	result.count = counters.count.load(std::memory_order_relaxed);
+	result.bytes = counters.bytes.load(std::memory_order_relaxed);
+	return result;
+}
+
+QString Dump() {
+	auto lines = QStringList();
+	auto total = int64(0);
+	for (auto i = 0; i != kKindsCount; ++i) {
+		auto kind = static_cast<Kind>(i);
+		auto usage = Get(kind);
+		total += usage.bytes;
+		lines.push_back(qsl("%1: %2, %3").arg(KindName(kind)).arg(usage.count).arg(FormatBytes(usage.bytes)));
+	}
+	lines.push_back(qsl("Total: %1").arg(FormatBytes(total)));
+	return lines.join('\n');
+}
+
+} // namespace MemoryStats
@@ -0,0 +1,100 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+#include <atomic>
+
+namespace MemoryStats {
+
+// Rough accounting of the memory held by the heavy client subsystems.
+//
+// Objects embed a Tracker (or call Acquired / Released) when they are cheap
+// to count on the fly, subsystems with their own bookkeeping register a
+// provider which is asked for the numbers only when they are shown.
+enum class Kind {
+	Histories,
+	HistoryItems,
+	TextLayouts,
+	ImageCache,
+	ClipReaders,
+	AudioBuffers,
+	MtpResponses,
+	LocalCaches,
+
+	KindsCount,
+};
+
+struct Usage {
+	int64 count = 0;
+	int64 bytes = 0;
+};
+
+// Thread: Any.
+void Acquired(Kind kind, int64 bytes);
+void Released(Kind kind, int64 bytes);
+
+// Thread: Main. The provider replaces the pushed counters of the kind.
+void SetProvider(Kind kind, base::lambda<Usage()> provider);
+void ClearProvider(Kind kind);
+
+// Thread: Main.
+Usage Get(Kind kind);
+QString Dump();
+
+namespace internal {
+
+void Change(Kind kind, int64 count, int64 bytes);
+
+} // namespace internal
+
+// Counts the object it is a member of together with the bytes it reports.
+// Copies are counted separately, the owner updates the bytes after a change.
+template <Kind kind>
+class Tracker {
+public:
+	Tracker() {
+		internal::Change(kind, 1, 0);
+	}
+	Tracker(const Tracker &other) : _bytes(other._bytes) {
+		internal::Change(kind, 1, _bytes);
+	}
+	Tracker &operator=(const Tracker &other) {
+		setBytes(other._bytes);
+		return *this;
+	}
+	~Tracker() {
+		internal::Change(kind, -1, -_bytes);
+	}
+
+	void setBytes(int64 bytes) {
+		if (_bytes != bytes) {
+			internal::Change(kind, 0, bytes - _bytes);
+			_bytes = bytes;
+		}
+	}
+
+private:
+	int64 _bytes = 0;
+
+};
+
+} // namespace MemoryStats
@@ -0,0 +1,312 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/scroll_benchmark.h"
+
+#include "base/benchmark.h"
+#include "base/timer.h"
+#include "core/memory_stats.h"
+#include "ui/frame_stats.h"
+#include "ui/widgets/scroll_area.h"
+#include "history/history_inner_widget.h"
+#include "dialogs/dialogs_inner_widget.h"
+#include "chat_helpers/stickers_list_widget.h"
+#include "overviewwidget.h"
+#include "mainwindow.h"
+
+namespace ScrollBenchmark {
+namespace {
+
+constexpr int kVelocities[] = { 1000, 4000 }; // px per second
+constexpr auto kTickTimeout = TimeMs(4);
+constexpr auto kMaxPassDuration = TimeMs(6000);
+constexpr auto kFrameDuration = int64(16667); // mcs, one frame at 60 fps
+
+constexpr MemoryStats::Kind kTrackedMemory[] = {
+	MemoryStats::Kind::HistoryItems,
+	MemoryStats::Kind::TextLayouts,
+	MemoryStats::Kind::ImageCache,
+};
+
+struct Target {
+	QString name;
+	QPointer<Ui::ScrollArea> scroll;
+};
+
+struct Frame {
+	int64 finished = 0;
+	int64 spent = 0;
+};
+
+QString TargetName(QWidget *widget) {
+	if (dynamic_cast<HistoryInner*>(widget)) {
+		return qsl("history");
+	} else if (dynamic_cast<DialogsInner*>(widget)) {
+		return qsl("dialogs");
+	} else if (dynamic_cast<ChatHelpers::StickersListWidget*>(widget)) {
+		return qsl("stickers");
+	} else if (dynamic_cast<OverviewInner*>(widget)) {
+		return qsl("overview");
+	}
+	return QString();
+}
+
+bool HasTarget(const std::vector<Target> &targets, const QString &name) {
+	return std::find_if(targets.begin(), targets.end(), [&](const Target &target) {
+		return (target.name == name);
+	}) != targets.end();
+}
+
+Ui::ScrollArea *FindScroll(QWidget *widget) {
+	for (auto parent = widget->parentWidget(); parent; parent = parent->parentWidget()) {
+		if (auto scroll = qobject_cast<Ui::ScrollArea*>(parent)) {
+			return scroll;
+		}
+	}
+	return nullptr;
+}
+
+std::vector<Target> CollectTargets(QWidget *window) {
+	auto result = std::vector<Target>();
+	for (auto widget : window->findChildren<QWidget*>()) {
+		if (!widget->isVisible()) {
+			continue;
+		}
+		auto name = TargetName(widget);
+		if (name.isEmpty()) {
+			continue;
+		}
+		auto scroll = FindScroll(widget);
+		auto already = HasTarget(result, name);
+		if (scroll && !already) {
+			result.push_back({ name, scroll });
+		}
+	}
+	return result;
+}
+
+class Runner {
+public:
+	Runner(std::vector<Target> targets, QStringList skipped, base::lambda<void(const QString &path)> done);
+
+	void start();
+
+private:
+	void startPass();
+	void tick();
+	void finishPass();
+	void finish();
+
+	std::vector<Target> _targets;
+	QStringList _skipped;
+	base::lambda<void(const QString &path)> _done;
+	base::Timer _timer;
+
+	int _target = 0;
+	int _velocity = 0;
+	TimeMs _passStarted = 0;
+	std::vector<Frame> _frames;
+	std::vector<MemoryStats::Usage> _memory;
+	QJsonArray _passes;
+
+};
+
+std::unique_ptr<Runner> Instance;
+
+Runner::Runner(std::vector<Target> targets, QStringList skipped, base::lambda<void(const QString &path)> done)
+: _targets(std::move(targets))
+, _skipped(std::move(skipped))
+, _done(std::move(done))
+, _timer([this] { tick(); }) {
+}
+
+void Runner::start() {
+	Ui::FrameStats::SetFrameObserver([this](int64 spent) {
+		_frames.push_back({ Ui::FrameStats::internal::Now(), spent });
+	});
+	startPass();
+}
+
+void Runner::startPass() {
+	if (_target == int(_targets.size())) {
+		finish();
+		return;
+	}
+	auto scroll = _targets[_target].scroll;
+	if (!scroll) {
+		_skipped.push_back(_targets[_target].name);
+		++_target;
+		_velocity = 0;
+		startPass();
+		return;
+	}
+	scroll->scrollToY(0);
+	_frames.clear();
+	_memory.clear();
+	for (auto kind : kTrackedMemory) {
+		_memory.push_back(MemoryStats::Get(kind));
+	}
+	_passStarted = getms(true);
+	_timer.callEach(kTickTimeout);
+}
+
+void Runner::tick() {
+	auto scroll = _targets[_target].scroll;
+	if (!scroll) {
+		finishPass();
+		return;
+	}
+	auto elapsed = getms(true) - _passStarted;
+	auto top = int(kVelocities[_velocity] * elapsed / 1000);
+	if (top >= scroll->scrollTopMax() || elapsed >= kMaxPassDuration) {
+		scroll->scrollToY(top);
+		finishPass();
+		return;
+	}
+	scroll->scrollToY(top);
+}
+
+void Runner::finishPass() {
+	_timer.cancel();
+
+	auto duration = getms(true) - _passStarted;
+	auto times = std::vector<double>();
+	times.reserve(_frames.size());
+	auto slow = 0;
+	auto dropped = int64(0);
+	for (auto i = 0, count = int(_frames.size()); i != count; ++i) {
+		auto &frame = _frames[i];
+		times.push_back(double(frame.spent));
+		if (frame.spent > kFrameDuration) {
+			++slow;
+		}
+		if (i > 0) {
+			auto gap = frame.finished - _frames[i - 1].finished;
+			dropped += std::max((gap + kFrameDuration / 2) / kFrameDuration - 1, int64(0));
+		}
+	}
+	auto summary = base::benchmark::Summarize(std::string(), std::move(times));
+	auto ms = [](double mcs) {
+		return mcs / 1000.;
+	};
+
+	auto memory = QJsonObject();
+	for (auto i = 0, count = int(_memory.size()); i != count; ++i) {
+		auto now = MemoryStats::Get(kTrackedMemory[i]);
+		auto key = [&] {
+			switch (kTrackedMemory[i]) {
+			case MemoryStats::Kind::HistoryItems: return qsl("history_items");
+			case MemoryStats::Kind::TextLayouts: return qsl("text_layouts");
+			case MemoryStats::Kind::ImageCache: return qsl("image_cache");
+			}
+			return QString();
+		}();
+		memory.insert(key, QJsonObject {
+			{ qsl("count"), double(now.count - _memory[i].count) },
+			{ qsl("bytes"), double(now.bytes - _memory[i].bytes) },
+		});
+	}
+
+	auto scroll = _targets[_target].scroll;
+	_passes.append(QJsonObject {
+		{ qsl("target"), _targets[_target].name },
+		{ qsl("velocity"), kVelocities[_velocity] },
+		{ qsl("duration_ms"), double(duration) },
+		{ qsl("distance_px"), scroll ? scroll->scrollTop() : 0 },
+		{ qsl("frames"), summary.iterations },
+		{ qsl("frame_ms"), QJsonObject {
+			{ qsl("p50"), ms(summary.median) },
+			{ qsl("p90"), ms(summary.p90) },
+			{ qsl("p99"), ms(summary.p99) },
+			{ qsl("max"), ms(summary.max) },
+			{ qsl("mean"), ms(summary.mean) },
+		} },
+		{ qsl("slow_frames"), slow },
+		{ qsl("dropped_frames"), double(dropped) },
+		{ qsl("memory_delta"), memory },
+	});
+	LOG(("Scroll Benchmark: %1 at %2 px/s, %3 frames, p90 %4 ms, %5 dropped"
+		).arg(_targets[_target].name
+		).arg(kVelocities[_velocity]
+		).arg(summary.iterations
+		).arg(ms(summary.p90), 0, 'f', 1
+		).arg(dropped));
+
+	if (++_velocity == int(base::array_size(kVelocities))) {
+		_velocity = 0;
+		++_target;
+	}
+	startPass();
+}
+
+void Runner::finish() {
+	Ui::FrameStats::SetFrameObserver(nullptr);
+
+	auto skipped = QJsonArray();
+	for (auto &name : _skipped) {
+		skipped.append(name);
+	}
+	auto result = QJsonObject {
+		{ qsl("version"), str_const_toString(AppVersionStr) },
+		{ qsl("date"), QDateTime::currentDateTime().toString(Qt::ISODate) },
+		{ qsl("retina_factor"), cIntRetinaFactor() },
+		{ qsl("passes"), _passes },
+		{ qsl("skipped"), skipped },
+	};
+	auto json = QJsonDocument(result).toJson();
+
+	QDir().mkpath(cWorkingDir() + qstr("DebugLogs"));
+	auto path = cWorkingDir() + qsl("DebugLogs/scroll_benchmark_%1.json").arg(QDateTime::currentDateTime().toString(qsl("yyyyMMdd_hhmmss")));
+	QFile f(path);
+	if (!f.open(QIODevice::WriteOnly) || f.write(json) != json.size()) {
+		LOG(("Scroll Benchmark Error: could not write '%1'.").arg(path));
+		path = QString();
+	}
+
+	auto done = std::move(_done);
+	Instance = nullptr; // Destroys this.
+	if (done) {
+		done(path);
+	}
+}
+
+} // namespace
+
+void Start(base::lambda<void(const QString &path)> done) {
+	auto window = App::wnd();
+	if (Instance || !window) {
+		return;
+	}
+	auto targets = CollectTargets(window);
+	auto skipped = QStringList();
+	for (auto name : { qsl("history"), qsl("dialogs"), qsl("stickers"), qsl("overview") }) {
+		if (!HasTarget(targets, name)) {
+			skipped.push_back(name);
+		}
+	}
+	Instance = std::make_unique<Runner>(std::move(targets), std::move(skipped), std::move(done));
+	Instance->start();
+}
+
+bool Running() {
+	return (Instance != nullptr);
+}
+
+} // namespace ScrollBenchmark
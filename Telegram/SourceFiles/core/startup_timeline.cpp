@@ -0,0 +1,118 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/startup_timeline.h"
+
+#include <chrono>
+#include <ctime>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif // Q_OS_WIN
+
+namespace StartupTimeline {
+namespace {
+
+struct Phase {
+	const char *name = nullptr;
+	TimeMs wall = 0;
+	TimeMs cpu = 0;
+};
+
+bool Started = false;
+bool Finished = false;
+bool Exceeded = false;
+std::chrono::steady_clock::time_point StartTime;
+TimeMs LastWall = 0;
+TimeMs LastCpu = 0;
+std::vector<Phase> Phases;
+
+TimeMs WallTime() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - StartTime).count();
+}
+
+// Process time of all the threads.
+TimeMs CpuTime() {
+#ifdef Q_OS_WIN
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	auto value = [](const FILETIME &time) {
+		return (TimeMs(time.dwHighDateTime) << 32) | TimeMs(time.dwLowDateTime);
+	};
+	return (value(kernel) + value(user)) / 10000; // 100 ns intervals
+#else // Q_OS_WIN
+	return TimeMs(std::clock()) * 1000 / CLOCKS_PER_SEC;
+#endif // Q_OS_WIN
+}
+
+} // namespace
+
+void Start() {
+	Expects(!Started);
+
+	Started = true;
+	StartTime = std::chrono::steady_clock::now();
+	LastCpu = CpuTime();
+	Phases.reserve(16);
+}
+
+void Mark(const char *phase) {
+	if (!Started || Finished) {
+		return;
+	}
+	auto wall = WallTime();
+	auto cpu = CpuTime();
+	Phases.push_back({ phase, wall - LastWall, cpu - LastCpu });
+	LastWall = wall;
+	LastCpu = cpu;
+}
+
+void Finish() {
+	if (!Started || Finished) {
+		return;
+	}
+	Finished = true;
+
+	auto budget = cStartupBudget();
+	auto at = TimeMs(0);
+	for (auto &phase : Phases) {
+		at += phase.wall;
+		LOG(("Startup: %1 finished at %2 ms, took %3 ms (%4 ms cpu).").arg(phase.name).arg(at).arg(phase.wall).arg(phase.cpu));
+		if (budget > 0 && phase.wall > budget) {
+			LOG(("Startup Error: %1 exceeded the budget of %2 ms.").arg(phase.name).arg(budget));
+			Exceeded = true;
+		}
+	}
+	LOG(("Startup: finished in %1 ms (%2 ms cpu).").arg(LastWall).arg(LastCpu));
+	base::take(Phases);
+
+	if (budget > 0) {
+		// Finish() can be called from the Messenger constructor.
+		InvokeQueued(QCoreApplication::instance(), [] { App::quit(); });
+	}
+}
+
+bool BudgetExceeded() {
+	return Exceeded;
+}
+
+} // namespace StartupTimeline
@@ -0,0 +1,43 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+namespace StartupTimeline {
+
+// Wall and CPU time of the client startup phases, written to the log
+// on each launch when the startup is finished.
+//
+// With "-startupbudget <ms>" a phase that took longer than the budget
+// fails the run: the client quits after the startup with exit code 1.
+
+// Must be called first thing in main().
+void Start();
+
+// Marks the end of the phase that started at the previous mark.
+void Mark(const char *phase);
+
+// Logs the timeline, the following calls are ignored.
+void Finish();
+
+bool BudgetExceeded();
+
+} // namespace StartupTimeline
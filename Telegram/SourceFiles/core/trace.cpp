@@ -0,0 +1,203 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/trace.h"
+
+#include <chrono>
+
+namespace Trace {
+namespace internal {
+
+std::atomic<bool> Recording = { false };
+
+} // namespace internal
+
+namespace {
+
+constexpr auto kEventsPerThread = 16384;
+constexpr auto kMaxFinishedThreads = 32;
+
+struct Event {
+	const char *name = nullptr;
+	int64 begin = 0;
+	int64 end = 0;
+};
+
+// Written by its thread, read by Export() from the main thread.
+class ThreadEvents {
+public:
+	ThreadEvents(int id, const QString &name) : _id(id), _name(name), _events(kEventsPerThread) {
+	}
+
+	int id() const {
+		return _id;
+	}
+	QString name() const {
+		return _name;
+	}
+
+	void add(const char *name, int64 begin, int64 end) {
+		QMutexLocker lock(&_mutex);
+		auto &event = _events[_next];
+		event.name = name;
+		event.begin = begin;
+		event.end = end;
+		_next = (_next + 1) % kEventsPerThread;
+		if (_count < kEventsPerThread) {
+			++_count;
+		}
+	}
+	void clear() {
+		QMutexLocker lock(&_mutex);
+		_count = _next = 0;
+	}
+
+	template <typename Callback>
+	void enumerate(Callback &&callback) const {
+		QMutexLocker lock(&_mutex);
+		for (auto i = 0; i != _count; ++i) {
+			callback(_events[(_next - _count + i + kEventsPerThread) % kEventsPerThread]);
+		}
+	}
+
+private:
+	const int _id = 0;
+	const QString _name;
+	mutable QMutex _mutex;
+	std::vector<Event> _events;
+	int _next = 0;
+	int _count = 0;
+
+};
+
+QMutex ThreadsMutex;
+std::vector<std::shared_ptr<ThreadEvents>> Threads;
+int ThreadsCounter = 0;
+
+QThreadStorage<std::shared_ptr<ThreadEvents>> CurrentThreadEvents;
+
+QString CurrentThreadName() {
+	auto thread = QThread::currentThread();
+	auto application = QCoreApplication::instance();
+	if (application && thread == application->thread()) {
+		return qsl("Main");
+	} else if (!thread->objectName().isEmpty()) {
+		return thread->objectName();
+	}
+	return QString::fromLatin1(thread->metaObject()->className());
+}
+
+ThreadEvents *RegisterCurrentThread() {
+	auto events = std::shared_ptr<ThreadEvents>();
+	{
+		QMutexLocker lock(&ThreadsMutex);
+
+		// Drop the oldest events of the finished threads.
+		auto finished = int(std::count_if(Threads.begin(), Threads.end(), [](auto &thread) {
+			return thread.use_count() == 1;
+		}));
+		for (auto i = Threads.begin(); i != Threads.end() && finished > kMaxFinishedThreads;) {
+			if (i->use_count() == 1) {
+				i = Threads.erase(i);
+				--finished;
+			} else {
+				++i;
+			}
+		}
+
+		events = std::make_shared<ThreadEvents>(++ThreadsCounter, CurrentThreadName());
+		Threads.push_back(events);
+	}
+	CurrentThreadEvents.setLocalData(events);
+	return events.get();
+}
+
+QByteArray Escaped(QString value) {
+	return value.replace('\\', qsl("\\\\")).replace('"', qsl("\\\"")).toUtf8();
+}
+
+} // namespace
+
+namespace internal {
+
+int64 Now() {
+	using namespace std::chrono;
+	return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Record(const char *name, int64 begin, int64 end) {
+	auto events = CurrentThreadEvents.hasLocalData()
+		? CurrentThreadEvents.localData().get()
+		: RegisterCurrentThread();
+	events->add(name, begin, end);
+}
+
+} // namespace internal
+
+void Start() {
+	if (internal::Recording.exchange(true)) {
+		return;
+	}
+	QMutexLocker lock(&ThreadsMutex);
+	for (auto &thread : Threads) {
+		thread->clear();
+	}
+}
+
+void Stop() {
+	internal::Recording = false;
+}
+
+bool Started() {
+	return internal::Recording;
+}
+
+QByteArray Export(TimeMs duration) {
+	auto threads = ([] {
+		QMutexLocker lock(&ThreadsMutex);
+		return Threads;
+	})();
+
+	const auto from = internal::Now() - duration * 1000LL;
+	auto result = QByteArray("{\"traceEvents\":[\n");
+	auto separator = "";
+	auto append = [&](const QByteArray &event) {
+		result.append(separator).append(event);
+		separator = ",\n";
+	};
+	for (auto &thread : threads) {
+		append(QByteArray("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":")
+			+ QByteArray::number(thread->id())
+			+ ",\"args\":{\"name\":\"" + Escaped(thread->name()) + "\"}}");
+		thread->enumerate([&](const Event &event) {
+			if (event.end < from) {
+				return;
+			}
+			append(QByteArray("{\"name\":\"") + event.name
+				+ "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(thread->id())
+				+ ",\"ts\":" + QByteArray::number(event.begin)
+				+ ",\"dur\":" + QByteArray::number(event.end - event.begin) + "}");
+		});
+	}
+	result.append("\n]}\n");
+	return result;
+}
+
+} // namespace Trace
@@ -0,0 +1,74 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <atomic>
+
+
+namespace Trace {
+
+// Scoped trace events for finding where the time goes across the threads.
+//
+// Each thread keeps the last events in its own ring, Export() merges them
+// in the Chrome trace event JSON format (open it in chrome://tracing).
+// While the recording is stopped a TRACE_SCOPE costs one atomic load.
+void Start();
+void Stop();
+bool Started();
+
+// Returns the events that finished in the last "duration" ms.
+QByteArray Export(TimeMs duration);
+
+namespace internal {
+
+extern std::atomic<bool> Recording;
+void Record(const char *name, int64 begin, int64 end);
+int64 Now(); // mcs
+
+} // namespace internal
+
+class Scope {
+public:
+	explicit Scope(const char *name)
+	: _name(internal::Recording.load(std::memory_order_relaxed) ? name : nullptr)
+	, _begin(_name ? internal::Now() : 0) {
+	}
+	Scope(const Scope &other) = delete;
+	Scope &operator=(const Scope &other) = delete;
+	~Scope() {
+		if (_name) {
+			internal::Record(_name, _begin, internal::Now());
+		}
+	}
+
+private:
+	const char *_name;
+	int64 _begin;
+
+};
+
+} // namespace Trace
+
+#define TRACE_SCOPE_CONCAT_(a, b) a##b
+#define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT_(a, b)
+
+// The name must be a string literal or live forever otherwise.
+#define TRACE_SCOPE(name) Trace::Scope TRACE_SCOPE_CONCAT(TraceScope, __LINE__)(name)
@@ -587,7 +587,8 @@ static int32 AlmostFullArcLength = (FullArcLength - MinArcLength);
 
 template <typename T, typename... Args>
 inline QSharedPointer<T> MakeShared(Args&&... args) {
-	return QSharedPointer<T>(new T(std::forward<Args>(args)...));
+	// The object and the reference counter are allocated in one block.
+	return QSharedPointer<T>::create(std::forward<Args>(args)...);
 }
 
 // This pointer is used for global non-POD variables that are allocated
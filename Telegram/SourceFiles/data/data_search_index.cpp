@@ -0,0 +1,154 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "data/data_search_index.h"
+
+#include "history/history.h"
+#include "storage/localstorage.h"
+
+namespace Data {
+
+void SearchIndex::add(not_null<HistoryItem*> item, const QString &text) {
+	remove(item);
+
+	auto words = TextUtilities::PrepareSearchWords(text);
+	if (words.isEmpty()) {
+		return;
+	}
+	words.removeDuplicates();
+	for_const (auto &word, words) {
+		_items[word].insert(item);
+	}
+	_itemWords.emplace(item, std::move(words));
+}
+
+void SearchIndex::remove(not_null<HistoryItem*> item) {
+	auto i = _itemWords.find(item);
+	if (i == _itemWords.end()) {
+		return;
+	}
+	for_const (auto &word, i->second) {
+		auto j = _items.find(word);
+		if (j != _items.end()) {
+			j->second.erase(item);
+			if (j->second.empty()) {
+				_items.erase(j);
+			}
+		}
+	}
+	_itemWords.erase(i);
+}
+
+std::vector<not_null<HistoryItem*>> SearchIndex::search(const QString &query, PeerData *inPeer, UserData *from, int limit) {
+	auto words = TextUtilities::PrepareSearchWords(query);
+	if (words.isEmpty()) {
+		return {};
+	}
+
+	auto migrated = inPeer ? inPeer->migrateFrom() : nullptr;
+	auto inSearchedPeer = [inPeer, migrated](PeerId peerId) {
+		return !inPeer || (peerId == inPeer->id) || (migrated && peerId == migrated->id);
+	};
+
+	// Stored messages become items and are indexed by their current text.
+	if (inPeer) {
+		indexStored(inPeer);
+		if (migrated) {
+			indexStored(migrated);
+		}
+		for (auto &id : find(_stored, words)) {
+			if (inSearchedPeer(id.first) && !App::histItemById(peerToChannel(id.first), id.second)) {
+				createStored(id);
+			}
+		}
+	}
+
+	auto result = std::vector<not_null<HistoryItem*>>();
+	for (auto item : find(_items, words)) {
+		if (!inSearchedPeer(item->history()->peer->id)) {
+			continue;
+		} else if (from && item->from() != from) {
+			continue;
+		}
+		result.push_back(item);
+	}
+	std::sort(result.begin(), result.end(), [](not_null<HistoryItem*> a, not_null<HistoryItem*> b) {
+		return (a->date > b->date) || (a->date == b->date && a->id > b->id);
+	});
+	if (int(result.size()) > limit) {
+		result.resize(limit);
+	}
+	return result;
+}
+
+void SearchIndex::indexStored(not_null<PeerData*> peer) {
+	if (!_storedIndexed.insert(peer->id).second) {
+		return;
+	}
+	for_const (auto &message, Local::readStoredHistoryMessages(peer->id)) {
+		if (message.type() != mtpc_message) {
+			continue;
+		}
+		auto &d = message.c_message();
+		auto words = TextUtilities::PrepareSearchWords(qs(d.vmessage));
+		words.removeDuplicates();
+		for_const (auto &word, words) {
+			_stored[word].insert(StoredId(peer->id, d.vid.v));
+		}
+	}
+}
+
+HistoryItem *SearchIndex::createStored(const StoredId &id) {
+	auto message = MTPMessage();
+	if (!App::peerLoaded(id.first) || !Local::readStoredHistoryMessage(id.first, id.second, &message)) {
+		return nullptr;
+	}
+	return App::histories().addNewMessage(message, NewMessageExisting);
+}
+
+template <typename Value>
+std::set<Value> SearchIndex::find(const std::map<QString, std::set<Value>> &index, const QStringList &words) const {
+	auto result = std::set<Value>();
+	auto first = true;
+	for_const (auto &word, words) {
+		auto matched = std::set<Value>();
+		for (auto i = index.lower_bound(word); i != index.end() && i->first.startsWith(word); ++i) {
+			matched.insert(i->second.begin(), i->second.end());
+		}
+		if (first) {
+			result = std::move(matched);
+			first = false;
+		} else {
+			for (auto i = result.begin(); i != result.end();) {
+				if (matched.find(*i) == matched.end()) {
+					i = result.erase(i);
+				} else {
+					++i;
+				}
+			}
+		}
+		if (result.empty()) {
+			break;
+		}
+	}
+	return result;
+}
+
+} // namespace Data
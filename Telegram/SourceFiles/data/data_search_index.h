@@ -0,0 +1,52 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Data {
+
+// Word prefixes of the loaded and locally stored messages, for showing
+// search results before the server replies. Stored messages of a peer
+// are indexed when searching in that peer for the first time.
+class SearchIndex {
+public:
+	void add(not_null<HistoryItem*> item, const QString &text);
+	void remove(not_null<HistoryItem*> item);
+
+	// Newest first, stored messages found are created as history items.
+	std::vector<not_null<HistoryItem*>> search(const QString &query, PeerData *inPeer, UserData *from, int limit);
+
+private:
+	using StoredId = std::pair<PeerId, MsgId>;
+
+	void indexStored(not_null<PeerData*> peer);
+	HistoryItem *createStored(const StoredId &id);
+
+	template <typename Value>
+	std::set<Value> find(const std::map<QString, std::set<Value>> &index, const QStringList &words) const;
+
+	std::map<QString, std::set<HistoryItem*>> _items;
+	std::map<HistoryItem*, QStringList> _itemWords;
+	std::map<QString, std::set<StoredId>> _stored;
+	std::set<PeerId> _storedIndexed;
+
+};
+
+} // namespace Data
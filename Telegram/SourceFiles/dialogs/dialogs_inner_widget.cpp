@@ -33,6 +33,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mainwidget.h"
 #include "storage/localstorage.h"
 #include "apiwrap.h"
+#include "base/flat_set.h"
 #include "window/themes/window_theme.h"
 #include "observer_peer.h"
 #include "auth_session.h"
@@ -464,7 +465,8 @@ void DialogsInner::paintSearchInPeer(Painter &p, int fullWidth, bool onlyBackgro
 	}
 }
 
-void DialogsInner::paintSearchInFilter(Painter &p, not_null<PeerData*> peer, int top, int fullWidth, const Text &text) const {
+template <typename PaintableText>
+void DialogsInner::paintSearchInFilter(Painter &p, not_null<PeerData*> peer, int top, int fullWidth, const PaintableText &text) const {
 	auto pen = p.pen();
 	peer->paintUserpicLeft(p, st::dialogsPadding.x(), top + (st::dialogsSearchInHeight - st::dialogsSearchInPhotoSize) / 2, getFullWidth(), st::dialogsSearchInPhotoSize);
 
@@ -1278,15 +1280,48 @@ void DialogsInner::onFilterUpdate(QString newFilter, bool force) {
 	auto words = TextUtilities::PrepareSearchWords(newFilter);
 	newFilter = words.isEmpty() ? QString() : words.join(' ');
 	if (newFilter != _filter || force) {
+		auto wasFilter = _filter;
 		_filter = newFilter;
 		if (_filter.isEmpty() && !_searchFromUser) {
 			clearFilter();
 		} else {
 			QStringList::const_iterator fb = words.cbegin(), fe = words.cend(), fi;
+			auto matches = [fb, fe](Dialogs::Row *row) {
+				const PeerData::Names &names(row->history()->peer->names);
+				PeerData::Names::const_iterator nb = names.cbegin(), ne = names.cend(), ni;
+				for (auto i = fb; i != fe; ++i) {
+					for (ni = nb; ni != ne; ++ni) {
+						if (ni->startsWith(*i)) {
+							break;
+						}
+					}
+					if (ni == ne) {
+						return false;
+					}
+				}
+				return true;
+			};
+
+			// If the filter was only extended (the user typed more) and the
+			// lists did not change, the new results are a subset of the old ones.
+			auto narrowing = !force
+				&& !_searchInPeer
+				&& !wasFilter.isEmpty()
+				&& _filter.startsWith(wasFilter)
+				&& (_filterResultsFor == wasFilter)
+				&& (_filterResultsDialogsCount == _dialogs->size())
+				&& (_filterResultsContactsCount == _contactsNoDialogs->size());
 
 			_state = FilteredState;
-			_filterResults.clear();
-			if (!_searchInPeer && !words.isEmpty()) {
+			auto wasResults = base::take(_filterResults);
+			_filterResultsFor = QString();
+			if (narrowing) {
+				for_const (auto row, wasResults) {
+					if (matches(row)) {
+						_filterResults.push_back(row);
+					}
+				}
+			} else if (!_searchInPeer && !words.isEmpty()) {
 				const Dialogs::List *toFilter = nullptr;
 				if (!_dialogs->isEmpty()) {
 					for (fi = fb; fi != fe; ++fi) {
@@ -1316,45 +1351,24 @@ void DialogsInner::onFilterUpdate(QString newFilter, bool force) {
 				_filterResults.reserve((toFilter ? toFilter->size() : 0) + (toFilterContacts ? toFilterContacts->size() : 0));
 				if (toFilter) {
 					for_const (auto row, *toFilter) {
-						const PeerData::Names &names(row->history()->peer->names);
-						PeerData::Names::const_iterator nb = names.cbegin(), ne = names.cend(), ni;
-						for (fi = fb; fi != fe; ++fi) {
-							QString filterName(*fi);
-							for (ni = nb; ni != ne; ++ni) {
-								if (ni->startsWith(*fi)) {
-									break;
-								}
-							}
-							if (ni == ne) {
-								break;
-							}
-						}
-						if (fi == fe) {
+						if (matches(row)) {
 							_filterResults.push_back(row);
 						}
 					}
 				}
 				if (toFilterContacts) {
 					for_const (auto row, *toFilterContacts) {
-						const PeerData::Names &names(row->history()->peer->names);
-						PeerData::Names::const_iterator nb = names.cbegin(), ne = names.cend(), ni;
-						for (fi = fb; fi != fe; ++fi) {
-							QString filterName(*fi);
-							for (ni = nb; ni != ne; ++ni) {
-								if (ni->startsWith(*fi)) {
-									break;
-								}
-							}
-							if (ni == ne) {
-								break;
-							}
-						}
-						if (fi == fe) {
+						if (matches(row)) {
 							_filterResults.push_back(row);
 						}
 					}
 				}
 			}
+			if (!_searchInPeer && !words.isEmpty()) {
+				_filterResultsFor = _filter;
+				_filterResultsDialogsCount = _dialogs->size();
+				_filterResultsContactsCount = _contactsNoDialogs->size();
+			}
 			refresh(true);
 		}
 		setMouseSelection(false, true);
@@ -1454,6 +1468,7 @@ void DialogsInner::itemRemoved(HistoryItem *item) {
 }
 
 void DialogsInner::dialogsReceived(const QVector<MTPDialog> &added) {
+	clearDialogsSnapshot(added);
 	for_const (auto &dialog, added) {
 		if (dialog.type() != mtpc_dialog) {
 			continue;
@@ -1515,6 +1530,91 @@ void DialogsInner::addAllSavedPeers() {
 	addSavedPeersAfter(QDateTime());
 }
 
+void DialogsInner::showDialogsSnapshot() {
+	auto entries = Local::readDialogsSnapshot();
+	for_const (auto &entry, entries) {
+		if (entry.date.isNull()) {
+			continue;
+		}
+		auto history = App::history(entry.peer->id);
+		if (!history->lastMsgDate.isNull()) {
+			continue;
+		}
+		history->setUnreadCount(entry.unreadCount);
+		history->setChatsListDate(entry.date);
+		if (history->inChatList(Dialogs::Mode::All)) {
+			_dialogsSnapshot.push_back(history);
+		}
+	}
+	if (!_dialogsSnapshot.empty()) {
+		refresh();
+	}
+}
+
+void DialogsInner::writeDialogsSnapshot() const {
+	auto entries = QVector<Local::DialogsSnapshotEntry>();
+	entries.reserve(DialogsFirstLoad);
+	for_const (auto row, _dialogs->all()) {
+		auto history = row->history();
+		if (history->lastMsgDate.isNull()) {
+			continue;
+		}
+		auto entry = Local::DialogsSnapshotEntry();
+		entry.peer = history->peer;
+		entry.date = history->lastMsgDate;
+		entry.unreadCount = history->unreadCount();
+		entries.push_back(entry);
+		if (entries.size() == DialogsFirstLoad) {
+			break;
+		}
+	}
+	Local::writeDialogsSnapshot(entries);
+}
+
+void DialogsInner::clearDialogsSnapshot(const QVector<MTPDialog> &received) {
+	if (_dialogsSnapshot.empty()) {
+		return;
+	}
+	auto receivedPeers = base::flat_set<PeerId>();
+	for_const (auto &dialog, received) {
+		if (dialog.type() == mtpc_dialog) {
+			receivedPeers.insert(peerFromMTP(dialog.c_dialog().vpeer));
+		}
+	}
+	for (auto history : base::take(_dialogsSnapshot)) {
+		if (history->lastMsg) {
+			// Real data already arrived for this history.
+			continue;
+		}
+
+		// The unread count from the server replaces the stored one.
+		history->setUnreadCount(0);
+		if (receivedPeers.contains(history->peer->id)) {
+			continue;
+		}
+
+		// Not in the top slice any more, it will be added back (if needed)
+		// when it is received in one of the next slices.
+		if (_selected && _selected->history() == history) {
+			_selected = nullptr;
+		}
+		if (_pressed && _pressed->history() == history) {
+			setPressed(nullptr);
+		}
+		history->removeFromChatList(Dialogs::Mode::All, _dialogs.get());
+		if (_dialogsImportant) {
+			history->removeFromChatList(Dialogs::Mode::Important, _dialogsImportant.get());
+		}
+		history->lastMsgDate = QDateTime();
+		if (_contacts->contains(history->peer->id)) {
+			if (!_contactsNoDialogs->contains(history->peer->id)) {
+				_contactsNoDialogs->addByName(history);
+			}
+		}
+	}
+	emit App::main()->dialogsUpdated();
+}
+
 bool DialogsInner::searchReceived(const QVector<MTPMessage> &messages, DialogsSearchRequestType type, int32 fullCount) {
 	if (type == DialogsSearchFromStart || type == DialogsSearchPeerFromStart) {
 		clearSearchResults(false);
@@ -1560,6 +1660,18 @@ bool DialogsInner::searchReceived(const QVector<MTPMessage> &messages, DialogsSe
 	return lastDateFound != 0;
 }
 
+void DialogsInner::localSearchReceived(const std::vector<not_null<HistoryItem*>> &items) {
+	clearSearchResults(false);
+	for (auto item : items) {
+		_searchResults.push_back(std::make_unique<Dialogs::FakeRow>(item));
+	}
+	_searchedCount = _searchResults.size();
+	if (_state == FilteredState && !_searchResults.empty()) {
+		_state = SearchedState;
+	}
+	refresh();
+}
+
 void DialogsInner::peerSearchReceived(const QString &query, const QVector<MTPPeer> &result) {
 	_peerSearchQuery = query.toLower().trimmed();
 	_peerSearchResults.clear();
@@ -1722,6 +1834,7 @@ void DialogsInner::setState(State newState) {
 		_hashtagResults.clear();
 		_hashtagSelected = -1;
 		_filterResults.clear();
+		_filterResultsFor = QString();
 		_filteredSelected = -1;
 	}
 	onFilterUpdate(_filter, true);
@@ -1763,6 +1876,7 @@ void DialogsInner::clearFilter() {
 		}
 		_hashtagResults.clear();
 		_filterResults.clear();
+		_filterResultsFor = QString();
 		_peerSearchResults.clear();
 		_searchResults.clear();
 		_lastSearchDate = 0;
@@ -2068,6 +2182,7 @@ void DialogsInner::saveRecentHashtags(const QString &text) {
 }
 
 void DialogsInner::destroyData() {
+	_dialogsSnapshot.clear();
 	_selected = nullptr;
 	_hashtagSelected = -1;
 	_hashtagResults.clear();
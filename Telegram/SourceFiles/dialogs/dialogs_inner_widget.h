@@ -48,7 +48,10 @@ public:
 	void dialogsReceived(const QVector<MTPDialog> &dialogs);
 	void addSavedPeersAfter(const QDateTime &date);
 	void addAllSavedPeers();
+	void showDialogsSnapshot();
+	void writeDialogsSnapshot() const;
 	bool searchReceived(const QVector<MTPMessage> &result, DialogsSearchRequestType type, int32 fullCount);
+	void localSearchReceived(const std::vector<not_null<HistoryItem*>> &items);
 	void peerSearchReceived(const QString &query, const QVector<MTPPeer> &result);
 	void showMore(int32 pixels);
 
@@ -172,6 +175,7 @@ private:
 		return _importantSwitchSelected || _selected || (_hashtagSelected >= 0) || (_filteredSelected >= 0) || (_peerSearchSelected >= 0) || (_searchedSelected >= 0);
 	}
 	void handlePeerNameChange(not_null<PeerData*> peer, const PeerData::Names &oldNames, const PeerData::NameFirstChars &oldChars);
+	void clearDialogsSnapshot(const QVector<MTPDialog> &received);
 
 	void itemRemoved(HistoryItem *item);
 	enum class UpdateRowSection {
@@ -195,7 +199,8 @@ private:
 	void paintDialog(Painter &p, Dialogs::Row *row, int fullWidth, PeerData *active, PeerData *selected, bool onlyBackground, TimeMs ms);
 	void paintPeerSearchResult(Painter &p, const PeerSearchResult *result, int fullWidth, bool active, bool selected, bool onlyBackground, TimeMs ms) const;
 	void paintSearchInPeer(Painter &p, int fullWidth, bool onlyBackground, TimeMs ms) const;
-	void paintSearchInFilter(Painter &p, not_null<PeerData*> peer, int top, int fullWidth, const Text &text) const;
+	template <typename PaintableText>
+	void paintSearchInFilter(Painter &p, not_null<PeerData*> peer, int top, int fullWidth, const PaintableText &text) const;
 
 	void clearSelection();
 	void clearSearchResults(bool clearPeerSearchResults = true);
@@ -223,6 +228,9 @@ private:
 	DialogsList _contactsNoDialogs;
 	DialogsList _contacts;
 
+	// Histories added from the local snapshot until the first server slice.
+	std::vector<History*> _dialogsSnapshot;
+
 	bool _mouseSelection = false;
 	QPoint _mouseLastGlobalPosition;
 	Qt::MouseButton _pressButton = Qt::LeftButton;
@@ -259,6 +267,9 @@ private:
 	bool _hashtagDeletePressed = false;
 
 	FilteredDialogs _filterResults;
+	QString _filterResultsFor;
+	int _filterResultsDialogsCount = 0;
+	int _filterResultsContactsCount = 0;
 	int _filteredSelected = -1;
 	int _filteredPressed = -1;
 
@@ -26,6 +26,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "styles/style_dialogs.h"
 #include "storage/localstorage.h"
 #include "lang/lang_keys.h"
+#include "ui/userpic_atlas.h"
 
 namespace Dialogs {
 namespace Layout {
@@ -34,27 +35,61 @@ namespace {
 // Show all dates that are in the last 20 hours in time format.
 constexpr int kRecentlyInSeconds = 20 * 3600;
 
-void paintRowDate(Painter &p, const QDateTime &date, QRect &rectForName, bool active, bool selected) {
-	auto now = QDateTime::currentDateTime();
-	auto lastTime = date;
+// Current time and date texts are reused by all rows for that long.
+constexpr auto kRowDateNowTimeout = TimeMs(1000);
+constexpr auto kRowDateTextsLimit = 1024;
+
+struct RowDateText {
+	QString text;
+	int width = 0;
+};
+
+const RowDateText &rowDateText(const QDateTime &date) {
+	static auto now = QDateTime();
+	static auto nowUpdated = TimeMs(0);
+	static auto texts = QHash<QDateTime, RowDateText>();
+
+	auto ms = getms(true);
+	if (now.isNull() || ms >= nowUpdated + kRowDateNowTimeout || ms < nowUpdated) {
+		auto updated = QDateTime::currentDateTime();
+		if (updated.date() != now.date()
+			|| updated.time().minute() != now.time().minute()
+			|| texts.size() > kRowDateTextsLimit) {
+			texts.clear();
+		}
+		now = updated;
+		nowUpdated = ms;
+	}
+	auto i = texts.constFind(date);
+	if (i != texts.cend()) {
+		return i.value();
+	}
+
 	auto nowDate = now.date();
-	auto lastDate = lastTime.date();
+	auto lastDate = date.date();
 
 	QString dt;
 	bool wasSameDay = (lastDate == nowDate);
-	bool wasRecently = qAbs(lastTime.secsTo(now)) < kRecentlyInSeconds;
+	bool wasRecently = qAbs(date.secsTo(now)) < kRecentlyInSeconds;
 	if (wasSameDay || wasRecently) {
-		dt = lastTime.toString(cTimeFormat());
+		dt = date.toString(cTimeFormat());
 	} else if (lastDate.year() == nowDate.year() && lastDate.weekNumber() == nowDate.weekNumber()) {
 		dt = langDayOfWeek(lastDate);
 	} else {
 		dt = lastDate.toString(qsl("d.MM.yy"));
 	}
-	int32 dtWidth = st::dialogsDateFont->width(dt);
-	rectForName.setWidth(rectForName.width() - dtWidth - st::dialogsDateSkip);
+	auto result = RowDateText();
+	result.width = st::dialogsDateFont->width(dt);
+	result.text = std::move(dt);
+	return texts.insert(date, result).value();
+}
+
+void paintRowDate(Painter &p, const QDateTime &date, QRect &rectForName, bool active, bool selected) {
+	auto &dt = rowDateText(date);
+	rectForName.setWidth(rectForName.width() - dt.width - st::dialogsDateSkip);
 	p.setFont(st::dialogsDateFont);
 	p.setPen(active ? st::dialogsDateFgActive : (selected ? st::dialogsDateFgOver : st::dialogsDateFg));
-	p.drawText(rectForName.left() + rectForName.width() + st::dialogsDateSkip, rectForName.top() + st::msgNameFont->height - st::msgDateFont->descent, dt);
+	p.drawText(rectForName.left() + rectForName.width() + st::dialogsDateSkip, rectForName.top() + st::msgNameFont->height - st::msgDateFont->descent, dt.text);
 }
 
 template <typename PaintItemCallback, typename PaintCounterCallback>
@@ -65,7 +100,7 @@ void paintRow(Painter &p, const RippleRow *row, History *history, HistoryItem *i
 	if (onlyBackground) return;
 
 	auto userpicPeer = (history->peer->migrateTo() ? history->peer->migrateTo() : history->peer);
-	userpicPeer->paintUserpicLeft(p, st::dialogsPadding.x(), st::dialogsPadding.y(), fullWidth, st::dialogsPhotoSize);
+	Ui::UserpicAtlas::ForSize(st::dialogsPhotoSize).paint(p, userpicPeer, st::dialogsPadding.x(), st::dialogsPadding.y(), fullWidth);
 
 	auto nameleft = st::dialogsPadding.x() + st::dialogsPhotoSize + st::dialogsPhotoPadding;
 	if (fullWidth <= nameleft) {
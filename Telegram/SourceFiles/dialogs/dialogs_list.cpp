@@ -30,19 +30,15 @@ List::List(SortMode sortMode)
 : _last(std::make_unique<Row>(nullptr, nullptr, nullptr, 0))
 , _begin(_last.get())
 , _end(_last.get())
-, _sortMode(sortMode)
-, _current(_last.get()) {
+, _sortMode(sortMode) {
 }
 
-void List::adjustCurrent(int32 y, int32 h) const {
-	if (isEmpty()) return;
-
-	int32 pos = (y > 0) ? (y / h) : 0;
-	while (_current->_pos > pos && _current != _begin) {
-		_current = _current->_prev;
-	}
-	while (_current->_pos + 1 <= pos && _current->_next != _end) {
-		_current = _current->_next;
+void List::movedInRows(int from, int to) {
+	auto begin = _rows.begin();
+	if (to < from) {
+		std::rotate(begin + to, begin + from, begin + from + 1);
+	} else if (to > from) {
+		std::rotate(begin + from, begin + from + 1, begin + to + 1);
 	}
 }
 
@@ -50,11 +46,12 @@ Row *List::addToEnd(History *history) {
 	Row *result = new Row(history, _end->_prev, _end, _end->_pos);
 	_end->_pos++;
 	if (_begin == _end) {
-		_begin = _current = result;
+		_begin = result;
 	} else {
 		_end->_prev->_next = result;
 	}
 	_rowByPeer.insert(history->peer->id, result);
+	_rows.push_back(result);
 	++_count;
 	_end->_prev = result;
 	if (_sortMode == SortMode::Date) {
@@ -66,10 +63,7 @@ Row *List::addToEnd(History *history) {
 bool List::insertBefore(Row *row, Row *before) {
 	if (row == before) return false;
 
-	if (_current == row) {
-		_current = row->_prev;
-	}
-
+	auto from = row->_pos;
 	Row *updateTill = row->_prev;
 	remove(row);
 
@@ -88,16 +82,14 @@ bool List::insertBefore(Row *row, Row *before) {
 		n->_next->_pos++;
 		row->_pos--;
 	}
+	movedInRows(from, row->_pos);
 	return true;
 }
 
 bool List::insertAfter(Row *row, Row *after) {
 	if (row == after) return false;
 
-	if (_current == row) {
-		_current = row->_next;
-	}
-
+	auto from = row->_pos;
 	Row *updateFrom = row->_next;
 	remove(row);
 
@@ -112,6 +104,7 @@ bool List::insertAfter(Row *row, Row *after) {
 		n->_pos--;
 		row->_pos++;
 	}
+	movedInRows(from, row->_pos);
 	return true;
 }
 
@@ -191,9 +184,7 @@ bool List::del(PeerId peerId, Row *replacedBy) {
 		emit App::main()->dialogRowReplaced(row, replacedBy);
 	}
 
-	if (row == _current) {
-		_current = row->_next;
-	}
+	_rows.erase(_rows.begin() + row->_pos);
 	for (auto change = row->_next; change != _end; change = change->_next) {
 		--change->_pos;
 	}
@@ -217,11 +208,11 @@ void List::remove(Row *row) {
 
 void List::clear() {
 	while (_begin != _end) {
-		_current = _begin;
+		auto row = _begin;
 		_begin = _begin->_next;
-		delete _current;
+		delete row;
 	}
-	_current = _begin;
+	_rows.clear();
 	_rowByPeer.clear();
 	_count = 0;
 }
@@ -99,19 +99,22 @@ public:
 	const_iterator find(Row *value) const { return cfind(value); }
 	iterator find(Row *value) { return value ? iterator(value) : end(); }
 	const_iterator cfind(int y, int h) const {
-		adjustCurrent(y, h);
-		return iterator(_current);
+		return const_iterator(rowAtPos((y > 0) ? (y / h) : 0));
 	}
 	const_iterator find(int y, int h) const { return cfind(y, h); }
 	iterator find(int y, int h) {
-		adjustCurrent(y, h);
-		return iterator(_current);
+		return iterator(rowAtPos((y > 0) ? (y / h) : 0));
 	}
 
 	~List();
 
 private:
-	void adjustCurrent(int y, int h) const;
+	// Returns the row at pos clamped to the list bounds, _end if empty.
+	Row *rowAtPos(int pos) const {
+		if (_rows.empty()) return _end;
+		return _rows[snap(pos, 0, int(_rows.size()) - 1)];
+	}
+	void movedInRows(int from, int to);
 	bool insertBefore(Row *row, Row *before);
 	bool insertAfter(Row *row, Row *after);
 	static Row *next(Row *row) {
@@ -130,7 +133,9 @@ private:
 	typedef QHash<PeerId, Row*> RowByPeer;
 	RowByPeer _rowByPeer;
 
-	mutable Row *_current; // cache
+	// Rows by their pos(), kept in sync with the linked list.
+	std::vector<Row*> _rows;
+
 };
 
 } // namespace Dialogs
@@ -31,11 +31,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/widgets/input_fields.h"
 #include "autoupdater.h"
 #include "auth_session.h"
+#include "data/data_search_index.h"
 #include "messenger.h"
 #include "ui/effects/widget_fade_wrap.h"
 #include "boxes/peer_list_box.h"
 #include "window/window_controller.h"
 #include "profile/profile_channel_controllers.h"
+#include "core/startup_timeline.h"
 
 namespace {
 
@@ -43,6 +45,39 @@ QString SwitchToChooseFromQuery() {
 	return qsl("from:");
 }
 
+// Leaves the messages that have all the query words as word prefixes,
+// so the results for a shorter query can be shown while it is typed.
+QVector<MTPMessage> FilterSearchResults(const MTPmessages_Messages &result, const QString &query) {
+	auto messages = [&]() -> const QVector<MTPMessage>* {
+		switch (result.type()) {
+		case mtpc_messages_messages: return &result.c_messages_messages().vmessages.v;
+		case mtpc_messages_messagesSlice: return &result.c_messages_messagesSlice().vmessages.v;
+		case mtpc_messages_channelMessages: return &result.c_messages_channelMessages().vmessages.v;
+		}
+		return nullptr;
+	}();
+	auto filtered = QVector<MTPMessage>();
+	if (!messages) {
+		return filtered;
+	}
+	auto words = TextUtilities::PrepareSearchWords(query);
+	for_const (auto &message, *messages) {
+		if (message.type() != mtpc_message) {
+			continue;
+		}
+		auto messageWords = TextUtilities::PrepareSearchWords(qs(message.c_message().vmessage));
+		auto matches = std::all_of(words.cbegin(), words.cend(), [&](const QString &word) {
+			return std::any_of(messageWords.cbegin(), messageWords.cend(), [&](const QString &messageWord) {
+				return messageWord.startsWith(word);
+			});
+		});
+		if (matches) {
+			filtered.push_back(message);
+		}
+	}
+	return filtered;
+}
+
 } // namespace
 
 class DialogsWidget::UpdateButton : public Ui::RippleButton {
@@ -100,6 +135,7 @@ DialogsWidget::DialogsWidget(QWidget *parent, not_null<Window::Controller*> cont
 , _lockUnlock(this, st::dialogsLock)
 , _scroll(this, st::dialogsScroll) {
 	_inner = _scroll->setOwnedWidget(object_ptr<DialogsInner>(this, controller, parent));
+	_scroll->setPaintAheadEnabled(true);
 	connect(_inner, SIGNAL(draggingScrollDelta(int)), this, SLOT(onDraggingScrollDelta(int)));
 	connect(_inner, SIGNAL(mustScrollTo(int,int)), _scroll, SLOT(scrollToY(int,int)));
 	connect(_inner, SIGNAL(dialogMoved(int,int)), this, SLOT(onDialogMoved(int,int)));
@@ -318,6 +354,7 @@ void DialogsWidget::unreadCountsReceived(const QVector<MTPDialog> &dialogs) {
 void DialogsWidget::dialogsReceived(const MTPmessages_Dialogs &dialogs, mtpRequestId requestId) {
 	if (_dialogsRequestId != requestId) return;
 
+	auto firstSlice = !_dialogsOffsetDate;
 	const QVector<MTPDialog> *dialogsList = 0;
 	const QVector<MTPMessage> *messagesList = 0;
 	switch (dialogs.type()) {
@@ -387,6 +424,11 @@ void DialogsWidget::dialogsReceived(const MTPmessages_Dialogs &dialogs, mtpReque
 
 		unreadCountsReceived(*dialogsList);
 		_inner->dialogsReceived(*dialogsList);
+		if (firstSlice) {
+			_inner->writeDialogsSnapshot();
+			StartupTimeline::Mark("First dialogs slice");
+			StartupTimeline::Finish();
+		}
 		onListScroll();
 	} else {
 		_dialogsFull = true;
@@ -480,6 +522,7 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 			_searchQueryFrom = _searchFromUser;
 			_searchFull = _searchFullMigrated = false;
 			MTP::cancel(base::take(_searchRequest));
+			clearSearchPrefetch();
 			searchReceived(_searchInPeer ? DialogsSearchPeerFromStart : DialogsSearchFromStart, i.value(), 0);
 			return true;
 		}
@@ -488,6 +531,7 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 		_searchQueryFrom = _searchFromUser;
 		_searchFull = _searchFullMigrated = false;
 		MTP::cancel(base::take(_searchRequest));
+		clearSearchPrefetch();
 		if (_searchInPeer) {
 			auto flags = _searchQueryFrom ? MTP_flags(MTPmessages_Search::Flag::f_from_id) : MTP_flags(0);
 			_searchRequest = MTP::send(MTPmessages_Search(flags, _searchInPeer->input, MTP_string(_searchQuery), _searchQueryFrom ? _searchQueryFrom->inputUser : MTP_inputUserEmpty(), MTP_inputMessagesFilterEmpty(), MTP_int(0), MTP_int(0), MTP_int(0), MTP_int(0), MTP_int(SearchPerPage), MTP_int(0), MTP_int(0)), rpcDone(&DialogsWidget::searchReceived, DialogsSearchPeerFromStart), rpcFail(&DialogsWidget::searchFailed, DialogsSearchPeerFromStart));
@@ -517,10 +561,63 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 
 void DialogsWidget::onNeedSearchMessages() {
 	if (!onSearchMessages(true)) {
+		cancelStaleSearch();
+		if (!showPrefixSearchResults()) {
+			showLocalSearchResults();
+		}
 		_searchTimer.start(AutoSearchTimeout);
 	}
 }
 
+void DialogsWidget::cancelStaleSearch() {
+	auto query = _filter->getLastText().trimmed();
+	if (query == _searchQuery && _searchQueryFrom == _searchFromUser) {
+		return;
+	}
+	clearSearchPrefetch();
+
+	// A first page request for a prefix of the query is left running,
+	// its results are cached and shown filtered by the whole query.
+	auto prefix = _searchQueries.constFind(_searchRequest);
+	auto keep = (prefix != _searchQueries.cend())
+		&& query.startsWith(prefix.value())
+		&& (_searchQueryFrom == _searchFromUser);
+	if (_searchRequest && !keep) {
+		_searchQueries.remove(_searchRequest);
+		MTP::cancel(base::take(_searchRequest));
+	}
+}
+
+bool DialogsWidget::showPrefixSearchResults() {
+	auto query = _filter->getLastText().trimmed();
+	for (auto length = query.size() - 1; length > 0; --length) {
+		auto i = _searchCache.constFind(query.mid(0, length));
+		if (i == _searchCache.cend()) {
+			continue;
+		}
+		auto filtered = FilterSearchResults(i.value(), query);
+		if (filtered.isEmpty()) {
+			return false;
+		}
+
+		// Server results replace these when the search request is done.
+		_inner->searchReceived(filtered, _searchInPeer ? DialogsSearchPeerFromStart : DialogsSearchFromStart, filtered.size());
+		update();
+		return true;
+	}
+	return false;
+}
+
+void DialogsWidget::showLocalSearchResults() {
+	auto query = _filter->getLastText().trimmed();
+	if (query.isEmpty()) {
+		return;
+	}
+
+	// Server results replace these when the search request is done.
+	_inner->localSearchReceived(Auth().searchIndex().search(query, _searchInPeer, _searchFromUser, SearchPerPage));
+}
+
 void DialogsWidget::onChooseByDrag() {
 	_inner->choosePeer();
 }
@@ -548,17 +645,16 @@ void DialogsWidget::searchMessages(const QString &query, PeerData *inPeer) {
 void DialogsWidget::onSearchMore() {
 	if (!_searchRequest) {
 		if (!_searchFull) {
-			auto offsetDate = _inner->lastSearchDate();
-			auto offsetPeer = _inner->lastSearchPeer();
-			auto offsetId = _inner->lastSearchId();
-			if (_searchInPeer) {
-				auto flags = _searchQueryFrom ? MTP_flags(MTPmessages_Search::Flag::f_from_id) : MTP_flags(0);
-				_searchRequest = MTP::send(MTPmessages_Search(flags, _searchInPeer->input, MTP_string(_searchQuery), _searchQueryFrom ? _searchQueryFrom->inputUser : MTP_inputUserEmpty(), MTP_inputMessagesFilterEmpty(), MTP_int(0), MTP_int(0), MTP_int(offsetId), MTP_int(0), MTP_int(SearchPerPage), MTP_int(0), MTP_int(0)), rpcDone(&DialogsWidget::searchReceived, offsetId ? DialogsSearchPeerFromOffset : DialogsSearchPeerFromStart), rpcFail(&DialogsWidget::searchFailed, offsetId ? DialogsSearchPeerFromOffset : DialogsSearchPeerFromStart));
-			} else {
-				_searchRequest = MTP::send(MTPmessages_SearchGlobal(MTP_string(_searchQuery), MTP_int(offsetDate), offsetPeer ? offsetPeer->input : MTP_inputPeerEmpty(), MTP_int(offsetId), MTP_int(SearchPerPage)), rpcDone(&DialogsWidget::searchReceived, offsetId ? DialogsSearchFromOffset : DialogsSearchFromStart), rpcFail(&DialogsWidget::searchFailed, offsetId ? DialogsSearchFromOffset : DialogsSearchFromStart));
+			if (_searchQuery != _filter->getLastText().trimmed()) {
+				return; // Filtered results of a prefix are shown, wait for the query results.
 			}
-			if (!offsetId) {
-				_searchQueries.insert(_searchRequest, _searchQuery);
+			if (_searchPrefetchRequest) {
+				_searchRequest = base::take(_searchPrefetchRequest);
+			} else if (_searchPrefetched) {
+				auto prefetched = base::take(_searchPrefetched);
+				searchReceived(_searchPrefetchedType, *prefetched, 0);
+			} else {
+				_searchRequest = sendSearchMore();
 			}
 		} else if (_searchInMigrated && !_searchFullMigrated) {
 			auto offsetMigratedId = _inner->lastSearchMigratedId();
@@ -568,6 +664,35 @@ void DialogsWidget::onSearchMore() {
 	}
 }
 
+mtpRequestId DialogsWidget::sendSearchMore() {
+	auto offsetDate = _inner->lastSearchDate();
+	auto offsetPeer = _inner->lastSearchPeer();
+	auto offsetId = _inner->lastSearchId();
+	auto result = mtpRequestId(0);
+	if (_searchInPeer) {
+		auto flags = _searchQueryFrom ? MTP_flags(MTPmessages_Search::Flag::f_from_id) : MTP_flags(0);
+		result = MTP::send(MTPmessages_Search(flags, _searchInPeer->input, MTP_string(_searchQuery), _searchQueryFrom ? _searchQueryFrom->inputUser : MTP_inputUserEmpty(), MTP_inputMessagesFilterEmpty(), MTP_int(0), MTP_int(0), MTP_int(offsetId), MTP_int(0), MTP_int(SearchPerPage), MTP_int(0), MTP_int(0)), rpcDone(&DialogsWidget::searchReceived, offsetId ? DialogsSearchPeerFromOffset : DialogsSearchPeerFromStart), rpcFail(&DialogsWidget::searchFailed, offsetId ? DialogsSearchPeerFromOffset : DialogsSearchPeerFromStart));
+	} else {
+		result = MTP::send(MTPmessages_SearchGlobal(MTP_string(_searchQuery), MTP_int(offsetDate), offsetPeer ? offsetPeer->input : MTP_inputPeerEmpty(), MTP_int(offsetId), MTP_int(SearchPerPage)), rpcDone(&DialogsWidget::searchReceived, offsetId ? DialogsSearchFromOffset : DialogsSearchFromStart), rpcFail(&DialogsWidget::searchFailed, offsetId ? DialogsSearchFromOffset : DialogsSearchFromStart));
+	}
+	if (!offsetId) {
+		_searchQueries.insert(result, _searchQuery);
+	}
+	return result;
+}
+
+void DialogsWidget::prefetchSearchMore() {
+	if (_searchRequest || _searchPrefetchRequest || _searchPrefetched || _searchFull || !_inner->lastSearchId()) {
+		return;
+	}
+	_searchPrefetchRequest = sendSearchMore();
+}
+
+void DialogsWidget::clearSearchPrefetch() {
+	MTP::cancel(base::take(_searchPrefetchRequest));
+	_searchPrefetched = base::none;
+}
+
 void DialogsWidget::loadDialogs() {
 	if (_dialogsRequestId) return;
 	if (_dialogsFull) {
@@ -584,6 +709,14 @@ void DialogsWidget::loadDialogs() {
 	}
 }
 
+void DialogsWidget::showDialogsSnapshot() {
+	_inner->showDialogsSnapshot();
+}
+
+void DialogsWidget::writeDialogsSnapshot() {
+	_inner->writeDialogsSnapshot();
+}
+
 void DialogsWidget::loadPinnedDialogs() {
 	if (_pinnedDialogsRequestId) return;
 
@@ -608,6 +741,12 @@ bool DialogsWidget::contactsFailed(const RPCError &error) {
 }
 
 void DialogsWidget::searchReceived(DialogsSearchRequestType type, const MTPmessages_Messages &result, mtpRequestId req) {
+	if (req && req == _searchPrefetchRequest) {
+		_searchPrefetchRequest = 0;
+		_searchPrefetched = result;
+		_searchPrefetchedType = type;
+		return;
+	}
 	if (_inner->state() == DialogsInner::FilteredState || _inner->state() == DialogsInner::SearchedState) {
 		if (type == DialogsSearchFromStart || type == DialogsSearchPeerFromStart) {
 			auto i = _searchQueries.find(req);
@@ -618,6 +757,13 @@ void DialogsWidget::searchReceived(DialogsSearchRequestType type, const MTPmessa
 		}
 	}
 
+	auto fromStart = (type == DialogsSearchFromStart || type == DialogsSearchPeerFromStart);
+	if (req && _searchRequest == req && fromStart && _searchQuery != _filter->getLastText().trimmed()) {
+		// The query has grown while this prefix was being searched.
+		_searchRequest = 0;
+		showPrefixSearchResults();
+		return;
+	}
 	if (_searchRequest == req) {
 		switch (result.type()) {
 		case mtpc_messages_messages: {
@@ -669,6 +815,9 @@ void DialogsWidget::searchReceived(DialogsSearchRequestType type, const MTPmessa
 		}
 
 		_searchRequest = 0;
+		if (type != DialogsSearchMigratedFromStart && type != DialogsSearchMigratedFromOffset) {
+			prefetchSearchMore();
+		}
 		onListScroll();
 		update();
 	}
@@ -702,6 +851,11 @@ void DialogsWidget::peerSearchReceived(const MTPcontacts_Found &result, mtpReque
 bool DialogsWidget::searchFailed(DialogsSearchRequestType type, const RPCError &error, mtpRequestId req) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
+	if (_searchPrefetchRequest == req) {
+		_searchPrefetchRequest = 0;
+		return true;
+	}
+
 	if (_searchRequest == req) {
 		_searchRequest = 0;
 		if (type == DialogsSearchMigratedFromStart || type == DialogsSearchMigratedFromOffset) {
@@ -866,6 +1020,7 @@ void DialogsWidget::clearSearchCache() {
 	_searchQuery = QString();
 	_searchQueryFrom = nullptr;
 	MTP::cancel(base::take(_searchRequest));
+	clearSearchPrefetch();
 }
 
 void DialogsWidget::showSearchFrom() {
@@ -1139,6 +1294,7 @@ bool DialogsWidget::onCancelSearch() {
 		MTP::cancel(_searchRequest);
 		_searchRequest = 0;
 	}
+	clearSearchPrefetch();
 	if (_searchInPeer && !clearing) {
 		if (Adaptive::OneColumn()) {
 			Ui::showPeerHistory(_searchInPeer, ShowAtUnreadMsgId);
@@ -1158,6 +1314,7 @@ void DialogsWidget::onCancelSearchInPeer() {
 		MTP::cancel(_searchRequest);
 		_searchRequest = 0;
 	}
+	clearSearchPrefetch();
 	if (_searchInPeer) {
 		if (Adaptive::OneColumn() && !App::main()->selectingPeer()) {
 			Ui::showPeerHistory(_searchInPeer, ShowAtUnreadMsgId);
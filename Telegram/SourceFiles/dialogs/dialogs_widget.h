@@ -67,6 +67,8 @@ public:
 
 	void loadDialogs();
 	void loadPinnedDialogs();
+	void showDialogsSnapshot();
+	void writeDialogsSnapshot();
 	void createDialog(History *history);
 	void dlgUpdated(Dialogs::Mode list, Dialogs::Row *row);
 	void dlgUpdated(PeerData *peer, MsgId msgId);
@@ -156,6 +158,12 @@ private:
 	void clearSearchCache();
 	void updateLockUnlockVisibility();
 	void updateJumpToDateVisibility(bool fast = false);
+	void showLocalSearchResults();
+	bool showPrefixSearchResults();
+	void cancelStaleSearch();
+	mtpRequestId sendSearchMore();
+	void prefetchSearchMore();
+	void clearSearchPrefetch();
 	void updateSearchFromVisibility(bool fast = false);
 	void updateControlsGeometry();
 	void updateForwardBar();
@@ -212,6 +220,12 @@ private:
 	bool _searchFullMigrated = false;
 	mtpRequestId _searchRequest = 0;
 
+	// The next page of the search results, requested while the
+	// current one is shown and used by the next onSearchMore().
+	mtpRequestId _searchPrefetchRequest = 0;
+	base::optional<MTPmessages_Messages> _searchPrefetched;
+	DialogsSearchRequestType _searchPrefetchedType = DialogsSearchFromOffset;
+
 	using SearchCache = QMap<QString, MTPmessages_Messages>;
 	SearchCache _searchCache;
 
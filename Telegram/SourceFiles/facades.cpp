@@ -538,6 +538,9 @@ struct Data {
 
 	bool ScreenIsLocked = false;
 
+	bool BackgroundMode = false;
+	base::Observable<void> BackgroundModeChanged;
+
 	int32 DebugLoggingFlags = 0;
 
 	float64 RememberedSongVolume = kDefaultVolume;
@@ -611,6 +614,7 @@ struct Data {
 	DBIConnectionType LastProxyType = dbictAuto;
 	bool TryIPv6 = (cPlatform() == dbipWindows) ? false : true;
 	ProxyData ConnectionProxy;
+	QByteArray SpecialConfig;
 	base::Observable<void> ConnectionTypeChanged;
 
 	int AutoLock = 3600;
@@ -661,6 +665,9 @@ DefineVar(Global, bool, ModerateModeEnabled);
 
 DefineVar(Global, bool, ScreenIsLocked);
 
+DefineVar(Global, bool, BackgroundMode);
+DefineRefVar(Global, base::Observable<void>, BackgroundModeChanged);
+
 DefineVar(Global, int32, DebugLoggingFlags);
 
 DefineVar(Global, float64, RememberedSongVolume);
@@ -734,6 +741,7 @@ DefineVar(Global, DBIConnectionType, ConnectionType);
 DefineVar(Global, DBIConnectionType, LastProxyType);
 DefineVar(Global, bool, TryIPv6);
 DefineVar(Global, ProxyData, ConnectionProxy);
+DefineVar(Global, QByteArray, SpecialConfig);
 DefineRefVar(Global, base::Observable<void>, ConnectionTypeChanged);
 
 DefineVar(Global, int, AutoLock);
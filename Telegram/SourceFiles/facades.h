@@ -300,6 +300,10 @@ DeclareVar(bool, ModerateModeEnabled);
 
 DeclareVar(bool, ScreenIsLocked);
 
+// The main window is minimized, hidden to tray or fully occluded.
+DeclareVar(bool, BackgroundMode);
+DeclareRefVar(base::Observable<void>, BackgroundModeChanged);
+
 DeclareVar(int32, DebugLoggingFlags);
 
 constexpr float64 kDefaultVolume = 0.9;
@@ -378,6 +382,7 @@ DeclareVar(DBIConnectionType, ConnectionType);
 DeclareVar(DBIConnectionType, LastProxyType);
 DeclareVar(bool, TryIPv6);
 DeclareVar(ProxyData, ConnectionProxy);
+DeclareVar(QByteArray, SpecialConfig); // last good simple config if it was needed
 DeclareRefVar(base::Observable<void>, ConnectionTypeChanged);
 
 DeclareVar(int, AutoLock);
@@ -36,9 +36,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "auth_session.h"
 #include "window/notifications_manager.h"
 #include "calls/calls_instance.h"
+#include "media/player/media_player_instance.h"
 
 namespace {
 
+constexpr auto kKeepRecentHistoriesLoaded = 4; // switching between recent chats doesn't reload and relayout them
 constexpr auto kStatusShowClientsideTyping = 6000;
 constexpr auto kStatusShowClientsideRecordVideo = 6000;
 constexpr auto kStatusShowClientsideUploadVideo = 6000;
@@ -83,6 +85,7 @@ History::History(const PeerId &peerId)
 	for (auto &countData : _overviewCountData) {
 		countData = -1; // not loaded yet
 	}
+	_memory.setBytes(sizeof(History));
 }
 
 void History::clearLastKeyboard() {
@@ -234,26 +237,43 @@ bool History::updateSendActionNeedsAnimating(UserData *user, const MTPSendMessag
 	}
 
 	auto ms = getms();
+	auto changed = false;
+	auto insertTyping = [&] {
+		changed = changed || !_typing.contains(user);
+		_typing.insert(user, ms + kStatusShowClientsideTyping);
+	};
+	auto insertAction = [&](Type type, TimeMs showFor, int progress) {
+		auto i = _sendActions.find(user);
+		changed = changed || (i == _sendActions.end()) || (i->type != type);
+		_sendActions.insert(user, { type, ms + showFor, progress });
+	};
 	switch (action.type()) {
-	case mtpc_sendMessageTypingAction: _typing.insert(user, ms + kStatusShowClientsideTyping); break;
-	case mtpc_sendMessageRecordVideoAction: _sendActions.insert(user, { Type::RecordVideo, ms + kStatusShowClientsideRecordVideo }); break;
-	case mtpc_sendMessageUploadVideoAction: _sendActions.insert(user, { Type::UploadVideo, ms + kStatusShowClientsideUploadVideo, action.c_sendMessageUploadVideoAction().vprogress.v }); break;
-	case mtpc_sendMessageRecordAudioAction: _sendActions.insert(user, { Type::RecordVoice, ms + kStatusShowClientsideRecordVoice }); break;
-	case mtpc_sendMessageUploadAudioAction: _sendActions.insert(user, { Type::UploadVoice, ms + kStatusShowClientsideUploadVoice, action.c_sendMessageUploadAudioAction().vprogress.v }); break;
-	case mtpc_sendMessageRecordRoundAction: _sendActions.insert(user, { Type::RecordRound, ms + kStatusShowClientsideRecordRound }); break;
-	case mtpc_sendMessageUploadRoundAction: _sendActions.insert(user, { Type::UploadRound, ms + kStatusShowClientsideUploadRound }); break;
-	case mtpc_sendMessageUploadPhotoAction: _sendActions.insert(user, { Type::UploadPhoto, ms + kStatusShowClientsideUploadPhoto, action.c_sendMessageUploadPhotoAction().vprogress.v }); break;
-	case mtpc_sendMessageUploadDocumentAction: _sendActions.insert(user, { Type::UploadFile, ms + kStatusShowClientsideUploadFile, action.c_sendMessageUploadDocumentAction().vprogress.v }); break;
-	case mtpc_sendMessageGeoLocationAction: _sendActions.insert(user, { Type::ChooseLocation, ms + kStatusShowClientsideChooseLocation }); break;
-	case mtpc_sendMessageChooseContactAction: _sendActions.insert(user, { Type::ChooseContact, ms + kStatusShowClientsideChooseContact }); break;
+	case mtpc_sendMessageTypingAction: insertTyping(); break;
+	case mtpc_sendMessageRecordVideoAction: insertAction(Type::RecordVideo, kStatusShowClientsideRecordVideo, 0); break;
+	case mtpc_sendMessageUploadVideoAction: insertAction(Type::UploadVideo, kStatusShowClientsideUploadVideo, action.c_sendMessageUploadVideoAction().vprogress.v); break;
+	case mtpc_sendMessageRecordAudioAction: insertAction(Type::RecordVoice, kStatusShowClientsideRecordVoice, 0); break;
+	case mtpc_sendMessageUploadAudioAction: insertAction(Type::UploadVoice, kStatusShowClientsideUploadVoice, action.c_sendMessageUploadAudioAction().vprogress.v); break;
+	case mtpc_sendMessageRecordRoundAction: insertAction(Type::RecordRound, kStatusShowClientsideRecordRound, 0); break;
+	case mtpc_sendMessageUploadRoundAction: insertAction(Type::UploadRound, kStatusShowClientsideUploadRound, 0); break;
+	case mtpc_sendMessageUploadPhotoAction: insertAction(Type::UploadPhoto, kStatusShowClientsideUploadPhoto, action.c_sendMessageUploadPhotoAction().vprogress.v); break;
+	case mtpc_sendMessageUploadDocumentAction: insertAction(Type::UploadFile, kStatusShowClientsideUploadFile, action.c_sendMessageUploadDocumentAction().vprogress.v); break;
+	case mtpc_sendMessageGeoLocationAction: insertAction(Type::ChooseLocation, kStatusShowClientsideChooseLocation, 0); break;
+	case mtpc_sendMessageChooseContactAction: insertAction(Type::ChooseContact, kStatusShowClientsideChooseContact, 0); break;
 	case mtpc_sendMessageGamePlayAction: {
 		auto it = _sendActions.find(user);
 		if (it == _sendActions.end() || it->type == Type::PlayGame || it->until <= ms) {
-			_sendActions.insert(user, { Type::PlayGame, ms + kStatusShowClientsidePlayGame });
+			insertAction(Type::PlayGame, kStatusShowClientsidePlayGame, 0);
 		}
 	} break;
 	default: return false;
 	}
+
+	// In large groups the same users repeat their actions every few seconds,
+	// only a new user or a new action type changes the text. Everything else
+	// is picked up by the next Histories::step_typings() frame.
+	if (!changed) {
+		return !_typing.isEmpty() || !_sendActions.isEmpty();
+	}
 	return updateSendActionNeedsAnimating(ms, true);
 }
 
@@ -311,7 +331,9 @@ bool History::updateSendActionNeedsAnimating(TimeMs ms, bool force) {
 			++i;
 		}
 	}
+	auto textUpdated = false;
 	if (changed) {
+		auto wasAnimationWidth = _sendActionAnimation.width();
 		QString newTypingString;
 		auto typingCount = _typing.size();
 		if (typingCount > 2) {
@@ -368,15 +390,20 @@ bool History::updateSendActionNeedsAnimating(TimeMs ms, bool force) {
 		if (_sendActionString != newTypingString) {
 			_sendActionString = newTypingString;
 			_sendActionText.setText(st::dialogsTextStyle, _sendActionString, _textNameOptions);
+			textUpdated = true;
+		} else if (_sendActionAnimation.width() != wasAnimationWidth) {
+			textUpdated = true;
 		}
 	}
 	auto result = (!_typing.isEmpty() || !_sendActions.isEmpty());
-	if (changed || result) {
+
+	// Only the text changes are reported in background, frames are not painted anyway.
+	if (textUpdated || (result && !Global::BackgroundMode())) {
 		App::histories().sendActionAnimationUpdated().notify({
 			this,
 			_sendActionAnimation.width(),
 			st::normalFont->height,
-			changed
+			textUpdated
 		});
 	}
 	return result;
@@ -710,6 +737,49 @@ bool Histories::unreadOnlyMuted() const {
 	return Global::IncludeMuted() ? (_unreadMuted >= _unreadFull) : false;
 }
 
+void Histories::unreadIncrement(int count, bool muted) {
+	if (!count) {
+		return;
+	}
+	_unreadFull += count;
+	if (muted) {
+		_unreadMuted += count;
+	}
+	Notify::unreadCounterUpdated();
+}
+
+void Histories::unreadMuteChanged(int count, bool muted) {
+	if (!count) {
+		return;
+	}
+	if (muted) {
+		_unreadMuted += count;
+	} else {
+		_unreadMuted -= count;
+	}
+	Notify::unreadCounterUpdated();
+}
+
+#ifdef _DEBUG
+void Histories::checkUnreadCounters() {
+	auto full = 0;
+	auto muted = 0;
+	for_const (auto history, map) {
+		if (history->inChatList(Dialogs::Mode::All)) {
+			full += history->unreadCount();
+			if (history->mute()) {
+				muted += history->unreadCount();
+			}
+		}
+	}
+	if (full != _unreadFull || muted != _unreadMuted) {
+		LOG(("Unread Error: counters %1 (%2 muted) should be %3 (%4 muted).").arg(_unreadFull).arg(_unreadMuted).arg(full).arg(muted));
+		_unreadFull = full;
+		_unreadMuted = muted;
+	}
+}
+#endif // _DEBUG
+
 void Histories::setIsPinned(History *history, bool isPinned) {
 	if (isPinned) {
 		_pinnedDialogs.insert(history);
@@ -795,6 +865,58 @@ void Histories::checkSelfDestructItems() {
 	}
 }
 
+void Histories::historyViewed(not_null<History*> history) {
+	history->setLastViewed(getms(true));
+	checkLoadedItemsBudget();
+}
+
+void Histories::setLoadedItemsBudget(int budget) {
+	_loadedItemsBudget = budget;
+	checkLoadedItemsBudget();
+}
+
+void Histories::checkLoadedItemsBudget() {
+	unloadItemsOverBudget(_loadedItemsBudget, kKeepRecentHistoriesLoaded);
+}
+
+void Histories::unloadItemsOverBudget(int budget, int keepRecent) {
+	auto total = 0;
+	auto candidates = std::vector<not_null<History*>>();
+	for_const (auto history, map) {
+		if (auto count = history->loadedItemsCount()) {
+			total += count;
+			if (history->canUnloadItems()) {
+				candidates.push_back(history);
+			}
+		}
+	}
+	if (total <= budget) {
+		return;
+	}
+	std::sort(candidates.begin(), candidates.end(), [](not_null<History*> a, not_null<History*> b) {
+		return (a->lastViewed() < b->lastViewed());
+	});
+
+	// Recently viewed ones keep their laid out items while they still count
+	// in the budget, so returning to them doesn't request and lay them out again.
+	auto kept = 0;
+	for (auto i = candidates.size(); i != 0 && kept != keepRecent; --i) {
+		if (candidates[i - 1]->lastViewed() > 0) {
+			++kept;
+		}
+	}
+	candidates.resize(candidates.size() - kept);
+	for (auto history : candidates) {
+		total -= history->loadedItemsCount();
+		history->unloadItems();
+		total += history->loadedItemsCount();
+		if (total <= budget) {
+			break;
+		}
+	}
+	DEBUG_LOG(("Histories Info: loaded items count %1 after unloading, budget %2.").arg(total).arg(budget));
+}
+
 HistoryItem *History::createItem(const MTPMessage &msg, bool applyServiceAction, bool detachExistingItem) {
 	auto msgId = MsgId(0);
 	switch (msg.type()) {
@@ -1096,8 +1218,16 @@ HistoryItem *History::addNewService(MsgId msgId, QDateTime date, const QString &
 }
 
 HistoryItem *History::addNewMessage(const MTPMessage &msg, NewMessageType type) {
-	if (isChannel()) return asChannelHistory()->addNewChannelMessage(msg, type);
+	auto result = isChannel()
+		? asChannelHistory()->addNewChannelMessage(msg, type)
+		: addNewNonChannelMessage(msg, type);
+	if (result && type != NewMessageExisting && type != NewMessageLast) {
+		Local::writeHistoryMessages(this, QVector<MTPMessage>(1, msg));
+	}
+	return result;
+}
 
+HistoryItem *History::addNewNonChannelMessage(const MTPMessage &msg, NewMessageType type) {
 	if (type == NewMessageExisting) return addToHistory(msg);
 	if (!loadedAtBottom() || peer->migrateTo()) {
 		HistoryItem *item = addToHistory(msg);
@@ -1155,10 +1285,8 @@ bool History::addToOverview(MediaOverviewType type, MsgId msgId, AddToOverviewMe
 }
 
 void History::eraseFromOverview(MediaOverviewType type, MsgId msgId) {
-	auto i = _overview[type].find(msgId);
-	if (i == _overview[type].cend()) return;
+	if (!_overview[type].remove(msgId)) return;
 
-	_overview[type].erase(i);
 	if (_overviewCountData[type] > 0) {
 		--_overviewCountData[type];
 	}
@@ -1531,6 +1659,8 @@ void History::addOlderSlice(const QVector<MTPMessage> &slice) {
 		asChannelHistory()->checkMaxReadMessageDate();
 	}
 	checkLastMsg();
+
+	Local::writeHistoryMessages(this, slice);
 }
 
 void History::addNewerSlice(const QVector<MTPMessage> &slice) {
@@ -1567,6 +1697,8 @@ void History::addNewerSlice(const QVector<MTPMessage> &slice) {
 
 	if (isChannel()) asChannelHistory()->checkJoinedMessage();
 	checkLastMsg();
+
+	Local::writeHistoryMessages(this, slice);
 }
 
 void History::checkLastMsg() {
@@ -1689,9 +1821,6 @@ void History::setUnreadCount(int newUnreadCount) {
 		}
 		if (inChatList(Dialogs::Mode::All)) {
 			App::histories().unreadIncrement(newUnreadCount - _unreadCount, mute());
-			if (!mute() || Global::IncludeMuted()) {
-				Notify::unreadCounterUpdated();
-			}
 		}
 		_unreadCount = newUnreadCount;
 		if (auto main = App::main()) {
@@ -1717,10 +1846,7 @@ void History::setUnreadCount(int newUnreadCount) {
 	if (_mute != newMute) {
 		_mute = newMute;
 		if (inChatList(Dialogs::Mode::All)) {
-			if (_unreadCount) {
-				App::histories().unreadMuteChanged(_unreadCount, newMute);
-				Notify::unreadCounterUpdated();
-			}
+			App::histories().unreadMuteChanged(_unreadCount, newMute);
 			Notify::historyMuteUpdated(this);
 		}
 		updateChatListEntry();
@@ -2074,18 +2200,78 @@ MsgId History::msgIdForRead() const {
 }
 
 int History::resizeGetHeight(int newWidth) {
-	bool resizeAllItems = (_flags & Flag::f_pending_resize) || (width != newWidth);
+	auto resizeAllItems = (_flags & Flag::f_pending_resize) || (width != newWidth);
 
-	if (!resizeAllItems && !hasPendingResizedItems()) {
+	if (!resizeAllItems && !hasPendingResizedItems() && !hasStaleItems()) {
 		return height;
 	}
 	_flags &= ~(Flag::f_pending_resize | Flag::f_has_pending_resized_items);
 
 	width = newWidth;
-	int y = 0;
+	return layoutBlocks(resizeAllItems, 0, ScrollMax);
+}
+
+int History::resizeGetHeight(int newWidth, int visibleTop, int visibleBottom) {
+	if (_flags & Flag::f_pending_resize) {
+		// Not only the width has changed, lay out everything.
+		return resizeGetHeight(newWidth);
+	}
+	auto resizeAllItems = (width != newWidth);
+
+	if (!resizeAllItems && !hasPendingResizedItems()) {
+		return height;
+	}
+	_flags &= ~Flag::f_has_pending_resized_items;
+
+	width = newWidth;
+	return layoutBlocks(resizeAllItems, visibleTop, visibleBottom);
+}
+
+int History::relayoutStaleItems(int visibleTop, int visibleBottom, int limit) {
+	if (!hasStaleItems()) {
+		return height;
+	}
+	auto relayout = [this, &limit](HistoryItem *item) {
+		if (item->width() != width) {
+			item->resizeGetHeight(width);
+			--limit;
+		}
+	};
 	for_const (auto block, blocks) {
+		auto blockTop = block->y();
+		if (blockTop >= visibleBottom || limit <= 0) {
+			break;
+		} else if (blockTop + block->height() < visibleTop) {
+			continue;
+		}
+		for_const (auto item, block->items) {
+			auto itemTop = blockTop + item->y();
+			if (itemTop >= visibleBottom || limit <= 0) {
+				break;
+			} else if (itemTop + item->height() >= visibleTop) {
+				relayout(item);
+			}
+		}
+	}
+	for (auto i = blocks.size(); i != 0 && limit > 0;) {
+		auto &items = blocks[--i]->items;
+		for (auto j = items.size(); j != 0 && limit > 0;) {
+			relayout(items[--j]);
+		}
+	}
+
+	// Only update the positions, without touching the other stale items.
+	return layoutBlocks(false, ScrollMax, ScrollMax);
+}
+
+int History::layoutBlocks(bool resizeAllItems, int visibleTop, int visibleBottom) {
+	_flags &= ~Flag::f_has_stale_items;
+
+	auto y = 0;
+	for_const (auto block, blocks) {
+		auto blockTop = block->y();
 		block->setY(y);
-		y += block->resizeGetHeight(newWidth, resizeAllItems);
+		y += block->resizeGetHeight(width, resizeAllItems, visibleTop - blockTop, visibleBottom - blockTop);
 	}
 	height = y;
 	return height;
@@ -2145,7 +2331,7 @@ void History::clear(bool leaveItems) {
 	}
 	if (!leaveItems) {
 		for (auto i = 0; i != OverviewCount; ++i) {
-			if (!_overview[i].isEmpty()) {
+			if (!_overview[i].empty()) {
 				_overviewCountData[i] = -1; // not loaded yet
 				_overview[i].clear();
 				if (!App::quitting()) {
@@ -2163,6 +2349,9 @@ void History::clear(bool leaveItems) {
 			peer->asChannel()->mgInfo->pinnedMsgId = 0;
 		}
 		clearLastKeyboard();
+		if (!App::quitting()) {
+			Local::clearHistoryMessages(peer->id);
+		}
 	}
 	setPendingResize();
 
@@ -2183,6 +2372,94 @@ void History::clear(bool leaveItems) {
 	}
 }
 
+int History::loadedItemsCount() const {
+	auto result = 0;
+	for_const (auto block, blocks) {
+		result += block->items.size();
+	}
+	return result;
+}
+
+bool History::canUnloadItems() const {
+	if (isEmpty() || !App::main()) {
+		return false;
+	}
+	auto isShown = [this](PeerData *shown) {
+		if (!shown) {
+			return false;
+		}
+		auto history = App::history(shown);
+		return (history == this)
+			|| (history->migrateFrom() == this)
+			|| (history->migrateToOrMe() == this);
+	};
+	if (isShown(App::main()->activePeer()) || isShown(App::main()->overviewPeer())) {
+		return false;
+	}
+	auto isPlaying = [this](AudioMsgId::Type type) {
+		auto item = App::histItemById(Media::Player::instance()->current(type).contextId());
+		return item && (item->history() == this);
+	};
+	if (isPlaying(AudioMsgId::Type::Voice) || isPlaying(AudioMsgId::Type::Song)) {
+		return false;
+	}
+	for_const (auto block, blocks) {
+		for_const (auto item, block->items) {
+			if (item->id <= 0) { // sending or uploading right now
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void History::unloadItems() {
+	Expects(canUnloadItems());
+
+	// Keep the items that are used while the history is not shown:
+	// the last message (with the message it replies to) for the chats
+	// list and the items waiting for the notifications.
+	auto keep = OrderedSet<HistoryItem*>();
+	if (lastMsg) {
+		keep.insert(lastMsg);
+		if (auto reply = lastMsg->Get<HistoryMessageReply>()) {
+			if (reply->replyToMsg) {
+				keep.insert(reply->replyToMsg);
+			}
+		}
+	}
+	for_const (auto item, notifies) {
+		keep.insert(item);
+	}
+
+	auto unloaded = std::vector<HistoryItem*>();
+	for_const (auto block, blocks) {
+		for_const (auto item, block->items) {
+			if (!keep.contains(item)) {
+				unloaded.push_back(item);
+			}
+		}
+	}
+	DEBUG_LOG(("Histories Info: unloading %1 items of %2.").arg(unloaded.size()).arg(peer->id));
+
+	// Overview lists hold ids of the unloaded items, request them again.
+	for (auto i = 0; i != OverviewCount; ++i) {
+		if (!_overview[i].empty()) {
+			_overviewCountData[i] = -1; // not loaded yet
+			_overview[i].clear();
+			Notify::mediaOverviewUpdated(peer, MediaOverviewType(i));
+		}
+	}
+
+	clear(true);
+
+	auto &pending = Global::RefPendingRepaintItems();
+	for (auto item : unloaded) {
+		pending.remove(item);
+		delete item;
+	}
+}
+
 void History::clearBlocks(bool leaveItems) {
 	Blocks lst;
 	std::swap(lst, blocks);
@@ -2192,6 +2469,9 @@ void History::clearBlocks(bool leaveItems) {
 		}
 		delete block;
 	}
+	if (!leaveItems && !lst.isEmpty()) {
+		TrimRuntimeComposerData();
+	}
 }
 
 void History::clearOnDestroy() {
@@ -2217,7 +2497,6 @@ Dialogs::Row *History::addToChatList(Dialogs::Mode list, Dialogs::IndexedList *i
 		chatListLinks(list) = indexed->addToEnd(this);
 		if (list == Dialogs::Mode::All && unreadCount()) {
 			App::histories().unreadIncrement(unreadCount(), mute());
-			Notify::unreadCounterUpdated();
 		}
 	}
 	return mainChatListLink(list);
@@ -2230,7 +2509,6 @@ void History::removeFromChatList(Dialogs::Mode list, Dialogs::IndexedList *index
 		chatListLinks(list).clear();
 		if (list == Dialogs::Mode::All && unreadCount()) {
 			App::histories().unreadIncrement(-unreadCount(), mute());
-			Notify::unreadCounterUpdated();
 		}
 	}
 }
@@ -2325,9 +2603,7 @@ void History::overviewSliceDone(int32 overviewIndex, const MTPmessages_Messages
 
 void History::changeMsgId(MsgId oldId, MsgId newId) {
 	for (auto i = 0; i != OverviewCount; ++i) {
-		auto j = _overview[i].find(oldId);
-		if (j != _overview[i].cend()) {
-			_overview[i].erase(j);
+		if (_overview[i].remove(oldId)) {
 			_overview[i].insert(newId);
 		}
 	}
@@ -2356,12 +2632,24 @@ History::~History() {
 	clearOnDestroy();
 }
 
-int HistoryBlock::resizeGetHeight(int newWidth, bool resizeAllItems) {
+int HistoryBlock::resizeGetHeight(int newWidth, bool resizeAllItems, int visibleTop, int visibleBottom) {
 	auto y = 0;
 	for_const (auto item, items) {
+		auto itemTop = item->y();
 		item->setY(y);
-		if (resizeAllItems || item->pendingResize()) {
+		if (item->pendingResize()) {
 			y += item->resizeGetHeight(newWidth);
+		} else if (resizeAllItems || item->width() != newWidth) {
+			auto visible = (itemTop < visibleBottom)
+				&& (itemTop + item->height() >= visibleTop);
+			if (visible) {
+				y += item->resizeGetHeight(newWidth);
+			} else {
+				y += item->resizeStaleGetHeight(newWidth);
+				if (item->width() != newWidth) {
+					_history->_flags |= History::Flag::f_has_stale_items;
+				}
+			}
 		} else {
 			y += item->height();
 		}
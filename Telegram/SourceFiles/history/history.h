@@ -27,6 +27,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "base/timer.h"
 #include "base/variant.h"
 #include "base/flat_set.h"
+#include "base/compact_set.h"
 #include "base/flags.h"
 
 void HistoryInit();
@@ -71,19 +72,14 @@ public:
 		return _unreadMuted;
 	}
 	bool unreadOnlyMuted() const;
-	void unreadIncrement(int32 count, bool muted) {
-		_unreadFull += count;
-		if (muted) {
-			_unreadMuted += count;
-		}
-	}
-	void unreadMuteChanged(int32 count, bool muted) {
-		if (muted) {
-			_unreadMuted += count;
-		} else {
-			_unreadMuted -= count;
-		}
-	}
+
+	// All the changes of the counters go through these methods, each change
+	// queues a single unread counter update for the tray, taskbar and top bar.
+	void unreadIncrement(int count, bool muted);
+	void unreadMuteChanged(int count, bool muted);
+#ifdef _DEBUG
+	void checkUnreadCounters();
+#endif // _DEBUG
 
 	void setIsPinned(History *history, bool isPinned);
 	void clearPinned();
@@ -102,8 +98,20 @@ public:
 	}
 	void selfDestructIn(not_null<HistoryItem*> item, TimeMs delay);
 
+	// Inactive histories unload their items when all the loaded items
+	// count exceeds this budget, least recently viewed are unloaded first.
+	static constexpr auto kDefaultLoadedItemsBudget = 20000;
+	void historyViewed(not_null<History*> history);
+	void setLoadedItemsBudget(int budget);
+
+	// Unloads inactive histories until the loaded items fit the given
+	// budget without changing the configured one, used on memory pressure.
+	// The keepRecent most recently viewed histories are not unloaded.
+	void unloadItemsOverBudget(int budget, int keepRecent = 0);
+
 private:
 	void checkSelfDestructItems();
+	void checkLoadedItemsBudget();
 
 	int _unreadFull = 0;
 	int _unreadMuted = 0;
@@ -113,6 +121,8 @@ private:
 	base::Timer _selfDestructTimer;
 	std::vector<FullMsgId> _selfDestructItems;
 
+	int _loadedItemsBudget = kDefaultLoadedItemsBudget;
+
 };
 
 class HistoryBlock;
@@ -221,6 +231,18 @@ public:
 
 	void clear(bool leaveItems = false);
 
+	// Destroys the loaded items that are not required while the history
+	// is not shown, they will be requested again when it is shown.
+	int loadedItemsCount() const;
+	bool canUnloadItems() const;
+	void unloadItems();
+	TimeMs lastViewed() const {
+		return _lastViewed;
+	}
+	void setLastViewed(TimeMs when) {
+		_lastViewed = when;
+	}
+
 	virtual ~History();
 
 	HistoryItem *addNewService(MsgId msgId, QDateTime date, const QString &text, MTPDmessage::Flags flags = 0, bool newMsg = true);
@@ -308,6 +330,18 @@ public:
 
 	int resizeGetHeight(int newWidth);
 
+	// After a width change lays out only the items intersecting the
+	// [visibleTop, visibleBottom) range of the current layout, all the other
+	// items keep an estimated height until relayoutStaleItems() is called.
+	int resizeGetHeight(int newWidth, int visibleTop, int visibleBottom);
+	bool hasStaleItems() const {
+		return _flags & Flag::f_has_stale_items;
+	}
+
+	// Lays out up to the limit of items that are left from the last width
+	// change, the items intersecting the visible range are processed first.
+	int relayoutStaleItems(int visibleTop, int visibleBottom, int limit);
+
 	void removeNotification(HistoryItem *item) {
 		if (!notifies.isEmpty()) {
 			for (auto i = notifies.begin(), e = notifies.end(); i != e; ++i) {
@@ -485,11 +519,11 @@ public:
 		}
 		return result;
 	}
-	const OrderedSet<MsgId> &overview(int32 overviewIndex) const {
+	const base::compact_set<MsgId> &overview(int32 overviewIndex) const {
 		return _overview[overviewIndex];
 	}
 	MsgId overviewMinId(int32 overviewIndex) const {
-		return _overview[overviewIndex].empty() ? 0 : *_overview[overviewIndex].begin();
+		return _overview[overviewIndex].empty() ? 0 : _overview[overviewIndex].front();
 	}
 	void overviewSliceDone(int32 overviewIndex, const MTPmessages_Messages &result, bool onlyCounts = false);
 	bool overviewHasMsgId(int32 overviewIndex, MsgId msgId) const {
@@ -502,6 +536,7 @@ public:
 
 protected:
 	void clearOnDestroy();
+	HistoryItem *addNewNonChannelMessage(const MTPMessage &msg, NewMessageType type);
 	HistoryItem *addNewToLastBlock(const MTPMessage &msg, NewMessageType type);
 
 	friend class HistoryBlock;
@@ -542,12 +577,15 @@ private:
 	// After adding a new history slice check the lastMsg and newLoaded.
 	void checkLastMsg();
 
+	int layoutBlocks(bool resizeAllItems, int visibleTop, int visibleBottom);
+
 	// Add all items to the media overview if we were not loaded at bottom and now are.
 	void checkAddAllToOverview();
 
 	enum class Flag {
 		f_has_pending_resized_items = (1 << 0),
 		f_pending_resize            = (1 << 1),
+		f_has_stale_items           = (1 << 2),
 	};
 	using Flags = base::flags<Flag>;
 	friend inline constexpr auto is_flag_type(Flag) { return true; };
@@ -573,7 +611,7 @@ private:
 	}
 	uint64 _sortKeyInChatList = 0; // like ((unixtime) << 32) | (incremented counter)
 
-	OrderedSet<MsgId> _overview[OverviewCount];
+	base::compact_set<MsgId> _overview[OverviewCount];
 	int32 _overviewCountData[OverviewCount]; // -1 - not loaded, 0 - all loaded, > 0 - count, but not all loaded
 
 	// A pointer to the block that is currently being built.
@@ -585,6 +623,8 @@ private:
 	};
 	std::unique_ptr<BuildingBlock> _buildingFrontBlock;
 
+	MemoryStats::Tracker<MemoryStats::Kind::Histories> _memory;
+
 	// Creates if necessary a new block for adding item.
 	// Depending on isBuildingFrontBlock() gets front or back block.
 	HistoryBlock *prepareBlockForAddingItem();
@@ -603,6 +643,7 @@ private:
 	QMap<SendAction::Type, TimeMs> _mySendActions;
 
 	int _pinnedIndex = 0; // > 0 for pinned dialogs
+	TimeMs _lastViewed = 0;
 
  };
 
@@ -657,7 +698,7 @@ public:
 	}
 	void removeItem(HistoryItem *item);
 
-	int resizeGetHeight(int newWidth, bool resizeAllItems);
+	int resizeGetHeight(int newWidth, bool resizeAllItems, int visibleTop, int visibleBottom);
 	int y() const {
 		return _y;
 	}
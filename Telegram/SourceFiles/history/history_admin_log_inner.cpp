@@ -47,6 +47,11 @@ constexpr auto kScrollDateHideTimeout = 1000;
 constexpr auto kEventsFirstPage = 20;
 constexpr auto kEventsPerPage = 50;
 
+// Items further than that from the viewport are destroyed and requested again
+// if the user scrolls back, the ones not further than the keep distance stay.
+constexpr auto kUnloadHeightsCount = 6 * PreloadHeightsCount;
+constexpr auto kKeepHeightsCount = 3 * PreloadHeightsCount;
+
 } // namespace
 
 template <InnerWidget::EnumItemsDirection direction, typename Method>
@@ -235,10 +240,14 @@ InnerWidget::InnerWidget(QWidget *parent, not_null<Window::Controller*> controll
 
 void InnerWidget::setVisibleTopBottom(int visibleTop, int visibleBottom) {
 	auto scrolledUp = (visibleTop < _visibleTop);
+	if (visibleTop != _visibleTop) {
+		_scrolledUp = scrolledUp;
+	}
 	_visibleTop = visibleTop;
 	_visibleBottom = visibleBottom;
 
 	updateVisibleTopItem();
+	unloadFarItems();
 	checkPreloadMore();
 	if (scrolledUp) {
 		_scrollDateCheck.call();
@@ -311,14 +320,120 @@ void InnerWidget::repaintScrollDateCallback() {
 }
 
 void InnerWidget::checkPreloadMore() {
-	if (_visibleTop + PreloadHeightsCount * (_visibleBottom - _visibleTop) > height()) {
+	// Look further ahead in the scroll direction, so that the next page
+	// usually arrives before the user reaches the last loaded item.
+	auto visibleHeight = _visibleBottom - _visibleTop;
+	auto downHeights = PreloadHeightsCount * (_scrolledUp ? 1 : 2);
+	auto upHeights = PreloadHeightsCount * (_scrolledUp ? 2 : 1);
+	if (_visibleTop + downHeights * visibleHeight > height()) {
 		preloadMore(Direction::Down);
 	}
-	if (_visibleTop < PreloadHeightsCount * (_visibleBottom - _visibleTop)) {
+	if (_visibleTop < upHeights * visibleHeight) {
 		preloadMore(Direction::Up);
 	}
 }
 
+void InnerWidget::unloadFarItems() {
+	auto visibleHeight = _visibleBottom - _visibleTop;
+	if (visibleHeight <= 0 || _items.empty()) {
+		return;
+	}
+	if (_visibleTop - _itemsTop > kUnloadHeightsCount * visibleHeight) {
+		unloadItems(Direction::Up, _visibleTop - kKeepHeightsCount * visibleHeight);
+	}
+	if (_itemsTop + _itemsHeight - _visibleBottom > kUnloadHeightsCount * visibleHeight) {
+		unloadItems(Direction::Down, _visibleBottom + kKeepHeightsCount * visibleHeight);
+	}
+}
+
+void InnerWidget::unloadItems(Direction direction, int edge) {
+	// One event can generate several items, the first generated one is in _itemsByIds
+	// and it is the top one of them. We cut only between whole events, so that they
+	// will be requested and generated again without duplicates.
+	auto heads = std::vector<HistoryItem*>();
+	heads.reserve(_itemsByIds.size());
+	for (auto &pair : _itemsByIds) {
+		heads.push_back(pair.second);
+	}
+	std::sort(heads.begin(), heads.end());
+	auto isHead = [&heads](HistoryItem *item) {
+		return std::binary_search(heads.begin(), heads.end(), item);
+	};
+
+	auto up = (direction == Direction::Up);
+	auto count = int(_items.size());
+	auto removeCount = 0;
+	if (up) {
+		// Items above are in the back of the _items vector.
+		for (; removeCount != count; ++removeCount) {
+			auto item = _items[count - removeCount - 1].get();
+			if (itemTop(item) + item->height() > edge && isHead(item)) {
+				break;
+			}
+		}
+	} else {
+		for (; removeCount != count; ++removeCount) {
+			auto item = _items[removeCount].get();
+			if (itemTop(item) < edge && (!removeCount || isHead(_items[removeCount - 1].get()))) {
+				break;
+			}
+		}
+	}
+	if (!removeCount) {
+		return;
+	}
+
+	auto removeFrom = up ? (_items.end() - removeCount) : _items.begin();
+	auto removeTill = up ? _items.end() : (_items.begin() + removeCount);
+	auto removed = std::vector<HistoryItem*>();
+	removed.reserve(removeCount);
+	for (auto i = removeFrom; i != removeTill; ++i) {
+		removed.push_back(i->get());
+	}
+	std::sort(removed.begin(), removed.end());
+	auto wasRemoved = [&removed](HistoryItem *item) {
+		return item && std::binary_search(removed.begin(), removed.end(), item);
+	};
+	for (auto i = _itemsByIds.begin(); i != _itemsByIds.end();) {
+		if (wasRemoved(i->second)) {
+			i = _itemsByIds.erase(i);
+		} else {
+			++i;
+		}
+	}
+	if (wasRemoved(_visibleTopItem)) {
+		_visibleTopItem = nullptr;
+		_visibleTopFromItem = 0;
+	}
+	if (wasRemoved(_scrollDateLastItem)) {
+		_scrollDateLastItem = nullptr;
+		_scrollDateLastItemTop = 0;
+	}
+	if (wasRemoved(_mouseActionItem)) {
+		_mouseActionItem = nullptr;
+		_mouseAction = MouseAction::None;
+	}
+	if (wasRemoved(_selectedItem)) {
+		_selectedItem = nullptr;
+		_selectedText = TextSelection();
+	}
+	_items.erase(removeFrom, removeTill);
+
+	// Request the removed events again when the user scrolls back to them.
+	request(base::take(up ? _preloadUpRequestId : _preloadDownRequestId)).cancel();
+	(up ? _upLoaded : _downLoaded) = false;
+	updateMinMaxIds();
+	if (!_items.empty()) {
+		if (up) {
+			_items.back()->setLogEntryDisplayDate(true);
+			_items.back()->setLogEntryAttachToPrevious(false);
+		} else {
+			_items.front()->setLogEntryAttachToNext(false);
+		}
+	}
+	updateSize();
+}
+
 void InnerWidget::applyFilter(FilterValue &&value) {
 	if (_filter != value) {
 		_filter = value;
@@ -135,6 +135,8 @@ private:
 
 	void requestAdmins();
 	void checkPreloadMore();
+	void unloadFarItems();
+	void unloadItems(Direction direction, int edge);
 	void updateVisibleTopItem();
 	void preloadMore(Direction direction);
 	void itemsAdded(Direction direction, int addedCount);
@@ -189,6 +191,7 @@ private:
 	int _minHeight = 0;
 	int _visibleTop = 0;
 	int _visibleBottom = 0;
+	bool _scrolledUp = false;
 	HistoryItem *_visibleTopItem = nullptr;
 	int _visibleTopFromItem = 0;
 
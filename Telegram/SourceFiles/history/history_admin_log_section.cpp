@@ -401,8 +401,7 @@ void Widget::paintEvent(QPaintEvent *e) {
 				}
 			}
 		} else {
-			PainterHighQualityEnabler hq(p);
-
+			// Fast scaling here, the smooth one is prepared by cachedBackground().
 			auto &pix = Window::Theme::Background()->pixmap();
 			QRect to, from;
 			Window::Theme::ComputeBackgroundRects(fill, pix.size(), to, from);
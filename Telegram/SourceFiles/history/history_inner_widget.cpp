@@ -22,10 +22,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "styles/style_history.h"
 #include "core/file_utilities.h"
+#include "core/trace.h"
 #include "history/history_message.h"
 #include "history/history_service_layout.h"
 #include "history/history_media_types.h"
 #include "ui/widgets/popup_menu.h"
+#include "ui/widgets/scroll_area.h"
+#include "ui/toast/toast.h"
 #include "window/window_controller.h"
 #include "chat_helpers/message_field.h"
 #include "chat_helpers/stickers.h"
@@ -36,10 +39,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "messenger.h"
 #include "apiwrap.h"
 #include "lang/lang_keys.h"
+#include "storage/file_download.h"
 
 namespace {
 
 constexpr auto kScrollDateHideTimeout = 1000;
+constexpr auto kCopySelectedItemsPerStep = size_t(500);
+constexpr auto kSelectedItemHeaderSize = 48; // Name, date and separator.
 
 class DateClickHandler : public ClickHandler {
 public:
@@ -156,21 +162,21 @@ void HistoryInner::repaintItem(const HistoryItem *item) {
 }
 
 template <bool TopToBottom, typename Method>
-void HistoryInner::enumerateItemsInHistory(History *history, int historytop, Method method) {
+void HistoryInner::enumerateItemsInHistory(History *history, int historytop, int areaTop, int areaBottom, Method method) {
 	// No displayed messages in this history.
 	if (historytop < 0 || history->isEmpty()) {
 		return;
 	}
-	if (_visibleAreaBottom <= historytop || historytop + history->height <= _visibleAreaTop) {
+	if (areaBottom <= historytop || historytop + history->height <= areaTop) {
 		return;
 	}
 
-	auto searchEdge = TopToBottom ? _visibleAreaTop : _visibleAreaBottom;
+	auto searchEdge = TopToBottom ? areaTop : areaBottom;
 
-	// Binary search for blockIndex of the first block that is not completely below the visible area.
+	// Binary search for blockIndex of the first block that is not completely below the area.
 	auto blockIndex = BinarySearchBlocksOrItems<TopToBottom>(history->blocks, searchEdge - historytop);
 
-	// Binary search for itemIndex of the first item that is not completely below the visible area.
+	// Binary search for itemIndex of the first item that is not completely below the area.
 	auto block = history->blocks.at(blockIndex);
 	auto blocktop = historytop + block->y();
 	auto blockbottom = blocktop + block->height();
@@ -182,24 +188,24 @@ void HistoryInner::enumerateItemsInHistory(History *history, int historytop, Met
 			auto itemtop = blocktop + item->y();
 			auto itembottom = itemtop + item->height();
 
-			// Binary search should've skipped all the items that are above / below the visible area.
+			// Binary search should've skipped all the items that are above / below the area.
 			if (TopToBottom) {
-				Assert(itembottom > _visibleAreaTop);
+				Assert(itembottom > areaTop);
 			} else {
-				Assert(itemtop < _visibleAreaBottom);
+				Assert(itemtop < areaBottom);
 			}
 
 			if (!method(item, itemtop, itembottom)) {
 				return;
 			}
 
-			// Skip all the items that are below / above the visible area.
+			// Skip all the items that are below / above the area.
 			if (TopToBottom) {
-				if (itembottom >= _visibleAreaBottom) {
+				if (itembottom >= areaBottom) {
 					return;
 				}
 			} else {
-				if (itemtop <= _visibleAreaTop) {
+				if (itemtop <= areaTop) {
 					return;
 				}
 			}
@@ -215,13 +221,13 @@ void HistoryInner::enumerateItemsInHistory(History *history, int historytop, Met
 			}
 		}
 
-		// Skip all the rest blocks that are below / above the visible area.
+		// Skip all the rest blocks that are below / above the area.
 		if (TopToBottom) {
-			if (blockbottom >= _visibleAreaBottom) {
+			if (blockbottom >= areaBottom) {
 				return;
 			}
 		} else {
-			if (blocktop <= _visibleAreaTop) {
+			if (blocktop <= areaTop) {
 				return;
 			}
 		}
@@ -356,6 +362,7 @@ void HistoryInner::paintEvent(QPaintEvent *e) {
 	if (Ui::skipPaintEvent(this, e)) {
 		return;
 	}
+	TRACE_SCOPE("HistoryInner::paintEvent");
 	if (hasPendingResizedItems()) {
 		return;
 	}
@@ -386,6 +393,9 @@ void HistoryInner::paintEvent(QPaintEvent *e) {
 	if (!noHistoryDisplayed) {
 		auto readMentions = HistoryItemsMap();
 
+		// Items rendered ahead of the scroll are not seen by the user yet.
+		auto seenByUser = !Ui::ScrollArea::PaintingAhead();
+
 		adjustCurrent(clip.top());
 
 		auto selEnd = _selected.cend();
@@ -427,10 +437,10 @@ void HistoryInner::paintEvent(QPaintEvent *e) {
 				}
 				item->draw(p, clip.translated(0, -y), sel, ms);
 
-				if (item->hasViews()) {
+				if (seenByUser && item->hasViews()) {
 					App::main()->scheduleViewIncrement(item);
 				}
-				if (item->mentionsMe() && item->isMediaUnread()) {
+				if (seenByUser && item->mentionsMe() && item->isMediaUnread()) {
 					readMentions.insert(item);
 					_widget->enqueueMessageHighlight(item);
 				}
@@ -478,10 +488,10 @@ void HistoryInner::paintEvent(QPaintEvent *e) {
 					}
 					item->draw(p, historyRect.translated(0, -y), sel, ms);
 
-					if (item->hasViews()) {
+					if (seenByUser && item->hasViews()) {
 						App::main()->scheduleViewIncrement(item);
 					}
-					if (item->mentionsMe() && item->isMediaUnread()) {
+					if (seenByUser && item->mentionsMe() && item->isMediaUnread()) {
 						readMentions.insert(item);
 						_widget->enqueueMessageHighlight(item);
 					}
@@ -1400,8 +1410,33 @@ void HistoryInner::onMenuDestroy(QObject *obj) {
 	}
 }
 
+struct HistoryInner::SelectedTextCopy {
+	std::vector<FullMsgId> items;
+	size_t done = 0;
+	TextWithEntities result;
+};
+
 void HistoryInner::copySelectedText() {
-	setToClipboard(getSelectedText());
+	if (_selectedTextCopy) {
+		return;
+	}
+	auto large = (size_t(_selected.size()) > kCopySelectedItemsPerStep)
+		&& (_selected.cbegin().value() == FullSelection)
+		&& (_mouseAction != MouseAction::Selecting);
+	if (!large) {
+		setToClipboard(getSelectedText());
+		return;
+	}
+
+	// Build the text of a huge selection in steps, so that the UI stays responsive.
+	auto items = selectedItemsInOrder(_selected);
+	_selectedTextCopy = std::make_unique<SelectedTextCopy>();
+	_selectedTextCopy->items.reserve(items.size());
+	for (auto item : items) {
+		_selectedTextCopy->items.push_back(item->fullId());
+	}
+	Ui::Toast::Show(lng_context_copy_selected_progress(lt_count, int(items.size())));
+	copySelectedTextStep();
 }
 
 void HistoryInner::copyContextUrl() {
@@ -1527,39 +1562,82 @@ TextWithEntities HistoryInner::getSelectedText() const {
 		return sel.cbegin().key()->selectedText(sel.cbegin().value());
 	}
 
-	int fullSize = 0;
-	QString timeFormat(qsl(", [dd.MM.yy hh:mm]\n"));
-	QMap<int, TextWithEntities> texts;
+	auto items = selectedItemsInOrder(sel);
+	auto texts = std::vector<TextWithEntities>();
+	texts.reserve(items.size());
+	auto fullSize = 0;
+	for (auto item : items) {
+		texts.push_back(item->selectedText(FullSelection));
+		fullSize += texts.back().text.size();
+	}
+
+	TextWithEntities result;
+	result.text.reserve(fullSize + int(items.size()) * kSelectedItemHeaderSize);
+	for (auto i = 0, count = int(items.size()); i != count; ++i) {
+		appendSelectedItemText(result, items[i], std::move(texts[i]));
+	}
+	return result;
+}
+
+std::vector<not_null<HistoryItem*>> HistoryInner::selectedItemsInOrder(const SelectedItems &sel) const {
+	auto positions = std::vector<std::pair<int, HistoryItem*>>();
+	positions.reserve(sel.size());
 	for (auto i = sel.cbegin(), e = sel.cend(); i != e; ++i) {
-		HistoryItem *item = i.key();
+		auto item = i.key();
 		if (item->detached()) continue;
 
-		QString time = item->date.toString(timeFormat);
-		TextWithEntities part, unwrapped = item->selectedText(FullSelection);
-		int size = item->author()->name.size() + time.size() + unwrapped.text.size();
-		part.text.reserve(size);
-
-		int y = itemTop(item);
+		auto y = itemTop(item);
 		if (y >= 0) {
-			part.text.append(item->author()->name).append(time);
-			TextUtilities::Append(part, std::move(unwrapped));
-			texts.insert(y, part);
-			fullSize += size;
+			positions.push_back({ y, item });
 		}
 	}
+	std::sort(positions.begin(), positions.end(), [](auto &a, auto &b) {
+		return (a.first < b.first);
+	});
 
-	TextWithEntities result;
-	auto sep = qsl("\n\n");
-	result.text.reserve(fullSize + (texts.size() - 1) * sep.size());
-	for (auto i = texts.begin(), e = texts.end(); i != e; ++i) {
-		TextUtilities::Append(result, std::move(i.value()));
-		if (i + 1 != e) {
-			result.text.append(sep);
-		}
+	auto result = std::vector<not_null<HistoryItem*>>();
+	result.reserve(positions.size());
+	for (auto &position : positions) {
+		result.push_back(position.second);
 	}
 	return result;
 }
 
+void HistoryInner::appendSelectedItemText(TextWithEntities &result, not_null<HistoryItem*> item, TextWithEntities &&text) const {
+	if (!result.text.isEmpty()) {
+		result.text.append(qstr("\n\n"));
+	}
+	result.text.append(item->author()->name).append(item->date.toString(qsl(", [dd.MM.yy hh:mm]\n")));
+	TextUtilities::Append(result, std::move(text));
+}
+
+void HistoryInner::copySelectedTextStep() {
+	Expects(_selectedTextCopy != nullptr);
+
+	auto &copy = *_selectedTextCopy;
+	auto till = std::min(copy.done + kCopySelectedItemsPerStep, copy.items.size());
+	for (; copy.done != till; ++copy.done) {
+		auto item = App::histItemById(copy.items[copy.done]);
+		if (item && !item->detached()) {
+			appendSelectedItemText(copy.result, item, item->selectedText(FullSelection));
+		}
+	}
+	if (copy.done < copy.items.size()) {
+		if (copy.done == kCopySelectedItemsPerStep) {
+			// Extrapolate the size of the whole text from the first step.
+			auto expected = qint64(copy.result.text.size()) * copy.items.size() / copy.done;
+			copy.result.text.reserve(int(qMin(expected, qint64(INT_MAX / 2))));
+		}
+		InvokeQueued(this, [this] { copySelectedTextStep(); });
+		return;
+	}
+
+	auto result = std::move(copy.result);
+	_selectedTextCopy = nullptr;
+	setToClipboard(result);
+	Ui::Toast::Show(lang(lng_context_copy_selected_done));
+}
+
 void HistoryInner::keyPressEvent(QKeyEvent *e) {
 	if (e->key() == Qt::Key_Escape) {
 		_widget->onListEscapePressed();
@@ -1586,9 +1664,28 @@ void HistoryInner::recountHeight() {
 		accumulate_max(oldHistoryPaddingTop, st::msgMargin.top() + st::msgMargin.bottom() + st::msgPadding.top() + st::msgPadding.bottom() + st::msgNameFont->height + st::botDescSkip + _botAbout->height);
 	}
 
-	_history->resizeGetHeight(_scroll->width());
-	if (_migrated) {
-		_migrated->resizeGetHeight(_scroll->width());
+	if (_visibleAreaBottom > _visibleAreaTop) {
+		// Lay out the visible items and a screen around them right away,
+		// the other items are laid out by relayoutStaleItems() afterwards.
+		auto skip = _visibleAreaBottom - _visibleAreaTop;
+		auto top = _visibleAreaTop - skip;
+		auto bottom = _visibleAreaBottom + skip;
+		auto htop = historyTop(), mtop = migratedTop();
+		if (htop >= 0) {
+			_history->resizeGetHeight(_scroll->width(), top - htop, bottom - htop);
+		} else {
+			_history->resizeGetHeight(_scroll->width());
+		}
+		if (_migrated && mtop >= 0) {
+			_migrated->resizeGetHeight(_scroll->width(), top - mtop, bottom - mtop);
+		} else if (_migrated) {
+			_migrated->resizeGetHeight(_scroll->width());
+		}
+	} else {
+		_history->resizeGetHeight(_scroll->width());
+		if (_migrated) {
+			_migrated->resizeGetHeight(_scroll->width());
+		}
 	}
 
 	// with migrated history we perhaps do not need to display first _history message
@@ -1647,6 +1744,16 @@ void HistoryInner::recountHeight() {
 	}
 }
 
+void HistoryInner::relayoutStaleItems(int limit) {
+	auto htop = historyTop(), mtop = migratedTop();
+	if (htop >= 0) {
+		_history->relayoutStaleItems(_visibleAreaTop - htop, _visibleAreaBottom - htop, limit);
+	}
+	if (mtop >= 0) {
+		_migrated->relayoutStaleItems(_visibleAreaTop - mtop, _visibleAreaBottom - mtop, limit);
+	}
+}
+
 void HistoryInner::updateBotInfo(bool recount) {
 	int newh = 0;
 	if (_botAbout && !_botAbout->info->description.isEmpty()) {
@@ -1698,6 +1805,9 @@ void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	_visibleAreaTop = top;
 	_visibleAreaBottom = bottom;
 
+	// Items painted in the new area will touch their loaders again.
+	Auth().downloader().clearPriorities();
+
 	// if history has pending resize events we should not update scrollTopItem
 	if (hasPendingResizedItems()) {
 		return;
@@ -1732,6 +1842,47 @@ void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	}
 }
 
+void HistoryInner::prefetchMedia(int top, int bottom) {
+	// Keep the prefetched downloads between the visible area and the new prefetch area,
+	// the rest of them are behind the user and won't be displayed soon.
+	auto keepTop = qMin(top, _visibleAreaTop);
+	auto keepBottom = qMax(bottom, _visibleAreaBottom);
+	for (auto i = _prefetchedMedia.begin(); i != _prefetchedMedia.end();) {
+		auto item = App::histItemById(*i);
+		auto media = item ? item->getMedia() : nullptr;
+		auto itemtop = item ? itemTop(item) : -1;
+		if (!media || itemtop < 0) {
+			i = _prefetchedMedia.erase(i);
+			continue;
+		}
+		auto itembottom = itemtop + item->height();
+		if (itembottom > _visibleAreaTop && itemtop < _visibleAreaBottom) {
+			// Displayed items are loaded the usual way from now on.
+			i = _prefetchedMedia.erase(i);
+		} else if (itembottom <= keepTop || itemtop >= keepBottom) {
+			media->cancelPrefetch();
+			i = _prefetchedMedia.erase(i);
+		} else {
+			++i;
+		}
+	}
+
+	if (bottom <= top) {
+		return;
+	}
+	enumerateItemsInArea<EnumItemsDirection::TopToBottom>(top, bottom, [this](not_null<HistoryItem*> item, int itemtop, int itembottom) {
+		if (itembottom > _visibleAreaTop && itemtop < _visibleAreaBottom) {
+			return true;
+		}
+		if (auto media = item->getMedia()) {
+			if (media->prefetch()) {
+				_prefetchedMedia.insert(item->fullId());
+			}
+		}
+		return true;
+	});
+}
+
 bool HistoryInner::displayScrollDate() const {
 	return (_visibleAreaTop <= height() - 2 * (_visibleAreaBottom - _visibleAreaTop));
 }
@@ -2325,7 +2476,7 @@ void HistoryInner::notifyIsBotChanged() {
 	if (newinfo) {
 		_botAbout.reset(new BotAbout(this, newinfo));
 		if (newinfo && !newinfo->inited) {
-			Auth().api().requestFullPeer(_peer);
+			_peer->updateFull();
 		}
 	} else {
 		_botAbout = nullptr;
@@ -20,6 +20,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #pragma once
 
+#include "base/flat_set.h"
 #include "ui/widgets/tooltip.h"
 #include "ui/widgets/scroll_area.h"
 #include "window/top_bar_widget.h"
@@ -50,6 +51,12 @@ public:
 	void recountHeight();
 	void updateSize();
 
+	// Items left with an estimated height after the last width change.
+	bool hasStaleItems() const {
+		return (_history && _history->hasStaleItems()) || (_migrated && _migrated->hasStaleItems());
+	}
+	void relayoutStaleItems(int limit);
+
 	void repaintItem(const HistoryItem *item);
 
 	bool canCopySelected() const;
@@ -68,6 +75,10 @@ public:
 	// updates history->scrollTopItem/scrollTopOffset
 	void visibleAreaUpdated(int top, int bottom);
 
+	// Starts the media downloads in the [top, bottom) area next to the visible one
+	// and drops the prefetched downloads the user has scrolled past without seeing.
+	void prefetchMedia(int top, int bottom);
+
 	int historyHeight() const;
 	int historyScrollTop() const;
 	int migratedTop() const;
@@ -212,6 +223,15 @@ private:
 	void applyDragSelection(SelectedItems *toItems) const;
 	void addSelectionRange(SelectedItems *toItems, int32 fromblock, int32 fromitem, int32 toblock, int32 toitem, History *h) const;
 
+	// Selected items that are not detached, sorted from the top to the bottom.
+	std::vector<not_null<HistoryItem*>> selectedItemsInOrder(const SelectedItems &sel) const;
+	void appendSelectedItemText(TextWithEntities &result, not_null<HistoryItem*> item, TextWithEntities &&text) const;
+
+	// Text of a huge selection that is being copied in steps.
+	struct SelectedTextCopy;
+	std::unique_ptr<SelectedTextCopy> _selectedTextCopy;
+	void copySelectedTextStep();
+
 	// Does any of the shown histories has this flag set.
 	bool hasPendingResizedItems() const {
 		return (_history && _history->hasPendingResizedItems()) || (_migrated && _migrated->hasPendingResizedItems());
@@ -267,30 +287,39 @@ private:
 	int _scrollDateLastItemTop = 0;
 	ClickHandlerPtr _scrollDateLink;
 
+	// Messages with media downloads started by prefetchMedia() that were not displayed yet.
+	base::flat_set<FullMsgId> _prefetchedMedia;
+
 	enum class EnumItemsDirection {
 		TopToBottom,
 		BottomToTop,
 	};
-	// This function finds all history items that are displayed and calls template method
-	// for each found message (in given direction) in the passed history with passed top offset.
+	// This function finds all history items that intersect the [areaTop, areaBottom) area and calls
+	// template method for each found message (in given direction) in the passed history with passed top offset.
 	//
 	// Method has "bool (*Method)(not_null<HistoryItem*> item, int itemtop, int itembottom)" signature
 	// if it returns false the enumeration stops immidiately.
 	template <bool TopToBottom, typename Method>
-	void enumerateItemsInHistory(History *history, int historytop, Method method);
+	void enumerateItemsInHistory(History *history, int historytop, int areaTop, int areaBottom, Method method);
 
 	template <EnumItemsDirection direction, typename Method>
-	void enumerateItems(Method method) {
+	void enumerateItemsInArea(int areaTop, int areaBottom, Method method) {
 		constexpr auto TopToBottom = (direction == EnumItemsDirection::TopToBottom);
 		if (TopToBottom && _migrated) {
-			enumerateItemsInHistory<TopToBottom>(_migrated, migratedTop(), method);
+			enumerateItemsInHistory<TopToBottom>(_migrated, migratedTop(), areaTop, areaBottom, method);
 		}
-		enumerateItemsInHistory<TopToBottom>(_history, historyTop(), method);
+		enumerateItemsInHistory<TopToBottom>(_history, historyTop(), areaTop, areaBottom, method);
 		if (!TopToBottom && _migrated) {
-			enumerateItemsInHistory<TopToBottom>(_migrated, migratedTop(), method);
+			enumerateItemsInHistory<TopToBottom>(_migrated, migratedTop(), areaTop, areaBottom, method);
 		}
 	}
 
+	// Enumerates the displayed history items.
+	template <EnumItemsDirection direction, typename Method>
+	void enumerateItems(Method method) {
+		enumerateItemsInArea<direction>(_visibleAreaTop, _visibleAreaBottom, method);
+	}
+
 	// This function finds all userpics on the left that are displayed and calls template method
 	// for each found userpic (from the top to the bottom) using enumerateItems() method.
 	//
@@ -30,6 +30,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "styles/style_history.h"
 #include "ui/effects/ripple_animation.h"
 #include "storage/file_upload.h"
+#include "storage/localstorage.h"
 #include "auth_session.h"
 #include "media/media_audio.h"
 #include "messenger.h"
@@ -39,6 +40,9 @@ namespace {
 // a new message from the same sender is attached to previous within 15 minutes
 constexpr int kAttachMessageToPreviousSecondsDelta = 900;
 
+// Remembered heights are used as an estimate for widths in the same bucket.
+constexpr auto kLayoutWidthBucket = 16;
+
 } // namespace
 
 ReplyMarkupClickHandler::ReplyMarkupClickHandler(const HistoryItem *item, int row, int col)
@@ -614,6 +618,7 @@ HistoryItem::HistoryItem(
 , _from(from ? App::user(from) : history->peer)
 , _flags(flags | MTPDmessage_ClientFlag::f_pending_init_dimensions | MTPDmessage_ClientFlag::f_pending_resize)
 , _authorNameVersion(author()->nameVersion) {
+	_memory.setBytes(sizeof(HistoryItem));
 }
 
 void HistoryItem::finishCreate() {
@@ -726,6 +731,9 @@ void HistoryItem::destroy() {
 		if ((!out() || isPost()) && unread() && history()->unreadCount() > 0) {
 			history()->setUnreadCount(history()->unreadCount() - 1);
 		}
+		if (id > 0) {
+			Local::removeHistoryMessage(history()->peer->id, id);
+		}
 	}
 	Global::RefPendingRepaintItems().remove(this);
 	delete this;
@@ -802,8 +810,10 @@ void HistoryItem::setAttachToPrevious(bool attachToPrevious) {
 }
 
 void HistoryItem::setId(MsgId newId) {
+	auto wasId = id;
 	history()->changeMsgId(id, newId);
 	id = newId;
+	Local::changeHistoryMessageId(history(), wasId, newId);
 
 	// We don't need to call Notify::replyMarkupUpdated(this) and update keyboard
 	// in history widget, because it can't exist for an outgoing message.
@@ -1196,6 +1206,37 @@ void HistoryItem::drawInDialog(Painter &p, const QRect &r, bool active, bool sel
 	}
 }
 
+int HistoryItem::resizeStaleGetHeight(int newWidth) {
+	if (pendingResize()) {
+		return resizeGetHeight(newWidth);
+	}
+	auto exact = [newWidth](const LayoutMemo &memo) {
+		return (memo.width == newWidth);
+	};
+	auto close = [newWidth](const LayoutMemo &memo) {
+		return (memo.width > 0)
+			&& (memo.width / kLayoutWidthBucket == newWidth / kLayoutWidthBucket);
+	};
+	if (exact(_layoutMemo) || (!exact(_previousLayoutMemo) && close(_layoutMemo))) {
+		_height = _layoutMemo.height;
+	} else if (exact(_previousLayoutMemo) || close(_previousLayoutMemo)) {
+		_height = _previousLayoutMemo.height;
+	}
+	return _height;
+}
+
+void HistoryItem::rememberLayoutHeight() {
+	if (_layoutMemo.width != _width) {
+		_previousLayoutMemo = _layoutMemo;
+	}
+	_layoutMemo.width = _width;
+	_layoutMemo.height = _height;
+}
+
+void HistoryItem::forgetLayoutHeights() {
+	_layoutMemo = _previousLayoutMemo = LayoutMemo();
+}
+
 HistoryItem::~HistoryItem() {
 	App::historyUnregItem(this);
 	if (id < 0 && !App::quitting()) {
@@ -489,8 +489,16 @@ public:
 			_flags &= ~MTPDmessage_ClientFlag::f_pending_resize;
 		}
 		_width = newWidth;
-		return resizeContentGetHeight();
+		auto result = resizeContentGetHeight();
+		rememberLayoutHeight();
+		return result;
 	}
+
+	// Keeps the layout for the current width() and only takes the height
+	// remembered for the new width (or a close one) as an estimate.
+	// The item should be resized for the new width later.
+	int resizeStaleGetHeight(int newWidth);
+
 	virtual void draw(Painter &p, QRect clip, TextSelection selection, TimeMs ms) const = 0;
 
 	virtual void dependencyItemRemoved(HistoryItem *dependency) {
@@ -846,6 +854,7 @@ public:
 	}
 	void setPendingResize() {
 		_flags |= MTPDmessage_ClientFlag::f_pending_resize;
+		forgetLayoutHeights();
 		if (!detached() || isLogEntry()) {
 			_history->setHasPendingResizedItems();
 		}
@@ -952,6 +961,9 @@ protected:
 
 	mutable int32 _authorNameVersion = 0;
 
+	// Counts only the common item part, its texts are counted as text layouts.
+	MemoryStats::Tracker<MemoryStats::Kind::HistoryItems> _memory;
+
 	HistoryItem *previousItem() const {
 		if (_block && _indexInBlock >= 0) {
 			if (_indexInBlock > 0) {
@@ -1035,9 +1047,20 @@ protected:
 	HistoryMediaPtr _media;
 
 private:
+	struct LayoutMemo {
+		int width = 0;
+		int height = 0;
+	};
+	void rememberLayoutHeight();
+	void forgetLayoutHeights();
+
 	int _y = 0;
 	int _width = 0;
 
+	// Heights for the last two widths the item was laid out for.
+	LayoutMemo _layoutMemo;
+	LayoutMemo _previousLayoutMemo;
+
 };
 
 // make all the constructors in HistoryItem children protected
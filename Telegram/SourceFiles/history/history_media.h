@@ -125,6 +125,16 @@ public:
 		return nullptr;
 	}
 
+	// Starts the automatic download of the media before it is displayed,
+	// returns true if some download was started.
+	virtual bool prefetch() {
+		return false;
+	}
+
+	// Drops the download started by prefetch() if it is not finished yet.
+	virtual void cancelPrefetch() {
+	}
+
 	bool playInline(/*bool autoplay = false*/) {
 		return playInline(false);
 	}
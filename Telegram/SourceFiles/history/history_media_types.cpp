@@ -94,6 +94,31 @@ bool needReSetInlineResultDocument(const MTPMessageMedia &media, DocumentData *e
 
 } // namespace
 
+HistoryTextEstimate HistoryTextEstimate::Count(const QString &text, const style::font &font, int skipBlockWidth) {
+	auto result = HistoryTextEstimate();
+	if (text.isEmpty()) {
+		return result;
+	}
+	auto charWidth = font->m.averageCharWidth();
+	auto length = 0;
+	auto finishParagraph = [&](int additionalWidth) {
+		auto width = length * charWidth + additionalWidth;
+		accumulate_max(result.maxWidth, width);
+		result.totalWidth += width;
+		++result.paragraphs;
+		length = 0;
+	};
+	for (auto ch : text) {
+		if (ch == QChar::LineFeed) {
+			finishParagraph(0);
+		} else {
+			++length;
+		}
+	}
+	finishParagraph(skipBlockWidth);
+	return result;
+}
+
 void HistoryInitMedia() {
 	initTextOptions();
 }
@@ -353,6 +378,23 @@ int HistoryPhoto::resizeGetHeight(int width) {
 	return _height;
 }
 
+bool HistoryPhoto::prefetch() {
+	if (_data->loaded() || _data->loading()) {
+		return false;
+	}
+	_data->automaticLoad(_parent);
+	return _data->loading();
+}
+
+void HistoryPhoto::cancelPrefetch() {
+	if (_data->loading()) {
+		_data->cancel();
+
+		// Let the automatic download start again when the photo is painted.
+		_data->automaticLoadSettingsChanged();
+	}
+}
+
 void HistoryPhoto::draw(Painter &p, const QRect &r, TextSelection selection, TimeMs ms) const {
 	if (_width < st::msgPadding.left() + st::msgPadding.right() + 1) return;
 
@@ -803,7 +845,11 @@ void HistoryVideo::draw(Painter &p, const QRect &r, TextSelection selection, Tim
 	auto roundCorners = inWebPage ? ImageRoundCorner::All : ((isBubbleTop() ? (ImageRoundCorner::TopLeft | ImageRoundCorner::TopRight) : ImageRoundCorner::None)
 		| ((isBubbleBottom() && _caption.isEmpty()) ? (ImageRoundCorner::BottomLeft | ImageRoundCorner::BottomRight) : ImageRoundCorner::None));
 	QRect rthumb(rtlrect(skipx, skipy, width, height, _width));
-	p.drawPixmap(rthumb.topLeft(), _data->thumb->pixBlurredSingle(_thumbw, 0, width, height, roundRadius, roundCorners));
+	if (auto poster = _data->loadPoster()) {
+		p.drawPixmap(rthumb.topLeft(), poster->pixSingle(_thumbw, 0, width, height, roundRadius, roundCorners));
+	} else {
+		p.drawPixmap(rthumb.topLeft(), _data->thumb->pixBlurredSingle(_thumbw, 0, width, height, roundRadius, roundCorners));
+	}
 	if (selected) {
 		App::complexOverlayRect(p, rthumb, roundRadius, roundCorners);
 	}
@@ -1929,6 +1975,9 @@ int HistoryGif::resizeGetHeight(int width) {
 			auto roundRadius = isRound ? ImageRoundRadius::Ellipse : inWebPage ? ImageRoundRadius::Small : ImageRoundRadius::Large;
 			auto roundCorners = (isRound || inWebPage) ? ImageRoundCorner::All : ((isBubbleTop() ? (ImageRoundCorner::TopLeft | ImageRoundCorner::TopRight) : ImageRoundCorner::None)
 				| ((isBubbleBottom() && _caption.isEmpty()) ? (ImageRoundCorner::BottomLeft | ImageRoundCorner::BottomRight) : ImageRoundCorner::None));
+			if (!_gif->seekPositionMs()) {
+				_data->savePoster(_gif->frameOriginal().toImage());
+			}
 			_gif->start(_thumbw, _thumbh, _width, _height, roundRadius, roundCorners);
 		}
 	} else {
@@ -1966,6 +2015,23 @@ int HistoryGif::resizeGetHeight(int width) {
 	return _height;
 }
 
+bool HistoryGif::prefetch() {
+	if (_data->loaded() || _data->loading()) {
+		return false;
+	}
+	_data->automaticLoad(_parent);
+	return _data->loading();
+}
+
+void HistoryGif::cancelPrefetch() {
+	if (_data->loading()) {
+		_data->cancel();
+
+		// Let the automatic download start again when the animation is painted.
+		_data->automaticLoadSettingsChanged();
+	}
+}
+
 void HistoryGif::draw(Painter &p, const QRect &r, TextSelection selection, TimeMs ms) const {
 	if (_width < st::msgPadding.left() + st::msgPadding.right() + 1) return;
 
@@ -2073,6 +2139,8 @@ void HistoryGif::draw(Painter &p, const QRect &r, TextSelection selection, TimeM
 				p.setOpacity(1.);
 			}
 		}
+	} else if (auto poster = _data->loadPoster()) {
+		p.drawPixmap(rthumb.topLeft(), poster->pixSingle(_thumbw, _thumbh, usew, height, roundRadius, roundCorners));
 	} else {
 		p.drawPixmap(rthumb.topLeft(), _data->thumb->pixBlurredSingle(_thumbw, _thumbh, usew, height, roundRadius, roundCorners));
 	}
@@ -3248,8 +3316,11 @@ HistoryWebPage::HistoryWebPage(not_null<HistoryItem*> parent, const HistoryWebPa
 , _data(other._data)
 , _attach(other._attach ? other._attach->clone(parent) : nullptr)
 , _asArticle(other._asArticle)
+, _textsReady(other._textsReady)
 , _title(other._title)
 , _description(other._description)
+, _titleEstimate(other._titleEstimate)
+, _descriptionEstimate(other._descriptionEstimate)
 , _siteNameWidth(other._siteNameWidth)
 , _durationWidth(other._durationWidth)
 , _pixw(other._pixw)
@@ -3257,6 +3328,7 @@ HistoryWebPage::HistoryWebPage(not_null<HistoryItem*> parent, const HistoryWebPa
 }
 
 void HistoryWebPage::initDimensions() {
+	_staticLayer.invalidate();
 	if (_data->pendingTill) {
 		_maxw = _minh = _height = 0;
 		return;
@@ -3268,7 +3340,7 @@ void HistoryWebPage::initDimensions() {
 	}
 
 	// init layout
-	auto title = TextUtilities::SingleLine(_data->title.isEmpty() ? _data->author : _data->title);
+	auto title = titleString();
 	if (!_data->description.text.isEmpty() && title.isEmpty() && _data->siteName.isEmpty() && !_data->url.isEmpty()) {
 		_data->siteName = siteNameFromUrl(_data->url);
 	}
@@ -3304,35 +3376,14 @@ void HistoryWebPage::initDimensions() {
 		}
 	}
 
-	auto textFloatsAroundInfo = !_asArticle && !_attach && isBubbleBottom();
-
 	// init strings
-	if (_description.isEmpty() && !_data->description.text.isEmpty()) {
-		auto text = _data->description;
-
-		if (textFloatsAroundInfo) {
-			text.text += _parent->skipBlock();
-		}
-		auto opts = &_webpageDescriptionOptions;
-		if (_data->siteName == qstr("Twitter")) {
-			opts = &_twitterDescriptionOptions;
-		} else if (_data->siteName == qstr("Instagram")) {
-			opts = &_instagramDescriptionOptions;
-		}
-		if (isLogEntryOriginal()) {
-			// Fix layout for small bubbles (narrow media caption edit log entries).
-			_description = Text(st::minPhotoSize
-				- st::msgPadding.left()
-				- st::msgPadding.right()
-				- st::webPageLeft);
-		}
-		_description.setMarkedText(st::webPageDescriptionStyle, text, *opts);
-	}
-	if (_title.isEmpty() && !title.isEmpty()) {
-		if (textFloatsAroundInfo && _description.isEmpty()) {
-			title += _parent->skipBlock();
-		}
-		_title.setText(st::webPageTitleStyle, title, _webpageTitleOptions);
+	if (_textsReady || isLogEntryOriginal()) {
+		buildTexts();
+	} else {
+		auto textFloatsAroundInfo = !_asArticle && !_attach && isBubbleBottom();
+		auto skipBlockWidth = textFloatsAroundInfo ? _parent->skipBlockWidth() : 0;
+		_descriptionEstimate = HistoryTextEstimate::Count(_data->description.text, st::webPageDescriptionFont, skipBlockWidth);
+		_titleEstimate = HistoryTextEstimate::Count(title, st::webPageTitleFont, _descriptionEstimate.empty() ? skipBlockWidth : 0);
 	}
 	if (!_siteNameWidth && !_data->siteName.isEmpty()) {
 		_siteNameWidth = st::webPageTitleFont->width(_data->siteName);
@@ -3345,9 +3396,9 @@ void HistoryWebPage::initDimensions() {
 	_minh = 0;
 
 	auto siteNameHeight = _data->siteName.isEmpty() ? 0 : lineHeight;
-	auto titleMinHeight = _title.isEmpty() ? 0 : lineHeight;
+	auto titleMinHeight = hasTitle() ? lineHeight : 0;
 	auto descMaxLines = isLogEntryOriginal() ? kMaxOriginalEntryLines : (3 + (siteNameHeight ? 0 : 1) + (titleMinHeight ? 0 : 1));
-	auto descriptionMinHeight = _description.isEmpty() ? 0 : qMin(_description.minHeight(), descMaxLines * lineHeight);
+	auto descriptionMinHeight = hasDescription() ? qMin(HistoryWebPage::descriptionMinHeight(), descMaxLines * lineHeight) : 0;
 	auto articleMinHeight = siteNameHeight + titleMinHeight + descriptionMinHeight;
 	auto articlePhotoMaxWidth = 0;
 	if (_asArticle) {
@@ -3355,23 +3406,23 @@ void HistoryWebPage::initDimensions() {
 	}
 
 	if (_siteNameWidth) {
-		if (_title.isEmpty() && _description.isEmpty()) {
+		if (!hasTitle() && !hasDescription()) {
 			accumulate_max(_maxw, _siteNameWidth + _parent->skipBlockWidth());
 		} else {
 			accumulate_max(_maxw, _siteNameWidth + articlePhotoMaxWidth);
 		}
 		_minh += lineHeight;
 	}
-	if (!_title.isEmpty()) {
-		accumulate_max(_maxw, _title.maxWidth() + articlePhotoMaxWidth);
+	if (hasTitle()) {
+		accumulate_max(_maxw, titleMaxWidth() + articlePhotoMaxWidth);
 		_minh += titleMinHeight;
 	}
-	if (!_description.isEmpty()) {
-		accumulate_max(_maxw, _description.maxWidth() + articlePhotoMaxWidth);
+	if (hasDescription()) {
+		accumulate_max(_maxw, descriptionMaxWidth() + articlePhotoMaxWidth);
 		_minh += descriptionMinHeight;
 	}
 	if (_attach) {
-		auto attachAtTop = !_siteNameWidth && _title.isEmpty() && _description.isEmpty();
+		auto attachAtTop = !_siteNameWidth && !hasTitle() && !hasDescription();
 		if (!attachAtTop) _minh += st::mediaInBubbleSkip;
 
 		_attach->initDimensions();
@@ -3421,10 +3472,10 @@ int HistoryWebPage::resizeGetHeight(int width) {
 
 			_height = siteNameHeight;
 
-			if (_title.isEmpty()) {
+			if (!hasTitle()) {
 				_titleLines = 0;
 			} else {
-				if (_title.countHeight(wleft) < 2 * st::webPageTitleFont->height) {
+				if (titleHeight(wleft) < 2 * st::webPageTitleFont->height) {
 					_titleLines = 1;
 				} else {
 					_titleLines = 2;
@@ -3432,7 +3483,7 @@ int HistoryWebPage::resizeGetHeight(int width) {
 				_height += _titleLines * lineHeight;
 			}
 
-			auto descriptionHeight = _description.countHeight(wleft);
+			auto descriptionHeight = HistoryWebPage::descriptionHeight(wleft);
 			if (descriptionHeight < (linesMax - siteNameLines - _titleLines) * st::webPageDescriptionFont->height) {
 				// We have height for all the lines.
 				_descriptionLines = -1;
@@ -3452,10 +3503,10 @@ int HistoryWebPage::resizeGetHeight(int width) {
 	} else {
 		_height = siteNameHeight;
 
-		if (_title.isEmpty()) {
+		if (!hasTitle()) {
 			_titleLines = 0;
 		} else {
-			if (_title.countHeight(width) < 2 * st::webPageTitleFont->height) {
+			if (titleHeight(width) < 2 * st::webPageTitleFont->height) {
 				_titleLines = 1;
 			} else {
 				_titleLines = 2;
@@ -3463,10 +3514,10 @@ int HistoryWebPage::resizeGetHeight(int width) {
 			_height += _titleLines * lineHeight;
 		}
 
-		if (_description.isEmpty()) {
+		if (!hasDescription()) {
 			_descriptionLines = 0;
 		} else {
-			auto descriptionHeight = _description.countHeight(width);
+			auto descriptionHeight = HistoryWebPage::descriptionHeight(width);
 			if (descriptionHeight < (linesMax - siteNameLines - _titleLines) * st::webPageDescriptionFont->height) {
 				// We have height for all the lines.
 				_descriptionLines = -1;
@@ -3500,6 +3551,7 @@ int HistoryWebPage::resizeGetHeight(int width) {
 
 void HistoryWebPage::draw(Painter &p, const QRect &r, TextSelection selection, TimeMs ms) const {
 	if (_width < st::msgPadding.left() + st::msgPadding.right() + 1) return;
+	ensureTexts();
 	int32 skipx = 0, skipy = 0, width = _width, height = _height;
 
 	bool out = _parent->out(), isPost = _parent->isPost(), outbg = out && !isPost;
@@ -3550,34 +3602,44 @@ void HistoryWebPage::draw(Painter &p, const QRect &r, TextSelection selection, T
 		}
 		width -= pw + st::webPagePhotoDelta;
 	}
-	if (_siteNameWidth) {
-		p.setFont(st::webPageTitleFont);
-		p.setPen(semibold);
-		p.drawTextLeft(padding.left(), tshift, _width, (width >= _siteNameWidth) ? _data->siteName : st::webPageTitleFont->elided(_data->siteName, width));
-		tshift += lineHeight;
-	}
-	if (_titleLines) {
-		p.setPen(outbg ? st::webPageTitleOutFg : st::webPageTitleInFg);
-		int32 endskip = 0;
-		if (_title.hasSkipBlock()) {
-			endskip = _parent->skipBlockWidth();
-		}
-		_title.drawLeftElided(p, padding.left(), tshift, width, _width, _titleLines, style::al_left, 0, -1, endskip, false, selection);
-		tshift += _titleLines * lineHeight;
-	}
-	if (_descriptionLines) {
-		p.setPen(outbg ? st::webPageDescriptionOutFg : st::webPageDescriptionInFg);
-		int32 endskip = 0;
-		if (_description.hasSkipBlock()) {
-			endskip = _parent->skipBlockWidth();
-		}
-		if (_descriptionLines > 0) {
-			_description.drawLeftElided(p, padding.left(), tshift, width, _width, _descriptionLines, style::al_left, 0, -1, endskip, false, toDescriptionSelection(selection));
-			tshift += _descriptionLines * lineHeight;
-		} else {
-			_description.drawLeft(p, padding.left(), tshift, width, _width, style::al_left, 0, -1, toDescriptionSelection(selection));
-			tshift += _description.countHeight(width);
-		}
+	auto textsHeight = (_siteNameWidth ? lineHeight : 0) + _titleLines * lineHeight;
+	if (_descriptionLines > 0) {
+		textsHeight += _descriptionLines * lineHeight;
+	} else if (_descriptionLines < 0) {
+		textsHeight += _description.countHeight(width);
+	}
+	if (textsHeight > 0) {
+		_staticLayer.paint(p, QRect(0, tshift, _width, textsHeight), selection, _parent->skipBlockWidth(), [&](Painter &p) {
+			auto top = tshift;
+			if (_siteNameWidth) {
+				p.setFont(st::webPageTitleFont);
+				p.setPen(semibold);
+				p.drawTextLeft(padding.left(), top, _width, (width >= _siteNameWidth) ? _data->siteName : st::webPageTitleFont->elided(_data->siteName, width));
+				top += lineHeight;
+			}
+			if (_titleLines) {
+				p.setPen(outbg ? st::webPageTitleOutFg : st::webPageTitleInFg);
+				int32 endskip = 0;
+				if (_title.hasSkipBlock()) {
+					endskip = _parent->skipBlockWidth();
+				}
+				_title.drawLeftElided(p, padding.left(), top, width, _width, _titleLines, style::al_left, 0, -1, endskip, false, selection);
+				top += _titleLines * lineHeight;
+			}
+			if (_descriptionLines) {
+				p.setPen(outbg ? st::webPageDescriptionOutFg : st::webPageDescriptionInFg);
+				int32 endskip = 0;
+				if (_description.hasSkipBlock()) {
+					endskip = _parent->skipBlockWidth();
+				}
+				if (_descriptionLines > 0) {
+					_description.drawLeftElided(p, padding.left(), top, width, _width, _descriptionLines, style::al_left, 0, -1, endskip, false, toDescriptionSelection(selection));
+				} else {
+					_description.drawLeft(p, padding.left(), top, width, _width, style::al_left, 0, -1, toDescriptionSelection(selection));
+				}
+			}
+		});
+		tshift += textsHeight;
 	}
 	if (_attach) {
 		auto attachAtTop = !_siteNameWidth && !_titleLines && !_descriptionLines;
@@ -3629,6 +3691,7 @@ HistoryTextState HistoryWebPage::getState(QPoint point, HistoryStateRequest requ
 	HistoryTextState result;
 
 	if (_width < st::msgPadding.left() + st::msgPadding.right() + 1) return result;
+	ensureTexts();
 	int32 skipx = 0, skipy = 0, width = _width, height = _height;
 
 	QMargins bubble(_attach ? _attach->bubbleMargins() : QMargins());
@@ -3707,6 +3770,7 @@ HistoryTextState HistoryWebPage::getState(QPoint point, HistoryStateRequest requ
 }
 
 TextSelection HistoryWebPage::adjustSelection(TextSelection selection, TextSelectType type) const {
+	ensureTexts();
 	if (!_descriptionLines || selection.to <= _title.length()) {
 		return _title.adjustSelection(selection, type);
 	}
@@ -3744,6 +3808,7 @@ TextWithEntities HistoryWebPage::selectedText(TextSelection selection) const {
 	if (selection == FullSelection && !isLogEntryOriginal()) {
 		return TextWithEntities();
 	}
+	ensureTexts();
 	auto titleResult = _title.originalTextWithEntities((selection == FullSelection) ? AllTextSelection : selection, ExpandLinksAll);
 	auto descriptionResult = _description.originalTextWithEntities(toDescriptionSelection((selection == FullSelection) ? AllTextSelection : selection), ExpandLinksAll);
 	if (titleResult.text.isEmpty()) {
@@ -3777,6 +3842,89 @@ bool HistoryWebPage::isLogEntryOriginal() const {
 	return _parent->isLogEntry() && _parent->getMedia() != this;
 }
 
+QString HistoryWebPage::titleString() const {
+	return TextUtilities::SingleLine(_data->title.isEmpty() ? _data->author : _data->title);
+}
+
+void HistoryWebPage::ensureTexts() const {
+	if (_textsReady) {
+		return;
+	}
+	const_cast<HistoryWebPage*>(this)->buildTexts();
+
+	// The message was laid out with the estimated sizes of the texts.
+	_parent->setPendingInitDimensions();
+}
+
+void HistoryWebPage::buildTexts() {
+	_textsReady = true;
+	_titleEstimate = _descriptionEstimate = HistoryTextEstimate();
+
+	auto textFloatsAroundInfo = !_asArticle && !_attach && isBubbleBottom();
+	if (_description.isEmpty() && !_data->description.text.isEmpty()) {
+		auto text = _data->description;
+
+		if (textFloatsAroundInfo) {
+			text.text += _parent->skipBlock();
+		}
+		auto opts = &_webpageDescriptionOptions;
+		if (_data->siteName == qstr("Twitter")) {
+			opts = &_twitterDescriptionOptions;
+		} else if (_data->siteName == qstr("Instagram")) {
+			opts = &_instagramDescriptionOptions;
+		}
+		if (isLogEntryOriginal()) {
+			// Fix layout for small bubbles (narrow media caption edit log entries).
+			_description = Text(st::minPhotoSize
+				- st::msgPadding.left()
+				- st::msgPadding.right()
+				- st::webPageLeft);
+		}
+		_description.setMarkedText(st::webPageDescriptionStyle, text, *opts);
+	}
+	auto title = titleString();
+	if (_title.isEmpty() && !title.isEmpty()) {
+		if (textFloatsAroundInfo && _description.isEmpty()) {
+			title += _parent->skipBlock();
+		}
+		_title.setText(st::webPageTitleStyle, title, _webpageTitleOptions);
+	}
+}
+
+bool HistoryWebPage::hasTitle() const {
+	return _textsReady ? !_title.isEmpty() : !_titleEstimate.empty();
+}
+
+bool HistoryWebPage::hasDescription() const {
+	return _textsReady ? !_description.isEmpty() : !_descriptionEstimate.empty();
+}
+
+int HistoryWebPage::titleMaxWidth() const {
+	return _textsReady ? _title.maxWidth() : _titleEstimate.maxWidth;
+}
+
+int HistoryWebPage::titleHeight(int width) const {
+	return _textsReady
+		? _title.countHeight(width)
+		: (_titleEstimate.lines(width) * st::webPageTitleFont->height);
+}
+
+int HistoryWebPage::descriptionMaxWidth() const {
+	return _textsReady ? _description.maxWidth() : _descriptionEstimate.maxWidth;
+}
+
+int HistoryWebPage::descriptionMinHeight() const {
+	return _textsReady
+		? _description.minHeight()
+		: (_descriptionEstimate.paragraphs * st::webPageDescriptionFont->height);
+}
+
+int HistoryWebPage::descriptionHeight(int width) const {
+	return _textsReady
+		? _description.countHeight(width)
+		: (_descriptionEstimate.lines(width) * st::webPageDescriptionFont->height);
+}
+
 int HistoryWebPage::bottomInfoPadding() const {
 	if (!isBubbleBottom()) return 0;
 
@@ -3805,6 +3953,7 @@ HistoryGame::HistoryGame(not_null<HistoryItem*> parent, const HistoryGame &other
 }
 
 void HistoryGame::initDimensions() {
+	_staticLayer.invalidate();
 	auto lineHeight = unitedLineHeight();
 
 	if (!_openl && _parent->id > 0) {
@@ -3967,23 +4116,29 @@ void HistoryGame::draw(Painter &p, const QRect &r, TextSelection selection, Time
 	p.fillRect(bar, barfg);
 
 	auto lineHeight = unitedLineHeight();
-	if (_titleLines) {
-		p.setPen(semibold);
-		int32 endskip = 0;
-		if (_title.hasSkipBlock()) {
-			endskip = _parent->skipBlockWidth();
-		}
-		_title.drawLeftElided(p, padding.left(), tshift, width, _width, _titleLines, style::al_left, 0, -1, endskip, false, selection);
-		tshift += _titleLines * lineHeight;
-	}
-	if (_descriptionLines) {
-		p.setPen(outbg ? st::webPageDescriptionOutFg : st::webPageDescriptionInFg);
-		int32 endskip = 0;
-		if (_description.hasSkipBlock()) {
-			endskip = _parent->skipBlockWidth();
-		}
-		_description.drawLeftElided(p, padding.left(), tshift, width, _width, _descriptionLines, style::al_left, 0, -1, endskip, false, toDescriptionSelection(selection));
-		tshift += _descriptionLines * lineHeight;
+	auto textsHeight = (_titleLines + _descriptionLines) * lineHeight;
+	if (textsHeight > 0) {
+		_staticLayer.paint(p, QRect(0, tshift, _width, textsHeight), selection, _parent->skipBlockWidth(), [&](Painter &p) {
+			auto top = tshift;
+			if (_titleLines) {
+				p.setPen(semibold);
+				int32 endskip = 0;
+				if (_title.hasSkipBlock()) {
+					endskip = _parent->skipBlockWidth();
+				}
+				_title.drawLeftElided(p, padding.left(), top, width, _width, _titleLines, style::al_left, 0, -1, endskip, false, selection);
+				top += _titleLines * lineHeight;
+			}
+			if (_descriptionLines) {
+				p.setPen(outbg ? st::webPageDescriptionOutFg : st::webPageDescriptionInFg);
+				int32 endskip = 0;
+				if (_description.hasSkipBlock()) {
+					endskip = _parent->skipBlockWidth();
+				}
+				_description.drawLeftElided(p, padding.left(), top, width, _width, _descriptionLines, style::al_left, 0, -1, endskip, false, toDescriptionSelection(selection));
+			}
+		});
+		tshift += textsHeight;
 	}
 	if (_attach) {
 		auto attachAtTop = !_titleLines && !_descriptionLines;
@@ -4277,6 +4432,7 @@ void HistoryInvoice::fillFromData(const MTPDmessageMediaInvoice &data) {
 }
 
 void HistoryInvoice::initDimensions() {
+	_staticLayer.invalidate();
 	auto lineHeight = unitedLineHeight();
 
 	if (_attach) {
@@ -4393,23 +4549,32 @@ void HistoryInvoice::draw(Painter &p, const QRect &r, TextSelection selection, T
 	}
 
 	auto lineHeight = unitedLineHeight();
-	if (_titleHeight) {
-		p.setPen(semibold);
-		p.setTextPalette(selected ? (outbg ? st::outTextPaletteSelected : st::inTextPaletteSelected) : (outbg ? st::outSemiboldPalette : st::inSemiboldPalette));
+	auto textsHeight = _titleHeight + _descriptionHeight;
+	if (textsHeight > 0) {
+		_staticLayer.paint(p, QRect(0, tshift, _width, textsHeight), selection, _parent->skipBlockWidth(), [&](Painter &p) {
+			auto top = tshift;
+			if (_titleHeight) {
+				p.setPen(semibold);
+				p.setTextPalette(selected ? (outbg ? st::outTextPaletteSelected : st::inTextPaletteSelected) : (outbg ? st::outSemiboldPalette : st::inSemiboldPalette));
+
+				int32 endskip = 0;
+				if (_title.hasSkipBlock()) {
+					endskip = _parent->skipBlockWidth();
+				}
+				_title.drawLeftElided(p, padding.left(), top, width, _width, _titleHeight / lineHeight, style::al_left, 0, -1, endskip, false, selection);
+				top += _titleHeight;
 
-		int32 endskip = 0;
-		if (_title.hasSkipBlock()) {
-			endskip = _parent->skipBlockWidth();
+				p.setTextPalette(selected ? (outbg ? st::outTextPaletteSelected : st::inTextPaletteSelected) : (outbg ? st::outTextPalette : st::inTextPalette));
+			}
+			if (_descriptionHeight) {
+				p.setPen(outbg ? st::webPageDescriptionOutFg : st::webPageDescriptionInFg);
+				_description.drawLeft(p, padding.left(), top, width, _width, style::al_left, 0, -1, toDescriptionSelection(selection));
+			}
+		});
+		if (_titleHeight) {
+			p.setTextPalette(selected ? (outbg ? st::outTextPaletteSelected : st::inTextPaletteSelected) : (outbg ? st::outTextPalette : st::inTextPalette));
 		}
-		_title.drawLeftElided(p, padding.left(), tshift, width, _width, _titleHeight / lineHeight, style::al_left, 0, -1, endskip, false, selection);
-		tshift += _titleHeight;
-
-		p.setTextPalette(selected ? (outbg ? st::outTextPaletteSelected : st::inTextPaletteSelected) : (outbg ? st::outTextPalette : st::inTextPalette));
-	}
-	if (_descriptionHeight) {
-		p.setPen(outbg ? st::webPageDescriptionOutFg : st::webPageDescriptionInFg);
-		_description.drawLeft(p, padding.left(), tshift, width, _width, style::al_left, 0, -1, toDescriptionSelection(selection));
-		tshift += _descriptionHeight;
+		tshift += textsHeight;
 	}
 	if (_attach) {
 		auto attachAtTop = !_titleHeight && !_descriptionHeight;
@@ -4702,7 +4867,7 @@ void HistoryLocation::draw(Painter &p, const QRect &r, TextSelection selection,
 	auto roundCorners = ((isBubbleTop() && _title.isEmpty() && _description.isEmpty()) ? (ImageRoundCorner::TopLeft | ImageRoundCorner::TopRight) : ImageRoundCorner::None)
 		| (isBubbleBottom() ? (ImageRoundCorner::BottomLeft | ImageRoundCorner::BottomRight) : ImageRoundCorner::None);
 	auto rthumb = QRect(skipx, skipy, width, height);
-	if (_data && !_data->thumb->isNull()) {
+	if (_data && _data->thumb->loaded()) {
 		int32 w = _data->thumb->width(), h = _data->thumb->height();
 		QPixmap pix;
 		if (width * h == height * w || (w == fullWidth() && h == fullHeight())) {
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include "history/history_media.h"
+#include "history/history_service_layout.h"
 #include "ui/effects/radial_animation.h"
 
 namespace Media {
@@ -31,6 +32,23 @@ class Playback;
 
 void HistoryInitMedia();
 
+// Rough size of a text that was not built yet, so that the previews
+// that were never displayed don't parse and measure their texts.
+struct HistoryTextEstimate {
+	static HistoryTextEstimate Count(const QString &text, const style::font &font, int skipBlockWidth = 0);
+
+	bool empty() const {
+		return !paragraphs;
+	}
+	int lines(int width) const {
+		return paragraphs + (totalWidth / qMax(width, 1));
+	}
+
+	int maxWidth = 0; // Of the longest paragraph.
+	int totalWidth = 0;
+	int paragraphs = 0;
+};
+
 class HistoryFileMedia : public HistoryMedia {
 public:
 	using HistoryMedia::HistoryMedia;
@@ -160,6 +178,8 @@ public:
 	PhotoData *photo() const {
 		return _data;
 	}
+	bool prefetch() override;
+	void cancelPrefetch() override;
 
 	void updateSentMedia(const MTPMessageMedia &media) override;
 	bool needReSetInlineResultMedia(const MTPMessageMedia &media) override;
@@ -515,6 +535,8 @@ public:
 	Media::Clip::Reader *getClipReader() override {
 		return _gif.get();
 	}
+	bool prefetch() override;
+	void cancelPrefetch() override;
 
 	bool playInline(bool autoplay) override;
 	void stopInline() override;
@@ -789,6 +811,7 @@ public:
 
 	TextSelection adjustSelection(TextSelection selection, TextSelectType type) const override WARN_UNUSED_RESULT;
 	uint16 fullSelectionLength() const override {
+		ensureTexts();
 		return _title.length() + _description.length();
 	}
 	bool hasTextForCopy() const override {
@@ -858,14 +881,30 @@ private:
 	int bottomInfoPadding() const;
 	bool isLogEntryOriginal() const;
 
+	// The title and description are built when the preview is first
+	// displayed, until then the layout uses their estimated sizes.
+	void ensureTexts() const;
+	void buildTexts();
+	QString titleString() const;
+	bool hasTitle() const;
+	bool hasDescription() const;
+	int titleMaxWidth() const;
+	int titleHeight(int width) const;
+	int descriptionMaxWidth() const;
+	int descriptionMinHeight() const;
+	int descriptionHeight(int width) const;
+
 	not_null<WebPageData*> _data;
 	ClickHandlerPtr _openl;
 	std::unique_ptr<HistoryMedia> _attach;
 
 	bool _asArticle = false;
+	bool _textsReady = false;
 	int32 _titleLines, _descriptionLines;
 
 	Text _title, _description;
+	HistoryTextEstimate _titleEstimate, _descriptionEstimate;
+	HistoryLayout::StaticLayer _staticLayer;
 	int32 _siteNameWidth = 0;
 
 	QString _duration;
@@ -978,6 +1017,7 @@ private:
 	int32 _titleLines, _descriptionLines;
 
 	Text _title, _description;
+	HistoryLayout::StaticLayer _staticLayer;
 
 	int _gameTagWidth = 0;
 
@@ -1069,6 +1109,7 @@ private:
 	Text _title;
 	Text _description;
 	Text _status;
+	HistoryLayout::StaticLayer _staticLayer;
 
 	MsgId _receiptMsgId = 0;
 
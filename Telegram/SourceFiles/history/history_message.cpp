@@ -29,6 +29,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "history/history_media_types.h"
 #include "history/history_service.h"
 #include "auth_session.h"
+#include "data/data_search_index.h"
 #include "boxes/share_box.h"
 #include "boxes/confirm_box.h"
 #include "ui/toast/toast.h"
@@ -1369,6 +1370,10 @@ void HistoryMessage::setMedia(const MTPMessageMedia *media) {
 }
 
 void HistoryMessage::setText(const TextWithEntities &textWithEntities) {
+	if (!isLogEntry()) {
+		Auth().searchIndex().add(this, textWithEntities.text);
+	}
+
 	for_const (auto &entity, textWithEntities.entities) {
 		auto type = entity.type();
 		if (type == EntityInTextUrl || type == EntityInTextCustomUrl || type == EntityInTextEmail) {
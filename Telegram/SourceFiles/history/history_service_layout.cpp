@@ -56,6 +56,13 @@ public:
 };
 Data::GlobalStructurePointer<ServiceMessageStyleData> serviceMessageStyle;
 
+constexpr auto kStaticLayersLimit = 64;
+
+const StaticLayer *StaticLayersHead = nullptr; // Most recently painted.
+const StaticLayer *StaticLayersTail = nullptr;
+int StaticLayersCount = 0;
+int StaticLayersPaletteVersion = 0;
+
 int historyServiceMsgRadius() {
 	static int HistoryServiceMsgRadius = ([]() {
 		auto minMsgHeight = (st::msgServiceFont->height + st::msgServicePadding.top() + st::msgServicePadding.bottom());
@@ -347,6 +354,77 @@ void serviceColorsUpdated() {
 			corner = QPixmap();
 		}
 	}
+	++StaticLayersPaletteVersion;
+}
+
+bool StaticLayer::validate(const Painter &p, QSize size, TextSelection selection, uint64 state) const {
+	auto key = Key();
+	key.size = size;
+	key.selection = selection;
+	key.palette = &p.textPalette();
+	key.active = ClickHandler::getActive().get();
+	key.pressed = ClickHandler::getPressed().get();
+	key.paletteVersion = StaticLayersPaletteVersion;
+	key.state = state;
+	auto result = !_cache.isNull()
+		&& (_key.size == key.size)
+		&& (_key.selection == key.selection)
+		&& (_key.palette == key.palette)
+		&& (_key.active == key.active)
+		&& (_key.pressed == key.pressed)
+		&& (_key.paletteVersion == key.paletteVersion)
+		&& (_key.state == key.state);
+	_key = key;
+	return result;
+}
+
+QImage StaticLayer::prepareImage(QSize size) const {
+	auto result = QImage(size * cIntRetinaFactor(), QImage::Format_ARGB32_Premultiplied);
+	result.setDevicePixelRatio(cRetinaFactor());
+	result.fill(Qt::transparent);
+	return result;
+}
+
+void StaticLayer::store(QImage &&image) const {
+	_cache = App::pixmapFromImageInPlace(std::move(image));
+
+	unlink();
+	_next = StaticLayersHead;
+	if (_next) {
+		_next->_prev = this;
+	} else {
+		StaticLayersTail = this;
+	}
+	StaticLayersHead = this;
+	if (++StaticLayersCount > kStaticLayersLimit) {
+		StaticLayersTail->invalidate();
+	}
+}
+
+void StaticLayer::invalidate() const {
+	if (!_cache.isNull()) {
+		_cache = QPixmap();
+		unlink();
+		--StaticLayersCount;
+	}
+}
+
+void StaticLayer::unlink() const {
+	if (_prev) {
+		_prev->_next = _next;
+	} else if (StaticLayersHead == this) {
+		StaticLayersHead = _next;
+	}
+	if (_next) {
+		_next->_prev = _prev;
+	} else if (StaticLayersTail == this) {
+		StaticLayersTail = _prev;
+	}
+	_prev = _next = nullptr;
+}
+
+StaticLayer::~StaticLayer() {
+	invalidate();
 }
 
 void paintBubble(Painter &p, QRect rect, int outerWidth, bool selected, bool outbg, RectPart tailSide) {
@@ -60,6 +60,61 @@ void paintEmpty(Painter &p, int width, int height);
 
 void serviceColorsUpdated();
 
+// Keeps the parts of a media bubble that do not change between repaints
+// (site name, title and description texts) in a pixmap. The attached media,
+// radial progress and other dynamic overlays are painted on top of it live.
+// Only a limited count of recently painted layers hold their pixmaps.
+class StaticLayer {
+public:
+	StaticLayer() = default;
+	StaticLayer(const StaticLayer &other) = delete;
+	StaticLayer &operator=(const StaticLayer &other) = delete;
+
+	// The callback paints the rect, using the painter it receives, only
+	// when the rect size, selection, text palette, link hover, theme
+	// or the media specific state have changed since the last time.
+	template <typename Callback>
+	void paint(Painter &p, QRect rect, TextSelection selection, uint64 state, Callback callback) const {
+		if (!validate(p, rect.size(), selection, state)) {
+			auto image = prepareImage(rect.size());
+			{
+				Painter q(&image);
+				q.setTextPalette(p.textPalette());
+				q.translate(-rect.topLeft());
+				callback(q);
+			}
+			store(std::move(image));
+		}
+		p.drawPixmap(rect.topLeft(), _cache);
+	}
+
+	void invalidate() const;
+
+	~StaticLayer();
+
+private:
+	struct Key {
+		QSize size;
+		TextSelection selection;
+		const style::TextPalette *palette = nullptr;
+		const ClickHandler *active = nullptr;
+		const ClickHandler *pressed = nullptr;
+		int paletteVersion = 0;
+		uint64 state = 0;
+	};
+
+	bool validate(const Painter &p, QSize size, TextSelection selection, uint64 state) const;
+	QImage prepareImage(QSize size) const;
+	void store(QImage &&image) const;
+	void unlink() const;
+
+	mutable Key _key;
+	mutable QPixmap _cache;
+	mutable const StaticLayer *_prev = nullptr;
+	mutable const StaticLayer *_next = nullptr;
+
+};
+
 void paintBubble(Painter &p, QRect rect, int outerWidth, bool selected, bool outbg, RectPart tailSide);
 
 } // namespace HistoryLayout
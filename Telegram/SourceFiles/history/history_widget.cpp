@@ -176,6 +176,12 @@ constexpr auto kSaveTabbedSelectorSectionTimeoutMs = 1000;
 constexpr auto kMessagesPerPageFirst = 30;
 constexpr auto kMessagesPerPage = 50;
 constexpr auto kPreloadHeightsCount = 3; // when 3 screens to scroll left make a preload request
+constexpr auto kPreloadHeightsMaxCount = 8; // fast scrolling pushes the preload request up to 8 screens away
+constexpr auto kMessagesPerPageMax = 100; // server limit for messages.getHistory
+constexpr auto kMessagesPerPageAnchored = 2 * kMessagesPerPage; // a jump target gets a default slice on both sides
+constexpr auto kMediaPrefetchHeightsMaxCount = 4; // media downloads start up to 4 screens ahead
+constexpr auto kScrollVelocityLookaheadMs = 1000; // preload the distance the user scrolls in one second
+constexpr auto kScrollVelocityPauseMs = 300; // the scroll is considered stopped after this pause
 constexpr auto kTabbedSelectorToggleTooltipTimeoutMs = 3000;
 constexpr auto kTabbedSelectorToggleTooltipCount = 3;
 constexpr auto kScrollToVoiceAfterScrolledMs = 1000;
@@ -183,6 +189,12 @@ constexpr auto kSkipRepaintWhileScrollMs = 100;
 constexpr auto kShowMembersDropdownTimeoutMs = 300;
 constexpr auto kDisplayEditTimeWarningMs = 300 * 1000;
 constexpr auto kFullDayInMs = 86400 * 1000;
+constexpr auto kMaxFileLoaderWorkers = 4; // each one can hold a large decoded image
+constexpr auto kRelayoutStaleItemsPerTick = 200;
+
+int FileLoaderWorkersCount() {
+	return qBound(1, QThread::idealThreadCount(), kMaxFileLoaderWorkers);
+}
 
 ApiWrap::RequestMessageDataCallback replyEditMessageDataCallback() {
 	return [](ChannelData *channel, MsgId msgId) {
@@ -633,7 +645,7 @@ HistoryWidget::HistoryWidget(QWidget *parent, not_null<Window::Controller*> cont
 , _tabbedSelector(_tabbedPanel->getSelector())
 , _attachDragDocument(this)
 , _attachDragPhoto(this)
-, _fileLoader(this, FileLoaderQueueStopTimeout)
+, _fileLoader(this, FileLoaderQueueStopTimeout, FileLoaderWorkersCount())
 , _topShadow(this, st::shadowFg) {
 	setAcceptDrops(true);
 
@@ -668,6 +680,7 @@ HistoryWidget::HistoryWidget(QWidget *parent, not_null<Window::Controller*> cont
 	connect(Media::Capture::instance(), SIGNAL(error()), this, SLOT(onRecordError()));
 	connect(Media::Capture::instance(), SIGNAL(updated(quint16,qint32)), this, SLOT(onRecordUpdate(quint16,qint32)));
 	connect(Media::Capture::instance(), SIGNAL(done(QByteArray,VoiceWaveform,qint32)), this, SLOT(onRecordDone(QByteArray,VoiceWaveform,qint32)));
+	connect(Media::Capture::instance(), SIGNAL(partReady(QByteArray,qint32)), this, SLOT(onRecordPart(QByteArray,qint32)));
 
 	_attachToggle->setClickedCallback(App::LambdaDelayed(st::historyAttach.ripple.hideDuration, this, [this] {
 		chooseAttach();
@@ -696,6 +709,7 @@ HistoryWidget::HistoryWidget(QWidget *parent, not_null<Window::Controller*> cont
 	_fieldBarCancel->hide();
 
 	_topBar->hide();
+	_scroll->setPaintAheadEnabled(true);
 	_scroll->hide();
 
 	_keyboard = _kbScroll->setOwnedWidget(object_ptr<BotKeyboard>(this));
@@ -1428,16 +1442,28 @@ void HistoryWidget::onRecordError() {
 }
 
 void HistoryWidget::onRecordDone(QByteArray result, VoiceWaveform waveform, qint32 samples) {
-	if (!canWriteMessage() || result.isEmpty()) return;
+	auto streamedId = base::take(_recordingStreamedId);
+	if (!canWriteMessage() || result.isEmpty()) {
+		if (streamedId) {
+			Auth().uploader().cancelStreamed(streamedId);
+		}
+		return;
+	}
 
 	App::wnd()->activateWindow();
 	auto duration = samples / Media::Player::kDefaultFrequency;
 	auto to = FileLoadTo(_peer->id, _silent->checked(), replyToId());
 	auto caption = QString();
-	_fileLoader.addTask(MakeShared<FileLoadTask>(result, duration, waveform, to, caption));
+	_fileLoader.addTask(MakeShared<FileLoadTask>(result, duration, waveform, to, caption, streamedId));
 	cancelReplyAfterMediaSend(lastForceReplyReplied());
 }
 
+void HistoryWidget::onRecordPart(QByteArray part, qint32 index) {
+	if (_recordingStreamedId) {
+		Auth().uploader().streamPart(_recordingStreamedId, index, part);
+	}
+}
+
 void HistoryWidget::onRecordUpdate(quint16 level, qint32 samples) {
 	if (!_recording) {
 		return;
@@ -1867,6 +1893,11 @@ void HistoryWidget::showHistory(const PeerId &peerId, MsgId showAtMsgId, bool re
 		_history = App::history(_peer);
 		_migrated = _history->migrateFrom();
 
+		if (wasHistory) {
+			wasHistory->setLastViewed(getms(true));
+		}
+		App::histories().historyViewed(_history);
+
 		if (_channel) {
 			updateNotifySettings();
 			if (_peer->notify == UnknownNotifySettings) {
@@ -1894,6 +1925,9 @@ void HistoryWidget::showHistory(const PeerId &peerId, MsgId showAtMsgId, bool re
 		pinnedMsgVisibilityUpdated();
 		if (_history->scrollTopItem || (_migrated && _migrated->scrollTopItem) || _history->isReadyFor(_showAtMsgId)) {
 			historyLoaded();
+		} else if (showStoredMessages()) {
+			// Newer messages are requested by preloadHistoryIfNeeded().
+			historyLoaded();
 		} else {
 			firstLoadMessages();
 			doneShow();
@@ -2483,6 +2517,20 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 	}
 }
 
+bool HistoryWidget::showStoredMessages() {
+	if (_migrated || !_history->isEmpty()) {
+		return false;
+	}
+	if (_showAtMsgId == ShowAtUnreadMsgId) {
+		if (_history->unreadCount()) {
+			return false;
+		}
+	} else if (_showAtMsgId != ShowAtTheEndMsgId) {
+		return false;
+	}
+	return Local::readHistoryMessages(_history);
+}
+
 void HistoryWidget::historyLoaded() {
 	countHistoryShowFrom();
 	destroyUnreadBar();
@@ -2541,10 +2589,12 @@ void HistoryWidget::firstLoadMessages() {
 		if (_migrated && _migrated->unreadCount()) {
 			_history->getReadyFor(_showAtMsgId);
 			from = _migrated->peer;
+			loadCount = kMessagesPerPageAnchored;
 			offset = -loadCount / 2;
 			offset_id = _migrated->inboxReadBefore;
 		} else if (_history->unreadCount()) {
 			_history->getReadyFor(_showAtMsgId);
+			loadCount = kMessagesPerPageAnchored;
 			offset = -loadCount / 2;
 			offset_id = _history->inboxReadBefore;
 		} else {
@@ -2555,12 +2605,14 @@ void HistoryWidget::firstLoadMessages() {
 		loadCount = kMessagesPerPageFirst;
 	} else if (_showAtMsgId > 0) {
 		_history->getReadyFor(_showAtMsgId);
+		loadCount = kMessagesPerPageAnchored;
 		offset = -loadCount / 2;
 		offset_id = _showAtMsgId;
 	} else if (_showAtMsgId < 0 && _history->isChannel()) {
 		if (_showAtMsgId < 0 && -_showAtMsgId < ServerMaxMsgId && _migrated) {
 			_history->getReadyFor(_showAtMsgId);
 			from = _migrated->peer;
+			loadCount = kMessagesPerPageAnchored;
 			offset = -loadCount / 2;
 			offset_id = -_showAtMsgId;
 		} else if (_showAtMsgId == SwitchAtTopMsgId) {
@@ -2586,7 +2638,7 @@ void HistoryWidget::loadMessages() {
 
 	auto offset_id = from->minMsgId();
 	auto offset = 0;
-	auto loadCount = offset_id ? kMessagesPerPage : kMessagesPerPageFirst;
+	auto loadCount = offset_id ? preloadMessagesCount(false) : kMessagesPerPageFirst;
 
 	_preloadRequest = MTP::send(MTPmessages_GetHistory(from->peer->input, MTP_int(offset_id), MTP_int(0), MTP_int(offset), MTP_int(loadCount), MTP_int(0), MTP_int(0)), rpcDone(&HistoryWidget::messagesReceived, from->peer), rpcFail(&HistoryWidget::messagesFailed));
 }
@@ -2604,7 +2656,7 @@ void HistoryWidget::loadMessagesDown() {
 		return;
 	}
 
-	auto loadCount = kMessagesPerPage;
+	auto loadCount = preloadMessagesCount(true);
 	auto offset = -loadCount;
 	auto offset_id = from->maxMsgId();
 	if (!offset_id) {
@@ -2629,9 +2681,11 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 	if (_delayedShowAtMsgId == ShowAtUnreadMsgId) {
 		if (_migrated && _migrated->unreadCount()) {
 			from = _migrated->peer;
+			loadCount = kMessagesPerPageAnchored;
 			offset = -loadCount / 2;
 			offset_id = _migrated->inboxReadBefore;
 		} else if (_history->unreadCount()) {
+			loadCount = kMessagesPerPageAnchored;
 			offset = -loadCount / 2;
 			offset_id = _history->inboxReadBefore;
 		} else {
@@ -2640,11 +2694,13 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 	} else if (_delayedShowAtMsgId == ShowAtTheEndMsgId) {
 		loadCount = kMessagesPerPageFirst;
 	} else if (_delayedShowAtMsgId > 0) {
+		loadCount = kMessagesPerPageAnchored;
 		offset = -loadCount / 2;
 		offset_id = _delayedShowAtMsgId;
 	} else if (_delayedShowAtMsgId < 0 && _history->isChannel()) {
 		if (_delayedShowAtMsgId < 0 && -_delayedShowAtMsgId < ServerMaxMsgId && _migrated) {
 			from = _migrated->peer;
+			loadCount = kMessagesPerPageAnchored;
 			offset = -loadCount / 2;
 			offset_id = -_delayedShowAtMsgId;
 		}
@@ -2655,6 +2711,7 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 
 void HistoryWidget::onScroll() {
 	App::checkImageCacheSize();
+	updateScrollVelocity();
 	preloadHistoryIfNeeded();
 	visibleAreaUpdated();
 	if (!_synteticScrollEvent) {
@@ -2678,6 +2735,10 @@ void HistoryWidget::visibleAreaUpdated() {
 	if (_list && !_scroll->isHidden()) {
 		auto scrollTop = _scroll->scrollTop();
 		auto scrollBottom = scrollTop + _scroll->height();
+
+		// Prefetch before the visible area update, so that the prefetched
+		// downloads rank below the ones touched by painting the visible items.
+		prefetchMediaByScroll(scrollTop, scrollBottom);
 		_list->visibleAreaUpdated(scrollTop, scrollBottom);
 		if (_history->loadedAtBottom() && (_history->unreadCount() > 0 || (_migrated && _migrated->unreadCount() > 0))) {
 			auto showFrom = (_migrated && _migrated->showFrom) ? _migrated->showFrom : (_history ? _history->showFrom : nullptr);
@@ -2716,15 +2777,83 @@ void HistoryWidget::preloadHistoryByScroll() {
 
 	auto scrollTop = _scroll->scrollTop();
 	auto scrollTopMax = _scroll->scrollTopMax();
-	auto scrollHeight = _scroll->height();
-	if (scrollTop + kPreloadHeightsCount * scrollHeight >= scrollTopMax) {
+	if (scrollTop + preloadDistance(true) >= scrollTopMax) {
 		loadMessagesDown();
 	}
-	if (scrollTop <= kPreloadHeightsCount * scrollHeight) {
+	if (scrollTop <= preloadDistance(false)) {
 		loadMessages();
 	}
 }
 
+void HistoryWidget::updateScrollVelocity() {
+	auto scrollTop = _scroll->scrollTop();
+	auto ms = getms();
+	auto delta = scrollTop - _scrollVelocityTop;
+	auto elapsed = ms - _scrollVelocityTime;
+	if (_synteticScrollEvent) {
+		// Content insertions and scroll animations don't count as the user scrolling.
+		_scrollVelocityTop = scrollTop;
+		return;
+	} else if (!elapsed) {
+		return;
+	}
+	_scrollVelocityTop = scrollTop;
+	_scrollVelocityTime = ms;
+	if (elapsed > kScrollVelocityPauseMs) {
+		_scrollVelocity = 0.;
+		return;
+	}
+	auto velocity = delta / float64(elapsed);
+	if ((velocity > 0.) == (_scrollVelocity > 0.)) {
+		_scrollVelocity = (_scrollVelocity + velocity) / 2.;
+	} else {
+		_scrollVelocity = velocity;
+	}
+}
+
+float64 HistoryWidget::currentScrollVelocity() const {
+	if (getms() - _scrollVelocityTime > kScrollVelocityPauseMs) {
+		return 0.;
+	}
+	return _scrollVelocity;
+}
+
+int HistoryWidget::preloadDistance(bool down) const {
+	auto scrollHeight = _scroll->height();
+	auto result = kPreloadHeightsCount * scrollHeight;
+	auto velocity = down ? currentScrollVelocity() : -currentScrollVelocity();
+	if (velocity > 0.) {
+		result += qRound(velocity * kScrollVelocityLookaheadMs);
+	}
+	return qMin(result, kPreloadHeightsMaxCount * scrollHeight);
+}
+
+int HistoryWidget::preloadMessagesCount(bool down) const {
+	// The default slice covers the default preload distance, make
+	// the slice bigger in the same proportion as the distance grows.
+	auto defaultDistance = kPreloadHeightsCount * _scroll->height();
+	if (defaultDistance <= 0) {
+		return kMessagesPerPage;
+	}
+	auto result = qRound(kMessagesPerPage * float64(preloadDistance(down)) / defaultDistance);
+	return snap(result, kMessagesPerPage, kMessagesPerPageMax);
+}
+
+void HistoryWidget::prefetchMediaByScroll(int scrollTop, int scrollBottom) {
+	auto velocity = currentScrollVelocity();
+	if (velocity == 0.) {
+		return;
+	}
+	auto scrollHeight = scrollBottom - scrollTop;
+	auto distance = qRound(qAbs(velocity) * kScrollVelocityLookaheadMs);
+	distance = snap(distance, scrollHeight, kMediaPrefetchHeightsMaxCount * scrollHeight);
+	if (velocity > 0.) {
+		_list->prefetchMedia(scrollBottom, scrollBottom + distance);
+	} else {
+		_list->prefetchMedia(scrollTop - distance, scrollTop);
+	}
+}
+
 void HistoryWidget::checkReplyReturns() {
 	if (_firstLoadRequest || _scroll->isHidden() || !_peer) {
 		return;
@@ -3272,6 +3401,10 @@ void HistoryWidget::recordStartCallback() {
 		}
 	}
 
+	if (_recordingStreamedId) {
+		Auth().uploader().cancelStreamed(base::take(_recordingStreamedId));
+	}
+	_recordingStreamedId = rand_value<uint64>();
 	emit Media::Capture::instance()->start();
 
 	_recording = _inField = true;
@@ -3307,6 +3440,9 @@ void HistoryWidget::mouseReleaseEvent(QMouseEvent *e) {
 
 void HistoryWidget::stopRecording(bool send) {
 	emit Media::Capture::instance()->stop(send);
+	if (!send && _recordingStreamedId) {
+		Auth().uploader().cancelStreamed(base::take(_recordingStreamedId));
+	}
 
 	a_recordingLevel = anim::value();
 	_a_recording.stop();
@@ -4463,7 +4599,23 @@ void HistoryWidget::sendFileConfirmed(const FileLoadResultPtr &file) {
 	connect(&Auth().uploader(), SIGNAL(photoFailed(const FullMsgId&)), this, SLOT(onPhotoFailed(const FullMsgId&)), Qt::UniqueConnection);
 	connect(&Auth().uploader(), SIGNAL(documentFailed(const FullMsgId&)), this, SLOT(onDocumentFailed(const FullMsgId&)), Qt::UniqueConnection);
 
-	Auth().uploader().upload(newId, file);
+	auto duplicateId = DocumentId(0);
+	auto duplicateAccessHash = uint64(0);
+	auto duplicate = (file->type == SendMediaType::File)
+		&& !file->contentHash.isEmpty()
+		&& Local::readUploadedFile(file->contentHash, file->filename, &duplicateId, &duplicateAccessHash);
+	if (duplicate) {
+		auto document = file->thumb.isNull() ? App::feedDocument(file->document) : App::feedDocument(file->document, file->thumb);
+		document->status = FileUploading;
+		if (!file->content.isEmpty()) {
+			document->setData(file->content);
+		}
+		if (!file->filepath.isEmpty()) {
+			document->setLocation(FileLocation(file->filepath));
+		}
+	} else {
+		Auth().uploader().upload(newId, file);
+	}
 
 	History *h = App::history(file->to.peer);
 
@@ -4519,9 +4671,56 @@ void HistoryWidget::sendFileConfirmed(const FileLoadResultPtr &file) {
 	App::main()->dialogsToUp();
 	peerMessagesUpdated(file->to.peer);
 
+	if (duplicate) {
+		sendUploadedDuplicate(newId, file, MTP_inputDocument(MTP_long(duplicateId), MTP_long(duplicateAccessHash)));
+	}
+
 	cancelReplyAfterMediaSend(lastKeyboardUsed);
 }
 
+void HistoryWidget::sendUploadedDuplicate(const FullMsgId &newId, const FileLoadResultPtr &file, const MTPInputDocument &document) {
+	if (auto item = App::histItemById(newId)) {
+		auto randomId = rand_value<uint64>();
+		App::historyRegRandom(randomId, newId);
+		auto hist = item->history();
+		auto replyTo = item->replyToId();
+		auto sendFlags = MTPmessages_SendMedia::Flags(0);
+		if (replyTo) {
+			sendFlags |= MTPmessages_SendMedia::Flag::f_reply_to_msg_id;
+		}
+
+		bool channelPost = hist->peer->isChannel() && !hist->peer->isMegagroup();
+		bool silentPost = channelPost && file->to.silent;
+		if (silentPost) {
+			sendFlags |= MTPmessages_SendMedia::Flag::f_silent;
+		}
+		_sendingUploadedDuplicates.insert(newId, file);
+		auto media = MTP_inputMediaDocument(MTP_flags(0), document, MTP_string(file->caption), MTPint());
+		hist->sendRequestId = MTP::send(MTPmessages_SendMedia(MTP_flags(sendFlags), hist->peer->input, MTP_int(replyTo), media, MTP_long(randomId), MTPnullMarkup), rpcDone(&HistoryWidget::uploadedDuplicateSent, newId), rpcFail(&HistoryWidget::uploadedDuplicateFailed, newId), 0, 0, hist->sendRequestId);
+	}
+}
+
+void HistoryWidget::uploadedDuplicateSent(FullMsgId newId, const MTPUpdates &updates) {
+	_sendingUploadedDuplicates.remove(newId);
+	App::main()->sentUpdatesReceived(updates);
+}
+
+bool HistoryWidget::uploadedDuplicateFailed(FullMsgId newId, const RPCError &error) {
+	if (MTP::isDefaultHandledError(error)) return false;
+
+	auto file = _sendingUploadedDuplicates.take(newId);
+	if (App::main()->sendMessageFail(error) || !file) {
+		return true;
+	}
+
+	// The server doesn't accept the old document any more, upload it again.
+	Local::removeUploadedFile(file->contentHash);
+	if (App::histItemById(newId)) {
+		Auth().uploader().upload(newId, file);
+	}
+	return true;
+}
+
 void HistoryWidget::onPhotoUploaded(const FullMsgId &newId, bool silent, const MTPInputFile &file) {
 	if (auto item = App::histItemById(newId)) {
 		uint64 randomId = rand_value<uint64>();
@@ -4737,6 +4936,10 @@ void HistoryWidget::grabFinish() {
 }
 
 void HistoryWidget::ui_repaintHistoryItem(not_null<const HistoryItem*> item) {
+	if (Global::BackgroundMode()) {
+		// The whole window is repainted when it leaves the background mode.
+		return;
+	}
 	if (_peer && _list && (item->history() == _history || (_migrated && item->history() == _migrated))) {
 		auto ms = getms();
 		if (_lastScrolled + kSkipRepaintWhileScrollMs <= ms) {
@@ -5022,6 +5225,9 @@ void HistoryWidget::updateHistoryGeometry(bool initial, bool loadedDown, const S
 
 void HistoryWidget::updateListSize() {
 	_list->recountHeight();
+	if (_list->hasStaleItems()) {
+		_relayoutStaleItems.call();
+	}
 	auto washidden = _scroll->isHidden();
 	if (washidden) {
 		_scroll->show();
@@ -5033,6 +5239,18 @@ void HistoryWidget::updateListSize() {
 	_updateHistoryGeometryRequired = true;
 }
 
+void HistoryWidget::relayoutStaleItems() {
+	if (!_list || !_list->hasStaleItems()) {
+		return;
+	}
+	_list->relayoutStaleItems(kRelayoutStaleItemsPerTick);
+
+	// Restores the scroll position from the scrollTopItem and
+	// schedules the next portion in updateListSize() if needed.
+	updateHistoryGeometry();
+	_list->update();
+}
+
 int HistoryWidget::unreadBarTop() const {
 	auto getUnreadBar = [this]() -> HistoryItem* {
 		if (_migrated && _migrated->unreadBar) {
@@ -6100,9 +6318,9 @@ void HistoryWidget::handlePeerUpdate() {
 	updateHistoryGeometry();
 	if (_peer->isChannel()) updateReportSpamStatus();
 	if (_peer->isChat() && _peer->asChat()->noParticipantInfo()) {
-		Auth().api().requestFullPeer(_peer);
+		_peer->updateFull();
 	} else if (_peer->isUser() && (_peer->asUser()->blockStatus() == UserData::BlockStatus::Unknown || _peer->asUser()->callsStatus() == UserData::CallsStatus::Unknown)) {
-		Auth().api().requestFullPeer(_peer);
+		_peer->updateFull();
 	} else if (_peer->isMegagroup() && !_peer->asChannel()->mgInfo->botStatus) {
 		Auth().api().requestBots(_peer->asChannel());
 	}
@@ -6644,8 +6862,7 @@ void HistoryWidget::paintEvent(QPaintEvent *e) {
 				}
 			}
 		} else {
-			PainterHighQualityEnabler hq(p);
-
+			// Fast scaling here, the smooth one is prepared by cachedBackground().
 			auto &pix = Window::Theme::Background()->pixmap();
 			QRect to, from;
 			Window::Theme::ComputeBackgroundRects(fill, pix.size(), to, from);
@@ -453,6 +453,7 @@ public slots:
 	void onRecordError();
 	void onRecordDone(QByteArray result, VoiceWaveform waveform, qint32 samples);
 	void onRecordUpdate(quint16 level, qint32 samples);
+	void onRecordPart(QByteArray part, qint32 index);
 
 	void onUpdateHistoryItems();
 
@@ -602,6 +603,12 @@ private:
 	// destroys _history and _migrated unread bars
 	void destroyUnreadBar();
 
+	// Documents that were uploaded already are sent by their server document.
+	void sendUploadedDuplicate(const FullMsgId &newId, const FileLoadResultPtr &file, const MTPInputDocument &document);
+	void uploadedDuplicateSent(FullMsgId newId, const MTPUpdates &updates);
+	bool uploadedDuplicateFailed(FullMsgId newId, const RPCError &error);
+	QMap<FullMsgId, FileLoadResultPtr> _sendingUploadedDuplicates;
+
 	mtpRequestId _saveEditMsgRequestId = 0;
 	void saveEditMsg();
 	void saveEditMsgDone(History *history, const MTPUpdates &updates, mtpRequestId req);
@@ -659,6 +666,7 @@ private:
 	};
 	void updateHistoryGeometry(bool initial = false, bool loadedDown = false, const ScrollChange &change = { ScrollChangeNone, 0 });
 	void updateListSize();
+	void relayoutStaleItems();
 
 	// Does any of the shown histories has this flag set.
 	bool hasPendingResizedItems() const {
@@ -689,6 +697,7 @@ private:
 	bool joinFail(const RPCError &error, mtpRequestId req);
 
 	void countHistoryShowFrom();
+	bool showStoredMessages();
 
 	enum class TextUpdateEvent {
 		SaveDraft  = 0x01,
@@ -717,6 +726,15 @@ private:
 	int countAutomaticScrollTop();
 	void preloadHistoryByScroll();
 	void checkReplyReturns();
+
+	// Scroll speed in pixels per millisecond, positive when scrolling down.
+	void updateScrollVelocity();
+	float64 currentScrollVelocity() const;
+
+	// Preload distance and slice size grow with the scroll speed in their direction.
+	int preloadDistance(bool down) const;
+	int preloadMessagesCount(bool down) const;
+	void prefetchMediaByScroll(int scrollTop, int scrollBottom);
 	void scrollToAnimationCallback(FullMsgId attachToId);
 
 	bool readyToForward() const;
@@ -748,9 +766,13 @@ private:
 	int _lastScrollTop = 0; // gifs optimization
 	TimeMs _lastScrolled = 0;
 	QTimer _updateHistoryItems;
+	SingleQueuedInvokation _relayoutStaleItems = { [this] { relayoutStaleItems(); } };
 
 	TimeMs _lastUserScrolled = 0;
 	bool _synteticScrollEvent = false;
+	float64 _scrollVelocity = 0.;
+	int _scrollVelocityTop = 0;
+	TimeMs _scrollVelocityTime = 0;
 	Animation _scrollToAnimation;
 
 	Animation _historyDownShown;
@@ -804,6 +826,7 @@ private:
 	bool _inPinnedMsg = false;
 	bool _inClickable = false;
 	int _recordingSamples = 0;
+	uint64 _recordingStreamedId = 0; // upload id of the parts sent while recording
 	int _recordCancelWidth;
 
 	// This can animate for a very long time (like in music playing),
@@ -36,6 +36,14 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 namespace InlineBots {
 namespace Layout {
 namespace internal {
+namespace {
+
+constexpr auto kMaxActiveGifReaders = 12;
+
+// Gifs with a live reader, the most recently painted one is the last.
+NeverFreedPointer<std::vector<Gif*>> ActiveGifs;
+
+} // namespace
 
 FileBase::FileBase(not_null<Context*> context, Result *result) : ItemBase(context, result) {
 }
@@ -117,10 +125,53 @@ void Gif::initDimensions() {
 void Gif::setPosition(int32 position) {
 	ItemBase::setPosition(position);
 	if (_position < 0) {
-		_gif.reset();
+		releaseReader(false);
+	}
+}
+
+void Gif::markReaderActive() const {
+	ActiveGifs.createIfNull();
+	auto that = const_cast<Gif*>(this);
+	auto &active = *ActiveGifs;
+	auto i = std::find(active.begin(), active.end(), that);
+	if (i != active.end()) {
+		if (i + 1 != active.end()) {
+			std::rotate(i, i + 1, active.end());
+		}
+		return;
+	}
+	active.push_back(that);
+	for (auto j = active.begin(); j != active.end() && int(active.size()) > kMaxActiveGifReaders;) {
+		auto gif = *j;
+		if (gif == that || gif->context()->inlineItemVisible(gif)) {
+			++j;
+			continue;
+		}
+		j = active.erase(j);
+		gif->releaseReader(true);
 	}
 }
 
+void Gif::releaseReader(bool keepFrame) {
+	if (!_gif) {
+		return;
+	}
+	if (keepFrame && _gif->started()) {
+		auto height = st::inlineMediaHeight;
+		auto frame = countFrameSize();
+		_thumb = _gif->current(frame.width(), frame.height(), _width, height, ImageRoundRadius::None, ImageRoundCorner::None, 0);
+	}
+	_gif.reset();
+	if (ActiveGifs) {
+		auto &active = *ActiveGifs;
+		active.erase(std::remove(active.begin(), active.end(), this), active.end());
+	}
+}
+
+Gif::~Gif() {
+	releaseReader(false);
+}
+
 void DeleteSavedGifClickHandler::onClickImpl() const {
 	auto index = cSavedGifs().indexOf(_data);
 	if (index >= 0) {
@@ -144,6 +195,9 @@ void Gif::paint(Painter &p, const QRect &clip, const PaintContext *context) cons
 		});
 		if (_gif) _gif->setAutoplay();
 	}
+	if (_gif) {
+		markReaderActive();
+	}
 
 	bool animating = (_gif && _gif->started());
 	if (displayLoading) {
@@ -342,7 +396,7 @@ void Gif::clipCallback(Media::Clip::Notification notification) {
 				auto frame = countFrameSize();
 				_gif->start(frame.width(), frame.height(), _width, height, ImageRoundRadius::None, ImageRoundCorner::None);
 			} else if (_gif->autoPausedGif() && !context()->inlineItemVisible(this)) {
-				_gif.reset();
+				releaseReader(false);
 				getShownDocument()->forget();
 			}
 		}
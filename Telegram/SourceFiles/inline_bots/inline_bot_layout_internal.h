@@ -78,9 +78,16 @@ public:
 	// ClickHandlerHost interface
 	void clickHandlerActiveChanged(const ClickHandlerPtr &p, bool active) override;
 
+	~Gif();
+
 private:
 	QSize countFrameSize() const;
 
+	// Only a few readers are kept alive at once, the least recently painted
+	// invisible ones are released and show their last frame instead.
+	void markReaderActive() const;
+	void releaseReader(bool keepFrame);
+
 	enum class StateFlag {
 		Over = 0x01,
 		DeleteOver = 0x02,
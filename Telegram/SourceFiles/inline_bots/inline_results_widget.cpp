@@ -45,6 +45,7 @@ namespace internal {
 namespace {
 
 constexpr auto kInlineBotRequestDelay = 400;
+constexpr auto kStashedInlineCachesLimit = 4;
 
 } // namespace
 
@@ -1001,9 +1002,9 @@ void Widget::inlineBotChanged() {
 	if (_inlineRequestId) MTP::cancel(_inlineRequestId);
 	_inlineRequestId = 0;
 	_inlineQuery = _inlineNextQuery = _inlineNextOffset = QString();
-	_inlineBot = nullptr;
-	_inlineCache.clear();
+	auto bot = base::take(_inlineBot);
 	_inner->inlineBotChanged();
+	stashInlineCache(bot);
 	_inner->hideInlineRowsPanel();
 
 	Notify::inlineBotRequesting(false);
@@ -1022,6 +1023,7 @@ void Widget::inlineResultsDone(const MTPmessages_BotResults &result) {
 
 		if (it == _inlineCache.cend()) {
 			it = _inlineCache.emplace(_inlineQuery, std::make_unique<internal::CacheEntry>()).first;
+			it->second->validTill = unixtime() + d.vcache_time.v;
 		}
 		auto entry = it->second.get();
 		entry->nextOffset = qs(d.vnext_offset);
@@ -1055,12 +1057,44 @@ void Widget::inlineResultsDone(const MTPmessages_BotResults &result) {
 	onScroll();
 }
 
+void Widget::stashInlineCache(not_null<UserData*> bot) {
+	if (_inlineCache.empty()) {
+		return;
+	}
+	_stashedInlineCaches.emplace_back(bot, base::take(_inlineCache));
+	if (_stashedInlineCaches.size() > size_t(internal::kStashedInlineCachesLimit)) {
+		_stashedInlineCaches.erase(_stashedInlineCaches.begin());
+	}
+}
+
+void Widget::restoreInlineCache(not_null<UserData*> bot) {
+	auto it = std::find_if(_stashedInlineCaches.begin(), _stashedInlineCaches.end(), [bot](auto &stashed) {
+		return (stashed.first == bot);
+	});
+	if (it == _stashedInlineCaches.end()) {
+		return;
+	}
+	_inlineCache = std::move(it->second);
+	_stashedInlineCaches.erase(it);
+
+	// The rows panel is empty now, so expired results can be destroyed.
+	auto now = unixtime();
+	for (auto i = _inlineCache.begin(); i != _inlineCache.end();) {
+		if (i->second->validTill <= now) {
+			i = _inlineCache.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
 void Widget::queryInlineBot(UserData *bot, PeerData *peer, QString query) {
 	bool force = false;
 	_inlineQueryPeer = peer;
 	if (bot != _inlineBot) {
 		inlineBotChanged();
 		_inlineBot = bot;
+		restoreInlineCache(bot);
 		force = true;
 		//if (_inlineBot->isBotInlineGeo()) {
 		//	Ui::show(Box<InformBox>(lang(lng_bot_inline_geo_unavailable)));
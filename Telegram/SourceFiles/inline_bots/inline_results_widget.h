@@ -54,6 +54,7 @@ constexpr int kInlineItemsMaxPerRow = 5;
 using Results = std::vector<std::unique_ptr<Result>>;
 
 struct CacheEntry {
+	TimeId validTill = 0;
 	QString nextOffset;
 	QString switchPmText, switchPmStartToken;
 	Results results;
@@ -240,6 +241,10 @@ private:
 	bool refreshInlineRows(int *added = nullptr);
 	void inlineResultsDone(const MTPmessages_BotResults &result);
 
+	using InlineCache = std::map<QString, std::unique_ptr<internal::CacheEntry>>;
+	void stashInlineCache(not_null<UserData*> bot);
+	void restoreInlineCache(not_null<UserData*> bot);
+
 	not_null<Window::Controller*> _controller;
 
 	int _contentMaxHeight = 0;
@@ -261,7 +266,10 @@ private:
 	object_ptr<Ui::ScrollArea> _scroll;
 	QPointer<internal::Inner> _inner;
 
-	std::map<QString, std::unique_ptr<internal::CacheEntry>> _inlineCache;
+	InlineCache _inlineCache;
+
+	// Results of the recently used bots, the most recent one is the last.
+	std::vector<std::pair<not_null<UserData*>, InlineCache>> _stashedInlineCaches;
 	QTimer _inlineRequestTimer;
 
 	UserData *_inlineBot = nullptr;
@@ -187,7 +187,7 @@ void CloudManager::applyLangPackData(const MTPDlangPackDifference &data) {
 		requestLangPackDifference();
 	} else if (!data.vstrings.v.isEmpty()) {
 		_langpack.applyDifference(data);
-		Local::writeLangPack();
+		Local::writeLangPackDifference();
 	} else {
 		LOG(("Lang Info: Up to date."));
 	}
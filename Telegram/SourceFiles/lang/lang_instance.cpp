@@ -33,6 +33,51 @@ namespace {
 
 constexpr auto kDefaultLanguage = str_const("en");
 constexpr auto kLangValuesLimit = 20000;
+constexpr auto kLangOverlayLimit = 1000;
+
+// Compiled values are the parsed non-default values in the order of the
+// serialized key-value pairs: qint32 count, count entries and then the
+// UTF-16 characters of all values. The tag indices inside the parsed
+// values may change between versions, so they are compiled for AppVersion.
+struct CompiledEntry {
+	qint32 offset = 0; // in chars
+	qint32 length = -1; // -1 if the value was not parsed
+};
+
+QByteArray CompileValues(const std::map<QByteArray, QByteArray> &nonDefaultValues, const std::vector<QString> &values, const std::vector<uchar> &nonDefaultSet) {
+	auto entries = std::vector<CompiledEntry>();
+	entries.reserve(nonDefaultValues.size());
+	auto chars = 0;
+	for (auto &nonDefault : nonDefaultValues) {
+		auto entry = CompiledEntry();
+		auto keyIndex = GetKeyIndex(QLatin1String(nonDefault.first));
+		if (keyIndex != kLangKeysCount && nonDefaultSet[keyIndex]) {
+			entry.offset = chars;
+			entry.length = values[keyIndex].size();
+			chars += entry.length;
+		}
+		entries.push_back(entry);
+	}
+
+	auto count = qint32(entries.size());
+	auto headerSize = int(sizeof(count) + entries.size() * sizeof(CompiledEntry));
+	auto result = QByteArray(headerSize + chars * int(sizeof(QChar)), Qt::Uninitialized);
+	auto data = result.data();
+	memcpy(data, &count, sizeof(count));
+	if (count > 0) {
+		memcpy(data + sizeof(count), entries.data(), entries.size() * sizeof(CompiledEntry));
+	}
+	auto characters = reinterpret_cast<QChar*>(data + headerSize);
+	auto index = 0;
+	for (auto &nonDefault : nonDefaultValues) {
+		auto &entry = entries[index++];
+		if (entry.length > 0) {
+			auto keyIndex = GetKeyIndex(QLatin1String(nonDefault.first));
+			memcpy(characters + entry.offset, values[keyIndex].constData(), entry.length * sizeof(QChar));
+		}
+	}
+	return result;
+}
 
 class ValueParser {
 public:
@@ -200,6 +245,10 @@ void Instance::reset() {
 	_values.clear();
 	_nonDefaultValues.clear();
 	_nonDefaultSet.clear();
+	if (!_compiled.isEmpty()) {
+		_retiredCompiled.push_back(base::take(_compiled));
+	}
+	clearOverlay();
 	_legacyId = kLegacyLanguageNone;
 	_customFilePathAbsolute = QString();
 	_customFilePathRelative = QString();
@@ -241,6 +290,45 @@ QString Instance::cloudLangCode() const {
 	return id();
 }
 
+bool Instance::loadCompiledValues(const QByteArray &compiled, const std::vector<QByteArray> &nonDefaultStrings) {
+	auto count = qint32(0);
+	if (compiled.size() < int(sizeof(count))) {
+		return false;
+	}
+	memcpy(&count, compiled.constData(), sizeof(count));
+	if (count * 2 != int(nonDefaultStrings.size())) {
+		return false;
+	}
+	auto headerSize = int(sizeof(count) + count * sizeof(CompiledEntry));
+	if (compiled.size() < headerSize) {
+		return false;
+	}
+	auto chars = (compiled.size() - headerSize) / int(sizeof(QChar));
+	auto entries = reinterpret_cast<const CompiledEntry*>(compiled.constData() + sizeof(count));
+	for (auto i = 0; i != count; ++i) {
+		auto &entry = entries[i];
+		if (entry.length >= 0 && (entry.offset < 0 || entry.offset > chars - entry.length)) {
+			return false;
+		}
+	}
+
+	// Values are referenced in place, _compiled keeps the characters.
+	_compiled = compiled;
+	auto characters = reinterpret_cast<const QChar*>(_compiled.constData() + headerSize);
+	for (auto i = 0; i != count; ++i) {
+		auto &key = nonDefaultStrings[2 * i];
+		_nonDefaultValues[key] = nonDefaultStrings[2 * i + 1];
+
+		auto &entry = entries[i];
+		auto keyIndex = GetKeyIndex(QLatin1String(key));
+		if (entry.length >= 0 && keyIndex != kLangKeysCount) {
+			_values[keyIndex] = QString::fromRawData(characters + entry.offset, entry.length);
+			_nonDefaultSet[keyIndex] = 1;
+		}
+	}
+	return true;
+}
+
 QByteArray Instance::serialize() const {
 	auto size = Serialize::stringSize(_id);
 	size += sizeof(qint32); // version
@@ -250,6 +338,8 @@ QByteArray Instance::serialize() const {
 	for (auto &nonDefault : _nonDefaultValues) {
 		size += Serialize::bytearraySize(nonDefault.first) + Serialize::bytearraySize(nonDefault.second);
 	}
+	auto compiled = CompileValues(_nonDefaultValues, _values, _nonDefaultSet);
+	size += sizeof(qint32) + Serialize::bytearraySize(compiled);
 
 	auto result = QByteArray();
 	result.reserve(size);
@@ -262,6 +352,7 @@ QByteArray Instance::serialize() const {
 		for (auto &nonDefault : _nonDefaultValues) {
 			stream << nonDefault.first << nonDefault.second;
 		}
+		stream << qint32(AppVersion) << compiled;
 	}
 	return result;
 }
@@ -309,18 +400,113 @@ void Instance::fillFromSerialized(const QByteArray &data) {
 		nonDefaultStrings.push_back(value);
 	}
 
+	// Packs written by the older versions don't have the compiled values.
+	auto compiledVersion = qint32(0);
+	auto compiled = QByteArray();
+	if (!stream.atEnd()) {
+		stream >> compiledVersion >> compiled;
+		if (stream.status() != QDataStream::Ok) {
+			compiledVersion = 0;
+		}
+	}
+
 	_id = id;
 	_version = version;
 	_customFilePathAbsolute = customFilePathAbsolute;
 	_customFilePathRelative = customFilePathRelative;
 	_customFileContent = customFileContent;
-	LOG(("Lang Info: Loaded cached, keys: %1").arg(nonDefaultValuesCount));
-	for (auto i = 0, count = nonDefaultValuesCount * 2; i != count; i += 2) {
-		applyValue(nonDefaultStrings[i], nonDefaultStrings[i + 1]);
+	if (compiledVersion == AppVersion && loadCompiledValues(compiled, nonDefaultStrings)) {
+		LOG(("Lang Info: Loaded cached compiled, keys: %1").arg(nonDefaultValuesCount));
+	} else {
+		LOG(("Lang Info: Loaded cached, keys: %1").arg(nonDefaultValuesCount));
+		for (auto i = 0, count = nonDefaultValuesCount * 2; i != count; i += 2) {
+			applyValue(nonDefaultStrings[i], nonDefaultStrings[i + 1]);
+		}
 	}
 	updatePluralRules();
 }
 
+QByteArray Instance::serializeOverlay() const {
+	auto size = int(sizeof(qint32) * 3); // base version, version, _overlay.size()
+	for (auto &value : _overlay) {
+		size += Serialize::bytearraySize(value.first) + sizeof(qint8);
+		if (value.second) {
+			size += Serialize::bytearraySize(*value.second);
+		}
+	}
+
+	auto result = QByteArray();
+	result.reserve(size);
+	{
+		QDataStream stream(&result, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream << qint32(_overlayBaseVersion) << qint32(_version) << qint32(_overlay.size());
+		for (auto &value : _overlay) {
+			stream << value.first;
+			if (value.second) {
+				stream << qint8(1) << *value.second;
+			} else {
+				stream << qint8(0);
+			}
+		}
+	}
+	return result;
+}
+
+bool Instance::fillOverlayFromSerialized(const QByteArray &data) {
+	QDataStream stream(data);
+	stream.setVersion(QDataStream::Qt_5_1);
+	qint32 baseVersion = 0, version = 0, count = 0;
+	stream >> baseVersion >> version >> count;
+	if (stream.status() != QDataStream::Ok) {
+		LOG(("Lang Error: Could not read data from serialized langpack overlay."));
+		return false;
+	} else if (baseVersion != _version || count < 0 || count > kLangOverlayLimit) {
+		LOG(("Lang Error: Bad langpack overlay, base version %1, version %2, values %3.").arg(baseVersion).arg(_version).arg(count));
+		return false;
+	}
+
+	auto overlay = std::map<QByteArray, base::optional<QByteArray>>();
+	for (auto i = 0; i != count; ++i) {
+		auto key = QByteArray();
+		auto set = qint8(0);
+		stream >> key >> set;
+		if (set) {
+			auto value = QByteArray();
+			stream >> value;
+			overlay.emplace(key, value);
+		} else {
+			overlay.emplace(key, base::none);
+		}
+		if (stream.status() != QDataStream::Ok) {
+			LOG(("Lang Error: Could not read data from serialized langpack overlay."));
+			return false;
+		}
+	}
+
+	for (auto &value : overlay) {
+		if (value.second) {
+			applyValue(value.first, *value.second);
+		} else {
+			resetValue(value.first);
+		}
+	}
+	_overlay = std::move(overlay);
+	_overlayBaseVersion = baseVersion;
+	_version = version;
+	LOG(("Lang Info: Loaded cached overlay, keys: %1").arg(count));
+	return true;
+}
+
+bool Instance::overlayTooLarge() const {
+	return (_overlay.size() > kLangOverlayLimit);
+}
+
+void Instance::clearOverlay() {
+	_overlay.clear();
+	_overlayBaseVersion = 0;
+}
+
 void Instance::loadFromContent(const QByteArray &content) {
 	Lang::FileParser loader(content, [this](QLatin1String key, const QByteArray &value) {
 		applyValue(QByteArray(key.data(), key.size()), value);
@@ -422,12 +608,17 @@ void Instance::applyDifference(const MTPDlangPackDifference &difference) {
 	Expects(isValidUpdate);
 	Expects(difference.vfrom_version.v <= _version);
 
+	if (_overlay.empty()) {
+		_overlayBaseVersion = _version;
+	}
 	_version = difference.vversion.v;
 	for_const (auto &mtpString, difference.vstrings.v) {
 		HandleString(mtpString, [this](auto &&key, auto &&value) {
 			applyValue(key, value);
+			_overlay[key] = value;
 		}, [this](auto &&key) {
 			resetValue(key);
+			_overlay[key] = base::none;
 		});
 	}
 	_updated.notify();
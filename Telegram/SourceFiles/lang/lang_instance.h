@@ -78,6 +78,13 @@ public:
 	void fillFromSerialized(const QByteArray &data);
 	void fillFromLegacy(int legacyId, const QString &legacyPath);
 
+	// The differences applied after the last serialize() are kept as an
+	// overlay, so that they can be written without rewriting the whole pack.
+	QByteArray serializeOverlay() const;
+	bool fillOverlayFromSerialized(const QByteArray &data);
+	bool overlayTooLarge() const;
+	void clearOverlay();
+
 	void applyDifference(const MTPDlangPackDifference &difference);
 	static std::map<LangKey, QString> ParseStrings(const MTPVector<MTPLangPackString> &strings);
 	base::Observable<void> &updated() {
@@ -106,6 +113,7 @@ private:
 	template <typename Result>
 	static LangKey ParseKeyValue(const QByteArray &key, const QByteArray &value, Result &result);
 
+	bool loadCompiledValues(const QByteArray &compiled, const std::vector<QByteArray> &nonDefaultStrings);
 	void applyValue(const QByteArray &key, const QByteArray &value);
 	void resetValue(const QByteArray &key);
 	void reset();
@@ -129,6 +137,15 @@ private:
 	std::vector<uchar> _nonDefaultSet;
 	std::map<QByteArray, QByteArray> _nonDefaultValues;
 
+	// Parsed values of the serialized pack, _values point inside of it.
+	// The replaced ones are never freed: lang() results may still use them.
+	QByteArray _compiled;
+	std::vector<QByteArray> _retiredCompiled;
+
+	// Empty optional means the value was reset to the default one.
+	std::map<QByteArray, base::optional<QByteArray>> _overlay;
+	int _overlayBaseVersion = 0;
+
 };
 
 } // namespace Lang
@@ -25,6 +25,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "platform/platform_specific.h"
 #include "mtproto/connection.h"
+#include "base/mpsc_ring.h"
 
 #ifndef TDESKTOP_DISABLE_CRASH_REPORTS
 
@@ -51,6 +52,14 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #endif // !TDESKTOP_DISABLE_CRASH_REPORTS
 
+namespace {
+
+constexpr auto kLogsQueueSize = 8192;
+constexpr auto kLogsWakeQueueSize = kLogsQueueSize / 2;
+constexpr auto kLogsWriteDelay = 100; // ms between the debug logs writes
+
+} // namespace
+
 enum LogDataType {
 	LogDataMain,
 	LogDataDebug,
@@ -270,6 +279,85 @@ private:
 
 LogsDataFields *LogsData = 0;
 
+// Debug, tcp and mtp logs are written by a separate thread in batches,
+// so the logging threads don't wait for each other and for the disk.
+// When the queue overflows the oldest entries are dropped.
+class LogsWriter : public QThread {
+public:
+	LogsWriter() : _queue(kLogsQueueSize) {
+	}
+
+	void put(LogDataType type, const QString &msg) {
+		const auto dropped = _queue.push_dropping_oldest({ type, msg });
+		if (dropped) {
+			_dropped += int(dropped);
+		}
+		if (_queue.size() >= kLogsWakeQueueSize && !_wakeRequested.exchange(true)) {
+			_wake.release();
+		}
+	}
+
+	void stop() {
+		_stopping = true;
+		_wake.release();
+		wait();
+	}
+
+protected:
+	void run() override {
+		while (!_stopping) {
+			_wake.tryAcquire(1, kLogsWriteDelay);
+			_wakeRequested = false;
+			writeQueued();
+		}
+		writeQueued();
+	}
+
+private:
+	struct Entry {
+		LogDataType type = LogDataDebug;
+		QString msg;
+	};
+
+	void writeQueued() {
+		QString batches[LogDataCount];
+		if (const auto dropped = _dropped.exchange(0)) {
+			batches[LogDataDebug] = QString("%1 WARNING: %2 log entries dropped!\n").arg(_logsEntryStart()).arg(dropped);
+		}
+		auto entry = Entry();
+		while (_queue.pop(entry)) {
+			batches[entry.type] += entry.msg;
+		}
+		for (auto type = 0; type != LogDataCount; ++type) {
+			if (!batches[type].isEmpty()) {
+				LogsData->write(LogDataType(type), batches[type]);
+			}
+		}
+	}
+
+	base::mpsc_ring<Entry> _queue;
+	std::atomic<int> _dropped = { 0 };
+	std::atomic<bool> _wakeRequested = { false };
+	std::atomic<bool> _stopping = { false };
+	QSemaphore _wake;
+
+};
+
+LogsWriter *LogsWriterInstance = nullptr;
+
+void _logsStartWriter() {
+	Assert(LogsWriterInstance == nullptr);
+	LogsWriterInstance = new LogsWriter();
+	LogsWriterInstance->start();
+}
+
+void _logsStopWriter() {
+	if (LogsWriterInstance) {
+		LogsWriterInstance->stop();
+		delete base::take(LogsWriterInstance);
+	}
+}
+
 typedef QList<QPair<LogDataType, QString> > LogsInMemoryList;
 LogsInMemoryList *LogsInMemory = 0;
 LogsInMemoryList *DeletedLogsInMemory = SharedMemoryLocation<LogsInMemoryList, 0>();
@@ -278,7 +366,11 @@ QString LogsBeforeSingleInstanceChecked; // LogsInMemory already dumped in LogsD
 
 void _logsWrite(LogDataType type, const QString &msg) {
 	if (LogsData && (type == LogDataMain || LogsStartIndexChosen < 0)) {
-		if (type == LogDataMain || cDebug()) {
+		if (type != LogDataMain && LogsWriterInstance) {
+			if (cDebug()) {
+				LogsWriterInstance->put(type, msg);
+			}
+		} else if (type == LogDataMain || cDebug()) {
 			LogsData->write(type, msg);
 		}
 	} else if (LogsInMemory != DeletedLogsInMemory) {
@@ -399,6 +491,7 @@ namespace Logs {
 	}
 
 	void finish() {
+		_logsStopWriter();
 		delete LogsData;
 		LogsData = 0;
 
@@ -427,6 +520,7 @@ namespace Logs {
 			LOG(("FATAL: Could not move logging to '%1'!").arg(_logsFilePath(LogDataMain)));
 			return false;
 		}
+		_logsStartWriter();
 
 		if (LogsInMemory) {
 			Assert(LogsInMemory != DeletedLogsInMemory);
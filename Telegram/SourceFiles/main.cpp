@@ -21,8 +21,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "application.h"
 #include "platform/platform_specific.h"
 #include "storage/localstorage.h"
+#include "core/startup_timeline.h"
 
 int main(int argc, char *argv[]) {
+	StartupTimeline::Start();
+
 #ifndef Q_OS_MAC // Retina display support is working fine, others are not.
 	QCoreApplication::setAttribute(Qt::AA_DisableHighDpiScaling, true);
 #endif // Q_OS_MAC
@@ -38,6 +41,7 @@ int main(int argc, char *argv[]) {
 	// both are finished in Application::closeApplication
 	Logs::start(); // must be started before Platform is started
 	Platform::start(); // must be started before QApplication is created
+	StartupTimeline::Mark("Platform start");
 
 	int result = 0;
 	{
@@ -45,6 +49,9 @@ int main(int argc, char *argv[]) {
 		result = app.exec();
 	}
 
+	if (!result && StartupTimeline::BudgetExceeded()) {
+		result = 1;
+	}
 	DEBUG_LOG(("Telegram finished, result: %1").arg(result));
 
 #ifndef TDESKTOP_DISABLE_AUTOUPDATE
@@ -64,6 +64,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "base/qthelp_regex.h"
 #include "base/qthelp_url.h"
 #include "base/flat_set.h"
+#include "base/task_queue.h"
 #include "window/themes/window_theme.h"
 #include "window/player_wrap_widget.h"
 #include "styles/style_boxes.h"
@@ -74,10 +75,16 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "window/window_controller.h"
 #include "calls/calls_instance.h"
 #include "calls/calls_top_bar.h"
+#include "core/startup_timeline.h"
 
 namespace {
 
 constexpr auto kSaveFloatPlayerPositionTimeoutMs = TimeMs(1000);
+constexpr auto kDifferenceChunkSize = 200;
+constexpr auto kDifferenceShowProgressSize = 2000;
+constexpr auto kChannelDifferenceRequestsLimit = 5; // getChannelDifference requests sent at once, the open chat doesn't wait
+constexpr auto kSendMediaReadTimeout = 300; // send readMessageContents for all items read in 0.3 secs together
+constexpr auto kViewsIncrementCanWait = 5; // getMessagesViews for all channels go out in one container
 
 MTPMessagesFilter TypeToMediaFilter(MediaOverviewType &type) {
 	switch (type) {
@@ -166,6 +173,7 @@ MainWidget::MainWidget(QWidget *parent, not_null<Window::Controller*> controller
 
 	connect(&_updateMutedTimer, SIGNAL(timeout()), this, SLOT(onUpdateMuted()));
 	connect(&_viewsIncrementTimer, SIGNAL(timeout()), this, SLOT(onViewsIncrement()));
+	connect(&_mediaMarkReadTimer, SIGNAL(timeout()), this, SLOT(onMediaMarkReadSend()));
 
 	_webPageOrGameUpdater.setSingleShot(true);
 	connect(&_webPageOrGameUpdater, SIGNAL(timeout()), this, SLOT(webPagesOrGamesUpdate()));
@@ -1349,12 +1357,32 @@ void MainWidget::onCacheBackground() {
 	} else {
 		auto &bg = Window::Theme::Background()->pixmap();
 
+		// Smooth scaling of a large background is slow, do it in a worker
+		// and use the fast scaled background until the result is ready.
 		QRect to, from;
 		Window::Theme::ComputeBackgroundRects(_willCacheFor, bg.size(), to, from);
-		_cachedX = to.x();
-		_cachedY = to.y();
-		_cachedBackground = App::pixmapFromImageInPlace(bg.toImage().copy(from).scaled(to.width() * cIntRetinaFactor(), to.height() * cIntRetinaFactor(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
-		_cachedBackground.setDevicePixelRatio(cRetinaFactor());
+		auto requestId = ++_cachingBackgroundRequestId;
+		auto cacheFor = _willCacheFor;
+		auto ready = base::lambda_guarded(this, [this, requestId, cacheFor, to](QImage &&result) {
+			if (requestId != _cachingBackgroundRequestId) {
+				return;
+			}
+			_cachingFor = QRect();
+			_cachedX = to.x();
+			_cachedY = to.y();
+			_cachedBackground = App::pixmapFromImageInPlace(std::move(result));
+			_cachedBackground.setDevicePixelRatio(cRetinaFactor());
+			_cachedFor = cacheFor;
+			update();
+		});
+		_cachingFor = cacheFor;
+		base::TaskQueue::Normal().Put([ready = std::move(ready), image = bg.toImage(), from, to]() mutable {
+			auto result = image.copy(from).scaled(to.width() * cIntRetinaFactor(), to.height() * cIntRetinaFactor(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			base::TaskQueue::Main().Put([ready = std::move(ready), result = std::move(result)]() mutable {
+				ready(std::move(result));
+			});
+		});
+		return;
 	}
 	_cachedFor = _willCacheFor;
 }
@@ -1975,27 +2003,29 @@ void MainWidget::mediaMarkRead(not_null<DocumentData*> data) {
 }
 
 void MainWidget::mediaMarkRead(const HistoryItemsMap &items) {
-	QVector<MTPint> markedIds;
-	QMap<ChannelData*, QVector<MTPint>> channelMarkedIds;
-	markedIds.reserve(items.size());
 	for_const (auto item, items) {
 		if ((!item->out() || item->mentionsMe()) && item->isMediaUnread()) {
 			item->markMediaRead();
 			if (item->id > 0) {
-				if (auto channel = item->history()->peer->asChannel()) {
-					channelMarkedIds[channel].push_back(MTP_int(item->id));
-				} else {
-					markedIds.push_back(MTP_int(item->id));
-				}
+				// Non-channel messages are collected with the nullptr key.
+				_mediaToMarkRead[item->history()->peer->asChannel()].push_back(MTP_int(item->id));
 			}
 		}
 	}
-	if (!markedIds.isEmpty()) {
-		MTP::send(MTPmessages_ReadMessageContents(MTP_vector<MTPint>(markedIds)), rpcDone(&MainWidget::messagesAffected, (PeerData*)0));
+	if (!_mediaToMarkRead.isEmpty() && !_mediaMarkReadTimer.isActive()) {
+		_mediaMarkReadTimer.start(kSendMediaReadTimeout);
 	}
-	for (auto i = channelMarkedIds.cbegin(), e = channelMarkedIds.cend(); i != e; ++i) {
-		MTP::send(MTPchannels_ReadMessageContents(i.key()->inputChannel, MTP_vector<MTPint>(i.value())));
+}
+
+void MainWidget::onMediaMarkReadSend() {
+	for (auto i = _mediaToMarkRead.cbegin(), e = _mediaToMarkRead.cend(); i != e; ++i) {
+		if (auto channel = i.key()) {
+			MTP::send(MTPchannels_ReadMessageContents(channel->inputChannel, MTP_vector<MTPint>(i.value())));
+		} else {
+			MTP::send(MTPmessages_ReadMessageContents(MTP_vector<MTPint>(i.value())), rpcDone(&MainWidget::messagesAffected, (PeerData*)0));
+		}
 	}
+	_mediaToMarkRead.clear();
 }
 
 void MainWidget::mediaMarkRead(not_null<HistoryItem*> item) {
@@ -2087,6 +2117,8 @@ bool MainWidget::isIdle() const {
 void MainWidget::clearCachedBackground() {
 	_cachedBackground = QPixmap();
 	_cacheBackgroundTimer.stop();
+	_cachingFor = QRect();
+	++_cachingBackgroundRequestId;
 	update();
 }
 
@@ -2096,7 +2128,7 @@ QPixmap MainWidget::cachedBackground(const QRect &forRect, int &x, int &y) {
 		y = _cachedY;
 		return _cachedBackground;
 	}
-	if (_willCacheFor != forRect || !_cacheBackgroundTimer.isActive()) {
+	if (_willCacheFor != forRect || (!_cacheBackgroundTimer.isActive() && _cachingFor != forRect)) {
 		_willCacheFor = forRect;
 		_cacheBackgroundTimer.start(CacheBackgroundTimeout);
 	}
@@ -2353,7 +2385,7 @@ void MainWidget::onViewsIncrement() {
 		for (ViewsIncrementMap::const_iterator j = i.value().cbegin(), end = i.value().cend(); j != end; ++j) {
 			ids.push_back(MTP_int(j.key()));
 		}
-		auto req = MTP::send(MTPmessages_GetMessagesViews(i.key()->input, MTP_vector<MTPint>(ids), MTP_bool(true)), rpcDone(&MainWidget::viewsIncrementDone, ids), rpcFail(&MainWidget::viewsIncrementFail), 0, 5);
+		auto req = MTP::send(MTPmessages_GetMessagesViews(i.key()->input, MTP_vector<MTPint>(ids), MTP_bool(true)), rpcDone(&MainWidget::viewsIncrementDone, ids), rpcFail(&MainWidget::viewsIncrementFail), 0, kViewsIncrementCanWait);
 		_viewsIncrementRequests.insert(i.key(), req);
 		i = _viewsToIncrement.erase(i);
 	}
@@ -2367,9 +2399,7 @@ void MainWidget::viewsIncrementDone(QVector<MTPint> ids, const MTPVector<MTPint>
 				PeerData *peer = i.key();
 				ChannelId channel = peerToChannel(peer->id);
 				for (int32 j = 0, l = ids.size(); j < l; ++j) {
-					if (HistoryItem *item = App::histItemById(channel, ids.at(j).v)) {
-						item->setViewsCount(v.at(j).v);
-					}
+					viewsCountReceived(channel, ids.at(j).v, v.at(j).v);
 				}
 				_viewsIncrementRequests.erase(i);
 				break;
@@ -2381,6 +2411,29 @@ void MainWidget::viewsIncrementDone(QVector<MTPint> ids, const MTPVector<MTPint>
 	}
 }
 
+void MainWidget::viewsCountReceived(ChannelId channel, MsgId msgId, int count) {
+	if (!App::histItemById(channel, msgId)) {
+		return;
+	}
+	auto i = _pendingViewsCounts.find(FullMsgId(channel, msgId));
+	if (i == _pendingViewsCounts.cend()) {
+		_pendingViewsCounts.insert(FullMsgId(channel, msgId), count);
+	} else if (i.value() < count) {
+		i.value() = count;
+	}
+	_applyViewsCounts.call();
+}
+
+void MainWidget::applyViewsCounts() {
+	auto counts = base::take(_pendingViewsCounts);
+	for (auto i = counts.cbegin(), e = counts.cend(); i != e; ++i) {
+		// Skip the items destroyed since the count was received.
+		if (auto item = App::histItemById(i.key())) {
+			item->setViewsCount(i.value());
+		}
+	}
+}
+
 bool MainWidget::viewsIncrementFail(const RPCError &error, mtpRequestId req) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
@@ -2725,7 +2778,13 @@ Window::SectionSlideParams MainWidget::prepareShowAnimation(bool willHaveTopBarS
 		result.withTabbedSection = false;
 	}
 
+	// If nothing is painted above the old section we can take its pixels
+	// right from the backing store instead of rendering it once again.
+	auto overlapped = Ui::isLayerShown() || (_player && !_player->isHidden());
 	for (auto &instance : _playerFloats) {
+		if (!instance->widget->isHidden()) {
+			overlapped = true;
+		}
 		instance->widget->hide();
 	}
 	if (_player) {
@@ -2743,9 +2802,18 @@ Window::SectionSlideParams MainWidget::prepareShowAnimation(bool willHaveTopBarS
 	if (playerPlaylistVisible) {
 		_playerPlaylist->hide();
 	}
+	if (playerVolumeVisible || playerPanelVisible || playerPlaylistVisible) {
+		overlapped = true;
+	}
 
 	auto sectionTop = getSectionTop();
-	if (selectingPeer() && Adaptive::OneColumn()) {
+	auto selectingInOneColumn = (selectingPeer() && Adaptive::OneColumn());
+	auto grabbed = (overlapped || selectingInOneColumn || _wideSection)
+		? QPixmap()
+		: grabSectionFromBackingStore(sectionTop);
+	if (!grabbed.isNull()) {
+		result.oldContentCache = std::move(grabbed);
+	} else if (selectingInOneColumn) {
 		result.oldContentCache = myGrab(this, QRect(0, sectionTop, _dialogsWidth, height() - sectionTop));
 	} else if (_wideSection) {
 		result.oldContentCache = _wideSection->grabForShowAnimation(result);
@@ -2934,6 +3002,29 @@ QRect MainWidget::historyRect() const {
 	return r;
 }
 
+QPixmap MainWidget::grabSectionFromBackingStore(int sectionTop) {
+	auto result = QImage();
+	if (Adaptive::OneColumn()) {
+		result = myGrabImageFromBackingStore(this, QRect(0, sectionTop, _dialogsWidth, height() - sectionTop));
+	} else {
+		result = myGrabImageFromBackingStore(this, QRect(_dialogsWidth, sectionTop, width() - _dialogsWidth, height() - sectionTop));
+		auto shadowWidth = st::lineWidth * cIntRetinaFactor();
+		if (result.width() > shadowWidth) {
+			// Cover the side shadow with the column next to it, the shadow
+			// is not sliding with the section, like in the rendered grab.
+			auto column = result.copy(shadowWidth, 0, 1, result.height());
+			auto ratio = result.devicePixelRatio();
+			result.setDevicePixelRatio(1.);
+			{
+				QPainter p(&result);
+				p.drawImage(QRect(0, 0, shadowWidth, result.height()), column);
+			}
+			result.setDevicePixelRatio(ratio);
+		}
+	}
+	return result.isNull() ? QPixmap() : App::pixmapFromImageInPlace(std::move(result));
+}
+
 QPixmap MainWidget::grabForShowAnimation(const Window::SectionSlideParams &params) {
 	QPixmap result;
 	for (auto &instance : _playerFloats) {
@@ -3515,6 +3606,7 @@ void MainWidget::updSetState(int32 pts, int32 date, int32 qts, int32 seq) {
 
 void MainWidget::gotChannelDifference(ChannelData *channel, const MTPupdates_ChannelDifference &diff) {
 	_channelFailDifferenceTimeout.remove(channel);
+	_channelDifferenceRequests.remove(channel);
 
 	int32 timeout = 0;
 	bool isFinal = true;
@@ -3613,6 +3705,7 @@ void MainWidget::gotChannelDifference(ChannelData *channel, const MTPupdates_Cha
 	} else if (activePeer() == channel) {
 		channel->ptsWaitingForShortPoll(timeout ? (timeout * 1000) : WaitForChannelGetDifference);
 	}
+	sendQueuedChannelDifferences();
 }
 
 void MainWidget::gotRangeDifference(ChannelData *channel, const MTPupdates_ChannelDifference &diff) {
@@ -3664,7 +3757,9 @@ bool MainWidget::failChannelDifference(ChannelData *channel, const RPCError &err
 	if (MTP::isDefaultHandledError(error)) return false;
 
 	LOG(("RPC Error in getChannelDifference: %1 %2: %3").arg(error.code()).arg(error.type()).arg(error.description()));
+	_channelDifferenceRequests.remove(channel);
 	failDifferenceStartTimerFor(channel);
+	sendQueuedChannelDifferences();
 	return true;
 }
 
@@ -3682,6 +3777,7 @@ void MainWidget::gotState(const MTPupdates_State &state) {
 
 void MainWidget::gotDifference(const MTPupdates_Difference &difference) {
 	_failDifferenceTimeout = 1;
+	StartupTimeline::Mark("First difference");
 
 	switch (difference.type()) {
 	case mtpc_updates_differenceEmpty: {
@@ -3695,21 +3791,23 @@ void MainWidget::gotDifference(const MTPupdates_Difference &difference) {
 	} break;
 	case mtpc_updates_differenceSlice: {
 		auto &d = difference.c_updates_differenceSlice();
-		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates);
-
-		auto &s = d.vintermediate_state.c_updates_state();
-		updSetState(s.vpts.v, s.vdate.v, s.vqts.v, s.vseq.v);
+		auto state = d.vintermediate_state;
+		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates, [this, state] {
+			auto &s = state.c_updates_state();
+			updSetState(s.vpts.v, s.vdate.v, s.vqts.v, s.vseq.v);
 
-		_ptsWaiter.setRequesting(false);
+			_ptsWaiter.setRequesting(false);
 
-		MTP_LOG(0, ("getDifference { good - after a slice of difference was received }%1").arg(cTestMode() ? " TESTMODE" : ""));
-		getDifference();
+			MTP_LOG(0, ("getDifference { good - after a slice of difference was received }%1").arg(cTestMode() ? " TESTMODE" : ""));
+			getDifference();
+		});
 	} break;
 	case mtpc_updates_difference: {
 		auto &d = difference.c_updates_difference();
-		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates);
-
-		gotState(d.vstate);
+		auto state = d.vstate;
+		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates, [this, state] {
+			gotState(state);
+		});
 	} break;
 	case mtpc_updates_differenceTooLong: {
 		auto &d = difference.c_updates_differenceTooLong();
@@ -3799,14 +3897,81 @@ bool MainWidget::ptsUpdateAndApply(int32 pts, int32 ptsCount) {
 	return _ptsWaiter.updateAndApply(nullptr, pts, ptsCount);
 }
 
-void MainWidget::feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other) {
+void MainWidget::feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other, base::lambda<void()> done) {
 	Auth().checkAutoLock();
 	App::feedUsers(users);
 	App::feedChats(chats);
 	feedMessageIds(other);
-	App::feedMsgs(msgs, NewMessageUnread);
-	feedUpdateVector(other, true);
+
+	auto total = msgs.v.size() + other.v.size();
+	if (total <= kDifferenceChunkSize) {
+		App::feedMsgs(msgs, NewMessageUnread);
+		feedUpdateVector(other, true);
+		_history->peerMessagesUpdated();
+		done();
+		return;
+	}
+
+	// Applying thousands of messages and updates in one pass freezes the
+	// window, so we feed them in chunks while still requesting the difference.
+	// All the other updates are ignored until the difference is fully applied.
+	_differenceApplying = std::make_unique<DifferenceApplying>();
+	_differenceApplying->messages = msgs.v;
+	_differenceApplying->updates = other.v;
+	_differenceApplying->showProgress = (total >= kDifferenceShowProgressSize);
+	_differenceApplying->done = std::move(done);
+	if (_differenceApplying->showProgress) {
+		App::wnd()->updateConnectingStatus();
+	}
+	applyDifferenceChunk();
+}
+
+void MainWidget::applyDifferenceChunk() {
+	if (!_differenceApplying) {
+		return;
+	}
+	auto &applying = *_differenceApplying;
+	auto left = kDifferenceChunkSize;
+	if (applying.messagesApplied < applying.messages.size()) {
+		auto count = qMin(left, applying.messages.size() - applying.messagesApplied);
+		App::feedMsgs(applying.messages.mid(applying.messagesApplied, count), NewMessageUnread);
+		applying.messagesApplied += count;
+		left -= count;
+	}
+	while (left > 0 && applying.updatesApplied < applying.updates.size()) {
+		auto &update = applying.updates[applying.updatesApplied++];
+		if (update.type() != mtpc_updateMessageID) {
+			feedUpdate(update);
+			--left;
+		}
+	}
 	_history->peerMessagesUpdated();
+
+	// Deliver the peer updates collected by this chunk before the next one.
+	Notify::peerUpdatedSendDelayed();
+
+	if (applying.messagesApplied < applying.messages.size() || applying.updatesApplied < applying.updates.size()) {
+		if (applying.showProgress) {
+			App::wnd()->updateConnectingStatus();
+		}
+		_applyDifferenceChunk.call();
+		return;
+	}
+
+	auto finished = base::take(_differenceApplying);
+	if (finished->showProgress) {
+		App::wnd()->updateConnectingStatus();
+	}
+	finished->done();
+}
+
+int MainWidget::differenceApplyingProgress() const {
+	if (!_differenceApplying || !_differenceApplying->showProgress) {
+		return -1;
+	}
+	auto total = _differenceApplying->messages.size() + _differenceApplying->updates.size();
+	auto applied = _differenceApplying->messagesApplied + _differenceApplying->updatesApplied;
+	return (applied * 100) / total;
 }
 
 bool MainWidget::failDifference(const RPCError &error) {
@@ -3900,6 +4065,20 @@ void MainWidget::getChannelDifference(ChannelData *channel, ChannelDifferenceReq
 		_channelGetDifferenceTimeAfterFail.remove(channel);
 	}
 
+	// After a long sleep we get updateChannelTooLong for lots of channels,
+	// only a few requests are sent at once and the rest wait in the queue.
+	if (_channelDifferenceRequests.size() >= kChannelDifferenceRequestsLimit && activePeer() != channel) {
+		auto i = _channelDifferenceQueue.find(channel);
+		if (i == _channelDifferenceQueue.cend()) {
+			_channelDifferenceQueue.insert(channel, from);
+		} else if (from == ChannelDifferenceRequest::PtsGapOrShortPoll) {
+			i.value() = from;
+		}
+		return;
+	}
+	_channelDifferenceQueue.remove(channel);
+	_channelDifferenceRequests.insert(channel);
+
 	channel->ptsSetRequesting(true);
 
 	auto filter = MTP_channelMessagesFilterEmpty();
@@ -3912,6 +4091,34 @@ void MainWidget::getChannelDifference(ChannelData *channel, ChannelDifferenceReq
 	MTP::send(MTPupdates_GetChannelDifference(MTP_flags(flags), channel->inputChannel, filter, MTP_int(channel->pts()), MTP_int(MTPChannelGetDifferenceLimit)), rpcDone(&MainWidget::gotChannelDifference, channel), rpcFail(&MainWidget::failChannelDifference, channel));
 }
 
+void MainWidget::sendQueuedChannelDifferences() {
+	auto priority = [this](ChannelData *channel) {
+		if (activePeer() == channel) {
+			return 2;
+		} else if (auto history = App::historyLoaded(channel)) {
+			if (history->isPinnedDialog() || !history->mute()) {
+				return 1;
+			}
+		}
+		return 0;
+	};
+	while (!_channelDifferenceQueue.isEmpty() && _channelDifferenceRequests.size() < kChannelDifferenceRequestsLimit) {
+		auto best = _channelDifferenceQueue.begin();
+		auto bestPriority = priority(best.key());
+		for (auto i = best + 1, e = _channelDifferenceQueue.end(); i != e && bestPriority < 2; ++i) {
+			auto iPriority = priority(i.key());
+			if (iPriority > bestPriority) {
+				best = i;
+				bestPriority = iPriority;
+			}
+		}
+		auto channel = best.key();
+		auto from = best.value();
+		_channelDifferenceQueue.erase(best);
+		getChannelDifference(channel, from);
+	}
+}
+
 void MainWidget::mtpPing() {
 	MTP::ping();
 }
@@ -3926,6 +4133,7 @@ void MainWidget::start(const MTPUser *self) {
 	}
 
 	Local::readSavedPeers();
+	_dialogs->showDialogsSnapshot();
 	cSetOtherOnline(0);
 	if (auto user = App::feedUsers(MTP_vector<MTPUser>(1, *self))) {
 		user->loadUserpic();
@@ -3936,11 +4144,7 @@ void MainWidget::start(const MTPUser *self) {
 
 	_started = true;
 	App::wnd()->sendServiceHistoryRequest();
-	Local::readInstalledStickers();
-	Local::readFeaturedStickers();
-	Local::readRecentStickers();
-	Local::readFavedStickers();
-	Local::readSavedGifs();
+	Local::startStickersAndGifsRead();
 	_history->start();
 
 	Messenger::Instance().checkStartUrl();
@@ -4278,6 +4482,8 @@ void MainWidget::incrementSticker(DocumentData *sticker) {
 	if (!sticker || !sticker->sticker()) return;
 	if (sticker->sticker()->set.type() == mtpc_inputStickerSetEmpty) return;
 
+	Local::ensureStickersAndGifsRead();
+
 	bool writeRecentStickers = false;
 	auto &sets = Global::RefStickerSets();
 	auto it = sets.find(Stickers::CloudRecentSetId);
@@ -4450,6 +4656,10 @@ void MainWidget::updateOnline(bool gotOtherOffline) {
 	_onlineTimer.start(updateIn);
 }
 
+void MainWidget::writeDialogsSnapshot() {
+	_dialogs->writeDialogsSnapshot();
+}
+
 void MainWidget::saveDraftToCloud() {
 	_history->saveFieldToHistoryLocalDraft();
 
@@ -4956,6 +5166,7 @@ void MainWidget::feedUpdate(const MTPUpdate &update) {
 
 		// Update web page anyway.
 		App::feedWebPage(d.vwebpage);
+		Local::writeWebPage(d.vwebpage);
 		_history->updatePreview();
 		webPagesOrGamesUpdate();
 
@@ -4967,6 +5178,7 @@ void MainWidget::feedUpdate(const MTPUpdate &update) {
 
 		// update web page anyway
 		App::feedWebPage(d.vwebpage);
+		Local::writeWebPage(d.vwebpage);
 		_history->updatePreview();
 		webPagesOrGamesUpdate();
 
@@ -5245,14 +5457,13 @@ void MainWidget::feedUpdate(const MTPUpdate &update) {
 
 	case mtpc_updateChannelMessageViews: {
 		auto &d = update.c_updateChannelMessageViews();
-		if (auto item = App::histItemById(d.vchannel_id.v, d.vid.v)) {
-			item->setViewsCount(d.vviews.v);
-		}
+		viewsCountReceived(d.vchannel_id.v, d.vid.v, d.vviews.v);
 	} break;
 
 	////// Cloud sticker sets
 	case mtpc_updateNewStickerSet: {
 		auto &d = update.c_updateNewStickerSet();
+		Local::ensureStickersAndGifsRead();
 		bool writeArchived = false;
 		if (d.vstickerset.type() == mtpc_messages_stickerSet) {
 			auto &set = d.vstickerset.c_messages_stickerSet();
@@ -5333,6 +5544,7 @@ void MainWidget::feedUpdate(const MTPUpdate &update) {
 
 	case mtpc_updateStickerSetsOrder: {
 		auto &d = update.c_updateStickerSetsOrder();
+		Local::ensureStickersAndGifsRead();
 		if (!d.is_masks()) {
 			auto &order = d.vorder.v;
 			auto &sets = Global::StickerSets();
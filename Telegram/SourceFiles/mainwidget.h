@@ -232,6 +232,7 @@ public:
 	TimeMs lastSetOnline() const;
 
 	void saveDraftToCloud();
+	void writeDialogsSnapshot();
 	void applyCloudDraft(History *history);
 	void writeDrafts(History *history);
 
@@ -378,6 +379,9 @@ public:
 		return _ptsWaiter.requesting();
 	}
 
+	// Percent of a large difference that was already applied or -1.
+	int differenceApplyingProgress() const;
+
 	bool contentOverlapped(const QRect &globalRect);
 
 	void documentLoadProgress(DocumentData *document);
@@ -443,6 +447,7 @@ public slots:
 	void onStickersInstalled(uint64 setId);
 
 	void onViewsIncrement();
+	void onMediaMarkReadSend();
 
 	void ui_showPeerHistoryAsync(quint64 peerId, qint32 showAtMsgId, Ui::ShowWay way);
 	void ui_autoplayMediaInlineAsync(qint32 channelId, qint32 msgId);
@@ -519,6 +524,7 @@ private:
 	void mediaOverviewUpdated(const Notify::PeerUpdate &update);
 
 	Window::SectionSlideParams prepareShowAnimation(bool willHaveTopBarShadow, bool willHaveTabbedSection);
+	QPixmap grabSectionFromBackingStore(int sectionTop);
 	void showNewWideSection(Window::SectionMemento &&memento, bool back, bool saveInStack);
 
 	// All this methods use the prepareShowAnimation().
@@ -532,9 +538,11 @@ private:
 	void saveSectionInStack();
 
 	void getChannelDifference(ChannelData *channel, ChannelDifferenceRequest from = ChannelDifferenceRequest::Unknown);
+	void sendQueuedChannelDifferences();
 	void gotDifference(const MTPupdates_Difference &diff);
 	bool failDifference(const RPCError &e);
-	void feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other);
+	void feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other, base::lambda<void()> done);
+	void applyDifferenceChunk();
 	void gotState(const MTPupdates_State &state);
 	void updSetState(int32 pts, int32 date, int32 qts, int32 seq);
 	void gotChannelDifference(ChannelData *channel, const MTPupdates_ChannelDifference &diff);
@@ -589,6 +597,8 @@ private:
 
 	void viewsIncrementDone(QVector<MTPint> ids, const MTPVector<MTPint> &result, mtpRequestId req);
 	bool viewsIncrementFail(const RPCError &error, mtpRequestId req);
+	void viewsCountReceived(ChannelId channel, MsgId msgId, int count);
+	void applyViewsCounts();
 
 	not_null<Window::Controller*> _controller;
 	bool _started = false;
@@ -643,6 +653,18 @@ private:
 
 	PtsWaiter _ptsWaiter;
 
+	// Large differences are applied in chunks, one chunk per event loop iteration.
+	struct DifferenceApplying {
+		QVector<MTPMessage> messages;
+		QVector<MTPUpdate> updates;
+		int messagesApplied = 0;
+		int updatesApplied = 0;
+		bool showProgress = false;
+		base::lambda<void()> done;
+	};
+	std::unique_ptr<DifferenceApplying> _differenceApplying;
+	SingleQueuedInvokation _applyDifferenceChunk = { [this] { applyDifferenceChunk(); } };
+
 	ChannelGetDifferenceTime _channelGetDifferenceTimeByPts, _channelGetDifferenceTimeAfterFail;
 	TimeMs _getDifferenceTimeByPts = 0;
 	TimeMs _getDifferenceTimeAfterFail = 0;
@@ -674,13 +696,16 @@ private:
 	int32 _failDifferenceTimeout = 1; // growing timeout for getDifference calls, if it fails
 	typedef QMap<ChannelData*, int32> ChannelFailDifferenceTimeout;
 	ChannelFailDifferenceTimeout _channelFailDifferenceTimeout; // growing timeout for getChannelDifference calls, if it fails
+	QSet<ChannelData*> _channelDifferenceRequests;
+	QMap<ChannelData*, ChannelDifferenceRequest> _channelDifferenceQueue;
 	SingleTimer _failDifferenceTimer;
 
 	TimeMs _lastUpdateTime = 0;
 	bool _handlingChannelDifference = false;
 
 	QPixmap _cachedBackground;
-	QRect _cachedFor, _willCacheFor;
+	QRect _cachedFor, _willCacheFor, _cachingFor;
+	uint64 _cachingBackgroundRequestId = 0;
 	int _cachedX = 0;
 	int _cachedY = 0;
 	SingleTimer _cacheBackgroundTimer;
@@ -699,6 +724,13 @@ private:
 	ViewsIncrementByRequest _viewsIncrementByRequest;
 	SingleTimer _viewsIncrementTimer;
 
+	// Views counts received from the server, applied once for each item.
+	QMap<FullMsgId, int> _pendingViewsCounts;
+	SingleQueuedInvokation _applyViewsCounts = { [this] { applyViewsCounts(); } };
+
+	QMap<ChannelData*, QVector<MTPint>> _mediaToMarkRead;
+	SingleTimer _mediaMarkReadTimer;
+
 	std::unique_ptr<App::WallPaper> _background;
 
 	bool _resizingSide = false;
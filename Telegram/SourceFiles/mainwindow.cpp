@@ -58,6 +58,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace {
 
+constexpr auto kCounterIconsCacheLimit = 64;
+
 // Code for testing languages is F7-F6-F7-F8
 void FeedLangTestingKey(int key) {
 	static auto codeState = 0;
@@ -383,6 +385,8 @@ void MainWindow::updateConnectingStatus() {
 	} else if (state < 0) {
 		showConnecting(lng_reconnecting(lt_count, ((-state) / 1000) + 1), lang(throughProxy ? lng_connecting_settings : lng_reconnecting_try_now));
 		QTimer::singleShot((-state) % 1000, this, SLOT(updateConnectingStatus()));
+	} else if (_main && _main->differenceApplyingProgress() >= 0) {
+		showConnecting(lng_updating_difference(lt_percent, QString::number(_main->differenceApplyingProgress())), QString());
 	} else {
 		hideConnecting();
 	}
@@ -589,6 +593,19 @@ bool MainWindow::eventFilter(QObject *object, QEvent *e) {
 			positionUpdated();
 		}
 	} break;
+
+	case QEvent::Show:
+	case QEvent::Hide: {
+		if (object == this) {
+			updateBackgroundMode();
+		}
+	} break;
+
+	case QEvent::Expose: {
+		if (object == windowHandle()) {
+			updateBackgroundMode();
+		}
+	} break;
 	}
 
 	return Platform::MainWindow::eventFilter(object, e);
@@ -888,6 +905,29 @@ void MainWindow::placeSmallCounter(QImage &img, int size, int count, style::colo
 }
 
 QImage MainWindow::iconWithCounter(int size, int count, style::color bg, style::color fg, bool smallIcon) {
+	// Large counters are drawn as "..N" (small) or "..NN", so all of them
+	// with the same last digits have the same icon.
+	auto key = CounterIconKey();
+	key.size = size;
+	if (smallIcon) {
+		key.count = (count < 100) ? count : (100 + (count % 10));
+	} else {
+		key.count = (count < 1000) ? count : (1000 + (count % 100));
+	}
+	key.bg = bg->c.rgba();
+	key.fg = fg->c.rgba();
+	key.smallIcon = smallIcon;
+	auto i = _counterIcons.find(key);
+	if (i == _counterIcons.end()) {
+		if (_counterIcons.size() >= kCounterIconsCacheLimit) {
+			_counterIcons.clear();
+		}
+		i = _counterIcons.emplace(key, renderIconWithCounter(size, count, bg, fg, smallIcon)).first;
+	}
+	return i->second;
+}
+
+QImage MainWindow::renderIconWithCounter(int size, int count, style::color bg, style::color fg, bool smallIcon) {
 	bool layer = false;
 	if (size < 0) {
 		size = -size;
@@ -185,8 +185,32 @@ private:
 	QPixmap grabInner();
 
 	void placeSmallCounter(QImage &img, int size, int count, style::color bg, const QPoint &shift, style::color color) override;
+	QImage renderIconWithCounter(int size, int count, style::color bg, style::color fg, bool smallIcon);
 	QImage icon16, icon32, icon64, iconbig16, iconbig32, iconbig64;
 
+	// The tray and taskbar icons are requested for the same few counters
+	// again and again, so the rendered ones are kept here.
+	struct CounterIconKey {
+		int size = 0;
+		int count = 0;
+		QRgb bg = 0;
+		QRgb fg = 0;
+		bool smallIcon = false;
+	};
+	friend inline bool operator<(const CounterIconKey &a, const CounterIconKey &b) {
+		if (a.size != b.size) {
+			return a.size < b.size;
+		} else if (a.count != b.count) {
+			return a.count < b.count;
+		} else if (a.bg != b.bg) {
+			return a.bg < b.bg;
+		} else if (a.fg != b.fg) {
+			return a.fg < b.fg;
+		}
+		return a.smallIcon < b.smallIcon;
+	}
+	std::map<CounterIconKey, QImage> _counterIcons;
+
 	struct DelayedServiceMsg {
 		DelayedServiceMsg(const TextWithEntities &message, const MTPMessageMedia &media, int32 date) : message(message), media(media), date(date) {
 		}
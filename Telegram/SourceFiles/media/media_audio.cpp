@@ -26,6 +26,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_audio_track.h"
 #include "platform/platform_audio.h"
 #include "base/task_queue.h"
+#include "core/memory_stats.h"
 
 #include <AL/al.h>
 #include <AL/alc.h>
@@ -345,6 +346,7 @@ void Mixer::Track::clear() {
 	bufferedLength = 0;
 	loading = false;
 	loaded = false;
+	underrun = false;
 	fadeStartPosition = 0;
 
 	format = 0;
@@ -365,6 +367,7 @@ void Mixer::Track::started() {
 	bufferedPosition = 0;
 	bufferedLength = 0;
 	loaded = false;
+	underrun = false;
 	fadeStartPosition = 0;
 
 	format = 0;
@@ -439,6 +442,14 @@ void Mixer::Track::resetStream() {
 	}
 }
 
+int64 Mixer::Track::bufferedBytes() const {
+	auto result = int64(data.size());
+	for (auto &samples : bufferSamples) {
+		result += samples.size();
+	}
+	return result;
+}
+
 Mixer::Track::~Track() = default;
 
 Mixer::Mixer()
@@ -467,12 +478,18 @@ Mixer::Mixer()
 	connect(this, SIGNAL(stoppedOnError(const AudioMsgId&)), this, SIGNAL(updated(const AudioMsgId&)), Qt::QueuedConnection);
 	connect(this, SIGNAL(updated(const AudioMsgId&)), this, SLOT(onUpdated(const AudioMsgId&)));
 
+	MemoryStats::SetProvider(MemoryStats::Kind::AudioBuffers, [this] {
+		QMutexLocker lock(&AudioMutex);
+		return memoryUsage();
+	});
+
 	_loaderThread.start();
 	_faderThread.start();
 }
 
 // Thread: Main. Locks: AudioMutex.
 Mixer::~Mixer() {
+	MemoryStats::ClearProvider(MemoryStats::Kind::AudioBuffers);
 	{
 		QMutexLocker lock(&AudioMutex);
 
@@ -492,11 +509,27 @@ Mixer::~Mixer() {
 	_loaderThread.wait();
 }
 
+MemoryStats::Usage Mixer::memoryUsage() const {
+	auto result = MemoryStats::Usage();
+	auto add = [&result](const Track &track) {
+		if (auto bytes = track.bufferedBytes()) {
+			++result.count;
+			result.bytes += bytes;
+		}
+	};
+	for (auto i = 0; i != kTogetherLimit; ++i) {
+		add(_audioTracks[i]);
+		add(_songTracks[i]);
+	}
+	add(_videoTrack);
+	return result;
+}
+
 void Mixer::onUpdated(const AudioMsgId &audio) {
 	if (audio.playId()) {
 		videoSoundProgress(audio);
 	}
-	Media::Player::Updated().notify(audio);
+	Media::Player::Updated().notifyCoalesced(audio);
 }
 
 void Mixer::onError(const AudioMsgId &audio) {
@@ -716,10 +749,22 @@ void Mixer::play(const AudioMsgId &audio, std::unique_ptr<VideoSoundData> videoD
 	}
 }
 
+void Mixer::prepareNext(const AudioMsgId &audio) {
+	auto document = audio.audio();
+	if (!document || audio.playId() || !document->loaded()) {
+		return;
+	}
+	_loader->prepareNext(audio, document->location(), document->data());
+}
+
 void Mixer::feedFromVideo(VideoSoundPart &&part) {
 	_loader->feedFromVideo(std::move(part));
 }
 
+int Mixer::videoSoundPartsQueued(const AudioMsgId &audio) const {
+	return _loader->fromVideoQueued(audio);
+}
+
 TimeMs Mixer::getVideoCorrectedTime(const AudioMsgId &audio, TimeMs frameMs, TimeMs systemMs) {
 	auto result = frameMs;
 
@@ -1082,6 +1127,18 @@ float64 Mixer::getVideoVolume() const {
 	return float64(_volumeVideo.loadAcquire()) / kVolumeRound;
 }
 
+int Mixer::underrunsCount(AudioMsgId::Type type) const {
+	return const_cast<Mixer*>(this)->underruns(type).loadAcquire();
+}
+
+QAtomicInt &Mixer::underruns(AudioMsgId::Type type) {
+	switch (type) {
+	case AudioMsgId::Type::Song: return _underrunsSong;
+	case AudioMsgId::Type::Video: return _underrunsVideo;
+	}
+	return _underrunsVoice;
+}
+
 Fader::Fader(QThread *thread) : QObject()
 , _timer(this)
 , _suppressVolumeAll(1., 1.)
@@ -1150,6 +1207,10 @@ void Fader::onTimer() {
 		if (emitSignals & EmitStopped) emit audioStopped(track->state.id);
 		if (emitSignals & EmitPositionUpdated) emit playPositionUpdated(track->state.id);
 		if (emitSignals & EmitNeedToPreload) emit needToPreload(track->state.id);
+		if (emitSignals & EmitUnderrun) {
+			auto count = mixer()->underruns(type).fetchAndAddRelaxed(1) + 1;
+			DEBUG_LOG(("Audio Info: playback underrun, type %1, count %2").arg(int(type)).arg(count));
+		}
 	};
 	auto suppressGainForMusic = ComputeVolume(AudioMsgId::Type::Song);
 	auto suppressGainForMusicChanged = volumeChangedSong || _volumeChangedSong;
@@ -1211,6 +1272,13 @@ int32 Fader::updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasF
 	}
 
 	auto fullPosition = track->bufferedPosition + positionInBuffered;
+	if (state == AL_PLAYING) {
+		track->underrun = false;
+	} else if (state == AL_STOPPED && track->loading && (fading || playing) && !track->underrun) {
+		// All the queued buffers were played before the loader has decoded the next part.
+		track->underrun = true;
+		emitSignals |= EmitUnderrun;
+	}
 	if (state != AL_PLAYING && !track->loading) {
 		if (fading || playing) {
 			fading = false;
@@ -129,8 +129,12 @@ public:
 	void stop(const AudioMsgId &audio);
 	void stop(const AudioMsgId &audio, State state);
 
+	// Opens the next playlist track and decodes its beginning in advance.
+	void prepareNext(const AudioMsgId &audio);
+
 	// Video player audio stream interface.
 	void feedFromVideo(VideoSoundPart &&part);
+	int videoSoundPartsQueued(const AudioMsgId &audio) const;
 	int64 getVideoCorrectedTime(const AudioMsgId &id, TimeMs frameMs, TimeMs systemMs);
 
 	void stopAndClear();
@@ -154,6 +158,9 @@ public:
 	void setVideoVolume(float64 volume);
 	float64 getVideoVolume() const;
 
+	// Thread: Any. Count of playback stalls because the loader was late.
+	int underrunsCount(AudioMsgId::Type type) const;
+
 	~Mixer();
 
 private slots:
@@ -180,6 +187,7 @@ private:
 	bool checkCurrentALError(AudioMsgId::Type type);
 
 	void videoSoundProgress(const AudioMsgId &audio);
+	QAtomicInt &underruns(AudioMsgId::Type type);
 
 	class Track {
 	public:
@@ -197,6 +205,8 @@ private:
 
 		int getNotQueuedBufferIndex();
 
+		int64 bufferedBytes() const;
+
 		~Track();
 
 		TrackState state;
@@ -207,6 +217,7 @@ private:
 		int64 bufferedLength = 0;
 		bool loading = false;
 		bool loaded = false;
+		bool underrun = false;
 		int64 fadeStartPosition = 0;
 
 		int32 format = 0;
@@ -239,6 +250,9 @@ private:
 	int *currentIndex(AudioMsgId::Type type);
 	const int *currentIndex(AudioMsgId::Type type) const;
 
+	// Thread: Main. Must be locked: AudioMutex.
+	MemoryStats::Usage memoryUsage() const;
+
 	int _audioCurrent = 0;
 	Track _audioTracks[kTogetherLimit];
 
@@ -250,6 +264,10 @@ private:
 	QAtomicInt _volumeVideo;
 	QAtomicInt _volumeSong;
 
+	QAtomicInt _underrunsVoice;
+	QAtomicInt _underrunsSong;
+	QAtomicInt _underrunsVideo;
+
 	friend class Fader;
 	friend class Loaders;
 
@@ -289,6 +307,7 @@ private:
 		EmitStopped = 0x02,
 		EmitPositionUpdated = 0x04,
 		EmitNeedToPreload = 0x08,
+		EmitUnderrun = 0x10,
 	};
 	int32 updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasFading, float64 volumeMultiplier, bool volumeChanged);
 	void setStoppedState(Mixer::Track *track, State state = State::Stopped);
@@ -36,6 +36,9 @@ constexpr auto kCaptureFrequency = Player::kDefaultFrequency;
 constexpr auto kCaptureSkipDuration = TimeMs(400);
 constexpr auto kCaptureFadeInDuration = TimeMs(300);
 
+// Size of the parts emitted while recording, must be accepted by the uploader.
+constexpr auto kCapturePartSize = int32(DocumentUploadPartSize0);
+
 Instance *CaptureInstance = nullptr;
 
 bool ErrorHappened(ALCdevice *device) {
@@ -65,6 +68,7 @@ Instance::Instance() : _inner(new Inner(&_thread)) {
 	connect(this, SIGNAL(stop(bool)), _inner, SLOT(onStop(bool)));
 	connect(_inner, SIGNAL(done(QByteArray, VoiceWaveform, qint32)), this, SIGNAL(done(QByteArray, VoiceWaveform, qint32)));
 	connect(_inner, SIGNAL(updated(quint16, qint32)), this, SIGNAL(updated(quint16, qint32)));
+	connect(_inner, SIGNAL(partReady(QByteArray, qint32)), this, SIGNAL(partReady(QByteArray, qint32)));
 	connect(_inner, SIGNAL(error()), this, SIGNAL(error()));
 	connect(&_thread, SIGNAL(started()), _inner, SLOT(onInit()));
 	connect(&_thread, SIGNAL(finished()), _inner, SLOT(deleteLater()));
@@ -118,6 +122,10 @@ struct Instance::Inner::Private {
 	QByteArray data;
 	int32 dataPos = 0;
 
+	// Parts of data that were already emitted in partReady() can't be changed.
+	int32 emittedSize = 0;
+	bool emittedChanged = false;
+
 	int64 waveformMod = 0;
 	int64 waveformEach = (kCaptureFrequency / 100);
 	uint16 waveformPeak = 0;
@@ -140,6 +148,7 @@ struct Instance::Inner::Private {
 		auto l = reinterpret_cast<Private*>(opaque);
 
 		if (buf_size <= 0) return 0;
+		if (l->dataPos < l->emittedSize) l->emittedChanged = true;
 		if (l->dataPos + buf_size > l->data.size()) l->data.resize(l->dataPos + buf_size);
 		memcpy(l->data.data() + l->dataPos, buf, buf_size);
 		l->dataPos += buf_size;
@@ -474,6 +483,8 @@ void Instance::Inner::onStop(bool needResult) {
 
 		d->dataPos = 0;
 		d->data.clear();
+		d->emittedSize = 0;
+		d->emittedChanged = false;
 
 		d->waveformMod = 0;
 		d->waveformPeak = 0;
@@ -536,6 +547,7 @@ void Instance::Inner::onTimeout() {
 			processFrame(encoded, framesize);
 			encoded += framesize;
 		}
+		emitReadyParts();
 
 		// Collapse the buffer
 		if (encoded > 0) {
@@ -548,6 +560,17 @@ void Instance::Inner::onTimeout() {
 	}
 }
 
+void Instance::Inner::emitReadyParts() {
+	// Keep the last part here, it will be uploaded with the final data.
+	while (!d->emittedChanged
+		&& d->emittedSize + kCapturePartSize < d->data.size()
+		&& d->emittedSize + kCapturePartSize <= UseBigFilesFrom) {
+		auto index = d->emittedSize / kCapturePartSize;
+		emit partReady(d->data.mid(d->emittedSize, kCapturePartSize), index);
+		d->emittedSize += kCapturePartSize;
+	}
+}
+
 void Instance::Inner::processFrame(int32 offset, int32 framesize) {
 	// Prepare audio frame
 
@@ -49,6 +49,10 @@ signals:
 	void updated(quint16 level, qint32 samples);
 	void error();
 
+	// Encoded parts of the recording, sent before the recording is done.
+	// All parts have the same size and form a prefix of the done() data.
+	void partReady(QByteArray part, qint32 index);
+
 private:
 	class Inner;
 	friend class Inner;
@@ -72,6 +76,7 @@ signals:
 	void error();
 	void updated(quint16 level, qint32 samples);
 	void done(QByteArray data, VoiceWaveform waveform, qint32 samples);
+	void partReady(QByteArray part, qint32 index);
 
 public slots:
 	void onInit();
@@ -82,6 +87,7 @@ public slots:
 
 private:
 	void processFrame(int32 offset, int32 framesize);
+	void emitReadyParts();
 
 	void writeFrame(AVFrame *frame);
 
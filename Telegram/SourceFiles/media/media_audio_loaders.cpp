@@ -26,36 +26,154 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace Media {
 namespace Player {
+namespace {
 
-Loaders::Loaders(QThread *thread) : _fromVideoNotify([this] { videoSoundAdded(); }) {
+constexpr auto kStartBufferSize = int(AudioVoiceMsgBufferSize / 8); // 32 Kb (0.17 - 0.37 secs)
+
+// About 20 seconds of audio packets, the reader waits if the loaders thread lags behind.
+constexpr auto kFromVideoQueueSize = 1024;
+
+void FreePackets(QQueue<FFMpeg::AVPacketDataWrap> &packets) {
+	for (auto &packetData : packets) {
+		AVPacket packet;
+		FFMpeg::packetFromDataWrap(packet, packetData);
+		FFMpeg::freePacket(&packet);
+	}
+	packets.clear();
+}
+
+} // namespace
+
+Loaders::Loaders(QThread *thread)
+: _fromVideoNotify([this] { videoSoundAdded(); })
+, _prepareNotify([this] { prepareNextAdded(); }) {
 	moveToThread(thread);
 	_fromVideoNotify.moveToThread(thread);
+	_prepareNotify.moveToThread(thread);
 	connect(thread, SIGNAL(started()), this, SLOT(onInit()));
 	connect(thread, SIGNAL(finished()), this, SLOT(deleteLater()));
 }
 
-void Loaders::feedFromVideo(VideoSoundPart &&part) {
-	auto invoke = false;
+Loaders::FromVideoQueue::FromVideoQueue() : packets(kFromVideoQueueSize) {
+}
+
+Loaders::FromVideoQueue::~FromVideoQueue() {
+	auto left = QQueue<FFMpeg::AVPacketDataWrap>();
+	auto packetData = FFMpeg::AVPacketDataWrap();
+	while (packets.pop(packetData)) {
+		left.enqueue(packetData);
+	}
+	FreePackets(left);
+}
+
+std::shared_ptr<Loaders::FromVideoQueue> Loaders::fromVideoQueue(const AudioMsgId &audio) {
 	{
-		QMutexLocker lock(&_fromVideoMutex);
-		_fromVideoQueues[part.audio].enqueue(FFMpeg::dataWrapFromPacket(*part.packet));
-		invoke = true;
+		QReadLocker lock(&_fromVideoLock);
+		auto i = _fromVideoQueues.constFind(audio);
+		if (i != _fromVideoQueues.cend()) {
+			return i.value();
+		}
+	}
+	QWriteLocker lock(&_fromVideoLock);
+	auto &result = _fromVideoQueues[audio];
+	if (!result) {
+		result = std::make_shared<FromVideoQueue>();
 	}
-	if (invoke) {
+	return result;
+}
+
+void Loaders::removeFromVideoQueue(const AudioMsgId &audio, const std::shared_ptr<FromVideoQueue> &queue) {
+	queue->closed.store(true, std::memory_order_release);
+
+	QWriteLocker lock(&_fromVideoLock);
+	auto i = _fromVideoQueues.find(audio);
+	if (i != _fromVideoQueues.end() && i.value() == queue) {
+		_fromVideoQueues.erase(i);
+	}
+}
+
+void Loaders::feedFromVideo(VideoSoundPart &&part) {
+	auto queue = fromVideoQueue(part.audio);
+	auto packetData = FFMpeg::dataWrapFromPacket(*part.packet);
+	while (!queue->packets.push(packetData)) {
+		if (queue->closed.load(std::memory_order_acquire)) {
+			auto packets = QQueue<FFMpeg::AVPacketDataWrap>();
+			packets.enqueue(packetData);
+			FreePackets(packets);
+			return;
+		}
 		_fromVideoNotify.call();
+		QThread::yieldCurrentThread();
 	}
+	_fromVideoNotify.call();
+}
+
+int Loaders::fromVideoQueued(const AudioMsgId &audio) {
+	QReadLocker lock(&_fromVideoLock);
+	auto i = _fromVideoQueues.constFind(audio);
+	return (i != _fromVideoQueues.cend()) ? int(i.value()->packets.size()) : 0;
+}
+
+void Loaders::prepareNext(const AudioMsgId &audio, const FileLocation &file, const QByteArray &data) {
+	{
+		QMutexLocker lock(&_prepareMutex);
+		_prepareAudio = audio;
+		_prepareFile = file;
+		_prepareData = data;
+	}
+	_prepareNotify.call();
+}
+
+void Loaders::prepareNextAdded() {
+	auto audio = AudioMsgId();
+	auto file = FileLocation();
+	auto data = QByteArray();
+	{
+		QMutexLocker lock(&_prepareMutex);
+		audio = base::take(_prepareAudio);
+		file = base::take(_prepareFile);
+		data = base::take(_prepareData);
+	}
+	if (!audio || audio == _prepared || audio == _audio || audio == _song) {
+		return;
+	}
+	_prepared = AudioMsgId();
+	_preparedLoader = nullptr;
+
+	auto loader = std::make_unique<FFMpegLoader>(file, data, base::byte_vector());
+	auto position = qint64(0);
+	if (!loader->open(position) || loader->samplesCount() <= 0) {
+		return;
+	}
+
+	// Decode the first part, so that the switch to this track is gapless.
+	auto samples = QByteArray();
+	auto samplesCount = int64(0);
+	while (samples.size() < kStartBufferSize) {
+		using Result = AudioPlayerLoader::ReadResult;
+		auto result = loader->readMore(samples, samplesCount);
+		if (result == Result::Error) {
+			return;
+		} else if (result != Result::Ok) {
+			break;
+		}
+	}
+	if (samplesCount > 0) {
+		loader->saveDecodedSamples(&samples, &samplesCount);
+	}
+	_prepared = audio;
+	_preparedLoader = std::move(loader);
 }
 
 void Loaders::videoSoundAdded() {
-	auto waitingAndAdded = false;
 	auto queues = decltype(_fromVideoQueues)();
 	{
-		QMutexLocker lock(&_fromVideoMutex);
-		queues = base::take(_fromVideoQueues);
+		QReadLocker lock(&_fromVideoLock);
+		queues = _fromVideoQueues;
 	}
-	auto tryLoader = [this](auto &audio, auto &loader, auto &it) {
+	auto tryLoader = [this](auto &audio, auto &loader, auto &it, auto &packets) {
 		if (audio == it.key() && loader) {
-			loader->enqueuePackets(it.value());
+			loader->enqueuePackets(packets);
 			if (loader->holdsSavedDecodedSamples()) {
 				onLoad(audio);
 			}
@@ -64,34 +182,32 @@ void Loaders::videoSoundAdded() {
 		return false;
 	};
 	for (auto i = queues.begin(), e = queues.end(); i != e; ++i) {
-		if (!tryLoader(_audio, _audioLoader, i)
-			&& !tryLoader(_song, _songLoader, i)
-			&& !tryLoader(_video, _videoLoader, i)) {
-			for (auto &packetData : i.value()) {
-				AVPacket packet;
-				FFMpeg::packetFromDataWrap(packet, packetData);
-				FFMpeg::freePacket(&packet);
-			}
+		auto packets = QQueue<FFMpeg::AVPacketDataWrap>();
+		auto packetData = FFMpeg::AVPacketDataWrap();
+		while (i.value()->packets.pop(packetData)) {
+			packets.enqueue(packetData);
+		}
+		if (!tryLoader(_audio, _audioLoader, i, packets)
+			&& !tryLoader(_song, _songLoader, i, packets)
+			&& !tryLoader(_video, _videoLoader, i, packets)) {
+			FreePackets(packets);
+			removeFromVideoQueue(i.key(), i.value());
 		}
-	}
-	if (waitingAndAdded) {
-		onLoad(_video);
 	}
 }
 
 Loaders::~Loaders() {
-	QMutexLocker lock(&_fromVideoMutex);
 	clearFromVideoQueue();
 }
 
 void Loaders::clearFromVideoQueue() {
-	auto queues = base::take(_fromVideoQueues);
+	auto queues = decltype(_fromVideoQueues)();
+	{
+		QWriteLocker lock(&_fromVideoLock);
+		queues = base::take(_fromVideoQueues);
+	}
 	for (auto &queue : queues) {
-		for (auto &packetData : queue) {
-			AVPacket packet;
-			FFMpeg::packetFromDataWrap(packet, packetData);
-			FFMpeg::freePacket(&packet);
-		}
+		queue->closed.store(true, std::memory_order_release);
 	}
 }
 
@@ -157,7 +273,10 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 	if (l->holdsSavedDecodedSamples()) {
 		l->takeSavedDecodedSamples(&samples, &samplesCount);
 	}
-	while (samples.size() < AudioVoiceMsgBufferSize) {
+	// The first part is short, so that the playback starts after decoding
+	// a fraction of a second, the next parts are requested by Fader at once.
+	auto bufferSize = started ? kStartBufferSize : int(AudioVoiceMsgBufferSize);
+	while (samples.size() < bufferSize) {
 		auto res = l->readMore(samples, samplesCount);
 		using Result = AudioPlayerLoader::ReadResult;
 		if (res == Result::Error) {
@@ -179,7 +298,7 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 		} else if (res == Result::Ok) {
 			errAtStart = false;
 		} else if (res == Result::Wait) {
-			waiting = (samples.size() < AudioVoiceMsgBufferSize);
+			waiting = (samples.size() < bufferSize);
 			if (waiting) {
 				l->saveDecodedSamples(&samples, &samplesCount);
 			}
@@ -318,6 +437,7 @@ AudioPlayerLoader *Loaders::setupLoader(const AudioMsgId &audio, SetupError &err
 	}
 
 	if (!l) {
+		auto prepared = false;
 		std::unique_ptr<AudioPlayerLoader> *loader = nullptr;
 		switch (audio.type()) {
 		case AudioMsgId::Type::Voice: _audio = audio; loader = &_audioLoader; break;
@@ -334,12 +454,18 @@ AudioPlayerLoader *Loaders::setupLoader(const AudioMsgId &audio, SetupError &err
 				return nullptr;
 			}
 			*loader = std::make_unique<ChildFFMpegLoader>(std::move(track->videoData));
+			l = loader->get();
+		} else if (_prepared == audio && !position && _preparedLoader->check(track->file, track->data)) {
+			_prepared = AudioMsgId();
+			*loader = std::move(_preparedLoader);
+			l = loader->get();
+			prepared = true;
 		} else {
 			*loader = std::make_unique<FFMpegLoader>(track->file, track->data, base::byte_vector());
+			l = loader->get();
 		}
-		l = loader->get();
 
-		if (!l->open(position)) {
+		if (!prepared && !l->open(position)) {
 			track->state.state = State::StoppedAtStart;
 			return nullptr;
 		}
@@ -23,6 +23,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_child_ffmpeg_loader.h"
 #include "media/media_audio.h"
 #include "media/media_child_ffmpeg_loader.h"
+#include "base/spsc_ring.h"
 
 class AudioPlayerLoader;
 class ChildFFMpegLoader;
@@ -36,6 +37,13 @@ class Loaders : public QObject {
 public:
 	Loaders(QThread *thread);
 	void feedFromVideo(VideoSoundPart &&part);
+
+	// Thread: Any. Count of the packets waiting for the loaders thread.
+	int fromVideoQueued(const AudioMsgId &audio);
+
+	// Thread: Main. The prepared loader is used if this track starts next.
+	void prepareNext(const AudioMsgId &audio, const FileLocation &file, const QByteArray &data);
+
 	~Loaders();
 
 signals:
@@ -58,10 +66,33 @@ private:
 	std::unique_ptr<AudioPlayerLoader> _songLoader;
 	std::unique_ptr<AudioPlayerLoader> _videoLoader;
 
-	QMutex _fromVideoMutex;
-	QMap<AudioMsgId, QQueue<FFMpeg::AVPacketDataWrap>> _fromVideoQueues;
+	// Each video reader thread feeds its own ring and the loaders thread drains it,
+	// so the packets are passed without locking. The lock guards only the map.
+	struct FromVideoQueue {
+		FromVideoQueue();
+		~FromVideoQueue();
+
+		base::spsc_ring<FFMpeg::AVPacketDataWrap> packets;
+		std::atomic<bool> closed = { false };
+	};
+	std::shared_ptr<FromVideoQueue> fromVideoQueue(const AudioMsgId &audio);
+	void removeFromVideoQueue(const AudioMsgId &audio, const std::shared_ptr<FromVideoQueue> &queue);
+
+	QReadWriteLock _fromVideoLock;
+	QMap<AudioMsgId, std::shared_ptr<FromVideoQueue>> _fromVideoQueues;
 	SingleQueuedInvokation _fromVideoNotify;
 
+	void prepareNextAdded();
+
+	QMutex _prepareMutex;
+	AudioMsgId _prepareAudio;
+	FileLocation _prepareFile;
+	QByteArray _prepareData;
+	SingleQueuedInvokation _prepareNotify;
+
+	AudioMsgId _prepared;
+	std::unique_ptr<AudioPlayerLoader> _preparedLoader;
+
 	void emitError(AudioMsgId::Type type);
 	AudioMsgId clear(AudioMsgId::Type type);
 	void setStoppedState(Mixer::Track *m, State state = State::Stopped);
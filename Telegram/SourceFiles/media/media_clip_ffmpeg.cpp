@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "media/media_audio.h"
 #include "media/media_child_ffmpeg_loader.h"
+#include "media/media_clip_reader.h"
 #include "storage/file_download.h"
 
 namespace Media {
@@ -55,6 +56,31 @@ bool isAlignedImage(const QImage &image) {
 	return !(reinterpret_cast<uintptr_t>(image.constBits()) % kAlignImageBy) && !(image.bytesPerLine() % kAlignImageBy);
 }
 
+#ifdef TDESKTOP_FFMPEG_HW_DECODING
+const AVHWDeviceType kHwDeviceTypes[] = {
+#ifdef Q_OS_WIN
+	AV_HWDEVICE_TYPE_D3D11VA,
+	AV_HWDEVICE_TYPE_DXVA2,
+#elif defined Q_OS_MAC // Q_OS_WIN
+	AV_HWDEVICE_TYPE_VIDEOTOOLBOX,
+#else // Q_OS_WIN || Q_OS_MAC
+	AV_HWDEVICE_TYPE_VAAPI,
+	AV_HWDEVICE_TYPE_VDPAU,
+#endif // Q_OS_WIN || Q_OS_MAC
+};
+
+AVPixelFormat getHardwareFormat(AVCodecContext *context, const AVPixelFormat *formats) {
+	auto wanted = *static_cast<AVPixelFormat*>(context->opaque);
+	for (auto format = formats; *format != AV_PIX_FMT_NONE; ++format) {
+		if (*format == wanted) {
+			return wanted;
+		}
+	}
+	// The decoder can't use the device for this stream, decode in software.
+	return formats[0];
+}
+#endif // TDESKTOP_FFMPEG_HW_DECODING
+
 } // namespace
 
 FFMpegReaderImplementation::FFMpegReaderImplementation(FileLocation *location, QByteArray *data, const AudioMsgId &audio) : ReaderImplementation(location, data)
@@ -74,6 +100,9 @@ ReaderImplementation::ReadResult FFMpegReaderImplementation::readNextFrame() {
 	do {
 		int res = avcodec_receive_frame(_codecContext, _frame);
 		if (res >= 0) {
+			if (!transferHardwareFrame()) {
+				return ReadResult::Error;
+			}
 			processReadFrame();
 			return ReadResult::Success;
 		}
@@ -148,6 +177,58 @@ ReaderImplementation::ReadResult FFMpegReaderImplementation::readNextFrame() {
 	return ReadResult::Error;
 }
 
+void FFMpegReaderImplementation::initHardwareDecoding() {
+#ifdef TDESKTOP_FFMPEG_HW_DECODING
+	if (!cHardwareVideoDecoding() || _mode == Mode::Inspecting || !_codec) {
+		return;
+	}
+	for (auto type : kHwDeviceTypes) {
+		for (auto i = 0;; ++i) {
+			auto config = avcodec_get_hw_config(_codec, i);
+			if (!config) {
+				break;
+			} else if (config->device_type != type || !(config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) {
+				continue;
+			}
+			AVBufferRef *device = nullptr;
+			if (av_hwdevice_ctx_create(&device, type, nullptr, nullptr, 0) < 0) {
+				break;
+			}
+			_hwFormat = config->pix_fmt;
+			_codecContext->hw_device_ctx = device;
+			_codecContext->opaque = &_hwFormat;
+			_codecContext->get_format = getHardwareFormat;
+			DEBUG_LOG(("Gif Info: Using %1 hardware decoding %2").arg(av_hwdevice_get_type_name(type)).arg(logData()));
+			return;
+		}
+	}
+#endif // TDESKTOP_FFMPEG_HW_DECODING
+}
+
+bool FFMpegReaderImplementation::transferHardwareFrame() {
+#ifdef TDESKTOP_FFMPEG_HW_DECODING
+	if (_hwFormat == AV_PIX_FMT_NONE || _frame->format != _hwFormat) {
+		return true;
+	}
+	if (!_hwTransferFrame) {
+		_hwTransferFrame = av_frame_alloc();
+	}
+	auto res = av_hwframe_transfer_data(_hwTransferFrame, _frame, 0);
+	if (res >= 0) {
+		res = av_frame_copy_props(_hwTransferFrame, _frame);
+	}
+	if (res < 0) {
+		av_frame_unref(_hwTransferFrame);
+		char err[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+		LOG(("Gif Error: Unable to av_hwframe_transfer_data() %1, error %2, %3").arg(logData()).arg(res).arg(av_make_error_string(err, sizeof(err), res)));
+		return false;
+	}
+	av_frame_unref(_frame);
+	av_frame_move_ref(_frame, _hwTransferFrame);
+#endif // TDESKTOP_FFMPEG_HW_DECODING
+	return true;
+}
+
 void FFMpegReaderImplementation::processReadFrame() {
 	int64 duration = av_frame_get_pkt_duration(_frame);
 	int64 framePts = _frame->pts;
@@ -355,6 +436,7 @@ bool FFMpegReaderImplementation::start(Mode mode, TimeMs &positionMs) {
 	av_opt_set_int(_codecContext, "refcounted_frames", 1, 0);
 
 	_codec = avcodec_find_decoder(_codecContext->codec_id);
+	initHardwareDecoding();
 
 	_audioStreamId = av_find_best_stream(_fmtContext, AVMEDIA_TYPE_AUDIO, -1, -1, 0, 0);
 	if (_mode == Mode::Inspecting) {
@@ -408,10 +490,17 @@ bool FFMpegReaderImplementation::start(Mode mode, TimeMs &positionMs) {
 		}
 	}
 
+	if (_mode == Mode::Normal) {
+		rememberKeyframes();
+	}
+
 	AVPacket packet;
 	auto readResult = readPacket(&packet);
 	if (readResult == PacketResult::Ok && positionMs > 0) {
 		positionMs = countPacketMs(&packet);
+		if (_mode == Mode::Normal && _audioMsgId.audio() && (packet.flags & AV_PKT_FLAG_KEY)) {
+			RememberKeyframe(_audioMsgId.audio()->id, positionMs);
+		}
 	}
 
 	if (hasAudio()) {
@@ -488,6 +577,9 @@ FFMpegReaderImplementation::~FFMpegReaderImplementation() {
 	}
 	if (_fmtContext) avformat_free_context(_fmtContext);
 	av_frame_free(&_frame);
+#ifdef TDESKTOP_FFMPEG_HW_DECODING
+	if (_hwTransferFrame) av_frame_free(&_hwTransferFrame);
+#endif // TDESKTOP_FFMPEG_HW_DECODING
 }
 
 FFMpegReaderImplementation::PacketResult FFMpegReaderImplementation::readPacket(AVPacket *packet) {
@@ -542,6 +634,38 @@ TimeMs FFMpegReaderImplementation::countPacketMs(AVPacket *packet) const {
 	return packetMs;
 }
 
+void FFMpegReaderImplementation::rememberKeyframes() {
+	auto document = _audioMsgId.audio();
+	if (!document || KeyframesIndexed(document->id)) {
+		return;
+	}
+
+	// The container index is filled when the input is opened (mp4 sample tables,
+	// webm cues), so all the keyframes are usually known before the first seek.
+	auto stream = _fmtContext->streams[_streamId];
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+	auto count = avformat_index_get_entries_count(stream);
+	auto entryAt = [stream](int index) {
+		return avformat_index_get_entry(stream, index);
+	};
+#else // LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+	auto count = stream->nb_index_entries;
+	auto entryAt = [stream](int index) -> const AVIndexEntry* {
+		return stream->index_entries + index;
+	};
+#endif // LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+
+	auto positions = std::vector<TimeMs>();
+	positions.reserve(count);
+	for (auto i = 0; i != count; ++i) {
+		auto entry = entryAt(i);
+		if (entry && (entry->flags & AVINDEX_KEYFRAME)) {
+			positions.push_back((entry->timestamp * 1000LL * stream->time_base.num) / stream->time_base.den);
+		}
+	}
+	RememberKeyframes(document->id, std::move(positions));
+}
+
 FFMpegReaderImplementation::PacketResult FFMpegReaderImplementation::readAndProcessPacket() {
 	AVPacket packet;
 	auto result = readPacket(&packet);
@@ -22,10 +22,22 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 extern "C" {
 
+#include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 
 } // extern "C"
 
+// The generic hardware decoding API is available since FFmpeg 4.0.
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+#define TDESKTOP_FFMPEG_HW_DECODING
+
+extern "C" {
+
+#include <libavutil/hwcontext.h>
+
+} // extern "C"
+#endif // LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+
 #include "media/media_clip_implementation.h"
 #include "media/media_child_ffmpeg_loader.h"
 
@@ -62,6 +74,10 @@ private:
 	ReadResult readNextFrame();
 	void processReadFrame();
 
+	// Tries the platform decoding devices, falls back to software decoding silently.
+	void initHardwareDecoding();
+	bool transferHardwareFrame();
+
 	enum class PacketResult {
 		Ok,
 		EndOfFile,
@@ -70,6 +86,7 @@ private:
 	PacketResult readPacket(AVPacket *packet);
 	void processPacket(AVPacket *packet);
 	TimeMs countPacketMs(AVPacket *packet) const;
+	void rememberKeyframes();
 	PacketResult readAndProcessPacket();
 
 	enum class Rotation {
@@ -101,6 +118,10 @@ private:
 	AVCodecContext *_codecContext = nullptr;
 	int _streamId = 0;
 	AVFrame *_frame = nullptr;
+#ifdef TDESKTOP_FFMPEG_HW_DECODING
+	AVPixelFormat _hwFormat = AV_PIX_FMT_NONE;
+	AVFrame *_hwTransferFrame = nullptr;
+#endif // TDESKTOP_FFMPEG_HW_DECODING
 	bool _opened = false;
 	bool _hadFrame = false;
 	bool _frameRead = false;
@@ -20,12 +20,55 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "media/media_clip_implementation.h"
 
+#include "storage/storage_streamed_file.h"
+
 namespace Media {
 namespace Clip {
 namespace internal {
 
+StreamedFileDevice::StreamedFileDevice(std::shared_ptr<Storage::StreamedFile> streamed, base::lambda<bool()> interrupted)
+: _streamed(std::move(streamed))
+, _interrupted(std::move(interrupted))
+, _file(_streamed->path()) {
+}
+
+bool StreamedFileDevice::open(OpenMode mode) {
+	if (mode != QIODevice::ReadOnly || !_file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	// No QIODevice buffering: it would read ahead through the parts we wait for.
+	return QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+void StreamedFileDevice::close() {
+	QIODevice::close();
+	_file.close();
+}
+
+qint64 StreamedFileDevice::size() const {
+	return _streamed->size();
+}
+
+qint64 StreamedFileDevice::readData(char *data, qint64 maxlen) {
+	auto offset = pos();
+	if (offset >= size()) {
+		return 0;
+	}
+	auto available = _streamed->waitForData(offset, maxlen, _interrupted);
+	if (!available || !_file.seek(offset)) {
+		return -1;
+	}
+	return _file.read(data, available);
+}
+
 void ReaderImplementation::initDevice() {
-	if (_data->isEmpty()) {
+	if (_streamed) {
+		_streamedDevice = std::make_unique<StreamedFileDevice>(_streamed, _interrupted);
+		_dataSize = _streamed->size();
+		_device = _streamedDevice.get();
+		return;
+	} else if (_data->isEmpty()) {
 		if (_file.isOpen()) _file.close();
 		_file.setFileName(_location->name());
 		_dataSize = _file.size();
@@ -22,10 +22,39 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 class FileLocation;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Media {
 namespace Clip {
 namespace internal {
 
+// Reads a file that is still being downloaded, blocks until the data is available.
+class StreamedFileDevice : public QIODevice {
+public:
+	StreamedFileDevice(std::shared_ptr<Storage::StreamedFile> streamed, base::lambda<bool()> interrupted);
+
+	bool open(OpenMode mode) override;
+	void close() override;
+	bool isSequential() const override {
+		return false;
+	}
+	qint64 size() const override;
+
+protected:
+	qint64 readData(char *data, qint64 maxlen) override;
+	qint64 writeData(const char *data, qint64 len) override {
+		return -1;
+	}
+
+private:
+	std::shared_ptr<Storage::StreamedFile> _streamed;
+	base::lambda<bool()> _interrupted;
+	QFile _file;
+
+};
+
 class ReaderImplementation {
 public:
 	ReaderImplementation(FileLocation *location, QByteArray *data)
@@ -58,6 +87,12 @@ public:
 
 	virtual bool start(Mode mode, TimeMs &positionMs) = 0;
 
+	// Play the file while it is downloaded, instead of the location and the data.
+	void setStreamed(std::shared_ptr<Storage::StreamedFile> streamed, base::lambda<bool()> interrupted) {
+		_streamed = std::move(streamed);
+		_interrupted = std::move(interrupted);
+	}
+
 	virtual ~ReaderImplementation() {
 	}
 	int64 dataSize() const {
@@ -72,6 +107,10 @@ protected:
 	QIODevice *_device = nullptr;
 	int64 _dataSize = 0;
 
+	std::shared_ptr<Storage::StreamedFile> _streamed;
+	base::lambda<bool()> _interrupted;
+	std::unique_ptr<StreamedFileDevice> _streamedDevice;
+
 	void initDevice();
 
 };
@@ -21,6 +21,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_clip_reader.h"
 
 #include "storage/file_download.h"
+#include "storage/storage_streamed_file.h"
+#include "core/trace.h"
+#include "core/memory_stats.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -38,9 +41,44 @@ namespace Media {
 namespace Clip {
 namespace {
 
+constexpr auto kFrameLateThreshold = TimeMs(20);
+constexpr auto kKeyframesDocumentsLimit = 32;
+constexpr auto kPlayingGifsAreaLimit = int64(16) * AverageGifSize; // pixels of displayed GIFs each thread decodes at once
+constexpr auto kThrottledGifCheckMs = TimeMs(100);
+
 QVector<QThread*> threads;
 QVector<Manager*> managers;
 
+struct DocumentKeyframes {
+	std::vector<TimeMs> positions;
+	bool indexed = false;
+};
+
+struct KeyframesCache {
+	QMutex mutex;
+	std::map<DocumentId, DocumentKeyframes> documents;
+	std::vector<DocumentId> order; // least recently added document first
+};
+
+KeyframesCache &Keyframes() {
+	static KeyframesCache result;
+	return result;
+}
+
+// Must be called with the cache mutex locked.
+DocumentKeyframes &KeyframesForDocument(KeyframesCache &cache, DocumentId documentId) {
+	auto i = cache.documents.find(documentId);
+	if (i != cache.documents.end()) {
+		return i->second;
+	}
+	if (cache.order.size() >= kKeyframesDocumentsLimit) {
+		cache.documents.erase(cache.order.front());
+		cache.order.erase(cache.order.begin());
+	}
+	cache.order.push_back(documentId);
+	return cache.documents[documentId];
+}
+
 QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bool hasAlpha, QImage &cache) {
 	auto needResize = (original.width() != request.framew) || (original.height() != request.frameh);
 	auto needOuterFill = (request.outerw != request.framew) || (request.outerh != request.frameh);
@@ -50,6 +88,7 @@ QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bo
 	}
 
 	auto factor = request.factor;
+	auto copyOpaque = !needResize && !hasAlpha && (original.format() == QImage::Format_ARGB32 || original.format() == QImage::Format_ARGB32_Premultiplied || original.format() == QImage::Format_RGB32);
 	auto needNewCache = (cache.width() != request.outerw || cache.height() != request.outerh);
 	if (needNewCache) {
 		cache = QImage(request.outerw, request.outerh, QImage::Format_ARGB32_Premultiplied);
@@ -77,10 +116,25 @@ QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bo
 			auto dst = QRect(position, QSize(request.framew / factor, request.frameh / factor));
 			auto src = QRect(0, 0, original.width(), original.height());
 			p.drawImage(dst, original, src, Qt::ColorOnly);
-		} else {
+		} else if (!copyOpaque) {
 			p.drawImage(position, original);
 		}
 	}
+	if (copyOpaque) {
+		// Opaque ARGB32 pixels are already premultiplied, so the frame lines
+		// are copied as they are instead of a per pixel conversion by QPainter.
+		auto left = qMax(0, (request.outerw - request.framew) / 2);
+		auto top = qMax(0, (request.outerh - request.frameh) / 2);
+		auto width = qMin(original.width(), cache.width() - left);
+		auto height = qMin(original.height(), cache.height() - top);
+		auto from = original.constBits();
+		auto fromPerLine = original.bytesPerLine();
+		auto to = cache.bits() + top * cache.bytesPerLine() + left * 4;
+		auto toPerLine = cache.bytesPerLine();
+		for (auto y = 0; y < height; ++y) {
+			memcpy(to + y * toPerLine, from + y * fromPerLine, width * 4);
+		}
+	}
 	if (needRounding) {
 		Images::prepareRound(cache, request.radius, request.corners);
 	}
@@ -105,11 +159,13 @@ Reader::Reader(not_null<DocumentData*> document, FullMsgId msgId, Callback &&cal
 , _mode(mode)
 , _audioMsgId(document, msgId, (mode == Mode::Video) ? rand_value<uint32>() : 0)
 , _seekPositionMs(seekMs) {
-	init(document->location(), document->data());
+	// Videos can start playing while they are still being downloaded.
+	auto streamed = (mode == Mode::Video && !document->loaded()) ? document->streamedFile() : nullptr;
+	init(document->location(), document->data(), std::move(streamed));
 }
 
-void Reader::init(const FileLocation &location, const QByteArray &data) {
-	if (threads.size() < ClipThreadsCount) {
+void Reader::init(const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed) {
+	if (threads.size() < ThreadsCount()) {
 		_threadIndex = threads.size();
 		threads.push_back(new QThread());
 		managers.push_back(new Manager(threads.back()));
@@ -125,7 +181,7 @@ void Reader::init(const FileLocation &location, const QByteArray &data) {
 			}
 		}
 	}
-	managers.at(_threadIndex)->append(this, location, data);
+	managers.at(_threadIndex)->append(this, location, data, std::move(streamed));
 }
 
 Reader::Frame *Reader::frameToShow(int32 *index) const { // 0 means not ready
@@ -363,12 +419,16 @@ Reader::~Reader() {
 
 class ReaderPrivate {
 public:
-	ReaderPrivate(Reader *reader, const FileLocation &location, const QByteArray &data) : _interface(reader)
+	ReaderPrivate(Reader *reader, const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed, not_null<const Manager*> manager) : _interface(reader)
 	, _mode(reader->mode())
 	, _audioMsgId(reader->audioMsgId())
 	, _seekPositionMs(reader->seekPositionMs())
-	, _data(data) {
-		if (_data.isEmpty()) {
+	, _data(data)
+	, _streamed(std::move(streamed)) {
+		if (_streamed) {
+			_data = QByteArray();
+			_interrupted = [this, manager] { return manager->stopped(this); };
+		} else if (_data.isEmpty()) {
 			_location = std::make_unique<FileLocation>(location);
 			if (!_location->accessEnable()) {
 				error();
@@ -390,6 +450,9 @@ public:
 
 				auto firstFramePositionMs = TimeMs(0);
 				auto reader = std::make_unique<internal::FFMpegReaderImplementation>(_location.get(), &_data, AudioMsgId());
+				if (_streamed) {
+					reader->setStreamed(_streamed, _interrupted);
+				}
 				if (reader->start(internal::ReaderImplementation::Mode::Normal, firstFramePositionMs)) {
 					auto firstFrameReadResult = reader->readFramesTill(-1, ms);
 					if (firstFrameReadResult == internal::ReaderImplementation::ReadResult::Success) {
@@ -442,7 +505,7 @@ public:
 			}
 		}
 
-		if (!_autoPausedGif && !_videoPausedAtMs && ms >= _nextFrameWhen) {
+		if (!_autoPausedGif && !_videoPausedAtMs && !_throttledAtMs && ms >= _nextFrameWhen) {
 			return ProcessResult::Repaint;
 		}
 		return ProcessResult::Wait;
@@ -482,10 +545,25 @@ public:
 		frame()->pix = PrepareFrame(_request, frame()->original, frame()->alpha, frame()->cache);
 		frame()->when = _nextFrameWhen;
 		frame()->positionMs = _nextFramePositionMs;
+		updateMemoryUsage();
 		return true;
 	}
 
+	void updateMemoryUsage() {
+		auto bytes = int64(_data.size());
+		for (auto &frame : _frames) {
+			bytes += frame.original.byteCount() + frame.cache.byteCount();
+			bytes += int64(frame.pix.width()) * frame.pix.height() * 4;
+		}
+		_memory.setBytes(bytes);
+	}
+
 	bool init() {
+		if (_streamed) {
+			_implementation = std::make_unique<internal::FFMpegReaderImplementation>(_location.get(), &_data, _audioMsgId);
+			_implementation->setStreamed(_streamed, _interrupted);
+			return _implementation->start(internal::ReaderImplementation::Mode::Normal, _seekPositionMs);
+		}
 		if (_data.isEmpty() && QFileInfo(_location->name()).size() <= Storage::kMaxAnimationInMemory) {
 			QFile f(_location->name());
 			if (f.open(QIODevice::ReadOnly)) {
@@ -522,6 +600,29 @@ public:
 		}
 	}
 
+	bool throttleable() const {
+		return (_mode == Reader::Mode::Gif) && _started && !_autoPausedGif && (_state != State::Error) && (_state != State::Finished);
+	}
+	int64 area() const {
+		return int64(_width) * _height;
+	}
+
+	void throttle(TimeMs ms) {
+		if (!_throttledAtMs) {
+			_throttledAtMs = ms;
+		}
+	}
+
+	void unthrottle(TimeMs ms) {
+		if (!_throttledAtMs) return; // Not throttled.
+
+		// Continue from the frozen frame, not from the current time.
+		auto delta = ms - _throttledAtMs;
+		_animationStarted += delta;
+		_nextFrameWhen += delta;
+		_throttledAtMs = 0;
+	}
+
 	void resumeVideo(TimeMs ms) {
 		if (!_videoPausedAtMs) return; // Not paused.
 
@@ -572,6 +673,9 @@ private:
 	std::unique_ptr<FileLocation> _location;
 	bool _accessed = false;
 
+	std::shared_ptr<Storage::StreamedFile> _streamed;
+	base::lambda<bool()> _interrupted;
+
 	QBuffer _buffer;
 	std::unique_ptr<internal::ReaderImplementation> _implementation;
 
@@ -594,6 +698,8 @@ private:
 	int _width = 0;
 	int _height = 0;
 
+	MemoryStats::Tracker<MemoryStats::Kind::ClipReaders> _memory;
+
 	bool _hasAudio = false;
 	TimeMs _durationMs = 0;
 	TimeMs _animationStarted = 0;
@@ -603,6 +709,7 @@ private:
 	bool _autoPausedGif = false;
 	bool _started = false;
 	TimeMs _videoPausedAtMs = 0;
+	TimeMs _throttledAtMs = 0;
 
 	friend class Manager;
 
@@ -621,8 +728,8 @@ Manager::Manager(QThread *thread) : _processingInThread(0), _needReProcess(false
 	anim::registerClipManager(this);
 }
 
-void Manager::append(Reader *reader, const FileLocation &location, const QByteArray &data) {
-	reader->_private = new ReaderPrivate(reader, location, data);
+void Manager::append(Reader *reader, const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed) {
+	reader->_private = new ReaderPrivate(reader, location, data, std::move(streamed), this);
 	_loadLevel.fetchAndAddRelaxed(AverageGifSize);
 	update(reader);
 }
@@ -669,6 +776,11 @@ Manager::ReaderPointers::const_iterator Manager::constUnsafeFindReaderPointer(Re
 	return (it == _readerPointers.cend() || it.key()->_private == reader) ? it : _readerPointers.cend();
 }
 
+bool Manager::stopped(ReaderPrivate *reader) const {
+	QMutexLocker lock(&_readerPointersMutex);
+	return (constUnsafeFindReaderPointer(reader) == _readerPointers.cend());
+}
+
 bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms) {
 	QMutexLocker lock(&_readerPointersMutex);
 	auto it = unsafeFindReaderPointer(reader);
@@ -731,6 +843,34 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 	return true;
 }
 
+void Manager::throttleGifs(TimeMs ms) {
+	// Only the displayed GIFs are decoded, the others are auto paused.
+	// If they don't fit in the thread budget, some of them freeze on the
+	// current frame until the budget is freed by another GIF.
+	auto playing = int64(0);
+	for (auto i = _readers.cbegin(), e = _readers.cend(); i != e; ++i) {
+		auto reader = i.key();
+		if (reader->throttleable() && !reader->_throttledAtMs) {
+			playing += reader->area();
+		}
+	}
+	for (auto i = _readers.begin(), e = _readers.end(); i != e; ++i) {
+		auto reader = i.key();
+		if (!reader->throttleable()) {
+			reader->unthrottle(ms);
+		} else if (!reader->_throttledAtMs) {
+			if (playing > kPlayingGifsAreaLimit && playing > reader->area()) {
+				reader->throttle(ms);
+				playing -= reader->area();
+			}
+		} else if (!playing || playing + reader->area() <= kPlayingGifsAreaLimit) {
+			reader->unthrottle(ms);
+			playing += reader->area();
+			i.value() = ms;
+		}
+	}
+}
+
 Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms) {
 	if (!handleProcessResult(reader, result, ms)) {
 		_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : AverageGifSize));
@@ -770,6 +910,7 @@ void Manager::process() {
 		_needReProcess = true;
 		return;
 	}
+	TRACE_SCOPE("Clip::Manager::process");
 
 	_timer.stop();
 	_processingInThread = thread();
@@ -802,9 +943,14 @@ void Manager::process() {
 		checkAllReaders = (_readers.size() > _readerPointers.size());
 	}
 
+	throttleGifs(ms);
+
 	for (auto i = _readers.begin(), e = _readers.end(); i != e;) {
 		ReaderPrivate *reader = i.key();
 		if (i.value() <= ms) {
+			if (reader->_started && !reader->_autoPausedGif && i.value() > 0 && ms - i.value() > kFrameLateThreshold) {
+				_framesLate.fetchAndAddRelaxed(1);
+			}
 			ResultHandleState state = handleResult(reader, reader->process(ms), ms);
 			if (state == ResultHandleRemove) {
 				i = _readers.erase(i);
@@ -816,6 +962,8 @@ void Manager::process() {
 			ms = getms();
 			if (reader->_videoPausedAtMs) {
 				i.value() = ms + 86400 * 1000ULL;
+			} else if (reader->_throttledAtMs) {
+				i.value() = ms + kThrottledGifCheckMs;
 			} else if (reader->_nextFrameWhen && reader->_started) {
 				i.value() = reader->_nextFrameWhen;
 			} else {
@@ -908,6 +1056,59 @@ FileLoadTask::Video PrepareForSending(const QString &fname, const QByteArray &da
 	return result;
 }
 
+bool KeyframesIndexed(DocumentId documentId) {
+	auto &cache = Keyframes();
+	QMutexLocker lock(&cache.mutex);
+	auto i = cache.documents.find(documentId);
+	return (i != cache.documents.end()) && i->second.indexed;
+}
+
+void RememberKeyframes(DocumentId documentId, std::vector<TimeMs> &&positions) {
+	auto &cache = Keyframes();
+	QMutexLocker lock(&cache.mutex);
+	auto &keyframes = KeyframesForDocument(cache, documentId);
+	if (keyframes.indexed) {
+		return;
+	}
+	keyframes.indexed = true;
+
+	auto &list = keyframes.positions;
+	list.insert(list.end(), positions.begin(), positions.end());
+	std::sort(list.begin(), list.end());
+	list.erase(std::unique(list.begin(), list.end()), list.end());
+}
+
+void RememberKeyframe(DocumentId documentId, TimeMs positionMs) {
+	auto &cache = Keyframes();
+	QMutexLocker lock(&cache.mutex);
+	auto &list = KeyframesForDocument(cache, documentId).positions;
+	auto i = std::lower_bound(list.begin(), list.end(), positionMs);
+	if (i == list.end() || *i != positionMs) {
+		list.insert(i, positionMs);
+	}
+}
+
+TimeMs KeyframeBefore(DocumentId documentId, TimeMs positionMs) {
+	auto &cache = Keyframes();
+	QMutexLocker lock(&cache.mutex);
+	auto i = cache.documents.find(documentId);
+	if (i == cache.documents.end()) {
+		return -1;
+	}
+	auto &list = i->second.positions;
+	auto j = std::upper_bound(list.begin(), list.end(), positionMs);
+	return (j == list.begin()) ? -1 : *(j - 1);
+}
+
+QVector<int> FramesLate() {
+	auto result = QVector<int>();
+	result.reserve(managers.size());
+	for_const (auto manager, managers) {
+		result.push_back(manager->framesLate());
+	}
+	return result;
+}
+
 void Finish() {
 	if (!threads.isEmpty()) {
 		for (int32 i = 0, l = threads.size(); i < l; ++i) {
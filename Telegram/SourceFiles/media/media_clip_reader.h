@@ -24,6 +24,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 class FileLocation;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Media {
 namespace Clip {
 
@@ -129,7 +133,7 @@ public:
 	~Reader();
 
 private:
-	void init(const FileLocation &location, const QByteArray &data);
+	void init(const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed = nullptr);
 
 	Callback _callback;
 	Mode _mode;
@@ -203,11 +207,18 @@ public:
 	int32 loadLevel() const {
 		return _loadLevel.load();
 	}
-	void append(Reader *reader, const FileLocation &location, const QByteArray &data);
+	int framesLate() const {
+		return _framesLate.load();
+	}
+	void append(Reader *reader, const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed);
 	void start(Reader *reader);
 	void update(Reader *reader);
 	void stop(Reader *reader);
 	bool carries(Reader *reader) const;
+
+	// Called by a reader that is blocked waiting for the streamed file data.
+	bool stopped(ReaderPrivate *reader) const;
+
 	~Manager();
 
 signals:
@@ -224,6 +235,7 @@ private:
 	void clear();
 
 	QAtomicInt _loadLevel;
+	QAtomicInt _framesLate;
 	using ReaderPointers = QMap<Reader*, QAtomicInt>;
 	ReaderPointers _readerPointers;
 	mutable QMutex _readerPointersMutex;
@@ -232,6 +244,7 @@ private:
 	ReaderPointers::iterator unsafeFindReaderPointer(ReaderPrivate *reader);
 
 	bool handleProcessResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms);
+	void throttleGifs(TimeMs ms);
 
 	enum ResultHandleState {
 		ResultHandleRemove,
@@ -251,6 +264,18 @@ private:
 
 FileLoadTask::Video PrepareForSending(const QString &fname, const QByteArray &data);
 
+// Keyframe positions of the opened videos, taken from the container index
+// and from the positions where the seeks have landed, kept per document.
+bool KeyframesIndexed(DocumentId documentId);
+void RememberKeyframes(DocumentId documentId, std::vector<TimeMs> &&positions);
+void RememberKeyframe(DocumentId documentId, TimeMs positionMs);
+
+// Returns the last known keyframe not later than positionMs or -1 if there is none.
+TimeMs KeyframeBefore(DocumentId documentId, TimeMs positionMs);
+
+// Count of frames each decoding thread has started to process too late.
+QVector<int> FramesLate();
+
 void Finish();
 
 } // namespace Clip
@@ -310,6 +310,14 @@ void Instance::stopSeeking(AudioMsgId::Type type) {
 }
 
 void Instance::documentLoadProgress(DocumentData *document) {
+	if (document->loaded()) {
+		// The next track was downloaded while the current one plays.
+		if (auto data = getData(document->song() ? AudioMsgId::Type::Song : AudioMsgId::Type::Voice)) {
+			if (data->isPlaying) {
+				preloadNext(data);
+			}
+		}
+	}
 	emitUpdate(document->song() ? AudioMsgId::Type::Song : AudioMsgId::Type::Voice, [document](const AudioMsgId &audioId) {
 		return (audioId.audio() == document);
 	});
@@ -362,6 +370,8 @@ void Instance::preloadNext(Data *data) {
 			if (auto document = media->getDocument()) {
 				if (!document->loaded(DocumentData::FilePathResolveSaveFromDataSilent)) {
 					DocumentOpenClickHandler::doOpen(document, nullptr, ActionOnLoadNone);
+				} else if (document->song() || document->voice()) {
+					mixer()->prepareNext(AudioMsgId(document, item->fullId()));
 				}
 			}
 		}
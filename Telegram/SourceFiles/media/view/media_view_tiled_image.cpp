@@ -0,0 +1,239 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "media/view/media_view_tiled_image.h"
+
+#include "base/task_queue.h"
+
+namespace Media {
+namespace View {
+namespace {
+
+constexpr auto kMinTiledImagePixels = 16 * 1000 * 1000;
+constexpr auto kTileSize = 512; // in pixels of the tile level
+constexpr auto kMaxLevel = 12;
+constexpr auto kMaxLoadingTiles = 4;
+constexpr auto kTilesSizeLimit = 64 * 1024 * 1024;
+
+int64 PixmapSize(const QPixmap &pixmap) {
+	return int64(pixmap.width()) * pixmap.height() * 4;
+}
+
+} // namespace
+
+std::unique_ptr<TiledImage> TiledImage::Create(const FileLocation &location, QSize previewSize, base::lambda<void()> updated) {
+	QImageReader reader(location.name());
+	auto size = reader.size();
+	if (size.isEmpty() || int64(size.width()) * size.height() < kMinTiledImagePixels) {
+		return nullptr;
+	}
+	if (!reader.supportsOption(QImageIOHandler::ClipRect) || !reader.supportsOption(QImageIOHandler::ScaledSize)) {
+		return nullptr;
+	}
+#ifndef OS_MAC_OLD
+	// Tiles are cut in the stored image coordinates, so we don't handle EXIF rotations.
+	if (reader.transformation() != QImageIOHandler::TransformationNone) {
+		return nullptr;
+	}
+#endif // OS_MAC_OLD
+	return std::make_unique<TiledImage>(location, size, previewSize, std::move(updated));
+}
+
+TiledImage::TiledImage(const FileLocation &location, QSize size, QSize previewSize, base::lambda<void()> updated)
+: _location(location)
+, _size(size)
+, _updated(std::move(updated)) {
+	_location.accessEnable();
+	loadPreview(previewSize);
+}
+
+TiledImage::TileKey TiledImage::ComputeKey(int level, int column, int row) {
+	return (TileKey(level) << 48) | (TileKey(column) << 24) | TileKey(row);
+}
+
+QRect TiledImage::tileSource(TileKey key) const {
+	auto level = int(key >> 48);
+	auto column = int((key >> 24) & 0xFFFFFFULL);
+	auto row = int(key & 0xFFFFFFULL);
+	auto side = (kTileSize << level);
+	return QRect(column * side, row * side, side, side).intersected(QRect(QPoint(), _size));
+}
+
+QSize TiledImage::tileScaled(TileKey key) const {
+	auto factor = (1 << int(key >> 48));
+	auto source = tileSource(key);
+	return QSize(
+		qMax((source.width() + factor - 1) / factor, 1),
+		qMax((source.height() + factor - 1) / factor, 1));
+}
+
+void TiledImage::loadPreview(QSize previewSize) {
+	auto scaled = _size.scaled(previewSize, Qt::KeepAspectRatio);
+	if (scaled.isEmpty()) {
+		return;
+	}
+	auto weak = base::weak_unique_ptr<TiledImage>(this);
+	base::TaskQueue::Normal().Put([weak, path = _location.name(), scaled] {
+		QImageReader reader(path);
+		reader.setScaledSize(scaled);
+		auto image = reader.read();
+		base::TaskQueue::Main().Put([weak, image = std::move(image)]() mutable {
+			if (auto that = weak.get()) {
+				that->previewReady(std::move(image));
+			}
+		});
+	});
+}
+
+void TiledImage::previewReady(QImage &&image) {
+	if (image.isNull()) {
+		return;
+	}
+	_preview = App::pixmapFromImageInPlace(std::move(image));
+	if (_updated) _updated();
+}
+
+void TiledImage::paint(Painter &p, QRect target, QRect clip) {
+	auto visible = target.intersected(clip);
+	auto needed = target.width() * cIntRetinaFactor();
+	if (visible.isEmpty() || target.width() <= 0 || target.height() <= 0 || needed <= _preview.width()) {
+		// The preview is enough for this zoom level.
+		_queue.clear();
+		_visible.clear();
+		return;
+	}
+
+	auto level = 0;
+	while (level < kMaxLevel && ((_size.width() >> (level + 1)) >= needed)) {
+		++level;
+	}
+	auto side = (kTileSize << level);
+	auto scaleX = _size.width() / float64(target.width());
+	auto scaleY = _size.height() / float64(target.height());
+	auto sourceLeft = qMax(int((visible.x() - target.x()) * scaleX), 0);
+	auto sourceTop = qMax(int((visible.y() - target.y()) * scaleY), 0);
+	auto sourceRight = qMin(int(std::ceil((visible.x() + visible.width() - target.x()) * scaleX)), _size.width());
+	auto sourceBottom = qMin(int(std::ceil((visible.y() + visible.height() - target.y()) * scaleY)), _size.height());
+
+	PainterHighQualityEnabler hq(p);
+	_queue.clear();
+	_visible.clear();
+	for (auto row = sourceTop / side; row * side < sourceBottom; ++row) {
+		for (auto column = sourceLeft / side; column * side < sourceRight; ++column) {
+			auto key = ComputeKey(level, column, row);
+			_visible.insert(key);
+
+			auto i = _tiles.find(key);
+			if (i == _tiles.end()) {
+				if (!_loading.contains(key)) {
+					_queue.push_back(key);
+				}
+				continue;
+			} else if (i->second.isNull()) {
+				continue;
+			}
+			auto source = tileSource(key);
+			auto rect = QRectF(
+				target.x() + source.x() / scaleX,
+				target.y() + source.y() / scaleY,
+				source.width() / scaleX,
+				source.height() / scaleY);
+			p.drawPixmap(rect, i->second, QRectF(i->second.rect()));
+		}
+	}
+	evictTiles(level);
+	startLoading();
+}
+
+void TiledImage::evictTiles(int level) {
+	// Tiles of other zoom levels are not needed when the current level tiles are visible.
+	for (auto i = _tiles.begin(); i != _tiles.end();) {
+		if (int(i->first >> 48) != level && !_visible.contains(i->first)) {
+			_tilesSize -= PixmapSize(i->second);
+			i = _tiles.erase(i);
+		} else {
+			++i;
+		}
+	}
+	for (auto i = _tiles.begin(); i != _tiles.end() && _tilesSize > kTilesSizeLimit;) {
+		if (!_visible.contains(i->first)) {
+			_tilesSize -= PixmapSize(i->second);
+			i = _tiles.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+void TiledImage::startLoading() {
+	auto started = 0;
+	for (auto key : _queue) {
+		if (int(_loading.size()) >= kMaxLoadingTiles) {
+			break;
+		}
+		loadTile(key);
+		++started;
+	}
+	_queue.erase(_queue.begin(), _queue.begin() + started);
+}
+
+void TiledImage::loadTile(TileKey key) {
+	_loading.insert(key);
+
+	auto weak = base::weak_unique_ptr<TiledImage>(this);
+	auto source = tileSource(key);
+	auto scaled = tileScaled(key);
+	base::TaskQueue::Normal().Put([weak, path = _location.name(), key, source, scaled] {
+		QImageReader reader(path);
+		reader.setClipRect(source);
+		reader.setScaledSize(scaled);
+		auto image = reader.read();
+		base::TaskQueue::Main().Put([weak, key, image = std::move(image)]() mutable {
+			if (auto that = weak.get()) {
+				that->tileReady(key, std::move(image));
+			}
+		});
+	});
+}
+
+void TiledImage::tileReady(TileKey key, QImage &&image) {
+	_loading.remove(key);
+
+	// Failed tiles are remembered as null pixmaps so that we don't request them again.
+	auto &tile = _tiles[key];
+	_tilesSize -= PixmapSize(tile);
+	tile = image.isNull() ? QPixmap() : App::pixmapFromImageInPlace(std::move(image));
+	_tilesSize += PixmapSize(tile);
+
+	if (_visible.contains(key)) {
+		if (_updated) _updated();
+	} else if (_tilesSize > kTilesSizeLimit) {
+		_tilesSize -= PixmapSize(tile);
+		_tiles.remove(key);
+	}
+	startLoading();
+}
+
+TiledImage::~TiledImage() {
+	_location.accessDisable();
+}
+
+} // namespace View
+} // namespace Media
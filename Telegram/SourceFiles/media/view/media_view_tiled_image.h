@@ -0,0 +1,83 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+#include "base/weak_unique_ptr.h"
+#include "base/flat_map.h"
+#include "base/flat_set.h"
+
+namespace Media {
+namespace View {
+
+// Huge images (like 40 megapixel photos sent as files) are never decoded as a whole.
+// A screen-sized preview is decoded first and then the visible parts are decoded
+// in tiles at the resolution required by the current zoom, both in the background.
+class TiledImage : public base::enable_weak_from_this {
+public:
+	// Returns nullptr if the image is small enough to be decoded as a whole
+	// or if its format doesn't support decoding only a part of the image.
+	static std::unique_ptr<TiledImage> Create(const FileLocation &location, QSize previewSize, base::lambda<void()> updated);
+
+	TiledImage(const FileLocation &location, QSize size, QSize previewSize, base::lambda<void()> updated);
+
+	QSize size() const {
+		return _size;
+	}
+	const QPixmap &preview() const {
+		return _preview;
+	}
+
+	// Paints the decoded tiles of the image placed at target, visible in clip.
+	// Tiles that are not decoded yet are requested, tiles out of clip may be evicted.
+	void paint(Painter &p, QRect target, QRect clip);
+
+	~TiledImage();
+
+private:
+	using TileKey = quint64;
+
+	static TileKey ComputeKey(int level, int column, int row);
+	QRect tileSource(TileKey key) const;
+	QSize tileScaled(TileKey key) const;
+
+	void loadPreview(QSize previewSize);
+	void previewReady(QImage &&image);
+	void loadTile(TileKey key);
+	void tileReady(TileKey key, QImage &&image);
+	void startLoading();
+	void evictTiles(int level);
+
+	FileLocation _location;
+	QSize _size;
+	base::lambda<void()> _updated;
+	QPixmap _preview;
+
+	base::flat_map<TileKey, QPixmap> _tiles;
+	int64 _tilesSize = 0;
+	base::flat_set<TileKey> _visible;
+	base::flat_set<TileKey> _loading;
+	std::vector<TileKey> _queue;
+
+};
+
+} // namespace View
+} // namespace Media
@@ -29,6 +29,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/widgets/buttons.h"
 #include "media/media_clip_reader.h"
 #include "media/view/media_clip_controller.h"
+#include "media/view/media_view_tiled_image.h"
 #include "styles/style_mediaview.h"
 #include "styles/style_history.h"
 #include "media/media_audio.h"
@@ -44,6 +45,12 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace {
 
+// How many photos behind the current one (opposite to the flipping direction) we keep prepared.
+constexpr auto kPrefetchBehindCount = 1;
+
+// Memory limit for the neighbour photos prepared to the screen size.
+constexpr auto kPreparedPhotosSizeLimit = 96 * 1024 * 1024;
+
 TextParseOptions _captionTextOptions = {
 	TextParseLinks | TextParseMentions | TextParseHashtags | TextParseMultiline | TextParseRichText, // flags
 	0, // maxw
@@ -99,6 +106,7 @@ MediaView::MediaView() : TWidget(nullptr)
 			subscribe(Auth().downloaderTaskFinished(), [this] {
 				if (!isHidden()) {
 					updateControls();
+					preparePrefetchedPhotos();
 				}
 			});
 			subscribe(Auth().calls().currentCallChanged(), [this](Calls::Call *call) {
@@ -255,6 +263,9 @@ bool MediaView::gifShown() const {
 				_gif->pauseResumeVideo();
 				const_cast<MediaView*>(this)->_videoPaused = _gif->videoPaused();
 			}
+			if (_doc && !_gif->seekPositionMs()) {
+				_doc->savePoster(_gif->frameOriginal().toImage());
+			}
 			auto rounding = (_doc && _doc->isRoundVideo()) ? ImageRoundRadius::Ellipse : ImageRoundRadius::None;
 			_gif->start(_gif->width() / cIntRetinaFactor(), _gif->height() / cIntRetinaFactor(), _gif->width() / cIntRetinaFactor(), _gif->height() / cIntRetinaFactor(), rounding, ImageRoundCorner::All);
 			const_cast<MediaView*>(this)->_current = QPixmap();
@@ -267,6 +278,7 @@ bool MediaView::gifShown() const {
 }
 
 void MediaView::stopGif() {
+	clearSeekPreview();
 	_gif = nullptr;
 	_videoPaused = _videoStopped = _videoIsSilent = false;
 	_fullScreenVideo = false;
@@ -397,7 +409,7 @@ void MediaView::updateControls() {
 		_leftNavVisible = (_index > 0) || (_index == 0 && (
 			(!_msgmigrated && _history && _history->overview(_overview).size() < _history->overviewCount(_overview)) ||
 			(_msgmigrated && _migrated && _migrated->overview(_overview).size() < _migrated->overviewCount(_overview)) ||
-			(!_msgmigrated && _history && _migrated && (!_migrated->overview(_overview).isEmpty() || _migrated->overviewCount(_overview) > 0)))) ||
+			(!_msgmigrated && _history && _migrated && (!_migrated->overview(_overview).empty() || _migrated->overviewCount(_overview) > 0)))) ||
 			(_index < 0 && _photo == _additionalChatPhoto &&
 				((_history && _history->overviewCount(_overview) > 0) ||
 				(_migrated && _history->overviewLoaded(_overview) && _migrated->overviewCount(_overview) > 0))
@@ -405,7 +417,7 @@ void MediaView::updateControls() {
 		_rightNavVisible = (_index >= 0) && (
 			(!_msgmigrated && _history && _index + 1 < _history->overview(_overview).size()) ||
 			(_msgmigrated && _migrated && _index + 1 < _migrated->overview(_overview).size()) ||
-			(_msgmigrated && _migrated && _history && (!_history->overview(_overview).isEmpty() || _history->overviewCount(_overview) > 0)) ||
+			(_msgmigrated && _migrated && _history && (!_history->overview(_overview).empty() || _history->overviewCount(_overview) > 0)) ||
 			(!_msgmigrated && _history && _index + 1 == _history->overview(_overview).size() && _additionalChatPhoto) ||
 			(_msgmigrated && _migrated && _index + 1 == _migrated->overview(_overview).size() && _history->overviewCount(_overview) == 0 && _additionalChatPhoto) ||
 			(!_history && _user && (_index + 1 < _user->photos.size() || _index + 1 < _user->photosCount)));
@@ -570,6 +582,8 @@ void MediaView::step_radial(TimeMs ms, bool timer) {
 				location.accessDisable();
 			}
 		}
+	} else if (_doc && !_gif && _doc->isVideo() && _doc->streamedFile()) {
+		displayDocument(_doc, App::histItemById(_msgmigrated ? 0 : _channel, _msgid));
 	}
 }
 
@@ -617,7 +631,7 @@ void MediaView::zoomReset() {
 		newZoom = 0;
 	}
 	_x = -_width / 2;
-	_y = -((gifShown() ? _gif->height() : (_current.height() / cIntRetinaFactor())) / 2);
+	_y = -((gifShown() ? _gif->height() : (currentImageSize().height() / cIntRetinaFactor())) / 2);
 	float64 z = (_zoom == ZoomToScreenLevel) ? _zoomToScreen : _zoom;
 	if (z >= 0) {
 		_x = qRound(_x * (z + 1));
@@ -658,8 +672,10 @@ void MediaView::clearData() {
 	_user = nullptr;
 	_photo = _additionalChatPhoto = nullptr;
 	_doc = nullptr;
+	_tiledImage = nullptr;
 	_fullScreenVideo = false;
 	_caption.clear();
+	clearPreparedPhotos();
 }
 
 MediaView::~MediaView() {
@@ -1218,20 +1234,14 @@ void MediaView::displayPhoto(PhotoData *photo, HistoryItem *item) {
 	Auth().downloader().clearPriorities();
 	_full = -1;
 	_current = QPixmap();
+	_tiledImage = nullptr;
 	_down = OverNone;
-	_w = convertScale(photo->full->width());
-	_h = convertScale(photo->full->height());
 	if (isHidden()) {
 		moveToScreen();
 	}
-	if (_w > width()) {
-		_h = qRound(_h * width() / float64(_w));
-		_w = width();
-	}
-	if (_h > height()) {
-		_w = qRound(_w * height() / float64(_h));
-		_h = height();
-	}
+	auto size = fittedPhotoSize(photo);
+	_w = size.width();
+	_h = size.height();
 	_x = (width() - _w) / 2;
 	_y = (height() - _h) / 2;
 	_width = _w;
@@ -1244,6 +1254,128 @@ void MediaView::displayPhoto(PhotoData *photo, HistoryItem *item) {
 	displayFinished();
 }
 
+QSize MediaView::fittedPhotoSize(not_null<PhotoData*> photo) const {
+	auto w = convertScale(photo->full->width());
+	auto h = convertScale(photo->full->height());
+	if (w > width()) {
+		h = qRound(h * width() / float64(w));
+		w = width();
+	}
+	if (h > height()) {
+		w = qRound(w * height() / float64(h));
+		h = height();
+	}
+	return QSize(w, h);
+}
+
+void MediaView::prefetchPhoto(not_null<PhotoData*> photo) {
+	photo->download();
+	if (std::find(_prefetchPhotos.cbegin(), _prefetchPhotos.cend(), photo) == _prefetchPhotos.cend()) {
+		_prefetchPhotos.push_back(photo);
+	}
+}
+
+void MediaView::preparePrefetchedPhotos() {
+	for (auto photo : _prefetchPhotos) {
+		preparePhoto(photo);
+	}
+}
+
+void MediaView::preparePhoto(not_null<PhotoData*> photo) {
+	if (!photo->loaded() || _preparingPhotos.contains(photo)) {
+		return;
+	}
+
+	// Same size as the one the full image gets scaled to in paintEvent() with no zoom.
+	auto fitted = fittedPhotoSize(photo);
+	auto w = fitted.width() * cIntRetinaFactor();
+	auto h = int((photo->full->height() * (qreal(w) / qreal(photo->full->width()))) + 0.9999);
+	auto size = QSize(w, h);
+	if (w <= 0 || h <= 0) {
+		return;
+	}
+	auto i = _preparedPhotos.find(photo);
+	if (i != _preparedPhotos.end() && i->second.size == size) {
+		return;
+	}
+
+	// Prefer decoding the saved file content in the background,
+	// fall back to a copy of the already decoded image.
+	auto data = photo->full->savedData();
+	auto image = data.isEmpty() ? photo->full->pix().toImage() : QImage();
+	if (data.isEmpty() && image.isNull()) {
+		return;
+	}
+	_preparingPhotos.insert(photo);
+
+	auto ready = base::lambda_guarded(this, [this, photo, size](QImage &&result) {
+		photoPrepared(photo, size, std::move(result));
+	});
+	base::TaskQueue::Normal().Put([ready = std::move(ready), data, image = std::move(image), size]() mutable {
+		if (image.isNull()) {
+			image = App::readImage(data);
+		}
+		if (!image.isNull()) {
+			image = Images::prepare(std::move(image), size.width(), size.height(), Images::Option::Smooth, size.width(), size.height());
+		}
+		base::TaskQueue::Main().Put([ready = std::move(ready), result = std::move(image)]() mutable {
+			ready(std::move(result));
+		});
+	});
+}
+
+void MediaView::photoPrepared(not_null<PhotoData*> photo, QSize size, QImage &&image) {
+	_preparingPhotos.remove(photo);
+	auto wanted = (photo == _photo)
+		|| (std::find(_prefetchPhotos.cbegin(), _prefetchPhotos.cend(), photo) != _prefetchPhotos.cend());
+	if (image.isNull() || !wanted || isHidden()) {
+		return;
+	}
+
+	auto &prepared = _preparedPhotos[photo];
+	_preparedPhotosSize -= int64(prepared.size.width()) * prepared.size.height() * 4;
+	prepared.size = size;
+	prepared.pixmap = App::pixmapFromImageInPlace(std::move(image));
+	if (cRetina()) prepared.pixmap.setDevicePixelRatio(cRetinaFactor());
+	_preparedPhotosSize += int64(size.width()) * size.height() * 4;
+	forgetPreparedPhotos();
+
+	if (photo == _photo && _full <= 0) {
+		update();
+	}
+}
+
+void MediaView::forgetPreparedPhotos() {
+	auto isWanted = [this](not_null<PhotoData*> photo) {
+		return (photo == _photo)
+			|| (std::find(_prefetchPhotos.cbegin(), _prefetchPhotos.cend(), photo) != _prefetchPhotos.cend());
+	};
+	for (auto i = _preparedPhotos.begin(); i != _preparedPhotos.end();) {
+		if (isWanted(i->first)) {
+			++i;
+			continue;
+		}
+		_preparedPhotosSize -= int64(i->second.size.width()) * i->second.size.height() * 4;
+		i = _preparedPhotos.erase(i);
+	}
+
+	// Still above the limit: drop the farthest prefetched photos first.
+	for (auto i = _prefetchPhotos.size(); i != 0 && _preparedPhotosSize > kPreparedPhotosSizeLimit;) {
+		auto j = _preparedPhotos.find(_prefetchPhotos[--i]);
+		if (j != _preparedPhotos.end() && j->first != _photo) {
+			_preparedPhotosSize -= int64(j->second.size.width()) * j->second.size.height() * 4;
+			_preparedPhotos.erase(j);
+		}
+	}
+}
+
+void MediaView::clearPreparedPhotos() {
+	_preloadDirection = 0;
+	_prefetchPhotos.clear();
+	_preparedPhotos.clear();
+	_preparedPhotosSize = 0;
+}
+
 void MediaView::destroyThemePreview() {
 	_themePreviewId = 0;
 	_themePreviewShown = false;
@@ -1257,6 +1389,7 @@ void MediaView::displayDocument(DocumentData *doc, HistoryItem *item) { // empty
 	if (documentChanged || (!doc->isAnimation() && !doc->isVideo())) {
 		_fullScreenVideo = false;
 		_current = QPixmap();
+		_tiledImage = nullptr;
 		stopGif();
 	} else if (gifShown()) {
 		_current = QPixmap();
@@ -1292,7 +1425,10 @@ void MediaView::displayDocument(DocumentData *doc, HistoryItem *item) { // empty
 				auto &location = _doc->location(true);
 				if (location.accessEnable()) {
 					if (QImageReader(location.name()).canRead()) {
-						_current = App::pixmapFromImageInPlace(App::readImage(location.name(), 0, false));
+						createTiledImage(location);
+						if (!_tiledImage) {
+							_current = App::pixmapFromImageInPlace(App::readImage(location.name(), 0, false));
+						}
 					}
 				}
 				location.accessDisable();
@@ -1349,6 +1485,9 @@ void MediaView::displayDocument(DocumentData *doc, HistoryItem *item) { // empty
 		_docIconRect = myrtlrect(_docRect.x() + st::mediaviewFilePadding, _docRect.y() + st::mediaviewFilePadding, st::mediaviewFileIconSize, st::mediaviewFileIconSize);
 	} else if (_themePreviewShown) {
 		updateThemePreviewGeometry();
+	} else if (_tiledImage) {
+		_w = convertScale(_tiledImage->size().width());
+		_h = convertScale(_tiledImage->size().height());
 	} else if (!_current.isNull()) {
 		_current.setDevicePixelRatio(cRetinaFactor());
 		_w = convertScale(_current.width());
@@ -1398,6 +1537,36 @@ void MediaView::displayDocument(DocumentData *doc, HistoryItem *item) { // empty
 	displayFinished();
 }
 
+QSize MediaView::currentImageSize() const {
+	return _tiledImage ? _tiledImage->size() : _current.size();
+}
+
+void MediaView::createTiledImage(const FileLocation &location) {
+	if (isHidden()) {
+		moveToScreen();
+	}
+	auto previewSize = size() * cIntRetinaFactor();
+	auto updated = base::lambda_guarded(this, [this] {
+		if (_tiledImage && !_tiledImage->preview().isNull()) {
+			_current = _tiledImage->preview();
+		}
+		update();
+	});
+	_tiledImage = Media::View::TiledImage::Create(location, previewSize, std::move(updated));
+	if (!_tiledImage) {
+		return;
+	}
+
+	// Until the preview is decoded we show the blurred thumbnail or an empty placeholder.
+	if (_doc->thumb->loaded()) {
+		_current = _doc->thumb->pixNoCache(_doc->thumb->width(), _doc->thumb->height(), Images::Option::Smooth | Images::Option::Blurred);
+	} else {
+		auto placeholder = QImage(1, 1, QImage::Format_ARGB32_Premultiplied);
+		placeholder.fill(st::imageBg->c);
+		_current = App::pixmapFromImageInPlace(std::move(placeholder));
+	}
+}
+
 void MediaView::updateThemePreviewGeometry() {
 	if (_themePreviewShown) {
 		auto previewRect = QRect((width() - st::themePreviewSize.width()) / 2, (height() - st::themePreviewSize.height()) / 2, st::themePreviewSize.width(), st::themePreviewSize.height());
@@ -1448,6 +1617,8 @@ void MediaView::initAnimation() {
 	} else if (location.accessEnable()) {
 		createClipReader();
 		location.accessDisable();
+	} else if (_doc->isVideo() && _doc->streamedFile()) {
+		createClipReader();
 	} else if (_doc->dimensions.width() && _doc->dimensions.height()) {
 		auto w = _doc->dimensions.width();
 		auto h = _doc->dimensions.height();
@@ -1609,12 +1780,76 @@ void MediaView::onVideoSeekProgress(TimeMs positionMs) {
 	if (!_videoPaused && !_videoStopped) {
 		onVideoPauseResume();
 	}
+	updateSeekPreview(positionMs);
 }
 
 void MediaView::onVideoSeekFinished(TimeMs positionMs) {
+	if (seekPreviewShown()) {
+		// Keep showing the keyframe until the playback reader gets to the exact position.
+		auto rounding = (_doc && _doc->isRoundVideo()) ? ImageRoundRadius::Ellipse : ImageRoundRadius::None;
+		auto width = _seekPreview->width() / cIntRetinaFactor();
+		auto height = _seekPreview->height() / cIntRetinaFactor();
+		_current = _seekPreview->current(width, height, width, height, rounding, ImageRoundCorner::All, getms());
+	}
+	clearSeekPreview();
 	restartVideoAtSeekPosition(positionMs);
 }
 
+void MediaView::updateSeekPreview(TimeMs positionMs) {
+	if (!_gif || !_doc || !_doc->loaded()) {
+		return;
+	}
+	_seekPreviewWantedMs = Media::Clip::KeyframeBefore(_doc->id, positionMs);
+	if (_seekPreviewWantedMs < 0 || _seekPreviewWantedMs == _seekPreviewMs) {
+		return;
+	} else if (_seekPreview && !_seekPreview->started() && _seekPreview->state() != Media::Clip::State::Error) {
+		// Wait for the previous keyframe to be shown, the wanted one is requested after that.
+		return;
+	}
+	_seekPreviewMs = _seekPreviewWantedMs;
+	_seekPreview = Media::Clip::MakeReader(_doc, FullMsgId(_channel, _msgid), [this](Media::Clip::Notification notification) {
+		seekPreviewCallback(notification);
+	}, Media::Clip::Reader::Mode::Gif, _seekPreviewMs);
+}
+
+void MediaView::seekPreviewCallback(Media::Clip::Notification notification) {
+	using namespace Media::Clip;
+
+	if (!_seekPreview) return;
+
+	switch (notification) {
+	case NotificationReinit: {
+		if (_seekPreview->state() == State::Error) {
+			clearSeekPreview();
+		} else if (_seekPreview->ready() && !_seekPreview->started()) {
+			auto rounding = (_doc && _doc->isRoundVideo()) ? ImageRoundRadius::Ellipse : ImageRoundRadius::None;
+			auto width = _seekPreview->width() / cIntRetinaFactor();
+			auto height = _seekPreview->height() / cIntRetinaFactor();
+			_seekPreview->pauseResumeVideo();
+			_seekPreview->start(width, height, width, height, rounding, ImageRoundCorner::None);
+			if (_seekPreviewWantedMs != _seekPreviewMs) {
+				updateSeekPreview(_seekPreviewWantedMs);
+				return;
+			}
+		}
+		update(_x, _y, _w, _h);
+	} break;
+
+	case NotificationRepaint: {
+		update(_x, _y, _w, _h);
+	} break;
+	}
+}
+
+bool MediaView::seekPreviewShown() const {
+	return _seekPreview && _seekPreview->started();
+}
+
+void MediaView::clearSeekPreview() {
+	_seekPreview = nullptr;
+	_seekPreviewMs = _seekPreviewWantedMs = -1;
+}
+
 void MediaView::onVideoVolumeChanged(float64 volume) {
 	Global::SetVideoVolume(volume);
 	updateMixerVideoVolume();
@@ -1714,8 +1949,13 @@ void MediaView::paintEvent(QPaintEvent *e) {
 		int32 w = _width * cIntRetinaFactor();
 		if (_full <= 0 && _photo->loaded()) {
 			int32 h = int((_photo->full->height() * (qreal(w) / qreal(_photo->full->width()))) + 0.9999);
-			_current = _photo->full->pixNoCache(w, h, Images::Option::Smooth);
-			if (cRetina()) _current.setDevicePixelRatio(cRetinaFactor());
+			auto prepared = _preparedPhotos.find(_photo);
+			if (prepared != _preparedPhotos.end() && prepared->second.size == QSize(w, h)) {
+				_current = prepared->second.pixmap;
+			} else {
+				_current = _photo->full->pixNoCache(w, h, Images::Option::Smooth);
+				if (cRetina()) _current.setDevicePixelRatio(cRetinaFactor());
+			}
 			_full = 1;
 		} else if (_full < 0 && _photo->medium->loaded()) {
 			int32 h = int((_photo->full->height() * (qreal(w) / qreal(_photo->full->width()))) + 0.9999);
@@ -1735,7 +1975,9 @@ void MediaView::paintEvent(QPaintEvent *e) {
 		QRect imgRect(_x, _y, _w, _h);
 		if (imgRect.intersects(r)) {
 			auto rounding = (_doc && _doc->isRoundVideo()) ? ImageRoundRadius::Ellipse : ImageRoundRadius::None;
-			auto toDraw = _current.isNull() ? _gif->current(_gif->width() / cIntRetinaFactor(), _gif->height() / cIntRetinaFactor(), _gif->width() / cIntRetinaFactor(), _gif->height() / cIntRetinaFactor(), rounding, ImageRoundCorner::None, ms) : _current;
+			auto toDraw = seekPreviewShown()
+				? _seekPreview->current(_seekPreview->width() / cIntRetinaFactor(), _seekPreview->height() / cIntRetinaFactor(), _seekPreview->width() / cIntRetinaFactor(), _seekPreview->height() / cIntRetinaFactor(), rounding, ImageRoundCorner::None, ms)
+				: _current.isNull() ? _gif->current(_gif->width() / cIntRetinaFactor(), _gif->height() / cIntRetinaFactor(), _gif->width() / cIntRetinaFactor(), _gif->height() / cIntRetinaFactor(), rounding, ImageRoundCorner::None, ms) : _current;
 			if (!_gif && (!_doc || !_doc->sticker() || _doc->sticker()->img->isNull()) && toDraw.hasAlpha()) {
 				p.fillRect(imgRect, _transparentBrush);
 			}
@@ -1745,6 +1987,9 @@ void MediaView::paintEvent(QPaintEvent *e) {
 			} else {
 				p.drawPixmap(_x, _y, toDraw);
 			}
+			if (_tiledImage) {
+				_tiledImage->paint(p, imgRect, r);
+			}
 
 			bool radial = false;
 			float64 radialOpacity = 0;
@@ -2133,8 +2378,8 @@ void MediaView::setZoomLevel(int newZoom) {
 	if (_zoom == newZoom) return;
 
 	float64 nx, ny, z = (_zoom == ZoomToScreenLevel) ? _zoomToScreen : _zoom;
-	_w = gifShown() ? convertScale(_gif->width()) : (convertScale(_current.width()) / cIntRetinaFactor());
-	_h = gifShown() ? convertScale(_gif->height()) : (convertScale(_current.height()) / cIntRetinaFactor());
+	_w = gifShown() ? convertScale(_gif->width()) : (convertScale(currentImageSize().width()) / cIntRetinaFactor());
+	_h = gifShown() ? convertScale(_gif->height()) : (convertScale(currentImageSize().height()) / cIntRetinaFactor());
 	if (z >= 0) {
 		nx = (_x - width() / 2.) / (z + 1);
 		ny = (_y - height() / 2.) / (z + 1);
@@ -2259,9 +2504,15 @@ void MediaView::preloadData(int32 delta) {
 	}
 	if (!_user && _overview == OverviewCount) return;
 
-	auto from = indexInOverview + (delta ? delta : -1);
-	auto to = indexInOverview + (delta ? delta * MediaOverviewPreloadCount : 1);
+	// Prefetch window is shifted in the direction the user is flipping photos in.
+	if (delta) {
+		_preloadDirection = (delta > 0) ? 1 : -1;
+	}
+	auto direction = _preloadDirection;
+	auto from = indexInOverview - (direction ? direction * kPrefetchBehindCount : 1);
+	auto to = indexInOverview + (direction ? direction * MediaOverviewPreloadCount : 1);
 	if (from > to) qSwap(from, to);
+	_prefetchPhotos.clear();
 	if (_history && _overview != OverviewCount) {
 		auto forgetIndex = indexInOverview - delta * 2;
 		auto forgetHistory = indexOfMigratedItem ? _migrated : _history;
@@ -2304,7 +2555,7 @@ void MediaView::preloadData(int32 delta) {
 				if (auto item = App::histItemById(previewHistory->channelId(), getMsgIdFromOverview(previewHistory, previewIndex))) {
 					if (auto media = item->getMedia()) {
 						switch (media->type()) {
-						case MediaTypePhoto: static_cast<HistoryPhoto*>(media)->photo()->download(); break;
+						case MediaTypePhoto: prefetchPhoto(static_cast<HistoryPhoto*>(media)->photo()); break;
 						case MediaTypeFile:
 						case MediaTypeVideo:
 						case MediaTypeGif: {
@@ -2326,7 +2577,7 @@ void MediaView::preloadData(int32 delta) {
 		}
 		for (int32 i = from; i <= to; ++i) {
 			if (i >= 0 && i < _user->photos.size() && i != indexInOverview) {
-				_user->photos[i]->download();
+				prefetchPhoto(_user->photos[i]);
 			}
 		}
 		int32 forgetIndex = indexInOverview - delta * 2;
@@ -2334,6 +2585,8 @@ void MediaView::preloadData(int32 delta) {
 			_user->photos[forgetIndex]->forget();
 		}
 	}
+	forgetPreparedPhotos();
+	preparePrefetchedPhotos();
 }
 
 void MediaView::mousePressEvent(QMouseEvent *e) {
@@ -2814,7 +3067,7 @@ void MediaView::loadBack() {
 				App::main()->loadMediaBack(_migrated->peer, _overview);
 			} else {
 				App::main()->loadMediaBack(_history->peer, _overview);
-				if (_migrated && _index == 0 && (_migrated->overviewCount(_overview) < 0 || _migrated->overview(_overview).isEmpty()) && !_migrated->overviewLoaded(_overview)) {
+				if (_migrated && _index == 0 && (_migrated->overviewCount(_overview) < 0 || _migrated->overview(_overview).empty()) && !_migrated->overviewLoaded(_overview)) {
 					App::main()->loadMediaBack(_migrated->peer, _overview);
 				}
 			}
@@ -2830,9 +3083,8 @@ void MediaView::loadBack() {
 
 MediaView::LastChatPhoto MediaView::computeLastOverviewChatPhoto() {
 	LastChatPhoto emptyResult = { nullptr, nullptr };
-	auto lastPhotoInOverview = [&emptyResult](auto history, auto list) -> LastChatPhoto {
-		auto end = list.end();
-		if (auto item = App::histItemById(history->channelId(), *--end)) {
+	auto lastPhotoInOverview = [&emptyResult](auto history, const auto &list) -> LastChatPhoto {
+		if (auto item = App::histItemById(history->channelId(), list.back())) {
 			if (auto media = item->getMedia()) {
 				if (media->type() == MediaTypePhoto && !item->toHistoryMessage()) {
 					return { item, static_cast<HistoryPhoto*>(media)->photo() };
@@ -2844,13 +3096,13 @@ MediaView::LastChatPhoto MediaView::computeLastOverviewChatPhoto() {
 
 	if (!_history) return emptyResult;
 	auto &list = _history->overview(OverviewChatPhotos);
-	if (!list.isEmpty()) {
+	if (!list.empty()) {
 		return lastPhotoInOverview(_history, list);
 	}
 
 	if (!_migrated || !_history->overviewLoaded(OverviewChatPhotos)) return emptyResult;
 	auto &migratedList = _migrated->overview(OverviewChatPhotos);
-	if (!migratedList.isEmpty()) {
+	if (!migratedList.empty()) {
 		return lastPhotoInOverview(_migrated, migratedList);
 	}
 	return emptyResult;
@@ -2906,8 +3158,8 @@ void MediaView::updateHeader() {
 	int32 index = _index, count = 0, addcount = (_migrated && _overview != OverviewCount) ? _migrated->overviewCount(_overview) : 0;
 	if (_history) {
 		if (_overview != OverviewCount) {
-			bool lastOverviewPhotoLoaded = (!_history->overview(_overview).isEmpty() || (
-				_migrated && _history->overviewCount(_overview) == 0 && !_migrated->overview(_overview).isEmpty()));
+			bool lastOverviewPhotoLoaded = (!_history->overview(_overview).empty() || (
+				_migrated && _history->overviewCount(_overview) == 0 && !_migrated->overview(_overview).empty()));
 			count = _history->overviewCount(_overview);
 			if (addcount >= 0 && count >= 0) {
 				count += addcount;
@@ -22,6 +22,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "ui/widgets/dropdown_menu.h"
 #include "ui/effects/radial_animation.h"
+#include "base/flat_map.h"
+#include "base/flat_set.h"
 
 namespace Media {
 namespace Player {
@@ -30,6 +32,9 @@ struct TrackState;
 namespace Clip {
 class Controller;
 } // namespace Clip
+namespace View {
+class TiledImage;
+} // namespace View
 } // namespace Media
 
 namespace Ui {
@@ -160,8 +165,17 @@ private:
 	void updateActions();
 
 	void displayPhoto(PhotoData *photo, HistoryItem *item);
+	QSize fittedPhotoSize(not_null<PhotoData*> photo) const;
+	void prefetchPhoto(not_null<PhotoData*> photo);
+	void preparePrefetchedPhotos();
+	void preparePhoto(not_null<PhotoData*> photo);
+	void photoPrepared(not_null<PhotoData*> photo, QSize size, QImage &&image);
+	void forgetPreparedPhotos();
+	void clearPreparedPhotos();
 	void displayDocument(DocumentData *doc, HistoryItem *item);
 	void displayFinished();
+	QSize currentImageSize() const;
+	void createTiledImage(const FileLocation &location);
 	void findCurrent();
 	void loadBack();
 
@@ -172,6 +186,13 @@ private:
 	void updateSilentVideoPlaybackState();
 	void restartVideoAtSeekPosition(TimeMs positionMs);
 
+	// While the seek bar is dragged the keyframe the playback would start from
+	// is shown by a separate silent reader, paused on its first frame.
+	void updateSeekPreview(TimeMs positionMs);
+	void seekPreviewCallback(Media::Clip::Notification notification);
+	bool seekPreviewShown() const;
+	void clearSeekPreview();
+
 	void createClipController();
 	void setClipControllerGeometry();
 
@@ -261,9 +282,25 @@ private:
 	bool _pressed = false;
 	int32 _dragging = 0;
 	QPixmap _current;
+	std::unique_ptr<Media::View::TiledImage> _tiledImage;
 	Media::Clip::ReaderPointer _gif;
+	Media::Clip::ReaderPointer _seekPreview;
+	TimeMs _seekPreviewMs = -1;
+	TimeMs _seekPreviewWantedMs = -1;
 	int32 _full = -1; // -1 - thumb, 0 - medium, 1 - full
 
+	// Neighbour photos scaled to the screen size in the background,
+	// so that switching to them doesn't wait for the full image scaling.
+	struct PreparedPhoto {
+		QSize size;
+		QPixmap pixmap;
+	};
+	int _preloadDirection = 0;
+	std::vector<not_null<PhotoData*>> _prefetchPhotos;
+	base::flat_map<not_null<PhotoData*>, PreparedPhoto> _preparedPhotos;
+	base::flat_set<not_null<PhotoData*>> _preparingPhotos;
+	int64 _preparedPhotosSize = 0;
+
 	// Video without audio stream playback information.
 	bool _videoIsSilent = false;
 	bool _videoPaused = false;
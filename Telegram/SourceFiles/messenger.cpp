@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "messenger.h"
 
 #include "base/timer.h"
+#include "base/task_queue.h"
 #include "storage/localstorage.h"
 #include "platform/platform_specific.h"
 #include "mainwindow.h"
@@ -42,12 +43,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_audio_track.h"
 #include "window/notifications_manager.h"
 #include "window/themes/window_theme.h"
-#include "history/history_location_manager.h"
 #include "ui/widgets/tooltip.h"
 #include "storage/serialize_common.h"
 #include "window/window_controller.h"
 #include "base/qthelp_regex.h"
 #include "base/qthelp_url.h"
+#include "core/memory_stats.h"
+#include "core/startup_timeline.h"
 #include "boxes/connection_box.h"
 #include "boxes/confirm_phone_box.h"
 #include "boxes/share_box.h"
@@ -55,6 +57,38 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 namespace {
 
 constexpr auto kQuitPreventTimeoutMs = 1500;
+constexpr auto kMemoryStatsLogTimeout = 5 * 60 * 1000; // 5 minutes
+constexpr auto kMemoryPressureCheckTimeout = 10 * 1000; // 10 seconds
+constexpr auto kMemoryPressureRepeatChecks = 30; // shed again each 5 minutes of low memory
+constexpr auto kMemoryPressureItemsBudget = Histories::kDefaultLoadedItemsBudget / 4;
+
+// The first tier trims the caches, the second one drops everything that
+// can be reloaded from the local storage: media, images and inactive chats.
+void ShedMemory(int tier) {
+	auto images = Images::GetCacheCounters();
+	auto stats = MemoryStats::Get(MemoryStats::Kind::HistoryItems);
+	if (tier == 1) {
+		Images::ShrinkCache(Images::CacheLimit() / 4, Images::VariantsCacheLimit() / 4);
+		if (AuthSession::Exists()) {
+			App::histories().unloadItemsOverBudget(kMemoryPressureItemsBudget);
+		}
+	} else {
+		if (App::main()) {
+			App::forgetMedia();
+		}
+		Images::ShrinkCache(0, 0);
+		if (AuthSession::Exists()) {
+			App::histories().unloadItemsOverBudget(0);
+		}
+	}
+	auto imagesNow = Images::GetCacheCounters();
+	auto statsNow = MemoryStats::Get(MemoryStats::Kind::HistoryItems);
+	LOG(("Memory Pressure: tier %1, freed %2 bytes of images and %3 bytes of variants, unloaded %4 messages."
+		).arg(tier
+		).arg(images.imagesSize - imagesNow.imagesSize
+		).arg(images.variantsSize - imagesNow.variantsSize
+		).arg(stats.count - statsNow.count));
+}
 
 Messenger *SingleInstance = nullptr;
 
@@ -70,6 +104,9 @@ struct Messenger::Private {
 	MTP::Instance::Config mtpConfig;
 	MTP::AuthKeysList mtpKeysToDestroy;
 	base::Timer quitTimer;
+	base::Timer memoryStatsTimer;
+	base::Timer memoryPressureTimer;
+	int memoryLowChecks = 0;
 };
 
 Messenger::Messenger() : QObject()
@@ -87,6 +124,7 @@ Messenger::Messenger() : QObject()
 
 	ThirdParty::start();
 	Global::start();
+	StartupTimeline::Mark("Fonts and third party start");
 
 	startLocalStorage();
 
@@ -112,9 +150,31 @@ Messenger::Messenger() : QObject()
 	anim::startManager();
 	HistoryInit();
 	Media::Player::start();
+	StartupTimeline::Mark("Styles and media start");
 
 	DEBUG_LOG(("Application Info: inited..."));
 
+	_private->memoryStatsTimer.setCallback([] {
+		if (cDebug()) {
+			DEBUG_LOG(("Memory Stats:\n%1").arg(MemoryStats::Dump()));
+		}
+	});
+	_private->memoryStatsTimer.callEach(kMemoryStatsLogTimeout);
+
+	_private->memoryPressureTimer.setCallback([this] {
+		if (!Platform::IsMemoryLow()) {
+			_private->memoryLowChecks = 0;
+			return;
+		}
+		auto checks = ++_private->memoryLowChecks;
+		if (checks <= 2) {
+			ShedMemory(checks);
+		} else if (!((checks - 2) % kMemoryPressureRepeatChecks)) {
+			ShedMemory(2);
+		}
+	});
+	_private->memoryPressureTimer.callEach(kMemoryPressureCheckTimeout);
+
 	QCoreApplication::instance()->installNativeEventFilter(psNativeEventFilter());
 
 	cChangeTimeFormat(QLocale::system().timeFormat(QLocale::ShortFormat));
@@ -136,13 +196,14 @@ Messenger::Messenger() : QObject()
 	Sandbox::connect(SIGNAL(applicationStateChanged(Qt::ApplicationState)), this, SLOT(onAppStateChanged(Qt::ApplicationState)));
 
 	DEBUG_LOG(("Application Info: window created..."));
+	StartupTimeline::Mark("Main window creation");
 
 	Shortcuts::start();
 
-	initLocationManager();
 	App::initMedia();
 
 	Local::ReadMapState state = Local::readMap(QByteArray());
+	StartupTimeline::Mark("Local map read");
 	if (state == Local::ReadMapPassNeeded) {
 		Global::SetLocalPasscode(true);
 		Global::RefLocalPasscodeChanged().notify();
@@ -153,6 +214,7 @@ Messenger::Messenger() : QObject()
 	}
 
 	DEBUG_LOG(("Application Info: MTP started..."));
+	StartupTimeline::Mark("MTP start");
 
 	DEBUG_LOG(("Application Info: showing."));
 	if (state == Local::ReadMapPassNeeded) {
@@ -165,6 +227,11 @@ Messenger::Messenger() : QObject()
 		}
 	}
 	_window->firstShow();
+	StartupTimeline::Mark("First show");
+	if (!AuthSession::Exists()) {
+		// Passcode or intro, no dialogs will be loaded.
+		StartupTimeline::Finish();
+	}
 
 	if (cStartToSettings()) {
 		_window->showSettings();
@@ -299,6 +366,16 @@ QByteArray Messenger::serializeMtpAuthorization() const {
 				key->write(stream);
 			}
 		};
+		auto writeSalts = [](QDataStream &stream, auto &keys) {
+			stream << qint32(keys.size());
+			for (auto &key : keys) {
+				auto salts = key->serverSalts();
+				stream << quint64(key->keyId()) << qint32(salts.size());
+				for (auto &salt : salts) {
+					stream << quint64(salt.salt) << qint32(salt.validSince) << qint32(salt.validUntil);
+				}
+			}
+		};
 
 		auto result = QByteArray();
 		auto size = sizeof(qint32) + sizeof(qint32); // userId + mainDcId
@@ -312,6 +389,7 @@ QByteArray Messenger::serializeMtpAuthorization() const {
 			stream << qint32(currentUserId) << qint32(mainDcId);
 			writeKeys(stream, keys);
 			writeKeys(stream, keysToDestroy);
+			writeSalts(stream, keys);
 
 			DEBUG_LOG(("MTP Info: Keys written, userId: %1, dcId: %2").arg(currentUserId).arg(mainDcId));
 		}
@@ -381,6 +459,36 @@ void Messenger::setMtpAuthorization(const QByteArray &serialized) {
 	};
 	readKeys(_private->mtpConfig.keys);
 	readKeys(_private->mtpKeysToDestroy);
+
+	// Server salts were added later, older data ends after the keys.
+	auto readSalts = [&stream](auto &keys) {
+		auto count = Serialize::read<qint32>(stream);
+		for (auto i = 0; i != count && stream.status() == QDataStream::Ok; ++i) {
+			auto keyId = Serialize::read<quint64>(stream);
+			auto saltsCount = Serialize::read<qint32>(stream);
+			auto salts = std::vector<MTP::AuthKey::ServerSalt>();
+			for (auto j = 0; j != saltsCount && stream.status() == QDataStream::Ok; ++j) {
+				auto salt = MTP::AuthKey::ServerSalt();
+				salt.salt = Serialize::read<quint64>(stream);
+				salt.validSince = Serialize::read<qint32>(stream);
+				salt.validUntil = Serialize::read<qint32>(stream);
+				salts.push_back(salt);
+			}
+			if (stream.status() != QDataStream::Ok) {
+				LOG(("MTP Error: could not read server salts from serialized mtp authorization."));
+				return;
+			}
+			for (auto &key : keys) {
+				if (key->keyId() == keyId) {
+					key->setServerSalts(std::move(salts));
+					break;
+				}
+			}
+		}
+	};
+	if (!stream.atEnd()) {
+		readSalts(_private->mtpConfig.keys);
+	}
 	LOG(("MTP Info: read keys, current: %1, to destroy: %2").arg(_private->mtpConfig.keys.size()).arg(_private->mtpKeysToDestroy.size()));
 }
 
@@ -614,6 +722,11 @@ void Messenger::call_handleHistoryUpdate() {
 }
 
 void Messenger::call_handleUnreadCounterUpdate() {
+#ifdef _DEBUG
+	if (AuthSession::Exists()) {
+		App::histories().checkUnreadCounters();
+	}
+#endif // _DEBUG
 	Global::RefUnreadCounterUpdate().notify(true);
 }
 
@@ -629,7 +742,7 @@ void Messenger::killDownloadSessions() {
 	auto ms = getms(), left = static_cast<TimeMs>(MTPAckSendWaiting) + MTPKillFileSessionTimeout;
 	for (auto i = killDownloadSessionTimes.begin(); i != killDownloadSessionTimes.end(); ) {
 		if (i.value() <= ms) {
-			for (int j = 0; j < MTP::kDownloadSessionsCount; ++j) {
+			for (int j = 0; j < MTP::kMaxDownloadSessionsCount; ++j) {
 				MTP::stopSession(MTP::downloadDcId(i.key(), j));
 			}
 			i = killDownloadSessionTimes.erase(i);
@@ -898,6 +1011,33 @@ void Messenger::clearPasscode() {
 Messenger::~Messenger() {
 	Expects(SingleInstance == this);
 
+	auto counters = base::GetObservableCounters();
+	DEBUG_LOG(("Observables: %1 events notified, %2 coalesced, %3 delivered."
+		).arg(counters.notified
+		).arg(counters.coalesced
+		).arg(counters.delivered));
+	auto images = Images::GetCacheCounters();
+	DEBUG_LOG(("Images: %1 cache hits, %2 misses, %3 images and %4 variants evicted."
+		).arg(images.hits
+		).arg(images.misses
+		).arg(images.evicted
+		).arg(images.variantsEvicted));
+	DEBUG_LOG(("Lambdas: %1 allocated on the heap."
+		).arg(base::lambda_allocations_count()));
+	auto logTaskQueue = [](const char *name, const base::TaskQueue &queue) {
+		auto counters = queue.GetCounters();
+		DEBUG_LOG(("Task Queue: %1 processed %2 tasks, %3 ms waited (%4 ms max), %5 ms spent."
+			).arg(name
+			).arg(counters.processed
+			).arg(counters.waited
+			).arg(counters.maxWaited
+			).arg(counters.spent));
+	};
+	logTaskQueue("main", base::TaskQueue::Main());
+	logTaskQueue("normal", base::TaskQueue::Normal());
+	logTaskQueue("background", base::TaskQueue::Background());
+	DEBUG_LOG(("Memory Stats:\n%1").arg(MemoryStats::Dump()));
+
 	_window.reset();
 	_mediaView.reset();
 
@@ -918,7 +1058,6 @@ Messenger::~Messenger() {
 
 	stopWebLoadManager();
 	App::deinitMedia();
-	deinitLocationManager();
 
 	Window::Theme::Unload();
 
@@ -21,9 +21,50 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mtproto/auth_key.h"
 
 #include <openssl/aes.h>
+#include <openssl/evp.h>
 
 namespace MTP {
 
+namespace {
+
+// Smaller chunks are encrypted by AES_ctr128_encrypt(), for them
+// the EVP context setup costs more than it saves.
+constexpr auto kEvpCtrMinBlocks = 16U;
+
+void IncrementCtrIvec(uchar *ivec, uint32 blocks) {
+	auto carry = uint64(blocks);
+	for (auto i = CTRState::IvecSize; i != 0 && carry != 0;) {
+		--i;
+		carry += ivec[i];
+		ivec[i] = static_cast<uchar>(carry & 0xFF);
+		carry >>= 8;
+	}
+}
+
+// EVP chooses the AES-NI or ARMv8 crypto implementation when the CPU supports it
+// and pipelines the counter blocks, the low level AES_ctr128_encrypt() does neither.
+bool EvpCtrEncryptBlocks(uchar *data, uint32 blocks, const void *key, uchar *ivec) {
+	auto context = EVP_CIPHER_CTX_new();
+	if (!context) {
+		return false;
+	}
+	if (EVP_EncryptInit_ex(context, EVP_aes_256_ctr(), nullptr, static_cast<const uchar*>(key), ivec) != 1) {
+		EVP_CIPHER_CTX_free(context);
+		return false;
+	}
+	auto length = int(blocks * AES_BLOCK_SIZE);
+	auto written = 0;
+	auto updated = EVP_EncryptUpdate(context, data, &written, data, length);
+	EVP_CIPHER_CTX_free(context);
+
+	// The data could be changed already, so there is no way back to AES_ctr128_encrypt().
+	Assert(updated == 1 && written == length);
+	IncrementCtrIvec(ivec, blocks);
+	return true;
+}
+
+} // namespace
+
 void AuthKey::prepareAES_oldmtp(const MTPint128 &msgKey, MTPint256 &aesKey, MTPint256 &aesIV, bool send) const {
 	uint32 x = send ? 0 : 8;
 
@@ -82,6 +123,35 @@ void AuthKey::prepareAES(const MTPint128 &msgKey, MTPint256 &aesKey, MTPint256 &
 	memcpy(iv + 8 + 16, sha256_b + 24, 8);
 }
 
+void AuthKey::setServerSalts(std::vector<ServerSalt> &&salts) {
+	QMutexLocker lock(&_saltsMutex);
+	_salts = std::move(salts);
+}
+
+std::vector<AuthKey::ServerSalt> AuthKey::serverSalts() const {
+	QMutexLocker lock(&_saltsMutex);
+	return _salts;
+}
+
+uint64 AuthKey::serverSalt(int32 now) const {
+	QMutexLocker lock(&_saltsMutex);
+	for (auto &salt : _salts) {
+		if (salt.validSince <= now && now < salt.validUntil) {
+			return salt.salt;
+		}
+	}
+	return 0;
+}
+
+int32 AuthKey::serverSaltsValidUntil() const {
+	QMutexLocker lock(&_saltsMutex);
+	auto result = int32(0);
+	for (auto &salt : _salts) {
+		accumulate_max(result, salt.validUntil);
+	}
+	return result;
+}
+
 void aesIgeEncryptRaw(const void *src, void *dst, uint32 len, const void *key, const void *iv) {
 	uchar aes_key[32], aes_iv[32];
 	memcpy(aes_key, key, 32);
@@ -102,14 +172,39 @@ void aesIgeDecryptRaw(const void *src, void *dst, uint32 len, const void *key, c
 	AES_ige_encrypt(static_cast<const uchar*>(src), static_cast<uchar*>(dst), len, &aes, aes_iv, AES_DECRYPT);
 }
 
-void aesCtrEncrypt(void *data, uint32 len, const void *key, CTRState *state) {
+void aesIgeDecryptPart(const void *src, void *dst, uint32 len, IGEState *state) {
 	AES_KEY aes;
-	AES_set_encrypt_key(static_cast<const uchar*>(key), 256, &aes);
+	AES_set_decrypt_key(state->key, 256, &aes);
+
+	static_assert(IGEState::IvSize == 2 * AES_BLOCK_SIZE, "Wrong size of ige iv!");
 
+	AES_ige_encrypt(static_cast<const uchar*>(src), static_cast<uchar*>(dst), len, &aes, state->iv, AES_DECRYPT);
+}
+
+void aesCtrEncrypt(void *data, uint32 len, const void *key, CTRState *state) {
 	static_assert(CTRState::IvecSize == AES_BLOCK_SIZE, "Wrong size of ctr ivec!");
 	static_assert(CTRState::EcountSize == AES_BLOCK_SIZE, "Wrong size of ctr ecount!");
 
-	AES_ctr128_encrypt(static_cast<const uchar*>(data), static_cast<uchar*>(data), len, &aes, state->ivec, state->ecount, &state->num);
+	auto bytes = static_cast<uchar*>(data);
+
+	// Use the rest of the last counter block first, then the full blocks go to EVP.
+	while (state->num != 0 && len != 0) {
+		*bytes++ ^= state->ecount[state->num];
+		state->num = (state->num + 1) % AES_BLOCK_SIZE;
+		--len;
+	}
+	auto blocks = len / AES_BLOCK_SIZE;
+	if (blocks >= kEvpCtrMinBlocks && EvpCtrEncryptBlocks(bytes, blocks, key, state->ivec)) {
+		bytes += blocks * AES_BLOCK_SIZE;
+		len -= blocks * AES_BLOCK_SIZE;
+	}
+	if (!len) {
+		return;
+	}
+
+	AES_KEY aes;
+	AES_set_encrypt_key(static_cast<const uchar*>(key), 256, &aes);
+	AES_ctr128_encrypt(bytes, bytes, len, &aes, state->ivec, state->ecount, &state->num);
 }
 
 } // namespace MTP
@@ -31,6 +31,12 @@ public:
 	using Data = std::array<gsl::byte, kSize>;
 	using KeyId = uint64;
 
+	struct ServerSalt {
+		uint64 salt = 0;
+		int32 validSince = 0;
+		int32 validUntil = 0;
+	};
+
 	enum class Type {
 		Generated,
 		ReadFromFile,
@@ -69,6 +75,13 @@ public:
 		to.writeRawData(reinterpret_cast<const char*>(_key.data()), _key.size());
 	}
 
+	// Future salts received from the server, they are saved with the key
+	// so that the first requests after a restart use a valid salt right away.
+	void setServerSalts(std::vector<ServerSalt> &&salts);
+	std::vector<ServerSalt> serverSalts() const;
+	uint64 serverSalt(int32 now) const; // 0 if there is no valid salt
+	int32 serverSaltsValidUntil() const;
+
 	bool equals(const std::shared_ptr<AuthKey> &other) const {
 		return other ? (_key == other->_key) : false;
 	}
@@ -98,6 +111,9 @@ private:
 	Data _key = { { gsl::byte{} } };
 	KeyId _keyId = 0;
 
+	mutable QMutex _saltsMutex;
+	std::vector<ServerSalt> _salts;
+
 };
 
 using AuthKeyPtr = std::shared_ptr<AuthKey>;
@@ -160,4 +176,24 @@ struct CTRState {
 };
 void aesCtrEncrypt(void *data, uint32 len, const void *key, CTRState *state);
 
+// ige used by parts, the iv is updated after each part so that the next part continues the chain
+struct IGEState {
+	static constexpr int KeySize = 32;
+	static constexpr int IvSize = 32;
+
+	uchar key[KeySize] = { 0 };
+	uchar iv[IvSize] = { 0 };
+};
+void aesIgeDecryptPart(const void *src, void *dst, uint32 len, IGEState *state); // len must be a multiple of 16
+
+inline void aesDecryptLocalPrepare(IGEState *state, const AuthKeyPtr &authKey, const void *key128) {
+	MTPint256 aesKey, aesIV;
+	authKey->prepareAES_oldmtp(*(const MTPint128*)key128, aesKey, aesIV, false);
+
+	static_assert(sizeof(aesKey) == IGEState::KeySize, "Wrong size of ige key!");
+	static_assert(sizeof(aesIV) == IGEState::IvSize, "Wrong size of ige iv!");
+	memcpy(state->key, &aesKey, IGEState::KeySize);
+	memcpy(state->iv, &aesIV, IGEState::IvSize);
+}
+
 } // namespace MTP
@@ -44,6 +44,10 @@ void ConfigLoader::load() {
 	if (!_instance->isKeysDestroyer()) {
 		sendRequest(_instance->mainDcId());
 		_enumDCTimer.callOnce(kEnumerateDcTimeout);
+		if (!Global::SpecialConfig().isEmpty()) {
+			DEBUG_LOG(("MTP Info: Special config was needed last time, requesting it in parallel."));
+			createSpecialLoader();
+		}
 	} else {
 		auto ids = _instance->dcOptions()->configEnumDcIds();
 		Assert(!ids.empty());
@@ -60,6 +64,18 @@ DcId ConfigLoader::specialToRealDcId(DcId specialDcId) {
 	return Instance::Config::kTemporaryMainDc + specialDcId;
 }
 
+void ConfigLoader::finished() {
+	if (_instance->isKeysDestroyer()) {
+		return;
+	}
+	if (_specialConfigLoaded) {
+		LOG(("MTP Info: Config loaded after using the special endpoint dc options."));
+	} else {
+		DEBUG_LOG(("MTP Info: Config loaded through the regular connection."));
+		Global::SetSpecialConfig(QByteArray());
+	}
+}
+
 void ConfigLoader::terminateRequest() {
 	if (_enumRequest) {
 		_instance->cancel(base::take(_enumRequest));
@@ -170,6 +186,7 @@ void ConfigLoader::specialConfigLoaded(const MTPConfig &result) {
 	// We use special config only for dc options.
 	// For everything else we wait for normal config from main dc.
 	_instance->dcOptions()->setFromList(data.vdc_options);
+	_specialConfigLoaded = true;
 }
 
 } // namespace internal
@@ -38,6 +38,10 @@ public:
 
 	void load();
 
+	// Called when the config is received, remembers if the special config
+	// was needed to get it, so that the next launch requests it right away.
+	void finished();
+
 private:
 	mtpRequestId sendRequest(ShiftedDcId shiftedDcId);
 	void addSpecialEndpoint(DcId dcId, const std::string &ip, int port);
@@ -66,6 +70,7 @@ private:
 	base::Timer _specialEnumTimer;
 	DcId _specialEnumCurrent = 0;
 	mtpRequestId _specialEnumRequest = 0;
+	bool _specialConfigLoaded = false;
 
 	RPCDoneHandlerPtr _doneHandler;
 	RPCFailHandlerPtr _failHandler;
@@ -23,10 +23,14 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mtproto/rsa_public_key.h"
 #include "mtproto/rpc_sender.h"
 #include "mtproto/dc_options.h"
+#include "mtproto/dc_metrics.h"
 #include "mtproto/connection_abstract.h"
 #include "zlib.h"
 #include "lang/lang_keys.h"
+#include "storage/localstorage.h"
 #include "base/openssl_help.h"
+#include "core/trace.h"
+#include "core/memory_stats.h"
 #include <openssl/bn.h>
 #include <openssl/err.h>
 #include <openssl/aes.h>
@@ -45,6 +49,22 @@ constexpr auto kMaxModExpSize = 256;
 // Don't try to handle messages larger than this size.
 constexpr auto kMaxMessageLength = 16 * 1024 * 1024;
 
+// Requests that do not fit in one container are left for the next one.
+constexpr auto kMaxContainerMessages = 1020;
+constexpr auto kMaxContainerSize = 256 * 1024;
+
+// Ids of one msgs_state_req, the rest are asked in the next one.
+constexpr auto kMaxStateRequestIds = 1024;
+
+// Bulk requests don't take the whole container, so that the interactive
+// ones added while it is being sent don't wait for a huge send to finish.
+constexpr auto kMaxBulkContainerSize = 128 * 1024;
+
+// Main session requests new salts when the saved ones end in less than an hour.
+constexpr auto kFutureSaltsCount = 32;
+constexpr auto kFutureSaltsMinValidity = 3600;
+constexpr auto kFutureSaltsRequestTimeout = 600 * TimeMs(1000);
+
 bool IsGoodModExpFirst(const openssl::BigNum &modexp, const openssl::BigNum &prime) {
 	auto diff = prime - modexp;
 	if (modexp.failed() || prime.failed() || diff.failed()) {
@@ -720,7 +740,7 @@ void ConnectionPrivate::tryToSend() {
 		}
 	}
 
-	mtpRequest ackRequest, resendRequest, stateRequest, httpWaitRequest;
+	mtpRequest ackRequest, resendRequest, stateRequest, httpWaitRequest, futureSaltsRequest;
 	if (!prependOnly && !ackRequestData.isEmpty()) {
 		MTPMsgsAck ack(MTP_msgs_ack(MTP_vector<MTPlong>(ackRequestData)));
 
@@ -749,12 +769,15 @@ void ConnectionPrivate::tryToSend() {
 			QWriteLocker locker(sessionData->stateRequestMutex());
 			mtpMsgIdsSet &ids(sessionData->stateRequestMap());
 			if (!ids.isEmpty()) {
-				stateReq.reserve(ids.size());
-				for (mtpMsgIdsSet::const_iterator i = ids.cbegin(), e = ids.cend(); i != e; ++i) {
+				stateReq.reserve(qMin(ids.size(), kMaxStateRequestIds));
+				for (auto i = ids.begin(); i != ids.end() && stateReq.size() < kMaxStateRequestIds;) {
 					stateReq.push_back(MTP_long(i.key()));
+					i = ids.erase(i);
+				}
+				if (!ids.isEmpty()) {
+					emit needToSendAsync();
 				}
 			}
-			ids.clear();
 		}
 		if (!stateReq.isEmpty()) {
 			MTPMsgsStateReq req(MTP_msgs_state_req(MTP_vector<MTPlong>(stateReq)));
@@ -774,6 +797,20 @@ void ConnectionPrivate::tryToSend() {
 			httpWaitRequest->msDate = getms(true); // > 0 - can send without container
 			httpWaitRequest->requestId = 0; // dont add to haveSent / wereAcked maps
 		}
+		if (_shiftedDcId == bareDcId(_shiftedDcId) && !_instance->isKeysDestroyer() && _futureSaltsRequestAt <= getms(true)) {
+			auto &key = sessionData->getKey();
+			if (key && key->serverSaltsValidUntil() < unixtime() + kFutureSaltsMinValidity) {
+				MTPGet_future_salts req(MTP_int(kFutureSaltsCount));
+
+				futureSaltsRequest = mtpRequestData::prepare(req.innerLength() >> 2);
+				req.write(*futureSaltsRequest);
+
+				futureSaltsRequest->msDate = getms(true); // > 0 - can send without container
+				futureSaltsRequest->requestId = 0; // dont add to haveSent / wereAcked maps
+				DEBUG_LOG(("MTP Info: requesting future salts, dc %1").arg(_shiftedDcId));
+			}
+			_futureSaltsRequestAt = getms(true) + kFutureSaltsRequestTimeout;
+		}
 	}
 
 	MTPInitConnection<mtpRequest> initWrapper;
@@ -797,26 +834,63 @@ void ConnectionPrivate::tryToSend() {
 		mtpPreRequestMap toSendDummy, &toSend(prependOnly ? toSendDummy : sessionData->toSendMap());
 		if (prependOnly) locker1.unlock();
 
-		uint32 toSendCount = toSend.size();
+		// Take the requests that fit in one container, at least one of them.
+		// Interactive requests go first, bulk ones fill the rest of the container.
+		auto toSendTaken = std::vector<mtpPreRequestMap::iterator>();
+		auto toSendSize = uint32(0);
+		// A request waiting for a still queued one keeps the original order,
+		// so that invokeAfterMsg finds the previous request in haveSent.
+		auto isInteractive = [&toSend](const mtpRequest &request) {
+			return mtpRequestData::isInteractive(request)
+				&& (!request->after || !toSend.contains(request->after->requestId));
+		};
+		auto takeRequests = [&](bool interactive, uint32 sizeLimit) {
+			for (auto i = toSend.begin(), e = toSend.end(); i != e; ++i) {
+				if (isInteractive(i.value()) != interactive) {
+					continue;
+				}
+				auto size = uint32(mtpRequestData::messageSize(i.value()) * kIntSize);
+				if (!toSendTaken.empty() && (toSendSize + size > sizeLimit || int(toSendTaken.size()) >= kMaxContainerMessages)) {
+					break;
+				}
+				toSendTaken.push_back(i);
+				toSendSize += size;
+			}
+		};
+		takeRequests(true, kMaxContainerSize);
+		takeRequests(false, qMax(toSendSize, uint32(kMaxBulkContainerSize)));
+		auto toSendLeft = (toSendTaken.size() < toSend.size());
+		if (!prependOnly) {
+			_instance->metrics()->queued(_shiftedDcId, toSend.size() - toSendTaken.size());
+		}
+
+		uint32 toSendCount = toSendTaken.size();
 		if (pingRequest) ++toSendCount;
 		if (ackRequest) ++toSendCount;
 		if (resendRequest) ++toSendCount;
 		if (stateRequest) ++toSendCount;
 		if (httpWaitRequest) ++toSendCount;
+		if (futureSaltsRequest) ++toSendCount;
 
 		if (!toSendCount) return; // nothing to send
 
-		mtpRequest first = pingRequest ? pingRequest : (ackRequest ? ackRequest : (resendRequest ? resendRequest : (stateRequest ? stateRequest : (httpWaitRequest ? httpWaitRequest : toSend.cbegin().value()))));
+		mtpRequest first = pingRequest ? pingRequest : (ackRequest ? ackRequest : (resendRequest ? resendRequest : (stateRequest ? stateRequest : (httpWaitRequest ? httpWaitRequest : (futureSaltsRequest ? futureSaltsRequest : toSendTaken.front().value())))));
 		if (toSendCount == 1 && first->msDate > 0) { // if can send without container
 			toSendRequest = first;
 			if (!prependOnly) {
-				toSend.clear();
+				if (!toSendTaken.empty()) {
+					toSend.erase(toSendTaken.front());
+				}
 				locker1.unlock();
+				if (toSendLeft) {
+					emit needToSendAsync();
+				}
 			}
 
 			mtpMsgId msgId = prepareToSend(toSendRequest, msgid());
 			if (pingRequest) {
 				_pingMsgId = msgId;
+				_pingSentAt = getms(true);
 				needAnyResponse = true;
 			} else if (resendRequest || stateRequest) {
 				needAnyResponse = true;
@@ -865,7 +939,8 @@ void ConnectionPrivate::tryToSend() {
 			if (resendRequest) containerSize += mtpRequestData::messageSize(resendRequest);
 			if (stateRequest) containerSize += mtpRequestData::messageSize(stateRequest);
 			if (httpWaitRequest) containerSize += mtpRequestData::messageSize(httpWaitRequest);
-			for (mtpPreRequestMap::iterator i = toSend.begin(), e = toSend.end(); i != e; ++i) {
+			if (futureSaltsRequest) containerSize += mtpRequestData::messageSize(futureSaltsRequest);
+			for (auto i : toSendTaken) {
 				containerSize += mtpRequestData::messageSize(i.value());
 				if (needsLayer && i.value()->needsLayer) {
 					containerSize += initSizeInInts;
@@ -879,7 +954,7 @@ void ConnectionPrivate::tryToSend() {
 				initSerialized.push_back(MTP::internal::CurrentLayer);
 				initWrapper.write(initSerialized);
 			}
-			toSendRequest = mtpRequestData::prepare(containerSize, containerSize + 3 * toSend.size()); // prepare container + each in invoke after
+			toSendRequest = mtpRequestData::prepare(containerSize, containerSize + 3 * toSendCount); // prepare container + each in invoke after
 			toSendRequest->push_back(mtpc_msg_container);
 			toSendRequest->push_back(toSendCount);
 
@@ -898,11 +973,12 @@ void ConnectionPrivate::tryToSend() {
 
 			if (pingRequest) {
 				_pingMsgId = placeToContainer(toSendRequest, bigMsgId, haveSentArr, pingRequest);
+				_pingSentAt = getms(true);
 				needAnyResponse = true;
 			} else if (resendRequest || stateRequest) {
 				needAnyResponse = true;
 			}
-			for (mtpPreRequestMap::iterator i = toSend.begin(), e = toSend.end(); i != e; ++i) {
+			for (auto i : toSendTaken) {
 				mtpRequest &req(i.value());
 				mtpMsgId msgId = prepareToSend(req, bigMsgId);
 				if (msgId > bigMsgId) msgId = replaceMsgId(req, bigMsgId);
@@ -949,12 +1025,20 @@ void ConnectionPrivate::tryToSend() {
 			if (resendRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, resendRequest);
 			if (ackRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, ackRequest);
 			if (httpWaitRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, httpWaitRequest);
+			if (futureSaltsRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, futureSaltsRequest);
 
 			mtpMsgId contMsgId = prepareToSend(toSendRequest, bigMsgId);
 			*(mtpMsgId*)(haveSentIdsWrap->data() + 4) = contMsgId;
 			(*haveSentIdsWrap)[6] = 0; // for container, msDate = 0, seqNo = 0
 			haveSent.insert(contMsgId, haveSentIdsWrap);
-			toSend.clear();
+			for (auto i : toSendTaken) {
+				toSend.erase(i);
+			}
+
+			DEBUG_LOG(("MTP Info: container of %1 messages, %2 of %3 bytes for requests, %4 requests left").arg(toSendCount).arg(toSendSize).arg(kMaxContainerSize).arg(toSend.size()));
+			if (toSendLeft) {
+				emit needToSendAsync();
+			}
 		}
 	}
 	mtpRequestData::padding(toSendRequest);
@@ -1042,7 +1126,7 @@ void ConnectionPrivate::connectToServer(bool afterConfig) {
 	_waitForConnectedTimer.stop();
 
 	setState(ConnectingState);
-	_pingId = _pingMsgId = _pingIdToSend = _pingSendAt = 0;
+	_pingId = _pingMsgId = _pingIdToSend = _pingSendAt = _pingSentAt = 0;
 	_pingSender.stop();
 
 	if (!noIPv4) DEBUG_LOG(("MTP Info: creating IPv4 connection to %1:%2 (tcp) and %3:%4 (http)...").arg(variants.data[kIPv4][kTcp].ip.c_str()).arg(variants.data[kIPv4][kTcp].port).arg(variants.data[kIPv4][kHttp].ip.c_str()).arg(variants.data[kIPv4][kHttp].port));
@@ -1103,6 +1187,7 @@ void ConnectionPrivate::restart() {
 }
 
 void ConnectionPrivate::onSentSome(uint64 size) {
+	_instance->metrics()->sent(_shiftedDcId, size);
 	if (!_waitForReceivedTimer.isActive()) {
 		auto remain = static_cast<uint64>(_waitForReceived);
 		if (!oldConnection) {
@@ -1199,6 +1284,7 @@ void ConnectionPrivate::onWaitIPv4Failed() {
 
 	if (_conn) {
 		DEBUG_LOG(("MTP Info: can't connect through IPv4, using IPv6 connection."));
+		_instance->dcOptions()->setIPv6Preferred(bareDcId(_shiftedDcId), true);
 
 		updateAuthKey();
 	} else {
@@ -1235,6 +1321,7 @@ void ConnectionPrivate::requestCDNConfig() {
 }
 
 void ConnectionPrivate::handleReceived() {
+	TRACE_SCOPE("ConnectionPrivate::handleReceived");
 	QReadLocker lockFinished(&sessionDataMutex);
 	if (!sessionData) return;
 
@@ -1263,13 +1350,14 @@ void ConnectionPrivate::handleReceived() {
 	while (!_conn->received().empty()) {
 		auto intsBuffer = std::move(_conn->received().front());
 		_conn->received().pop_front();
+		_instance->metrics()->received(_shiftedDcId, intsBuffer.size() * kIntSize);
 
 		constexpr auto kExternalHeaderIntsCount = 6U; // 2 auth_key_id, 4 msg_key
 		constexpr auto kEncryptedHeaderIntsCount = 8U; // 2 salt, 2 session, 2 msg_id, 1 seq_no, 1 length
 		constexpr auto kMinimalEncryptedIntsCount = kEncryptedHeaderIntsCount + 4U; // + 1 data + 3 padding
 		constexpr auto kMinimalIntsCount = kExternalHeaderIntsCount + kMinimalEncryptedIntsCount;
 		auto intsCount = uint32(intsBuffer.size());
-		auto ints = intsBuffer.constData();
+		auto ints = intsBuffer.data();
 		if ((intsCount < kMinimalIntsCount) || (intsCount > kMaxMessageLength / kIntSize)) {
 			LOG(("TCP Error: bad message received, len %1").arg(intsCount * kIntSize));
 			TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(ints, intsCount * kIntSize).str()));
@@ -1283,19 +1371,19 @@ void ConnectionPrivate::handleReceived() {
 			return restartOnError();
 		}
 
+		// The received buffer is not needed after decryption, so it is decrypted in place.
 		auto encryptedInts = ints + kExternalHeaderIntsCount;
 		auto encryptedIntsCount = (intsCount - kExternalHeaderIntsCount);
 		auto encryptedBytesCount = encryptedIntsCount * kIntSize;
-		auto decryptedBuffer = QByteArray(encryptedBytesCount, Qt::Uninitialized);
 		auto msgKey = *(MTPint128*)(ints + 2);
 
 #ifdef TDESKTOP_MTPROTO_OLD
-		aesIgeDecrypt_oldmtp(encryptedInts, decryptedBuffer.data(), encryptedBytesCount, key, msgKey);
+		aesIgeDecrypt_oldmtp(encryptedInts, encryptedInts, encryptedBytesCount, key, msgKey);
 #else // TDESKTOP_MTPROTO_OLD
-		aesIgeDecrypt(encryptedInts, decryptedBuffer.data(), encryptedBytesCount, key, msgKey);
+		aesIgeDecrypt(encryptedInts, encryptedInts, encryptedBytesCount, key, msgKey);
 #endif // TDESKTOP_MTPROTO_OLD
 
-		auto decryptedInts = reinterpret_cast<const mtpPrime*>(decryptedBuffer.constData());
+		auto decryptedInts = static_cast<const mtpPrime*>(encryptedInts);
 		auto serverSalt = *(uint64*)&decryptedInts[0];
 		auto session = *(uint64*)&decryptedInts[2];
 		auto msgId = *(uint64*)&decryptedInts[4];
@@ -1558,6 +1646,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		msg.read(from, end);
 		const auto &data(msg.c_bad_msg_notification());
 		LOG(("Message Info: bad message notification received (error_code %3) for msg_id = %1, seq_no = %2").arg(data.vbad_msg_id.v).arg(data.vbad_msg_seqno.v).arg(data.verror_code.v));
+		_instance->metrics()->badMsgNotification(_shiftedDcId);
 
 		mtpMsgId resendId = data.vbad_msg_id.v;
 		if (resendId == _pingMsgId) {
@@ -1907,6 +1996,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 			// Save rpc_result for processing in the main thread.
 			QWriteLocker locker(sessionData->haveReceivedMutex());
 			sessionData->haveReceivedResponses().insert(requestId, response);
+			MemoryStats::Acquired(MemoryStats::Kind::MtpResponses, response.size() * sizeof(mtpPrime));
 		} else {
 			DEBUG_LOG(("RPC Info: requestId not found for msgId %1").arg(reqMsgId.v));
 		}
@@ -1949,6 +2039,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		// Notify main process about new session - need to get difference.
 		QWriteLocker locker(sessionData->haveReceivedMutex());
 		sessionData->haveReceivedUpdates().push_back(SerializedMessage(update));
+		MemoryStats::Acquired(MemoryStats::Kind::MtpResponses, update.size() * sizeof(mtpPrime));
 	} return HandleResult::Success;
 
 	case mtpc_ping: {
@@ -1976,6 +2067,9 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		} else {
 			DEBUG_LOG(("Message Info: just pong..."));
 		}
+		if (data.vmsg_id.v == _pingMsgId && _pingSentAt) {
+			_instance->metrics()->pingReceived(_shiftedDcId, getms(true) - base::take(_pingSentAt));
+		}
 
 		QVector<MTPlong> ids(1, data.vmsg_id);
 		if (badTime) {
@@ -1988,6 +2082,28 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		requestsAcked(ids, true);
 	} return HandleResult::Success;
 
+	case mtpc_future_salts: {
+		MTPFutureSalts msg;
+		msg.read(from, end);
+		const auto &data(msg.c_future_salts());
+		DEBUG_LOG(("Message Info: future salts received, req_msg_id: %1, count: %2").arg(data.vreq_msg_id.v).arg(data.vsalts.v.size()));
+
+		auto salts = std::vector<AuthKey::ServerSalt>();
+		salts.reserve(data.vsalts.v.size());
+		for (auto &salt : data.vsalts.v) {
+			auto &fields = salt.c_future_salt();
+			auto entry = AuthKey::ServerSalt();
+			entry.salt = fields.vsalt.v;
+			entry.validSince = fields.vvalid_since.v;
+			entry.validUntil = fields.vvalid_until.v;
+			salts.push_back(entry);
+		}
+		if (auto &key = sessionData->getKey()) {
+			key->setServerSalts(std::move(salts));
+			InvokeQueued(_instance, [] { Local::writeMtpData(); });
+		}
+	} return HandleResult::Success;
+
 	}
 
 	} catch (Exception &) {
@@ -2006,6 +2122,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		// Notify main process about the new updates.
 		QWriteLocker locker(sessionData->haveReceivedMutex());
 		sessionData->haveReceivedUpdates().push_back(SerializedMessage(update));
+		MemoryStats::Acquired(MemoryStats::Kind::MtpResponses, update.size() * sizeof(mtpPrime));
 
 		if (cons != mtpc_updatesTooLong && cons != mtpc_updateShortMessage && cons != mtpc_updateShortChatMessage && cons != mtpc_updateShortSentMessage && cons != mtpc_updateShort && cons != mtpc_updatesCombined && cons != mtpc_updates) {
 			LOG(("Message Error: unknown constructor %1").arg(cons)); // maybe new api?..
@@ -2226,6 +2343,7 @@ void ConnectionPrivate::handleMsgsStates(const QVector<MTPlong> &ids, const QByt
 
 void ConnectionPrivate::resend(quint64 msgId, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo) {
 	if (msgId == _pingMsgId) return;
+	_instance->metrics()->resent(_shiftedDcId, 1);
 	emit resendAsync(msgId, msCanWait, forceContainer, sendMsgStateInfo);
 }
 
@@ -2236,6 +2354,7 @@ void ConnectionPrivate::resendMany(QVector<quint64> msgIds, qint64 msCanWait, bo
 			--l;
 		}
 	}
+	_instance->metrics()->resent(_shiftedDcId, msgIds.size());
 	emit resendManyAsync(msgIds, msCanWait, forceContainer, sendMsgStateInfo);
 }
 
@@ -2258,6 +2377,7 @@ void ConnectionPrivate::onConnected4() {
 
 	_conn = _conn4;
 	destroyConn(&_conn6);
+	_instance->dcOptions()->setIPv6Preferred(bareDcId(_shiftedDcId), false);
 
 	DEBUG_LOG(("MTP Info: connection through IPv4 succeed."));
 
@@ -2280,6 +2400,13 @@ void ConnectionPrivate::onConnected6() {
 		return restart();
 	}
 
+	if (_instance->dcOptions()->ipv6Preferred(bareDcId(_shiftedDcId))) {
+		DEBUG_LOG(("MTP Info: connection through IPv6 succeed, IPv4 was too slow last time."));
+
+		lockFinished.unlock();
+		return onWaitIPv4Failed();
+	}
+
 	DEBUG_LOG(("MTP Info: connection through IPv6 succeed, waiting IPv4 for %1ms.").arg(MTPIPv4ConnectionWaitTimeout));
 
 	_waitForIPv4Timer.start(MTPIPv4ConnectionWaitTimeout);
@@ -2763,6 +2890,14 @@ void ConnectionPrivate::authKeyCreated() {
 
 	connect(_conn, SIGNAL(receivedData()), this, SLOT(handleReceived()));
 
+	if (!sessionData->getSalt()) {
+		if (auto &key = sessionData->getKey()) {
+			if (auto salt = key->serverSalt(unixtime())) {
+				DEBUG_LOG(("MTP Info: using saved server salt %1, dc %2").arg(salt).arg(_shiftedDcId));
+				sessionData->setSalt(salt);
+			}
+		}
+	}
 	if (sessionData->getSalt()) { // else receive salt in bad_server_salt first, then try to send all the requests
 		setState(ConnectedState);
 		if (restarted) {
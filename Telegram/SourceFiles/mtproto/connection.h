@@ -233,6 +233,8 @@ private:
 	mtpPingId _pingIdToSend = 0;
 	TimeMs _pingSendAt = 0;
 	mtpMsgId _pingMsgId = 0;
+	TimeMs _pingSentAt = 0;
+	TimeMs _futureSaltsRequestAt = 0;
 	SingleTimer _pingSender;
 
 	void resend(quint64 msgId, qint64 msCanWait = 0, bool forceContainer = false, bool sendMsgStateInfo = false);
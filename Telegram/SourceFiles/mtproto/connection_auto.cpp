@@ -134,9 +134,14 @@ void AutoConnection::httpSend(mtpBuffer &buffer) {
 	QNetworkRequest request(address);
 	request.setHeader(QNetworkRequest::ContentLengthHeader, QVariant(requestSize));
     request.setHeader(QNetworkRequest::ContentTypeHeader, QVariant(qsl("application/x-www-form-urlencoded")));
+	request.setRawHeader("Connection", "keep-alive");
 
 	TCP_LOG(("HTTP Info: sending %1 len request").arg(requestSize));
-	requests.insert(manager.post(request, QByteArray((const char*)(&buffer[2]), requestSize)));
+	auto reply = manager.post(request, QByteArray((const char*)(&buffer[2]), requestSize));
+	requests.insert(reply);
+	if (base::take(_longPollRequested)) {
+		_longPoll = reply;
+	}
 }
 
 void AutoConnection::disconnectFromServer() {
@@ -145,6 +150,8 @@ void AutoConnection::disconnectFromServer() {
 
 	Requests copy = requests;
 	requests.clear();
+	_longPoll = nullptr;
+	_longPollRequested = false;
 	for (Requests::const_iterator i = copy.cbegin(), e = copy.cend(); i != e; ++i) {
 		(*i)->abort();
 		(*i)->deleteLater();
@@ -194,6 +201,9 @@ void AutoConnection::requestFinished(QNetworkReply *reply) {
 	if (status == FinishedWork) return;
 
 	reply->deleteLater();
+	if (reply == _longPoll) {
+		_longPoll = nullptr;
+	}
 	if (reply->error() == QNetworkReply::NoError) {
 		requests.remove(reply);
 
@@ -250,10 +260,9 @@ void AutoConnection::requestFinished(QNetworkReply *reply) {
 	}
 }
 
-void AutoConnection::socketPacket(const char *packet, uint32 length) {
+void AutoConnection::socketPacket(mtpBuffer &&data) {
 	if (status == FinishedWork) return;
 
-	mtpBuffer data = AbstractTCPConnection::handleResponse(packet, length);
 	if (data.size() == 1) {
 		if (status == WaitingBoth) {
 			status = WaitingHttp;
@@ -269,7 +278,7 @@ void AutoConnection::socketPacket(const char *packet, uint32 length) {
 			LOG(("Strange Tcp Error; status %1").arg(status));
 		}
 	} else if (status == UsingTcp) {
-		_receivedQueue.push_back(data);
+		_receivedQueue.push_back(std::move(data));
 		emit receivedData();
 	} else if (status == WaitingBoth || status == WaitingTcp || status == HttpReady) {
 		tcpTimeoutTimer.stop();
@@ -299,11 +308,15 @@ void AutoConnection::socketPacket(const char *packet, uint32 length) {
 }
 
 bool AutoConnection::usingHttpWait() {
-	return (status == UsingHttp);
+	if (status != UsingHttp || _longPoll || _longPollRequested) {
+		return false;
+	}
+	_longPollRequested = true;
+	return true;
 }
 
 bool AutoConnection::needHttpWait() {
-	return (status == UsingHttp) ? requests.isEmpty() : false;
+	return (status == UsingHttp) ? (!_longPoll && !_longPollRequested) : false;
 }
 
 int32 AutoConnection::debugState() const {
@@ -57,7 +57,7 @@ public slots:
 
 protected:
 
-	void socketPacket(const char *packet, uint32 length) override;
+	void socketPacket(mtpBuffer &&data) override;
 
 private:
 
@@ -81,6 +81,10 @@ private:
 	typedef QSet<QNetworkReply*> Requests;
 	Requests requests;
 
+	// See HTTPConnection, only one request at a time carries http_wait.
+	QNetworkReply *_longPoll = nullptr;
+	bool _longPollRequested = false;
+
 	QString _addrTcp, _addrHttp;
 	int32 _portTcp, _portHttp;
 	MTPDdcOption::Flags _flagsTcp, _flagsHttp;
@@ -110,9 +110,14 @@ void HTTPConnection::sendData(mtpBuffer &buffer) {
 	QNetworkRequest request(address);
 	request.setHeader(QNetworkRequest::ContentLengthHeader, QVariant(requestSize));
 	request.setHeader(QNetworkRequest::ContentTypeHeader, QVariant(qsl("application/x-www-form-urlencoded")));
+	request.setRawHeader("Connection", "keep-alive");
 
 	TCP_LOG(("HTTP Info: sending %1 len request %2").arg(requestSize).arg(Logs::mb(&buffer[2], requestSize).str()));
-	requests.insert(manager.post(request, QByteArray((const char*)(&buffer[2]), requestSize)));
+	auto reply = manager.post(request, QByteArray((const char*)(&buffer[2]), requestSize));
+	requests.insert(reply);
+	if (base::take(_longPollRequested)) {
+		_longPoll = reply;
+	}
 }
 
 void HTTPConnection::disconnectFromServer() {
@@ -121,6 +126,8 @@ void HTTPConnection::disconnectFromServer() {
 
 	Requests copy = requests;
 	requests.clear();
+	_longPoll = nullptr;
+	_longPollRequested = false;
 	for (Requests::const_iterator i = copy.cbegin(), e = copy.cend(); i != e; ++i) {
 		(*i)->abort();
 		(*i)->deleteLater();
@@ -155,6 +162,9 @@ void HTTPConnection::requestFinished(QNetworkReply *reply) {
 	if (status == FinishedWork) return;
 
 	reply->deleteLater();
+	if (reply == _longPoll) {
+		_longPoll = nullptr;
+	}
 	if (reply->error() == QNetworkReply::NoError) {
 		requests.remove(reply);
 
@@ -190,11 +200,16 @@ void HTTPConnection::requestFinished(QNetworkReply *reply) {
 }
 
 bool HTTPConnection::usingHttpWait() {
+	// Called right before the request is prepared and sent in sendData().
+	if (_longPoll || _longPollRequested) {
+		return false;
+	}
+	_longPollRequested = true;
 	return true;
 }
 
 bool HTTPConnection::needHttpWait() {
-	return requests.isEmpty();
+	return !_longPoll && !_longPollRequested;
 }
 
 int32 HTTPConnection::debugState() const {
@@ -66,6 +66,11 @@ private:
 	typedef QSet<QNetworkReply*> Requests;
 	Requests requests;
 
+	// Only one request at a time carries http_wait and is held by the server,
+	// the others are answered right away and don't wait behind it.
+	QNetworkReply *_longPoll = nullptr;
+	bool _longPollRequested = false;
+
 };
 
 } // namespace internal
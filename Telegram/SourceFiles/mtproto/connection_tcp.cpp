@@ -27,6 +27,9 @@ namespace internal {
 
 namespace {
 
+// Encrypted packets are collected and written to the socket once per event loop iteration.
+constexpr auto kSendBufferReserve = 64 * 1024;
+
 uint32 tcpPacketSize(const char *packet) { // must have at least 4 bytes readable
 	uint32 result = (packet[0] > 0) ? packet[0] : 0;
 	if (result == 0x7f) {
@@ -58,81 +61,90 @@ void AbstractTCPConnection::socketRead() {
 	}
 
 	do {
-		uint32 toRead = packetLeft ? packetLeft : (readingToShort ? (MTPShortBufferSize * sizeof(mtpPrime) - packetRead) : 4);
-		if (readingToShort) {
-			if (currentPos + toRead > ((char*)shortBuffer) + MTPShortBufferSize * sizeof(mtpPrime)) {
-				longBuffer.resize(((packetRead + toRead) >> 2) + 1);
-				memcpy(&longBuffer[0], shortBuffer, packetRead);
-				currentPos = ((char*)&longBuffer[0]) + packetRead;
-				readingToShort = false;
+		if (!readingToShort) {
+			// The rest of a long packet is read right to its own buffer.
+			int32 bytes = (int32)sock.read(currentPos, packetLeft);
+			if (bytes < 0) {
+				LOG(("TCP Error: socket read return -1"));
+				emit error(kErrorCodeOther);
+				return;
+			} else if (!bytes) {
+				TCP_LOG(("TCP Info: no bytes read, but bytes available was true..."));
+				break;
 			}
-		} else {
-			if (longBuffer.size() * sizeof(mtpPrime) < packetRead + toRead) {
-				longBuffer.resize(((packetRead + toRead) >> 2) + 1);
-				currentPos = ((char*)&longBuffer[0]) + packetRead;
-			}
-		}
-		int32 bytes = (int32)sock.read(currentPos, toRead);
-		if (bytes > 0) {
 			aesCtrEncrypt(currentPos, bytes, _receiveKey, &_receiveState);
 			TCP_LOG(("TCP Info: read %1 bytes").arg(bytes));
 
-			packetRead += bytes;
+			packetLeft -= bytes;
 			currentPos += bytes;
 			if (packetLeft) {
-				packetLeft -= bytes;
-				if (!packetLeft) {
-					socketPacket(currentPos - packetRead, packetRead);
-					currentPos = (char*)shortBuffer;
-					packetRead = packetLeft = 0;
-					readingToShort = true;
-					longBuffer.clear();
-				} else {
-					TCP_LOG(("TCP Info: not enough %1 for packet! read %2").arg(packetLeft).arg(packetRead));
-					emit receivedSome();
-				}
-			} else {
-				bool move = false;
-				while (packetRead >= 4) {
-					uint32 packetSize = tcpPacketSize(currentPos - packetRead);
-					if (packetSize < 5 || packetSize > MTPPacketSizeMax) {
-						LOG(("TCP Error: packet size = %1").arg(packetSize));
-						emit error(kErrorCodeOther);
-						return;
-					}
-					if (packetRead >= packetSize) {
-						socketPacket(currentPos - packetRead, packetSize);
-						packetRead -= packetSize;
-						packetLeft = 0;
-						move = true;
-					} else {
-						packetLeft = packetSize - packetRead;
-						TCP_LOG(("TCP Info: not enough %1 for packet! size %2 read %3").arg(packetLeft).arg(packetSize).arg(packetRead));
-						emit receivedSome();
-						break;
-					}
-				}
-				if (move) {
-					if (!packetRead) {
-						currentPos = (char*)shortBuffer;
-						readingToShort = true;
-						longBuffer.clear();
-					} else if (!readingToShort && packetRead < MTPShortBufferSize * sizeof(mtpPrime)) {
-						memcpy(shortBuffer, currentPos - packetRead, packetRead);
-						currentPos = (char*)shortBuffer + packetRead;
-						readingToShort = true;
-						longBuffer.clear();
-					}
-				}
+				TCP_LOG(("TCP Info: not enough %1 for packet!").arg(packetLeft));
+				emit receivedSome();
+				continue;
+			}
+			auto packet = base::take(longBuffer);
+			currentPos = (char*)shortBuffer;
+			readingToShort = true;
+			TCP_LOG(("TCP Info: packet received, size = %1").arg(packet.size() * sizeof(mtpPrime)));
+			if (packet.size() == 1) {
+				LOG(("TCP Error: error packet received, code = %1").arg(packet[0]));
 			}
-		} else if (bytes < 0) {
+			socketPacket(std::move(packet));
+			continue;
+		}
+
+		uint32 toRead = MTPShortBufferSize * sizeof(mtpPrime) - packetRead;
+		int32 bytes = (int32)sock.read(currentPos, toRead);
+		if (bytes < 0) {
 			LOG(("TCP Error: socket read return -1"));
 			emit error(kErrorCodeOther);
 			return;
-		} else {
+		} else if (!bytes) {
 			TCP_LOG(("TCP Info: no bytes read, but bytes available was true..."));
 			break;
 		}
+		aesCtrEncrypt(currentPos, bytes, _receiveKey, &_receiveState);
+		TCP_LOG(("TCP Info: read %1 bytes").arg(bytes));
+
+		packetRead += bytes;
+		currentPos += bytes;
+
+		auto from = (char*)shortBuffer;
+		while (packetRead >= 4) {
+			uint32 packetSize = tcpPacketSize(from);
+			if (packetSize < 5 || packetSize > MTPPacketSizeMax) {
+				LOG(("TCP Error: packet size = %1").arg(packetSize));
+				emit error(kErrorCodeOther);
+				return;
+			}
+			if (packetRead >= packetSize) {
+				socketPacket(handleResponse(from, packetSize));
+				from += packetSize;
+				packetRead -= packetSize;
+				continue;
+			}
+
+			// Not enough data for the packet, read the rest straight to the
+			// packet buffer, so that it is not copied after it is received.
+			auto headerSize = (packetSize & 0x03) ? 1U : 4U;
+			auto payloadSize = packetSize - headerSize;
+			auto payloadRead = packetRead - headerSize;
+			longBuffer.resize(payloadSize / sizeof(mtpPrime));
+			memcpy(longBuffer.data(), from + headerSize, payloadRead);
+			currentPos = ((char*)longBuffer.data()) + payloadRead;
+			packetLeft = packetSize - packetRead;
+			packetRead = 0;
+			readingToShort = false;
+			TCP_LOG(("TCP Info: not enough %1 for packet! size %2 read %3").arg(packetLeft).arg(packetSize).arg(payloadRead + headerSize));
+			emit receivedSome();
+			break;
+		}
+		if (readingToShort) {
+			if (packetRead && from != (char*)shortBuffer) {
+				memmove(shortBuffer, from, packetRead);
+			}
+			currentPos = (char*)shortBuffer + packetRead;
+		}
 	} while (sock.state() == QAbstractSocket::ConnectedState && sock.bytesAvailable());
 }
 
@@ -299,9 +311,9 @@ void AbstractTCPConnection::tcpSend(mtpBuffer &buffer) {
 		// write protocol identifier
 		*reinterpret_cast<uint32*>(nonce + 56) = 0xefefefefU;
 
-		sock.write(nonce, 56);
+		appendToSend(nonce, 56);
 		aesCtrEncrypt(nonce, 64, _sendKey, &_sendState);
-		sock.write(nonce + 56, 8);
+		appendToSend(nonce + 56, 8);
 	}
 	++packetNum;
 
@@ -312,7 +324,7 @@ void AbstractTCPConnection::tcpSend(mtpBuffer &buffer) {
 		TCP_LOG(("TCP Info: write %1 packet %2").arg(packetNum).arg(len + 1));
 
 		aesCtrEncrypt(data + 7, len + 1, _sendKey, &_sendState);
-		sock.write(data + 7, len + 1);
+		appendToSend(data + 7, len + 1);
 	} else {
 		data[4] = 0x7f;
 		reinterpret_cast<uchar*>(data)[5] = uchar(size & 0xFF);
@@ -321,8 +333,31 @@ void AbstractTCPConnection::tcpSend(mtpBuffer &buffer) {
 		TCP_LOG(("TCP Info: write %1 packet %2").arg(packetNum).arg(len + 4));
 
 		aesCtrEncrypt(data + 4, len + 4, _sendKey, &_sendState);
-		sock.write(data + 4, len + 4);
+		appendToSend(data + 4, len + 4);
+	}
+}
+
+void AbstractTCPConnection::appendToSend(const char *data, int length) {
+	if (!_sendBuffer.capacity()) {
+		_sendBuffer.reserve(kSendBufferReserve); // resize(0) keeps the reserved memory
+	}
+	_sendBuffer.append(data, length);
+	if (!_sendFlushQueued) {
+		_sendFlushQueued = true;
+		InvokeQueued(this, [this] { flushSend(); });
+	}
+}
+
+void AbstractTCPConnection::flushSend() {
+	_sendFlushQueued = false;
+	if (_sendBuffer.isEmpty()) {
+		return;
+	}
+	if (sock.state() == QAbstractSocket::ConnectedState) {
+		TCP_LOG(("TCP Info: flush %1 bytes").arg(_sendBuffer.size()));
+		sock.write(_sendBuffer.constData(), _sendBuffer.size());
 	}
+	_sendBuffer.resize(0);
 }
 
 void TCPConnection::disconnectFromServer() {
@@ -330,6 +365,7 @@ void TCPConnection::disconnectFromServer() {
 	status = FinishedWork;
 
 	disconnect(&sock, SIGNAL(readyRead()), 0, 0);
+	_sendBuffer.resize(0);
 	sock.close();
 }
 
@@ -342,14 +378,13 @@ void TCPConnection::connectTcp(const DcOptions::Endpoint &endpoint) {
 	sock.connectToHost(QHostAddress(_addr), _port);
 }
 
-void TCPConnection::socketPacket(const char *packet, uint32 length) {
+void TCPConnection::socketPacket(mtpBuffer &&data) {
 	if (status == FinishedWork) return;
 
-	mtpBuffer data = handleResponse(packet, length);
 	if (data.size() == 1) {
 		emit error(data[0]);
 	} else if (status == UsingTcp) {
-		_receivedQueue.push_back(data);
+		_receivedQueue.push_back(std::move(data));
 		emit receivedData();
 	} else if (status == WaitingTcp) {
 		tcpTimeoutTimer.stop();
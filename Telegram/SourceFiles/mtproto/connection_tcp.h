@@ -46,9 +46,9 @@ protected:
 	uint32 packetRead, packetLeft; // reading from socket
 	bool readingToShort;
 	char *currentPos;
-	mtpBuffer longBuffer;
+	mtpBuffer longBuffer; // payload of a packet that did not fit in one read
 	mtpPrime shortBuffer[MTPShortBufferSize];
-	virtual void socketPacket(const char *packet, uint32 length) = 0;
+	virtual void socketPacket(mtpBuffer &&data) = 0;
 
 	static mtpBuffer handleResponse(const char *packet, uint32 length);
 	static void handleError(QAbstractSocket::SocketError e, QTcpSocket &sock);
@@ -58,6 +58,10 @@ protected:
 	}
 
 	void tcpSend(mtpBuffer &buffer);
+	void appendToSend(const char *data, int length);
+	void flushSend();
+	QByteArray _sendBuffer;
+	bool _sendFlushQueued = false;
 	uchar _sendKey[CTRState::KeySize];
 	CTRState _sendState;
 	uchar _receiveKey[CTRState::KeySize];
@@ -94,7 +98,7 @@ public slots:
 
 protected:
 
-	void socketPacket(const char *packet, uint32 length) override;
+	void socketPacket(mtpBuffer &&data) override;
 
 private:
 
@@ -22,6 +22,81 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "zlib.h"
 
+namespace {
+
+// Large request buffers (mostly file parts and containers that wrap them)
+// are returned here when the last mtpRequest to them is released and are
+// reused by the next mtpRequestData::prepare() of a similar size.
+constexpr auto kPoolMinCapacity = 1024; // in mtpPrime, 4 KB
+constexpr auto kPoolClassesCount = 10; // 4 KB, 8 KB, .., 2 MB
+constexpr auto kPoolClassLimit = 4; // buffers kept in each size class
+constexpr auto kPoolSizeLimit = 8 * 1024 * 1024; // in bytes
+
+class BufferPool {
+public:
+	bool take(int capacity, mtpBuffer &result) {
+		auto index = classIndex(capacity);
+		if (index < 0) {
+			return false;
+		}
+		QMutexLocker lock(&_mutex);
+		for (; index != kPoolClassesCount; ++index) {
+			auto &buffers = _classes[index];
+			for (auto i = buffers.begin(), e = buffers.end(); i != e; ++i) {
+				if (i->capacity() >= capacity) {
+					_size -= i->capacity() * sizeof(mtpPrime);
+					result = std::move(*i);
+					buffers.erase(i);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void put(mtpBuffer &&buffer) {
+		auto capacity = buffer.capacity();
+		auto index = classIndex(capacity);
+		if (index < 0 || !buffer.isDetached()) {
+			return;
+		}
+		auto size = capacity * sizeof(mtpPrime);
+		QMutexLocker lock(&_mutex);
+		auto &buffers = _classes[index];
+		if (buffers.size() >= kPoolClassLimit || _size + size > kPoolSizeLimit) {
+			return;
+		}
+		_size += size;
+		buffers.push_back(std::move(buffer));
+	}
+
+private:
+	static int classIndex(int capacity) {
+		if (capacity < kPoolMinCapacity) {
+			return -1;
+		}
+		auto result = 0;
+		for (auto bound = kPoolMinCapacity * 2; bound <= capacity; bound *= 2) {
+			if (++result == kPoolClassesCount - 1) {
+				break;
+			}
+		}
+		return result;
+	}
+
+	QMutex _mutex;
+	std::vector<mtpBuffer> _classes[kPoolClassesCount];
+	size_t _size = 0;
+
+};
+
+BufferPool &Pool() {
+	static BufferPool result;
+	return result;
+}
+
+} // namespace
+
 uint32 MTPstring::innerLength() const {
 	uint32 l = v.length();
 	if (l < 254) {
@@ -113,15 +188,94 @@ bool mtpRequestData::needAckByType(mtpTypeId type) {
 	return true;
 }
 
+bool mtpRequestData::interactiveByType(mtpTypeId type) {
+	switch (type) {
+	case mtpc_messages_sendMessage:
+	case mtpc_messages_sendMedia:
+	case mtpc_messages_sendInlineBotResult:
+	case mtpc_messages_sendEncrypted:
+	case mtpc_messages_forwardMessages:
+	case mtpc_messages_editMessage:
+	case mtpc_messages_deleteMessages:
+	case mtpc_channels_deleteMessages:
+	case mtpc_messages_readHistory:
+	case mtpc_channels_readHistory:
+	case mtpc_messages_readEncryptedHistory:
+	case mtpc_messages_readMessageContents:
+	case mtpc_channels_readMessageContents:
+	case mtpc_messages_setTyping:
+	case mtpc_messages_setEncryptedTyping:
+	case mtpc_messages_getBotCallbackAnswer:
+	case mtpc_account_updateStatus:
+	case mtpc_phone_requestCall:
+	case mtpc_phone_acceptCall:
+	case mtpc_phone_confirmCall:
+	case mtpc_phone_discardCall:
+	return true;
+	}
+	return false;
+}
+
+bool mtpRequestData::packableByType(mtpTypeId type) {
+	switch (type) {
+	case mtpc_contacts_importContacts:
+	return true;
+	}
+	return false;
+}
+
+void mtpRequestData::gzipPackIfLarge(mtpRequest &request) {
+	constexpr auto kMinPackSize = 16 * 1024;
+	if (request->size() < 9 || !packableByType((*request)[8])) {
+		return;
+	}
+	auto bodySize = request.innerLength();
+	if (bodySize < kMinPackSize) {
+		return;
+	}
+
+	z_stream stream;
+	stream.zalloc = 0;
+	stream.zfree = 0;
+	stream.opaque = 0;
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return;
+	}
+	auto packed = QByteArray(deflateBound(&stream, bodySize), Qt::Uninitialized);
+	stream.next_in = reinterpret_cast<Bytef*>(request->data() + 8);
+	stream.avail_in = bodySize;
+	stream.next_out = reinterpret_cast<Bytef*>(packed.data());
+	stream.avail_out = packed.size();
+	auto res = deflate(&stream, Z_FINISH);
+	packed.resize(stream.total_out);
+	deflateEnd(&stream);
+
+	// Don't bother if the request became smaller less than by a quarter.
+	if (res != Z_STREAM_END || uint32(packed.size()) > bodySize - bodySize / 4) {
+		return;
+	}
+	auto wrapped = MTP_bytes(std::move(packed));
+	auto result = prepare(1 + (wrapped.innerLength() >> 2));
+	result->push_back(mtpc_gzip_packed);
+	wrapped.write(*result);
+	request = std::move(result);
+}
+
 mtpRequest mtpRequestData::prepare(uint32 requestSize, uint32 maxSize) {
 	if (!maxSize) maxSize = requestSize;
 	mtpRequest result(new mtpRequestData(true));
-	result->reserve(8 + maxSize + _padding(maxSize)); // 2: salt, 2: session_id, 2: msg_id, 1: seq_no, 1: message_length
+	auto capacity = 8 + maxSize + _padding(maxSize); // 2: salt, 2: session_id, 2: msg_id, 1: seq_no, 1: message_length
+	Pool().take(int(capacity), *result);
+	result->reserve(capacity);
 	result->resize(7);
 	result->push_back(requestSize << 2);
 	return result;
 }
 
+mtpRequestData::~mtpRequestData() {
+	Pool().put(std::move(*static_cast<mtpBuffer*>(this)));
+}
+
 void mtpRequestData::padding(mtpRequest &request) {
 	if (request->size() < 9) return;
 
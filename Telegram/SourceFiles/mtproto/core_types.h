@@ -67,9 +67,15 @@ public:
 	mtpRequestData(bool/* sure*/) {
 	}
 
+	// Gives large buffers back to the pool used by prepare().
+	~mtpRequestData();
+
 	static mtpRequest prepare(uint32 requestSize, uint32 maxSize = 0);
 	static void padding(mtpRequest &request);
 
+	// Replaces a large request of a packable type with its gzip_packed version.
+	static void gzipPackIfLarge(mtpRequest &request);
+
 	static uint32 messageSize(const mtpRequest &request) {
 		if (request->size() < 9) return 0;
 		return 4 + (request.innerLength() >> 2); // 2: msg_id, 1: seq_no, q: message_length
@@ -83,8 +89,17 @@ public:
 	}
 	static bool needAckByType(mtpTypeId type);
 
+	// Interactive requests (sending, reading, typing) are put to containers
+	// before the bulk ones (history preloads, file parts) waiting in the same session.
+	static bool isInteractive(const mtpRequest &request) {
+		if (request->size() < 9) return false;
+		return mtpRequestData::interactiveByType((*request)[8]);
+	}
+	static bool interactiveByType(mtpTypeId type);
+
 private:
 	static uint32 _padding(uint32 requestSize);
+	static bool packableByType(mtpTypeId type);
 
 };
 
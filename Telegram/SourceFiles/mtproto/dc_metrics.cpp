@@ -0,0 +1,132 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include "mtproto/dc_metrics.h"
+
+namespace MTP {
+
+void DcMetrics::Rolling::advance(TimeMs now) {
+	auto second = now / 1000;
+	if (second - _second >= kRollingSeconds) {
+		_buckets.fill(0);
+	} else {
+		for (auto i = _second + 1; i <= second; ++i) {
+			_buckets[i % kRollingSeconds] = 0;
+		}
+	}
+	accumulate_max(_second, second);
+}
+
+void DcMetrics::Rolling::add(TimeMs now, int64 bytes) {
+	advance(now);
+	_buckets[_second % kRollingSeconds] += bytes;
+}
+
+int64 DcMetrics::Rolling::perSecond(TimeMs now) const {
+	auto second = now / 1000;
+	auto result = int64(0);
+	for (auto i = 0; i != kRollingSeconds; ++i) {
+		auto bucketSecond = _second - i;
+		if (second - bucketSecond < kRollingSeconds) {
+			result += _buckets[bucketSecond % kRollingSeconds];
+		}
+	}
+	return result / kRollingSeconds;
+}
+
+void DcMetrics::pingReceived(ShiftedDcId shiftedDcId, TimeMs rtt) {
+	QMutexLocker lock(&_mutex);
+	auto &counters = _counters[shiftedDcId];
+	counters.rtt = counters.rtt ? (counters.rtt * 7 + rtt) / 8 : rtt;
+	counters.minRtt = counters.minRtt ? qMin(counters.minRtt, rtt) : rtt;
+}
+
+void DcMetrics::sent(ShiftedDcId shiftedDcId, int64 bytes) {
+	auto now = getms(true);
+	QMutexLocker lock(&_mutex);
+	auto &counters = _counters[shiftedDcId];
+	counters.sentBytes += bytes;
+	counters.sentRolling.add(now, bytes);
+}
+
+void DcMetrics::received(ShiftedDcId shiftedDcId, int64 bytes) {
+	auto now = getms(true);
+	QMutexLocker lock(&_mutex);
+	auto &counters = _counters[shiftedDcId];
+	counters.receivedBytes += bytes;
+	counters.receivedRolling.add(now, bytes);
+}
+
+void DcMetrics::resent(ShiftedDcId shiftedDcId, int count) {
+	QMutexLocker lock(&_mutex);
+	_counters[shiftedDcId].resent += count;
+}
+
+void DcMetrics::resentBytes(ShiftedDcId shiftedDcId, int64 bytes) {
+	QMutexLocker lock(&_mutex);
+	_counters[shiftedDcId].resentBytes += bytes;
+}
+
+void DcMetrics::badMsgNotification(ShiftedDcId shiftedDcId) {
+	QMutexLocker lock(&_mutex);
+	++_counters[shiftedDcId].badMsgNotifications;
+}
+
+void DcMetrics::queued(ShiftedDcId shiftedDcId, int count) {
+	QMutexLocker lock(&_mutex);
+	_counters[shiftedDcId].queued = count;
+}
+
+std::vector<DcMetricsStats> DcMetrics::collect() const {
+	auto now = getms(true);
+	auto result = std::vector<DcMetricsStats>();
+
+	QMutexLocker lock(&_mutex);
+	result.reserve(_counters.size());
+	for (auto &entry : _counters) {
+		auto &counters = entry.second;
+		auto stats = DcMetricsStats();
+		stats.shiftedDcId = entry.first;
+		stats.rtt = counters.rtt;
+		stats.minRtt = counters.minRtt;
+		stats.sentBytes = counters.sentBytes;
+		stats.receivedBytes = counters.receivedBytes;
+		stats.sentPerSecond = counters.sentRolling.perSecond(now);
+		stats.receivedPerSecond = counters.receivedRolling.perSecond(now);
+		stats.resent = counters.resent;
+		stats.resentBytes = counters.resentBytes;
+		stats.badMsgNotifications = counters.badMsgNotifications;
+		stats.queued = counters.queued;
+		result.push_back(stats);
+	}
+	return result;
+}
+
+void DcMetrics::writeToLog() const {
+	auto stats = collect();
+	LOG(("MTP Metrics: %1 dcs").arg(stats.size()));
+	for (auto &dc : stats) {
+		LOG(("MTP Metrics: dc %1, rtt %2 ms (min %3 ms), sent %4 KB (%5 KB/s), received %6 KB (%7 KB/s), resent %8 (%9 KB), bad msg %10, queued %11").arg(dc.shiftedDcId).arg(dc.rtt).arg(dc.minRtt).arg(dc.sentBytes / 1024).arg(dc.sentPerSecond / 1024).arg(dc.receivedBytes / 1024).arg(dc.receivedPerSecond / 1024).arg(dc.resent).arg(dc.resentBytes / 1024).arg(dc.badMsgNotifications).arg(dc.queued));
+	}
+}
+
+} // namespace MTP
@@ -0,0 +1,90 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#pragma once
+
+namespace MTP {
+
+struct DcMetricsStats {
+	ShiftedDcId shiftedDcId = 0;
+	TimeMs rtt = 0; // smoothed ping round trip time
+	TimeMs minRtt = 0;
+	int64 sentBytes = 0;
+	int64 receivedBytes = 0;
+	int64 sentPerSecond = 0; // during the last minute
+	int64 receivedPerSecond = 0;
+	int resent = 0;
+	int64 resentBytes = 0; // requests sent again, without the containers
+	int badMsgNotifications = 0;
+	int queued = 0; // requests waiting in toSendMap at the last send
+};
+
+// Rolling network counters for every shifted dc.
+//
+// Filled from the connection threads, so all the methods are thread-safe.
+class DcMetrics {
+public:
+	void pingReceived(ShiftedDcId shiftedDcId, TimeMs rtt);
+	void sent(ShiftedDcId shiftedDcId, int64 bytes);
+	void received(ShiftedDcId shiftedDcId, int64 bytes);
+	void resent(ShiftedDcId shiftedDcId, int count);
+	void resentBytes(ShiftedDcId shiftedDcId, int64 bytes);
+	void badMsgNotification(ShiftedDcId shiftedDcId);
+	void queued(ShiftedDcId shiftedDcId, int count);
+
+	std::vector<DcMetricsStats> collect() const;
+	void writeToLog() const;
+
+private:
+	static constexpr auto kRollingSeconds = 60;
+
+	class Rolling {
+	public:
+		void add(TimeMs now, int64 bytes);
+		int64 perSecond(TimeMs now) const;
+
+	private:
+		void advance(TimeMs now);
+
+		std::array<int64, kRollingSeconds> _buckets = { { 0 } };
+		TimeMs _second = 0; // the second of the last bucket
+
+	};
+	struct Counters {
+		TimeMs rtt = 0;
+		TimeMs minRtt = 0;
+		int64 sentBytes = 0;
+		int64 receivedBytes = 0;
+		Rolling sentRolling;
+		Rolling receivedRolling;
+		int resent = 0;
+		int64 resentBytes = 0;
+		int badMsgNotifications = 0;
+		int queued = 0;
+	};
+
+	mutable QMutex _mutex;
+	std::map<ShiftedDcId, Counters> _counters;
+
+};
+
+} // namespace MTP
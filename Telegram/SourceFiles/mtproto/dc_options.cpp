@@ -373,6 +373,20 @@ bool DcOptions::hasCDNKeysForDc(DcId dcId) const {
 	return _cdnPublicKeys.find(dcId) != _cdnPublicKeys.cend();
 }
 
+void DcOptions::setIPv6Preferred(DcId dcId, bool preferred) {
+	QMutexLocker lock(&_ipv6PreferredMutex);
+	if (preferred) {
+		_ipv6Preferred.insert(dcId);
+	} else {
+		_ipv6Preferred.erase(dcId);
+	}
+}
+
+bool DcOptions::ipv6Preferred(DcId dcId) const {
+	QMutexLocker lock(&_ipv6PreferredMutex);
+	return _ipv6Preferred.find(dcId) != _ipv6Preferred.cend();
+}
+
 bool DcOptions::getDcRSAKey(DcId dcId, const QVector<MTPlong> &fingerprints, internal::RSAPublicKey *result) const {
 	auto findKey = [&fingerprints, &result](const std::map<uint64, internal::RSAPublicKey> &keys) {
 		for_const (auto &fingerprint, fingerprints) {
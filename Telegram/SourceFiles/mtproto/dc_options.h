@@ -75,6 +75,10 @@ public:
 
 	void setCDNConfig(const MTPDcdnConfig &config);
 	bool hasCDNKeysForDc(DcId dcId) const;
+
+	// IPv6 is preferred for a dc after IPv4 could not connect in time.
+	void setIPv6Preferred(DcId dcId, bool preferred);
+	bool ipv6Preferred(DcId dcId) const;
 	bool getDcRSAKey(DcId dcId, const QVector<MTPlong> &fingerprints, internal::RSAPublicKey *result) const;
 
 	// Debug feature for now.
@@ -110,6 +114,9 @@ private:
 	std::map<DcId, std::map<uint64, internal::RSAPublicKey>> _cdnPublicKeys;
 	mutable QReadWriteLock _useThroughLockers;
 
+	std::set<DcId> _ipv6Preferred;
+	mutable QMutex _ipv6PreferredMutex;
+
 	mutable base::Observable<Ids> _changed;
 
 	// True when we have overriden options from a .tdesktop-endpoints file.
@@ -86,13 +86,16 @@ constexpr ShiftedDcId logoutDcId(DcId dcId) {
 	return shiftDcId(dcId, internal::kLogoutDcShift);
 }
 
+// Download sessions are opened when the previous ones are saturated,
+// the extra ones are closed after being idle for some time.
 constexpr auto kDownloadSessionsCount = 2;
+constexpr auto kMaxDownloadSessionsCount = 4;
 constexpr auto kUploadSessionsCount = 2;
 
 namespace internal {
 
 constexpr ShiftedDcId downloadDcId(DcId dcId, int index) {
-	static_assert(kDownloadSessionsCount < internal::kMaxMediaDcCount, "Too large MTPDownloadSessionsCount!");
+	static_assert(kMaxDownloadSessionsCount < internal::kMaxMediaDcCount, "Too large MTPDownloadSessionsCount!");
 	return shiftDcId(dcId, internal::kBaseDownloadDcShift + index);
 };
 
@@ -100,12 +103,12 @@ constexpr ShiftedDcId downloadDcId(DcId dcId, int index) {
 
 // send(req, callbacks, MTP::downloadDcId(dc, index)) - for download shifted dc id
 inline ShiftedDcId downloadDcId(DcId dcId, int index) {
-	Expects(index >= 0 && index < kDownloadSessionsCount);
+	Expects(index >= 0 && index < kMaxDownloadSessionsCount);
 	return internal::downloadDcId(dcId, index);
 }
 
 inline constexpr bool isDownloadDcId(ShiftedDcId shiftedDcId) {
-	return (shiftedDcId >= internal::downloadDcId(0, 0)) && (shiftedDcId < internal::downloadDcId(0, kDownloadSessionsCount - 1) + internal::kDcShift);
+	return (shiftedDcId >= internal::downloadDcId(0, 0)) && (shiftedDcId < internal::downloadDcId(0, kMaxDownloadSessionsCount - 1) + internal::kDcShift);
 }
 
 inline bool isCdnDc(MTPDdcOption::Flags flags) {
@@ -235,6 +238,7 @@ mtpRequestId Session::send(const TRequest &request, RPCResponseHandler callbacks
 		uint32 requestSize = request.innerLength() >> 2;
 		mtpRequest reqSerialized(mtpRequestData::prepare(requestSize));
 		request.write(*reqSerialized);
+		mtpRequestData::gzipPackIfLarge(reqSerialized);
 
 		DEBUG_LOG(("MTP Info: adding request to toSendMap, msCanWait %1").arg(msCanWait));
 
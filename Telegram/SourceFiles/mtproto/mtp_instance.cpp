@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mtproto/mtp_instance.h"
 
 #include "mtproto/dc_options.h"
+#include "mtproto/dc_metrics.h"
 #include "mtproto/dcenter.h"
 #include "mtproto/config_loader.h"
 #include "mtproto/connection.h"
@@ -33,6 +34,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "lang/lang_instance.h"
 #include "lang/lang_cloud_manager.h"
 #include "base/timer.h"
+#include "base/flat_map.h"
 
 namespace MTP {
 
@@ -51,6 +53,7 @@ public:
 	void addKeysForDestroy(AuthKeysList &&keys);
 
 	not_null<DcOptions*> dcOptions();
+	not_null<DcMetrics*> metrics();
 
 	void requestConfig();
 	void requestCDNConfig();
@@ -139,6 +142,7 @@ private:
 
 	not_null<Instance*> _instance;
 	not_null<DcOptions*> _dcOptions;
+	DcMetrics _metrics;
 	Instance::Mode _mode = Instance::Mode::Normal;
 
 	DcId _mainDcId = Config::kDefaultMainDc;
@@ -159,17 +163,20 @@ private:
 
 	std::map<ShiftedDcId, mtpRequestId> _logoutGuestRequestIds;
 
+	// Request ids grow monotonically, so the per-request tables are kept in flat
+	// maps: a new request is appended to the end without any node allocation.
+
 	// holds dcWithShift for request to this dc or -dc for request to main dc
-	std::map<mtpRequestId, ShiftedDcId> _requestsByDc;
+	base::flat_map<mtpRequestId, ShiftedDcId> _requestsByDc;
 	QMutex _requestByDcLock;
 
 	// holds target dcWithShift for auth export request
 	std::map<mtpRequestId, ShiftedDcId> _authExportRequests;
 
-	std::map<mtpRequestId, RPCResponseHandler> _parserMap;
+	base::flat_map<mtpRequestId, RPCResponseHandler> _parserMap;
 	QMutex _parserMapLock;
 
-	std::map<mtpRequestId, mtpRequest> _requestMap;
+	base::flat_map<mtpRequestId, mtpRequest> _requestMap;
 	QReadWriteLock _requestMapLock;
 
 	std::deque<std::pair<mtpRequestId, TimeMs>> _delayedRequests;
@@ -560,6 +567,10 @@ not_null<DcOptions*> Instance::Private::dcOptions() {
 	return _dcOptions;
 }
 
+not_null<DcMetrics*> Instance::Private::metrics() {
+	return &_metrics;
+}
+
 void Instance::Private::unpaused() {
 	for (auto &session : _sessions) {
 		session.second->unpaused();
@@ -580,6 +591,9 @@ void Instance::Private::connectionFinished(internal::Connection *connection) {
 void Instance::Private::configLoadDone(const MTPConfig &result) {
 	Expects(result.type() == mtpc_config);
 
+	if (_configLoader) {
+		_configLoader->finished();
+	}
 	_configLoader.reset();
 
 	auto &data = result.c_config();
@@ -682,11 +696,11 @@ void Instance::Private::unregisterRequest(mtpRequestId requestId) {
 
 	{
 		QWriteLocker locker(&_requestMapLock);
-		_requestMap.erase(requestId);
+		_requestMap.remove(requestId);
 	}
 
 	QMutexLocker locker(&_requestByDcLock);
-	_requestsByDc.erase(requestId);
+	_requestsByDc.remove(requestId);
 }
 
 mtpRequestId Instance::Private::storeRequest(mtpRequest &request, const RPCResponseHandler &parser) {
@@ -1373,6 +1387,10 @@ not_null<DcOptions*> Instance::dcOptions() {
 	return _private->dcOptions();
 }
 
+not_null<DcMetrics*> Instance::metrics() {
+	return _private->metrics();
+}
+
 void Instance::unpaused() {
 	_private->unpaused();
 }
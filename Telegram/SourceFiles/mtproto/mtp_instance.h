@@ -29,6 +29,7 @@ class Dcenter;
 } // namespace internal
 
 class DcOptions;
+class DcMetrics;
 class Session;
 class AuthKey;
 using AuthKeyPtr = std::shared_ptr<AuthKey>;
@@ -68,6 +69,7 @@ public:
 	void addKeysForDestroy(AuthKeysList &&keys);
 
 	not_null<DcOptions*> dcOptions();
+	not_null<DcMetrics*> metrics();
 
 	template <typename TRequest>
 	mtpRequestId send(const TRequest &request, RPCResponseHandler callbacks = RPCResponseHandler(), ShiftedDcId dcId = 0, TimeMs msCanWait = 0, mtpRequestId after = 0) {
@@ -283,48 +283,48 @@ using RPCCallbackClears = QVector<RPCCallbackClear> ;
 
 template <typename TReturn>
 inline RPCDoneHandlerPtr rpcDone(TReturn (*onDone)(const mtpPrime *, const mtpPrime *)) { // done(from, end)
-	return RPCDoneHandlerPtr(new RPCDoneHandlerBare<TReturn>(onDone));
+	return MakeShared<RPCDoneHandlerBare<TReturn>>(onDone);
 }
 
 template <typename TReturn>
 inline RPCDoneHandlerPtr rpcDone(TReturn (*onDone)(const mtpPrime *, const mtpPrime *, mtpRequestId)) { // done(from, end, req_id)
-	return RPCDoneHandlerPtr(new RPCDoneHandlerBareReq<TReturn>(onDone));
+	return MakeShared<RPCDoneHandlerBareReq<TReturn>>(onDone);
 }
 
 template <typename TReturn, typename TResponse>
 inline RPCDoneHandlerPtr rpcDone(TReturn (*onDone)(const TResponse &)) { // done(result)
-	return RPCDoneHandlerPtr(new RPCDoneHandlerPlain<TReturn, TResponse>(onDone));
+	return MakeShared<RPCDoneHandlerPlain<TReturn, TResponse>>(onDone);
 }
 
 template <typename TReturn, typename TResponse>
 inline RPCDoneHandlerPtr rpcDone(TReturn (*onDone)(const TResponse &, mtpRequestId)) { // done(result, req_id)
-	return RPCDoneHandlerPtr(new RPCDoneHandlerReq<TReturn, TResponse>(onDone));
+	return MakeShared<RPCDoneHandlerReq<TReturn, TResponse>>(onDone);
 }
 
 template <typename TReturn>
 inline RPCDoneHandlerPtr rpcDone(TReturn (*onDone)()) { // done()
-	return RPCDoneHandlerPtr(new RPCDoneHandlerNo<TReturn>(onDone));
+	return MakeShared<RPCDoneHandlerNo<TReturn>>(onDone);
 }
 
 template <typename TReturn>
 inline RPCDoneHandlerPtr rpcDone(TReturn (*onDone)(mtpRequestId)) { // done(req_id)
-	return RPCDoneHandlerPtr(new RPCDoneHandlerNoReq<TReturn>(onDone));
+	return MakeShared<RPCDoneHandlerNoReq<TReturn>>(onDone);
 }
 
 inline RPCFailHandlerPtr rpcFail(bool (*onFail)(const RPCError &)) { // fail(error)
-	return RPCFailHandlerPtr(new RPCFailHandlerPlain(onFail));
+	return MakeShared<RPCFailHandlerPlain>(onFail);
 }
 
 inline RPCFailHandlerPtr rpcFail(bool (*onFail)(const RPCError &, mtpRequestId)) { // fail(error, req_id)
-	return RPCFailHandlerPtr(new RPCFailHandlerReq(onFail));
+	return MakeShared<RPCFailHandlerReq>(onFail);
 }
 
 inline RPCFailHandlerPtr rpcFail(bool (*onFail)()) { // fail()
-	return RPCFailHandlerPtr(new RPCFailHandlerNo(onFail));
+	return MakeShared<RPCFailHandlerNo>(onFail);
 }
 
 inline RPCFailHandlerPtr rpcFail(bool (*onFail)(mtpRequestId)) { // fail(req_id)
-	return RPCFailHandlerPtr(new RPCFailHandlerNoReq(onFail));
+	return MakeShared<RPCFailHandlerNoReq>(onFail);
 }
 
 class RPCSender;
@@ -729,102 +729,102 @@ class RPCSender {
 public:
 	template <typename TReturn, typename TReceiver> // done(from, end)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(const mtpPrime *, const mtpPrime *)) {
-		return RPCDoneHandlerPtr(new RPCDoneHandlerBareOwned<TReturn, TReceiver>(static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCDoneHandlerBareOwned<TReturn, TReceiver>>(static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename TReturn, typename TReceiver> // done(from, end, req_id)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(const mtpPrime *, const mtpPrime *, mtpRequestId)) {
-		return RPCDoneHandlerPtr(new RPCDoneHandlerBareOwnedReq<TReturn, TReceiver>(static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCDoneHandlerBareOwnedReq<TReturn, TReceiver>>(static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename TReturn, typename TReceiver, typename TResponse> // done(result)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(const TResponse &)) {
-		return RPCDoneHandlerPtr(new RPCDoneHandlerOwned<TReturn, TReceiver, TResponse>(static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCDoneHandlerOwned<TReturn, TReceiver, TResponse>>(static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename TReturn, typename TReceiver, typename TResponse> // done(result, req_id)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(const TResponse &, mtpRequestId)) {
-		return RPCDoneHandlerPtr(new RPCDoneHandlerOwnedReq<TReturn, TReceiver, TResponse>(static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCDoneHandlerOwnedReq<TReturn, TReceiver, TResponse>>(static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename TReturn, typename TReceiver> // done()
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)()) {
-		return RPCDoneHandlerPtr(new RPCDoneHandlerOwnedNo<TReturn, TReceiver>(static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCDoneHandlerOwnedNo<TReturn, TReceiver>>(static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename TReturn, typename TReceiver> // done(req_id)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(mtpRequestId)) {
-		return RPCDoneHandlerPtr(new RPCDoneHandlerOwnedNoReq<TReturn, TReceiver>(static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCDoneHandlerOwnedNoReq<TReturn, TReceiver>>(static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename TReceiver> // fail(error)
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)(const RPCError &)) {
-		return RPCFailHandlerPtr(new RPCFailHandlerOwned<TReceiver>(static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCFailHandlerOwned<TReceiver>>(static_cast<TReceiver*>(this), onFail);
 	}
 
 	template <typename TReceiver> // fail(error, req_id)
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)(const RPCError &, mtpRequestId)) {
-		return RPCFailHandlerPtr(new RPCFailHandlerOwnedReq<TReceiver>(static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCFailHandlerOwnedReq<TReceiver>>(static_cast<TReceiver*>(this), onFail);
 	}
 
 	template <typename TReceiver> // fail()
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)()) {
-		return RPCFailHandlerPtr(new RPCFailHandlerOwnedNo<TReceiver>(static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCFailHandlerOwnedNo<TReceiver>>(static_cast<TReceiver*>(this), onFail);
 	}
 
 	template <typename TReceiver> // fail(req_id)
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)(mtpRequestId)) {
-		return RPCFailHandlerPtr(new RPCFailHandlerOwnedNo<TReceiver>(static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCFailHandlerOwnedNo<TReceiver>>(static_cast<TReceiver*>(this), onFail);
 	}
 
 	template <typename T, typename TReturn, typename TReceiver> // done(b, from, end)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(T, const mtpPrime *, const mtpPrime *), T b) {
-		return RPCDoneHandlerPtr(new RPCBindedDoneHandlerBareOwned<T, TReturn, TReceiver>(b, static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCBindedDoneHandlerBareOwned<T, TReturn, TReceiver>>(b, static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename T, typename TReturn, typename TReceiver> // done(b, from, end, req_id)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(T, const mtpPrime *, const mtpPrime *, mtpRequestId), T b) {
-		return RPCDoneHandlerPtr(new RPCBindedDoneHandlerBareOwnedReq<T, TReturn, TReceiver>(b, static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCBindedDoneHandlerBareOwnedReq<T, TReturn, TReceiver>>(b, static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename T, typename TReturn, typename TReceiver, typename TResponse> // done(b, result)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(T, const TResponse &), T b) {
-		return RPCDoneHandlerPtr(new RPCBindedDoneHandlerOwned<T, TReturn, TReceiver, TResponse>(b, static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCBindedDoneHandlerOwned<T, TReturn, TReceiver, TResponse>>(b, static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename T, typename TReturn, typename TReceiver, typename TResponse> // done(b, result, req_id)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(T, const TResponse &, mtpRequestId), T b) {
-		return RPCDoneHandlerPtr(new RPCBindedDoneHandlerOwnedReq<T, TReturn, TReceiver, TResponse>(b, static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCBindedDoneHandlerOwnedReq<T, TReturn, TReceiver, TResponse>>(b, static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename T, typename TReturn, typename TReceiver> // done(b)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(T), T b) {
-		return RPCDoneHandlerPtr(new RPCBindedDoneHandlerOwnedNo<T, TReturn, TReceiver>(b, static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCBindedDoneHandlerOwnedNo<T, TReturn, TReceiver>>(b, static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename T, typename TReturn, typename TReceiver> // done(b, req_id)
 	RPCDoneHandlerPtr rpcDone(TReturn (TReceiver::*onDone)(T, mtpRequestId), T b) {
-		return RPCDoneHandlerPtr(new RPCBindedDoneHandlerOwnedNoReq<T, TReturn, TReceiver>(b, static_cast<TReceiver*>(this), onDone));
+		return MakeShared<RPCBindedDoneHandlerOwnedNoReq<T, TReturn, TReceiver>>(b, static_cast<TReceiver*>(this), onDone);
 	}
 
 	template <typename T, typename TReceiver> // fail(b, error)
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)(T, const RPCError &), T b) {
-		return RPCFailHandlerPtr(new RPCBindedFailHandlerOwned<T, TReceiver>(b, static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCBindedFailHandlerOwned<T, TReceiver>>(b, static_cast<TReceiver*>(this), onFail);
 	}
 
 	template <typename T, typename TReceiver> // fail(b, error, req_id)
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)(T, const RPCError &, mtpRequestId), T b) {
-		return RPCFailHandlerPtr(new RPCBindedFailHandlerOwnedReq<T, TReceiver>(b, static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCBindedFailHandlerOwnedReq<T, TReceiver>>(b, static_cast<TReceiver*>(this), onFail);
 	}
 
 	template <typename T, typename TReceiver> // fail(b)
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)(T), T b) {
-		return RPCFailHandlerPtr(new RPCBindedFailHandlerOwnedNo<T, TReceiver>(b, static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCBindedFailHandlerOwnedNo<T, TReceiver>>(b, static_cast<TReceiver*>(this), onFail);
 	}
 
 	template <typename T, typename TReceiver> // fail(b, req_id)
 	RPCFailHandlerPtr rpcFail(bool (TReceiver::*onFail)(T, mtpRequestId), T b) {
-		return RPCFailHandlerPtr(new RPCBindedFailHandlerOwnedNo<T, TReceiver>(b, static_cast<TReceiver*>(this), onFail));
+		return MakeShared<RPCBindedFailHandlerOwnedNo<T, TReceiver>>(b, static_cast<TReceiver*>(this), onFail);
 	}
 
 	virtual void rpcClear() {
@@ -850,14 +850,22 @@ protected:
 using MTPStateChangedHandler = void (*)(int32 dcId, int32 state);
 using MTPSessionResetHandler = void (*)(int32 dcId);
 
+// Handlers are allocated anyway, so they keep the callback captures inline,
+// most of the request callbacks don't fit in the default lambda storage.
+constexpr auto kRPCHandlerLambdaSize = 64U;
+
+template <typename FunctionType>
+using RPCHandlerLambda = base::lambda_once<FunctionType, kRPCHandlerLambdaSize>;
+
 template <typename Base, typename FunctionType>
 class RPCHandlerImplementation : public Base {
 protected:
-	using Lambda = base::lambda_once<FunctionType>;
+	using Lambda = RPCHandlerLambda<FunctionType>;
 	using Parent = RPCHandlerImplementation<Base, FunctionType>;
 
 public:
-	RPCHandlerImplementation(Lambda handler) : _handler(std::move(handler)) {
+	template <typename Callable>
+	RPCHandlerImplementation(Callable &&handler) : _handler(std::forward<Callable>(handler)) {
 	}
 
 protected:
@@ -936,39 +944,39 @@ public:
 
 };
 
-template <typename R>
-inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(base::lambda_once<R(const mtpPrime*, const mtpPrime*)> lambda) {
-	return RPCDoneHandlerPtr(new RPCDoneHandlerImplementationBare<R>(std::move(lambda)));
+template <typename R, typename Lambda>
+inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<R(const mtpPrime*, const mtpPrime*)>*) {
+	return MakeShared<RPCDoneHandlerImplementationBare<R>>(std::forward<Lambda>(lambda));
 }
 
-template <typename R>
-inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(base::lambda_once<R(const mtpPrime*, const mtpPrime*, mtpRequestId)> lambda) {
-	return RPCDoneHandlerPtr(new RPCDoneHandlerImplementationBareReq<R>(std::move(lambda)));
+template <typename R, typename Lambda>
+inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<R(const mtpPrime*, const mtpPrime*, mtpRequestId)>*) {
+	return MakeShared<RPCDoneHandlerImplementationBareReq<R>>(std::forward<Lambda>(lambda));
 }
 
-template <typename R, typename T>
-inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(base::lambda_once<R(const T&)> lambda) {
-	return RPCDoneHandlerPtr(new RPCDoneHandlerImplementationPlain<R, T>(std::move(lambda)));
+template <typename R, typename T, typename Lambda>
+inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<R(const T&)>*) {
+	return MakeShared<RPCDoneHandlerImplementationPlain<R, T>>(std::forward<Lambda>(lambda));
 }
 
-template <typename R, typename T>
-inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(base::lambda_once<R(const T&, mtpRequestId)> lambda) {
-	return RPCDoneHandlerPtr(new RPCDoneHandlerImplementationReq<R, T>(std::move(lambda)));
+template <typename R, typename T, typename Lambda>
+inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<R(const T&, mtpRequestId)>*) {
+	return MakeShared<RPCDoneHandlerImplementationReq<R, T>>(std::forward<Lambda>(lambda));
 }
 
-template <typename R>
-inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(base::lambda_once<R()> lambda) {
-	return RPCDoneHandlerPtr(new RPCDoneHandlerImplementationNo<R>(std::move(lambda)));
+template <typename R, typename Lambda>
+inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<R()>*) {
+	return MakeShared<RPCDoneHandlerImplementationNo<R>>(std::forward<Lambda>(lambda));
 }
 
-template <typename R>
-inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(base::lambda_once<R(mtpRequestId)> lambda) {
-	return RPCDoneHandlerPtr(new RPCDoneHandlerImplementationNoReq<R>(std::move(lambda)));
+template <typename R, typename Lambda>
+inline RPCDoneHandlerPtr rpcDone_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<R(mtpRequestId)>*) {
+	return MakeShared<RPCDoneHandlerImplementationNoReq<R>>(std::forward<Lambda>(lambda));
 }
 
 template <typename Lambda>
 RPCDoneHandlerPtr rpcDone(Lambda lambda) {
-	return rpcDone_lambda_wrap_helper(base::lambda_type<Lambda>(std::move(lambda)));
+	return rpcDone_lambda_wrap_helper(std::move(lambda), static_cast<base::lambda_type<Lambda>*>(nullptr));
 }
 
 template <typename FunctionType>
@@ -1010,23 +1018,27 @@ public:
 
 };
 
-inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(base::lambda_once<bool(const RPCError&)> lambda) {
-	return RPCFailHandlerPtr(new RPCFailHandlerImplementationPlain(std::move(lambda)));
+template <typename Lambda>
+inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<bool(const RPCError&)>*) {
+	return MakeShared<RPCFailHandlerImplementationPlain>(std::forward<Lambda>(lambda));
 }
 
-inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(base::lambda_once<bool(const RPCError&, mtpRequestId)> lambda) {
-	return RPCFailHandlerPtr(new RPCFailHandlerImplementationReq(std::move(lambda)));
+template <typename Lambda>
+inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<bool(const RPCError&, mtpRequestId)>*) {
+	return MakeShared<RPCFailHandlerImplementationReq>(std::forward<Lambda>(lambda));
 }
 
-inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(base::lambda_once<bool()> lambda) {
-	return RPCFailHandlerPtr(new RPCFailHandlerImplementationNo(std::move(lambda)));
+template <typename Lambda>
+inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<bool()>*) {
+	return MakeShared<RPCFailHandlerImplementationNo>(std::forward<Lambda>(lambda));
 }
 
-inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(base::lambda_once<bool(mtpRequestId)> lambda) {
-	return RPCFailHandlerPtr(new RPCFailHandlerImplementationNoReq(std::move(lambda)));
+template <typename Lambda>
+inline RPCFailHandlerPtr rpcFail_lambda_wrap_helper(Lambda &&lambda, base::lambda_once<bool(mtpRequestId)>*) {
+	return MakeShared<RPCFailHandlerImplementationNoReq>(std::forward<Lambda>(lambda));
 }
 
 template <typename Lambda>
 RPCFailHandlerPtr rpcFail(Lambda lambda) {
-	return rpcFail_lambda_wrap_helper(base::lambda_type<Lambda>(std::move(lambda)));
+	return rpcFail_lambda_wrap_helper(std::move(lambda), static_cast<base::lambda_type<Lambda>*>(nullptr));
 }
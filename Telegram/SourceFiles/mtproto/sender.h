@@ -35,8 +35,8 @@ class Sender {
 		RequestBuilder &operator=(RequestBuilder &&other) = delete;
 
 	protected:
-		using FailPlainHandler = base::lambda_once<void(const RPCError &error)>;
-		using FailRequestIdHandler = base::lambda_once<void(const RPCError &error, mtpRequestId requestId)>;
+		using FailPlainHandler = RPCHandlerLambda<void(const RPCError &error)>;
+		using FailRequestIdHandler = RPCHandlerLambda<void(const RPCError &error, mtpRequestId requestId)>;
 		enum class FailSkipPolicy {
 			Simple,
 			HandleFlood,
@@ -44,7 +44,7 @@ class Sender {
 		};
 		template <typename Response>
 		struct DonePlainPolicy {
-			using Callback = base::lambda_once<void(const Response &result)>;
+			using Callback = RPCHandlerLambda<void(const Response &result)>;
 			static void handle(Callback &&handler, mtpRequestId requestId, Response &&result) {
 				handler(result);
 			}
@@ -52,7 +52,7 @@ class Sender {
 		};
 		template <typename Response>
 		struct DoneRequestIdPolicy {
-			using Callback = base::lambda_once<void(const Response &result, mtpRequestId requestId)>;
+			using Callback = RPCHandlerLambda<void(const Response &result, mtpRequestId requestId)>;
 			static void handle(Callback &&handler, mtpRequestId requestId, Response &&result) {
 				handler(result, requestId);
 			}
@@ -85,14 +85,14 @@ class Sender {
 		};
 
 		struct FailPlainPolicy {
-			using Callback = base::lambda_once<void(const RPCError &error)>;
+			using Callback = RPCHandlerLambda<void(const RPCError &error)>;
 			static void handle(Callback &&handler, mtpRequestId requestId, const RPCError &error) {
 				handler(error);
 			}
 
 		};
 		struct FailRequestIdPolicy {
-			using Callback = base::lambda_once<void(const RPCError &error, mtpRequestId requestId)>;
+			using Callback = RPCHandlerLambda<void(const RPCError &error, mtpRequestId requestId)>;
 			static void handle(Callback &&handler, mtpRequestId requestId, const RPCError &error) {
 				handler(error, requestId);
 			}
@@ -222,19 +222,19 @@ public:
 			setCanWait(ms);
 			return *this;
 		}
-		SpecificRequestBuilder &done(base::lambda_once<void(const typename Request::ResponseType &result)> callback) WARN_UNUSED_RESULT {
+		SpecificRequestBuilder &done(RPCHandlerLambda<void(const typename Request::ResponseType &result)> callback) WARN_UNUSED_RESULT {
 			setDoneHandler(MakeShared<DoneHandler<typename Request::ResponseType, DonePlainPolicy>>(sender(), std::move(callback)));
 			return *this;
 		}
-		SpecificRequestBuilder &done(base::lambda_once<void(const typename Request::ResponseType &result, mtpRequestId requestId)> callback) WARN_UNUSED_RESULT {
+		SpecificRequestBuilder &done(RPCHandlerLambda<void(const typename Request::ResponseType &result, mtpRequestId requestId)> callback) WARN_UNUSED_RESULT {
 			setDoneHandler(MakeShared<DoneHandler<typename Request::ResponseType, DoneRequestIdPolicy>>(sender(), std::move(callback)));
 			return *this;
 		}
-		SpecificRequestBuilder &fail(base::lambda_once<void(const RPCError &error)> callback) noexcept WARN_UNUSED_RESULT {
+		SpecificRequestBuilder &fail(RPCHandlerLambda<void(const RPCError &error)> callback) noexcept WARN_UNUSED_RESULT {
 			setFailHandler(std::move(callback));
 			return *this;
 		}
-		SpecificRequestBuilder &fail(base::lambda_once<void(const RPCError &error, mtpRequestId requestId)> callback) noexcept WARN_UNUSED_RESULT {
+		SpecificRequestBuilder &fail(RPCHandlerLambda<void(const RPCError &error, mtpRequestId requestId)> callback) noexcept WARN_UNUSED_RESULT {
 			setFailHandler(std::move(callback));
 			return *this;
 		}
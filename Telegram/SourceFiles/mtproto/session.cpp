@@ -22,10 +22,27 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "mtproto/connection.h"
 #include "mtproto/dcenter.h"
+#include "mtproto/dc_metrics.h"
 #include "mtproto/auth_key.h"
+#include "core/memory_stats.h"
 
 namespace MTP {
 namespace internal {
+namespace {
+
+constexpr auto kSlowReceivedMs = TimeMs(20); // in debug mode log the received messages handled longer than that
+constexpr auto kCheckStateBeforeResendSize = 1024; // ints, after a restart bigger requests are resent only if the server lacks them
+
+void LogSlowReceived(const char *kind, const SerializedMessage &message, TimeMs duration) {
+	if (duration < kSlowReceivedMs || !cDebug()) {
+		return;
+	}
+	auto type = message.isEmpty() ? mtpTypeId(0) : mtpTypeId(message.at(0));
+	auto bytes = message.size() * sizeof(mtpPrime);
+	DEBUG_LOG(("MTP Perf: %1 0x%2 of %3 bytes handled in %4 ms").arg(kind).arg(type, 8, 16, QChar('0')).arg(bytes).arg(duration));
+}
+
+} // namespace
 
 void SessionData::setKey(const AuthKeyPtr &key) {
 	if (_authKey != key) {
@@ -417,6 +434,7 @@ mtpRequestId Session::resend(quint64 msgId, qint64 msCanWait, bool forceContaine
 		}
 		return 0xFFFFFFFF;
 	} else if (!mtpRequestData::isStateRequest(request)) {
+		_instance->metrics()->resentBytes(dcWithShift, mtpRequestData::messageSize(request) * sizeof(mtpPrime));
 		request->msDate = forceContainer ? 0 : getms(true);
 		sendPrepared(request, msCanWait, false);
 		{
@@ -437,14 +455,35 @@ void Session::resendMany(QVector<quint64> msgIds, qint64 msCanWait, bool forceCo
 
 void Session::resendAll() {
 	QVector<mtpMsgId> toResend;
+	QVector<mtpMsgId> toCheck;
 	{
 		QReadLocker locker(data.haveSentMutex());
 		const mtpRequestMap &haveSent(data.haveSentMap());
 		toResend.reserve(haveSent.size());
+		auto ms = getms(true);
 		for (mtpRequestMap::const_iterator i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
-			if (i.value()->requestId) toResend.push_back(i.key());
+			auto &request = i.value();
+			if (!request->requestId) continue;
+
+			if (!mtpRequestData::isStateRequest(request) && mtpRequestData::messageSize(request) >= kCheckStateBeforeResendSize) {
+				// The state info answer resends it only if the server has not received it.
+				request->msDate = ms;
+				toCheck.push_back(i.key());
+			} else {
+				toResend.push_back(i.key());
+			}
 		}
 	}
+	if (!toCheck.isEmpty()) {
+		DEBUG_LOG(("MTP Info: requesting state of msgs before resending: %1").arg(Logs::vector(toCheck)));
+		{
+			QWriteLocker locker(data.stateRequestMutex());
+			for (auto msgId : toCheck) {
+				data.stateRequestMap().insert(msgId, true);
+			}
+		}
+		sendAnything(10);
+	}
 	for (uint32 i = 0, l = toResend.size(); i < l; ++i) {
 		resend(toResend[i], 10, true);
 	}
@@ -518,35 +557,33 @@ void Session::tryToReceive() {
 		return;
 	}
 	while (true) {
-		auto requestId = mtpRequestId(0);
-		auto isUpdate = false;
-		auto message = SerializedMessage();
+		// Take all the received messages at once, so that the connection
+		// thread waits for the lock only once for a whole batch of them.
+		auto responses = QMap<mtpRequestId, SerializedMessage>();
+		auto updates = QList<SerializedMessage>();
 		{
 			QWriteLocker locker(data.haveReceivedMutex());
-			auto &responses = data.haveReceivedResponses();
-			auto response = responses.begin();
-			if (response == responses.cend()) {
-				auto &updates = data.haveReceivedUpdates();
-				auto update = updates.begin();
-				if (update == updates.cend()) {
-					return;
-				} else {
-					message = std::move(*update);
-					isUpdate = true;
-					updates.pop_front();
-				}
-			} else {
-				requestId = response.key();
-				message = std::move(response.value());
-				responses.erase(response);
-			}
+			std::swap(responses, data.haveReceivedResponses());
+			std::swap(updates, data.haveReceivedUpdates());
+		}
+		if (responses.isEmpty() && updates.isEmpty()) {
+			return;
 		}
-		if (isUpdate) {
-			if (dcWithShift == bareDcId(dcWithShift)) { // call globalCallback only in main session
+		for (auto i = responses.cbegin(), e = responses.cend(); i != e; ++i) {
+			auto &message = i.value();
+			auto handleStart = getms(true);
+			_instance->execCallback(i.key(), message.constData(), message.constData() + message.size());
+			LogSlowReceived("response", message, getms(true) - handleStart);
+			MemoryStats::Released(MemoryStats::Kind::MtpResponses, message.size() * sizeof(mtpPrime));
+		}
+		auto mainSession = (dcWithShift == bareDcId(dcWithShift));
+		for (auto &message : updates) {
+			if (mainSession) { // call globalCallback only in main session
+				auto handleStart = getms(true);
 				_instance->globalCallback(message.constData(), message.constData() + message.size());
+				LogSlowReceived("update", message, getms(true) - handleStart);
 			}
-		} else {
-			_instance->execCallback(requestId, message.constData(), message.constData() + message.size());
+			MemoryStats::Released(MemoryStats::Kind::MtpResponses, message.size() * sizeof(mtpPrime));
 		}
 	}
 }
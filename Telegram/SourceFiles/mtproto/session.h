@@ -20,6 +20,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #pragma once
 
+#include <deque>
+
 #include "core/single_timer.h"
 #include "mtproto/rpc_sender.h"
 
@@ -34,13 +36,19 @@ namespace internal {
 class Dcenter;
 class Connection;
 
+// Msg ids grow monotonically, so they are kept in a sorted deque: a new id is
+// appended to the end and the oldest ids are dropped from the front in shrink().
 class ReceivedMsgIds {
 public:
 	bool registerMsgId(mtpMsgId msgId, bool needAck) {
-		auto i = _idsNeedAck.constFind(msgId);
-		if (i == _idsNeedAck.cend()) {
-			if (_idsNeedAck.size() < MTPIdsBufferSize || msgId > min()) {
-				_idsNeedAck.insert(msgId, needAck);
+		if (_ids.empty() || _ids.back().msgId < msgId) {
+			_ids.push_back({ msgId, needAck });
+			return true;
+		}
+		auto i = lowerBound(msgId);
+		if (i == _ids.end() || i->msgId != msgId) {
+			if (_ids.size() < size_t(MTPIdsBufferSize) || msgId > min()) {
+				_ids.insert(i, { msgId, needAck });
 				return true;
 			}
 			MTP_LOG(-1, ("No need to handle - %1 < min = %2").arg(msgId).arg(min()));
@@ -51,18 +59,16 @@ public:
 	}
 
 	mtpMsgId min() const {
-		return _idsNeedAck.isEmpty() ? 0 : _idsNeedAck.cbegin().key();
+		return _ids.empty() ? 0 : _ids.front().msgId;
 	}
 
 	mtpMsgId max() const {
-		auto end = _idsNeedAck.cend();
-		return _idsNeedAck.isEmpty() ? 0 : (--end).key();
+		return _ids.empty() ? 0 : _ids.back().msgId;
 	}
 
 	void shrink() {
-		auto size = _idsNeedAck.size();
-		while (size-- > MTPIdsBufferSize) {
-			_idsNeedAck.erase(_idsNeedAck.begin());
+		while (_ids.size() > size_t(MTPIdsBufferSize)) {
+			_ids.pop_front();
 		}
 	}
 
@@ -72,19 +78,34 @@ public:
 		NoAckNeeded,
 	};
 	State lookup(mtpMsgId msgId) const {
-		auto i = _idsNeedAck.constFind(msgId);
-		if (i == _idsNeedAck.cend()) {
+		auto i = lowerBound(msgId);
+		if (i == _ids.end() || i->msgId != msgId) {
 			return State::NotFound;
 		}
-		return i.value() ? State::NeedsAck : State::NoAckNeeded;
+		return i->needAck ? State::NeedsAck : State::NoAckNeeded;
 	}
 
 	void clear() {
-		_idsNeedAck.clear();
+		_ids.clear();
 	}
 
 private:
-	QMap<mtpMsgId, bool> _idsNeedAck;
+	struct Id {
+		mtpMsgId msgId;
+		bool needAck;
+	};
+	std::deque<Id>::iterator lowerBound(mtpMsgId msgId) {
+		return std::lower_bound(_ids.begin(), _ids.end(), msgId, [](const Id &id, mtpMsgId msgId) {
+			return id.msgId < msgId;
+		});
+	}
+	std::deque<Id>::const_iterator lowerBound(mtpMsgId msgId) const {
+		return std::lower_bound(_ids.begin(), _ids.end(), msgId, [](const Id &id, mtpMsgId msgId) {
+			return id.msgId < msgId;
+		});
+	}
+
+	std::deque<Id> _ids;
 
 };
 
@@ -45,6 +45,13 @@ Y1hZCxdv6cs5UnW9+PWvS+WIbkh+GaWYxwIDAQAB\n\
 SpecialConfigRequest::SpecialConfigRequest(base::lambda<void(DcId dcId, const std::string &ip, int port)> callback) : _callback(std::move(callback)) {
 	App::setProxySettings(_manager);
 
+	// The simple config saved last time is used until it expires, while
+	// the fresh one is requested in the same time.
+	auto saved = Global::SpecialConfig();
+	if (!saved.isEmpty() && !handleResponse(saved, "saved")) {
+		Global::SetSpecialConfig(QByteArray());
+	}
+
 	performAppRequest();
 	performDnsRequest();
 }
@@ -80,7 +87,7 @@ void SpecialConfigRequest::appFinished() {
 	}
 	auto result = _appReply->readAll();
 	_appReply.release()->deleteLater();
-	handleResponse(result);
+	handleResponse(result, "app");
 }
 
 void SpecialConfigRequest::dnsFinished() {
@@ -126,7 +133,7 @@ void SpecialConfigRequest::dnsFinished() {
 		}
 	}
 	auto text = QStringList(entries.values()).join(QString());
-	handleResponse(text.toLatin1());
+	handleResponse(text.toLatin1(), "dns");
 }
 
 bool SpecialConfigRequest::decryptSimpleConfig(const QByteArray &bytes) {
@@ -200,21 +207,23 @@ bool SpecialConfigRequest::decryptSimpleConfig(const QByteArray &bytes) {
 	return true;
 }
 
-void SpecialConfigRequest::handleResponse(const QByteArray &bytes) {
+bool SpecialConfigRequest::handleResponse(const QByteArray &bytes, const char *source) {
 	if (!decryptSimpleConfig(bytes)) {
-		return;
+		return false;
 	}
 	Assert(_simpleConfig.type() == mtpc_help_configSimple);
 	auto &config = _simpleConfig.c_help_configSimple();
 	auto now = unixtime();
 	if (now < config.vdate.v || now > config.vexpires.v) {
 		LOG(("Config Error: Bad date frame for simple config: %1-%2, our time is %3.").arg(config.vdate.v).arg(config.vexpires.v).arg(now));
-		return;
+		return false;
 	}
 	if (config.vip_port_list.v.empty()) {
 		LOG(("Config Error: Empty simple config received."));
-		return;
+		return false;
 	}
+	DEBUG_LOG(("Config Info: Simple config received from %1, expires %2.").arg(source).arg(config.vexpires.v));
+	Global::SetSpecialConfig(bytes);
 	for (auto &entry : config.vip_port_list.v) {
 		Assert(entry.type() == mtpc_ipPort);
 		auto &ipPort = entry.c_ipPort();
@@ -222,6 +231,7 @@ void SpecialConfigRequest::handleResponse(const QByteArray &bytes) {
 		auto ipString = qsl("%1.%2.%3.%4").arg((ip >> 24) & 0xFF).arg((ip >> 16) & 0xFF).arg((ip >> 8) & 0xFF).arg(ip & 0xFF);
 		_callback(config.vdc_id.v, ipString.toStdString(), ipPort.vport.v);
 	}
+	return true;
 }
 
 SpecialConfigRequest::~SpecialConfigRequest() {
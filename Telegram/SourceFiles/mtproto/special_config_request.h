@@ -33,7 +33,7 @@ private:
 	void performDnsRequest();
 	void appFinished();
 	void dnsFinished();
-	void handleResponse(const QByteArray &bytes);
+	bool handleResponse(const QByteArray &bytes, const char *source);
 	bool decryptSimpleConfig(const QByteArray &bytes);
 
 	base::lambda<void(DcId dcId, const std::string &ip, int port)> _callback;
@@ -308,6 +308,18 @@ void Photo::invalidateCache() {
 	}
 }
 
+void Photo::preload() const {
+	if (!_data->loaded()) {
+		_data->thumb->load();
+		_data->medium->automaticLoad(_parent);
+	}
+}
+
+void Photo::unloadHeavyPart() {
+	_pix = QPixmap();
+	_goodLoaded = false;
+}
+
 Video::Video(DocumentData *video, HistoryItem *parent) : RadialProgressItem(parent)
 , _data(video)
 , _duration(formatDurationText(_data->duration()))
@@ -462,6 +474,15 @@ void Video::invalidateCache() {
 	}
 }
 
+void Video::preload() const {
+	_data->thumb->load();
+}
+
+void Video::unloadHeavyPart() {
+	_pix = QPixmap();
+	_thumbLoaded = false;
+}
+
 void Video::getState(ClickHandlerPtr &link, HistoryCursorState &cursor, QPoint point) const {
 	bool loaded = _data->loaded();
 
@@ -937,6 +958,10 @@ void Document::getState(ClickHandlerPtr &link, HistoryCursorState &cursor, QPoin
 	}
 }
 
+void Document::unloadHeavyPart() {
+	_thumb = QPixmap();
+}
+
 bool Document::updateStatusText() {
 	bool showPause = false;
 	int32 statusSize = 0, realDuration = 0;
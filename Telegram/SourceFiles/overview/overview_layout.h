@@ -62,6 +62,14 @@ public:
 	virtual void invalidateCache() {
 	}
 
+	// Starts loading the thumbnails before the item is visible.
+	virtual void preload() const {
+	}
+
+	// Drops the cached pixmaps when the item is far from the viewport.
+	virtual void unloadHeavyPart() {
+	}
+
 };
 
 class ItemBase : public AbstractItem {
@@ -190,6 +198,8 @@ public:
 	void clickHandlerPressedChanged(const ClickHandlerPtr &action, bool pressed) override;
 
 	void invalidateCache() override;
+	void preload() const override;
+	void unloadHeavyPart() override;
 
 private:
 	void ensureCheckboxCreated();
@@ -217,6 +227,7 @@ public:
 	void clickHandlerPressedChanged(const ClickHandlerPtr &action, bool pressed) override;
 
 	void invalidateCache() override;
+	void unloadHeavyPart() override;
 
 protected:
 	float64 dataProgress() const override {
@@ -297,6 +308,9 @@ public:
 		return _data;
 	}
 
+	void preload() const override;
+	void unloadHeavyPart() override;
+
 protected:
 	float64 dataProgress() const override {
 		return _data->progress();
@@ -47,6 +47,14 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "storage/file_download.h"
 #include "ui/widgets/dropdown_menu.h"
 
+namespace {
+
+constexpr auto kLayoutWindowScreens = 3;
+constexpr auto kPreloadScreens = 2;
+constexpr auto kPreloadIdsAhead = SearchPerPage / 2;
+
+} // namespace
+
 // flick scroll taken from http://qt-project.org/doc/qt-4.8/demos-embedded-anomaly-src-flickcharm-cpp.html
 
 OverviewInner::OverviewInner(OverviewWidget *overview, Ui::ScrollArea *scroll, PeerData *peer, MediaOverviewType type) : TWidget(nullptr)
@@ -722,6 +730,7 @@ void OverviewInner::clear() {
 	}
 	_layoutDates.clear();
 	_items.clear();
+	_heavyItems.clear();
 
 	App::clearMousedItems();
 }
@@ -765,6 +774,10 @@ bool OverviewInner::preloadLocal() {
 	if (_itemsToBeLoaded >= migratedIndexSkip() + _history->overview(_type).size()) return false;
 	_itemsToBeLoaded += LinksOverviewPerPage;
 	mediaOverviewUpdated();
+	if (_itemsToBeLoaded + kPreloadIdsAhead >= migratedIndexSkip() + _history->overview(_type).size()) {
+		// Request the next ids page before the local ones are over.
+		preloadMore();
+	}
 	return true;
 }
 
@@ -800,7 +813,7 @@ void OverviewInner::paintEvent(QPaintEvent *e) {
 	auto ms = getms();
 	Overview::Layout::PaintContext context(ms, _selMode);
 
-	if (_history->overview(_type).isEmpty() && (!_migrated || !_history->overviewLoaded(_type) || _migrated->overview(_type).isEmpty())) {
+	if (_history->overview(_type).empty() && (!_migrated || !_history->overviewLoaded(_type) || _migrated->overview(_type).empty())) {
 		HistoryLayout::paintEmpty(p, _width, height());
 		return;
 	} else if (_inSearch && _searchResults.isEmpty() && _searchFull && (!_migrated || _searchFullMigrated) && !_searchTimer.isActive()) {
@@ -833,14 +846,16 @@ void OverviewInner::paintEvent(QPaintEvent *e) {
 
 				QPoint pos(int32(col * w + st::overviewPhotoSkip), _marginTop + row * (_rowWidth + st::overviewPhotoSkip) + st::overviewPhotoSkip);
 				p.translate(pos.x(), pos.y());
+				_items.at(i)->resizeGetHeight(_rowWidth);
 				_items.at(i)->paint(p, r.translated(-pos.x(), -pos.y()), itemSelectedValue(i), &context);
+				paintedHeavyItem(_items.at(i));
 				p.translate(-pos.x(), -pos.y());
 			}
 		}
 	} else {
 		p.translate(_rowsLeft, _marginTop);
 		int32 y = 0, w = _rowWidth;
-		for (int32 j = 0, l = _items.size(); j < l; ++j) {
+		for (int32 j = itemPositionByTop(r.top() - _marginTop), l = _items.size(); j < l; ++j) {
 			int32 i = _reversed ? (l - j - 1) : j, nexti = _reversed ? (i - 1) : (i + 1);
 			int32 nextItemTop = (j + 1 == l) ? (_reversed ? 0 : _height) : _items.at(nexti)->Get<Overview::Layout::Info>()->top;
 			if (_reversed) nextItemTop = _height - nextItemTop;
@@ -853,6 +868,7 @@ void OverviewInner::paintEvent(QPaintEvent *e) {
 				context.isAfterDate = (j > 0) ? !_items.at(j - 1)->toMediaItem() : false;
 				p.translate(0, curY - y);
 				_items.at(i)->paint(p, r.translated(-_rowsLeft, -_marginTop - curY), itemSelectedValue(i), &context);
+				paintedHeavyItem(_items.at(i));
 				y = curY;
 			}
 		}
@@ -906,7 +922,7 @@ void OverviewInner::onUpdateSelected() {
 			}
 		}
 	} else {
-		for (int32 j = 0, l = _items.size(); j < l; ++j) {
+		for (int32 j = itemPositionByTop(m.y() - _marginTop), l = _items.size(); j < l; ++j) {
 			bool lastItem = (j + 1 == l);
 			int32 i = _reversed ? (l - j - 1) : j, nexti = _reversed ? (i - 1) : (i + 1);
 			int32 nextItemTop = lastItem ? (_reversed ? 0 : _height) : _items.at(nexti)->Get<Overview::Layout::Info>()->top;
@@ -1347,10 +1363,15 @@ void OverviewInner::resizeItems() {
 
 void OverviewInner::resizeAndRepositionItems() {
 	if (_type == OverviewPhotos || _type == OverviewVideos) {
-		for (auto i = 0, l = _items.size(); i < l; ++i) {
+		// All cells have the same size, only the ones around the viewport
+		// are resized now, the others will be resized when painted.
+		_height = countHeight();
+		auto screen = _visibleBottom - _visibleTop;
+		auto from = 0, till = 0;
+		countItemsRange(_visibleTop - kLayoutWindowScreens * screen, _visibleBottom + kLayoutWindowScreens * screen, from, till);
+		for (auto i = from; i < till; ++i) {
 			_items.at(i)->resizeGetHeight(_rowWidth);
 		}
-		_height = countHeight();
 	} else {
 		_height = 0;
 		for (auto i = 0, l = _items.size(); i < l; ++i) {
@@ -1365,6 +1386,15 @@ void OverviewInner::dropResizeIndex() {
 	_resizeIndex = -1;
 }
 
+void OverviewInner::setVisibleTopBottom(int visibleTop, int visibleBottom) {
+	if (visibleTop != _visibleTop) {
+		_scrollDirection = (visibleTop > _visibleTop) ? 1 : -1;
+	}
+	_visibleTop = visibleTop;
+	_visibleBottom = visibleBottom;
+	updateLayoutWindow();
+}
+
 PeerData *OverviewInner::peer() const {
 	return _peer;
 }
@@ -1742,6 +1772,7 @@ void OverviewInner::mediaOverviewUpdated() {
 	fixItemIndex(_dragItemIndex, _dragItem);
 
 	recountMargins();
+	updateLayoutWindow();
 	int32 newHeight = _marginTop + _height + _marginBottom, deltaHeight = newHeight - height();
 	if (deltaHeight) {
 		resize(_width, newHeight);
@@ -1802,6 +1833,7 @@ void OverviewInner::itemRemoved(HistoryItem *item) {
 		if (index >= 0) {
 			_items.remove(index);
 		}
+		_heavyItems.removeOne(j.value());
 		delete j.value();
 		_layoutItems.erase(j);
 
@@ -1880,6 +1912,78 @@ void OverviewInner::recountMargins() {
 	}
 }
 
+int OverviewInner::listItemTop(int position) const {
+	auto index = _reversed ? (_items.size() - position - 1) : position;
+	auto top = _items.at(index)->Get<Overview::Layout::Info>()->top;
+	return _reversed ? (_height - top) : top;
+}
+
+int OverviewInner::itemPositionByTop(int top) const {
+	// Items are ordered by their top in the list, find the one containing the top.
+	auto from = 0, till = int(_items.size());
+	while (from < till) {
+		auto middle = (from + till) / 2;
+		if (listItemTop(middle) > top) {
+			till = middle;
+		} else {
+			from = middle + 1;
+		}
+	}
+	return qMax(from - 1, 0);
+}
+
+void OverviewInner::countItemsRange(int top, int bottom, int &from, int &till) const {
+	auto count = int(_items.size());
+	from = till = 0;
+	if (!count) {
+		return;
+	} else if (_type == OverviewPhotos || _type == OverviewVideos) {
+		auto rowHeight = _rowWidth + st::overviewPhotoSkip;
+		auto rowsCount = count / _photosInRow + ((count % _photosInRow) ? 1 : 0);
+		from = floorclamp(top - _marginTop - st::overviewPhotoSkip, rowHeight, 0, rowsCount) * _photosInRow;
+		till = qMin(ceilclamp(bottom - _marginTop - st::overviewPhotoSkip, rowHeight, 0, rowsCount) * _photosInRow, count);
+	} else {
+		auto first = itemPositionByTop(top - _marginTop);
+		auto last = qMin(itemPositionByTop(bottom - _marginTop) + 1, count);
+		from = _reversed ? (count - last) : first;
+		till = _reversed ? (count - first) : last;
+	}
+}
+
+void OverviewInner::paintedHeavyItem(Overview::Layout::AbstractItem *item) {
+	if (!_heavyItems.contains(item)) {
+		_heavyItems.insert(item);
+	}
+}
+
+void OverviewInner::updateLayoutWindow() {
+	auto screen = _visibleBottom - _visibleTop;
+	auto from = 0, till = 0;
+	countItemsRange(_visibleTop - kLayoutWindowScreens * screen, _visibleBottom + kLayoutWindowScreens * screen, from, till);
+
+	auto window = std::vector<Overview::Layout::AbstractItem*>();
+	window.reserve(till - from);
+	for (auto i = from; i < till; ++i) {
+		window.push_back(_items.at(i));
+	}
+	std::sort(window.begin(), window.end());
+	for (auto i = _heavyItems.begin(); i != _heavyItems.end();) {
+		if (std::binary_search(window.begin(), window.end(), *i)) {
+			++i;
+		} else {
+			(*i)->unloadHeavyPart();
+			i = _heavyItems.erase(i);
+		}
+	}
+
+	auto preloadTop = (_scrollDirection < 0) ? (_visibleTop - kPreloadScreens * screen) : _visibleBottom;
+	auto preloadBottom = (_scrollDirection < 0) ? _visibleTop : (_visibleBottom + kPreloadScreens * screen);
+	countItemsRange(preloadTop, preloadBottom, from, till);
+	for (auto i = from; i < till; ++i) {
+		_items.at(i)->preload();
+	}
+}
+
 Overview::Layout::ItemBase *OverviewInner::layoutPrepare(HistoryItem *item) {
 	if (!item) return nullptr;
 
@@ -1981,6 +2085,8 @@ void OverviewWidget::clear() {
 
 void OverviewWidget::onScroll() {
 	Auth().downloader().clearPriorities();
+	auto scrollTop = _scroll->scrollTop();
+	_inner->setVisibleTopBottom(scrollTop, scrollTop + _scroll->height());
 	int32 preloadThreshold = _scroll->height() * 5;
 	bool needToPreload = false;
 	do {
@@ -2241,9 +2347,9 @@ void OverviewWidget::mediaOverviewUpdated(const Notify::PeerUpdate &update) {
 	History *m = (update.peer && update.peer->migrateFrom()) ? App::historyLoaded(update.peer->migrateFrom()->id) : 0;
 	if (h) {
 		for (int32 i = 0; i < OverviewCount; ++i) {
-			if (!h->overview(i).isEmpty() || h->overviewCount(i) > 0 || i == type()) {
+			if (!h->overview(i).empty() || h->overviewCount(i) > 0 || i == type()) {
 				mask |= (1 << i);
-			} else if (m && (!m->overview(i).isEmpty() || m->overviewCount(i) > 0)) {
+			} else if (m && (!m->overview(i).empty() || m->overviewCount(i) > 0)) {
 				mask |= (1 << i);
 			}
 		}
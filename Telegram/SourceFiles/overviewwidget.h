@@ -24,6 +24,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "window/top_bar_widget.h"
 #include "ui/widgets/tooltip.h"
 #include "ui/widgets/scroll_area.h"
+#include "base/flat_set.h"
 
 namespace Overview {
 namespace Layout {
@@ -80,6 +81,8 @@ public:
 	int32 resizeToWidth(int32 nwidth, int32 scrollTop, int32 minHeight, bool force = false); // returns new scroll top
 	void dropResizeIndex();
 
+	void setVisibleTopBottom(int visibleTop, int visibleBottom) override;
+
 	PeerData *peer() const;
 	PeerData *migratePeer() const;
 	MediaOverviewType type() const;
@@ -169,6 +172,14 @@ private:
 	void recountMargins();
 	int countHeight();
 
+	// Layouts keep their cached pixmaps only in a window of a few screens
+	// around the viewport, thumbnails ahead of the scroll direction are preloaded.
+	void updateLayoutWindow();
+	void countItemsRange(int top, int bottom, int &from, int &till) const;
+	int itemPositionByTop(int top) const;
+	int listItemTop(int position) const;
+	void paintedHeavyItem(Overview::Layout::AbstractItem *item);
+
 	OverviewWidget *_overview;
 	Ui::ScrollArea *_scroll;
 	int _resizeIndex = -1;
@@ -205,6 +216,11 @@ private:
 	// photos
 	int32 _photosInRow = 1;
 
+	int _visibleTop = 0;
+	int _visibleBottom = 0;
+	int _scrollDirection = 0;
+	base::flat_set<Overview::Layout::AbstractItem*> _heavyItems;
+
 	QTimer _searchTimer;
 	QString _searchQuery;
 	bool _inSearch = false;
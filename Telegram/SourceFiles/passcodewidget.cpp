@@ -46,7 +46,9 @@ PasscodeWidget::PasscodeWidget(QWidget *parent) : TWidget(parent)
 }
 
 void PasscodeWidget::onSubmit() {
-	if (_passcode->text().isEmpty()) {
+	if (_checking) {
+		return;
+	} else if (_passcode->text().isEmpty()) {
 		_passcode->showError();
 		return;
 	}
@@ -57,35 +59,47 @@ void PasscodeWidget::onSubmit() {
 		return;
 	}
 
+	auto passcode = _passcode->text().toUtf8();
+	setChecking(true);
 	if (App::main()) {
-		if (Local::checkPasscode(_passcode->text().toUtf8())) {
-			Messenger::Instance().clearPasscode(); // Destroys this widget.
-			return;
-		} else {
-			cSetPasscodeBadTries(cPasscodeBadTries() + 1);
-			cSetPasscodeLastTry(getms(true));
-			onError();
-			return;
-		}
+		Local::checkPasscode(passcode, base::lambda_guarded(this, [this](bool correct) {
+			setChecking(false);
+			if (correct) {
+				Messenger::Instance().clearPasscode(); // Destroys this widget.
+			} else {
+				passcodeFailed();
+			}
+		}));
 	} else {
-		if (Local::readMap(_passcode->text().toUtf8()) != Local::ReadMapPassNeeded) {
-			cSetPasscodeBadTries(0);
-
-			Messenger::Instance().startMtp();
-			if (AuthSession::Exists()) {
-				App::wnd()->setupMain();
+		Local::readMap(passcode, base::lambda_guarded(this, [this](Local::ReadMapState state) {
+			setChecking(false);
+			if (state != Local::ReadMapPassNeeded) {
+				cSetPasscodeBadTries(0);
+
+				Messenger::Instance().startMtp();
+				if (AuthSession::Exists()) {
+					App::wnd()->setupMain();
+				} else {
+					App::wnd()->setupIntro();
+				}
 			} else {
-				App::wnd()->setupIntro();
+				passcodeFailed();
 			}
-		} else {
-			cSetPasscodeBadTries(cPasscodeBadTries() + 1);
-			cSetPasscodeLastTry(getms(true));
-			onError();
-			return;
-		}
+		}));
 	}
 }
 
+void PasscodeWidget::setChecking(bool checking) {
+	_checking = checking;
+	_submit->setText(langFactory(_checking ? lng_passcode_checking : lng_passcode_submit));
+}
+
+void PasscodeWidget::passcodeFailed() {
+	cSetPasscodeBadTries(cPasscodeBadTries() + 1);
+	cSetPasscodeLastTry(getms(true));
+	onError();
+}
+
 void PasscodeWidget::onError() {
 	_error = lang(lng_passcode_wrong);
 	_passcode->selectAll();
@@ -47,6 +47,8 @@ public slots:
 
 private:
 	void animationCallback();
+	void setChecking(bool checking);
+	void passcodeFailed();
 
 	void showAll();
 	void hideAll();
@@ -59,5 +61,6 @@ private:
 	object_ptr<Ui::RoundButton> _submit;
 	object_ptr<Ui::LinkButton> _logout;
 	QString _error;
+	bool _checking = false;
 
 };
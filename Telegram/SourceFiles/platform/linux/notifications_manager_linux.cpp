@@ -25,11 +25,15 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "platform/linux/linux_libs.h"
 #include "lang/lang_keys.h"
 #include "base/task_queue.h"
+#include "base/timer.h"
 
 namespace Platform {
 namespace Notifications {
 namespace {
 
+// If the notification server doesn't answer in that time we switch to the default notifications.
+constexpr auto kRequestTimeout = 5000;
+
 bool LibNotifyLoaded() {
 	return (Libs::notify_init != nullptr)
 		&& (Libs::notify_uninit != nullptr)
@@ -267,6 +271,7 @@ QString GetServerName() {
 }
 
 auto LibNotifyServerName = QString();
+auto LibNotifyHangs = false;
 
 } // namespace
 
@@ -281,7 +286,7 @@ bool Supported() {
 }
 
 std::unique_ptr<Window::Notifications::Manager> Create(Window::Notifications::System *system) {
-	if (Global::NativeNotifications() && Supported()) {
+	if (Global::NativeNotifications() && Supported() && !LibNotifyHangs) {
 		return std::make_unique<Manager>(system);
 	}
 	return nullptr;
@@ -321,6 +326,14 @@ public:
 private:
 	QString escapeNotificationText(const QString &text) const;
 	void showNextNotification();
+	void showFailed(PeerId peerId, MsgId msgId, const Notification &notification);
+	void closeNotifications(QList<Notification> &&notifications);
+
+	// All the libnotify calls go through D-Bus and may block for a long time,
+	// so they're done one by one in the _requests queue, not in the main thread.
+	void performRequest(base::lambda_once<bool()> request, base::lambda_once<void(bool result)> done = nullptr);
+	void requestFinished(uint64 index);
+	void checkRequestTimeout();
 
 	struct QueuedNotification {
 		PeerData *peer = nullptr;
@@ -346,10 +359,18 @@ private:
 
 	std::shared_ptr<Manager*> _guarded;
 
+	std::unique_ptr<base::TaskQueue> _requests;
+	uint64 _requestsSent = 0;
+	uint64 _requestsFinished = 0;
+	uint64 _requestWaiting = 0;
+	base::Timer _requestTimer;
+
 };
 
 void Manager::Private::init(Manager *manager) {
 	_guarded = std::make_shared<Manager*>(manager);
+	_requests = std::make_unique<base::TaskQueue>(base::TaskQueue::Priority::Normal);
+	_requestTimer.setCallback([this] { checkRequestTimeout(); });
 
 	if (auto capabilities = Libs::notify_get_server_caps()) {
 		for (auto capability = capabilities; capability; capability = capability->next) {
@@ -438,7 +459,8 @@ void Manager::Private::showNextNotification() {
 	} else {
 		key = data.peer->userpicUniqueKey();
 	}
-	notification->setImage(_cachedUserpics.get(key, data.peer));
+	auto userpic = QImage();
+	auto userpicPath = _cachedUserpics.get(key, data.peer, &userpic);
 
 	auto i = _notifications.find(peerId);
 	if (i != _notifications.cend()) {
@@ -446,7 +468,7 @@ void Manager::Private::showNextNotification() {
 		if (j != i->cend()) {
 			auto oldNotification = j.value();
 			i->erase(j);
-			oldNotification->close();
+			closeNotifications({ oldNotification });
 			i = _notifications.find(peerId);
 		}
 	}
@@ -454,25 +476,99 @@ void Manager::Private::showNextNotification() {
 		i = _notifications.insert(peerId, QMap<MsgId, Notification>());
 	}
 	_notifications[peerId].insert(msgId, notification);
-	if (!notification->show()) {
-		i = _notifications.find(peerId);
-		if (i != _notifications.cend()) {
-			i->remove(msgId);
+	performRequest([notification, userpic = std::move(userpic), userpicPath] {
+		if (!userpic.isNull()) {
+			userpic.save(userpicPath, "PNG");
+		}
+		notification->setImage(userpicPath);
+		return notification->show();
+	}, [this, peerId, msgId, notification](bool shown) {
+		if (!shown) {
+			showFailed(peerId, msgId, notification);
+		}
+	});
+}
+
+void Manager::Private::showFailed(PeerId peerId, MsgId msgId, const Notification &notification) {
+	auto i = _notifications.find(peerId);
+	if (i != _notifications.cend()) {
+		auto j = i->find(msgId);
+		if (j != i->cend() && j.value() == notification) {
+			i->erase(j);
 			if (i->isEmpty()) _notifications.erase(i);
 		}
-		showNextNotification();
 	}
+	showNextNotification();
+}
+
+void Manager::Private::closeNotifications(QList<Notification> &&notifications) {
+	if (notifications.isEmpty()) {
+		return;
+	}
+	performRequest([notifications = std::move(notifications)] {
+		for_const (auto notification, notifications) {
+			notification->close();
+		}
+		return true;
+	});
+}
+
+void Manager::Private::performRequest(base::lambda_once<bool()> request, base::lambda_once<void(bool result)> done) {
+	auto index = ++_requestsSent;
+	_requests->Put([weak = std::weak_ptr<Manager*>(_guarded), index, request = std::move(request), done = std::move(done)]() mutable {
+		auto result = request();
+		base::TaskQueue::Main().Put([weak, index, result, done = std::move(done)]() mutable {
+			if (auto strong = weak.lock()) {
+				(*strong)->_private->requestFinished(index);
+				if (done) {
+					done(result);
+				}
+			}
+		});
+	});
+	if (!_requestTimer.isActive()) {
+		_requestWaiting = index;
+		_requestTimer.callOnce(kRequestTimeout);
+	}
+}
+
+void Manager::Private::requestFinished(uint64 index) {
+	_requestsFinished = index;
+	if (_requestsFinished < _requestWaiting) {
+		return;
+	}
+	if (_requestsFinished < _requestsSent) {
+		_requestWaiting = _requestsSent;
+		_requestTimer.callOnce(kRequestTimeout);
+	} else {
+		_requestTimer.cancel();
+	}
+}
+
+void Manager::Private::checkRequestTimeout() {
+	if (_requestsFinished >= _requestWaiting) {
+		return;
+	}
+	LOG(("LibNotify Error: no answer in %1 ms, switching to the default notifications.").arg(kRequestTimeout));
+	LibNotifyHangs = true;
+
+	// This destroys the manager, so it is done outside of the timer callback.
+	base::TaskQueue::Main().Put([weak = std::weak_ptr<Manager*>(_guarded)] {
+		if (auto strong = weak.lock()) {
+			(*strong)->system()->createManager();
+		}
+	});
 }
 
 void Manager::Private::clearAll() {
 	_queuedNotifications.clear();
 
 	auto temp = base::take(_notifications);
-	for_const (auto &notifications, temp) {
-		for_const (auto notification, notifications) {
-			notification->close();
-		}
+	auto notifications = QList<Notification>();
+	for_const (auto &list, temp) {
+		notifications.append(list.values());
 	}
+	closeNotifications(std::move(notifications));
 }
 
 void Manager::Private::clearFromHistory(History *history) {
@@ -489,9 +585,7 @@ void Manager::Private::clearFromHistory(History *history) {
 		auto temp = base::take(i.value());
 		_notifications.erase(i);
 
-		for_const (auto notification, temp) {
-			notification->close();
-		}
+		closeNotifications(temp.values());
 	}
 
 	showNextNotification();
@@ -510,7 +604,17 @@ void Manager::Private::clearNotification(PeerId peerId, MsgId msgId) {
 }
 
 Manager::Private::~Private() {
-	clearAll();
+	// The queued requests are dropped with the queue, so close the rest right here,
+	// but only if the server works fine and no request is being processed right now.
+	_queuedNotifications.clear();
+	auto temp = base::take(_notifications);
+	if (!LibNotifyHangs && _requestsFinished == _requestsSent) {
+		for_const (auto &notifications, temp) {
+			for_const (auto notification, notifications) {
+				notification->close();
+			}
+		}
+	}
 }
 
 Manager::Manager(Window::Notifications::System *system) : NativeManager(system)
@@ -393,6 +393,33 @@ QString SystemLanguage() {
 	return QString();
 }
 
+bool IsMemoryLow() {
+	// Pressure stall information (Linux 4.20+): share of time some tasks
+	// were stalled waiting for memory during the last 10 seconds.
+	QFile pressure(qsl("/proc/pressure/memory"));
+	if (pressure.open(QIODevice::ReadOnly)) {
+		auto line = QString::fromLatin1(pressure.readLine());
+		auto match = QRegularExpression(qsl("^some avg10=([\\d\\.]+)")).match(line);
+		if (match.hasMatch()) {
+			return (match.captured(1).toDouble() >= 10.);
+		}
+	}
+
+	// Fallback to the share of the memory available without swapping.
+	QFile meminfo(qsl("/proc/meminfo"));
+	if (!meminfo.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	auto content = QString::fromLatin1(meminfo.readAll());
+	auto parse = [&content](const QString &name) {
+		auto match = QRegularExpression(qsl("^") + name + qsl(":\\s+(\\d+) kB"), QRegularExpression::MultilineOption).match(content);
+		return match.hasMatch() ? match.captured(1).toLongLong() : -1LL;
+	};
+	auto total = parse(qsl("MemTotal"));
+	auto available = parse(qsl("MemAvailable"));
+	return (total > 0 && available >= 0 && available * 20 < total);
+}
+
 namespace ThirdParty {
 
 void start() {
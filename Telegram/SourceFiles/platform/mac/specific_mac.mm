@@ -38,6 +38,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include <IOKit/hidsystem/ev_keymap.h>
 #include <SPMediaKeyTap.h>
 #include <mach-o/dyld.h>
+#include <sys/sysctl.h>
 
 namespace {
 
@@ -382,6 +383,17 @@ void StartTranslucentPaint(QPainter &p, QPaintEvent *e) {
 #endif // OS_MAC_OLD
 }
 
+bool IsMemoryLow() {
+	// Same levels as DISPATCH_MEMORYPRESSURE_NORMAL / _WARN / _CRITICAL.
+	constexpr auto kPressureWarn = 2;
+	auto level = 0;
+	auto size = sizeof(level);
+	if (sysctlbyname("kern.memorystatus_vm_pressure_level", &level, &size, nullptr, 0) != 0) {
+		return false;
+	}
+	return (level >= kPressureWarn);
+}
+
 QString SystemCountry() {
 	NSLocale *currentLocale = [NSLocale currentLocale];  // get the current locale.
 	NSString *countryCode = [currentLocale objectForKey:NSLocaleCountryCode];
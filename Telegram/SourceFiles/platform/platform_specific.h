@@ -35,6 +35,9 @@ void ReInitOnTopPanel(QWidget *panel);
 QString SystemLanguage();
 QString SystemCountry();
 
+// Polled from time to time, true while the system is short of memory.
+bool IsMemoryLow();
+
 namespace ThirdParty {
 
 void start();
@@ -334,6 +334,15 @@ void finish() {
 	EventFilter::destroy();
 }
 
+bool IsMemoryLow() {
+	static const auto notification = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+	if (!notification) {
+		return false;
+	}
+	auto low = BOOL(FALSE);
+	return QueryMemoryResourceNotification(notification, &low) && low;
+}
+
 QString SystemCountry() {
 	int chCount = GetLocaleInfo(LOCALE_USER_DEFAULT, LOCALE_SISO3166CTRYNAME, 0, 0);
 	if (chCount && chCount < 128) {
@@ -101,7 +101,7 @@ void ActionsWidget::validateBlockStatus() const {
 		return false;
 	};
 	if (needFullPeer()) {
-		Auth().api().requestFullPeer(peer());
+		peer()->updateFull();
 	}
 }
 
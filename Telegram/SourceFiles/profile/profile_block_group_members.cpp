@@ -290,7 +290,7 @@ void GroupMembersWidget::refreshMembers() {
 	if (auto chat = peer()->asChat()) {
 		checkSelfAdmin(chat);
 		if (chat->noParticipantInfo()) {
-			Auth().api().requestFullPeer(chat);
+			chat->updateFull();
 		}
 		fillChatMembers(chat);
 		refreshLimitReached();
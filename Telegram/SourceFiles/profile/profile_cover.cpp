@@ -98,7 +98,7 @@ PhotoData *CoverWidget::validatePhoto() const {
 	auto photo = (_peer->photoId && _peer->photoId != UnknownPeerPhotoId) ? App::photo(_peer->photoId) : nullptr;
 	_userpicButton->setPointerCursor(photo != nullptr && photo->date != 0);
 	if ((_peer->photoId == UnknownPeerPhotoId) || (_peer->photoId && (!photo || !photo->date))) {
-		Auth().api().requestFullPeer(_peer);
+		_peer->updateFull();
 		return nullptr;
 	}
 	return photo;
@@ -48,6 +48,8 @@ bool gStartInTray = false;
 bool gAutoStart = false;
 bool gSendToMenu = false;
 bool gUseExternalVideoPlayer = false;
+bool gHardwareVideoDecoding = false;
+bool gShowCallStatistics = false;
 bool gAutoUpdate = true;
 TWindowPos gWindowPos;
 LaunchMode gLaunchMode = LaunchModeNormal;
@@ -57,6 +59,7 @@ bool gRestartingUpdate = false, gRestarting = false, gRestartingToSettings = fal
 int32 gLastUpdateCheck = 0;
 bool gNoStartUpdate = false;
 bool gStartToSettings = false;
+int gStartupBudget = 0;
 bool gReplaceEmojis = true;
 
 bool gCtrlEnter = false;
@@ -201,6 +204,8 @@ void settingsParseArgs(int argc, char *argv[]) {
 			gNoStartUpdate = true;
 		} else if (qstr("-tosettings") == argv[i]) {
 			gStartToSettings = true;
+		} else if (qstr("-startupbudget") == argv[i] && i + 1 < argc) {
+			gStartupBudget = qMax(QString(argv[++i]).toInt(), 0);
 		} else if (qstr("-startintray") == argv[i]) {
 			gStartInTray = true;
 		} else if (qstr("-sendpath") == argv[i] && i + 1 < argc) {
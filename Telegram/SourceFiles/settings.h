@@ -67,6 +67,8 @@ DeclareSetting(bool, StartMinimized);
 DeclareSetting(bool, StartInTray);
 DeclareSetting(bool, SendToMenu);
 DeclareSetting(bool, UseExternalVideoPlayer);
+DeclareSetting(bool, HardwareVideoDecoding);
+DeclareSetting(bool, ShowCallStatistics);
 enum LaunchMode {
 	LaunchModeNormal = 0,
 	LaunchModeAutoStart,
@@ -112,6 +114,7 @@ DeclareSetting(bool, NoStartUpdate);
 DeclareSetting(bool, StartToSettings);
 DeclareSetting(bool, ReplaceEmojis);
 DeclareReadSetting(bool, ManyInstance);
+DeclareReadSetting(int, StartupBudget);
 
 DeclareSetting(QByteArray, LocalSalt);
 DeclareSetting(DBIScale, RealScale);
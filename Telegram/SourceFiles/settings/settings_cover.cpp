@@ -79,7 +79,7 @@ PhotoData *CoverWidget::validatePhoto() const {
 	auto photo = (_self->photoId && _self->photoId != UnknownPeerPhotoId) ? App::photo(_self->photoId) : nullptr;
 	_userpicButton->setPointerCursor(photo != nullptr && photo->date != 0);
 	if ((_self->photoId == UnknownPeerPhotoId) || (_self->photoId && (!photo || !photo->date))) {
-		Auth().api().requestFullPeer(_self);
+		_self->updateFull();
 		return nullptr;
 	}
 	return photo;
@@ -28,6 +28,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/effects/widget_fade_wrap.h"
 #include "ui/widgets/scroll_area.h"
 #include "ui/widgets/buttons.h"
+#include "ui/frame_stats.h"
 #include "mainwindow.h"
 #include "mainwidget.h"
 #include "storage/localstorage.h"
@@ -37,14 +38,23 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "messenger.h"
 #include "mtproto/mtp_instance.h"
 #include "mtproto/dc_options.h"
+#include "mtproto/dc_metrics.h"
 #include "core/file_utilities.h"
+#include "core/benchmarks.h"
+#include "core/scroll_benchmark.h"
+#include "core/memory_stats.h"
+#include "core/trace.h"
 #include "window/themes/window_theme.h"
 #include "window/themes/window_theme_editor.h"
 #include "media/media_audio_track.h"
+#include "storage/file_download.h"
+#include "storage/storage_download_window.h"
 
 namespace Settings {
 namespace {
 
+constexpr auto kTraceExportDuration = 10000;
+
 QString SecretText;
 QMap<QString, base::lambda<void()>> Codes;
 
@@ -73,6 +83,22 @@ void fillCodes() {
 		}
 		Ui::show(Box<InformBox>(DebugLogging::FileLoader() ? qsl("Enabled file download logging") : qsl("Disabled file download logging")));
 	});
+	Codes.insert(qsl("downloadstats"), [] {
+		auto lines = QStringList();
+		for (auto &stats : Storage::CollectDownloadWindowStats()) {
+			lines.push_back(qsl("DC %1: window %2, in flight %3, rtt %4 ms (min %5 ms), goodput %6 KB/s").arg(stats.dcId).arg(stats.limit).arg(stats.inFlight).arg(stats.rtt).arg(stats.minRtt).arg(stats.goodput / 1024));
+		}
+		Ui::show(Box<InformBox>(lines.isEmpty() ? qsl("No downloads were made yet.") : lines.join('\n')));
+	});
+	Codes.insert(qsl("netstats"), [] {
+		auto metrics = Messenger::Instance().mtp()->metrics();
+		auto lines = QStringList();
+		for (auto &stats : metrics->collect()) {
+			lines.push_back(qsl("DC %1: rtt %2 ms (min %3 ms), in %4 KB/s, out %5 KB/s, resent %6 (%7 KB), bad msg %8, queued %9").arg(stats.shiftedDcId).arg(stats.rtt).arg(stats.minRtt).arg(stats.receivedPerSecond / 1024).arg(stats.sentPerSecond / 1024).arg(stats.resent).arg(stats.resentBytes / 1024).arg(stats.badMsgNotifications).arg(stats.queued));
+		}
+		metrics->writeToLog();
+		Ui::show(Box<InformBox>(lines.isEmpty() ? qsl("No connections were made yet.") : lines.join('\n')));
+	});
 	Codes.insert(qsl("crashplease"), [] {
 		Unexpected("Crashed in Settings!");
 	});
@@ -113,6 +139,54 @@ void fillCodes() {
 			Ui::hideLayer();
 		}));
 	});
+	Codes.insert(qsl("hwdecoding"), [] {
+		auto text = cHardwareVideoDecoding() ? qsl("Disable hardware video decoding?") : qsl("Enable hardware video decoding?");
+		Ui::show(Box<ConfirmBox>(text, [] {
+			cSetHardwareVideoDecoding(!cHardwareVideoDecoding());
+			Local::writeUserSettings();
+			Ui::hideLayer();
+		}));
+	});
+	Codes.insert(qsl("callstats"), [] {
+		cSetShowCallStatistics(!cShowCallStatistics());
+		Ui::show(Box<InformBox>(cShowCallStatistics() ? qsl("Call statistics will be shown in the call panel.") : qsl("Call statistics will be hidden.")));
+	});
+	Codes.insert(qsl("benchmarks"), [] {
+		Ui::show(Box<InformBox>(Benchmarks::Run()));
+	});
+	Codes.insert(qsl("scrollbench"), [] {
+		if (ScrollBenchmark::Running()) {
+			return;
+		}
+		Ui::hideSettingsAndLayer(true);
+		ScrollBenchmark::Start([](const QString &path) {
+			Ui::show(Box<InformBox>(path.isEmpty() ? qsl("Could not save the scroll benchmark results.") : qsl("Scroll benchmark results saved to '%1'.").arg(path)));
+		});
+	});
+	Codes.insert(qsl("framestats"), [] {
+		Ui::FrameStats::Toggle();
+	});
+	Codes.insert(qsl("memorystats"), [] {
+		Ui::show(Box<InformBox>(MemoryStats::Dump()));
+	});
+	Codes.insert(qsl("trace"), [] {
+		if (!Trace::Started()) {
+			Trace::Start();
+			Ui::show(Box<InformBox>(qsl("Trace recording started. Type 'trace' again to save the last %1 seconds.").arg(kTraceExportDuration / 1000)));
+			return;
+		}
+		auto trace = Trace::Export(kTraceExportDuration);
+		Trace::Stop();
+
+		QDir().mkpath(cWorkingDir() + qstr("DebugLogs"));
+		auto path = cWorkingDir() + qsl("DebugLogs/trace_%1.json").arg(QDateTime::currentDateTime().toString(qsl("yyyyMMdd_hhmmss")));
+		QFile f(path);
+		if (f.open(QIODevice::WriteOnly) && f.write(trace) == trace.size()) {
+			Ui::show(Box<InformBox>(qsl("Trace saved to '%1', open it in chrome://tracing.").arg(path)));
+		} else {
+			Ui::show(Box<InformBox>(qsl("Could not write '%1'.").arg(path)));
+		}
+	});
 	Codes.insert(qsl("endpoints"), [] {
 		FileDialog::GetOpenPath("Open DC endpoints", "DC Endpoints (*.tdesktop-endpoints)", [](const FileDialog::OpenResult &result) {
 			if (!result.paths.isEmpty()) {
@@ -24,13 +24,91 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mainwindow.h"
 #include "messenger.h"
 #include "storage/localstorage.h"
+#include "storage/storage_download_window.h"
+#include "storage/storage_downloaded_parts.h"
+#include "storage/storage_streamed_file.h"
 #include "platform/platform_file_utilities.h"
 #include "auth_session.h"
+#include "base/task_queue.h"
+
+namespace {
+
+// Can be called from any thread.
+void DecryptCdnPart(QByteArray &bytes, const QByteArray &key, const QByteArray &iv, int offset) {
+	auto state = MTP::CTRState();
+	auto ivec = gsl::as_writeable_bytes(gsl::make_span(state.ivec));
+	auto ivBytes = gsl::as_bytes(gsl::make_span(iv));
+	std::copy(ivBytes.begin(), ivBytes.end(), ivec.begin());
+
+	auto counterOffset = static_cast<uint32>(offset) >> 4;
+	state.ivec[15] = static_cast<uchar>(counterOffset & 0xFF);
+	state.ivec[14] = static_cast<uchar>((counterOffset >> 8) & 0xFF);
+	state.ivec[13] = static_cast<uchar>((counterOffset >> 16) & 0xFF);
+	state.ivec[12] = static_cast<uchar>((counterOffset >> 24) & 0xFF);
+
+	MTP::aesCtrEncrypt(bytes.data(), bytes.size(), key.constData(), &state);
+}
+
+// Can be called from any thread.
+bool CdnPartHashGood(base::const_byte_span bytes, const QByteArray &hash) {
+	auto realHash = hashSha256(bytes.data(), bytes.size());
+	return !base::compare_bytes(gsl::as_bytes(gsl::make_span(realHash)), gsl::as_bytes(gsl::make_span(hash)));
+}
+
+// Can be called from any thread.
+QImage ReadImage(QByteArray data, QByteArray *format, const QSize &shrinkBox) {
+	if (!shrinkBox.isEmpty()) {
+		// Decode straight to the box size if the format supports it (JPEG does DCT scaling).
+		QBuffer buffer(&data);
+		QImageReader reader(&buffer);
+		auto rotated = false;
+#ifndef OS_MAC_OLD
+		reader.setAutoTransform(true);
+		rotated = (reader.transformation() & QImageIOHandler::TransformationRotate90);
+#endif // OS_MAC_OLD
+		auto size = reader.size();
+		if (!rotated && size.isValid() && !reader.supportsAnimation() && (size.width() > shrinkBox.width() || size.height() > shrinkBox.height())) {
+			reader.setScaledSize(size.scaled(shrinkBox, Qt::KeepAspectRatio));
+			auto result = QImage();
+			if (reader.read(&result)) {
+				*format = reader.format();
+				return result;
+			}
+		}
+	}
+	auto result = App::readImage(data, format, false);
+	if (!result.isNull() && !shrinkBox.isEmpty() && (result.width() > shrinkBox.width() || result.height() > shrinkBox.height())) {
+		result = result.scaled(shrinkBox, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	}
+	return result;
+}
+
+} // namespace
 
 namespace Storage {
+namespace {
+
+// A new download session is opened when each of the opened ones has this much requested.
+constexpr auto kSessionSaturatedBytes = 1024 * 1024;
+constexpr auto kIdleSessionTimeout = 30 * TimeMs(1000);
+
+// Media dcs are prewarmed in batches a bit after the media was received,
+// so that the startup requests and the visible loads go first.
+constexpr auto kPrewarmDelay = 3 * TimeMs(1000);
+constexpr auto kPrewarmCanWait = 1000; // prewarm requests can be delayed in the session
+
+// Automatic downloads can receive that much in the last budget period.
+constexpr auto kAutoDownloadBudgetBytes = 64 * 1024 * 1024;
+constexpr auto kAutoDownloadBudgetPeriod = 5 * 60 * TimeMs(1000);
+constexpr auto kAutoDownloadBudgetSlice = TimeMs(1000); // received bytes are summed by slices
+
+} // namespace
 
 Downloader::Downloader()
-: _delayedLoadersDestroyer([this] { _delayedDestroyedLoaders.clear(); }) {
+: _delayedLoadersDestroyer([this] { _delayedDestroyedLoaders.clear(); })
+, _killIdleSessionsTimer([this] { killIdleSessions(); })
+, _prewarmTimer([this] { prewarmQueued(); })
+, _autoDownloadBudgetTimer([this] { autoDownloadBudgetRefilled(); }) {
 }
 
 void Downloader::delayedDestroyLoader(std::unique_ptr<FileLoader> loader) {
@@ -43,48 +121,207 @@ void Downloader::clearPriorities() {
 }
 
 void Downloader::requestedAmountIncrement(MTP::DcId dcId, int index, int amount) {
-	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it == _requestedBytesAmount.cend()) {
-		it = _requestedBytesAmount.emplace(dcId, RequestedInDc { { 0 } }).first;
-	}
-	it->second[index] += amount;
-	if (it->second[index]) {
+	Expects(index >= 0 && index < MTP::kMaxDownloadSessionsCount);
+	auto &requested = _requestedBytesAmount[dcId];
+	requested.bytes[index] += amount;
+	if (requested.bytes[index]) {
 		Messenger::Instance().killDownloadSessionsStop(dcId);
 	} else {
 		Messenger::Instance().killDownloadSessionsStart(dcId);
+		requested.idleSince[index] = getms(true);
+		if (index >= MTP::kDownloadSessionsCount && !_killIdleSessionsTimer.isActive()) {
+			_killIdleSessionsTimer.callOnce(kIdleSessionTimeout);
+		}
 	}
 }
 
-int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) const {
+int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) {
+	auto &requested = _requestedBytesAmount[dcId];
 	auto result = 0;
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it != _requestedBytesAmount.cend()) {
-		for (auto i = 1; i != MTP::kDownloadSessionsCount; ++i) {
-			if (it->second[i] < it->second[result]) {
-				result = i;
-			}
+	for (auto i = 1; i != requested.sessionsCount; ++i) {
+		if (requested.bytes[i] < requested.bytes[result]) {
+			result = i;
 		}
 	}
+	if (requested.bytes[result] >= kSessionSaturatedBytes && requested.sessionsCount < MTP::kMaxDownloadSessionsCount) {
+		result = requested.sessionsCount++;
+		DEBUG_LOG(("Download Info: all sessions of dc %1 are saturated, opening session %2").arg(dcId).arg(result));
+	}
 	return result;
 }
 
+void Downloader::killIdleSessions() {
+	auto now = getms(true);
+	auto left = TimeMs(0);
+	for (auto &entry : _requestedBytesAmount) {
+		auto dcId = entry.first;
+		auto &requested = entry.second;
+
+		// Only the last session is closed, so that the opened ones have sequential indices.
+		while (requested.sessionsCount > MTP::kDownloadSessionsCount) {
+			auto index = requested.sessionsCount - 1;
+			if (requested.bytes[index]) {
+				break;
+			}
+			auto idleTill = requested.idleSince[index] + kIdleSessionTimeout;
+			if (idleTill > now) {
+				if (!left || idleTill - now < left) {
+					left = idleTill - now;
+				}
+				break;
+			}
+			DEBUG_LOG(("Download Info: closing idle session %1 of dc %2").arg(index).arg(dcId));
+			MTP::stopSession(MTP::downloadDcId(dcId, index));
+			--requested.sessionsCount;
+		}
+	}
+	if (left) {
+		_killIdleSessionsTimer.callOnce(left);
+	}
+}
+
+void Downloader::prewarmDc(MTP::DcId dcId) {
+	if (!dcId || dcId == MTP::maindc() || _prewarmedDcs.contains(dcId)) {
+		return;
+	}
+	_prewarmedDcs.insert(dcId);
+	if (_requestedBytesAmount.find(dcId) != _requestedBytesAmount.end()) {
+		return; // Something was already loaded from that dc.
+	}
+	_prewarmQueue.push_back(dcId);
+	if (!_prewarmTimer.isActive()) {
+		_prewarmTimer.callOnce(kPrewarmDelay);
+	}
+}
+
+void Downloader::prewarmQueued() {
+	for (auto dcId : base::take(_prewarmQueue)) {
+		if (_requestedBytesAmount.find(dcId) != _requestedBytesAmount.end()) {
+			continue;
+		}
+		DEBUG_LOG(("Download Info: prewarming dc %1").arg(dcId));
+
+		// Any request that requires the authorization will do: the first one
+		// in a new dc gets 401 and makes MTP export and import the authorization.
+		auto requestId = MTP::send(
+			MTPusers_GetUsers(MTP_vector<MTPInputUser>(1, MTP_inputUserSelf())),
+			rpcDone([this](const MTPVector<MTPUser> &result, mtpRequestId requestId) {
+				prewarmFinished(requestId);
+			}),
+			rpcFail([this](const RPCError &error, mtpRequestId requestId) {
+				prewarmFinished(requestId);
+				return true;
+			}),
+			MTP::downloadDcId(dcId, 0),
+			kPrewarmCanWait);
+		_prewarmRequests.emplace(requestId, dcId);
+
+		// Keep the download sessions alive while the request is running,
+		// their usual idle shutdown starts when it is finished.
+		requestedAmountIncrement(dcId, 0, 1);
+	}
+}
+
+void Downloader::prewarmFinished(mtpRequestId requestId) {
+	auto i = _prewarmRequests.find(requestId);
+	if (i == _prewarmRequests.end()) {
+		return;
+	}
+	auto dcId = i->second;
+	_prewarmRequests.erase(i);
+	requestedAmountIncrement(dcId, 0, -1);
+}
+
+bool Downloader::autoDownloadBudgetLeft() {
+	auto now = getms(true);
+	autoDownloadForgetOld(now);
+	if (_autoDownloadedBytes < kAutoDownloadBudgetBytes) {
+		return true;
+	}
+	if (!_autoDownloadSkipped) {
+		_autoDownloadSkipped = true;
+		DEBUG_LOG(("Download Info: automatic downloads budget is spent."));
+	}
+	if (!_autoDownloadBudgetTimer.isActive()) {
+		_autoDownloadBudgetTimer.callOnce(_autoDownloaded.front().first + kAutoDownloadBudgetPeriod - now);
+	}
+	return false;
+}
+
+void Downloader::autoDownloadReceived(int amount) {
+	auto now = getms(true);
+	auto slice = now - (now % kAutoDownloadBudgetSlice);
+	if (_autoDownloaded.empty() || _autoDownloaded.back().first != slice) {
+		_autoDownloaded.push_back({ slice, 0 });
+	}
+	_autoDownloaded.back().second += amount;
+	_autoDownloadedBytes += amount;
+}
+
+void Downloader::autoDownloadForgetOld(TimeMs now) {
+	auto till = std::find_if(_autoDownloaded.begin(), _autoDownloaded.end(), [now](const std::pair<TimeMs, int64> &slice) {
+		return (slice.first + kAutoDownloadBudgetPeriod > now);
+	});
+	for (auto i = _autoDownloaded.begin(); i != till; ++i) {
+		_autoDownloadedBytes -= i->second;
+	}
+	_autoDownloaded.erase(_autoDownloaded.begin(), till);
+}
+
+void Downloader::autoDownloadBudgetRefilled() {
+	if (!autoDownloadBudgetLeft() || !base::take(_autoDownloadSkipped)) {
+		return;
+	}
+	DEBUG_LOG(("Download Info: automatic downloads budget is refilled."));
+
+	// The skipped files have their loaders cancelled, allow them again.
+	for (auto &entry : App::photosData()) {
+		entry.second->automaticLoadSettingsChanged();
+	}
+	for (auto &entry : App::documentsData()) {
+		entry.second->automaticLoadSettingsChanged();
+	}
+	_taskFinishedObservable.notify();
+}
+
 Downloader::~Downloader() {
+	for (auto &request : base::take(_prewarmRequests)) {
+		MTP::cancel(request.first);
+	}
+
 	// The file loaders have pointer to downloader and they cancel
 	// requests in destructor where they use that pointer, so all
 	// of them need to be destroyed before any internal state of Downloader.
 	_delayedDestroyedLoaders.clear();
 }
 
+bool AutoDownloadAllowed(AutoDownloadType type, const HistoryItem *item) {
+	auto settings = [type] {
+		switch (type) {
+		case AutoDownloadType::Photo: return cAutoDownloadPhoto();
+		case AutoDownloadType::Audio: return cAutoDownloadAudio();
+		case AutoDownloadType::Gif: return cAutoDownloadGif();
+		}
+		Unexpected("Type in AutoDownloadAllowed().");
+	}();
+	auto allowed = false;
+	if (item) {
+		allowed = item->history()->peer->isUser() ? !(settings & dbiadNoPrivate) : !(settings & dbiadNoGroups);
+	} else { // if load at least anywhere
+		allowed = !(settings & dbiadNoPrivate) || !(settings & dbiadNoGroups);
+	}
+	return allowed && Auth().downloader().autoDownloadBudgetLeft();
+}
+
 } // namespace Storage
 
 namespace {
 
 constexpr auto kDownloadPhotoPartSize = 64 * 1024; // 64kb for photo
 constexpr auto kDownloadDocumentPartSize = 128 * 1024; // 128kb for document
-constexpr auto kMaxFileQueries = 16; // max 16 file parts downloaded at the same time
 constexpr auto kMaxWebFileQueries = 8; // max 8 http[s] files downloaded at the same time
 constexpr auto kDownloadCdnPartSize = 128 * 1024; // 128kb for cdn requests
+constexpr auto kSavePartsEach = 32; // save the downloaded parts bitmap after each 4mb
 
 } // namespace
 
@@ -95,6 +332,9 @@ struct FileLoaderQueue {
 	int queriesLimit = 0;
 	FileLoader *start = nullptr;
 	FileLoader *end = nullptr;
+
+	// mtp queues adjust queriesLimit by the window, web queue keeps it fixed
+	Storage::DownloadWindow window;
 };
 
 namespace {
@@ -111,8 +351,32 @@ WebLoadManager *webLoadManager() {
 }
 WebLoadMainManager *_webLoadMainManager = nullptr;
 
+FileLoaderQueue *mtpQueue(MTP::DcId dcId) {
+	auto shiftedDcId = MTP::downloadDcId(dcId, 0);
+	auto i = queues.find(shiftedDcId);
+	if (i == queues.cend()) {
+		auto queue = FileLoaderQueue(0);
+		queue.queriesLimit = queue.window.limit();
+		i = queues.insert(shiftedDcId, queue);
+	}
+	return &i.value();
+}
+
 } // namespace
 
+namespace Storage {
+
+std::vector<DownloadWindowStats> CollectDownloadWindowStats() {
+	auto result = std::vector<DownloadWindowStats>();
+	result.reserve(queues.size());
+	for (auto i = queues.cbegin(), e = queues.cend(); i != e; ++i) {
+		result.push_back(i->window.stats(MTP::bareDcId(i.key()), i->queriesCount));
+	}
+	return result;
+}
+
+} // namespace Storage
+
 FileLoader::FileLoader(const QString &toFile, int32 size, LocationType locationType, LoadToCacheSetting toCache, LoadFromCloudSetting fromCloud, bool autoLoading)
 : _downloader(&Auth().downloader())
 , _autoLoading(autoLoading)
@@ -141,17 +405,46 @@ QPixmap FileLoader::imagePixmap(const QSize &shrinkBox) const {
 
 void FileLoader::readImage(const QSize &shrinkBox) const {
 	auto format = QByteArray();
-	auto image = App::readImage(_data, &format, false);
+	auto image = ReadImage(_data, &format, shrinkBox);
 	if (!image.isNull()) {
-		if (!shrinkBox.isEmpty() && (image.width() > shrinkBox.width() || image.height() > shrinkBox.height())) {
-			_imagePixmap = App::pixmapFromImageInPlace(image.scaled(shrinkBox, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-		} else {
-			_imagePixmap = App::pixmapFromImageInPlace(std::move(image));
-		}
+		_imagePixmap = App::pixmapFromImageInPlace(std::move(image));
 		_imageFormat = format;
 	}
 }
 
+void FileLoader::notifyFinished() {
+	if (_locationType != UnknownFileLocation || _data.isEmpty() || !_imagePixmap.isNull()) {
+		_downloader->taskFinished().notify();
+		emit progress(this);
+		return;
+	}
+
+	// Decode the image in a background thread, finished() stays false till then.
+	_imageDecoding = true;
+	base::TaskQueue::Normal().Put([weak = QPointer<FileLoader>(this), data = _data, box = _imageShrinkBox]() mutable {
+		auto format = QByteArray();
+		auto image = ReadImage(std::move(data), &format, box);
+		base::TaskQueue::Main().Put([weak, format, image = std::move(image)]() mutable {
+			if (weak) {
+				weak->imageDecoded(std::move(image), format);
+			}
+		});
+	});
+}
+
+void FileLoader::imageDecoded(QImage &&image, const QByteArray &format) {
+	_imageDecoding = false;
+	if (_cancelled) {
+		return;
+	}
+	if (!image.isNull()) {
+		_imagePixmap = App::pixmapFromImageInPlace(std::move(image));
+		_imageFormat = format;
+	}
+	_downloader->taskFinished().notify();
+	emit progress(this);
+}
+
 float64 FileLoader::currentProgress() const {
 	if (_finished) return 1.;
 	if (!fullSize()) return 0.;
@@ -175,17 +468,33 @@ void FileLoader::permitLoadFromCloud() {
 	_fromCloud = LoadFromCloudOrLocal;
 }
 
+Storage::DownloadPriority FileLoader::priority() const {
+	if (_userInitiated) {
+		return Storage::DownloadPriority::UserInitiated;
+	} else if (_priority == _downloader->currentPriority()) {
+		return Storage::DownloadPriority::Visible;
+	}
+	return _autoLoading ? Storage::DownloadPriority::Background : Storage::DownloadPriority::Prefetch;
+}
+
 void FileLoader::loadNext() {
 	if (_queue->queriesCount >= _queue->queriesLimit) {
 		return;
 	}
-	for (auto i = _queue->start; i;) {
-		if (i->loadPart()) {
-			if (_queue->queriesCount >= _queue->queriesLimit) {
-				return;
+	for (auto priority : {
+		Storage::DownloadPriority::UserInitiated,
+		Storage::DownloadPriority::Visible,
+		Storage::DownloadPriority::Prefetch,
+		Storage::DownloadPriority::Background,
+	}) {
+		for (auto i = _queue->start; i;) {
+			if (i->priority() == priority && i->loadPart()) {
+				if (_queue->queriesCount >= _queue->queriesLimit) {
+					return;
+				}
+			} else {
+				i = i->_next;
 			}
-		} else {
-			i = i->_next;
 		}
 	}
 }
@@ -270,12 +579,17 @@ void FileLoader::start(bool loadFirst, bool prior) {
 	}
 
 	if (!_filename.isEmpty() && _toCache == LoadToFileOnly && !_fileIsOpen) {
-		_fileIsOpen = _file.open(QIODevice::WriteOnly);
+		_fileIsOpen = openFile();
 		if (!_fileIsOpen) {
 			return cancel(true);
 		}
 	}
 
+	if (_autoLoading && Global::BackgroundMode()) {
+		// Automatic downloads are queued after everything else while the window is in background.
+		loadFirst = prior = false;
+	}
+
 	auto currentPriority = _downloader->currentPriority();
 	FileLoader *before = 0, *after = 0;
 	if (prior) {
@@ -369,6 +683,10 @@ void FileLoader::cancel() {
 	cancel(false);
 }
 
+bool FileLoader::openFile() {
+	return _file.open(QIODevice::WriteOnly);
+}
+
 void FileLoader::cancel(bool fail) {
 	bool started = currentOffset(true) > 0;
 	cancelRequests();
@@ -377,7 +695,9 @@ void FileLoader::cancel(bool fail) {
 	if (_fileIsOpen) {
 		_file.close();
 		_fileIsOpen = false;
-		_file.remove();
+		if (!keepPartialFile(fail)) {
+			_file.remove();
+		}
 	}
 	_data = QByteArray();
 
@@ -394,22 +714,22 @@ void FileLoader::cancel(bool fail) {
 }
 
 void FileLoader::startLoading(bool loadFirst, bool prior) {
-	if ((_queue->queriesCount >= _queue->queriesLimit && (!loadFirst || !prior)) || _finished) {
+	if (_finished) {
 		return;
+	} else if (_queue->queriesCount < _queue->queriesLimit) {
+		// A loader that left the visible area should not take a free slot
+		// while there are visible or user initiated ones waiting for it.
+		loadNext();
+	} else if (loadFirst && prior) {
+		loadPart();
 	}
-	loadPart();
 }
 
 mtpFileLoader::mtpFileLoader(const StorageImageLocation *location, int32 size, LoadFromCloudSetting fromCloud, bool autoLoading)
 : FileLoader(QString(), size, UnknownFileLocation, LoadToCacheAsWell, fromCloud, autoLoading)
 , _dcId(location->dc())
 , _location(location) {
-	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
-	auto i = queues.find(shiftedDcId);
-	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
-	}
-	_queue = &i.value();
+	_queue = mtpQueue(_dcId);
 }
 
 mtpFileLoader::mtpFileLoader(int32 dc, uint64 id, uint64 accessHash, int32 version, LocationType type, const QString &to, int32 size, LoadToCacheSetting toCache, LoadFromCloudSetting fromCloud, bool autoLoading)
@@ -418,31 +738,34 @@ mtpFileLoader::mtpFileLoader(int32 dc, uint64 id, uint64 accessHash, int32 versi
 , _id(id)
 , _accessHash(accessHash)
 , _version(version) {
-	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
-	auto i = queues.find(shiftedDcId);
-	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
-	}
-	_queue = &i.value();
+	_queue = mtpQueue(_dcId);
 }
 
 mtpFileLoader::mtpFileLoader(const WebFileImageLocation *location, int32 size, LoadFromCloudSetting fromCloud, bool autoLoading)
 : FileLoader(QString(), size, UnknownFileLocation, LoadToCacheAsWell, fromCloud, autoLoading)
 , _dcId(location->dc())
 , _urlLocation(location) {
-	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
-	auto i = queues.find(shiftedDcId);
-	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
-	}
-	_queue = &i.value();
+	_queue = mtpQueue(_dcId);
 }
 
 int32 mtpFileLoader::currentOffset(bool includeSkipped) const {
+	if (_parts) {
+		return _parts->completedBytes();
+	}
 	return (_fileIsOpen ? _file.size() : _data.size()) - (includeSkipped ? 0 : _skippedBytes);
 }
 
 bool mtpFileLoader::loadPart() {
+	if (_parts) {
+		// The parts could be requested in any order, see streamingRequested().
+		auto offset = _finished ? -1 : nextMissingPart();
+		if (offset < 0) {
+			return false;
+		}
+		makeRequest(offset);
+		_nextRequestOffset = offset + partSize();
+		return true;
+	}
 	if (_finished || _lastComplete || (!_sentRequests.empty() && !_size)) {
 		return false;
 	} else if (_size && _nextRequestOffset >= _size) {
@@ -454,6 +777,97 @@ bool mtpFileLoader::loadPart() {
 	return true;
 }
 
+int mtpFileLoader::nextMissingPart() const {
+	auto partRequested = [this](int offset) {
+		for (auto &sent : _sentRequests) {
+			if (sent.second.offset == offset) {
+				return true;
+			}
+		}
+		return (_cdnUncheckedParts.find(offset) != _cdnUncheckedParts.cend())
+			|| (_cdnDecryptingParts.find(offset) != _cdnDecryptingParts.cend());
+	};
+
+	// Go on from the last requested part, then from the beginning.
+	for (auto from : { _nextRequestOffset, 0 }) {
+		for (auto offset = _parts->firstMissing(from); offset < _size; offset = _parts->firstMissing(offset + partSize())) {
+			if (!partRequested(offset)) {
+				return offset;
+			}
+		}
+	}
+	return -1;
+}
+
+std::shared_ptr<Storage::StreamedFile> mtpFileLoader::streamedFile() {
+	if (!_parts || !_fileIsOpen) {
+		return nullptr;
+	}
+	if (!_streamed) {
+		_streamed = std::make_shared<Storage::StreamedFile>(_filename, *_parts);
+
+		// Called from the reader threads, cleared before the loader is destroyed.
+		_streamed->setRequestHandler([this](int offset) {
+			InvokeQueued(this, [this, offset] { streamingRequested(offset); });
+		});
+	}
+	return _streamed;
+}
+
+void mtpFileLoader::streamingRequested(int offset) {
+	if (!_parts || _finished || _parts->completed(offset)) {
+		return;
+	}
+	DEBUG_LOG(("Download Info: streaming requested offset %1 of '%2'").arg(offset).arg(_filename));
+
+	// Continue from the part the reader waits for and load it first.
+	_nextRequestOffset = offset - (offset % partSize());
+	start(true, true);
+}
+
+bool mtpFileLoader::openFile() {
+	if (!_size) {
+		return FileLoader::openFile();
+	}
+
+	// The destination is preallocated and the parts are written at their
+	// offsets, a previous partial download of this document is continued.
+	auto parts = std::make_unique<Storage::DownloadedParts>(partSize(), _size);
+	auto mkey = mediaKey(_locationType, _dcId, _id, _version);
+	auto savedPath = QString();
+	auto savedParts = QByteArray();
+	auto resume = false;
+	if (Local::readDownloadParts(mkey, &savedPath, &savedParts)) {
+		resume = (QFileInfo(savedPath).size() == _size)
+			&& parts->deserialize(savedParts)
+			&& !parts->finished();
+		if (resume && savedPath != _filename) {
+			// The destination was chosen and confirmed already, reuse the partial file for it.
+			QFile::remove(_filename);
+			resume = QFile::rename(savedPath, _filename);
+		}
+	}
+	if (resume && _file.open(QIODevice::ReadWrite)) {
+		DEBUG_LOG(("Download Info: continuing '%1' from %2 of %3 bytes").arg(_filename).arg(parts->completedBytes()).arg(_size));
+		for (auto offset = 0; offset < _size; offset += partSize()) {
+			if (parts->completed(offset)) {
+				_resumedUnchecked.insert(offset);
+			}
+		}
+	} else {
+		parts = std::make_unique<Storage::DownloadedParts>(partSize(), _size);
+		if (!_file.open(QIODevice::WriteOnly)) {
+			return false;
+		} else if (!_file.resize(_size)) {
+			_file.close();
+			return false;
+		}
+	}
+	_parts = std::move(parts);
+	_nextRequestOffset = _parts->firstMissing(0);
+	return true;
+}
+
 int mtpFileLoader::partSize() const {
 	return kDownloadCdnPartSize;
 
@@ -522,7 +936,7 @@ void mtpFileLoader::requestMoreCdnFileHashes() {
 void mtpFileLoader::normalPartLoaded(const MTPupload_File &result, mtpRequestId requestId) {
 	Expects(result.type() == mtpc_upload_fileCdnRedirect || result.type() == mtpc_upload_file);
 
-	auto offset = finishSentRequestGetOffset(requestId);
+	auto offset = finishReceivedRequestGetOffset(requestId, result.type() == mtpc_upload_file ? result.c_upload_file().vbytes.v.size() : 0);
 	if (result.type() == mtpc_upload_fileCdnRedirect) {
 		return switchToCDN(offset, result.c_upload_fileCdnRedirect());
 	}
@@ -533,8 +947,8 @@ void mtpFileLoader::normalPartLoaded(const MTPupload_File &result, mtpRequestId
 void mtpFileLoader::webPartLoaded(const MTPupload_WebFile &result, mtpRequestId requestId) {
 	Expects(result.type() == mtpc_upload_webFile);
 
-	auto offset = finishSentRequestGetOffset(requestId);
 	auto &webFile = result.c_upload_webFile();
+	auto offset = finishReceivedRequestGetOffset(requestId, webFile.vbytes.v.size());
 	if (!_size) {
 		_size = webFile.vsize.v;
 	} else if (webFile.vsize.v != _size) {
@@ -546,7 +960,7 @@ void mtpFileLoader::webPartLoaded(const MTPupload_WebFile &result, mtpRequestId
 }
 
 void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId requestId) {
-	auto offset = finishSentRequestGetOffset(requestId);
+	auto offset = finishReceivedRequestGetOffset(requestId, result.type() == mtpc_upload_cdnFile ? result.c_upload_cdnFile().vbytes.v.size() : 0);
 	if (result.type() == mtpc_upload_cdnFileReuploadNeeded) {
 		auto requestData = RequestData();
 		requestData.dcId = _dcId;
@@ -559,28 +973,47 @@ void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId
 	}
 	Expects(result.type() == mtpc_upload_cdnFile);
 
-	auto key = gsl::as_bytes(gsl::make_span(_cdnEncryptionKey));
-	auto iv = gsl::as_bytes(gsl::make_span(_cdnEncryptionIV));
-	Expects(key.size() == MTP::CTRState::KeySize);
-	Expects(iv.size() == MTP::CTRState::IvecSize);
-
-	auto state = MTP::CTRState();
-	auto ivec = gsl::as_writeable_bytes(gsl::make_span(state.ivec));
-	std::copy(iv.begin(), iv.end(), ivec.begin());
+	Expects(_cdnEncryptionKey.size() == MTP::CTRState::KeySize);
+	Expects(_cdnEncryptionIV.size() == MTP::CTRState::IvecSize);
+
+	auto hashIt = _cdnFileHashes.find(offset);
+	auto hash = (hashIt != _cdnFileHashes.cend()) ? hashIt->second.hash : QByteArray();
+	if (!_cdnDecryptQueue) {
+		_cdnDecryptQueue = std::make_unique<base::TaskQueue>(base::TaskQueue::Priority::Normal);
+	}
+	_cdnDecryptingParts.emplace(offset);
+	_cdnDecryptQueue->Put([weak = QPointer<mtpFileLoader>(this), offset, key = _cdnEncryptionKey, iv = _cdnEncryptionIV, hash, bytes = result.c_upload_cdnFile().vbytes.v]() mutable {
+		DecryptCdnPart(bytes, key, iv, offset);
+		auto checked = hash.isEmpty()
+			? CheckCdnHashResult::NoHash
+			: CdnPartHashGood(gsl::as_bytes(gsl::make_span(bytes)), hash)
+			? CheckCdnHashResult::Good
+			: CheckCdnHashResult::Invalid;
+		base::TaskQueue::Main().Put([weak, offset, bytes = std::move(bytes), checked]() mutable {
+			if (weak) {
+				weak->cdnPartDecrypted(offset, std::move(bytes), checked);
+			}
+		});
+	});
 
-	auto counterOffset = static_cast<uint32>(offset) >> 4;
-	state.ivec[15] = static_cast<uchar>(counterOffset & 0xFF);
-	state.ivec[14] = static_cast<uchar>((counterOffset >> 8) & 0xFF);
-	state.ivec[13] = static_cast<uchar>((counterOffset >> 16) & 0xFF);
-	state.ivec[12] = static_cast<uchar>((counterOffset >> 24) & 0xFF);
+	// Keep the requests pipeline full while the part is being decrypted.
+	loadNext();
+}
 
-	auto decryptInPlace = result.c_upload_cdnFile().vbytes.v;
-	MTP::aesCtrEncrypt(decryptInPlace.data(), decryptInPlace.size(), key.data(), &state);
-	auto bytes = gsl::as_bytes(gsl::make_span(decryptInPlace));
+void mtpFileLoader::cdnPartDecrypted(int offset, QByteArray bytes, CheckCdnHashResult result) {
+	_cdnDecryptingParts.erase(offset);
+	if (_finished) {
+		return;
+	}
 
-	switch (checkCdnFileHash(offset, bytes)) {
+	auto span = gsl::as_bytes(gsl::make_span(bytes));
+	if (result == CheckCdnHashResult::NoHash) {
+		// The hash could have arrived while this part was being decrypted.
+		result = checkCdnFileHash(offset, span);
+	}
+	switch (result) {
 	case CheckCdnHashResult::NoHash: {
-		_cdnUncheckedParts.emplace(offset, decryptInPlace);
+		_cdnUncheckedParts.emplace(offset, std::move(bytes));
 		requestMoreCdnFileHashes();
 	} return;
 
@@ -590,7 +1023,7 @@ void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId
 	} return;
 
 	case CheckCdnHashResult::Good: {
-		partLoaded(offset, bytes);
+		partLoaded(offset, span);
 	} return;
 	}
 	Unexpected("Result of checkCdnFileHash()");
@@ -601,11 +1034,9 @@ mtpFileLoader::CheckCdnHashResult mtpFileLoader::checkCdnFileHash(int offset, ba
 	if (cdnFileHashIt == _cdnFileHashes.cend()) {
 		return CheckCdnHashResult::NoHash;
 	}
-	auto realHash = hashSha256(bytes.data(), bytes.size());
-	if (base::compare_bytes(gsl::as_bytes(gsl::make_span(realHash)), gsl::as_bytes(gsl::make_span(cdnFileHashIt->second.hash)))) {
-		return CheckCdnHashResult::Invalid;
-	}
-	return CheckCdnHashResult::Good;
+	return CdnPartHashGood(bytes, cdnFileHashIt->second.hash)
+		? CheckCdnHashResult::Good
+		: CheckCdnHashResult::Invalid;
 }
 
 void mtpFileLoader::reuploadDone(const MTPVector<MTPCdnFileHash> &result, mtpRequestId requestId) {
@@ -663,7 +1094,17 @@ void mtpFileLoader::getCdnFileHashesDone(const MTPVector<MTPCdnFileHash> &result
 void mtpFileLoader::placeSentRequest(mtpRequestId requestId, const RequestData &requestData) {
 	_downloader->requestedAmountIncrement(requestData.dcId, requestData.dcIndex, partSize());
 	++_queue->queriesCount;
-	_sentRequests.emplace(requestId, requestData);
+	_queue->window.sent(_queue->queriesCount);
+	_sentRequests.emplace(requestId, requestData).first->second.sent = getms();
+}
+
+int mtpFileLoader::finishReceivedRequestGetOffset(mtpRequestId requestId, int bytes) {
+	auto it = _sentRequests.find(requestId);
+	Expects(it != _sentRequests.cend());
+
+	_queue->window.received(getms() - it->second.sent, bytes);
+	_queue->queriesLimit = _queue->window.limit();
+	return finishSentRequestGetOffset(requestId);
 }
 
 int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
@@ -681,7 +1122,24 @@ int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
 
 void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
 	if (bytes.size()) {
-		if (_fileIsOpen) {
+		if (_autoLoading && !_userInitiated) {
+			_downloader->autoDownloadReceived(bytes.size());
+		}
+		if (_parts) {
+			_file.seek(offset);
+			if (_file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size()) != qint64(bytes.size())) {
+				return cancel(true);
+			}
+			_parts->setCompleted(offset, bytes.size());
+			if (_streamed) {
+				_file.flush();
+				_streamed->partCompleted(offset, bytes.size());
+			}
+			if (++_partsSinceSave >= kSavePartsEach) {
+				_partsSinceSave = 0;
+				saveParts();
+			}
+		} else if (_fileIsOpen) {
 			auto fsize = _file.size();
 			if (offset < fsize) {
 				_skippedBytes -= bytes.size();
@@ -721,10 +1179,13 @@ void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
 			}
 		}
 	}
-	if (!bytes.size() || (bytes.size() % 1024)) { // bad next offset
+	if (!_parts && (!bytes.size() || (bytes.size() % 1024))) { // bad next offset
 		_lastComplete = true;
 	}
-	if (_sentRequests.empty() && _cdnUncheckedParts.empty() && (_lastComplete || (_size && _nextRequestOffset >= _size))) {
+	auto allReceived = _parts
+		? _parts->finished()
+		: (_lastComplete || (_size && _nextRequestOffset >= _size));
+	if (_sentRequests.empty() && _cdnUncheckedParts.empty() && _cdnDecryptingParts.empty() && allReceived) {
 		if (!_filename.isEmpty() && (_toCache == LoadToCacheAsWell)) {
 			if (!_fileIsOpen) _fileIsOpen = _file.open(QIODevice::WriteOnly);
 			if (!_fileIsOpen) {
@@ -740,6 +1201,10 @@ void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
 			_fileIsOpen = false;
 			Platform::File::PostprocessDownloaded(QFileInfo(_file).absoluteFilePath());
 		}
+		if (_parts) {
+			Local::removeDownloadParts(mediaKey(_locationType, _dcId, _id, _version));
+			_parts = nullptr;
+		}
 		removeFromQueue();
 
 		if (_localStatus == LocalNotFound || _localStatus == LocalFailed) {
@@ -763,17 +1228,19 @@ void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
 		}
 	}
 	if (_finished) {
-		_downloader->taskFinished().notify();
+		notifyFinished();
+	} else {
+		emit progress(this);
 	}
 
-	emit progress(this);
-
 	loadNext();
 }
 
 bool mtpFileLoader::partFailed(const RPCError &error) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
+	_queue->window.failed();
+	_queue->queriesLimit = _queue->window.limit();
 	cancel(true);
 	return true;
 }
@@ -810,6 +1277,9 @@ void mtpFileLoader::addCdnHashes(const QVector<MTPCdnFileHash> &hashes) {
 		auto &data = hash.c_cdnFileHash();
 		_cdnFileHashes.emplace(data.voffset.v, CdnFileHash { data.vlimit.v, data.vhash.v });
 	}
+	if (_parts && !_resumedUnchecked.empty()) {
+		checkResumedParts();
+	}
 }
 
 void mtpFileLoader::changeCDNParams(int offset, MTP::DcId dcId, const QByteArray &token, const QByteArray &encryptionKey, const QByteArray &encryptionIV, const QVector<MTPCdnFileHash> &hashes) {
@@ -880,8 +1350,61 @@ bool mtpFileLoader::tryLoadLocal() {
 	return false;
 }
 
+bool mtpFileLoader::keepPartialFile(bool failed) {
+	if (!_parts) {
+		return false;
+	}
+	if (_streamed) {
+		_streamed->fail();
+	}
+	auto mkey = mediaKey(_locationType, _dcId, _id, _version);
+	auto keep = failed && _parts->completedBytes() > 0;
+	if (keep) {
+		// A failed download is continued by the next attempt.
+		Local::writeDownloadParts(mkey, _filename, _parts->serialize());
+	} else {
+		Local::removeDownloadParts(mkey);
+	}
+	_parts = nullptr;
+	return keep;
+}
+
+void mtpFileLoader::saveParts() {
+	// The parts data must reach the file before the bitmap marks them completed.
+	_file.flush();
+	Local::writeDownloadParts(mediaKey(_locationType, _dcId, _id, _version), _filename, _parts->serialize());
+}
+
+void mtpFileLoader::checkResumedParts() {
+	for (auto i = _resumedUnchecked.begin(); i != _resumedUnchecked.end();) {
+		auto offset = *i;
+		auto hash = _cdnFileHashes.find(offset);
+		if (hash == _cdnFileHashes.cend()) {
+			++i;
+			continue;
+		}
+		_file.seek(offset);
+		auto bytes = _file.read(hash->second.limit);
+		if (checkCdnFileHash(offset, gsl::as_bytes(gsl::make_span(bytes))) != CheckCdnHashResult::Good) {
+			LOG(("Download Error: continued part at offset %1 does not match its cdnFileHash.").arg(offset));
+			_parts->setMissing(offset);
+			if (_streamed) {
+				_streamed->partMissing(offset);
+			}
+			accumulate_min(_nextRequestOffset, offset);
+		}
+		i = _resumedUnchecked.erase(i);
+	}
+}
+
 mtpFileLoader::~mtpFileLoader() {
+	if (_streamed) {
+		_streamed->fail();
+	}
 	cancelRequests();
+	if (_parts && _fileIsOpen) {
+		saveParts();
+	}
 }
 
 webFileLoader::webFileLoader(const QString &url, const QString &to, LoadFromCloudSetting fromCloud, bool autoLoading)
@@ -947,9 +1470,7 @@ void webFileLoader::onFinished(const QByteArray &data) {
 	if (_localStatus == LocalNotFound || _localStatus == LocalFailed) {
 		Local::writeWebFile(_url, _data);
 	}
-	_downloader->taskFinished().notify();
-
-	emit progress(this);
+	notifyFinished();
 
 	loadNext();
 }
@@ -1003,6 +1524,9 @@ public:
 		QNetworkRequest req(_url);
 		QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(_already) + "-";
 		req.setRawHeader("Range", rangeHeaderValue);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+		req.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+#endif // Qt >= 5.8.0
 		_reply = manager.get(req);
 		return _reply;
 	}
@@ -1035,6 +1559,9 @@ public:
 	qint64 already() const {
 		return _already;
 	}
+	QString host() const {
+		return _url.host();
+	}
 
 private:
 	static constexpr auto kMaxHttpRedirects = 5;
@@ -1047,6 +1574,9 @@ private:
 	int32 _redirectsLeft = kMaxHttpRedirects;
 	QByteArray _data;
 
+	bool _hasSlot = false;
+	QString _slotHost; // the host this loader takes a request slot of
+
 	friend class WebLoadManager;
 };
 
@@ -1166,7 +1696,8 @@ void WebLoadManager::onFailed(QNetworkReply *reply) {
 
 	if (!handleReplyResult(loader, WebReplyProcessError)) {
 		_loaders.remove(loader);
-		delete loader;
+		destroyLoader(loader);
+		sendWaiting();
 	}
 }
 
@@ -1213,10 +1744,11 @@ void WebLoadManager::onProgress(qint64 already, qint64 size) {
 	if (!handleReplyResult(loader, result)) {
 		_replies.erase(j);
 		_loaders.remove(loader);
-		delete loader;
+		destroyLoader(loader);
 
 		reply->abort();
 		reply->deleteLater();
+		sendWaiting();
 	}
 }
 
@@ -1240,10 +1772,12 @@ void WebLoadManager::onMeta() {
 				if (!handleReplyResult(loader, WebReplyProcessProgress)) {
 					_replies.erase(j);
 					_loaders.remove(loader);
-					delete loader;
+					destroyLoader(loader);
 
 					reply->abort();
 					reply->deleteLater();
+					sendWaiting();
+					return;
 				}
 			}
 		}
@@ -1251,7 +1785,6 @@ void WebLoadManager::onMeta() {
 }
 
 void WebLoadManager::process() {
-	Loaders newLoaders;
 	{
 		QMutexLocker lock(&_loaderPointersMutex);
 		for (LoaderPointers::iterator i = _loaderPointers.begin(), e = _loaderPointers.end(); i != e; ++i) {
@@ -1259,7 +1792,7 @@ void WebLoadManager::process() {
 			if (i.value()) {
 				if (it == _loaders.cend()) {
 					_loaders.insert(i.value());
-					newLoaders.insert(i.value());
+					_waiting.push_back(i.value());
 				}
 				i.value() = 0;
 			}
@@ -1270,23 +1803,49 @@ void WebLoadManager::process() {
 				it = _loaderPointers.end();
 			}
 			if (it == _loaderPointers.cend()) {
-				if (QNetworkReply *reply = (*i)->reply()) {
+				// Loaders destroyed while waiting for a slot never send anything.
+				auto loader = *i;
+				if (QNetworkReply *reply = loader->reply()) {
 					_replies.remove(reply);
 					reply->abort();
 					reply->deleteLater();
 				}
-				delete (*i);
 				i = _loaders.erase(i);
+				destroyLoader(loader);
 			} else {
 				++i;
 			}
 		}
 	}
-	for_const (webFileLoaderPrivate *loader, newLoaders) {
-		if (_loaders.contains(loader)) {
-			sendRequest(loader);
+	sendWaiting();
+}
+
+void WebLoadManager::sendWaiting() {
+	for (auto i = _waiting.begin(); i != _waiting.end();) {
+		auto loader = *i;
+		auto host = loader->host();
+		auto &requests = _requestsPerHost[host];
+		if (requests >= kMaxRequestsPerHost) {
+			++i;
+			continue;
+		}
+		++requests;
+		loader->_hasSlot = true;
+		loader->_slotHost = host;
+		i = _waiting.erase(i);
+		sendRequest(loader);
+	}
+}
+
+void WebLoadManager::destroyLoader(webFileLoaderPrivate *loader) {
+	_waiting.removeOne(loader);
+	if (loader->_hasSlot) {
+		auto it = _requestsPerHost.find(loader->_slotHost);
+		if (it != _requestsPerHost.cend() && --it.value() <= 0) {
+			_requestsPerHost.erase(it);
 		}
 	}
+	delete loader;
 }
 
 void WebLoadManager::sendRequest(webFileLoaderPrivate *loader, const QString &redirect) {
@@ -1330,6 +1889,8 @@ void WebLoadManager::clear() {
 		delete loader;
 	}
 	_loaders.clear();
+	_waiting.clear();
+	_requestsPerHost.clear();
 
 	for (Replies::iterator i = _replies.begin(), e = _replies.end(); i != e; ++i) {
 		delete i.key();
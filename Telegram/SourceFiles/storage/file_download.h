@@ -21,8 +21,17 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include "base/observer.h"
+#include "base/timer.h"
+#include "base/flat_map.h"
+#include "base/flat_set.h"
 #include "storage/localimageloader.h" // for TaskId
 
+namespace base {
+class TaskQueue;
+} // namespace base
+
+class HistoryItem;
+
 namespace Storage {
 
 constexpr auto kMaxFileInMemory = 10 * 1024 * 1024; // 10 MB max file could be hold in memory
@@ -30,6 +39,27 @@ constexpr auto kMaxVoiceInMemory = 2 * 1024 * 1024; // 2 MB audio is hold in mem
 constexpr auto kMaxStickerInMemory = 2 * 1024 * 1024; // 2 MB stickers hold in memory, auto loaded and displayed inline
 constexpr auto kMaxAnimationInMemory = kMaxFileInMemory; // 10 MB gif and mp4 animations held in memory while playing
 
+class DownloadedParts;
+class StreamedFile;
+
+enum class AutoDownloadType {
+	Photo,
+	Audio,
+	Gif,
+};
+
+// Checks the chat type settings of the type and the byte budget of the
+// automatic downloads. Without an item checks if any chat type is allowed.
+bool AutoDownloadAllowed(AutoDownloadType type, const HistoryItem *item);
+
+// Free download slots in a queue are given to the loaders of the higher class first.
+enum class DownloadPriority {
+	UserInitiated,
+	Visible, // started or painted after the last clearPriorities()
+	Prefetch,
+	Background, // auto download that is not visible any more
+};
+
 class Downloader final {
 public:
 	Downloader();
@@ -37,6 +67,9 @@ public:
 	int currentPriority() const {
 		return _priority;
 	}
+
+	// Called when the visible area changes, loaders that are not touched
+	// (started again) after that drop to Prefetch or Background class.
 	void clearPriorities();
 
 	void delayedDestroyLoader(std::unique_ptr<FileLoader> loader);
@@ -46,7 +79,17 @@ public:
 	}
 
 	void requestedAmountIncrement(MTP::DcId dcId, int index, int amount);
-	int chooseDcIndexForRequest(MTP::DcId dcId) const;
+	int chooseDcIndexForRequest(MTP::DcId dcId);
+
+	// Called when media from some dc is received, opens a download session
+	// to that dc (and imports the authorization there) in background.
+	void prewarmDc(MTP::DcId dcId);
+
+	// Automatic downloads spend a byte budget that refills over time.
+	// When it is spent new ones are not started from the cloud until it
+	// refills, then the files that were skipped are tried again.
+	bool autoDownloadBudgetLeft();
+	void autoDownloadReceived(int amount);
 
 	~Downloader();
 
@@ -57,11 +100,37 @@ private:
 	SingleQueuedInvokation _delayedLoadersDestroyer;
 	std::vector<std::unique_ptr<FileLoader>> _delayedDestroyedLoaders;
 
-	using RequestedInDc = std::array<int64, MTP::kDownloadSessionsCount>;
+	struct RequestedInDc {
+		std::array<int64, MTP::kMaxDownloadSessionsCount> bytes = { { 0 } };
+		std::array<TimeMs, MTP::kMaxDownloadSessionsCount> idleSince = { { 0 } };
+		int sessionsCount = MTP::kDownloadSessionsCount;
+	};
+	void killIdleSessions();
+
 	std::map<MTP::DcId, RequestedInDc> _requestedBytesAmount;
+	base::Timer _killIdleSessionsTimer;
+
+	void prewarmQueued();
+	void prewarmFinished(mtpRequestId requestId);
+
+	base::flat_set<MTP::DcId> _prewarmedDcs;
+	std::vector<MTP::DcId> _prewarmQueue;
+	base::flat_map<mtpRequestId, MTP::DcId> _prewarmRequests;
+	base::Timer _prewarmTimer;
+
+	void autoDownloadBudgetRefilled();
+	void autoDownloadForgetOld(TimeMs now);
+
+	std::vector<std::pair<TimeMs, int64>> _autoDownloaded;
+	int64 _autoDownloadedBytes = 0;
+	bool _autoDownloadSkipped = false;
+	base::Timer _autoDownloadBudgetTimer;
 
 };
 
+struct DownloadWindowStats;
+std::vector<DownloadWindowStats> CollectDownloadWindowStats();
+
 } // namespace Storage
 
 struct StorageImageSaved {
@@ -91,7 +160,7 @@ class FileLoader : public QObject {
 public:
 	FileLoader(const QString &toFile, int32 size, LocationType locationType, LoadToCacheSetting, LoadFromCloudSetting fromCloud, bool autoLoading);
 	bool finished() const {
-		return _finished;
+		return _finished && !_imageDecoding;
 	}
 	bool cancelled() const {
 		return _cancelled;
@@ -104,6 +173,11 @@ public:
 	}
 	QByteArray imageFormat(const QSize &shrinkBox = QSize()) const;
 	QPixmap imagePixmap(const QSize &shrinkBox = QSize()) const;
+
+	// Downloaded images are decoded in a background thread, right to this box size.
+	void setImageShrinkBox(const QSize &box) {
+		_imageShrinkBox = box;
+	}
 	QString fileName() const {
 		return _filename;
 	}
@@ -134,8 +208,20 @@ public:
 		return _autoLoading;
 	}
 
+	// The user asked for this file, it is loaded before all the others.
+	void setUserInitiated() {
+		_userInitiated = true;
+	}
+	Storage::DownloadPriority priority() const;
+
 	virtual void stop() {
 	}
+
+	// Returns nullptr if the file can't be played while it is downloaded.
+	virtual std::shared_ptr<Storage::StreamedFile> streamedFile() {
+		return nullptr;
+	}
+
 	virtual ~FileLoader();
 
 	void localLoaded(const StorageImageSaved &result, const QByteArray &imageFormat = QByteArray(), const QPixmap &imagePixmap = QPixmap());
@@ -147,6 +233,10 @@ signals:
 protected:
 	void readImage(const QSize &shrinkBox) const;
 
+	// Emits progress() for a finished download, after decoding it if it is an image.
+	void notifyFinished();
+	void imageDecoded(QImage &&image, const QByteArray &format);
+
 	not_null<Storage::Downloader*> _downloader;
 	FileLoader *_prev = nullptr;
 	FileLoader *_next = nullptr;
@@ -155,8 +245,10 @@ protected:
 
 	bool _paused = false;
 	bool _autoLoading = false;
+	bool _userInitiated = false;
 	bool _inQueue = false;
 	bool _finished = false;
+	bool _imageDecoding = false;
 	bool _cancelled = false;
 	mutable LocalLoadStatus _localStatus = LocalNotTried;
 
@@ -169,6 +261,10 @@ protected:
 
 	void loadNext();
 	virtual bool loadPart() = 0;
+	virtual bool openFile();
+	virtual bool keepPartialFile(bool failed) {
+		return false;
+	}
 
 	QString _filename;
 	QFile _file;
@@ -183,6 +279,7 @@ protected:
 	LocationType _locationType;
 
 	TaskId _localTaskId = 0;
+	QSize _imageShrinkBox;
 	mutable QByteArray _imageFormat;
 	mutable QPixmap _imagePixmap;
 
@@ -208,6 +305,8 @@ public:
 		rpcInvalidate();
 	}
 
+	std::shared_ptr<Storage::StreamedFile> streamedFile() override;
+
 	~mtpFileLoader();
 
 private:
@@ -215,6 +314,7 @@ private:
 		MTP::DcId dcId = 0;
 		int dcIndex = 0;
 		int offset = 0;
+		TimeMs sent = 0;
 	};
 	struct CdnFileHash {
 		CdnFileHash(int limit, QByteArray hash) : limit(limit), hash(hash) {
@@ -231,6 +331,10 @@ private:
 	void makeRequest(int offset);
 
 	bool loadPart() override;
+	int nextMissingPart() const;
+	void streamingRequested(int offset);
+	bool openFile() override;
+	bool keepPartialFile(bool failed) override;
 	void normalPartLoaded(const MTPupload_File &result, mtpRequestId requestId);
 	void webPartLoaded(const MTPupload_WebFile &result, mtpRequestId requestId);
 	void cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId requestId);
@@ -239,11 +343,14 @@ private:
 	void getCdnFileHashesDone(const MTPVector<MTPCdnFileHash> &result, mtpRequestId requestId);
 
 	void partLoaded(int offset, base::const_byte_span bytes);
+	void saveParts();
+	void checkResumedParts();
 	bool partFailed(const RPCError &error);
 	bool cdnPartFailed(const RPCError &error, mtpRequestId requestId);
 
 	void placeSentRequest(mtpRequestId requestId, const RequestData &requestData);
 	int finishSentRequestGetOffset(mtpRequestId requestId);
+	int finishReceivedRequestGetOffset(mtpRequestId requestId, int bytes);
 	void switchToCDN(int offset, const MTPDupload_fileCdnRedirect &redirect);
 	void addCdnHashes(const QVector<MTPCdnFileHash> &hashes);
 	void changeCDNParams(int offset, MTP::DcId dcId, const QByteArray &token, const QByteArray &encryptionKey, const QByteArray &encryptionIV, const QVector<MTPCdnFileHash> &hashes);
@@ -254,11 +361,18 @@ private:
 		Good,
 	};
 	CheckCdnHashResult checkCdnFileHash(int offset, base::const_byte_span bytes);
+	void cdnPartDecrypted(int offset, QByteArray bytes, CheckCdnHashResult result);
 
 	std::map<mtpRequestId, RequestData> _sentRequests;
 
 	bool _lastComplete = false;
 	int32 _skippedBytes = 0;
+
+	// for documents downloaded straight to disk
+	std::unique_ptr<Storage::DownloadedParts> _parts;
+	int _partsSinceSave = 0;
+	std::set<int> _resumedUnchecked; // offsets not checked by cdn hashes yet
+	std::shared_ptr<Storage::StreamedFile> _streamed;
 	int32 _nextRequestOffset = 0;
 
 	MTP::DcId _dcId = 0; // for photo locations
@@ -278,6 +392,10 @@ private:
 	std::map<int, QByteArray> _cdnUncheckedParts;
 	mtpRequestId _cdnHashesRequestId = 0;
 
+	// cdn parts are decrypted and checked in a serial queue, so they come back in order
+	std::unique_ptr<base::TaskQueue> _cdnDecryptQueue;
+	std::set<int> _cdnDecryptingParts;
+
 };
 
 class webFileLoaderPrivate;
@@ -366,8 +484,14 @@ public slots:
 private:
 	void clear();
 	void sendRequest(webFileLoaderPrivate *loader, const QString &redirect = QString());
+	void sendWaiting();
+	void destroyLoader(webFileLoaderPrivate *loader);
 	bool handleReplyResult(webFileLoaderPrivate *loader, WebReplyProcessResult result);
 
+	// Requests to one host wait in _waiting above this limit, so that a
+	// screen of thumbnails from one server does not delay all the others.
+	static constexpr auto kMaxRequestsPerHost = 4;
+
 #ifndef TDESKTOP_DISABLE_NETWORK_PROXY
 	QNetworkProxy _proxySettings;
 #endif // !TDESKTOP_DISABLE_NETWORK_PROXY
@@ -382,6 +506,9 @@ private:
 	typedef QMap<QNetworkReply*, webFileLoaderPrivate*> Replies;
 	Replies _replies;
 
+	QList<webFileLoaderPrivate*> _waiting; // loaders waiting for a free host slot
+	QMap<QString, int> _requestsPerHost;
+
 };
 
 class WebLoadMainManager : public QObject {
@@ -23,7 +23,12 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 namespace Storage {
 namespace {
 
-constexpr auto kMaxUploadFileParallelSize = MTP::kUploadSessionsCount * 512 * 1024; // max 512kb uploaded at the same time in each session
+constexpr auto kMaxUploadInFlightSize = 32 * 1024 * 1024; // bounds the memory used by the parts in flight
+constexpr auto kMaxUploadFilesAtOnce = 4;
+constexpr auto kPreferredPartDuration = TimeMs(250);
+
+// Sessions without measured goodput are compared by the bytes in flight.
+constexpr auto kUnmeasuredGoodput = 1024 * 1024;
 
 } // namespace
 
@@ -63,6 +68,9 @@ void Uploader::upload(const FullMsgId &msgId, const FileLoadResultPtr &file) {
 	} else if (file->type == SendMediaType::File || file->type == SendMediaType::Audio) {
 		auto document = file->thumb.isNull() ? App::feedDocument(file->document) : App::feedDocument(file->document, file->thumb);
 		document->status = FileUploading;
+		if (file->type == SendMediaType::File) {
+			document->uploadContentHash = file->contentHash;
+		}
 		if (!file->content.isEmpty()) {
 			document->setData(file->content);
 		}
@@ -70,12 +78,96 @@ void Uploader::upload(const FullMsgId &msgId, const FileLoadResultPtr &file) {
 			document->setLocation(FileLocation(file->filepath));
 		}
 	}
-	queue.insert(msgId, File(file));
+	auto entry = File(file);
+	if (file->type == SendMediaType::Audio) {
+		useStreamedParts(msgId, entry);
+	}
+	queue.insert(msgId, entry);
+	sendNext();
+}
+
+void Uploader::streamPart(uint64 fileId, int32 index, const QByteArray &bytes) {
+	auto &file = streamed[fileId];
+	if (file.failed) {
+		return;
+	}
+	auto expected = file.partsSent + file.pending.size();
+	auto size = bytes.size();
+	if (index != expected
+		|| (file.partSize && size != file.partSize)
+		|| (size % 1024) || ((512 * 1024) % size)
+		|| int64(index + 1) * size > UseBigFilesFrom) {
+		// The whole file will be uploaded after the recording is finished.
+		file.failed = true;
+		file.pending.clear();
+		return;
+	}
+	file.partSize = size;
+	file.pending.push_back(bytes);
 	sendNext();
 }
 
-void Uploader::currentFailed() {
-	Queue::iterator j = queue.find(uploading);
+void Uploader::cancelStreamed(uint64 fileId) {
+	if (streamed.remove(fileId)) {
+		cancelStreamedRequests(fileId);
+		sendNext();
+	}
+}
+
+void Uploader::cancelStreamedRequests(uint64 fileId) {
+	for (auto i = requestsSent.begin(); i != requestsSent.end();) {
+		if (i->streamedId == fileId) {
+			MTP::cancel(i.key());
+			sentSize -= i->size;
+			sentSizes[i->dc] -= i->size;
+			--sentCounts[i->dc];
+			i = requestsSent.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+void Uploader::useStreamedParts(const FullMsgId &msgId, File &file) {
+	auto i = streamed.find(file.id());
+	if (i == streamed.end()) {
+		return;
+	}
+	auto streamedFile = i.value();
+	streamed.erase(i);
+
+	auto &content = file.file->content;
+	auto streamedSize = int64(streamedFile.partsSent) * streamedFile.partSize;
+	auto usable = !streamedFile.failed
+		&& (streamedFile.partsSent > 0)
+		&& file.file->filepath.isEmpty()
+		&& (file.docSize == content.size())
+		&& (file.docSize <= UseBigFilesFrom)
+		&& (streamedSize <= content.size());
+	if (usable && !file.setPartSize(streamedFile.partSize)) {
+		file.setDocSize(file.docSize);
+		usable = false;
+	}
+	if (!usable) {
+		cancelStreamedRequests(file.id());
+		return;
+	}
+
+	// The streamed parts in flight now belong to the uploaded file.
+	for (auto &request : requestsSent) {
+		if (request.streamedId == file.id()) {
+			request.streamedId = 0;
+			request.msgId = msgId;
+			++file.requestsInFlight;
+			++file.docRequestsInFlight;
+		}
+	}
+	file.docSentParts = streamedFile.partsSent;
+	file.md5Hash.feed(content.constData(), uint32(streamedSize));
+}
+
+void Uploader::fileFailed(const FullMsgId &msgId) {
+	auto j = queue.find(msgId);
 	if (j != queue.end()) {
 		if (j->type() == SendMediaType::Photo) {
 			emit photoFailed(j.key());
@@ -89,13 +181,16 @@ void Uploader::currentFailed() {
 		queue.erase(j);
 	}
 
-	requestsSent.clear();
-	docRequestsSent.clear();
-	dcMap.clear();
-	uploading = FullMsgId();
-	sentSize = 0;
-	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
-		sentSizes[i] = 0;
+	for (auto i = requestsSent.begin(); i != requestsSent.end();) {
+		if (i->msgId == msgId) {
+			MTP::cancel(i.key());
+			sentSize -= i->size;
+			sentSizes[i->dc] -= i->size;
+			--sentCounts[i->dc];
+			i = requestsSent.erase(i);
+		} else {
+			++i;
+		}
 	}
 
 	sendNext();
@@ -108,10 +203,10 @@ void Uploader::killSessions() {
 }
 
 void Uploader::sendNext() {
-	if (sentSize >= kMaxUploadFileParallelSize || _paused.msg) return;
+	if (_paused.msg) return;
 
 	bool killing = killSessionsTimer.isActive();
-	if (queue.isEmpty()) {
+	if (queue.isEmpty() && streamed.isEmpty()) {
 		if (!killing) {
 			killSessionsTimer.start(MTPAckSendWaiting + MTPKillFileSessionTimeout);
 		}
@@ -121,61 +216,127 @@ void Uploader::sendNext() {
 	if (killing) {
 		killSessionsTimer.stop();
 	}
-	Queue::iterator i = uploading.msg ? queue.find(uploading) : queue.begin();
-	if (!uploading.msg) {
-		uploading = i.key();
-	} else if (i == queue.end()) {
-		i = queue.begin();
-		uploading = i.key();
-	}
-	int todc = 0;
-	for (int dc = 1; dc < MTP::kUploadSessionsCount; ++dc) {
-		if (sentSizes[dc] < sentSizes[todc]) {
-			todc = dc;
+
+	// Files are reported in the queue order, so that the messages are sent in order.
+	while (!queue.isEmpty() && !queue.begin()->hasPartsToSend() && !queue.begin()->requestsInFlight) {
+		finishFile(queue.begin());
+	}
+	while (sendStreamedPart()) {
+	}
+	while (sendPart()) {
+	}
+	if (!queue.isEmpty() || !streamed.isEmpty()) {
+		nextTimer.start(UploadRequestInterval);
+	}
+}
+
+bool Uploader::sendStreamedPart() {
+	for (auto i = streamed.begin(); i != streamed.end(); ++i) {
+		if (i->failed || i->pending.isEmpty()) {
+			continue;
 		}
+		auto dc = chooseSession(i->partSize);
+		if (dc < 0) {
+			return false;
+		}
+		auto bytes = i->pending.takeFirst();
+
+		auto request = Request();
+		request.streamedId = i.key();
+		request.dc = dc;
+		request.size = bytes.size();
+		request.doc = true;
+		request.sent = getms();
+
+		auto requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(i.key()), MTP_int(i->partsSent), MTP_bytes(bytes)), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(dc));
+		++i->partsSent;
+
+		requestsSent.insert(requestId, request);
+		sentSize += request.size;
+		sentSizes[dc] += request.size;
+		windows[dc].sent(++sentCounts[dc]);
+		return true;
 	}
+	return false;
+}
 
-	UploadFileParts &parts(i->file ? (i->type() == SendMediaType::Photo ? i->file->fileparts : i->file->thumbparts) : i->media.parts);
-	uint64 partsOfId(i->file ? (i->type() == SendMediaType::Photo ? i->file->id : i->file->thumbId) : i->media.thumbId);
-	if (parts.isEmpty()) {
-		if (i->docSentParts >= i->docPartsCount) {
-			if (requestsSent.isEmpty() && docRequestsSent.isEmpty()) {
-				bool silent = i->file && i->file->to.silent;
-				if (i->type() == SendMediaType::Photo) {
-					auto photoFilename = i->filename();
-					if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
-						// Server has some extensions checking for inputMediaUploadedPhoto,
-						// so force the extension to be .jpg anyway. It doesn't matter,
-						// because the filename from inputFile is not used anywhere.
-						photoFilename += qstr(".jpg");
-					}
-					emit photoReady(uploading, silent, MTP_inputFile(MTP_long(i->id()), MTP_int(i->partsCount), MTP_string(photoFilename), MTP_bytes(i->file ? i->file->filemd5 : i->media.jpeg_md5)));
-				} else if (i->type() == SendMediaType::File || i->type() == SendMediaType::Audio) {
-					QByteArray docMd5(32, Qt::Uninitialized);
-					hashMd5Hex(i->md5Hash.result(), docMd5.data());
-
-					MTPInputFile doc = (i->docSize > UseBigFilesFrom) ? MTP_inputFileBig(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename())) : MTP_inputFile(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename()), MTP_bytes(docMd5));
-					if (i->partsCount) {
-						emit thumbDocumentReady(uploading, silent, doc, MTP_inputFile(MTP_long(i->thumbId()), MTP_int(i->partsCount), MTP_string(i->file ? i->file->thumbname : (qsl("thumb.") + i->media.thumbExt)), MTP_bytes(i->file ? i->file->thumbmd5 : i->media.jpeg_md5)));
-					} else {
-						emit documentReady(uploading, silent, doc);
-					}
-				}
-				queue.remove(uploading);
-				uploading = FullMsgId();
-				sendNext();
-			}
-			return;
+bool Uploader::sendPart() {
+	// Several files from the queue start are uploaded at the same time,
+	// the one with the least parts in flight gets the next free slot.
+	auto chosen = queue.end();
+	auto files = 0;
+	for (auto i = queue.begin(); i != queue.end() && files != kMaxUploadFilesAtOnce; ++i, ++files) {
+		if (i->hasPartsToSend() && (chosen == queue.end() || i->requestsInFlight < chosen->requestsInFlight)) {
+			chosen = i;
 		}
+	}
+	if (chosen == queue.end()) {
+		return false;
+	}
+	if (!chosen->docSentParts && chosen->docPartsCount && !chosen->docRequestsInFlight) {
+		chosen->setDocSize(chosen->docSize, preferredPartSize());
+	}
+	auto &parts(chosen->file ? (chosen->type() == SendMediaType::Photo ? chosen->file->fileparts : chosen->file->thumbparts) : chosen->media.parts);
+	auto size = parts.isEmpty() ? chosen->docPartSize : parts.begin().value().size();
+	auto dc = chooseSession(size);
+	if (dc < 0) {
+		return false;
+	}
+	return sendPart(chosen, dc);
+}
+
+int Uploader::chooseSession(int32 size) const {
+	if (sentSize + size > kMaxUploadInFlightSize && sentSize > 0) {
+		return -1;
+	}
+
+	// Prefer the session that is expected to deliver this part first.
+	auto result = -1;
+	auto resultScore = 0.;
+	for (auto dc = 0; dc != MTP::kUploadSessionsCount; ++dc) {
+		if (sentCounts[dc] >= windows[dc].limit()) {
+			continue;
+		}
+		auto goodput = windows[dc].goodput();
+		auto score = goodput
+			? (float64(sentSizes[dc]) + size) / goodput
+			: float64(sentSizes[dc]) / kUnmeasuredGoodput;
+		if (result < 0 || score < resultScore) {
+			result = dc;
+			resultScore = score;
+		}
+	}
+	return result;
+}
 
+int32 Uploader::preferredPartSize() const {
+	// Large parts on fast connections, so that each part takes some time to be sent.
+	auto goodput = int64(0);
+	for (auto &window : windows) {
+		accumulate_max(goodput, window.goodput());
+	}
+	return int32(qMin(goodput * kPreferredPartDuration / 1000, int64(DocumentUploadPartSize4)));
+}
+
+bool Uploader::sendPart(Queue::iterator i, int dc) {
+	auto &parts(i->file ? (i->type() == SendMediaType::Photo ? i->file->fileparts : i->file->thumbparts) : i->media.parts);
+	auto partsOfId = i->file ? (i->type() == SendMediaType::Photo ? i->file->id : i->file->thumbId) : i->media.thumbId;
+
+	auto request = Request();
+	request.msgId = i.key();
+	request.dc = dc;
+	request.sent = getms();
+
+	mtpRequestId requestId;
+	if (parts.isEmpty()) {
 		QByteArray &content(i->file ? i->file->content : i->media.data);
 		QByteArray toSend;
 		if (content.isEmpty()) {
 			if (!i->docFile) {
 				i->docFile.reset(new QFile(i->file ? i->file->filepath : i->media.file));
 				if (!i->docFile->open(QIODevice::ReadOnly)) {
-					currentFailed();
-					return;
+					fileFailed(i.key());
+					return false;
 				}
 			}
 			toSend = i->docFile->read(i->docPartSize);
@@ -184,44 +345,70 @@ void Uploader::sendNext() {
 			}
 		} else {
 			toSend = content.mid(i->docSentParts * i->docPartSize, i->docPartSize);
-			if ((i->type() == SendMediaType::File || i->type() == SendMediaType::Audio) && i->docSentParts <= UseBigFilesFrom) {
+			if ((i->type() == SendMediaType::File || i->type() == SendMediaType::Audio) && i->docSize <= UseBigFilesFrom) {
 				i->md5Hash.feed(toSend.constData(), toSend.size());
 			}
 		}
 		if (toSend.size() > i->docPartSize || (toSend.size() < i->docPartSize && i->docSentParts + 1 != i->docPartsCount)) {
-			currentFailed();
-			return;
+			fileFailed(i.key());
+			return false;
 		}
-		mtpRequestId requestId;
 		if (i->docSize > UseBigFilesFrom) {
-			requestId = MTP::send(MTPupload_SaveBigFilePart(MTP_long(i->id()), MTP_int(i->docSentParts), MTP_int(i->docPartsCount), MTP_bytes(toSend)), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(todc));
+			requestId = MTP::send(MTPupload_SaveBigFilePart(MTP_long(i->id()), MTP_int(i->docSentParts), MTP_int(i->docPartsCount), MTP_bytes(toSend)), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(dc));
 		} else {
-			requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(i->id()), MTP_int(i->docSentParts), MTP_bytes(toSend)), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(todc));
+			requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(i->id()), MTP_int(i->docSentParts), MTP_bytes(toSend)), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(dc));
 		}
-		docRequestsSent.insert(requestId, i->docSentParts);
-		dcMap.insert(requestId, todc);
-		sentSize += i->docPartSize;
-		sentSizes[todc] += i->docPartSize;
-
+		request.size = i->docPartSize;
+		request.doc = true;
+		++i->docRequestsInFlight;
 		i->docSentParts++;
 	} else {
 		UploadFileParts::iterator part = parts.begin();
 
-		mtpRequestId requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(partsOfId), MTP_int(part.key()), MTP_bytes(part.value())), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(todc));
-		requestsSent.insert(requestId, part.value());
-		dcMap.insert(requestId, todc);
-		sentSize += part.value().size();
-		sentSizes[todc] += part.value().size();
+		requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(partsOfId), MTP_int(part.key()), MTP_bytes(part.value())), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(dc));
+		request.size = part.value().size();
 
 		parts.erase(part);
 	}
-	nextTimer.start(UploadRequestInterval);
+	++i->requestsInFlight;
+	requestsSent.insert(requestId, request);
+	sentSize += request.size;
+	sentSizes[dc] += request.size;
+	windows[dc].sent(++sentCounts[dc]);
+	return true;
+}
+
+void Uploader::finishFile(Queue::iterator i) {
+	auto msgId = i.key();
+	bool silent = i->file && i->file->to.silent;
+	if (i->type() == SendMediaType::Photo) {
+		auto photoFilename = i->filename();
+		if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
+			// Server has some extensions checking for inputMediaUploadedPhoto,
+			// so force the extension to be .jpg anyway. It doesn't matter,
+			// because the filename from inputFile is not used anywhere.
+			photoFilename += qstr(".jpg");
+		}
+		emit photoReady(msgId, silent, MTP_inputFile(MTP_long(i->id()), MTP_int(i->partsCount), MTP_string(photoFilename), MTP_bytes(i->file ? i->file->filemd5 : i->media.jpeg_md5)));
+	} else if (i->type() == SendMediaType::File || i->type() == SendMediaType::Audio) {
+		QByteArray docMd5(32, Qt::Uninitialized);
+		hashMd5Hex(i->md5Hash.result(), docMd5.data());
+
+		MTPInputFile doc = (i->docSize > UseBigFilesFrom) ? MTP_inputFileBig(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename())) : MTP_inputFile(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename()), MTP_bytes(docMd5));
+		if (i->partsCount) {
+			emit thumbDocumentReady(msgId, silent, doc, MTP_inputFile(MTP_long(i->thumbId()), MTP_int(i->partsCount), MTP_string(i->file ? i->file->thumbname : (qsl("thumb.") + i->media.thumbExt)), MTP_bytes(i->file ? i->file->thumbmd5 : i->media.jpeg_md5)));
+		} else {
+			emit documentReady(msgId, silent, doc);
+		}
+	}
+	queue.erase(i);
 }
 
 void Uploader::cancel(const FullMsgId &msgId) {
 	uploaded.remove(msgId);
-	if (uploading == msgId) {
-		currentFailed();
+	auto i = queue.constFind(msgId);
+	if (i != queue.cend() && i->started()) {
+		fileFailed(msgId);
 	} else {
 		queue.remove(msgId);
 	}
@@ -242,72 +429,76 @@ void Uploader::confirm(const FullMsgId &msgId) {
 void Uploader::clear() {
 	uploaded.clear();
 	queue.clear();
-	for (QMap<mtpRequestId, QByteArray>::const_iterator i = requestsSent.cbegin(), e = requestsSent.cend(); i != e; ++i) {
+	streamed.clear();
+	for (auto i = requestsSent.cbegin(), e = requestsSent.cend(); i != e; ++i) {
 		MTP::cancel(i.key());
 	}
 	requestsSent.clear();
-	for (QMap<mtpRequestId, int32>::const_iterator i = docRequestsSent.cbegin(), e = docRequestsSent.cend(); i != e; ++i) {
-		MTP::cancel(i.key());
-	}
-	docRequestsSent.clear();
-	dcMap.clear();
 	sentSize = 0;
 	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
 		MTP::stopSession(MTP::uploadDcId(i));
 		sentSizes[i] = 0;
+		sentCounts[i] = 0;
 	}
 	killSessionsTimer.stop();
 }
 
 void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
-	QMap<mtpRequestId, int32>::iterator j = docRequestsSent.end();
-	QMap<mtpRequestId, QByteArray>::iterator i = requestsSent.find(requestId);
+	auto i = requestsSent.find(requestId);
 	if (i == requestsSent.cend()) {
-		j = docRequestsSent.find(requestId);
+		sendNext();
+		return;
 	}
-	if (i != requestsSent.cend() || j != docRequestsSent.cend()) {
-		if (mtpIsFalse(result)) { // failed to upload current file
-			currentFailed();
-			return;
-		} else {
-			QMap<mtpRequestId, int32>::iterator dcIt = dcMap.find(requestId);
-			if (dcIt == dcMap.cend()) { // must not happen
-				currentFailed();
-				return;
-			}
-			int32 dc = dcIt.value();
-			dcMap.erase(dcIt);
-
-			int32 sentPartSize = 0;
-			Queue::const_iterator k = queue.constFind(uploading);
-			if (i != requestsSent.cend()) {
-				sentPartSize = i.value().size();
-				requestsSent.erase(i);
-			} else {
-				sentPartSize = k->docPartSize;
-				docRequestsSent.erase(j);
+	auto request = i.value();
+	requestsSent.erase(i);
+
+	sentSize -= request.size;
+	sentSizes[request.dc] -= request.size;
+	--sentCounts[request.dc];
+	windows[request.dc].received(getms() - request.sent, request.size);
+
+	if (request.streamedId) {
+		if (mtpIsFalse(result)) {
+			auto j = streamed.find(request.streamedId);
+			if (j != streamed.end()) {
+				j->failed = true;
+				j->pending.clear();
 			}
-			sentSize -= sentPartSize;
-			sentSizes[dc] -= sentPartSize;
-			if (k->type() == SendMediaType::Photo) {
-				k->fileSentSize += sentPartSize;
-				PhotoData *photo = App::photo(k->id());
-				if (photo->uploading() && k->file) {
-					photo->uploadingData->size = k->file->partssize;
-					photo->uploadingData->offset = k->fileSentSize;
-				}
-				emit photoProgress(k.key());
-			} else if (k->type() == SendMediaType::File || k->type() == SendMediaType::Audio) {
-				DocumentData *doc = App::document(k->id());
-				if (doc->uploading()) {
-					doc->uploadOffset = (k->docSentParts - docRequestsSent.size()) * k->docPartSize;
-					if (doc->uploadOffset > doc->size) {
-						doc->uploadOffset = doc->size;
-					}
-				}
-				emit documentProgress(k.key());
+		}
+		sendNext();
+		return;
+	}
+
+	auto k = queue.find(request.msgId);
+	if (k == queue.end()) {
+		sendNext();
+		return;
+	}
+	--k->requestsInFlight;
+	if (request.doc) {
+		--k->docRequestsInFlight;
+	}
+	if (mtpIsFalse(result)) { // failed to upload current file
+		fileFailed(request.msgId);
+		return;
+	}
+	if (k->type() == SendMediaType::Photo) {
+		k->fileSentSize += request.size;
+		PhotoData *photo = App::photo(k->id());
+		if (photo->uploading() && k->file) {
+			photo->uploadingData->size = k->file->partssize;
+			photo->uploadingData->offset = k->fileSentSize;
+		}
+		emit photoProgress(k.key());
+	} else if (k->type() == SendMediaType::File || k->type() == SendMediaType::Audio) {
+		DocumentData *doc = App::document(k->id());
+		if (doc->uploading()) {
+			doc->uploadOffset = (k->docSentParts - k->docRequestsInFlight) * k->docPartSize;
+			if (doc->uploadOffset > doc->size) {
+				doc->uploadOffset = doc->size;
 			}
 		}
+		emit documentProgress(k.key());
 	}
 
 	sendNext();
@@ -316,10 +507,26 @@ void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
 bool Uploader::partFailed(const RPCError &error, mtpRequestId requestId) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
-	if (requestsSent.constFind(requestId) != requestsSent.cend() || docRequestsSent.constFind(requestId) != docRequestsSent.cend()) { // failed to upload current file
-		currentFailed();
+	auto i = requestsSent.find(requestId);
+	if (i != requestsSent.end() && i->streamedId) {
+		// Failed to upload a part of a recording, it will be uploaded as a whole.
+		windows[i->dc].failed();
+		auto j = streamed.find(i->streamedId);
+		if (j != streamed.end()) {
+			j->failed = true;
+			j->pending.clear();
+		}
+		sentSize -= i->size;
+		sentSizes[i->dc] -= i->size;
+		--sentCounts[i->dc];
+		requestsSent.erase(i);
+		sendNext();
+	} else if (i != requestsSent.end()) { // failed to upload current file
+		windows[i->dc].failed();
+		fileFailed(i->msgId);
+	} else {
+		sendNext();
 	}
-	sendNext();
 	return true;
 }
 
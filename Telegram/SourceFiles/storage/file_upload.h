@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include "storage/localimageloader.h"
+#include "storage/storage_download_window.h"
 
 namespace Storage {
 
@@ -39,6 +40,11 @@ public:
 	void pause(const FullMsgId &msgId);
 	void confirm(const FullMsgId &msgId);
 
+	// Parts of a voice message are uploaded while it is being recorded.
+	// When the file with the same id is uploaded, the streamed parts are skipped.
+	void streamPart(uint64 fileId, int32 index, const QByteArray &bytes);
+	void cancelStreamed(uint64 fileId);
+
 	void clear();
 
 	~Uploader();
@@ -77,18 +83,24 @@ private:
 				docSize = docPartSize = docPartsCount = 0;
 			}
 		}
-		void setDocSize(int32 size) {
+		// Part size can't be less than preferred, it is chosen before the first part is sent.
+		void setDocSize(int32 size, int32 preferredPartSize = 0) {
+			constexpr int32 kPartSizes[] = {
+				DocumentUploadPartSize0,
+				DocumentUploadPartSize1,
+				DocumentUploadPartSize2,
+				DocumentUploadPartSize3,
+				DocumentUploadPartSize4,
+			};
+			constexpr auto kPartSizesCount = int(sizeof(kPartSizes) / sizeof(kPartSizes[0]));
+
 			docSize = size;
-			if (docSize >= 1024 * 1024 || !setPartSize(DocumentUploadPartSize0)) {
-				if (docSize > 32 * 1024 * 1024 || !setPartSize(DocumentUploadPartSize1)) {
-					if (!setPartSize(DocumentUploadPartSize2)) {
-						if (!setPartSize(DocumentUploadPartSize3)) {
-							if (!setPartSize(DocumentUploadPartSize4)) {
-								LOG(("Upload Error: bad doc size: %1").arg(docSize));
-							}
-						}
-					}
-				}
+			auto index = (docSize < 1024 * 1024) ? 0 : (docSize <= 32 * 1024 * 1024) ? 1 : 2;
+			while (index + 1 < kPartSizesCount && (kPartSizes[index] < preferredPartSize || !setPartSize(kPartSizes[index]))) {
+				++index;
+			}
+			if (!setPartSize(kPartSizes[index])) {
+				LOG(("Upload Error: bad doc size: %1").arg(docSize));
 			}
 		}
 		bool setPartSize(uint32 partSize) {
@@ -97,10 +109,21 @@ private:
 			return (docPartsCount <= DocumentMaxPartsCount);
 		}
 
+		bool hasPartsToSend() const {
+			auto &parts = file ? (type() == SendMediaType::Photo ? file->fileparts : file->thumbparts) : media.parts;
+			return !parts.isEmpty() || (docSentParts < docPartsCount);
+		}
+		bool started() const {
+			auto &parts = file ? (type() == SendMediaType::Photo ? file->fileparts : file->thumbparts) : media.parts;
+			return (parts.size() != partsCount) || (docSentParts > 0);
+		}
+
 		FileLoadResultPtr file;
 		SendMediaReady media;
 		int32 partsCount;
-		mutable int32 fileSentSize;
+		int32 fileSentSize = 0;
+		int32 requestsInFlight = 0;
+		int32 docRequestsInFlight = 0;
 
 		uint64 id() const {
 			return file ? file->id : media.id;
@@ -125,20 +148,50 @@ private:
 	};
 	typedef QMap<FullMsgId, File> Queue;
 
+	struct StreamedFile {
+		int32 partSize = 0;
+		int32 partsSent = 0;
+		QList<QByteArray> pending;
+		bool failed = false;
+	};
+	typedef QMap<uint64, StreamedFile> Streamed;
+
+	struct Request {
+		FullMsgId msgId;
+		uint64 streamedId = 0; // not zero until the streamed file is uploaded
+		int32 dc = 0;
+		int32 size = 0;
+		bool doc = false;
+		TimeMs sent = 0;
+	};
+
 	void partLoaded(const MTPBool &result, mtpRequestId requestId);
 	bool partFailed(const RPCError &err, mtpRequestId requestId);
 
-	void currentFailed();
+	// Returns false if there is no free session or no file to send a part of.
+	bool sendPart();
+	bool sendPart(Queue::iterator i, int dc);
+	bool sendStreamedPart();
+	void useStreamedParts(const FullMsgId &msgId, File &file);
+	void cancelStreamedRequests(uint64 fileId);
+	void finishFile(Queue::iterator i);
+	int chooseSession(int32 size) const;
+	int32 preferredPartSize() const;
 
-	QMap<mtpRequestId, QByteArray> requestsSent;
-	QMap<mtpRequestId, int32> docRequestsSent;
-	QMap<mtpRequestId, int32> dcMap;
+	void fileFailed(const FullMsgId &msgId);
+
+	QMap<mtpRequestId, Request> requestsSent;
 	uint32 sentSize = 0;
 	uint32 sentSizes[MTP::kUploadSessionsCount] = { 0 };
+	int sentCounts[MTP::kUploadSessionsCount] = { 0 };
+
+	// The same window that tunes the downloads controls in-flight upload parts.
+	DownloadWindow windows[MTP::kUploadSessionsCount];
 
-	FullMsgId uploading, _paused;
+	FullMsgId _paused;
 	Queue queue;
 	Queue uploaded;
+	Streamed streamed;
 	QTimer nextTimer, killSessionsTimer;
 
 };
@@ -32,13 +32,92 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace {
 
+constexpr auto kContentHashReadSize = 1024 * 1024;
+constexpr auto kPhotoQuality = 87;
+constexpr auto kPhotoMinQuality = 73;
+constexpr auto kPhotoQualityStep = 7;
+constexpr auto kPhotoBytesBudget = 512 * 1024;
+
 bool ValidateThumbDimensions(int width, int height) {
 	return (width > 0) && (height > 0) && (width < 20 * height) && (height < 20 * width);
 }
 
+QImage ScaledToFit(const QImage &image, int size) {
+	if (image.width() > size || image.height() > size) {
+		return image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	}
+	return image;
+}
+
+// Lowers the quality step by step while the result doesn't fit in the budget.
+QByteArray EncodePhoto(const QImage &image, int bytesBudget) {
+	auto result = QByteArray();
+	for (auto quality = kPhotoQuality; ; quality -= kPhotoQualityStep) {
+		result = QByteArray();
+		{
+			QBuffer buffer(&result);
+			image.save(&buffer, "JPG", quality);
+		}
+		if (result.size() <= bytesBudget || quality - kPhotoQualityStep < kPhotoMinQuality) {
+			break;
+		}
+	}
+	return result;
+}
+
+QByteArray CountContentHash(const QByteArray &content) {
+	auto hash = HashMd5(content.constData(), content.size());
+	return QByteArray(reinterpret_cast<const char*>(hash.result()), 16);
+}
+
+// The same file sent to several chats is hashed once while it is not modified.
+QByteArray CountContentHash(const QFileInfo &info) {
+	struct Cached {
+		qint64 size = 0;
+		QDateTime modified;
+		QByteArray hash;
+	};
+	static QMutex CachedMutex;
+	static QMap<QString, Cached> CachedHashes;
+
+	auto path = info.absoluteFilePath();
+	{
+		QMutexLocker lock(&CachedMutex);
+		auto i = CachedHashes.constFind(path);
+		if (i != CachedHashes.cend() && i->size == info.size() && i->modified == info.lastModified()) {
+			return i->hash;
+		}
+	}
+
+	QFile f(path);
+	if (!f.open(QIODevice::ReadOnly)) {
+		return QByteArray();
+	}
+	auto hash = HashMd5();
+	auto buffer = QByteArray(kContentHashReadSize, Qt::Uninitialized);
+	auto read = qint64(0);
+	while ((read = f.read(buffer.data(), buffer.size())) > 0) {
+		hash.feed(buffer.constData(), read);
+	}
+	if (read < 0 || f.pos() != info.size()) {
+		return QByteArray();
+	}
+	auto result = QByteArray(reinterpret_cast<const char*>(hash.result()), 16);
+
+	QMutexLocker lock(&CachedMutex);
+	auto &cached = CachedHashes[path];
+	cached.size = info.size();
+	cached.modified = info.lastModified();
+	cached.hash = result;
+	return result;
+}
+
 } // namespace
 
-TaskQueue::TaskQueue(QObject *parent, int32 stopTimeoutMs) : QObject(parent), _thread(0), _worker(0), _stopTimer(0) {
+TaskQueue::TaskQueue(QObject *parent, int32 stopTimeoutMs, int workersCount, QThread::Priority priority) : QObject(parent)
+, _workersCount(qMax(workersCount, 1))
+, _priority(priority)
+, _stopTimer(0) {
 	if (stopTimeoutMs > 0) {
 		_stopTimer = new QTimer(this);
 		connect(_stopTimer, SIGNAL(timeout()), this, SLOT(stop()));
@@ -68,16 +147,19 @@ void TaskQueue::addTasks(const TasksList &tasks) {
 }
 
 void TaskQueue::wakeThread() {
-	if (!_thread) {
-		_thread = new QThread();
-
-		_worker = new TaskQueueWorker(this);
-		_worker->moveToThread(_thread);
-
-		connect(this, SIGNAL(taskAdded()), _worker, SLOT(onTaskAdded()));
-		connect(_worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
-
-		_thread->start();
+	if (_threads.empty()) {
+		for (auto i = 0; i != _workersCount; ++i) {
+			auto thread = new QThread();
+			auto worker = new TaskQueueWorker(this);
+			worker->moveToThread(thread);
+
+			connect(this, SIGNAL(taskAdded()), worker, SLOT(onTaskAdded()));
+			connect(worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
+
+			thread->start(_priority);
+			_threads.push_back(thread);
+			_workers.push_back(worker);
+		}
 	}
 	if (_stopTimer) _stopTimer->stop();
 	emit taskAdded();
@@ -92,6 +174,13 @@ void TaskQueue::cancelTask(TaskId id) {
 				return;
 			}
 		}
+		for (int32 i = 0, l = _tasksInProcess.size(); i != l; ++i) {
+			if (_tasksInProcess.at(i)->id() == id) {
+				_tasksInProcess.removeAt(i);
+				_tasksProcessed.erase(id);
+				return;
+			}
+		}
 	}
 	QMutexLocker lock(&_tasksToFinishMutex);
 	for (int32 i = 0, l = _tasksToFinish.size(); i != l; ++i) {
@@ -102,6 +191,37 @@ void TaskQueue::cancelTask(TaskId id) {
 	}
 }
 
+TaskPtr TaskQueue::takeTaskToProcess() {
+	QMutexLocker lock(&_tasksToProcessMutex);
+	if (_tasksToProcess.isEmpty()) {
+		return TaskPtr();
+	}
+	auto task = _tasksToProcess.front();
+	_tasksToProcess.pop_front();
+	_tasksInProcess.push_back(task);
+	return task;
+}
+
+bool TaskQueue::taskProcessed(const TaskPtr &task) {
+	auto emitTaskProcessed = false;
+	{
+		QMutexLocker lockToProcess(&_tasksToProcessMutex);
+		if (!_tasksInProcess.contains(task)) {
+			return false; // cancelled
+		}
+		_tasksProcessed.insert(task->id());
+
+		QMutexLocker lockToFinish(&_tasksToFinishMutex);
+		while (!_tasksInProcess.isEmpty() && _tasksProcessed.count(_tasksInProcess.front()->id())) {
+			emitTaskProcessed = emitTaskProcessed || _tasksToFinish.isEmpty();
+			_tasksProcessed.erase(_tasksInProcess.front()->id());
+			_tasksToFinish.push_back(_tasksInProcess.front());
+			_tasksInProcess.pop_front();
+		}
+	}
+	return emitTaskProcessed;
+}
+
 void TaskQueue::onTaskProcessed() {
 	do {
 		TaskPtr task;
@@ -116,24 +236,32 @@ void TaskQueue::onTaskProcessed() {
 
 	if (_stopTimer) {
 		QMutexLocker lock(&_tasksToProcessMutex);
-		if (_tasksToProcess.isEmpty()) {
+		if (_tasksToProcess.isEmpty() && _tasksInProcess.isEmpty()) {
 			_stopTimer->start();
 		}
 	}
 }
 
 void TaskQueue::stop() {
-	if (_thread) {
-		_thread->requestInterruption();
-		_thread->quit();
+	for (auto thread : _threads) {
+		thread->requestInterruption();
+		thread->quit();
+	}
+	if (!_threads.empty()) {
 		DEBUG_LOG(("Waiting for taskThread to finish"));
-		_thread->wait();
-		delete _worker;
-		delete _thread;
-		_worker = 0;
-		_thread = 0;
+	}
+	for (auto thread : _threads) {
+		thread->wait();
+	}
+	for (auto worker : base::take(_workers)) {
+		delete worker;
+	}
+	for (auto thread : base::take(_threads)) {
+		delete thread;
 	}
 	_tasksToProcess.clear();
+	_tasksInProcess.clear();
+	_tasksProcessed.clear();
 	_tasksToFinish.clear();
 }
 
@@ -146,36 +274,18 @@ void TaskQueueWorker::onTaskAdded() {
 	if (_inTaskAdded) return;
 	_inTaskAdded = true;
 
-	bool someTasksLeft = false;
-	do {
-		TaskPtr task;
-		{
-			QMutexLocker lock(&_queue->_tasksToProcessMutex);
-			if (!_queue->_tasksToProcess.isEmpty()) {
-				task = _queue->_tasksToProcess.front();
-			}
+	while (!thread()->isInterruptionRequested()) {
+		auto task = _queue->takeTaskToProcess();
+		if (!task) {
+			break;
 		}
-
-		if (task) {
-			task->process();
-			bool emitTaskProcessed = false;
-			{
-				QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
-				if (!_queue->_tasksToProcess.isEmpty() && _queue->_tasksToProcess.front() == task) {
-					_queue->_tasksToProcess.pop_front();
-					someTasksLeft = !_queue->_tasksToProcess.isEmpty();
-
-					QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
-					emitTaskProcessed = _queue->_tasksToFinish.isEmpty();
-					_queue->_tasksToFinish.push_back(task);
-				}
-			}
-			if (emitTaskProcessed) {
-				emit taskProcessed();
-			}
+		task->process();
+		if (_queue->taskProcessed(task)) {
+			emit taskProcessed();
 		}
+
 		QCoreApplication::processEvents();
-	} while (someTasksLeft && !thread()->isInterruptionRequested());
+	}
 
 	_inTaskAdded = false;
 }
@@ -196,7 +306,7 @@ FileLoadTask::FileLoadTask(const QByteArray &content, const QImage &image, SendM
 , _caption(caption) {
 }
 
-FileLoadTask::FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption) : _id(rand_value<uint64>())
+FileLoadTask::FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption, uint64 streamedId) : _id(streamedId ? streamedId : rand_value<uint64>())
 , _to(to)
 , _content(voice)
 , _duration(duration)
@@ -485,25 +595,28 @@ void FileLoadTask::process() {
 		attributes.push_back(MTP_documentAttributeImageSize(MTP_int(w), MTP_int(h)));
 
 		if (ValidateThumbDimensions(w, h)) {
+			auto thumbSource = fullimage;
 			if (isAnimation) {
 				attributes.push_back(MTP_documentAttributeAnimated());
 			} else if (_type != SendMediaType::File) {
-				auto thumb = (w > 100 || h > 100) ? App::pixmapFromImageInPlace(fullimage.scaled(100, 100, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage);
-				photoThumbs.insert('s', thumb);
-				photoSizes.push_back(MTP_photoSize(MTP_string("s"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(thumb.width()), MTP_int(thumb.height()), MTP_int(0)));
+				auto started = getms();
 
-				auto medium = (w > 320 || h > 320) ? App::pixmapFromImageInPlace(fullimage.scaled(320, 320, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage);
-				photoThumbs.insert('m', medium);
-				photoSizes.push_back(MTP_photoSize(MTP_string("m"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(medium.width()), MTP_int(medium.height()), MTP_int(0)));
+				// Each size is scaled down from the previous one, not from the full image.
+				auto full = ScaledToFit(fullimage, 1280);
+				auto medium = ScaledToFit(full, 320);
+				auto tiny = ScaledToFit(medium, 100);
+				thumbSource = medium;
 
-				auto full = (w > 1280 || h > 1280) ? App::pixmapFromImageInPlace(fullimage.scaled(1280, 1280, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage);
-				photoThumbs.insert('y', full);
+				filedata = EncodePhoto(full, kPhotoBytesBudget);
+
+				photoSizes.push_back(MTP_photoSize(MTP_string("s"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(tiny.width()), MTP_int(tiny.height()), MTP_int(0)));
+				photoSizes.push_back(MTP_photoSize(MTP_string("m"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(medium.width()), MTP_int(medium.height()), MTP_int(0)));
 				photoSizes.push_back(MTP_photoSize(MTP_string("y"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(full.width()), MTP_int(full.height()), MTP_int(0)));
+				photoThumbs.insert('s', App::pixmapFromImageInPlace(std::move(tiny)));
+				photoThumbs.insert('m', App::pixmapFromImageInPlace(std::move(medium)));
+				photoThumbs.insert('y', App::pixmapFromImageInPlace(std::move(full)));
 
-				{
-					QBuffer buffer(&filedata);
-					full.save(&buffer, "JPG", 87);
-				}
+				DEBUG_LOG(("Photo Info: prepared %1x%2 photo in %3 ms, %4 bytes.").arg(w).arg(h).arg(getms() - started).arg(filedata.size()));
 
 				photo = MTP_photo(MTP_flags(0), MTP_long(_id), MTP_long(0), MTP_int(unixtime()), MTP_vector<MTPPhotoSize>(photoSizes));
 
@@ -526,7 +639,7 @@ void FileLoadTask::process() {
 				thumbname = qsl("thumb.webp");
 			}
 
-			QPixmap full = (w > 90 || h > 90) ? App::pixmapFromImageInPlace(fullimage.scaled(90, 90, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage, Qt::ColorOnly);
+			QPixmap full = (w > 90 || h > 90) ? App::pixmapFromImageInPlace(thumbSource.scaled(90, 90, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage, Qt::ColorOnly);
 
 			{
 				QBuffer buffer(&thumbdata);
@@ -552,6 +665,8 @@ void FileLoadTask::process() {
 	} else if (_type != SendMediaType::Photo) {
 		document = MTP_document(MTP_long(_id), MTP_long(0), MTP_int(unixtime()), MTP_string(filemime), MTP_int(filesize), thumbSize, MTP_int(MTP::maindc()), MTP_int(0), MTP_vector<MTPDocumentAttribute>(attributes));
 		_type = SendMediaType::File;
+
+		_result->contentHash = info.exists() ? CountContentHash(info) : CountContentHash(_content);
 	}
 
 	_result->type = _type;
@@ -122,7 +122,8 @@ class TaskQueue : public QObject {
 	Q_OBJECT
 
 public:
-	TaskQueue(QObject *parent, int32 stopTimeoutMs = 0); // <= 0 - never stop worker
+	// Tasks are processed by workersCount threads, but finished in the order they were added.
+	TaskQueue(QObject *parent, int32 stopTimeoutMs = 0, int workersCount = 1, QThread::Priority priority = QThread::InheritPriority); // <= 0 - never stop worker
 
 	TaskId addTask(TaskPtr task);
 	void addTasks(const TasksList &tasks);
@@ -142,10 +143,20 @@ private:
 
 	void wakeThread();
 
+	// Returns nullptr if there are no tasks to process.
+	TaskPtr takeTaskToProcess();
+
+	// Returns true if taskProcessed() should be emitted.
+	bool taskProcessed(const TaskPtr &task);
+
 	TasksList _tasksToProcess, _tasksToFinish;
+	TasksList _tasksInProcess; // taken by workers, in the order they were added
+	std::set<TaskId> _tasksProcessed; // by workers, waiting for the previous ones
 	QMutex _tasksToProcessMutex, _tasksToFinishMutex;
-	QThread *_thread;
-	TaskQueueWorker *_worker;
+	int _workersCount = 1;
+	QThread::Priority _priority = QThread::InheritPriority;
+	std::vector<QThread*> _threads;
+	std::vector<TaskQueueWorker*> _workers;
 	QTimer *_stopTimer;
 
 };
@@ -196,6 +207,7 @@ struct FileLoadResult {
 	QString filename;
 	QString filemime;
 	int32 filesize = 0;
+	QByteArray contentHash; // md5 of a document, it is not uploaded again if it was sent already
 	UploadFileParts fileparts;
 	QByteArray filemd5;
 	int32 partssize;
@@ -262,7 +274,7 @@ public:
 
 	FileLoadTask(const QString &filepath, std::unique_ptr<MediaInformation> information, SendMediaType type, const FileLoadTo &to, const QString &caption);
 	FileLoadTask(const QByteArray &content, const QImage &image, SendMediaType type, const FileLoadTo &to, const QString &caption);
-	FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption);
+	FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption, uint64 streamedId = 0);
 
 	uint64 fileid() const {
 		return _id;
@@ -22,7 +22,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "storage/serialize_document.h"
 #include "storage/serialize_common.h"
+#include "storage/storage_media_cache.h"
 #include "data/data_drafts.h"
+#include "history/history.h"
 #include "window/themes/window_theme.h"
 #include "observer_peer.h"
 #include "mainwidget.h"
@@ -37,13 +39,27 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "auth_session.h"
 #include "window/window_controller.h"
 #include "base/flags.h"
+#include "base/task_queue.h"
+#include "core/trace.h"
+#include "core/memory_stats.h"
+#include "core/startup_timeline.h"
 
 #include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <thread>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else // Q_OS_WIN
+#include <unistd.h>
+#endif // Q_OS_WIN
 
 namespace Local {
 namespace {
 
 constexpr int kThemeFileSizeLimit = 5 * 1024 * 1024;
+constexpr auto kMediaCacheSizeLimit = qint64(1024 * 1024 * 1024);
+constexpr auto kReadEncryptedPartSize = 64 * 1024;
 
 using FileKey = quint64;
 
@@ -66,6 +82,7 @@ QString _basePath, _userBasePath;
 bool _started = false;
 internal::Manager *_manager = nullptr;
 TaskQueue *_localLoader = nullptr;
+TaskQueue *_waveformCounter = nullptr;
 
 bool _working() {
 	return _manager && !_basePath.isEmpty();
@@ -112,6 +129,8 @@ FileKey genKey(FileOptions options = FileOption::User | FileOption::Safe) {
 	return result;
 }
 
+void _cancelWrite(const QString &path);
+
 void clearKey(const FileKey &key, FileOptions options = FileOption::User | FileOption::Safe) {
 	if (options & FileOption::User) {
 		if (!_userWorking()) return;
@@ -121,7 +140,9 @@ void clearKey(const FileKey &key, FileOptions options = FileOption::User | FileO
 
 	QString base = (options & FileOption::User) ? _userBasePath : _basePath, name;
 	name.reserve(base.size() + 0x11);
-	name.append(base).append(toFilePart(key)).append('0');
+	name.append(base).append(toFilePart(key));
+	_cancelWrite(name);
+	name.append('0');
 	QFile::remove(name);
 	if (options & FileOption::Safe) {
 		name[name.size() - 1] = '1';
@@ -163,6 +184,19 @@ void createLocalKey(const QByteArray &pass, QByteArray *salt, MTP::AuthKeyPtr *r
 	*result = std::make_shared<MTP::AuthKey>(key);
 }
 
+// The passcode key derivation is slow, so it runs in a background thread.
+// The callback is called in the main thread with the derived key.
+void createLocalKeyAsync(const QByteArray &pass, const QByteArray &salt, base::lambda_once<void(MTP::AuthKeyPtr key)> done) {
+	base::TaskQueue::Background().Put([pass, salt, done = std::move(done)]() mutable {
+		auto key = MTP::AuthKeyPtr();
+		auto saltCopy = salt;
+		createLocalKey(pass, &saltCopy, &key);
+		base::TaskQueue::Main().Put([key = std::move(key), done = std::move(done)]() mutable {
+			done(std::move(key));
+		});
+	});
+}
+
 struct FileReadDescriptor {
 	FileReadDescriptor() : version(0) {
 	}
@@ -269,8 +303,9 @@ struct FileWriteDescriptor {
 	}
 	static QByteArray prepareEncrypted(EncryptedDescriptor &data, const MTP::AuthKeyPtr &key = LocalKey) {
 		data.finish();
-		QByteArray &toEncrypt(data.data);
-
+		return prepareEncrypted(base::take(data.data), key);
+	}
+	static QByteArray prepareEncrypted(QByteArray toEncrypt, const MTP::AuthKeyPtr &key = LocalKey) {
 		// prepare for encryption
 		uint32 size = toEncrypt.size(), fullSize = size;
 		if (fullSize & 0x0F) {
@@ -317,15 +352,344 @@ struct FileWriteDescriptor {
 	}
 };
 
-bool readFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe) {
-	if (options & FileOption::User) {
-		if (!_userWorking()) return false;
-	} else {
-		if (!_working()) return false;
+QString _filePathBase(const QString &name, FileOptions options) {
+	return ((options & FileOption::User) ? _userBasePath : _basePath) + name;
+}
+
+void _forgetEvicted(const Storage::MediaCache::Keys &keys);
+void _compactMediaCacheIfNeeded();
+
+void _syncFile(const QString &path) {
+	QFile f(path);
+	if (!f.open(QIODevice::ReadWrite)) {
+		return;
 	}
+#ifdef Q_OS_WIN
+	_commit(f.handle());
+#else // Q_OS_WIN
+	fsync(f.handle());
+#endif // Q_OS_WIN
+}
 
-	// detect order of read attempts
-	QString toTry[2];
+// Encrypts and writes files in a separate thread.
+//
+// Repeated writes of the same file are collapsed while they are
+// waiting in the queue, only the last one is written. Delayed jobs
+// (like drafts) wait in the queue so that frequent changes are
+// collapsed, but not longer than the delay after the first change.
+class Writer {
+public:
+	struct Job {
+		QString name;
+		FileOptions options;
+		QByteArray data; // finished EncryptedDescriptor data
+		MTP::AuthKeyPtr key;
+
+		// Media records go to the media cache instead of separate files.
+		std::shared_ptr<Storage::MediaCache> cache;
+		FileKey cacheKey = 0;
+
+		TimeMs queued = 0;
+		TimeMs notBefore = 0;
+	};
+
+	Writer(QObject *context);
+
+	void put(Job &&job, TimeMs delay = 0);
+
+	// Finishes the pending write of the file (in the calling thread if it is not started yet).
+	void waitFor(const QString &path);
+
+	// Drops the pending write of the file, if any.
+	void cancel(const QString &path);
+
+	// Drops all pending writes.
+	void clear();
+
+	void flush();
+
+	WriterStats stats() const;
+
+	~Writer();
+
+private:
+	void threadFunction();
+
+	// Returns the path of the written file if it should be synced.
+	QString perform(Job &job);
+	void finished(const Job &job, TimeMs latency);
+
+	QObject *_context = nullptr;
+
+	mutable QMutex _mutex;
+	QWaitCondition _added, _done;
+	std::deque<QString> _order;
+	QMap<QString, Job> _jobs;
+	QSet<QString> _inProgress;
+	bool _stopped = false;
+	int _flushing = 0;
+	WriterStats _stats;
+	TimeMs _latencySum = 0;
+
+	std::thread _thread;
+
+};
+
+// Up to this amount of different files can wait for writing,
+// if the queue is full the file is written in the calling thread.
+constexpr auto kWriterQueueLimit = 256;
+constexpr auto kWriterBatchLimit = 32;
+
+// Drafts and their cursors are rewritten at most once in this time
+// while the user is typing, pending writes are flushed on exit.
+constexpr auto kDraftsWriteDelay = TimeMs(3000);
+
+Writer::Writer(QObject *context) : _context(context) {
+	_thread = std::thread([this] { threadFunction(); });
+}
+
+void Writer::put(Job &&job, TimeMs delay) {
+	job.queued = getms();
+	job.notBefore = delay ? (job.queued + delay) : 0;
+	auto path = _filePathBase(job.name, job.options);
+	{
+		QMutexLocker lock(&_mutex);
+		auto i = _jobs.find(path);
+		if (i != _jobs.end()) {
+			// Keep the earliest deadline, so the data is not delayed forever.
+			auto notBefore = i.value().notBefore;
+			job.notBefore = (notBefore && job.notBefore) ? qMin(notBefore, job.notBefore) : 0;
+			job.queued = i.value().queued;
+			i.value() = std::move(job);
+			++_stats.coalesced;
+			return;
+		} else if (int(_jobs.size()) < kWriterQueueLimit) {
+			_jobs.insert(path, std::move(job));
+			_order.push_back(path);
+			accumulate_max(_stats.maxQueueDepth, int(_jobs.size()));
+			_added.wakeOne();
+			return;
+		}
+		++_stats.overflowed;
+		while (_inProgress.contains(path)) {
+			_done.wait(&_mutex);
+		}
+		_inProgress.insert(path);
+	}
+	auto written = perform(job);
+	if (!written.isEmpty()) {
+		_syncFile(written);
+	}
+	QMutexLocker lock(&_mutex);
+	_inProgress.remove(path);
+	finished(job, getms() - job.queued);
+	_done.wakeAll();
+}
+
+void Writer::waitFor(const QString &path) {
+	auto job = Job();
+	{
+		QMutexLocker lock(&_mutex);
+		while (_inProgress.contains(path)) {
+			_done.wait(&_mutex);
+		}
+		auto i = _jobs.find(path);
+		if (i == _jobs.end()) {
+			return;
+		}
+		job = std::move(i.value());
+		_jobs.erase(i);
+		_order.erase(std::find(_order.begin(), _order.end(), path));
+		_inProgress.insert(path);
+	}
+	auto written = perform(job);
+	if (!written.isEmpty()) {
+		_syncFile(written);
+	}
+	QMutexLocker lock(&_mutex);
+	_inProgress.remove(path);
+	finished(job, getms() - job.queued);
+	_done.wakeAll();
+}
+
+void Writer::cancel(const QString &path) {
+	QMutexLocker lock(&_mutex);
+	while (_inProgress.contains(path)) {
+		_done.wait(&_mutex);
+	}
+	if (_jobs.remove(path)) {
+		_order.erase(std::find(_order.begin(), _order.end(), path));
+	}
+}
+
+void Writer::clear() {
+	QMutexLocker lock(&_mutex);
+	_jobs.clear();
+	_order.clear();
+	while (!_inProgress.isEmpty()) {
+		_done.wait(&_mutex);
+	}
+}
+
+void Writer::flush() {
+	QMutexLocker lock(&_mutex);
+	++_flushing;
+	_added.wakeOne();
+	while (!_order.empty() || !_inProgress.isEmpty()) {
+		_done.wait(&_mutex);
+	}
+	--_flushing;
+}
+
+WriterStats Writer::stats() const {
+	QMutexLocker lock(&_mutex);
+	auto result = _stats;
+	result.queueDepth = _jobs.size();
+	return result;
+}
+
+void Writer::finished(const Job &job, TimeMs latency) {
+	++_stats.written;
+	_latencySum += latency;
+	_stats.averageLatency = _latencySum / _stats.written;
+	accumulate_max(_stats.maxLatency, latency);
+}
+
+QString Writer::perform(Job &job) {
+	auto encrypted = FileWriteDescriptor::prepareEncrypted(base::take(job.data), job.key);
+	if (job.cache) {
+		auto evicted = job.cache->put(job.cacheKey, encrypted);
+		if (!evicted.isEmpty() && _context) {
+			InvokeQueued(_context, [evicted] {
+				_forgetEvicted(evicted);
+				_compactMediaCacheIfNeeded();
+			});
+		}
+		return QString();
+	}
+	FileWriteDescriptor file(job.name, job.options);
+	if (!file.writeData(encrypted)) {
+		return QString();
+	}
+	return file.file.fileName();
+}
+
+void Writer::threadFunction() {
+	auto batch = std::vector<std::pair<QString, Job>>();
+	auto synced = std::vector<QString>();
+	while (true) {
+		{
+			QMutexLocker lock(&_mutex);
+			while (_order.empty() && !_stopped) {
+				_added.wait(&_mutex);
+			}
+			if (_order.empty()) {
+				return;
+			}
+			auto now = getms();
+			auto waitTill = TimeMs(0);
+			auto writeDelayed = _stopped || (_flushing > 0);
+			for (auto o = _order.begin(); o != _order.end() && batch.size() < kWriterBatchLimit;) {
+				auto path = *o;
+				auto i = _jobs.find(path);
+				auto notBefore = i.value().notBefore;
+				if (notBefore > now && !writeDelayed) {
+					if (!waitTill || waitTill > notBefore) {
+						waitTill = notBefore;
+					}
+					++o;
+					continue;
+				}
+				o = _order.erase(o);
+				batch.push_back(std::make_pair(path, std::move(i.value())));
+				_jobs.erase(i);
+				_inProgress.insert(path);
+			}
+			if (batch.empty()) {
+				// Only delayed jobs are in the queue.
+				_added.wait(&_mutex, waitTill - now);
+				continue;
+			}
+		}
+		for (auto &job : batch) {
+			auto written = perform(job.second);
+			if (!written.isEmpty()) {
+				synced.push_back(written);
+			}
+		}
+
+		// One sync pass for the whole batch instead of one after each write.
+		for (auto &path : synced) {
+			_syncFile(path);
+		}
+		synced.clear();
+
+		auto now = getms();
+		QMutexLocker lock(&_mutex);
+		for (auto &job : batch) {
+			_inProgress.remove(job.first);
+			finished(job.second, now - job.second.queued);
+		}
+		DEBUG_LOG(("Local Writer Info: written %1 files, queue depth %2, average latency %3ms").arg(batch.size()).arg(_jobs.size()).arg(_stats.averageLatency));
+		batch.clear();
+		_done.wakeAll();
+	}
+}
+
+Writer::~Writer() {
+	{
+		QMutexLocker lock(&_mutex);
+		_stopped = true;
+		_added.wakeAll();
+	}
+	_thread.join();
+}
+
+std::unique_ptr<Writer> _writer;
+
+void _cancelWrite(const QString &path) {
+	if (_writer) {
+		_writer->cancel(path);
+	}
+}
+
+// Sticker sets, saved gifs and recent hashtags are read and decrypted
+// in the local loader thread after start and parsed when first needed.
+std::map<FileKey, std::unique_ptr<FileReadDescriptor>> _preloadedFiles;
+std::set<FileKey> _preloadInvalidated;
+TaskId _preloadTaskId = 0;
+TimeMs _preloadStarted = 0;
+bool _stickersAndGifsRead = false;
+
+void _invalidatePreloaded(FileKey key) {
+	_preloadedFiles.erase(key);
+	if (_preloadTaskId) {
+		_preloadInvalidated.insert(key);
+	}
+}
+
+void _writeEncrypted(const QString &name, EncryptedDescriptor &data, FileOptions options = FileOption::User | FileOption::Safe, TimeMs delay = 0) {
+	data.finish();
+	if (!_writer) {
+		FileWriteDescriptor file(name, options);
+		file.writeData(FileWriteDescriptor::prepareEncrypted(base::take(data.data)));
+		return;
+	}
+	auto job = Writer::Job();
+	job.name = name;
+	job.options = options;
+	job.data = base::take(data.data);
+	job.key = LocalKey;
+	_writer->put(std::move(job), delay);
+}
+
+void _writeEncrypted(FileKey key, EncryptedDescriptor &data, FileOptions options = FileOption::User | FileOption::Safe, TimeMs delay = 0) {
+	_invalidatePreloaded(key);
+	_writeEncrypted(toFilePart(key), data, options, delay);
+}
+
+// Fills the names of the files to try reading, the most recent one goes first.
+void _readFileNames(QString (&toTry)[2], const QString &name, FileOptions options) {
 	toTry[0] = ((options & FileOption::User) ? _userBasePath : _basePath) + name + '0';
 	if (options & FileOption::Safe) {
 		QFileInfo toTry0(toTry[0]);
@@ -344,6 +708,45 @@ bool readFile(FileReadDescriptor &result, const QString &name, FileOptions optio
 			toTry[0][toTry[0].size() - 1] = '1';
 		}
 	}
+}
+
+bool _readFileHeader(QFile &f, const QString &name, char (&magic)[tdfMagicLen], qint32 &version) {
+	// check magic
+	if (f.read(magic, tdfMagicLen) != tdfMagicLen) {
+		DEBUG_LOG(("App Info: failed to read magic from '%1'").arg(name));
+		return false;
+	}
+	if (memcmp(magic, tdfMagic, tdfMagicLen)) {
+		DEBUG_LOG(("App Info: bad magic %1 in '%2'").arg(Logs::mb(magic, tdfMagicLen).str()).arg(name));
+		return false;
+	}
+
+	// read app version
+	if (f.read((char*)&version, sizeof(version)) != sizeof(version)) {
+		DEBUG_LOG(("App Info: failed to read version from '%1'").arg(name));
+		return false;
+	}
+	if (version > AppVersion) {
+		DEBUG_LOG(("App Info: version too big %1 for '%2', my version %3").arg(version).arg(name).arg(AppVersion));
+		return false;
+	}
+	return true;
+}
+
+bool readFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe) {
+	TRACE_SCOPE("Local::readFile");
+	if (options & FileOption::User) {
+		if (!_userWorking()) return false;
+	} else {
+		if (!_working()) return false;
+	}
+	if (_writer) {
+		_writer->waitFor(_filePathBase(name, options));
+	}
+
+	// detect order of read attempts
+	QString toTry[2];
+	_readFileNames(toTry, name, options);
 	for (int32 i = 0; i < 2; ++i) {
 		QString fname(toTry[i]);
 		if (fname.isEmpty()) break;
@@ -354,25 +757,9 @@ bool readFile(FileReadDescriptor &result, const QString &name, FileOptions optio
 			continue;
 		}
 
-		// check magic
 		char magic[tdfMagicLen];
-		if (f.read(magic, tdfMagicLen) != tdfMagicLen) {
-			DEBUG_LOG(("App Info: failed to read magic from '%1'").arg(name));
-			continue;
-		}
-		if (memcmp(magic, tdfMagic, tdfMagicLen)) {
-			DEBUG_LOG(("App Info: bad magic %1 in '%2'").arg(Logs::mb(magic, tdfMagicLen).str()).arg(name));
-			continue;
-		}
-
-		// read app version
 		qint32 version;
-		if (f.read((char*)&version, sizeof(version)) != sizeof(version)) {
-			DEBUG_LOG(("App Info: failed to read version from '%1'").arg(name));
-			continue;
-		}
-		if (version > AppVersion) {
-			DEBUG_LOG(("App Info: version too big %1 for '%2', my version %3").arg(version).arg(name).arg(AppVersion));
+		if (!_readFileHeader(f, name, magic, version)) {
 			continue;
 		}
 
@@ -450,55 +837,367 @@ bool decryptLocal(EncryptedDescriptor &result, const QByteArray &encrypted, cons
 	return true;
 }
 
-bool readEncryptedFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe, const MTP::AuthKeyPtr &key = LocalKey) {
-	if (!readFile(result, name, options)) {
+constexpr auto kJournalMagic = quint32(0x4C4E524A); // "JRNL"
+constexpr auto kJournalHeaderSize = qint64(sizeof(quint32) * 2); // magic + generation
+constexpr auto kJournalMinCompactSize = qint64(64 * 1024);
+
+// Append-only log of small encrypted records on top of a fully written file.
+//
+// Each full write of the file bumps its generation and starts a new journal. The
+// journal of a generation lives in name + (generation % 2), so the journal of the
+// previous generation is kept untouched until the new full write is done: if the
+// new file did not make it to the disk the old one is read with its own journal.
+// Every record is checked by decryptLocal(), a torn tail is cut off on replay.
+class Journal {
+public:
+	static QString Path(const QString &name, quint32 generation) {
+		return _userBasePath + name + QString::number(generation % 2);
+	}
+	static void Remove(const QString &name) {
+		QFile::remove(Path(name, 0));
+		QFile::remove(Path(name, 1));
+	}
+
+	void start(const QString &name, quint32 generation) {
+		close();
+		_file.setFileName(Path(name, generation));
+		if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			LOG(("App Error: could not open journal '%1' for writing.").arg(name));
+			return;
+		}
+		_stream.setDevice(&_file);
+		_stream.setVersion(QDataStream::Qt_5_1);
+		_stream << kJournalMagic << quint32(generation);
+		if (_stream.status() != QDataStream::Ok || !_file.flush()) {
+			LOG(("App Error: could not write journal '%1' header.").arg(name));
+			close();
+		}
+	}
+
+	// Calls callback(QDataStream&) for each record, it returns false for a bad record.
+	// Leaves the journal open for appending right after the last good record.
+	template <typename Callback>
+	int replay(const QString &name, quint32 generation, Callback callback) {
+		close();
+		_file.setFileName(Path(name, generation));
+		if (!_file.exists() || !_file.open(QIODevice::ReadWrite)) {
+			start(name, generation);
+			return 0;
+		}
+		_stream.setDevice(&_file);
+		_stream.setVersion(QDataStream::Qt_5_1);
+
+		auto magic = quint32(0), written = quint32(0);
+		_stream >> magic >> written;
+		if (_stream.status() != QDataStream::Ok || magic != kJournalMagic || written != generation) {
+			start(name, generation);
+			return 0;
+		}
+
+		auto result = 0;
+		auto good = _file.pos();
+		while (!_stream.atEnd()) {
+			auto encrypted = QByteArray();
+			_stream >> encrypted;
+
+			EncryptedDescriptor record;
+			if (_stream.status() != QDataStream::Ok
+				|| !decryptLocal(record, encrypted)
+				|| !callback(record.stream)) {
+				LOG(("App Info: journal '%1' is broken after %2 records, cutting the tail.").arg(name).arg(result));
+				break;
+			}
+			good = _file.pos();
+			++result;
+		}
+		_stream.resetStatus();
+		if (good < _file.size()) {
+			_file.resize(good);
+		}
+		if (!_file.seek(good)) {
+			close();
+			return result;
+		}
+		_size = good - kJournalHeaderSize;
+		return result;
+	}
+
+	bool append(EncryptedDescriptor &data) {
+		if (!started()) {
+			return false;
+		}
+		auto encrypted = FileWriteDescriptor::prepareEncrypted(data);
+		_stream << encrypted;
+		if (_stream.status() != QDataStream::Ok || !_file.flush()) {
+			LOG(("App Error: could not append to journal '%1'.").arg(_file.fileName()));
+			close();
+			return false;
+		}
+		_size += Serialize::bytearraySize(encrypted);
+		return true;
+	}
+
+	bool started() const {
+		return _file.isOpen();
+	}
+
+	// Size of the records, without the header.
+	qint64 size() const {
+		return _size;
+	}
+
+	void close() {
+		_stream.setDevice(nullptr);
+		_file.close();
+		_size = 0;
+	}
+
+private:
+	QFile _file;
+	QDataStream _stream;
+	qint64 _size = 0;
+
+};
+
+// Reads the file by parts, checking the signature and decrypting on the fly, so that
+// only the decrypted data is kept in memory instead of the file, the encrypted part
+// and the decrypted part all at once.
+bool _readEncryptedFileParts(FileReadDescriptor &result, QFile &f, const QString &name, const MTP::AuthKeyPtr &key) {
+	char magic[tdfMagicLen];
+	qint32 version;
+	if (!_readFileHeader(f, name, magic, version)) {
 		return false;
 	}
-	QByteArray encrypted;
-	result.stream >> encrypted;
 
-	EncryptedDescriptor data;
-	if (!decryptLocal(data, encrypted, key)) {
-		result.stream.setDevice(0);
-		if (result.buffer.isOpen()) result.buffer.close();
-		result.buffer.setBuffer(0);
-		result.data = QByteArray();
-		result.version = 0;
+	auto dataSize = int32(f.size() - f.pos() - 16);
+	if (dataSize < int32(sizeof(quint32))) {
+		DEBUG_LOG(("App Info: bad file '%1', could not read sign part").arg(name));
 		return false;
 	}
 
-	result.stream.setDevice(0);
-	if (result.buffer.isOpen()) result.buffer.close();
-	result.buffer.setBuffer(0);
-	result.data = data.data;
+	// read the serialized QByteArray length and check it before reading anything else
+	HashMd5 md5;
+	uchar encryptedSizeBytes[sizeof(quint32)];
+	if (f.read(reinterpret_cast<char*>(encryptedSizeBytes), sizeof(encryptedSizeBytes)) != sizeof(encryptedSizeBytes)) {
+		DEBUG_LOG(("App Info: failed to read encrypted part size from '%1'").arg(name));
+		return false;
+	}
+	md5.feed(encryptedSizeBytes, sizeof(encryptedSizeBytes));
+	auto encryptedSize = qFromBigEndian<quint32>(encryptedSizeBytes);
+	if (encryptedSize <= 16 || (encryptedSize & 0x0F) || encryptedSize > quint32(dataSize) - sizeof(quint32)) {
+		LOG(("App Error: bad encrypted part size: %1, file '%2'").arg(encryptedSize).arg(name));
+		return false;
+	}
+
+	char encryptedKey[16];
+	if (f.read(encryptedKey, sizeof(encryptedKey)) != sizeof(encryptedKey)) {
+		DEBUG_LOG(("App Info: failed to read encrypted key from '%1'").arg(name));
+		return false;
+	}
+	md5.feed(encryptedKey, sizeof(encryptedKey));
+
+	auto fullLen = encryptedSize - 16;
+	auto decrypted = QByteArray();
+	decrypted.resize(fullLen);
+	auto part = QByteArray();
+	part.resize(qMin(quint32(kReadEncryptedPartSize), fullLen));
+
+	MTP::IGEState state;
+	aesDecryptLocalPrepare(&state, key, encryptedKey);
+	SHA_CTX sha1;
+	SHA1_Init(&sha1);
+	for (auto offset = quint32(0); offset < fullLen;) {
+		auto size = qMin(quint32(part.size()), fullLen - offset);
+		if (f.read(part.data(), size) != qint64(size)) {
+			DEBUG_LOG(("App Info: failed to read encrypted part from '%1'").arg(name));
+			return false;
+		}
+		md5.feed(part.constData(), size);
+
+		auto destination = decrypted.data() + offset;
+		MTP::aesIgeDecryptPart(part.constData(), destination, size, &state);
+		SHA1_Update(&sha1, destination, size);
+		if (!offset) {
+			// the length in the first block is the first thing that gets broken by a wrong key
+			auto dataLen = *(const uint32*)destination;
+			if (dataLen > fullLen || dataLen <= fullLen - 16 || dataLen < sizeof(uint32)) {
+				LOG(("App Info: bad decrypt key, data not decrypted - incorrect password?"));
+				return false;
+			}
+		}
+		offset += size;
+	}
+	part = QByteArray();
+
+	// the encrypted part is the only thing written to these files, but check the rest anyway
+	auto rest = f.read(dataSize - sizeof(quint32) - encryptedSize);
+	if (rest.size() != dataSize - int32(sizeof(quint32) + encryptedSize)) {
+		DEBUG_LOG(("App Info: bad file '%1', could not read sign part").arg(name));
+		return false;
+	}
+	md5.feed(rest.constData(), rest.size());
+
+	// check signature
+	char signature[16];
+	if (f.read(signature, sizeof(signature)) != sizeof(signature)) {
+		DEBUG_LOG(("App Info: bad file '%1', could not read sign part").arg(name));
+		return false;
+	}
+	md5.feed(&dataSize, sizeof(dataSize));
+	md5.feed(&version, sizeof(version));
+	md5.feed(magic, tdfMagicLen);
+	if (memcmp(md5.result(), signature, 16)) {
+		DEBUG_LOG(("App Info: bad file '%1', signature did not match").arg(name));
+		return false;
+	}
+
+	uchar sha1Buffer[20];
+	SHA1_Final(sha1Buffer, &sha1);
+	if (memcmp(sha1Buffer, encryptedKey, 16)) {
+		LOG(("App Info: bad decrypt key, data not decrypted - incorrect password?"));
+		return false;
+	}
+
+	auto dataLen = *(const uint32*)decrypted.constData();
+	decrypted.resize(dataLen);
+	result.data = std::move(decrypted);
+
+	result.version = version;
 	result.buffer.setBuffer(&result.data);
 	result.buffer.open(QIODevice::ReadOnly);
-	result.buffer.seek(data.buffer.pos());
+	result.buffer.seek(sizeof(uint32)); // skip len
 	result.stream.setDevice(&result.buffer);
 	result.stream.setVersion(QDataStream::Qt_5_1);
 
 	return true;
 }
 
+bool readEncryptedFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe, const MTP::AuthKeyPtr &key = LocalKey) {
+	if (options & FileOption::User) {
+		if (!_userWorking()) return false;
+	} else {
+		if (!_working()) return false;
+	}
+	if (_writer) {
+		_writer->waitFor(_filePathBase(name, options));
+	}
+
+	// detect order of read attempts
+	QString toTry[2];
+	_readFileNames(toTry, name, options);
+	for (int32 i = 0; i < 2; ++i) {
+		QString fname(toTry[i]);
+		if (fname.isEmpty()) break;
+
+		QFile f(fname);
+		if (!f.open(QIODevice::ReadOnly)) {
+			DEBUG_LOG(("App Info: failed to open '%1' for reading").arg(name));
+			continue;
+		}
+		if (!_readEncryptedFileParts(result, f, name, key)) {
+			continue;
+		}
+
+		if ((i == 0 && !toTry[1].isEmpty()) || i == 1) {
+			QFile::remove(toTry[1 - i]);
+		}
+
+		return true;
+	}
+	return false;
+}
+
 bool readEncryptedFile(FileReadDescriptor &result, const FileKey &fkey, FileOptions options = FileOption::User | FileOption::Safe, const MTP::AuthKeyPtr &key = LocalKey) {
 	return readEncryptedFile(result, toFilePart(fkey), options, key);
 }
 
-FileKey _dataNameKey = 0;
+void _readStickersAndGifs() {
+	_stickersAndGifsRead = true;
 
-enum { // Local Storage Keys
-	lskUserMap = 0x00,
-	lskDraft = 0x01, // data: PeerId peer
-	lskDraftPosition = 0x02, // data: PeerId peer
-	lskImages = 0x03, // data: StorageKey location
-	lskLocations = 0x04, // no data
-	lskStickerImages = 0x05, // data: StorageKey location
-	lskAudios = 0x06, // data: StorageKey location
-	lskRecentStickersOld = 0x07, // no data
-	lskBackground = 0x08, // no data
-	lskUserSettings = 0x09, // no data
-	lskRecentHashtagsAndBots = 0x0a, // no data
-	lskStickersOld = 0x0b, // no data
+	auto ms = getms();
+	readInstalledStickers();
+	readFeaturedStickers();
+	readRecentStickers();
+	readFavedStickers();
+	readSavedGifs();
+	LOG(("App Info: stickers and gifs parsed in %1ms, %2ms after start.").arg(getms() - ms).arg(ms - _preloadStarted));
+}
+
+class PreloadFilesTask : public Task {
+public:
+	PreloadFilesTask(std::vector<FileKey> &&keys) : _keys(std::move(keys)) {
+	}
+	void process() override {
+		auto ms = getms();
+		for (auto key : _keys) {
+			auto file = std::make_unique<FileReadDescriptor>();
+			if (!readEncryptedFile(*file, key)) {
+				file = nullptr;
+			}
+			_files.emplace(key, std::move(file));
+		}
+		_duration = getms() - ms;
+	}
+	void finish() override {
+		if (_preloadTaskId != id()) {
+			return; // Files were required before the task was finished.
+		}
+		_preloadTaskId = 0;
+		for (auto &file : _files) {
+			if (!_preloadInvalidated.count(file.first)) {
+				_preloadedFiles.emplace(file.first, std::move(file.second));
+			}
+		}
+		_preloadInvalidated.clear();
+		LOG(("App Info: %1 files preloaded in %2ms in background, %3ms after start.").arg(_files.size()).arg(_duration).arg(getms() - _preloadStarted));
+		if (!_stickersAndGifsRead) {
+			_readStickersAndGifs();
+		}
+	}
+
+private:
+	std::vector<FileKey> _keys;
+	std::map<FileKey, std::unique_ptr<FileReadDescriptor>> _files;
+	TimeMs _duration = 0;
+
+};
+
+// Returns the preloaded file if we have it, otherwise reads the file right now.
+bool _readPreloadedOrEncryptedFile(FileReadDescriptor &result, FileKey key) {
+	auto i = _preloadedFiles.find(key);
+	if (i == _preloadedFiles.end()) {
+		return readEncryptedFile(result, key);
+	}
+	auto file = std::move(i->second);
+	_preloadedFiles.erase(i);
+	if (!file) {
+		return false;
+	}
+	result.version = file->version;
+	result.data = file->data;
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.buffer.seek(file->buffer.pos());
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+	return true;
+}
+
+FileKey _dataNameKey = 0;
+
+enum { // Local Storage Keys
+	lskUserMap = 0x00,
+	lskDraft = 0x01, // data: PeerId peer
+	lskDraftPosition = 0x02, // data: PeerId peer
+	lskImages = 0x03, // data: StorageKey location
+	lskLocations = 0x04, // no data
+	lskStickerImages = 0x05, // data: StorageKey location
+	lskAudios = 0x06, // data: StorageKey location
+	lskRecentStickersOld = 0x07, // no data
+	lskBackground = 0x08, // no data
+	lskUserSettings = 0x09, // no data
+	lskRecentHashtagsAndBots = 0x0a, // no data
+	lskStickersOld = 0x0b, // no data
 	lskSavedPeers = 0x0c, // no data
 	lskReportSpamStatuses = 0x0d, // no data
 	lskSavedGifsOld = 0x0e, // no data
@@ -506,6 +1205,13 @@ enum { // Local Storage Keys
 	lskStickersKeys = 0x10, // no data
 	lskTrustedBots = 0x11, // no data
 	lskFavedStickers = 0x12, // no data
+	lskDownloadParts = 0x13, // no data
+	lskUploadedFiles = 0x14, // no data
+	lskHistoryMessages = 0x15, // data: PeerId peer
+	lskDialogsSnapshot = 0x16, // no data
+	lskVoiceWaveforms = 0x17, // no data
+	lskMapGeneration = 0x18, // not a file, generation of the map journal
+	lskWebPages = 0x19, // no data
 };
 
 enum {
@@ -580,6 +1286,9 @@ enum {
 	dbiLangPackKey = 0x4e,
 	dbiConnectionType = 0x4f,
 	dbiStickersFavedLimit = 0x50,
+	dbiHardwareVideoDecoding = 0x51,
+	dbiLangPackOverlayKey = 0x52,
+	dbiSpecialConfig = 0x53,
 
 	dbiEncryptedWithSalt = 333,
 	dbiEncrypted = 444,
@@ -609,10 +1318,64 @@ WebFilesMap _webFilesMap;
 uint64 _storageWebFilesSize = 0;
 FileKey _locationsKey = 0, _reportSpamStatusesKey = 0, _trustedBotsKey = 0;
 
+// Single location changes are appended to the journal of the locations file.
+enum class LocationsRecord : quint32 {
+	Added = 1,
+	Removed = 2,
+	Alias = 3,
+	WebFileAdded = 4,
+	WebFileRemoved = 5,
+};
+Journal _locationsJournal;
+quint32 _locationsGeneration = 0;
+qint64 _locationsWrittenSize = 0;
+
+QString _locationsJournalName() {
+	return toFilePart(_locationsKey) + 'j';
+}
+
 using TrustedBots = OrderedSet<uint64>;
 TrustedBots _trustedBots;
 bool _trustedBotsRead = false;
 
+// Documents downloaded straight to disk: partial file path and parts bitmap.
+struct DownloadPartsRecord {
+	QString path;
+	QByteArray parts;
+};
+FileKey _downloadPartsKey = 0;
+QMap<MediaKey, DownloadPartsRecord> _downloadParts;
+bool _downloadPartsRead = false;
+
+// Documents uploaded by us, by the md5 of their content, to send them again without uploading.
+constexpr auto kUploadedFilesLimit = 1024;
+struct UploadedFileRecord {
+	QString filename;
+	quint64 id = 0;
+	quint64 accessHash = 0;
+};
+FileKey _uploadedFilesKey = 0;
+QMap<QByteArray, UploadedFileRecord> _uploadedFiles;
+bool _uploadedFilesRead = false;
+
+// Newest messages of the histories, serialized as they were received from the server.
+constexpr auto kHistoryMessagesLimit = 50;
+constexpr auto kHistoryMessagesSizeLimit = 64 * 1024;
+struct HistoryMessageRecord {
+	QByteArray data;
+	QVector<PeerId> peers; // senders, forwarded from and via bots
+};
+struct HistoryMessagesRecord {
+	std::map<MsgId, HistoryMessageRecord> messages;
+	std::map<MsgId, HistoryMessageRecord> sending; // by local id, not written
+	int size = 0;
+	bool changed = false;
+};
+typedef QMap<PeerId, FileKey> HistoryMessagesMap;
+HistoryMessagesMap _historyMessagesMap;
+std::map<PeerId, HistoryMessagesRecord> _historyMessages; // read from disk or changed
+bool _readingHistoryMessages = false;
+
 FileKey _recentStickersKeyOld = 0;
 FileKey _installedStickersKey = 0, _featuredStickersKey = 0, _recentStickersKey = 0, _favedStickersKey = 0, _archivedStickersKey = 0;
 FileKey _savedGifsKey = 0;
@@ -631,12 +1394,45 @@ FileKey _recentHashtagsAndBotsKey = 0;
 bool _recentHashtagsAndBotsWereRead = false;
 
 FileKey _savedPeersKey = 0;
+FileKey _dialogsSnapshotKey = 0;
+
+// Waveforms counted locally for voice messages sent by older clients.
+constexpr auto kVoiceWaveformsLimit = 1024;
+FileKey _voiceWaveformsKey = 0;
+std::map<DocumentId, VoiceWaveform> _voiceWaveforms;
+bool _voiceWaveformsRead = false;
+
+// Resolved web pages, to show link previews without asking the server again.
+constexpr auto kWebPagesLimit = 512;
+constexpr auto kWebPagesTtl = TimeId(7 * 86400);
+struct WebPageRecord {
+	TimeId saved = 0;
+	QByteArray data; // serialized MTPWebPage
+};
+FileKey _webPagesKey = 0;
+std::map<WebPageId, WebPageRecord> _webPages;
+bool _webPagesRead = false;
 FileKey _langPackKey = 0;
+FileKey _langPackOverlayKey = 0;
 
 typedef QMap<StorageKey, FileDesc> StorageMap;
 StorageMap _imagesMap, _stickerImagesMap, _audiosMap;
 int32 _storageImagesSize = 0, _storageStickersSize = 0, _storageAudiosSize = 0;
 
+// Images, sticker images and audios entries change all the time, so they are
+// appended to the journal of the map, other map keys change rarely.
+enum class MapRecord : quint32 {
+	StorageAdded = 1,
+	StorageRemoved = 2,
+};
+Journal _mapJournal;
+quint32 _mapGeneration = 0;
+qint64 _mapWrittenSize = 0;
+
+// Images, stickers, audios and web files are packed in the media cache.
+// The maps above still hold the record keys and sizes, the cache holds the data.
+std::shared_ptr<Storage::MediaCache> _mediaCache;
+
 bool _mapChanged = false;
 int32 _oldMapVersion = 0, _oldSettingsVersion = 0;
 
@@ -655,6 +1451,90 @@ StoredAuthSession &GetStoredAuthSessionCache() {
 }
 
 void _writeMap(WriteMapWhen when = WriteMapWhen::Soon);
+void _openMediaCache();
+
+QString _mapJournalName() {
+	return qsl("mapj");
+}
+
+bool _journaledStorageMap(quint32 mapType, StorageMap **map, int32 **size) {
+	switch (mapType) {
+	case lskImages: *map = &_imagesMap; *size = &_storageImagesSize; return true;
+	case lskStickerImages: *map = &_stickerImagesMap; *size = &_storageStickersSize; return true;
+	case lskAudios: *map = &_audiosMap; *size = &_storageAudiosSize; return true;
+	}
+	return false;
+}
+
+bool _applyMapRecord(QDataStream &stream) {
+	quint32 type = 0, mapType = 0;
+	quint64 first, second;
+	stream >> type >> mapType >> first >> second;
+	if (!_checkStreamStatus(stream)) return false;
+
+	StorageMap *map = nullptr;
+	int32 *size = nullptr;
+	if (!_journaledStorageMap(mapType, &map, &size)) {
+		LOG(("App Error: unknown map type in map journal: %1").arg(mapType));
+		return false;
+	}
+	auto location = StorageKey(first, second);
+	switch (MapRecord(type)) {
+	case MapRecord::StorageAdded: {
+		quint64 key;
+		qint32 fileSize;
+		stream >> key >> fileSize;
+		if (!_checkStreamStatus(stream)) return false;
+
+		auto i = map->find(location);
+		if (i != map->end()) {
+			*size -= i.value().second;
+		}
+		map->insert(location, FileDesc(key, fileSize));
+		*size += fileSize;
+	} break;
+
+	case MapRecord::StorageRemoved: {
+		auto i = map->find(location);
+		if (i != map->end()) {
+			*size -= i.value().second;
+			map->erase(i);
+		}
+	} break;
+
+	default:
+		LOG(("App Error: unknown map journal record type: %1").arg(type));
+		return false;
+	}
+	return true;
+}
+
+// Appends a single images / sticker images / audios change instead of rewriting
+// the whole map. Falls back to the full (compacting) write when the journal grows.
+void _appendMapRecord(EncryptedDescriptor &data) {
+	if (!_working()) return;
+
+	auto compactSize = qMax(kJournalMinCompactSize, _mapWrittenSize);
+	if (!_mapJournal.started()
+		|| _mapJournal.size() > compactSize
+		|| !_mapJournal.append(data)) {
+		_mapChanged = true;
+		_writeMap();
+	}
+}
+
+void _appendStorageAdded(quint32 mapType, const StorageKey &location, const FileDesc &desc) {
+	EncryptedDescriptor data(sizeof(quint32) * 2 + sizeof(quint64) * 3 + sizeof(qint32));
+	data.stream << quint32(MapRecord::StorageAdded) << quint32(mapType) << quint64(location.first) << quint64(location.second);
+	data.stream << quint64(desc.first) << qint32(desc.second);
+	_appendMapRecord(data);
+}
+
+void _appendStorageRemoved(quint32 mapType, const StorageKey &location) {
+	EncryptedDescriptor data(sizeof(quint32) * 2 + sizeof(quint64) * 2);
+	data.stream << quint32(MapRecord::StorageRemoved) << quint32(mapType) << quint64(location.first) << quint64(location.second);
+	_appendMapRecord(data);
+}
 
 void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 	if (when != WriteMapWhen::Now) {
@@ -666,6 +1546,8 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 	_manager->writingLocations();
 	if (_fileLocations.isEmpty() && _webFilesMap.isEmpty()) {
 		if (_locationsKey) {
+			_locationsJournal.close();
+			Journal::Remove(_locationsJournalName());
 			clearKey(_locationsKey);
 			_locationsKey = 0;
 			_mapChanged = true;
@@ -708,6 +1590,8 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 			size += Serialize::stringSize(i.key()) + sizeof(quint64) + sizeof(qint32);
 		}
 
+		size += sizeof(quint32); // generation
+
 		EncryptedDescriptor data(size);
 		auto legacyTypeField = 0;
 		for (FileLocations::const_iterator i = _fileLocations.cbegin(); i != _fileLocations.cend(); ++i) {
@@ -734,11 +1618,135 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 			data.stream << i.key() << quint64(i.value().first) << qint32(i.value().second);
 		}
 
-		FileWriteDescriptor file(_locationsKey);
-		file.writeEncrypted(data);
+		data.stream << quint32(++_locationsGeneration);
+
+		_writeEncrypted(_locationsKey, data);
+		_locationsJournal.start(_locationsJournalName(), _locationsGeneration);
+		_locationsWrittenSize = size;
+	}
+}
+
+bool _applyLocationsRecord(QDataStream &stream) {
+	quint32 type = 0;
+	stream >> type;
+	switch (LocationsRecord(type)) {
+	case LocationsRecord::Added: {
+		quint64 first, second;
+		QByteArray bookmark;
+		FileLocation loc;
+		stream >> first >> second >> loc.fname >> bookmark >> loc.modified >> loc.size;
+		if (!_checkStreamStatus(stream)) return false;
+
+		loc.setBookmark(bookmark);
+		auto key = MediaKey(first, second);
+		_fileLocations.insert(key, loc);
+		_fileLocationPairs.insert(loc.fname, FileLocationPair(key, loc));
+	} break;
+
+	case LocationsRecord::Removed: {
+		quint64 first, second;
+		QString fname;
+		stream >> first >> second >> fname;
+		if (!_checkStreamStatus(stream)) return false;
+
+		auto key = MediaKey(first, second);
+		for (auto i = _fileLocations.find(key); (i != _fileLocations.end()) && (i.key() == key); ++i) {
+			if (i.value().fname == fname) {
+				_fileLocations.erase(i);
+				break;
+			}
+		}
+		auto i = _fileLocationPairs.find(fname);
+		if (i != _fileLocationPairs.end() && i.value().first == key) {
+			_fileLocationPairs.erase(i);
+		}
+	} break;
+
+	case LocationsRecord::Alias: {
+		quint64 kfirst, ksecond, vfirst, vsecond;
+		stream >> kfirst >> ksecond >> vfirst >> vsecond;
+		if (!_checkStreamStatus(stream)) return false;
+
+		_fileLocationAliases.insert(MediaKey(kfirst, ksecond), MediaKey(vfirst, vsecond));
+	} break;
+
+	case LocationsRecord::WebFileAdded: {
+		QString url;
+		quint64 key;
+		qint32 size;
+		stream >> url >> key >> size;
+		if (!_checkStreamStatus(stream)) return false;
+
+		auto i = _webFilesMap.find(url);
+		if (i != _webFilesMap.end()) {
+			_storageWebFilesSize -= i.value().second;
+		}
+		_webFilesMap.insert(url, FileDesc(key, size));
+		_storageWebFilesSize += size;
+	} break;
+
+	case LocationsRecord::WebFileRemoved: {
+		QString url;
+		stream >> url;
+		if (!_checkStreamStatus(stream)) return false;
+
+		auto i = _webFilesMap.find(url);
+		if (i != _webFilesMap.end()) {
+			_storageWebFilesSize -= i.value().second;
+			_webFilesMap.erase(i);
+		}
+	} break;
+
+	default:
+		LOG(("App Error: unknown locations journal record type: %1").arg(type));
+		return false;
+	}
+	return true;
+}
+
+// Appends a single change instead of rewriting the whole locations file.
+// Falls back to the full (compacting) write when the journal grows too big.
+void _appendLocationsRecord(EncryptedDescriptor &data) {
+	if (!_working()) return;
+
+	auto compactSize = qMax(kJournalMinCompactSize, _locationsWrittenSize);
+	if (!_locationsJournal.started()
+		|| _locationsJournal.size() > compactSize
+		|| !_locationsJournal.append(data)) {
+		_writeLocations(WriteMapWhen::Fast);
 	}
 }
 
+void _appendLocationAdded(const MediaKey &location, const FileLocation &local) {
+	EncryptedDescriptor data(sizeof(quint32) + sizeof(quint64) * 2 + Serialize::stringSize(local.name()) + Serialize::bytearraySize(local.bookmark()) + Serialize::dateTimeSize() + sizeof(qint32));
+	data.stream << quint32(LocationsRecord::Added) << quint64(location.first) << quint64(location.second) << local.name() << local.bookmark() << local.modified << qint32(local.size);
+	_appendLocationsRecord(data);
+}
+
+void _appendLocationRemoved(const MediaKey &location, const QString &fname) {
+	EncryptedDescriptor data(sizeof(quint32) + sizeof(quint64) * 2 + Serialize::stringSize(fname));
+	data.stream << quint32(LocationsRecord::Removed) << quint64(location.first) << quint64(location.second) << fname;
+	_appendLocationsRecord(data);
+}
+
+void _appendLocationAlias(const MediaKey &alias, const MediaKey &location) {
+	EncryptedDescriptor data(sizeof(quint32) + sizeof(quint64) * 4);
+	data.stream << quint32(LocationsRecord::Alias) << quint64(alias.first) << quint64(alias.second) << quint64(location.first) << quint64(location.second);
+	_appendLocationsRecord(data);
+}
+
+void _appendWebFileAdded(const QString &url, const FileDesc &desc) {
+	EncryptedDescriptor data(sizeof(quint32) + Serialize::stringSize(url) + sizeof(quint64) + sizeof(qint32));
+	data.stream << quint32(LocationsRecord::WebFileAdded) << url << quint64(desc.first) << qint32(desc.second);
+	_appendLocationsRecord(data);
+}
+
+void _appendWebFileRemoved(const QString &url) {
+	EncryptedDescriptor data(sizeof(quint32) + Serialize::stringSize(url));
+	data.stream << quint32(LocationsRecord::WebFileRemoved) << url;
+	_appendLocationsRecord(data);
+}
+
 void _readLocations() {
 	FileReadDescriptor locations;
 	if (!readEncryptedFile(locations, _locationsKey)) {
@@ -795,6 +1803,18 @@ void _readLocations() {
 				_webFilesMap.insert(url, FileDesc(key, size));
 				_storageWebFilesSize += size;
 			}
+
+			if (!locations.stream.atEnd()) {
+				locations.stream >> _locationsGeneration;
+			}
+		}
+	}
+
+	if (_locationsGeneration) {
+		_locationsWrittenSize = locations.data.size();
+		auto replayed = _locationsJournal.replay(_locationsJournalName(), _locationsGeneration, _applyLocationsRecord);
+		if (replayed > 0) {
+			LOG(("App Info: replayed %1 locations journal records.").arg(replayed));
 		}
 	}
 }
@@ -829,8 +1849,7 @@ void _writeReportSpamStatuses() {
 			data.stream << quint64(i.key()) << qint32(i.value());
 		}
 
-		FileWriteDescriptor file(_reportSpamStatusesKey);
-		file.writeEncrypted(data);
+		_writeEncrypted(_reportSpamStatusesKey, data);
 	}
 }
 
@@ -899,6 +1918,14 @@ bool _readSetting(quint32 blockId, QDataStream &stream, int version, ReadSetting
 		context.dcOptions.constructFromSerialized(serialized);
 	} break;
 
+	case dbiSpecialConfig: {
+		auto serialized = QByteArray();
+		stream >> serialized;
+		if (!_checkStreamStatus(stream)) return false;
+
+		Global::SetSpecialConfig(serialized);
+	} break;
+
 	case dbiChatSizeMax: {
 		qint32 maxSize;
 		stream >> maxSize;
@@ -999,6 +2026,14 @@ bool _readSetting(quint32 blockId, QDataStream &stream, int version, ReadSetting
 		cSetUseExternalVideoPlayer(v == 1);
 	} break;
 
+	case dbiHardwareVideoDecoding: {
+		qint32 v;
+		stream >> v;
+		if (!_checkStreamStatus(stream)) return false;
+
+		cSetHardwareVideoDecoding(v == 1);
+	} break;
+
 	case dbiSoundNotify: {
 		qint32 v;
 		stream >> v;
@@ -1209,6 +2244,14 @@ bool _readSetting(quint32 blockId, QDataStream &stream, int version, ReadSetting
 		_langPackKey = langPackKey;
 	} break;
 
+	case dbiLangPackOverlayKey: {
+		quint64 langPackOverlayKey = 0;
+		stream >> langPackOverlayKey;
+		if (!_checkStreamStatus(stream)) return false;
+
+		_langPackOverlayKey = langPackOverlayKey;
+	} break;
+
 	case dbiTryIPv6: {
 		qint32 v;
 		stream >> v;
@@ -1779,7 +2822,7 @@ void _writeUserSettings() {
 		return Window::Controller::kDefaultDialogsWidthRatio;
 	};
 
-	uint32 size = 21 * (sizeof(quint32) + sizeof(qint32));
+	uint32 size = 22 * (sizeof(quint32) + sizeof(qint32));
 	size += sizeof(quint32) + Serialize::stringSize(Global::AskDownloadPath() ? QString() : Global::DownloadPath()) + Serialize::bytearraySize(Global::AskDownloadPath() ? QByteArray() : Global::DownloadPathBookmark());
 
 	size += sizeof(quint32) + sizeof(qint32);
@@ -1824,6 +2867,7 @@ void _writeUserSettings() {
 	data.stream << quint32(dbiAutoPlay) << qint32(cAutoPlayGif() ? 1 : 0);
 	data.stream << quint32(dbiDialogsWidthRatio) << qint32(snap(qRound(dialogsWidthRatio() * 1000000), 0, 1000000));
 	data.stream << quint32(dbiUseExternalVideoPlayer) << qint32(cUseExternalVideoPlayer());
+	data.stream << quint32(dbiHardwareVideoDecoding) << qint32(cHardwareVideoDecoding() ? 1 : 0);
 	if (!userData.isEmpty()) {
 		data.stream << quint32(dbiAuthSessionData) << userData;
 	}
@@ -1846,8 +2890,7 @@ void _writeUserSettings() {
 		data.stream << quint32(dbiHiddenPinnedMessages) << Global::HiddenPinnedMessages();
 	}
 
-	FileWriteDescriptor file(_userSettingsKey);
-	file.writeEncrypted(data);
+	_writeEncrypted(_userSettingsKey, data);
 }
 
 void _readUserSettings() {
@@ -1927,13 +2970,34 @@ void _readMtpData() {
 	applyReadContext(std::move(context));
 }
 
-ReadMapState _readMap(const QByteArray &pass) {
-	auto ms = getms();
+void _prepareUserBasePath() {
 	QByteArray dataNameUtf8 = (cDataFile() + (cTestMode() ? qsl(":/test/") : QString())).toUtf8();
 	FileKey dataNameHash[2];
 	hashMd5(dataNameUtf8.constData(), dataNameUtf8.size(), dataNameHash);
 	_dataNameKey = dataNameHash[0];
 	_userBasePath = _basePath + toFilePart(_dataNameKey) + QChar('/');
+}
+
+// Returns an empty salt if the map can't be read, _readMap() will fail then.
+QByteArray _readMapSalt() {
+	_prepareUserBasePath();
+
+	FileReadDescriptor mapData;
+	if (!readFile(mapData, qsl("map"))) {
+		return QByteArray();
+	}
+	QByteArray salt;
+	mapData.stream >> salt;
+	if (!_checkStreamStatus(mapData.stream) || salt.size() != LocalEncryptSaltSize) {
+		return QByteArray();
+	}
+	return salt;
+}
+
+// If passKey is provided it must be derived from the pass and the map salt.
+ReadMapState _readMap(const QByteArray &pass, const MTP::AuthKeyPtr &passKey = nullptr, const QByteArray &passKeySalt = QByteArray()) {
+	auto ms = getms();
+	_prepareUserBasePath();
 
 	FileReadDescriptor mapData;
 	if (!readFile(mapData, qsl("map"))) {
@@ -1951,7 +3015,11 @@ ReadMapState _readMap(const QByteArray &pass) {
 		LOG(("App Error: bad salt in map file, size: %1").arg(salt.size()));
 		return ReadMapFailed;
 	}
-	createLocalKey(pass, &salt, &PassKey);
+	if (passKey && passKeySalt == salt) {
+		PassKey = passKey;
+	} else {
+		createLocalKey(pass, &salt, &PassKey);
+	}
 
 	EncryptedDescriptor keyData, map;
 	if (!decryptLocal(keyData, keyEncrypted, PassKey)) {
@@ -1976,13 +3044,18 @@ ReadMapState _readMap(const QByteArray &pass) {
 
 	DraftsMap draftsMap, draftCursorsMap;
 	DraftsNotReadMap draftsNotReadMap;
+	HistoryMessagesMap historyMessagesMap;
 	StorageMap imagesMap, stickerImagesMap, audiosMap;
 	qint64 storageImagesSize = 0, storageStickersSize = 0, storageAudiosSize = 0;
-	quint64 locationsKey = 0, reportSpamStatusesKey = 0, trustedBotsKey = 0;
+	quint64 locationsKey = 0, reportSpamStatusesKey = 0, trustedBotsKey = 0, downloadPartsKey = 0, uploadedFilesKey = 0;
 	quint64 recentStickersKeyOld = 0;
 	quint64 installedStickersKey = 0, featuredStickersKey = 0, recentStickersKey = 0, favedStickersKey = 0, archivedStickersKey = 0;
 	quint64 savedGifsKey = 0;
 	quint64 backgroundKey = 0, userSettingsKey = 0, recentHashtagsAndBotsKey = 0, savedPeersKey = 0;
+	quint64 dialogsSnapshotKey = 0;
+	quint64 voiceWaveformsKey = 0;
+	quint64 webPagesKey = 0;
+	quint32 mapGeneration = 0;
 	while (!map.stream.atEnd()) {
 		quint32 keyType;
 		map.stream >> keyType;
@@ -2008,6 +3081,16 @@ ReadMapState _readMap(const QByteArray &pass) {
 				draftCursorsMap.insert(p, key);
 			}
 		} break;
+		case lskHistoryMessages: {
+			quint32 count = 0;
+			map.stream >> count;
+			for (quint32 i = 0; i < count; ++i) {
+				FileKey key;
+				quint64 p;
+				map.stream >> key >> p;
+				historyMessagesMap.insert(p, key);
+			}
+		} break;
 		case lskImages: {
 			quint32 count = 0;
 			map.stream >> count;
@@ -2053,6 +3136,12 @@ ReadMapState _readMap(const QByteArray &pass) {
 		case lskTrustedBots: {
 			map.stream >> trustedBotsKey;
 		} break;
+		case lskDownloadParts: {
+			map.stream >> downloadPartsKey;
+		} break;
+		case lskUploadedFiles: {
+			map.stream >> uploadedFilesKey;
+		} break;
 		case lskRecentStickersOld: {
 			map.stream >> recentStickersKeyOld;
 		} break;
@@ -2084,6 +3173,18 @@ ReadMapState _readMap(const QByteArray &pass) {
 		case lskSavedPeers: {
 			map.stream >> savedPeersKey;
 		} break;
+		case lskDialogsSnapshot: {
+			map.stream >> dialogsSnapshotKey;
+		} break;
+		case lskVoiceWaveforms: {
+			map.stream >> voiceWaveformsKey;
+		} break;
+		case lskMapGeneration: {
+			map.stream >> mapGeneration;
+		} break;
+		case lskWebPages: {
+			map.stream >> webPagesKey;
+		} break;
 		default:
 		LOG(("App Error: unknown key type in encrypted map: %1").arg(keyType));
 		return ReadMapFailed;
@@ -2096,6 +3197,7 @@ ReadMapState _readMap(const QByteArray &pass) {
 	_draftsMap = draftsMap;
 	_draftCursorsMap = draftCursorsMap;
 	_draftsNotReadMap = draftsNotReadMap;
+	_historyMessagesMap = historyMessagesMap;
 
 	_imagesMap = imagesMap;
 	_storageImagesSize = storageImagesSize;
@@ -2104,9 +3206,20 @@ ReadMapState _readMap(const QByteArray &pass) {
 	_audiosMap = audiosMap;
 	_storageAudiosSize = storageAudiosSize;
 
+	_mapGeneration = mapGeneration;
+	_mapWrittenSize = mapEncrypted.size();
+	if (_mapGeneration) {
+		auto replayed = _mapJournal.replay(_mapJournalName(), _mapGeneration, _applyMapRecord);
+		if (replayed > 0) {
+			LOG(("App Info: replayed %1 map journal records.").arg(replayed));
+		}
+	}
+
 	_locationsKey = locationsKey;
 	_reportSpamStatusesKey = reportSpamStatusesKey;
 	_trustedBotsKey = trustedBotsKey;
+	_downloadPartsKey = downloadPartsKey;
+	_uploadedFilesKey = uploadedFilesKey;
 	_recentStickersKeyOld = recentStickersKeyOld;
 	_installedStickersKey = installedStickersKey;
 	_featuredStickersKey = featuredStickersKey;
@@ -2115,10 +3228,14 @@ ReadMapState _readMap(const QByteArray &pass) {
 	_archivedStickersKey = archivedStickersKey;
 	_savedGifsKey = savedGifsKey;
 	_savedPeersKey = savedPeersKey;
+	_dialogsSnapshotKey = dialogsSnapshotKey;
+	_voiceWaveformsKey = voiceWaveformsKey;
+	_webPagesKey = webPagesKey;
 	_backgroundKey = backgroundKey;
 	_userSettingsKey = userSettingsKey;
 	_recentHashtagsAndBotsKey = recentHashtagsAndBotsKey;
 	_oldMapVersion = mapData.version;
+	_openMediaCache();
 	if (_oldMapVersion < AppVersion) {
 		_mapChanged = true;
 		_writeMap();
@@ -2180,12 +3297,15 @@ void _writeMap(WriteMapWhen when) {
 	uint32 mapSize = 0;
 	if (!_draftsMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _draftsMap.size() * sizeof(quint64) * 2;
 	if (!_draftCursorsMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _draftCursorsMap.size() * sizeof(quint64) * 2;
+	if (!_historyMessagesMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _historyMessagesMap.size() * sizeof(quint64) * 2;
 	if (!_imagesMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _imagesMap.size() * (sizeof(quint64) * 3 + sizeof(qint32));
 	if (!_stickerImagesMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _stickerImagesMap.size() * (sizeof(quint64) * 3 + sizeof(qint32));
 	if (!_audiosMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _audiosMap.size() * (sizeof(quint64) * 3 + sizeof(qint32));
 	if (_locationsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_reportSpamStatusesKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_trustedBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_downloadPartsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_uploadedFilesKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_recentStickersKeyOld) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_installedStickersKey || _featuredStickersKey || _recentStickersKey || _archivedStickersKey) {
 		mapSize += sizeof(quint32) + 4 * sizeof(quint64);
@@ -2193,9 +3313,13 @@ void _writeMap(WriteMapWhen when) {
 	if (_favedStickersKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_savedGifsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_savedPeersKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_dialogsSnapshotKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_voiceWaveformsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_webPagesKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_backgroundKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_userSettingsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_recentHashtagsAndBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	mapSize += sizeof(quint32) * 2; // generation
 	EncryptedDescriptor mapData(mapSize);
 	if (!_draftsMap.isEmpty()) {
 		mapData.stream << quint32(lskDraft) << quint32(_draftsMap.size());
@@ -2209,6 +3333,12 @@ void _writeMap(WriteMapWhen when) {
 			mapData.stream << quint64(i.value()) << quint64(i.key());
 		}
 	}
+	if (!_historyMessagesMap.isEmpty()) {
+		mapData.stream << quint32(lskHistoryMessages) << quint32(_historyMessagesMap.size());
+		for (auto i = _historyMessagesMap.cbegin(), e = _historyMessagesMap.cend(); i != e; ++i) {
+			mapData.stream << quint64(i.value()) << quint64(i.key());
+		}
+	}
 	if (!_imagesMap.isEmpty()) {
 		mapData.stream << quint32(lskImages) << quint32(_imagesMap.size());
 		for (StorageMap::const_iterator i = _imagesMap.cbegin(), e = _imagesMap.cend(); i != e; ++i) {
@@ -2236,6 +3366,12 @@ void _writeMap(WriteMapWhen when) {
 	if (_trustedBotsKey) {
 		mapData.stream << quint32(lskTrustedBots) << quint64(_trustedBotsKey);
 	}
+	if (_downloadPartsKey) {
+		mapData.stream << quint32(lskDownloadParts) << quint64(_downloadPartsKey);
+	}
+	if (_uploadedFilesKey) {
+		mapData.stream << quint32(lskUploadedFiles) << quint64(_uploadedFilesKey);
+	}
 	if (_recentStickersKeyOld) {
 		mapData.stream << quint32(lskRecentStickersOld) << quint64(_recentStickersKeyOld);
 	}
@@ -2252,6 +3388,15 @@ void _writeMap(WriteMapWhen when) {
 	if (_savedPeersKey) {
 		mapData.stream << quint32(lskSavedPeers) << quint64(_savedPeersKey);
 	}
+	if (_dialogsSnapshotKey) {
+		mapData.stream << quint32(lskDialogsSnapshot) << quint64(_dialogsSnapshotKey);
+	}
+	if (_voiceWaveformsKey) {
+		mapData.stream << quint32(lskVoiceWaveforms) << quint64(_voiceWaveformsKey);
+	}
+	if (_webPagesKey) {
+		mapData.stream << quint32(lskWebPages) << quint64(_webPagesKey);
+	}
 	if (_backgroundKey) {
 		mapData.stream << quint32(lskBackground) << quint64(_backgroundKey);
 	}
@@ -2261,9 +3406,21 @@ void _writeMap(WriteMapWhen when) {
 	if (_recentHashtagsAndBotsKey) {
 		mapData.stream << quint32(lskRecentHashtagsAndBots) << quint64(_recentHashtagsAndBotsKey);
 	}
+	mapData.stream << quint32(lskMapGeneration) << quint32(++_mapGeneration);
 	map.writeEncrypted(mapData);
+	map.finish();
+
+	// The new journal may be started only when the map of its generation is written.
+	_mapJournal.start(_mapJournalName(), _mapGeneration);
+	_mapWrittenSize = mapSize;
 
 	_mapChanged = false;
+
+	if (_mediaCache) {
+		_mediaCache->writeIndex();
+	} else {
+		_openMediaCache();
+	}
 }
 
 } // namespace
@@ -2272,20 +3429,49 @@ void finish() {
 	if (_manager) {
 		_writeMap(WriteMapWhen::Now);
 		_manager->finish();
+		if (_writer) {
+			_writer->flush();
+			auto stats = _writer->stats();
+			LOG(("Local Writer Info: %1 files written, %2 writes collapsed, %3 written in place, max queue depth %4, average latency %5ms, max latency %6ms").arg(stats.written).arg(stats.coalesced).arg(stats.overflowed).arg(stats.maxQueueDepth).arg(stats.averageLatency).arg(stats.maxLatency));
+		}
 		_manager->deleteLater();
 		_manager = 0;
 		delete base::take(_localLoader);
+		delete base::take(_waveformCounter);
+		_writer = nullptr;
 	}
+	_mediaCache = nullptr;
+	MemoryStats::ClearProvider(MemoryStats::Kind::LocalCaches);
 }
 
 void readTheme();
 void readLangPack();
 
+MemoryStats::Usage _memoryUsage() {
+	auto result = MemoryStats::Usage();
+	auto add = [&result](int count, int64 entryBytes) {
+		result.count += count;
+		result.bytes += count * entryBytes;
+	};
+	add(_imagesMap.size() + _stickerImagesMap.size() + _audiosMap.size(), sizeof(StorageKey) + sizeof(FileDesc));
+	add(_webFilesMap.size(), sizeof(QString) + sizeof(FileDesc));
+	add(_fileLocations.size(), sizeof(MediaKey) + sizeof(FileLocation));
+	add(_fileLocationPairs.size(), sizeof(QString) + sizeof(FileLocationPair));
+	if (_mediaCache) {
+		result.count += _mediaCache->count();
+		result.bytes += _mediaCache->indexBytes();
+	}
+	return result;
+}
+
 void start() {
 	Expects(!_manager);
 
 	_manager = new internal::Manager();
+	MemoryStats::SetProvider(MemoryStats::Kind::LocalCaches, [] { return _memoryUsage(); });
 	_localLoader = new TaskQueue(0, FileLoaderQueueStopTimeout);
+	_waveformCounter = new TaskQueue(0, FileLoaderQueueStopTimeout, 1, QThread::LowPriority);
+	_writer = std::make_unique<Writer>(_manager);
 
 	_basePath = cWorkingDir() + qsl("tdata/");
 	if (!QDir().exists(_basePath)) QDir().mkpath(_basePath);
@@ -2336,8 +3522,11 @@ void start() {
 	_oldSettingsVersion = settingsData.version;
 	_settingsSalt = salt;
 
+	StartupTimeline::Mark("Settings read");
 	readTheme();
+	StartupTimeline::Mark("Theme read");
 	readLangPack();
+	StartupTimeline::Mark("Lang pack read");
 
 	applyReadContext(std::move(context));
 }
@@ -2362,6 +3551,9 @@ void writeSettings() {
 
 	quint32 size = 12 * (sizeof(quint32) + sizeof(qint32));
 	size += sizeof(quint32) + Serialize::bytearraySize(dcOptionsSerialized);
+	if (!Global::SpecialConfig().isEmpty()) {
+		size += sizeof(quint32) + Serialize::bytearraySize(Global::SpecialConfig());
+	}
 
 	auto &proxy = Global::ConnectionProxy();
 	size += sizeof(quint32) + sizeof(qint32) + sizeof(qint32);
@@ -2373,6 +3565,9 @@ void writeSettings() {
 	if (_langPackKey) {
 		size += sizeof(quint32) + sizeof(quint64);
 	}
+	if (_langPackOverlayKey) {
+		size += sizeof(quint32) + sizeof(quint64);
+	}
 	size += sizeof(quint32) + sizeof(qint32) * 8;
 
 	EncryptedDescriptor data(size);
@@ -2390,6 +3585,9 @@ void writeSettings() {
 	data.stream << quint32(dbiLastUpdateCheck) << qint32(cLastUpdateCheck());
 	data.stream << quint32(dbiScale) << qint32(cConfigScale());
 	data.stream << quint32(dbiDcOptions) << dcOptionsSerialized;
+	if (!Global::SpecialConfig().isEmpty()) {
+		data.stream << quint32(dbiSpecialConfig) << Global::SpecialConfig();
+	}
 
 	data.stream << quint32(dbiConnectionType) << qint32(Global::ConnectionType()) << qint32(Global::LastProxyType());
 	data.stream << proxy.host << qint32(proxy.port) << proxy.user << proxy.password;
@@ -2401,6 +3599,9 @@ void writeSettings() {
 	if (_langPackKey) {
 		data.stream << quint32(dbiLangPackKey) << quint64(_langPackKey);
 	}
+	if (_langPackOverlayKey) {
+		data.stream << quint32(dbiLangPackOverlayKey) << quint64(_langPackOverlayKey);
+	}
 
 	auto position = cWindowPos();
 	data.stream << quint32(dbiWindowPosition) << qint32(position.x) << qint32(position.y) << qint32(position.w) << qint32(position.h);
@@ -2423,10 +3624,18 @@ void reset() {
 	if (_localLoader) {
 		_localLoader->stop();
 	}
+	if (_waveformCounter) {
+		_waveformCounter->stop();
+	}
+	if (_writer) {
+		_writer->clear();
+	}
 
 	_passKeySalt.clear(); // reset passcode, local key
 	_draftsMap.clear();
 	_draftCursorsMap.clear();
+	_historyMessagesMap.clear();
+	_historyMessages.clear();
 	_fileLocations.clear();
 	_fileLocationPairs.clear();
 	_fileLocationAliases.clear();
@@ -2438,11 +3647,35 @@ void reset() {
 	_webFilesMap.clear();
 	_storageWebFilesSize = 0;
 	_locationsKey = _reportSpamStatusesKey = _trustedBotsKey = 0;
+	_locationsJournal.close();
+	_locationsGeneration = 0;
+	_locationsWrittenSize = 0;
+	_mapJournal.close();
+	_mapGeneration = 0;
+	_mapWrittenSize = 0;
+	_downloadPartsKey = 0;
+	_downloadParts.clear();
+	_downloadPartsRead = false;
+	_uploadedFilesKey = 0;
+	_uploadedFiles.clear();
+	_uploadedFilesRead = false;
 	_recentStickersKeyOld = 0;
 	_installedStickersKey = _featuredStickersKey = _recentStickersKey = _favedStickersKey = _archivedStickersKey = 0;
 	_savedGifsKey = 0;
 	_backgroundKey = _userSettingsKey = _recentHashtagsAndBotsKey = _savedPeersKey = 0;
+	_dialogsSnapshotKey = 0;
+	_voiceWaveformsKey = 0;
+	_voiceWaveforms.clear();
+	_voiceWaveformsRead = false;
+	_webPagesKey = 0;
+	_webPages.clear();
+	_webPagesRead = false;
 	_oldMapVersion = _oldSettingsVersion = 0;
+	_mediaCache = nullptr;
+	_preloadTaskId = 0;
+	_preloadedFiles.clear();
+	_preloadInvalidated.clear();
+	_stickersAndGifsRead = false;
 	StoredAuthSessionCache.reset();
 	_mapChanged = true;
 	_writeMap(WriteMapWhen::Now);
@@ -2450,14 +3683,8 @@ void reset() {
 	_writeMtpData();
 }
 
-bool checkPasscode(const QByteArray &passcode) {
-	auto checkKey = MTP::AuthKeyPtr();
-	createLocalKey(passcode, &_passKeySalt, &checkKey);
-	return checkKey->equals(PassKey);
-}
-
-void setPasscode(const QByteArray &passcode) {
-	createLocalKey(passcode, &_passKeySalt, &PassKey);
+void _setPassKey(const QByteArray &passcode, MTP::AuthKeyPtr key) {
+	PassKey = std::move(key);
 
 	EncryptedDescriptor passKeyData(kLocalKeySize);
 	LocalKey->write(passKeyData.stream);
@@ -2470,6 +3697,27 @@ void setPasscode(const QByteArray &passcode) {
 	Global::RefLocalPasscodeChanged().notify();
 }
 
+void checkPasscode(const QByteArray &passcode, base::lambda_once<void(bool correct)> done) {
+	createLocalKeyAsync(passcode, _passKeySalt, [done = std::move(done)](MTP::AuthKeyPtr key) mutable {
+		done(key->equals(PassKey));
+	});
+}
+
+void setPasscode(const QByteArray &passcode, base::lambda_once<void()> done) {
+	if (passcode.isEmpty()) {
+		// Without the passcode the derivation is fast.
+		auto key = MTP::AuthKeyPtr();
+		createLocalKey(passcode, &_passKeySalt, &key);
+		_setPassKey(passcode, std::move(key));
+		done();
+		return;
+	}
+	createLocalKeyAsync(passcode, _passKeySalt, [passcode, done = std::move(done)](MTP::AuthKeyPtr key) mutable {
+		_setPassKey(passcode, std::move(key));
+		done();
+	});
+}
+
 ReadMapState readMap(const QByteArray &pass) {
 	ReadMapState result = _readMap(pass);
 	if (result == ReadMapFailed) {
@@ -2479,6 +3727,22 @@ ReadMapState readMap(const QByteArray &pass) {
 	return result;
 }
 
+void readMap(const QByteArray &pass, base::lambda_once<void(ReadMapState state)> done) {
+	auto salt = _readMapSalt();
+	if (salt.isEmpty()) {
+		done(readMap(pass));
+		return;
+	}
+	createLocalKeyAsync(pass, salt, [pass, salt, done = std::move(done)](MTP::AuthKeyPtr key) mutable {
+		auto result = _readMap(pass, key, salt);
+		if (result == ReadMapFailed) {
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Now);
+		}
+		done(result);
+	});
+}
+
 int32 oldMapVersion() {
 	return _oldMapVersion;
 }
@@ -2522,8 +3786,7 @@ void writeDrafts(const PeerId &peer, const MessageDraft &localDraft, const Messa
 		data.stream << editDraft.textWithTags.text << editTags;
 		data.stream << qint32(editDraft.msgId) << qint32(editDraft.previewCancelled ? 1 : 0);
 
-		FileWriteDescriptor file(i.value());
-		file.writeEncrypted(data);
+		_writeEncrypted(i.value(), data, FileOption::User | FileOption::Safe, kDraftsWriteDelay);
 
 		_draftsNotReadMap.remove(peer);
 	}
@@ -2652,8 +3915,7 @@ void writeDraftCursors(const PeerId &peer, const MessageCursor &msgCursor, const
 		data.stream << quint64(peer) << qint32(msgCursor.position) << qint32(msgCursor.anchor) << qint32(msgCursor.scroll);
 		data.stream << qint32(editCursor.position) << qint32(editCursor.anchor) << qint32(editCursor.scroll);
 
-		FileWriteDescriptor file(i.value());
-		file.writeEncrypted(data);
+		_writeEncrypted(i.value(), data, FileOption::User | FileOption::Safe, kDraftsWriteDelay);
 	}
 }
 
@@ -2678,23 +3940,25 @@ void writeFileLocation(MediaKey location, const FileLocation &local) {
 		if (i.value().second == local) {
 			if (i.value().first != location) {
 				_fileLocationAliases.insert(location, i.value().first);
-				_writeLocations(WriteMapWhen::Fast);
+				_appendLocationAlias(location, i.value().first);
 			}
 			return;
 		}
 		if (i.value().first != location) {
-			for (FileLocations::iterator j = _fileLocations.find(i.value().first), e = _fileLocations.end(); (j != e) && (j.key() == i.value().first);) {
+			auto removed = i.value().first;
+			for (FileLocations::iterator j = _fileLocations.find(removed), e = _fileLocations.end(); (j != e) && (j.key() == removed); ++j) {
 				if (j.value() == i.value().second) {
 					_fileLocations.erase(j);
 					break;
 				}
 			}
 			_fileLocationPairs.erase(i);
+			_appendLocationRemoved(removed, local.fname);
 		}
 	}
 	_fileLocations.insert(location, local);
 	_fileLocationPairs.insert(local.fname, FileLocationPair(location, local));
-	_writeLocations(WriteMapWhen::Fast);
+	_appendLocationAdded(location, local);
 }
 
 FileLocation readFileLocation(MediaKey location, bool check) {
@@ -2707,9 +3971,10 @@ FileLocation readFileLocation(MediaKey location, bool check) {
 	for (FileLocations::iterator i = _fileLocations.find(location); (i != _fileLocations.end()) && (i.key() == location);) {
 		if (check) {
 			if (!i.value().check()) {
-				_fileLocationPairs.remove(i.value().fname);
+				auto fname = i.value().fname;
+				_fileLocationPairs.remove(fname);
 				i = _fileLocations.erase(i);
-				_writeLocations();
+				_appendLocationRemoved(location, fname);
 				continue;
 			}
 		}
@@ -2742,24 +4007,141 @@ qint32 _storageAudioSize(qint32 rawlen) {
 	return result;
 }
 
-void writeImage(const StorageKey &location, const ImagePtr &image) {
-	if (image->isNull() || !image->loaded()) return;
-	if (_imagesMap.constFind(location) != _imagesMap.cend()) return;
+class CompactMediaCacheTask : public Task {
+public:
+	CompactMediaCacheTask(std::shared_ptr<Storage::MediaCache> cache) : _cache(std::move(cache)) {
+	}
+	void process() override {
+		_cache->compact();
+	}
+	void finish() override {
+	}
 
-	image->forget();
-	writeImage(location, StorageImageSaved(image->savedData()), false);
-}
+private:
+	std::shared_ptr<Storage::MediaCache> _cache;
 
-void writeImage(const StorageKey &location, const StorageImageSaved &image, bool overwrite) {
-	if (!_working()) return;
+};
 
-	qint32 size = _storageImageSize(image.data.size());
-	StorageMap::const_iterator i = _imagesMap.constFind(location);
-	if (i == _imagesMap.cend()) {
+void _openMediaCache() {
+	if (_mediaCache || _userBasePath.isEmpty()) {
+		return;
+	}
+	auto cache = std::make_shared<Storage::MediaCache>(_userBasePath + qsl("media_cache/"), kMediaCacheSizeLimit);
+	if (cache->open()) {
+		_mediaCache = std::move(cache);
+	}
+}
+
+void _compactMediaCacheIfNeeded() {
+	if (_mediaCache && _localLoader && _mediaCache->compactionNeeded()) {
+		_localLoader->addTask(MakeShared<CompactMediaCacheTask>(_mediaCache));
+	}
+}
+
+void _forgetEvicted(const Storage::MediaCache::Keys &keys) {
+	if (keys.isEmpty()) {
+		return;
+	}
+	auto evicted = QSet<FileKey>();
+	evicted.reserve(keys.size());
+	for_const (auto key, keys) {
+		evicted.insert(key);
+	}
+	auto forget = [&evicted](quint32 mapType, StorageMap &map, int32 &size) {
+		for (auto i = map.begin(); i != map.end();) {
+			if (evicted.contains(i->first)) {
+				auto location = i.key();
+				size -= i->second;
+				i = map.erase(i);
+				_appendStorageRemoved(mapType, location);
+			} else {
+				++i;
+			}
+		}
+	};
+	forget(lskImages, _imagesMap, _storageImagesSize);
+	forget(lskStickerImages, _stickerImagesMap, _storageStickersSize);
+	forget(lskAudios, _audiosMap, _storageAudiosSize);
+	for (auto i = _webFilesMap.begin(); i != _webFilesMap.end();) {
+		if (evicted.contains(i->first)) {
+			auto url = i.key();
+			_storageWebFilesSize -= i->second;
+			i = _webFilesMap.erase(i);
+			_appendWebFileRemoved(url);
+		} else {
+			++i;
+		}
+	}
+}
+
+void _writeCachedRecord(FileKey key, EncryptedDescriptor &data) {
+	if (!_mediaCache) {
+		_writeEncrypted(key, data, FileOption::User);
+	} else if (!_writer) {
+		_forgetEvicted(_mediaCache->put(key, FileWriteDescriptor::prepareEncrypted(data)));
+		_compactMediaCacheIfNeeded();
+	} else {
+		data.finish();
+		auto job = Writer::Job();
+		job.name = toFilePart(key);
+		job.options = FileOption::User;
+		job.data = base::take(data.data);
+		job.key = LocalKey;
+		job.cache = _mediaCache;
+		job.cacheKey = key;
+		_writer->put(std::move(job));
+		_compactMediaCacheIfNeeded();
+	}
+}
+
+// Is executed in the local loader thread, so the cache pointer is passed explicitly.
+bool _readCachedRecord(FileReadDescriptor &result, FileKey key, const std::shared_ptr<Storage::MediaCache> &cache) {
+	if (_writer) {
+		_writer->waitFor(_filePathBase(toFilePart(key), FileOption::User));
+	}
+	auto encrypted = cache ? cache->get(key) : QByteArray();
+	if (encrypted.isEmpty()) {
+		// Records written before the media cache was introduced are kept in separate files.
+		return readEncryptedFile(result, key, FileOption::User);
+	}
+	EncryptedDescriptor data;
+	if (!decryptLocal(data, encrypted)) {
+		return false;
+	}
+	result.version = AppVersion;
+	result.data = data.data;
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.buffer.seek(data.buffer.pos());
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+	return true;
+}
+
+void _clearCachedRecord(FileKey key) {
+	clearKey(key, FileOption::User);
+	if (_mediaCache) {
+		_mediaCache->remove(key);
+	}
+}
+
+void writeImage(const StorageKey &location, const ImagePtr &image) {
+	if (image->isNull() || !image->loaded()) return;
+	if (_imagesMap.constFind(location) != _imagesMap.cend()) return;
+
+	image->forget();
+	writeImage(location, StorageImageSaved(image->savedData()), false);
+}
+
+void writeImage(const StorageKey &location, const StorageImageSaved &image, bool overwrite) {
+	if (!_working()) return;
+
+	qint32 size = _storageImageSize(image.data.size());
+	StorageMap::const_iterator i = _imagesMap.constFind(location);
+	if (i == _imagesMap.cend()) {
 		i = _imagesMap.insert(location, FileDesc(genKey(FileOption::User), size));
 		_storageImagesSize += size;
-		_mapChanged = true;
-		_writeMap();
+		_appendStorageAdded(lskImages, location, i.value());
 	} else if (!overwrite) {
 		return;
 	}
@@ -2769,24 +4151,24 @@ void writeImage(const StorageKey &location, const StorageImageSaved &image, bool
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + image.data.size());
 	data.stream << quint64(location.first) << quint64(location.second) << quint32(legacyTypeField) << image.data;
 
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	auto key = i.value().first;
 	if (i.value().second != size) {
 		_storageImagesSize += size;
 		_storageImagesSize -= i.value().second;
 		_imagesMap[location].second = size;
 	}
+	_writeCachedRecord(key, data);
 }
 
 class AbstractCachedLoadTask : public Task {
 public:
 
 	AbstractCachedLoadTask(const FileKey &key, const StorageKey &location, bool readImageFlag, mtpFileLoader *loader) :
-		_key(key), _location(location), _readImageFlag(readImageFlag), _loader(loader), _result(0) {
+		_key(key), _location(location), _readImageFlag(readImageFlag), _cache(_mediaCache), _loader(loader), _result(0) {
 	}
 	void process() {
 		FileReadDescriptor image;
-		if (!readEncryptedFile(image, _key, FileOption::User)) {
+		if (!_readCachedRecord(image, _key, _cache)) {
 			return;
 		}
 
@@ -2820,6 +4202,7 @@ protected:
 	FileKey _key;
 	StorageKey _location;
 	bool _readImageFlag;
+	std::shared_ptr<Storage::MediaCache> _cache;
 	struct Result {
 		Result(const QByteArray &data, bool readImageFlag) : image(data) {
 			if (readImageFlag) {
@@ -2852,7 +4235,7 @@ public:
 	void clearInMap() override {
 		StorageMap::iterator j = _imagesMap.find(_location);
 		if (j != _imagesMap.cend() && j->first == _key) {
-			clearKey(_key, FileOption::User);
+			_clearCachedRecord(_key);
 			_storageImagesSize -= j->second;
 			_imagesMap.erase(j);
 		}
@@ -2875,6 +4258,82 @@ qint64 storageImagesSize() {
 	return _storageImagesSize;
 }
 
+StorageKey videoPosterKey(DocumentId document) {
+	// The high part never matches the mediaKey() of a photo,
+	// so posters share the images map, its size and clearing.
+	constexpr auto kPosterTag = int32(0x504F5354);
+	return StorageKey(mediaMix32To64(kPosterTag, qMin(cIntRetinaFactor(), 0xFF)), document);
+}
+
+void writeVideoPoster(const StorageKey &key, const QImage &poster) {
+	if (!_working() || poster.isNull()) return;
+
+	auto bytes = QByteArray();
+	{
+		QBuffer buffer(&bytes);
+		poster.save(&buffer, "JPG", 87);
+	}
+	if (!bytes.isEmpty()) {
+		writeImage(key, StorageImageSaved(bytes), true);
+	}
+}
+
+class VideoPosterLoadTask : public Task {
+public:
+	VideoPosterLoadTask(const FileKey &key, const StorageKey &location, base::lambda<void(QImage &&poster)> done)
+		: _key(key)
+		, _location(location)
+		, _cache(_mediaCache)
+		, _done(std::move(done)) {
+	}
+	void process() override {
+		FileReadDescriptor poster;
+		if (!_readCachedRecord(poster, _key, _cache)) {
+			return;
+		}
+
+		quint64 first = 0, second = 0;
+		qint32 legacyTypeField = 0;
+		QByteArray bytes;
+		poster.stream >> first >> second >> legacyTypeField >> bytes;
+		if (poster.stream.status() != QDataStream::Ok || bytes.isEmpty()) {
+			return;
+		}
+		_result = App::readImage(bytes);
+	}
+	void finish() override {
+		if (_result.isNull()) {
+			auto j = _imagesMap.find(_location);
+			if (j != _imagesMap.cend() && j->first == _key) {
+				_clearCachedRecord(_key);
+				_storageImagesSize -= j->second;
+				_imagesMap.erase(j);
+			}
+		}
+		_done(std::move(_result));
+	}
+
+private:
+	FileKey _key;
+	StorageKey _location;
+	std::shared_ptr<Storage::MediaCache> _cache;
+	base::lambda<void(QImage &&poster)> _done;
+	QImage _result;
+
+};
+
+TaskId startVideoPosterLoad(const StorageKey &key, base::lambda<void(QImage &&poster)> done) {
+	auto j = _imagesMap.constFind(key);
+	if (j == _imagesMap.cend() || !_localLoader) {
+		return 0;
+	}
+	return _localLoader->addTask(MakeShared<VideoPosterLoadTask>(j->first, key, std::move(done)));
+}
+
+bool willVideoPosterLoad(const StorageKey &key) {
+	return _imagesMap.constFind(key) != _imagesMap.cend();
+}
+
 void writeStickerImage(const StorageKey &location, const QByteArray &sticker, bool overwrite) {
 	if (!_working()) return;
 
@@ -2883,20 +4342,19 @@ void writeStickerImage(const StorageKey &location, const QByteArray &sticker, bo
 	if (i == _stickerImagesMap.cend()) {
 		i = _stickerImagesMap.insert(location, FileDesc(genKey(FileOption::User), size));
 		_storageStickersSize += size;
-		_mapChanged = true;
-		_writeMap();
+		_appendStorageAdded(lskStickerImages, location, i.value());
 	} else if (!overwrite) {
 		return;
 	}
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + sticker.size());
 	data.stream << quint64(location.first) << quint64(location.second) << sticker;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	auto key = i.value().first;
 	if (i.value().second != size) {
 		_storageStickersSize += size;
 		_storageStickersSize -= i.value().second;
 		_stickerImagesMap[location].second = size;
 	}
+	_writeCachedRecord(key, data);
 }
 
 class StickerImageLoadTask : public AbstractCachedLoadTask {
@@ -2910,7 +4368,7 @@ public:
 	void clearInMap() {
 		auto j = _stickerImagesMap.find(_location);
 		if (j != _stickerImagesMap.cend() && j->first == _key) {
-			clearKey(j.value().first, FileOption::User);
+			_clearCachedRecord(j.value().first);
 			_storageStickersSize -= j.value().second;
 			_stickerImagesMap.erase(j);
 		}
@@ -2934,9 +4392,9 @@ bool copyStickerImage(const StorageKey &oldLocation, const StorageKey &newLocati
 	if (i == _stickerImagesMap.cend()) {
 		return false;
 	}
-	_stickerImagesMap.insert(newLocation, i.value());
-	_mapChanged = true;
-	_writeMap();
+	auto desc = i.value();
+	_stickerImagesMap.insert(newLocation, desc);
+	_appendStorageAdded(lskStickerImages, newLocation, desc);
 	return true;
 }
 
@@ -2944,6 +4402,106 @@ int32 hasStickers() {
 	return _stickerImagesMap.size();
 }
 
+StorageKey stickerRasterKey(DocumentId document, QSize size) {
+	// The high part never matches the mediaKey() of a sticker image,
+	// so rasters share the sticker images map, its size and clearing.
+	constexpr auto kRasterTag = int32(0x52415354);
+	auto packed = (qMin(cIntRetinaFactor(), 0xFF) << 24)
+		| (qMin(size.width(), 0xFFF) << 12)
+		| qMin(size.height(), 0xFFF);
+	return StorageKey(mediaMix32To64(kRasterTag, packed), document);
+}
+
+void writeStickerRaster(const StorageKey &key, const QImage &raster) {
+	if (!_working() || raster.isNull()) return;
+
+	auto image = raster.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	auto bytes = QByteArray();
+	bytes.reserve(image.width() * image.height() * 4);
+	for (auto y = 0; y != image.height(); ++y) {
+		bytes.append(reinterpret_cast<const char*>(image.constScanLine(y)), image.width() * 4);
+	}
+
+	qint32 size = _storageStickerSize(sizeof(qint32) * 2 + bytes.size());
+	auto i = _stickerImagesMap.constFind(key);
+	if (i == _stickerImagesMap.cend()) {
+		i = _stickerImagesMap.insert(key, FileDesc(genKey(FileOption::User), size));
+		_storageStickersSize += size;
+		_appendStorageAdded(lskStickerImages, key, i.value());
+	}
+	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(qint32) * 2 + sizeof(quint32) + bytes.size());
+	data.stream << quint64(key.first) << quint64(key.second) << qint32(image.width()) << qint32(image.height()) << bytes;
+	auto fileKey = i.value().first;
+	if (i.value().second != size) {
+		_storageStickersSize += size;
+		_storageStickersSize -= i.value().second;
+		_stickerImagesMap[key].second = size;
+	}
+	_writeCachedRecord(fileKey, data);
+}
+
+class StickerRasterLoadTask : public Task {
+public:
+	StickerRasterLoadTask(const FileKey &key, const StorageKey &location, base::lambda<void(QImage &&raster)> done)
+		: _key(key)
+		, _location(location)
+		, _cache(_mediaCache)
+		, _done(std::move(done)) {
+	}
+	void process() override {
+		FileReadDescriptor raster;
+		if (!_readCachedRecord(raster, _key, _cache)) {
+			return;
+		}
+
+		quint64 first = 0, second = 0;
+		qint32 width = 0, height = 0;
+		QByteArray bytes;
+		raster.stream >> first >> second >> width >> height >> bytes;
+		if (raster.stream.status() != QDataStream::Ok
+			|| width <= 0
+			|| height <= 0
+			|| bytes.size() != width * height * 4) {
+			return;
+		}
+		_result = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+		for (auto y = 0; y != height; ++y) {
+			memcpy(_result.scanLine(y), bytes.constData() + y * width * 4, width * 4);
+		}
+	}
+	void finish() override {
+		if (_result.isNull()) {
+			auto j = _stickerImagesMap.find(_location);
+			if (j != _stickerImagesMap.cend() && j->first == _key) {
+				_clearCachedRecord(j.value().first);
+				_storageStickersSize -= j.value().second;
+				_stickerImagesMap.erase(j);
+			}
+		}
+		_done(std::move(_result));
+	}
+
+private:
+	FileKey _key;
+	StorageKey _location;
+	std::shared_ptr<Storage::MediaCache> _cache;
+	base::lambda<void(QImage &&raster)> _done;
+	QImage _result;
+
+};
+
+TaskId startStickerRasterLoad(const StorageKey &key, base::lambda<void(QImage &&raster)> done) {
+	auto j = _stickerImagesMap.constFind(key);
+	if (j == _stickerImagesMap.cend() || !_localLoader) {
+		return 0;
+	}
+	return _localLoader->addTask(MakeShared<StickerRasterLoadTask>(j->first, key, std::move(done)));
+}
+
+bool willStickerRasterLoad(const StorageKey &key) {
+	return _stickerImagesMap.constFind(key) != _stickerImagesMap.cend();
+}
+
 qint64 storageStickersSize() {
 	return _storageStickersSize;
 }
@@ -2956,20 +4514,19 @@ void writeAudio(const StorageKey &location, const QByteArray &audio, bool overwr
 	if (i == _audiosMap.cend()) {
 		i = _audiosMap.insert(location, FileDesc(genKey(FileOption::User), size));
 		_storageAudiosSize += size;
-		_mapChanged = true;
-		_writeMap();
+		_appendStorageAdded(lskAudios, location, i.value());
 	} else if (!overwrite) {
 		return;
 	}
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + audio.size());
 	data.stream << quint64(location.first) << quint64(location.second) << audio;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	auto key = i.value().first;
 	if (i.value().second != size) {
 		_storageAudiosSize += size;
 		_storageAudiosSize -= i.value().second;
 		_audiosMap[location].second = size;
 	}
+	_writeCachedRecord(key, data);
 }
 
 class AudioLoadTask : public AbstractCachedLoadTask {
@@ -2983,7 +4540,7 @@ public:
 	void clearInMap() {
 		auto j = _audiosMap.find(_location);
 		if (j != _audiosMap.cend() && j->first == _key) {
-			clearKey(j.value().first, FileOption::User);
+			_clearCachedRecord(j.value().first);
 			_storageAudiosSize -= j.value().second;
 			_audiosMap.erase(j);
 		}
@@ -3003,9 +4560,9 @@ bool copyAudio(const StorageKey &oldLocation, const StorageKey &newLocation) {
 	if (i == _audiosMap.cend()) {
 		return false;
 	}
-	_audiosMap.insert(newLocation, i.value());
-	_mapChanged = true;
-	_writeMap();
+	auto desc = i.value();
+	_audiosMap.insert(newLocation, desc);
+	_appendStorageAdded(lskAudios, newLocation, desc);
 	return true;
 }
 
@@ -3033,19 +4590,19 @@ void writeWebFile(const QString &url, const QByteArray &content, bool overwrite)
 	if (i == _webFilesMap.cend()) {
 		i = _webFilesMap.insert(url, FileDesc(genKey(FileOption::User), size));
 		_storageWebFilesSize += size;
-		_writeLocations();
+		_appendWebFileAdded(url, i.value());
 	} else if (!overwrite) {
 		return;
 	}
 	EncryptedDescriptor data(Serialize::stringSize(url) + sizeof(quint32) + sizeof(quint32) + content.size());
 	data.stream << url << content;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	auto key = i.value().first;
 	if (i.value().second != size) {
 		_storageWebFilesSize += size;
 		_storageWebFilesSize -= i.value().second;
 		_webFilesMap[url].second = size;
 	}
+	_writeCachedRecord(key, data);
 }
 
 class WebFileLoadTask : public Task {
@@ -3053,12 +4610,13 @@ public:
 	WebFileLoadTask(const FileKey &key, const QString &url, webFileLoader *loader)
 		: _key(key)
 		, _url(url)
+		, _cache(_mediaCache)
 		, _loader(loader)
 		, _result(0) {
 	}
 	void process() {
 		FileReadDescriptor image;
-		if (!readEncryptedFile(image, _key, FileOption::User)) {
+		if (!_readCachedRecord(image, _key, _cache)) {
 			return;
 		}
 
@@ -3074,7 +4632,7 @@ public:
 		} else {
 			WebFilesMap::iterator j = _webFilesMap.find(_url);
 			if (j != _webFilesMap.cend() && j->first == _key) {
-				clearKey(j.value().first, FileOption::User);
+				_clearCachedRecord(j.value().first);
 				_storageWebFilesSize -= j.value().second;
 				_webFilesMap.erase(j);
 			}
@@ -3088,6 +4646,7 @@ public:
 protected:
 	FileKey _key;
 	QString _url;
+	std::shared_ptr<Storage::MediaCache> _cache;
 	struct Result {
 		explicit Result(const QByteArray &data) : image(data) {
 			QByteArray guessFormat;
@@ -3122,6 +4681,83 @@ qint64 storageWebFilesSize() {
 	return _storageWebFilesSize;
 }
 
+char _countWavemax(const VoiceWaveform &waveform) {
+	// Waveform values are 0..31, so the maximum fits the unsigned char range.
+	auto begin = reinterpret_cast<const uchar*>(waveform.constData());
+	auto end = begin + waveform.size();
+	return (begin != end) ? char(*std::max_element(begin, end)) : char(0);
+}
+
+void _readVoiceWaveforms() {
+	if (_voiceWaveformsRead) return;
+	_voiceWaveformsRead = true;
+	if (!_voiceWaveformsKey) return;
+
+	FileReadDescriptor waveforms;
+	if (!readEncryptedFile(waveforms, _voiceWaveformsKey)) {
+		clearKey(_voiceWaveformsKey);
+		_voiceWaveformsKey = 0;
+		_writeMap();
+		return;
+	}
+
+	quint32 count = 0;
+	waveforms.stream >> count;
+	for (quint32 i = 0; i < count; ++i) {
+		quint64 id = 0;
+		QByteArray waveform;
+		waveforms.stream >> id >> waveform;
+		if (!_checkStreamStatus(waveforms.stream)) {
+			break;
+		}
+		if (!waveform.isEmpty()) {
+			_voiceWaveforms.emplace(id, waveform);
+		}
+	}
+}
+
+void _writeVoiceWaveforms() {
+	if (!_working()) return;
+	_manager->writingVoiceWaveforms();
+
+	if (_voiceWaveforms.empty()) {
+		if (_voiceWaveformsKey) {
+			clearKey(_voiceWaveformsKey);
+			_voiceWaveformsKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+		return;
+	}
+	if (!_voiceWaveformsKey) {
+		_voiceWaveformsKey = genKey();
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Fast);
+	}
+	quint32 size = sizeof(quint32);
+	for (auto &entry : _voiceWaveforms) {
+		size += sizeof(quint64) + Serialize::bytearraySize(entry.second);
+	}
+	EncryptedDescriptor data(size);
+	data.stream << quint32(_voiceWaveforms.size());
+	for (auto &entry : _voiceWaveforms) {
+		data.stream << quint64(entry.first) << entry.second;
+	}
+	_writeEncrypted(_voiceWaveformsKey, data);
+}
+
+void _rememberVoiceWaveform(DocumentId id, const VoiceWaveform &waveform) {
+	if (!_working()) return;
+
+	_readVoiceWaveforms();
+	_voiceWaveforms[id] = waveform;
+	while (int(_voiceWaveforms.size()) > kVoiceWaveformsLimit) {
+		// Document ids grow with time, forget the oldest voice messages first.
+		_voiceWaveforms.erase(_voiceWaveforms.begin());
+	}
+	_manager->writeVoiceWaveforms(false);
+}
+
 class CountWaveformTask : public Task {
 public:
 	CountWaveformTask(DocumentData *doc)
@@ -3137,18 +4773,14 @@ public:
 		if (!_doc) return;
 
 		_waveform = audioCountWaveform(_loc, _data);
-		uchar wavemax = 0;
-		for (int32 i = 0, l = _waveform.size(); i < l; ++i) {
-			uchar waveat = _waveform.at(i);
-			if (wavemax < waveat) wavemax = waveat;
-		}
-		_wavemax = wavemax;
+		_wavemax = _countWavemax(_waveform);
 	}
 	void finish() {
 		if (VoiceData *voice = _doc ? _doc->voice() : 0) {
 			if (!_waveform.isEmpty()) {
 				voice->waveform = _waveform;
 				voice->wavemax = _wavemax;
+				_rememberVoiceWaveform(_doc->id, _waveform);
 			}
 			if (voice->waveform.isEmpty()) {
 				voice->waveform.resize(1);
@@ -3184,19 +4816,147 @@ protected:
 
 void countVoiceWaveform(DocumentData *document) {
 	if (VoiceData *voice = document->voice()) {
-		if (_localLoader) {
+		if (_working()) {
+			_readVoiceWaveforms();
+			auto i = _voiceWaveforms.find(document->id);
+			if (i != _voiceWaveforms.end()) {
+				voice->waveform = i->second;
+				voice->wavemax = _countWavemax(voice->waveform);
+				return;
+			}
+		}
+
+		// Decoding a whole voice message is slow, so it is done in a separate
+		// low priority queue and does not delay the local images loading.
+		if (_waveformCounter) {
 			voice->waveform.resize(1 + sizeof(TaskId));
 			voice->waveform[0] = -1; // counting
-			TaskId taskId = _localLoader->addTask(MakeShared<CountWaveformTask>(document));
+			TaskId taskId = _waveformCounter->addTask(MakeShared<CountWaveformTask>(document));
 			memcpy(voice->waveform.data() + 1, &taskId, sizeof(taskId));
 		}
 	}
 }
 
+void _readWebPages() {
+	if (_webPagesRead) return;
+	_webPagesRead = true;
+	if (!_webPagesKey) return;
+
+	FileReadDescriptor webPages;
+	if (!readEncryptedFile(webPages, _webPagesKey)) {
+		clearKey(_webPagesKey);
+		_webPagesKey = 0;
+		_writeMap();
+		return;
+	}
+
+	auto now = unixtime();
+	quint32 count = 0;
+	webPages.stream >> count;
+	for (quint32 i = 0; i < count; ++i) {
+		quint64 id = 0;
+		qint32 saved = 0;
+		QByteArray data;
+		webPages.stream >> id >> saved >> data;
+		if (!_checkStreamStatus(webPages.stream)) {
+			break;
+		}
+		if (saved + kWebPagesTtl > now && !data.isEmpty()) {
+			auto &record = _webPages[id];
+			record.saved = saved;
+			record.data = std::move(data);
+		}
+	}
+}
+
+void _writeWebPages() {
+	if (!_working()) return;
+	_manager->writingWebPages();
+
+	if (_webPages.empty()) {
+		if (_webPagesKey) {
+			clearKey(_webPagesKey);
+			_webPagesKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+		return;
+	}
+	if (!_webPagesKey) {
+		_webPagesKey = genKey();
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Fast);
+	}
+	quint32 size = sizeof(quint32);
+	for (auto &entry : _webPages) {
+		size += sizeof(quint64) + sizeof(qint32) + Serialize::bytearraySize(entry.second.data);
+	}
+	EncryptedDescriptor data(size);
+	data.stream << quint32(_webPages.size());
+	for (auto &entry : _webPages) {
+		data.stream << quint64(entry.first) << qint32(entry.second.saved) << entry.second.data;
+	}
+	_writeEncrypted(_webPagesKey, data);
+}
+
+void writeWebPage(const MTPWebPage &webpage) {
+	if (!_working() || webpage.type() != mtpc_webPage) return;
+
+	_readWebPages();
+	auto buffer = mtpBuffer();
+	webpage.write(buffer);
+	auto &record = _webPages[webpage.c_webPage().vid.v];
+	record.saved = unixtime();
+	record.data = QByteArray(reinterpret_cast<const char*>(buffer.constData()), buffer.size() * sizeof(mtpPrime));
+	if (int(_webPages.size()) > kWebPagesLimit) {
+		auto oldest = std::min_element(_webPages.begin(), _webPages.end(), [](auto &a, auto &b) {
+			return a.second.saved < b.second.saved;
+		});
+		_webPages.erase(oldest);
+	}
+	_manager->writeWebPages(false);
+}
+
+bool hasWebPage(WebPageId id) {
+	if (!_working()) return false;
+
+	_readWebPages();
+	auto i = _webPages.find(id);
+	return (i != _webPages.end()) && (i->second.saved + kWebPagesTtl > unixtime());
+}
+
+bool readWebPage(WebPageId id, MTPWebPage *result) {
+	if (!_working()) return false;
+
+	_readWebPages();
+	auto i = _webPages.find(id);
+	if (i == _webPages.end()) {
+		return false;
+	}
+	if (i->second.saved + kWebPagesTtl <= unixtime()) {
+		_webPages.erase(i);
+		_manager->writeWebPages(false);
+		return false;
+	}
+	auto from = reinterpret_cast<const mtpPrime*>(i->second.data.constData());
+	auto end = from + (i->second.data.size() / sizeof(mtpPrime));
+	try {
+		result->read(from, end);
+	} catch (Exception &) {
+		_webPages.erase(i);
+		_manager->writeWebPages(false);
+		return false;
+	}
+	return true;
+}
+
 void cancelTask(TaskId id) {
 	if (_localLoader) {
 		_localLoader->cancelTask(id);
 	}
+	if (_waveformCounter) {
+		_waveformCounter->cancelTask(id);
+	}
 }
 
 void _writeStickerSet(QDataStream &stream, const Stickers::Set &set) {
@@ -3300,13 +5060,12 @@ void _writeStickerSets(FileKey &stickersKey, CheckSet checkSet, const Stickers::
 	}
 	data.stream << order;
 
-	FileWriteDescriptor file(stickersKey);
-	file.writeEncrypted(data);
+	_writeEncrypted(stickersKey, data);
 }
 
 void _readStickerSets(FileKey &stickersKey, Stickers::Order *outOrder = nullptr, MTPDstickerSet::Flags readingFlags = 0) {
 	FileReadDescriptor stickers;
-	if (!readEncryptedFile(stickers, stickersKey)) {
+	if (!_readPreloadedOrEncryptedFile(stickers, stickersKey)) {
 		clearKey(stickersKey);
 		stickersKey = 0;
 		_writeMap();
@@ -3455,6 +5214,7 @@ void _readStickerSets(FileKey &stickersKey, Stickers::Order *outOrder = nullptr,
 
 void writeInstalledStickers() {
 	if (!Global::started()) return;
+	ensureStickersAndGifsRead();
 
 	_writeStickerSets(_installedStickersKey, [](const Stickers::Set &set) {
 		if (set.id == Stickers::CloudRecentSetId || set.id == Stickers::FavedSetId) { // separate files for them
@@ -3476,6 +5236,7 @@ void writeInstalledStickers() {
 
 void writeFeaturedStickers() {
 	if (!Global::started()) return;
+	ensureStickersAndGifsRead();
 
 	_writeStickerSets(_featuredStickersKey, [](const Stickers::Set &set) {
 		if (set.id == Stickers::CloudRecentSetId || set.id == Stickers::FavedSetId) { // separate files for them
@@ -3495,6 +5256,7 @@ void writeFeaturedStickers() {
 
 void writeRecentStickers() {
 	if (!Global::started()) return;
+	ensureStickersAndGifsRead();
 
 	_writeStickerSets(_recentStickersKey, [](const Stickers::Set &set) {
 		if (set.id != Stickers::CloudRecentSetId || set.stickers.isEmpty()) {
@@ -3506,6 +5268,7 @@ void writeRecentStickers() {
 
 void writeFavedStickers() {
 	if (!Global::started()) return;
+	ensureStickersAndGifsRead();
 
 	_writeStickerSets(_favedStickersKey, [](const Stickers::Set &set) {
 		if (set.id != Stickers::FavedSetId || set.stickers.isEmpty()) {
@@ -3644,6 +5407,37 @@ void readArchivedStickers() {
 	}
 }
 
+void startStickersAndGifsRead() {
+	_stickersAndGifsRead = false;
+	_preloadedFiles.clear();
+	_preloadInvalidated.clear();
+	_preloadStarted = getms();
+
+	auto keys = std::vector<FileKey>();
+	for (auto key : { _installedStickersKey, _featuredStickersKey, _recentStickersKey, _favedStickersKey, _savedGifsKey }) {
+		if (key) {
+			keys.push_back(key);
+		}
+	}
+	if (_recentHashtagsAndBotsKey && !_recentHashtagsAndBotsWereRead) {
+		keys.push_back(_recentHashtagsAndBotsKey);
+	}
+	if (keys.empty() || !_localLoader || _recentStickersKeyOld) {
+		_readStickersAndGifs();
+		return;
+	}
+	_preloadTaskId = _localLoader->addTask(MakeShared<PreloadFilesTask>(std::move(keys)));
+}
+
+void ensureStickersAndGifsRead() {
+	if (_stickersAndGifsRead) {
+		return;
+	}
+	_preloadTaskId = 0;
+	_preloadInvalidated.clear();
+	_readStickersAndGifs();
+}
+
 int32 countDocumentVectorHash(const QVector<DocumentData*> vector) {
 	uint32 acc = 0;
 	for_const (auto doc, vector) {
@@ -3664,6 +5458,8 @@ int32 countSpecialStickerSetHash(uint64 setId) {
 }
 
 int32 countStickersHash(bool checkOutdatedInfo) {
+	ensureStickersAndGifsRead();
+
 	uint32 acc = 0;
 	bool foundOutdated = false;
 	auto &sets = Global::StickerSets();
@@ -3683,14 +5479,18 @@ int32 countStickersHash(bool checkOutdatedInfo) {
 }
 
 int32 countRecentStickersHash() {
+	ensureStickersAndGifsRead();
 	return countSpecialStickerSetHash(Stickers::CloudRecentSetId);
 }
 
 int32 countFavedStickersHash() {
+	ensureStickersAndGifsRead();
 	return countSpecialStickerSetHash(Stickers::FavedSetId);
 }
 
 int32 countFeaturedStickersHash() {
+	ensureStickersAndGifsRead();
+
 	uint32 acc = 0;
 	auto &sets = Global::StickerSets();
 	auto &featured = Global::FeaturedStickerSetsOrder();
@@ -3707,11 +5507,13 @@ int32 countFeaturedStickersHash() {
 }
 
 int32 countSavedGifsHash() {
+	ensureStickersAndGifsRead();
 	return countDocumentVectorHash(cSavedGifs());
 }
 
 void writeSavedGifs() {
 	if (!_working()) return;
+	ensureStickersAndGifsRead();
 
 	auto &saved = cSavedGifs();
 	if (saved.isEmpty()) {
@@ -3737,8 +5539,7 @@ void writeSavedGifs() {
 		for_const (auto gif, saved) {
 			Serialize::Document::writeToStream(data.stream, gif);
 		}
-		FileWriteDescriptor file(_savedGifsKey);
-		file.writeEncrypted(data);
+		_writeEncrypted(_savedGifsKey, data);
 	}
 }
 
@@ -3746,7 +5547,7 @@ void readSavedGifs() {
 	if (!_savedGifsKey) return;
 
 	FileReadDescriptor gifs;
-	if (!readEncryptedFile(gifs, _savedGifsKey)) {
+	if (!_readPreloadedOrEncryptedFile(gifs, _savedGifsKey)) {
 		clearKey(_savedGifsKey);
 		_savedGifsKey = 0;
 		_writeMap();
@@ -3793,8 +5594,7 @@ void writeBackground(int32 id, const QImage &img) {
 	EncryptedDescriptor data(size);
 	data.stream << qint32(id) << bmp;
 
-	FileWriteDescriptor file(_backgroundKey);
-	file.writeEncrypted(data);
+	_writeEncrypted(_backgroundKey, data);
 }
 
 bool readBackground() {
@@ -3948,8 +5748,20 @@ void readLangPack() {
 	}
 	auto data = QByteArray();
 	langpack.stream >> data;
-	if (langpack.stream.status() == QDataStream::Ok) {
-		Lang::Current().fillFromSerialized(data);
+	if (langpack.stream.status() != QDataStream::Ok) {
+		return;
+	}
+	Lang::Current().fillFromSerialized(data);
+
+	FileReadDescriptor overlay;
+	if (!_langPackOverlayKey || !readEncryptedFile(overlay, _langPackOverlayKey, FileOption::Safe, SettingsKey)) {
+		return;
+	}
+	auto overlayData = QByteArray();
+	overlay.stream >> overlayData;
+	if (overlay.stream.status() != QDataStream::Ok || !Lang::Current().fillOverlayFromSerialized(overlayData)) {
+		clearKey(_langPackOverlayKey, FileOption::Safe);
+		_langPackOverlayKey = 0;
 	}
 }
 
@@ -3965,6 +5777,30 @@ void writeLangPack() {
 
 	FileWriteDescriptor file(_langPackKey, FileOption::Safe);
 	file.writeEncrypted(data, SettingsKey);
+
+	Lang::Current().clearOverlay();
+	if (_langPackOverlayKey) {
+		clearKey(_langPackOverlayKey, FileOption::Safe);
+		_langPackOverlayKey = 0;
+		writeSettings();
+	}
+}
+
+void writeLangPackDifference() {
+	if (!_langPackKey || Lang::Current().overlayTooLarge()) {
+		return writeLangPack();
+	}
+	auto overlay = Lang::Current().serializeOverlay();
+	if (!_langPackOverlayKey) {
+		_langPackOverlayKey = genKey(FileOption::Safe);
+		writeSettings();
+	}
+
+	EncryptedDescriptor data(Serialize::bytearraySize(overlay));
+	data.stream << overlay;
+
+	FileWriteDescriptor file(_langPackOverlayKey, FileOption::Safe);
+	file.writeEncrypted(data, SettingsKey);
 }
 
 QString themePaletteAbsolutePath() {
@@ -4207,8 +6043,7 @@ void writeRecentHashtagsAndBots() {
 		for (RecentInlineBots::const_iterator i = bots.cbegin(), e = bots.cend(); i != e; ++i) {
 			_writePeer(data.stream, *i);
 		}
-		FileWriteDescriptor file(_recentHashtagsAndBotsKey);
-		file.writeEncrypted(data);
+		_writeEncrypted(_recentHashtagsAndBotsKey, data);
 	}
 }
 
@@ -4219,7 +6054,7 @@ void readRecentHashtagsAndBots() {
 	if (!_recentHashtagsAndBotsKey) return;
 
 	FileReadDescriptor hashtags;
-	if (!readEncryptedFile(hashtags, _recentHashtagsAndBotsKey)) {
+	if (!_readPreloadedOrEncryptedFile(hashtags, _recentHashtagsAndBotsKey)) {
 		clearKey(_recentHashtagsAndBotsKey);
 		_recentHashtagsAndBotsKey = 0;
 		_writeMap();
@@ -4295,8 +6130,7 @@ void writeSavedPeers() {
 			data.stream << i.value();
 		}
 
-		FileWriteDescriptor file(_savedPeersKey);
-		file.writeEncrypted(data);
+		_writeEncrypted(_savedPeersKey, data);
 	}
 }
 
@@ -4364,9 +6198,72 @@ void removeSavedPeer(PeerData *peer) {
 	}
 }
 
-void writeReportSpamStatuses() {
-	_writeReportSpamStatuses();
-}
+void writeDialogsSnapshot(const QVector<DialogsSnapshotEntry> &entries) {
+	if (!_working()) return;
+
+	if (entries.isEmpty()) {
+		if (_dialogsSnapshotKey) {
+			clearKey(_dialogsSnapshotKey);
+			_dialogsSnapshotKey = 0;
+			_mapChanged = true;
+		}
+		_writeMap();
+	} else {
+		if (!_dialogsSnapshotKey) {
+			_dialogsSnapshotKey = genKey();
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Fast);
+		}
+		quint32 size = sizeof(quint32);
+		for_const (auto &entry, entries) {
+			size += _peerSize(entry.peer) + Serialize::dateTimeSize() + sizeof(qint32);
+		}
+
+		EncryptedDescriptor data(size);
+		data.stream << quint32(entries.size());
+		for_const (auto &entry, entries) {
+			_writePeer(data.stream, entry.peer);
+			data.stream << entry.date << qint32(entry.unreadCount);
+		}
+
+		_writeEncrypted(_dialogsSnapshotKey, data);
+	}
+}
+
+QVector<DialogsSnapshotEntry> readDialogsSnapshot() {
+	auto result = QVector<DialogsSnapshotEntry>();
+	if (!_dialogsSnapshotKey) return result;
+
+	FileReadDescriptor snapshot;
+	if (!readEncryptedFile(snapshot, _dialogsSnapshotKey)) {
+		clearKey(_dialogsSnapshotKey);
+		_dialogsSnapshotKey = 0;
+		_writeMap();
+		return result;
+	}
+
+	quint32 count = 0;
+	snapshot.stream >> count;
+	result.reserve(count);
+	for (quint32 i = 0; i < count; ++i) {
+		auto entry = DialogsSnapshotEntry();
+		entry.peer = _readPeer(snapshot);
+		if (!entry.peer) break;
+
+		qint32 unreadCount = 0;
+		snapshot.stream >> entry.date >> unreadCount;
+		if (!_checkStreamStatus(snapshot.stream)) {
+			break;
+		}
+		entry.unreadCount = unreadCount;
+		result.push_back(entry);
+	}
+	return result;
+}
+
+void writeReportSpamStatuses() {
+	_writeReportSpamStatuses();
+}
 
 void writeTrustedBots() {
 	if (!_working()) return;
@@ -4391,8 +6288,7 @@ void writeTrustedBots() {
 			data.stream << quint64(botId);
 		}
 
-		FileWriteDescriptor file(_trustedBotsKey);
-		file.writeEncrypted(data);
+		_writeEncrypted(_trustedBotsKey, data);
 	}
 }
 
@@ -4431,6 +6327,591 @@ bool isBotTrusted(UserData *bot) {
 	return _trustedBots.contains(bot->id);
 }
 
+void _writeDownloadParts() {
+	if (!_working()) return;
+
+	if (_downloadParts.isEmpty()) {
+		if (_downloadPartsKey) {
+			clearKey(_downloadPartsKey);
+			_downloadPartsKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+	} else {
+		if (!_downloadPartsKey) {
+			_downloadPartsKey = genKey();
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Fast);
+		}
+		quint32 size = sizeof(qint32);
+		for (auto i = _downloadParts.cbegin(), e = _downloadParts.cend(); i != e; ++i) {
+			size += sizeof(quint64) * 2 + Serialize::stringSize(i->path) + Serialize::bytearraySize(i->parts);
+		}
+		EncryptedDescriptor data(size);
+		data.stream << qint32(_downloadParts.size());
+		for (auto i = _downloadParts.cbegin(), e = _downloadParts.cend(); i != e; ++i) {
+			data.stream << quint64(i.key().first) << quint64(i.key().second) << i->path << i->parts;
+		}
+
+		_writeEncrypted(_downloadPartsKey, data);
+	}
+}
+
+void _readDownloadParts() {
+	if (_downloadPartsRead) return;
+	_downloadPartsRead = true;
+	if (!_downloadPartsKey) return;
+
+	FileReadDescriptor parts;
+	if (!readEncryptedFile(parts, _downloadPartsKey)) {
+		clearKey(_downloadPartsKey);
+		_downloadPartsKey = 0;
+		_writeMap();
+		return;
+	}
+
+	qint32 count = 0;
+	parts.stream >> count;
+	for (int i = 0; i < count; ++i) {
+		quint64 first = 0, second = 0;
+		auto record = DownloadPartsRecord();
+		parts.stream >> first >> second >> record.path >> record.parts;
+		if (!_checkStreamStatus(parts.stream)) {
+			_downloadParts.clear();
+			return;
+		}
+		_downloadParts.insert(MediaKey(first, second), record);
+	}
+}
+
+void writeDownloadParts(const MediaKey &location, const QString &path, const QByteArray &parts) {
+	_readDownloadParts();
+
+	auto &record = _downloadParts[location];
+	record.path = path;
+	record.parts = parts;
+	_writeDownloadParts();
+}
+
+bool readDownloadParts(const MediaKey &location, QString *path, QByteArray *parts) {
+	_readDownloadParts();
+
+	auto i = _downloadParts.constFind(location);
+	if (i == _downloadParts.cend()) {
+		return false;
+	}
+	*path = i->path;
+	*parts = i->parts;
+	return true;
+}
+
+void removeDownloadParts(const MediaKey &location) {
+	_readDownloadParts();
+
+	if (_downloadParts.remove(location)) {
+		_writeDownloadParts();
+	}
+}
+
+void _writeUploadedFiles() {
+	if (!_working()) return;
+
+	if (_uploadedFiles.isEmpty()) {
+		if (_uploadedFilesKey) {
+			clearKey(_uploadedFilesKey);
+			_uploadedFilesKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+	} else {
+		if (!_uploadedFilesKey) {
+			_uploadedFilesKey = genKey();
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Fast);
+		}
+		quint32 size = sizeof(qint32);
+		for (auto i = _uploadedFiles.cbegin(), e = _uploadedFiles.cend(); i != e; ++i) {
+			size += Serialize::bytearraySize(i.key()) + Serialize::stringSize(i->filename) + sizeof(quint64) * 2;
+		}
+		EncryptedDescriptor data(size);
+		data.stream << qint32(_uploadedFiles.size());
+		for (auto i = _uploadedFiles.cbegin(), e = _uploadedFiles.cend(); i != e; ++i) {
+			data.stream << i.key() << i->filename << i->id << i->accessHash;
+		}
+
+		_writeEncrypted(_uploadedFilesKey, data);
+	}
+}
+
+void _readUploadedFiles() {
+	if (_uploadedFilesRead) return;
+	_uploadedFilesRead = true;
+	if (!_uploadedFilesKey) return;
+
+	FileReadDescriptor files;
+	if (!readEncryptedFile(files, _uploadedFilesKey)) {
+		clearKey(_uploadedFilesKey);
+		_uploadedFilesKey = 0;
+		_writeMap();
+		return;
+	}
+
+	qint32 count = 0;
+	files.stream >> count;
+	for (int i = 0; i < count; ++i) {
+		auto hash = QByteArray();
+		auto record = UploadedFileRecord();
+		files.stream >> hash >> record.filename >> record.id >> record.accessHash;
+		if (!_checkStreamStatus(files.stream)) {
+			_uploadedFiles.clear();
+			return;
+		}
+		_uploadedFiles.insert(hash, record);
+	}
+}
+
+void writeUploadedFile(const QByteArray &contentHash, const QString &filename, const DocumentId &id, const uint64 &accessHash) {
+	_readUploadedFiles();
+
+	if (_uploadedFiles.size() >= kUploadedFilesLimit && !_uploadedFiles.contains(contentHash)) {
+		_uploadedFiles.erase(_uploadedFiles.begin());
+	}
+	auto &record = _uploadedFiles[contentHash];
+	record.filename = filename;
+	record.id = id;
+	record.accessHash = accessHash;
+	_writeUploadedFiles();
+}
+
+bool readUploadedFile(const QByteArray &contentHash, const QString &filename, DocumentId *id, uint64 *accessHash) {
+	_readUploadedFiles();
+
+	auto i = _uploadedFiles.constFind(contentHash);
+	if (i == _uploadedFiles.cend() || i->filename != filename) {
+		return false;
+	}
+	*id = i->id;
+	*accessHash = i->accessHash;
+	return true;
+}
+
+void removeUploadedFile(const QByteArray &contentHash) {
+	_readUploadedFiles();
+
+	if (_uploadedFiles.remove(contentHash)) {
+		_writeUploadedFiles();
+	}
+}
+
+QByteArray _serializeHistoryMessage(const MTPMessage &message) {
+	auto buffer = mtpBuffer();
+	message.write(buffer);
+	return QByteArray(reinterpret_cast<const char*>(buffer.constData()), buffer.size() * sizeof(mtpPrime));
+}
+
+bool _deserializeHistoryMessage(const QByteArray &data, MTPMessage *result) {
+	auto from = reinterpret_cast<const mtpPrime*>(data.constData());
+	auto end = from + (data.size() / sizeof(mtpPrime));
+	try {
+		result->read(from, end);
+	} catch (Exception &) {
+		return false;
+	}
+	return (from == end);
+}
+
+// Both message and messageService start with constructor, flags and id.
+void _setSerializedHistoryMessageId(QByteArray &data, MsgId msgId) {
+	if (data.size() < 3 * int(sizeof(mtpPrime))) {
+		return;
+	}
+
+	auto primes = reinterpret_cast<mtpPrime*>(data.data());
+	if (mtpTypeId(primes[0]) == mtpc_message || mtpTypeId(primes[0]) == mtpc_messageService) {
+		primes[2] = msgId;
+	}
+}
+
+QVector<PeerId> _historyMessagePeers(const MTPMessage &message) {
+	auto result = QVector<PeerId>();
+	auto add = [&result](PeerId peerId) {
+		if (peerId && !result.contains(peerId)) {
+			result.push_back(peerId);
+		}
+	};
+	auto addUser = [&add](const MTPint &userId) {
+		add(peerFromUser(userId));
+	};
+	switch (message.type()) {
+	case mtpc_message: {
+		auto &d = message.c_message();
+		if (d.has_from_id()) addUser(d.vfrom_id);
+		if (d.has_fwd_from()) {
+			auto &f = d.vfwd_from.c_messageFwdHeader();
+			if (f.has_from_id()) addUser(f.vfrom_id);
+			if (f.has_channel_id()) add(peerFromChannel(f.vchannel_id));
+		}
+		if (d.has_via_bot_id()) addUser(d.vvia_bot_id);
+	} break;
+	case mtpc_messageService: {
+		auto &d = message.c_messageService();
+		if (d.has_from_id()) addUser(d.vfrom_id);
+		switch (d.vaction.type()) {
+		case mtpc_messageActionChatCreate: {
+			for_const (auto &userId, d.vaction.c_messageActionChatCreate().vusers.v) {
+				addUser(userId);
+			}
+		} break;
+		case mtpc_messageActionChatAddUser: {
+			for_const (auto &userId, d.vaction.c_messageActionChatAddUser().vusers.v) {
+				addUser(userId);
+			}
+		} break;
+		case mtpc_messageActionChatDeleteUser: addUser(d.vaction.c_messageActionChatDeleteUser().vuser_id); break;
+		case mtpc_messageActionChatJoinedByLink: addUser(d.vaction.c_messageActionChatJoinedByLink().vinviter_id); break;
+		}
+	} break;
+	}
+	return result;
+}
+
+void _writeHistoryMessagesRecord(const PeerId &peer, const HistoryMessagesRecord &record) {
+	if (record.messages.empty()) {
+		auto i = _historyMessagesMap.find(peer);
+		if (i != _historyMessagesMap.cend()) {
+			clearKey(i.value());
+			_historyMessagesMap.erase(i);
+			_mapChanged = true;
+			_writeMap();
+		}
+		return;
+	}
+
+	auto i = _historyMessagesMap.constFind(peer);
+	if (i == _historyMessagesMap.cend()) {
+		i = _historyMessagesMap.insert(peer, genKey());
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Fast);
+	}
+
+	auto peers = OrderedSet<PeerId>();
+	for (auto &message : record.messages) {
+		for_const (auto peerId, message.second.peers) {
+			peers.insert(peerId);
+		}
+	}
+	auto loaded = QVector<PeerData*>();
+	loaded.reserve(peers.size());
+	for_const (auto peerId, peers) {
+		if (auto data = App::peerLoaded(peerId)) {
+			loaded.push_back(data);
+		}
+	}
+
+	quint32 size = sizeof(quint64) + sizeof(quint32) * 2;
+	for_const (auto data, loaded) {
+		size += _peerSize(data);
+	}
+	for (auto &message : record.messages) {
+		size += sizeof(qint32) + Serialize::bytearraySize(message.second.data);
+	}
+
+	EncryptedDescriptor data(size);
+	data.stream << quint64(peer) << quint32(loaded.size());
+	for_const (auto peerData, loaded) {
+		_writePeer(data.stream, peerData);
+	}
+	data.stream << quint32(record.messages.size());
+	for (auto &message : record.messages) {
+		data.stream << qint32(message.first) << message.second.data;
+	}
+
+	_writeEncrypted(i.value(), data);
+}
+
+void _writeHistoryMessages() {
+	if (!_working()) return;
+
+	_manager->writingHistoryMessages();
+	for (auto &record : _historyMessages) {
+		if (record.second.changed) {
+			record.second.changed = false;
+			_writeHistoryMessagesRecord(record.first, record.second);
+		}
+	}
+}
+
+HistoryMessagesRecord &_historyMessagesRecord(const PeerId &peer) {
+	auto i = _historyMessages.find(peer);
+	if (i != _historyMessages.end()) {
+		return i->second;
+	}
+	auto &result = _historyMessages[peer];
+
+	auto j = _historyMessagesMap.find(peer);
+	if (j == _historyMessagesMap.cend()) {
+		return result;
+	}
+	FileReadDescriptor messages;
+	if (!readEncryptedFile(messages, j.value())) {
+		clearKey(j.value());
+		_historyMessagesMap.erase(j);
+		_mapChanged = true;
+		_writeMap();
+		return result;
+	}
+
+	quint64 messagesPeer = 0;
+	quint32 peersCount = 0;
+	messages.stream >> messagesPeer >> peersCount;
+	for (quint32 k = 0; k < peersCount; ++k) {
+		_readPeer(messages);
+		if (!_checkStreamStatus(messages.stream)) {
+			break;
+		}
+	}
+	quint32 count = 0;
+	messages.stream >> count;
+	for (quint32 k = 0; k < count; ++k) {
+		qint32 msgId = 0;
+		auto data = QByteArray();
+		messages.stream >> msgId >> data;
+
+		auto message = MTPMessage();
+		if (!_checkStreamStatus(messages.stream) || messagesPeer != peer || !_deserializeHistoryMessage(data, &message)) {
+			result.messages.clear();
+			result.size = 0;
+			result.changed = true;
+			_manager->writeHistoryMessages(false);
+			break;
+		}
+		auto &stored = result.messages[msgId];
+		stored.peers = _historyMessagePeers(message);
+		stored.data = std::move(data);
+		result.size += stored.data.size();
+	}
+	return result;
+}
+
+void _historyMessagesRemove(HistoryMessagesRecord &record, std::map<MsgId, HistoryMessageRecord>::iterator i) {
+	record.size -= i->second.data.size();
+	record.messages.erase(i);
+	record.changed = true;
+}
+
+// Stored messages must be a continuous range of the history, so new messages
+// are added only if the loaded messages continue the already stored ones.
+bool _historyMessagesContinued(not_null<History*> history, HistoryMessagesRecord &record) {
+	if (record.messages.empty()) {
+		return history->loadedAtBottom();
+	}
+	auto i = record.messages.lower_bound(history->minMsgId());
+	if (i != record.messages.end() && i->first <= history->maxMsgId()) {
+		return true;
+	} else if (!history->loadedAtBottom()) {
+		return false;
+	}
+	record.messages.clear();
+	record.size = 0;
+	record.changed = true;
+	return true;
+}
+
+void _checkHistoryMessagesRange(not_null<History*> history, HistoryMessagesRecord &record) {
+	if (history->loadedAtBottom()) {
+		// Messages after the last loaded one were deleted.
+		for (auto i = record.messages.upper_bound(history->maxMsgId()); i != record.messages.end();) {
+			_historyMessagesRemove(record, i++);
+		}
+	}
+	if (record.messages.empty()) {
+		return;
+	}
+
+	// Messages loaded between the stored ones, but not stored, make a gap.
+	auto oldest = record.messages.begin()->first;
+	auto newest = record.messages.rbegin()->first;
+	for (auto i = history->blocks.cend(), e = history->blocks.cbegin(); i != e;) {
+		--i;
+		auto &items = (*i)->items;
+		for (auto j = items.cend(), en = items.cbegin(); j != en;) {
+			--j;
+			auto msgId = (*j)->id;
+			if (msgId <= 0 || msgId > newest) {
+				continue;
+			} else if (msgId < oldest) {
+				return;
+			} else if (record.messages.find(msgId) == record.messages.end()) {
+				for (auto k = record.messages.begin(); k != record.messages.end() && k->first < msgId;) {
+					_historyMessagesRemove(record, k++);
+				}
+				return;
+			}
+		}
+	}
+}
+
+void _trimHistoryMessages(HistoryMessagesRecord &record) {
+	while (!record.messages.empty() && (int(record.messages.size()) > kHistoryMessagesLimit || record.size > kHistoryMessagesSizeLimit)) {
+		_historyMessagesRemove(record, record.messages.begin());
+	}
+}
+
+void writeHistoryMessages(not_null<History*> history, const QVector<MTPMessage> &slice) {
+	if (!_working() || _readingHistoryMessages || slice.isEmpty()) return;
+	if (history->isEmpty() || history->peer->migrateTo()) return;
+
+	auto peer = history->peer->id;
+	if (!history->loadedAtBottom() && !_historyMessagesMap.contains(peer) && _historyMessages.find(peer) == _historyMessages.end()) {
+		return;
+	}
+	auto &record = _historyMessagesRecord(peer);
+	if (!_historyMessagesContinued(history, record)) {
+		return;
+	}
+	for_const (auto &message, slice) {
+		auto msgId = idFromMessage(message);
+		if (!msgId || message.type() == mtpc_messageEmpty) {
+			continue;
+		}
+		auto &stored = (msgId > 0) ? record.messages[msgId] : record.sending[msgId];
+		auto data = _serializeHistoryMessage(message);
+		if (msgId > 0) {
+			record.size += data.size() - stored.data.size();
+			record.changed = true;
+		}
+		stored.peers = _historyMessagePeers(message);
+		stored.data = std::move(data);
+	}
+	while (int(record.sending.size()) > kHistoryMessagesLimit) {
+		record.sending.erase(record.sending.begin());
+	}
+	_checkHistoryMessagesRange(history, record);
+	_trimHistoryMessages(record);
+	if (record.changed) {
+		_manager->writeHistoryMessages(false);
+	}
+}
+
+void changeHistoryMessageId(not_null<History*> history, MsgId wasId, MsgId nowId) {
+	if (!_working()) return;
+
+	auto i = _historyMessages.find(history->peer->id);
+	if (i == _historyMessages.end()) {
+		return;
+	}
+	auto &record = i->second;
+	auto j = record.sending.find(wasId);
+	if (j == record.sending.end()) {
+		return;
+	}
+	auto stored = std::move(j->second);
+	record.sending.erase(j);
+	if (nowId <= 0 || !_historyMessagesContinued(history, record)) {
+		return;
+	}
+	_setSerializedHistoryMessageId(stored.data, nowId);
+	if (record.messages.find(nowId) == record.messages.end()) {
+		record.size += stored.data.size();
+		record.messages.emplace(nowId, std::move(stored));
+		record.changed = true;
+	}
+	_checkHistoryMessagesRange(history, record);
+	_trimHistoryMessages(record);
+	if (record.changed) {
+		_manager->writeHistoryMessages(false);
+	}
+}
+
+void editHistoryMessage(const PeerId &peer, const MTPMessage &message) {
+	if (!_working()) return;
+	if (!_historyMessagesMap.contains(peer) && _historyMessages.find(peer) == _historyMessages.end()) return;
+
+	auto &record = _historyMessagesRecord(peer);
+	auto i = record.messages.find(idFromMessage(message));
+	if (i != record.messages.end()) {
+		auto data = _serializeHistoryMessage(message);
+		record.size += data.size() - i->second.data.size();
+		i->second.peers = _historyMessagePeers(message);
+		i->second.data = std::move(data);
+		record.changed = true;
+		_trimHistoryMessages(record);
+		_manager->writeHistoryMessages(false);
+	}
+}
+
+void removeHistoryMessage(const PeerId &peer, MsgId msgId) {
+	if (!_working()) return;
+	if (!_historyMessagesMap.contains(peer) && _historyMessages.find(peer) == _historyMessages.end()) return;
+
+	auto &record = _historyMessagesRecord(peer);
+	auto i = record.messages.find(msgId);
+	if (i != record.messages.end()) {
+		_historyMessagesRemove(record, i);
+		_manager->writeHistoryMessages(false);
+	}
+}
+
+void clearHistoryMessages(const PeerId &peer) {
+	if (!_working()) return;
+
+	auto i = _historyMessages.find(peer);
+	if (i != _historyMessages.end()) {
+		_historyMessages.erase(i);
+	}
+	_writeHistoryMessagesRecord(peer, HistoryMessagesRecord());
+}
+
+QVector<MTPMessage> readStoredHistoryMessages(const PeerId &peer) {
+	auto result = QVector<MTPMessage>();
+	if (!_working()) return result;
+	if (!_historyMessagesMap.contains(peer) && _historyMessages.find(peer) == _historyMessages.end()) {
+		return result;
+	}
+
+	auto &record = _historyMessagesRecord(peer);
+	result.reserve(record.messages.size());
+	for (auto i = record.messages.crbegin(), e = record.messages.crend(); i != e; ++i) {
+		auto message = MTPMessage();
+		if (_deserializeHistoryMessage(i->second.data, &message)) {
+			result.push_back(message);
+		}
+	}
+	return result;
+}
+
+bool readStoredHistoryMessage(const PeerId &peer, MsgId msgId, MTPMessage *result) {
+	if (!_working()) return false;
+	if (!_historyMessagesMap.contains(peer) && _historyMessages.find(peer) == _historyMessages.end()) {
+		return false;
+	}
+
+	auto &record = _historyMessagesRecord(peer);
+	auto i = record.messages.find(msgId);
+	return (i != record.messages.end()) && _deserializeHistoryMessage(i->second.data, result);
+}
+
+bool readHistoryMessages(not_null<History*> history) {
+	if (!history->isEmpty()) return false;
+
+	auto slice = readStoredHistoryMessages(history->peer->id);
+	if (slice.isEmpty()) {
+		return false;
+	}
+
+	// The server is asked for the newer messages until the last message is reached.
+	_readingHistoryMessages = true;
+	history->setNotLoadedAtBottom();
+	history->addOlderSlice(slice);
+	_readingHistoryMessages = false;
+
+	return !history->isEmpty();
+}
+
+WriterStats writerStats() {
+	return _writer ? _writer->stats() : WriterStats();
+}
+
 bool encrypt(const void *src, void *dst, uint32 len, const void *key128) {
 	if (!LocalKey) {
 		return false;
@@ -4447,10 +6928,46 @@ bool decrypt(const void *src, void *dst, uint32 len, const void *key128) {
 	return true;
 }
 
+namespace {
+
+QString OldTempDirsPattern() {
+	return qsl("tdld_old*");
+}
+
+// Moves the downloads folder aside, so that new downloads get an empty
+// folder right away and the old one is removed in the clear manager thread.
+void MoveTempDirForRemoving() {
+	auto path = cTempDir();
+	path.chop(1); // trailing '/'
+	if (!QDir(path).exists()) {
+		return;
+	}
+	auto removing = path + qsl("_old") + QString::number(getms(true));
+	if (!QDir().rename(path, removing)) {
+		LOG(("App Error: could not move the downloads folder for removing."));
+	}
+}
+
+bool RemoveOldTempDirs() {
+	auto result = true;
+	auto base = cWorkingDir() + qsl("tdata");
+	QDirIterator di(base, QStringList(OldTempDirsPattern()), QDir::Dirs | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+	while (di.hasNext()) {
+		di.next();
+		if (!QDir(di.filePath()).removeRecursively()) {
+			result = false;
+		}
+	}
+	return result;
+}
+
+} // namespace
+
 struct ClearManagerData {
 	QThread *thread;
 	StorageMap images, stickers, audios;
 	WebFilesMap webFiles;
+	std::shared_ptr<Storage::MediaCache> cache;
 	QMutex mutex;
 	QList<int> tasks;
 	bool working;
@@ -4468,6 +6985,10 @@ bool ClearManager::addTask(int task) {
 	if (!data->tasks.isEmpty() && (data->tasks.at(0) == ClearManagerAll)) return true;
 	if (task == ClearManagerAll) {
 		data->tasks.clear();
+		if (_mediaCache) {
+			// A few segment files, so it is fast enough to do it right away.
+			_mediaCache->clear();
+		}
 		if (!_imagesMap.isEmpty()) {
 			_imagesMap.clear();
 			_storageImagesSize = 0;
@@ -4503,6 +7024,16 @@ bool ClearManager::addTask(int task) {
 			_trustedBotsKey = 0;
 			_mapChanged = true;
 		}
+		if (_downloadPartsKey) {
+			_downloadPartsKey = 0;
+			_downloadParts.clear();
+			_mapChanged = true;
+		}
+		if (_uploadedFilesKey) {
+			_uploadedFilesKey = 0;
+			_uploadedFiles.clear();
+			_mapChanged = true;
+		}
 		if (_recentStickersKeyOld) {
 			_recentStickersKeyOld = 0;
 			_mapChanged = true;
@@ -4519,9 +7050,29 @@ bool ClearManager::addTask(int task) {
 			_savedPeersKey = 0;
 			_mapChanged = true;
 		}
+		if (_dialogsSnapshotKey) {
+			_dialogsSnapshotKey = 0;
+			_mapChanged = true;
+		}
+		if (_voiceWaveformsKey) {
+			_voiceWaveformsKey = 0;
+			_mapChanged = true;
+		}
+		_voiceWaveforms.clear();
+		_voiceWaveformsRead = false;
+		if (_webPagesKey) {
+			_webPagesKey = 0;
+			_mapChanged = true;
+		}
+		_webPages.clear();
+		_webPagesRead = false;
 		_writeMap();
 	} else {
+		if (task & ClearManagerDownloads) {
+			MoveTempDirForRemoving();
+		}
 		if (task & ClearManagerStorage) {
+			data->cache = _mediaCache;
 			if (data->images.isEmpty()) {
 				data->images = _imagesMap;
 			} else {
@@ -4634,6 +7185,7 @@ void ClearManager::onStart() {
 		bool result = false;
 		StorageMap images, stickers, audios;
 		WebFilesMap webFiles;
+		std::shared_ptr<Storage::MediaCache> cache;
 		{
 			QMutexLocker lock(&data->mutex);
 			if (data->tasks.isEmpty()) {
@@ -4645,15 +7197,20 @@ void ClearManager::onStart() {
 			stickers = data->stickers;
 			audios = data->audios;
 			webFiles = data->webFiles;
+			cache = data->cache;
 		}
 		switch (task) {
 		case ClearManagerAll: {
 			result = QDir(cTempDir()).removeRecursively();
+			if (!RemoveOldTempDirs()) result = false;
 			QDirIterator di(_userBasePath, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
 			while (di.hasNext()) {
 				di.next();
 				const QFileInfo& fi = di.fileInfo();
 				if (fi.isDir() && !fi.isSymLink()) {
+					if (fi.fileName() == qstr("media_cache")) {
+						continue; // Cleared in ClearManager::addTask().
+					}
 					if (!QDir(di.filePath()).removeRecursively()) result = false;
 				} else {
 					QString path = di.filePath();
@@ -4664,23 +7221,43 @@ void ClearManager::onStart() {
 			}
 		} break;
 		case ClearManagerDownloads:
-			result = QDir(cTempDir()).removeRecursively();
+			result = RemoveOldTempDirs();
+			if (!QDir(cTempDir()).removeRecursively()) result = false;
 		break;
-		case ClearManagerStorage:
+		case ClearManagerStorage: {
+			auto keys = Storage::MediaCache::Keys();
+			keys.reserve(images.size() + stickers.size() + audios.size() + webFiles.size());
 			for (StorageMap::const_iterator i = images.cbegin(), e = images.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				keys.push_back(i.value().first);
 			}
 			for (StorageMap::const_iterator i = stickers.cbegin(), e = stickers.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				keys.push_back(i.value().first);
 			}
 			for (StorageMap::const_iterator i = audios.cbegin(), e = audios.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				keys.push_back(i.value().first);
 			}
 			for (WebFilesMap::const_iterator i = webFiles.cbegin(), e = webFiles.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				keys.push_back(i.value().first);
+			}
+			// Records written before the media cache was introduced are kept in separate files.
+			// Records found in the cache never had such a file, skip the file system for them.
+			auto legacy = Storage::MediaCache::Keys();
+			if (cache) {
+				legacy.reserve(keys.size());
+				for_const (auto key, keys) {
+					if (!cache->contains(key)) {
+						legacy.push_back(key);
+					}
+				}
+				cache->remove(keys);
+			} else {
+				legacy = keys;
+			}
+			for_const (auto key, legacy) {
+				clearKey(key, FileOption::User);
 			}
 			result = true;
-		break;
+		} break;
 		}
 		{
 			QMutexLocker lock(&data->mutex);
@@ -4707,6 +7284,12 @@ Manager::Manager() {
 	connect(&_mapWriteTimer, SIGNAL(timeout()), this, SLOT(mapWriteTimeout()));
 	_locationsWriteTimer.setSingleShot(true);
 	connect(&_locationsWriteTimer, SIGNAL(timeout()), this, SLOT(locationsWriteTimeout()));
+	_historyMessagesWriteTimer.setSingleShot(true);
+	connect(&_historyMessagesWriteTimer, SIGNAL(timeout()), this, SLOT(historyMessagesWriteTimeout()));
+	_voiceWaveformsWriteTimer.setSingleShot(true);
+	connect(&_voiceWaveformsWriteTimer, SIGNAL(timeout()), this, SLOT(voiceWaveformsWriteTimeout()));
+	_webPagesWriteTimer.setSingleShot(true);
+	connect(&_webPagesWriteTimer, SIGNAL(timeout()), this, SLOT(webPagesWriteTimeout()));
 }
 
 void Manager::writeMap(bool fast) {
@@ -4733,6 +7316,42 @@ void Manager::writingLocations() {
 	_locationsWriteTimer.stop();
 }
 
+void Manager::writeHistoryMessages(bool fast) {
+	if (!_historyMessagesWriteTimer.isActive() || fast) {
+		_historyMessagesWriteTimer.start(fast ? 1 : WriteMapTimeout);
+	} else if (_historyMessagesWriteTimer.remainingTime() <= 0) {
+		historyMessagesWriteTimeout();
+	}
+}
+
+void Manager::writingHistoryMessages() {
+	_historyMessagesWriteTimer.stop();
+}
+
+void Manager::writeVoiceWaveforms(bool fast) {
+	if (!_voiceWaveformsWriteTimer.isActive() || fast) {
+		_voiceWaveformsWriteTimer.start(fast ? 1 : WriteMapTimeout);
+	} else if (_voiceWaveformsWriteTimer.remainingTime() <= 0) {
+		voiceWaveformsWriteTimeout();
+	}
+}
+
+void Manager::writingVoiceWaveforms() {
+	_voiceWaveformsWriteTimer.stop();
+}
+
+void Manager::writeWebPages(bool fast) {
+	if (!_webPagesWriteTimer.isActive() || fast) {
+		_webPagesWriteTimer.start(fast ? 1 : WriteMapTimeout);
+	} else if (_webPagesWriteTimer.remainingTime() <= 0) {
+		webPagesWriteTimeout();
+	}
+}
+
+void Manager::writingWebPages() {
+	_webPagesWriteTimer.stop();
+}
+
 void Manager::mapWriteTimeout() {
 	_writeMap(WriteMapWhen::Now);
 }
@@ -4741,6 +7360,18 @@ void Manager::locationsWriteTimeout() {
 	_writeLocations(WriteMapWhen::Now);
 }
 
+void Manager::historyMessagesWriteTimeout() {
+	_writeHistoryMessages();
+}
+
+void Manager::voiceWaveformsWriteTimeout() {
+	_writeVoiceWaveforms();
+}
+
+void Manager::webPagesWriteTimeout() {
+	_writeWebPages();
+}
+
 void Manager::finish() {
 	if (_mapWriteTimer.isActive()) {
 		mapWriteTimeout();
@@ -4748,6 +7379,15 @@ void Manager::finish() {
 	if (_locationsWriteTimer.isActive()) {
 		locationsWriteTimeout();
 	}
+	if (_historyMessagesWriteTimer.isActive()) {
+		historyMessagesWriteTimeout();
+	}
+	if (_voiceWaveformsWriteTimer.isActive()) {
+		voiceWaveformsWriteTimeout();
+	}
+	if (_webPagesWriteTimer.isActive()) {
+		webPagesWriteTimeout();
+	}
 }
 
 } // namespace internal
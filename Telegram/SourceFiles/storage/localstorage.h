@@ -47,8 +47,10 @@ void writeMtpData();
 
 void reset();
 
-bool checkPasscode(const QByteArray &passcode);
-void setPasscode(const QByteArray &passcode);
+// The passcode key is derived in a background thread,
+// the callbacks are called in the main thread.
+void checkPasscode(const QByteArray &passcode, base::lambda_once<void(bool correct)> done);
+void setPasscode(const QByteArray &passcode, base::lambda_once<void()> done);
 
 enum ClearManagerTask {
 	ClearManagerAll = 0xFFFF,
@@ -87,6 +89,7 @@ enum ReadMapState {
 	ReadMapPassNeeded = 2,
 };
 ReadMapState readMap(const QByteArray &pass);
+void readMap(const QByteArray &pass, base::lambda_once<void(ReadMapState state)> done);
 int32 oldMapVersion();
 
 int32 oldSettingsVersion();
@@ -107,6 +110,16 @@ void writeDraftCursors(const PeerId &peer, const MessageCursor &localCursor, con
 bool hasDraftCursors(const PeerId &peer);
 bool hasDraft(const PeerId &peer);
 
+// Newest messages of the histories, to show a history before the server replies.
+void writeHistoryMessages(not_null<History*> history, const QVector<MTPMessage> &slice);
+void changeHistoryMessageId(not_null<History*> history, MsgId wasId, MsgId nowId);
+void editHistoryMessage(const PeerId &peer, const MTPMessage &message);
+void removeHistoryMessage(const PeerId &peer, MsgId msgId);
+void clearHistoryMessages(const PeerId &peer);
+bool readHistoryMessages(not_null<History*> history);
+QVector<MTPMessage> readStoredHistoryMessages(const PeerId &peer); // newest first
+bool readStoredHistoryMessage(const PeerId &peer, MsgId msgId, MTPMessage *result);
+
 void writeFileLocation(MediaKey location, const FileLocation &local);
 FileLocation readFileLocation(MediaKey location, bool check = true);
 
@@ -115,6 +128,10 @@ void writeImage(const StorageKey &location, const StorageImageSaved &jpeg, bool
 TaskId startImageLoad(const StorageKey &location, mtpFileLoader *loader);
 int32 hasImages();
 qint64 storageImagesSize();
+StorageKey videoPosterKey(DocumentId document);
+void writeVideoPoster(const StorageKey &key, const QImage &poster);
+TaskId startVideoPosterLoad(const StorageKey &key, base::lambda<void(QImage &&poster)> done);
+bool willVideoPosterLoad(const StorageKey &key);
 
 void writeStickerImage(const StorageKey &location, const QByteArray &data, bool overwrite = true);
 TaskId startStickerImageLoad(const StorageKey &location, mtpFileLoader *loader);
@@ -123,6 +140,12 @@ bool copyStickerImage(const StorageKey &oldLocation, const StorageKey &newLocati
 int32 hasStickers();
 qint64 storageStickersSize();
 
+// Display-size premultiplied sticker bitmaps, kept next to the sticker images.
+StorageKey stickerRasterKey(DocumentId document, QSize size);
+void writeStickerRaster(const StorageKey &key, const QImage &raster);
+TaskId startStickerRasterLoad(const StorageKey &key, base::lambda<void(QImage &&raster)> done);
+bool willStickerRasterLoad(const StorageKey &key);
+
 void writeAudio(const StorageKey &location, const QByteArray &data, bool overwrite = true);
 TaskId startAudioLoad(const StorageKey &location, mtpFileLoader *loader);
 bool copyAudio(const StorageKey &oldLocation, const StorageKey &newLocation);
@@ -136,8 +159,19 @@ qint64 storageWebFilesSize();
 
 void countVoiceWaveform(DocumentData *document);
 
+// Resolved web pages are kept for a week, so pending link previews of the
+// locally stored messages are shown without asking the server again.
+void writeWebPage(const MTPWebPage &webpage);
+bool hasWebPage(WebPageId id);
+bool readWebPage(WebPageId id, MTPWebPage *result);
+
 void cancelTask(TaskId id);
 
+// Sticker sets and saved gifs are read in the background after start.
+// Call ensureStickersAndGifsRead() before working with them.
+void startStickersAndGifsRead();
+void ensureStickersAndGifsRead();
+
 void writeInstalledStickers();
 void writeFeaturedStickers();
 void writeRecentStickers();
@@ -169,6 +203,9 @@ bool copyThemeColorsToPalette(const QString &file);
 
 void writeLangPack();
 
+// Writes only the strings changed since the last writeLangPack().
+void writeLangPackDifference();
+
 void writeRecentHashtagsAndBots();
 void readRecentHashtagsAndBots();
 
@@ -176,11 +213,41 @@ void addSavedPeer(PeerData *peer, const QDateTime &position);
 void removeSavedPeer(PeerData *peer);
 void readSavedPeers();
 
+// Top of the chats list, shown at startup until the server dialogs arrive.
+struct DialogsSnapshotEntry {
+	PeerData *peer = nullptr;
+	QDateTime date;
+	int unreadCount = 0;
+};
+void writeDialogsSnapshot(const QVector<DialogsSnapshotEntry> &entries);
+QVector<DialogsSnapshotEntry> readDialogsSnapshot();
+
 void writeReportSpamStatuses();
 
 void makeBotTrusted(UserData *bot);
 bool isBotTrusted(UserData *bot);
 
+// Completed parts of documents downloaded straight to disk, to continue them after a restart.
+void writeDownloadParts(const MediaKey &location, const QString &path, const QByteArray &parts);
+bool readDownloadParts(const MediaKey &location, QString *path, QByteArray *parts);
+void removeDownloadParts(const MediaKey &location);
+
+// Documents already uploaded by us, the filename must match as the server document keeps it.
+void writeUploadedFile(const QByteArray &contentHash, const QString &filename, const DocumentId &id, const uint64 &accessHash);
+bool readUploadedFile(const QByteArray &contentHash, const QString &filename, DocumentId *id, uint64 *accessHash);
+void removeUploadedFile(const QByteArray &contentHash);
+
+struct WriterStats {
+	int queueDepth = 0;
+	int maxQueueDepth = 0;
+	int64 written = 0;
+	int64 coalesced = 0; // writes replaced by a later write of the same file
+	int64 overflowed = 0; // writes done in the calling thread because the queue was full
+	TimeMs averageLatency = 0;
+	TimeMs maxLatency = 0;
+};
+WriterStats writerStats();
+
 bool encrypt(const void *src, void *dst, uint32 len, const void *key128);
 bool decrypt(const void *src, void *dst, uint32 len, const void *key128);
 
@@ -196,15 +263,27 @@ public:
 	void writingMap();
 	void writeLocations(bool fast);
 	void writingLocations();
+	void writeHistoryMessages(bool fast);
+	void writingHistoryMessages();
+	void writeVoiceWaveforms(bool fast);
+	void writingVoiceWaveforms();
+	void writeWebPages(bool fast);
+	void writingWebPages();
 	void finish();
 
 public slots:
 	void mapWriteTimeout();
 	void locationsWriteTimeout();
+	void historyMessagesWriteTimeout();
+	void voiceWaveformsWriteTimeout();
+	void webPagesWriteTimeout();
 
 private:
 	QTimer _mapWriteTimer;
 	QTimer _locationsWriteTimer;
+	QTimer _historyMessagesWriteTimer;
+	QTimer _voiceWaveformsWriteTimer;
+	QTimer _webPagesWriteTimer;
 
 };
 
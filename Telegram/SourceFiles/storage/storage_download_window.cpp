@@ -0,0 +1,106 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/storage_download_window.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kMinWindow = 2;
+constexpr auto kMaxWindow = 64;
+constexpr auto kMinInterval = TimeMs(500);
+constexpr auto kIdleTimeout = TimeMs(5000); // start measuring from scratch after that
+constexpr auto kMinRttLifetime = TimeMs(10000); // forget the minimal rtt after that
+constexpr auto kQueueingRttFactor = 2; // rtt this times bigger than minimal means queueing
+
+} // namespace
+
+void DownloadWindow::sent(int inFlight) {
+	if (inFlight >= _limit) {
+		_intervalLimited = true;
+	}
+}
+
+void DownloadWindow::received(TimeMs rtt, int bytes) {
+	auto now = getms();
+	if (!_lastReceived || now - _lastReceived > kIdleTimeout) {
+		_intervalStart = now;
+		_intervalBytes = 0;
+		_intervalLimited = false;
+	}
+	_lastReceived = now;
+
+	accumulate_max(rtt, TimeMs(1));
+	_rtt = _rtt ? ((_rtt * 7 + rtt) / 8) : rtt;
+	if (!_minRtt || rtt <= _minRtt || now - _minRttUpdated > kMinRttLifetime) {
+		_minRtt = rtt;
+		_minRttUpdated = now;
+	}
+
+	_intervalBytes += bytes;
+	if (now - _intervalStart >= qMax(2 * _rtt, kMinInterval)) {
+		adjust(now);
+	}
+}
+
+void DownloadWindow::failed() {
+	setLimit(_limit / 2);
+	_intervalStart = getms();
+	_intervalBytes = 0;
+	_intervalLimited = false;
+}
+
+void DownloadWindow::adjust(TimeMs now) {
+	auto goodput = (_intervalBytes * 1000) / (now - _intervalStart);
+	auto queueing = (_rtt > _minRtt * kQueueingRttFactor);
+	auto improved = (goodput > _goodput + _goodput / 10);
+	if (_intervalLimited && (improved || !queueing)) {
+		setLimit(_limit + qMax(_limit / 4, 1));
+	} else if (queueing && !improved) {
+		setLimit(_limit - qMax(_limit / 8, 1));
+	}
+	_goodput = goodput;
+	_intervalStart = now;
+	_intervalBytes = 0;
+	_intervalLimited = false;
+}
+
+void DownloadWindow::setLimit(int limit) {
+	limit = snap(limit, kMinWindow, kMaxWindow);
+	if (_limit != limit) {
+		if (DebugLogging::FileLoader()) {
+			DEBUG_LOG(("Download Info: window %1 -> %2, rtt %3 (min %4), goodput %5").arg(_limit).arg(limit).arg(_rtt).arg(_minRtt).arg(_goodput));
+		}
+		_limit = limit;
+	}
+}
+
+DownloadWindowStats DownloadWindow::stats(MTP::DcId dcId, int inFlight) const {
+	auto result = DownloadWindowStats();
+	result.dcId = dcId;
+	result.limit = _limit;
+	result.inFlight = inFlight;
+	result.rtt = _rtt;
+	result.minRtt = _minRtt;
+	result.goodput = _goodput;
+	return result;
+}
+
+} // namespace Storage
@@ -0,0 +1,73 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Storage {
+
+struct DownloadWindowStats {
+	MTP::DcId dcId = 0;
+	int limit = 0;
+	int inFlight = 0;
+	TimeMs rtt = 0;
+	TimeMs minRtt = 0;
+	int64 goodput = 0; // bytes per second
+};
+
+// Controls the count of file parts requested at the same time from one dc.
+//
+// The window grows while it is the limiting factor and the round trip time
+// stays close to the minimal observed one or the goodput keeps growing,
+// and shrinks when the requests start waiting in queues without any goodput
+// gain or when requests fail.
+class DownloadWindow {
+public:
+	int limit() const {
+		return _limit;
+	}
+	int64 goodput() const {
+		return _goodput;
+	}
+
+	// Must be called after a request was sent, inFlight includes it.
+	void sent(int inFlight);
+	void received(TimeMs rtt, int bytes);
+	void failed();
+
+	DownloadWindowStats stats(MTP::DcId dcId, int inFlight) const;
+
+private:
+	void adjust(TimeMs now);
+	void setLimit(int limit);
+
+	int _limit = 16;
+	TimeMs _rtt = 0; // smoothed
+	TimeMs _minRtt = 0;
+	TimeMs _minRttUpdated = 0;
+	TimeMs _lastReceived = 0;
+
+	TimeMs _intervalStart = 0;
+	int64 _intervalBytes = 0;
+	bool _intervalLimited = false;
+	int64 _goodput = 0;
+
+};
+
+} // namespace Storage
@@ -0,0 +1,116 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/storage_downloaded_parts.h"
+
+namespace Storage {
+DownloadedParts::DownloadedParts(int partSize, int fullSize)
+: _partSize(partSize)
+, _fullSize(fullSize)
+, _parts((fullSize + partSize - 1) / partSize, false) {
+	Expects(partSize > 0);
+	Expects(fullSize > 0);
+}
+
+int DownloadedParts::index(int offset) const {
+	return offset / _partSize;
+}
+
+int DownloadedParts::partBytes(int index) const {
+	return qMin(_partSize, _fullSize - index * _partSize);
+}
+
+bool DownloadedParts::completed(int offset) const {
+	auto i = index(offset);
+	return (i >= 0 && i < count()) ? _parts[i] : false;
+}
+
+void DownloadedParts::setCompleted(int offset, int bytes) {
+	auto i = index(offset);
+	if (i < 0 || i >= count() || _parts[i]) {
+		return;
+	}
+	_parts[i] = true;
+	++_completedCount;
+	_completedBytes += bytes;
+}
+
+void DownloadedParts::setMissing(int offset) {
+	auto i = index(offset);
+	if (i < 0 || i >= count() || !_parts[i]) {
+		return;
+	}
+	_parts[i] = false;
+	--_completedCount;
+	_completedBytes -= partBytes(i);
+}
+
+int DownloadedParts::firstMissing(int offset) const {
+	for (auto i = index(offset), till = count(); i < till; ++i) {
+		if (!_parts[i]) {
+			return qMax(i * _partSize, offset);
+		}
+	}
+	return _fullSize;
+}
+
+QByteArray DownloadedParts::serialize() const {
+	auto bitmap = QByteArray((count() + 7) / 8, 0);
+	for (auto i = 0, till = count(); i < till; ++i) {
+		if (_parts[i]) {
+			bitmap[i / 8] = char(bitmap.at(i / 8) | (1 << (i % 8)));
+		}
+	}
+
+	auto result = QByteArray();
+	{
+		QDataStream stream(&result, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream << qint32(_partSize) << qint32(_fullSize) << bitmap;
+	}
+	return result;
+}
+
+bool DownloadedParts::deserialize(const QByteArray &serialized) {
+	QDataStream stream(serialized);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto partSize = qint32(0), fullSize = qint32(0);
+	auto bitmap = QByteArray();
+	stream >> partSize >> fullSize >> bitmap;
+	if (stream.status() != QDataStream::Ok
+		|| partSize != _partSize
+		|| fullSize != _fullSize
+		|| bitmap.size() != (count() + 7) / 8) {
+		return false;
+	}
+
+	_completedCount = _completedBytes = 0;
+	for (auto i = 0, till = count(); i < till; ++i) {
+		_parts[i] = (bitmap.at(i / 8) & (1 << (i % 8))) != 0;
+		if (_parts[i]) {
+			++_completedCount;
+			_completedBytes += partBytes(i);
+		}
+	}
+	return true;
+}
+
+} // namespace Storage
@@ -0,0 +1,71 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Storage {
+
+// Completed parts of a file that is downloaded straight to its destination.
+//
+// The parts bitmap is serialized to the local storage together with the
+// destination path, so that the download could continue after a restart.
+class DownloadedParts {
+public:
+	DownloadedParts(int partSize, int fullSize);
+
+	int partSize() const {
+		return _partSize;
+	}
+	int fullSize() const {
+		return _fullSize;
+	}
+	int count() const {
+		return _parts.size();
+	}
+	int completedBytes() const {
+		return _completedBytes;
+	}
+	bool finished() const {
+		return (_completedCount == count());
+	}
+
+	bool completed(int offset) const;
+	void setCompleted(int offset, int bytes);
+	void setMissing(int offset);
+
+	// Returns the first offset not less than the given one that was not downloaded yet.
+	int firstMissing(int offset) const;
+
+	QByteArray serialize() const;
+	bool deserialize(const QByteArray &serialized);
+
+private:
+	int index(int offset) const;
+	int partBytes(int index) const;
+
+	int _partSize = 0;
+	int _fullSize = 0;
+	std::vector<bool> _parts;
+	int _completedCount = 0;
+	int _completedBytes = 0;
+
+};
+
+} // namespace Storage
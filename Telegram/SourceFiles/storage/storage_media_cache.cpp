@@ -0,0 +1,580 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/storage_media_cache.h"
+
+#include "core/trace.h"
+
+namespace Storage {
+namespace {
+
+constexpr char kIndexMagic[] = { 'T', 'D', 'C', '$' };
+constexpr auto kIndexMagicLength = int(sizeof(kIndexMagic));
+constexpr auto kIndexVersion = qint32(1);
+constexpr auto kSegmentSizeLimit = qint64(64 * 1024 * 1024);
+constexpr auto kRecordSizeLimit = qint32(256 * 1024 * 1024);
+
+// Compact a segment when more than a half of it is occupied by removed records.
+constexpr auto kCompactMinimalGarbage = qint64(4 * 1024 * 1024);
+
+// Evict records until the cache takes not more than 90% of the size limit.
+constexpr auto kEvictToPercent = 90;
+
+struct RecordHeader {
+	quint64 key = 0;
+	qint32 size = 0;
+	qint32 checksum = 0;
+};
+constexpr auto kRecordHeaderSize = qint32(sizeof(RecordHeader));
+
+qint64 recordFullSize(qint32 size) {
+	return kRecordHeaderSize + qint64(size);
+}
+
+} // namespace
+
+MediaCache::MediaCache(const QString &path, qint64 sizeLimit)
+: _path(path)
+, _sizeLimit(sizeLimit) {
+}
+
+QString MediaCache::segmentPath(int segment) const {
+	return _path + qsl("segment") + QString::number(segment);
+}
+
+bool MediaCache::open() {
+	QMutexLocker lock(&_mutex);
+	if (!QDir().exists(_path) && !QDir().mkpath(_path)) {
+		LOG(("Media Cache Error: could not create '%1'").arg(_path));
+		return false;
+	}
+	if (!tryReadIndex()) {
+		_index.clear();
+		_segments.clear();
+	}
+
+	// Recover records that were written after the last index write
+	// and forget about segments that disappeared.
+	auto existing = QMap<int, qint64>();
+	auto files = QDir(_path).entryInfoList(QStringList(qsl("segment*")), QDir::Files);
+	for_const (auto &info, files) {
+		auto ok = false;
+		auto segment = info.fileName().mid(qstr("segment").size()).toInt(&ok);
+		if (ok && segment > 0) {
+			existing.insert(segment, info.size());
+		}
+	}
+	for (auto i = _index.begin(); i != _index.end();) {
+		auto j = existing.constFind(i->segment);
+		if (j == existing.cend() || i->offset + recordFullSize(i->size) > j.value()) {
+			i = _index.erase(i);
+			_indexChanged = true;
+		} else {
+			++i;
+		}
+	}
+	for (auto i = _segments.begin(); i != _segments.end();) {
+		if (!existing.contains(i.key())) {
+			i = _segments.erase(i);
+		} else {
+			++i;
+		}
+	}
+	for (auto i = existing.cbegin(), e = existing.cend(); i != e; ++i) {
+		auto j = _segments.find(i.key());
+		if (j == _segments.end()) {
+			_segments.insert(i.key(), Segment());
+			scanSegment(i.key(), 0);
+		} else if (i.value() > j->size) {
+			scanSegment(i.key(), j->size);
+		}
+	}
+
+	_alive = 0;
+	for (auto &segment : _segments) {
+		segment.alive = 0;
+	}
+	for_const (auto &entry, _index) {
+		auto full = recordFullSize(entry.size);
+		_segments[entry.segment].alive += full;
+		_alive += full;
+		accumulate_max(_usedCounter, entry.used);
+	}
+
+	_writingSegment = _segments.isEmpty() ? 1 : _segments.lastKey();
+	if (!openWriting()) {
+		return false;
+	}
+	LOG(("Media Cache Info: opened with %1 records in %2 segments, %3 bytes").arg(_index.size()).arg(_segments.size()).arg(_alive));
+	return true;
+}
+
+bool MediaCache::openWriting() {
+	if (_writing.isOpen()) {
+		_writing.close();
+	}
+	_writing.setFileName(segmentPath(_writingSegment));
+	if (!_writing.open(QIODevice::ReadWrite)) {
+		LOG(("Media Cache Error: could not open segment '%1' for writing").arg(_writing.fileName()));
+		return false;
+	}
+	auto &segment = _segments[_writingSegment];
+	if (_writing.size() != segment.size) {
+		// Cut the partially written record, if any.
+		_writing.resize(segment.size);
+	}
+	_writing.seek(segment.size);
+	return true;
+}
+
+bool MediaCache::ensureWritableSegment(qint32 recordSize) {
+	if (!_writing.isOpen() && !openWriting()) {
+		return false;
+	}
+	auto current = _segments.value(_writingSegment).size;
+	if (current > 0 && current + recordFullSize(recordSize) > kSegmentSizeLimit) {
+		++_writingSegment;
+		return openWriting();
+	}
+	return true;
+}
+
+bool MediaCache::tryReadIndex() {
+	QFile f(_path + qsl("index"));
+	if (!f.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	auto bytes = f.readAll();
+	f.close();
+
+	auto dataSize = bytes.size() - int(sizeof(qint32));
+	if (dataSize < kIndexMagicLength || memcmp(bytes.constData(), kIndexMagic, kIndexMagicLength)) {
+		LOG(("Media Cache Error: bad index magic."));
+		return false;
+	}
+	auto checksum = qint32(0);
+	memcpy(&checksum, bytes.constData() + dataSize, sizeof(checksum));
+	if (hashCrc32(bytes.constData(), dataSize) != checksum) {
+		LOG(("Media Cache Error: bad index checksum."));
+		return false;
+	}
+	bytes.resize(dataSize);
+
+	QDataStream stream(bytes);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream.skipRawData(kIndexMagicLength);
+
+	auto version = qint32(0), segmentsCount = qint32(0);
+	stream >> version >> segmentsCount;
+	if (version != kIndexVersion || segmentsCount < 0) {
+		LOG(("Media Cache Error: bad index version %1.").arg(version));
+		return false;
+	}
+	for (auto i = 0; i != segmentsCount; ++i) {
+		auto segment = qint32(0);
+		auto size = qint64(0);
+		stream >> segment >> size;
+		_segments[segment].size = size;
+	}
+	auto entriesCount = qint32(0);
+	stream >> entriesCount;
+	if (stream.status() != QDataStream::Ok || entriesCount < 0) {
+		return false;
+	}
+	_index.reserve(entriesCount);
+	for (auto i = 0; i != entriesCount; ++i) {
+		auto key = Key(0);
+		auto entry = Entry();
+		stream >> key >> entry.segment >> entry.offset >> entry.size >> entry.used;
+		if (!_segments.contains(entry.segment) || entry.size < 0) {
+			return false;
+		}
+		_index.insert(key, entry);
+	}
+	return (stream.status() == QDataStream::Ok);
+}
+
+void MediaCache::scanSegment(int segment, qint64 from) {
+	QFile f(segmentPath(segment));
+	if (!f.open(QIODevice::ReadOnly) || !f.seek(from)) {
+		return;
+	}
+	auto offset = from;
+	auto total = f.size();
+	auto recovered = 0;
+	while (offset + kRecordHeaderSize <= total) {
+		auto header = RecordHeader();
+		if (f.read(reinterpret_cast<char*>(&header), kRecordHeaderSize) != kRecordHeaderSize) {
+			break;
+		}
+		if (header.size < 0 || header.size > kRecordSizeLimit || offset + recordFullSize(header.size) > total) {
+			break;
+		}
+		auto data = f.read(header.size);
+		if (data.size() != header.size || hashCrc32(data.constData(), data.size()) != header.checksum) {
+			break;
+		}
+		auto entry = Entry();
+		entry.segment = segment;
+		entry.offset = offset;
+		entry.size = header.size;
+		entry.used = ++_usedCounter;
+		_index.insert(header.key, entry);
+		offset += recordFullSize(header.size);
+		++recovered;
+	}
+	if (recovered) {
+		LOG(("Media Cache Info: recovered %1 records from segment %2").arg(recovered).arg(segment));
+		_indexChanged = true;
+	}
+
+	// Everything after offset is a partially written record, it will be cut.
+	_segments[segment].size = offset;
+}
+
+bool MediaCache::writeRecord(Key key, const QByteArray &data, Entry *entry) {
+	if (!ensureWritableSegment(data.size())) {
+		return false;
+	}
+	auto &segment = _segments[_writingSegment];
+
+	auto header = RecordHeader();
+	header.key = key;
+	header.size = data.size();
+	header.checksum = hashCrc32(data.constData(), data.size());
+	if (_writing.write(reinterpret_cast<const char*>(&header), kRecordHeaderSize) != kRecordHeaderSize
+		|| _writing.write(data) != data.size()
+		|| !_writing.flush()) {
+		LOG(("Media Cache Error: could not write to segment %1").arg(_writingSegment));
+		_writing.close();
+		return false;
+	}
+	entry->segment = _writingSegment;
+	entry->offset = segment.size;
+	entry->size = data.size();
+
+	auto full = recordFullSize(data.size());
+	segment.size += full;
+	segment.alive += full;
+	_alive += full;
+	_indexChanged = true;
+	return true;
+}
+
+bool MediaCache::readRecord(Key key, const Entry &entry, QByteArray *result) const {
+	QFile f(segmentPath(entry.segment));
+	if (!f.open(QIODevice::ReadOnly) || !f.seek(entry.offset)) {
+		return false;
+	}
+	auto header = RecordHeader();
+	if (f.read(reinterpret_cast<char*>(&header), kRecordHeaderSize) != kRecordHeaderSize) {
+		return false;
+	}
+	if (header.key != key || header.size != entry.size) {
+		return false;
+	}
+	auto data = f.read(header.size);
+	if (data.size() != header.size || hashCrc32(data.constData(), data.size()) != header.checksum) {
+		return false;
+	}
+	*result = data;
+	return true;
+}
+
+MediaCache::Keys MediaCache::put(Key key, const QByteArray &data) {
+	TRACE_SCOPE("MediaCache::put");
+	QMutexLocker lock(&_mutex);
+	removeLocked(key);
+
+	auto entry = Entry();
+	if (!writeRecord(key, data, &entry)) {
+		return Keys();
+	}
+	entry.used = ++_usedCounter;
+	_index.insert(key, entry);
+
+	return (_alive > _sizeLimit) ? evictLocked() : Keys();
+}
+
+QByteArray MediaCache::get(Key key) {
+	TRACE_SCOPE("MediaCache::get");
+	auto entry = Entry();
+	{
+		QMutexLocker lock(&_mutex);
+		auto i = _index.find(key);
+		if (i == _index.end()) {
+			return QByteArray();
+		}
+		i->used = ++_usedCounter;
+		entry = i.value();
+	}
+
+	auto result = QByteArray();
+	if (readRecord(key, entry, &result)) {
+		return result;
+	}
+
+	// The record could be moved by compaction while we were reading it.
+	QMutexLocker lock(&_mutex);
+	auto i = _index.constFind(key);
+	if (i == _index.cend()) {
+		return QByteArray();
+	} else if (i->segment != entry.segment || i->offset != entry.offset) {
+		if (readRecord(key, i.value(), &result)) {
+			return result;
+		}
+	}
+	LOG(("Media Cache Error: could not read record from segment %1").arg(i->segment));
+	auto segment = i->segment;
+	removeLocked(key);
+	removeSegmentIfEmpty(segment);
+	return QByteArray();
+}
+
+bool MediaCache::contains(Key key) const {
+	QMutexLocker lock(&_mutex);
+	return _index.contains(key);
+}
+
+void MediaCache::removeLocked(Key key) {
+	auto i = _index.find(key);
+	if (i == _index.end()) {
+		return;
+	}
+	auto full = recordFullSize(i->size);
+	_segments[i->segment].alive -= full;
+	_alive -= full;
+	_index.erase(i);
+	_indexChanged = true;
+}
+
+void MediaCache::removeSegmentIfEmpty(int segment) {
+	auto i = _segments.find(segment);
+	if (i == _segments.end() || i->alive > 0) {
+		return;
+	}
+	if (segment == _writingSegment) {
+		if (i->size > 0 && _writing.isOpen() && _writing.resize(0)) {
+			_writing.seek(0);
+			i->size = 0;
+			_indexChanged = true;
+		}
+	} else if (QFile::remove(segmentPath(segment))) {
+		_segments.erase(i);
+		_indexChanged = true;
+	}
+}
+
+void MediaCache::remove(Key key) {
+	QMutexLocker lock(&_mutex);
+	auto i = _index.constFind(key);
+	if (i != _index.cend()) {
+		auto segment = i->segment;
+		removeLocked(key);
+		removeSegmentIfEmpty(segment);
+	}
+}
+
+void MediaCache::remove(const Keys &keys) {
+	QMutexLocker lock(&_mutex);
+	for_const (auto key, keys) {
+		removeLocked(key);
+	}
+	for (auto segment : _segments.keys()) {
+		removeSegmentIfEmpty(segment);
+	}
+}
+
+void MediaCache::clear() {
+	QMutexLocker lock(&_mutex);
+	_writing.close();
+	for (auto segment : _segments.keys()) {
+		QFile::remove(segmentPath(segment));
+	}
+	QFile::remove(_path + qsl("index"));
+	_index.clear();
+	_segments.clear();
+	_alive = 0;
+	_indexChanged = false;
+	_writingSegment = 1;
+	openWriting();
+}
+
+MediaCache::Keys MediaCache::evictLocked() {
+	struct Used {
+		quint64 used;
+		Key key;
+		inline bool operator<(const Used &other) const {
+			return used < other.used;
+		}
+	};
+	auto sorted = std::vector<Used>();
+	sorted.reserve(_index.size());
+	for (auto i = _index.cbegin(), e = _index.cend(); i != e; ++i) {
+		sorted.push_back({ i->used, i.key() });
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	auto result = Keys();
+	auto limit = (_sizeLimit / 100) * kEvictToPercent;
+	for (auto i = sorted.cbegin(), e = sorted.cend(); i != e && _alive > limit; ++i) {
+		removeLocked(i->key);
+		result.push_back(i->key);
+	}
+	for (auto segment : _segments.keys()) {
+		removeSegmentIfEmpty(segment);
+	}
+	LOG(("Media Cache Info: evicted %1 records, %2 bytes left").arg(result.size()).arg(_alive));
+	return result;
+}
+
+void MediaCache::writeIndex() {
+	auto bytes = QByteArray();
+	{
+		QMutexLocker lock(&_mutex);
+		if (!_indexChanged) {
+			return;
+		}
+		_indexChanged = false;
+
+		auto size = kIndexMagicLength + 2 * sizeof(qint32);
+		size += _segments.size() * (sizeof(qint32) + sizeof(qint64));
+		size += sizeof(qint32) + _index.size() * (sizeof(quint64) + sizeof(qint32) + sizeof(qint64) + sizeof(qint32) + sizeof(quint64));
+		bytes.reserve(size + sizeof(qint32));
+		{
+			QBuffer buffer(&bytes);
+			buffer.open(QIODevice::WriteOnly);
+			buffer.write(kIndexMagic, kIndexMagicLength);
+
+			QDataStream stream(&buffer);
+			stream.setVersion(QDataStream::Qt_5_1);
+			stream << kIndexVersion << qint32(_segments.size());
+			for (auto i = _segments.cbegin(), e = _segments.cend(); i != e; ++i) {
+				stream << qint32(i.key()) << qint64(i->size);
+			}
+			stream << qint32(_index.size());
+			for (auto i = _index.cbegin(), e = _index.cend(); i != e; ++i) {
+				stream << quint64(i.key()) << qint32(i->segment) << qint64(i->offset) << qint32(i->size) << quint64(i->used);
+			}
+		}
+	}
+	auto checksum = hashCrc32(bytes.constData(), bytes.size());
+	bytes.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+	QSaveFile f(_path + qsl("index"));
+	if (!f.open(QIODevice::WriteOnly) || f.write(bytes) != bytes.size() || !f.commit()) {
+		LOG(("Media Cache Error: could not write index."));
+		QMutexLocker lock(&_mutex);
+		_indexChanged = true;
+	}
+}
+
+int MediaCache::chooseCompactionSegment() const {
+	auto result = 0;
+	auto maxGarbage = qint64(0);
+	for (auto i = _segments.cbegin(), e = _segments.cend(); i != e; ++i) {
+		if (i.key() == _writingSegment) {
+			continue;
+		}
+		auto garbage = i->size - i->alive;
+		if (garbage * 2 > i->size && garbage >= kCompactMinimalGarbage && garbage > maxGarbage) {
+			maxGarbage = garbage;
+			result = i.key();
+		} else if (i->alive <= 0 && !result) {
+			result = i.key();
+		}
+	}
+	return result;
+}
+
+bool MediaCache::compactionNeeded() const {
+	QMutexLocker lock(&_mutex);
+	return !_compacting && (chooseCompactionSegment() != 0);
+}
+
+void MediaCache::compact() {
+	auto segment = 0;
+	auto moving = QVector<QPair<Key, Entry>>();
+	{
+		QMutexLocker lock(&_mutex);
+		if (_compacting) {
+			return;
+		}
+		segment = chooseCompactionSegment();
+		if (!segment) {
+			return;
+		}
+		_compacting = true;
+		for (auto i = _index.cbegin(), e = _index.cend(); i != e; ++i) {
+			if (i->segment == segment) {
+				moving.push_back(qMakePair(i.key(), i.value()));
+			}
+		}
+	}
+
+	auto moved = 0;
+	for_const (auto &record, moving) {
+		auto data = QByteArray();
+		auto read = readRecord(record.first, record.second, &data);
+
+		QMutexLocker lock(&_mutex);
+		auto i = _index.find(record.first);
+		if (i == _index.end() || i->segment != record.second.segment || i->offset != record.second.offset) {
+			continue; // Removed or replaced while we were working.
+		}
+		auto used = i->used;
+		removeLocked(record.first);
+		if (!read) {
+			continue;
+		}
+		auto entry = Entry();
+		if (writeRecord(record.first, data, &entry)) {
+			entry.used = used;
+			_index.insert(record.first, entry);
+			++moved;
+		}
+	}
+
+	QMutexLocker lock(&_mutex);
+	removeSegmentIfEmpty(segment);
+	_compacting = false;
+	LOG(("Media Cache Info: compacted segment %1, moved %2 records").arg(segment).arg(moved));
+}
+
+qint64 MediaCache::size() const {
+	QMutexLocker lock(&_mutex);
+	return _alive;
+}
+
+int MediaCache::count() const {
+	QMutexLocker lock(&_mutex);
+	return _index.size();
+}
+
+qint64 MediaCache::indexBytes() const {
+	QMutexLocker lock(&_mutex);
+	return qint64(_index.size()) * (sizeof(Key) + sizeof(Entry));
+}
+
+MediaCache::~MediaCache() {
+	writeIndex();
+}
+
+} // namespace Storage
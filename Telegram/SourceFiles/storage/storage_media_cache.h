@@ -0,0 +1,105 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Storage {
+
+// Packed storage for small cached media records (images, stickers, audios, web files).
+//
+// Records are appended to a few large segment files, an index maps the record key
+// to its place in the segment. The cache does not know anything about the record
+// contents, Local encrypts them with LocalKey before putting them here.
+//
+// All methods are thread-safe: writes come from the main thread, reads come from
+// the local loader thread and compaction runs in the local loader thread as well.
+class MediaCache {
+public:
+	using Key = quint64;
+	using Keys = QVector<Key>;
+
+	MediaCache(const QString &path, qint64 sizeLimit);
+
+	// Reads the index (or rebuilds it from segments) and prepares for writing.
+	bool open();
+
+	// Returns the keys that were evicted to fit the size limit.
+	Keys put(Key key, const QByteArray &data);
+	QByteArray get(Key key);
+	bool contains(Key key) const;
+	void remove(Key key);
+	void remove(const Keys &keys);
+	void clear();
+
+	// Writes the index if it was changed since the last write.
+	void writeIndex();
+
+	bool compactionNeeded() const;
+	void compact();
+
+	qint64 size() const;
+	int count() const;
+
+	// Memory held by the index of the records.
+	qint64 indexBytes() const;
+
+	~MediaCache();
+
+private:
+	struct Entry {
+		int segment = 0;
+		qint64 offset = 0;
+		qint32 size = 0;
+		quint64 used = 0;
+	};
+	struct Segment {
+		qint64 size = 0; // size of the file, including removed records
+		qint64 alive = 0; // size of the records still present in the index
+	};
+
+	QString segmentPath(int segment) const;
+	bool openWriting();
+	bool ensureWritableSegment(qint32 recordSize);
+	bool tryReadIndex();
+	void scanSegment(int segment, qint64 from);
+	bool writeRecord(Key key, const QByteArray &data, Entry *entry);
+	bool readRecord(Key key, const Entry &entry, QByteArray *result) const;
+	void removeLocked(Key key);
+	void removeSegmentIfEmpty(int segment);
+	Keys evictLocked();
+	int chooseCompactionSegment() const;
+
+	const QString _path;
+	const qint64 _sizeLimit;
+
+	mutable QMutex _mutex;
+	QHash<Key, Entry> _index;
+	QMap<int, Segment> _segments;
+	qint64 _alive = 0;
+	quint64 _usedCounter = 0;
+	bool _indexChanged = false;
+	bool _compacting = false;
+
+	int _writingSegment = 0;
+	QFile _writing;
+
+};
+
+} // namespace Storage
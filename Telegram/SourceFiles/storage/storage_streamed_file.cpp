@@ -0,0 +1,87 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/storage_streamed_file.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kInterruptCheckTimeout = 100; // check if the reader was interrupted each 100ms
+
+} // namespace
+
+StreamedFile::StreamedFile(const QString &path, const DownloadedParts &parts)
+: _path(path)
+, _size(parts.fullSize())
+, _parts(parts) {
+}
+
+void StreamedFile::setRequestHandler(base::lambda<void(int offset)> handler) {
+	QMutexLocker lock(&_mutex);
+	_requestHandler = std::move(handler);
+}
+
+void StreamedFile::partCompleted(int offset, int bytes) {
+	QMutexLocker lock(&_mutex);
+	_parts.setCompleted(offset, bytes);
+	if (_requested >= 0 && _parts.completed(_requested)) {
+		_requested = -1;
+	}
+	_condition.wakeAll();
+}
+
+void StreamedFile::partMissing(int offset) {
+	QMutexLocker lock(&_mutex);
+	_parts.setMissing(offset);
+}
+
+void StreamedFile::fail() {
+	QMutexLocker lock(&_mutex);
+	_failed = true;
+	_requestHandler = nullptr;
+	_condition.wakeAll();
+}
+
+int64 StreamedFile::waitForData(int64 offset, int64 size, base::lambda<bool()> interrupted) {
+	QMutexLocker lock(&_mutex);
+	if (offset < 0 || offset >= _size || size <= 0) {
+		return 0;
+	}
+	auto partSize = _parts.partSize();
+	while (!_parts.completed(int(offset))) {
+		if (_failed || (interrupted && interrupted())) {
+			return 0;
+		}
+		auto partOffset = int(offset - (offset % partSize));
+		if (_requested != partOffset && _requestHandler) {
+			_requested = partOffset;
+			_requestHandler(partOffset);
+		}
+		_condition.wait(&_mutex, kInterruptCheckTimeout);
+	}
+
+	auto till = offset;
+	while (till < offset + size && till < _size && _parts.completed(int(till))) {
+		till = (till / partSize + 1) * partSize;
+	}
+	return qMin(qMin(till, int64(_size)), offset + size) - offset;
+}
+
+} // namespace Storage
@@ -0,0 +1,67 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include "storage/storage_downloaded_parts.h"
+
+namespace Storage {
+
+// A file that is played while it is still being downloaded straight to disk.
+//
+// Shared between the loader in the main thread and the readers in their own
+// threads: readers block until the data they need is downloaded and ask the
+// loader to download the parts they are waiting for first.
+class StreamedFile {
+public:
+	StreamedFile(const QString &path, const DownloadedParts &parts);
+
+	const QString &path() const {
+		return _path;
+	}
+	int size() const {
+		return _size;
+	}
+
+	// Called by the loader in the main thread.
+	void setRequestHandler(base::lambda<void(int offset)> handler);
+	void partCompleted(int offset, int bytes);
+	void partMissing(int offset);
+	void fail();
+
+	// Called by the readers, blocks until the data at the offset is downloaded.
+	// Returns the count of bytes available from the offset, not more than size,
+	// or zero if the download failed or the reader was interrupted.
+	int64 waitForData(int64 offset, int64 size, base::lambda<bool()> interrupted);
+
+private:
+	const QString _path;
+	const int _size = 0;
+
+	QMutex _mutex;
+	QWaitCondition _condition;
+	DownloadedParts _parts;
+	base::lambda<void(int offset)> _requestHandler;
+	int _requested = -1;
+	bool _failed = false;
+
+};
+
+} // namespace Storage
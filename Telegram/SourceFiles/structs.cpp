@@ -431,7 +431,9 @@ void UserData::setPhoto(const MTPUserProfilePhoto &p) { // see Local::readPeer a
 		const auto &d(p.c_userProfilePhoto());
 		newPhotoId = d.vphoto_id.v;
 		newPhotoLoc = App::imageLocation(160, 160, d.vphoto_small);
-		newPhoto = newPhotoLoc.isNull() ? ImagePtr() : ImagePtr(newPhotoLoc);
+
+		// Peers are fed again on each sync, don't look up the same image in the images cache.
+		newPhoto = newPhotoLoc.isNull() ? ImagePtr() : (newPhotoLoc == photoLoc && _userpic) ? _userpic : ImagePtr(newPhotoLoc);
 		//App::feedPhoto(App::photoFromUserPhoto(peerToUser(id), MTP_int(unixtime()), p));
 	} break;
 	default: {
@@ -642,7 +644,7 @@ void ChatData::setPhoto(const MTPChatPhoto &p, const PhotoId &phId) { // see Loc
 			newPhotoId = phId;
 		}
 		newPhotoLoc = App::imageLocation(160, 160, d.vphoto_small);
-		newPhoto = newPhotoLoc.isNull() ? ImagePtr() : ImagePtr(newPhotoLoc);
+		newPhoto = newPhotoLoc.isNull() ? ImagePtr() : (newPhotoLoc == photoLoc && _userpic) ? _userpic : ImagePtr(newPhotoLoc);
 //		photoFull = newPhoto ? ImagePtr(640, 640, d.vphoto_big, ImagePtr()) : ImagePtr();
 	} break;
 	default: {
@@ -695,7 +697,7 @@ void ChannelData::setPhoto(const MTPChatPhoto &p, const PhotoId &phId) { // see
 			newPhotoId = phId;
 		}
 		newPhotoLoc = App::imageLocation(160, 160, d.vphoto_small);
-		newPhoto = newPhotoLoc.isNull() ? ImagePtr() : ImagePtr(newPhotoLoc);
+		newPhoto = newPhotoLoc.isNull() ? ImagePtr() : (newPhotoLoc == photoLoc && _userpic) ? _userpic : ImagePtr(newPhotoLoc);
 //		photoFull = newPhoto ? ImagePtr(640, 640, d.vphoto_big, newPhoto) : ImagePtr();
 	} break;
 	default: {
@@ -720,6 +722,8 @@ void ChannelData::setName(const QString &newName, const QString &newUsername) {
 void PeerData::updateFull() {
 	if (!_lastFullUpdate || getms(true) > _lastFullUpdate + kUpdateFullPeerTimeout) {
 		updateFullForced();
+	} else {
+		Auth().api().countCachedLookup(ApiWrap::Lookup::FullPeer);
 	}
 }
 
@@ -1707,25 +1711,11 @@ void DocumentData::automaticLoad(const HistoryItem *item) {
 		if (type == StickerDocument) {
 			save(QString(), _actionOnLoad, _actionOnLoadMsgId);
 		} else if (isAnimation()) {
-			bool loadFromCloud = false;
-			if (item) {
-				if (item->history()->peer->isUser()) {
-					loadFromCloud = !(cAutoDownloadGif() & dbiadNoPrivate);
-				} else {
-					loadFromCloud = !(cAutoDownloadGif() & dbiadNoGroups);
-				}
-			} else { // if load at least anywhere
-				loadFromCloud = !(cAutoDownloadGif() & dbiadNoPrivate) || !(cAutoDownloadGif() & dbiadNoGroups);
-			}
+			auto loadFromCloud = Storage::AutoDownloadAllowed(Storage::AutoDownloadType::Gif, item);
 			save(QString(), _actionOnLoad, _actionOnLoadMsgId, loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true);
 		} else if (voice()) {
 			if (item) {
-				bool loadFromCloud = false;
-				if (item->history()->peer->isUser()) {
-					loadFromCloud = !(cAutoDownloadAudio() & dbiadNoPrivate);
-				} else {
-					loadFromCloud = !(cAutoDownloadAudio() & dbiadNoGroups);
-				}
+				auto loadFromCloud = Storage::AutoDownloadAllowed(Storage::AutoDownloadType::Audio, item);
 				save(QString(), _actionOnLoad, _actionOnLoadMsgId, loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true);
 			}
 		}
@@ -1852,6 +1842,10 @@ bool DocumentData::loading() const {
 	return _loader && _loader != CancelledMtpFileLoader;
 }
 
+std::shared_ptr<Storage::StreamedFile> DocumentData::streamedFile() const {
+	return loading() ? _loader->streamedFile() : nullptr;
+}
+
 QString DocumentData::loadingFilePath() const {
 	return loading() ? _loader->fileName() : QString();
 }
@@ -1914,6 +1908,10 @@ void DocumentData::save(const QString &toFile, ActionOnLoad action, const FullMs
 	_actionOnLoadMsgId = actionMsgId;
 	if (_loader) {
 		if (fromCloud == LoadFromCloudOrLocal) _loader->permitLoadFromCloud();
+		if (!autoLoading && type != StickerDocument) _loader->setUserInitiated();
+
+		// Mark the loader visible again, automaticLoad() is called while painting.
+		if (_loader->loading()) _loader->start();
 	} else {
 		status = FileReady;
 		if (!_access && !_url.isEmpty()) {
@@ -1923,6 +1921,9 @@ void DocumentData::save(const QString &toFile, ActionOnLoad action, const FullMs
 		}
 		_loader->connect(_loader, SIGNAL(progress(FileLoader*)), App::main(), SLOT(documentLoadProgress(FileLoader*)));
 		_loader->connect(_loader, SIGNAL(failed(FileLoader*,bool)), App::main(), SLOT(documentLoadFailed(FileLoader*,bool)));
+
+		// Stickers are saved from automaticLoad() without the autoLoading flag.
+		if (!autoLoading && type != StickerDocument) _loader->setUserInitiated();
 		_loader->start();
 	}
 	notifyLayoutChanged();
@@ -2073,6 +2074,44 @@ ImagePtr DocumentData::makeReplyPreview() {
 	return replyPreview;
 }
 
+ImagePtr DocumentData::loadPoster() {
+	if (_poster->isNull() && !_posterRequested) {
+		_posterRequested = true;
+		auto key = Local::videoPosterKey(id);
+		if (Local::willVideoPosterLoad(key)) {
+			auto document = id;
+			Local::startVideoPosterLoad(key, [document](QImage &&poster) {
+				if (poster.isNull()) {
+					return;
+				}
+				auto &documents = App::documentsData();
+				auto i = documents.find(document);
+				if (i != documents.end() && i->second->_poster->isNull()) {
+					i->second->_poster = ImagePtr(App::pixmapFromImageInPlace(std::move(poster)), "JPG");
+					for (auto item : App::documentItems().value(i->second)) {
+						Ui::repaintHistoryItem(item);
+					}
+				}
+			});
+		}
+	}
+	return _poster;
+}
+
+void DocumentData::savePoster(const QImage &frame) {
+	if (frame.isNull() || !_poster->isNull()) {
+		return;
+	}
+	auto limit = st::maxGifSize * cIntRetinaFactor();
+	auto image = (frame.width() > limit || frame.height() > limit)
+		? frame.scaled(limit, limit, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+		: frame;
+	image = Images::prepareOpaque(std::move(image));
+	Local::writeVideoPoster(Local::videoPosterKey(id), image);
+	_poster = ImagePtr(App::pixmapFromImageInPlace(std::move(image)), "JPG");
+	_posterRequested = true;
+}
+
 bool fileIsImage(const QString &name, const QString &mime) {
 	QString lowermime = mime.toLower(), namelower = name.toLower();
 	if (lowermime.startsWith(qstr("image/"))) {
@@ -337,7 +337,7 @@ public:
 		return (_lastFullUpdate != 0);
 	}
 
-	const Text &dialogName() const;
+	const SingleLineText &dialogName() const;
 	const QString &shortName() const;
 	const QString &userName() const;
 
@@ -347,7 +347,7 @@ public:
 	}
 
 	QString name;
-	Text nameText;
+	SingleLineText nameText;
 	using Names = OrderedSet<QString>;
 	Names names; // for filtering
 	using NameFirstChars = OrderedSet<QChar>;
@@ -519,7 +519,7 @@ public:
 		return _phone;
 	}
 	QString nameOrPhone;
-	Text phoneText;
+	SingleLineText phoneText;
 	TimeId onlineTill = 0;
 	int32 contact = -1; // -1 - not contact, cant add (self, empty, deleted, foreign), 0 - not contact, can add (request), 1 - contact
 
@@ -1072,7 +1072,7 @@ inline ChatData *PeerData::migrateFrom() const {
 inline ChannelData *PeerData::migrateTo() const {
 	return (isChat() && asChat()->migrateToPtr && asChat()->migrateToPtr->amIn()) ? asChat()->migrateToPtr : nullptr;
 }
-inline const Text &PeerData::dialogName() const {
+inline const SingleLineText &PeerData::dialogName() const {
 	return migrateTo() ? migrateTo()->dialogName() : ((isUser() && !asUser()->phoneText.isEmpty()) ? asUser()->phoneText : nameText);
 }
 inline const QString &PeerData::shortName() const {
@@ -1118,6 +1118,11 @@ public:
 	void forget();
 	ImagePtr makeReplyPreview();
 
+	// A sharp first frame of a GIF or a video, kept in the local cache,
+	// so that a still does not require opening the file with FFmpeg.
+	ImagePtr loadPoster();
+	void savePoster(const QImage &frame);
+
 	PhotoId id;
 	uint64 access;
 	int32 date;
@@ -1230,6 +1235,10 @@ struct VoiceData : public DocumentAdditionalData {
 
 bool fileIsImage(const QString &name, const QString &mime);
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Serialize {
 class Document;
 } // namespace Serialize;
@@ -1254,6 +1263,9 @@ public:
 	bool loaded(FilePathResolveType type = FilePathResolveCached) const;
 	bool loading() const;
 	QString loadingFilePath() const;
+
+	// The file being downloaded, can be read while the download is in progress.
+	std::shared_ptr<Storage::StreamedFile> streamedFile() const;
 	bool displayLoading() const;
 	void save(const QString &toFile, ActionOnLoad action = ActionOnLoadNone, const FullMsgId &actionMsgId = FullMsgId(), LoadFromCloudSetting fromCloud = LoadFromCloudOrLocal, bool autoLoading = false);
 	void cancel();
@@ -1376,6 +1388,7 @@ public:
 
 	FileStatus status = FileReady;
 	int32 uploadOffset = 0;
+	QByteArray uploadContentHash; // remembered in Local when the server document is received
 
 	int32 md5[8];
 
@@ -1414,6 +1427,8 @@ private:
 	ActionOnLoad _actionOnLoad = ActionOnLoadNone;
 	FullMsgId _actionOnLoadMsgId;
 	mutable FileLoader *_loader = nullptr;
+	ImagePtr _poster;
+	bool _posterRequested = false;
 
 	void notifyLayoutChanged() const;
 
@@ -39,8 +39,17 @@ ReaderPointer::~ReaderPointer() {
 
 namespace {
 
+// Animations are stepped once per display frame, frames are aligned to
+// multiples of the frame duration so that all the widgets updated in
+// one step are repainted together. While no window is exposed the steps
+// go rarely, only to let the animations finish and fire their callbacks.
+constexpr auto kDefaultRefreshRate = 60;
+constexpr auto kHiddenFrameDuration = TimeMs(200);
+constexpr auto kBackgroundFrameDuration = TimeMs(1000);
+
 AnimationManager *_manager = nullptr;
 bool AnimationsDisabled = false;
+bool AnimationsInBackground = false;
 
 } // namespace
 
@@ -118,6 +127,13 @@ void SetDisabled(bool disabled) {
 	AnimationsDisabled = disabled;
 }
 
+void SetBackground(bool background) {
+	AnimationsInBackground = background;
+	if (_manager) {
+		_manager->backgroundChanged();
+	}
+}
+
 } // anim
 
 void BasicAnimation::start() {
@@ -136,10 +152,39 @@ void BasicAnimation::stop() {
 }
 
 AnimationManager::AnimationManager() : _timer(this), _iterating(false) {
-	_timer.setSingleShot(false);
+	_timer.setSingleShot(true);
+	_timer.setTimerType(Qt::PreciseTimer);
 	connect(&_timer, SIGNAL(timeout()), this, SLOT(timeout()));
 }
 
+TimeMs AnimationManager::frameDuration() const {
+	auto screen = QGuiApplication::primaryScreen();
+	auto rate = screen ? qRound(screen->refreshRate()) : 0;
+	if (rate <= 0) {
+		rate = kDefaultRefreshRate;
+	}
+	return qMax(TimeMs(1000 / rate), TimeMs(AnimationTimerDelta));
+}
+
+bool AnimationManager::anyWindowExposed() const {
+	for (auto window : QGuiApplication::topLevelWindows()) {
+		if (window->isExposed() && window->windowState() != Qt::WindowMinimized) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void AnimationManager::schedule() {
+	auto now = getms();
+	_exposed = anyWindowExposed();
+	auto frame = _exposed
+		? frameDuration()
+		: (AnimationsInBackground ? kBackgroundFrameDuration : kHiddenFrameDuration);
+	auto next = ((now / frame) + 1) * frame;
+	_timer.start(int(next - now));
+}
+
 void AnimationManager::start(BasicAnimation *obj) {
 	if (_iterating) {
 		_starting.insert(obj);
@@ -148,7 +193,7 @@ void AnimationManager::start(BasicAnimation *obj) {
 		}
 	} else {
 		if (_objects.isEmpty()) {
-			_timer.start(AnimationTimerDelta);
+			schedule();
 		}
 		_objects.insert(obj);
 	}
@@ -171,6 +216,12 @@ void AnimationManager::stop(BasicAnimation *obj) {
 	}
 }
 
+void AnimationManager::backgroundChanged() {
+	if (!_iterating && !_objects.empty()) {
+		schedule();
+	}
+}
+
 void AnimationManager::timeout() {
 	_iterating = true;
 	auto ms = getms();
@@ -181,6 +232,16 @@ void AnimationManager::timeout() {
 	}
 	_iterating = false;
 
+	auto duration = getms() - ms;
+	++_framesCount;
+	if (!_exposed) {
+		++_hiddenFramesCount;
+	}
+	_stepsDuration += duration;
+	if (duration > frameDuration()) {
+		++_slowFramesCount;
+	}
+
 	if (!_starting.isEmpty()) {
 		for_const (auto object, _starting) {
 			_objects.insert(object);
@@ -195,6 +256,18 @@ void AnimationManager::timeout() {
 	}
 	if (_objects.empty()) {
 		_timer.stop();
+	} else {
+		schedule();
+	}
+}
+
+AnimationManager::~AnimationManager() {
+	if (_framesCount > 0) {
+		DEBUG_LOG(("Animations: %1 frames (%2 while hidden, %3 slow), %4 ms in steps."
+			).arg(_framesCount
+			).arg(_hiddenFramesCount
+			).arg(_slowFramesCount
+			).arg(_stepsDuration));
 	}
 }
 
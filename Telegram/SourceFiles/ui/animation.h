@@ -420,6 +420,9 @@ QPainterPath path(QPointF (&from)[N]) {
 bool Disabled();
 void SetDisabled(bool disabled);
 
+// While in background the animations are stepped rarely, only to let them finish.
+void SetBackground(bool background);
+
 };
 
 class BasicAnimation;
@@ -701,6 +704,9 @@ public:
 
 	void start(BasicAnimation *obj);
 	void stop(BasicAnimation *obj);
+	void backgroundChanged();
+
+	~AnimationManager();
 
 public slots:
 	void timeout();
@@ -708,9 +714,19 @@ public slots:
 	void clipCallback(Media::Clip::Reader *reader, qint32 threadIndex, qint32 notification);
 
 private:
+	void schedule();
+	TimeMs frameDuration() const;
+	bool anyWindowExposed() const;
+
 	using AnimatingObjects = OrderedSet<BasicAnimation*>;
 	AnimatingObjects _objects, _starting, _stopping;
 	QTimer _timer;
 	bool _iterating;
+	bool _exposed = true;
+
+	int _framesCount = 0;
+	int _hiddenFramesCount = 0;
+	int _slowFramesCount = 0;
+	TimeMs _stepsDuration = 0;
 
 };
@@ -21,6 +21,57 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/effects/ripple_animation.h"
 
 namespace Ui {
+namespace {
+
+// Many buttons and list rows create ripples with the same simple masks,
+// so those masks and their pixmaps are kept by the shape, size and radius.
+constexpr auto kSharedMasksLimit = 64;
+
+enum class MaskShape {
+	Rect,
+	RoundRect,
+	Ellipse,
+};
+
+// Pixmaps by the QImage::cacheKey() of the shared masks, null until used.
+QMap<uint64, QImage> SharedMasks;
+QMap<qint64, QPixmap> SharedMaskPixmaps;
+
+uint64 SharedMaskKey(MaskShape shape, QSize size, int radius) {
+	return (uint64(shape) << 48)
+		| (uint64(radius & 0xFFFF) << 32)
+		| (uint64(size.width() & 0xFFFF) << 16)
+		| uint64(size.height() & 0xFFFF);
+}
+
+template <typename Create>
+QImage SharedMask(MaskShape shape, QSize size, int radius, Create create) {
+	auto key = SharedMaskKey(shape, size, radius);
+	auto i = SharedMasks.constFind(key);
+	if (i == SharedMasks.cend()) {
+		if (SharedMasks.size() >= kSharedMasksLimit) {
+			// Animations that use the masks hold their own references.
+			SharedMasks.clear();
+			SharedMaskPixmaps.clear();
+		}
+		auto mask = create();
+		SharedMaskPixmaps.insert(mask.cacheKey(), QPixmap());
+		i = SharedMasks.insert(key, std::move(mask));
+	}
+	return i.value();
+}
+
+QPixmap PrepareMask(QImage &&mask) {
+	auto i = SharedMaskPixmaps.find(mask.cacheKey());
+	if (i == SharedMaskPixmaps.end()) {
+		return App::pixmapFromImageInPlace(std::move(mask));
+	} else if (i.value().isNull()) {
+		i.value() = QPixmap::fromImage(mask);
+	}
+	return i.value();
+}
+
+} // namespace
 
 class RippleAnimation::Ripple {
 public:
@@ -147,7 +198,7 @@ void RippleAnimation::Ripple::finish() {
 
 RippleAnimation::RippleAnimation(const style::RippleAnimation &st, QImage mask, const UpdateCallback &callback)
 : _st(st)
-, _mask(App::pixmapFromImageInPlace(std::move(mask)))
+, _mask(PrepareMask(std::move(mask)))
 , _update(callback) {
 }
 
@@ -210,18 +261,24 @@ QImage RippleAnimation::maskByDrawer(QSize size, bool filled, base::lambda<void(
 }
 
 QImage RippleAnimation::rectMask(QSize size) {
-	return maskByDrawer(size, true, base::lambda<void(QPainter&)>());
+	return SharedMask(MaskShape::Rect, size, 0, [size] {
+		return maskByDrawer(size, true, base::lambda<void(QPainter&)>());
+	});
 }
 
 QImage RippleAnimation::roundRectMask(QSize size, int radius) {
-	return maskByDrawer(size, false, [size, radius](QPainter &p) {
-		p.drawRoundedRect(0, 0, size.width(), size.height(), radius, radius);
+	return SharedMask(MaskShape::RoundRect, size, radius, [size, radius] {
+		return maskByDrawer(size, false, [size, radius](QPainter &p) {
+			p.drawRoundedRect(0, 0, size.width(), size.height(), radius, radius);
+		});
 	});
 }
 
 QImage RippleAnimation::ellipseMask(QSize size) {
-	return maskByDrawer(size, false, [size](QPainter &p) {
-		p.drawEllipse(0, 0, size.width(), size.height());
+	return SharedMask(MaskShape::Ellipse, size, 0, [size] {
+		return maskByDrawer(size, false, [size](QPainter &p) {
+			p.drawEllipse(0, 0, size.width(), size.height());
+		});
 	});
 }
 
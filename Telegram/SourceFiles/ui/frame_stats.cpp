@@ -0,0 +1,216 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "ui/frame_stats.h"
+
+#include "base/timer.h"
+#include "mainwindow.h"
+
+#include <chrono>
+
+namespace Ui {
+namespace FrameStats {
+namespace internal {
+
+bool Enabled = false;
+
+int64 Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace internal
+
+namespace {
+
+constexpr auto kRefreshTimeout = 1000;
+constexpr auto kTopWidgetsCount = 8;
+constexpr auto kSlowFrameDuration = 16667; // mcs, one frame at 60 fps
+constexpr auto kHudPadding = 8;
+
+struct WidgetStats {
+	int64 spent = 0;
+	int paints = 0;
+};
+
+// Collected since the last refresh of the overlay.
+struct Period {
+	int frames = 0;
+	int slowFrames = 0;
+	int64 spent = 0;
+	int64 maxSpent = 0;
+	int paints = 0;
+	int64 paintedArea = 0;
+	int64 windowsArea = 0;
+	std::map<const char*, WidgetStats> widgets;
+};
+
+Period Current;
+int64 FrameStart = 0;
+int FrameDepth = 0;
+
+int64 RegionArea(const QRegion &region) {
+	auto result = int64(0);
+	for (auto &rect : region.rects()) {
+		result += int64(rect.width()) * rect.height();
+	}
+	return result;
+}
+
+QString FormatMs(int64 mcs) {
+	return QString::number(mcs / 1000., 'f', 1) + qsl(" ms");
+}
+
+class Hud : public TWidget {
+public:
+	Hud(QWidget *parent) : TWidget(parent), _timer([this] { refresh(); }) {
+		setAttribute(Qt::WA_TransparentForMouseEvents);
+		_lines.push_back(qsl("Collecting frame stats..."));
+		updateGeometry();
+		show();
+		_timer.callEach(kRefreshTimeout);
+	}
+
+protected:
+	void paintEvent(QPaintEvent *e) override {
+		Painter p(this);
+		p.fillRect(rect(), QColor(0, 0, 0, 192));
+		p.setFont(st::normalFont);
+		p.setPen(QColor(255, 255, 255));
+		auto top = kHudPadding;
+		for (auto &line : _lines) {
+			p.drawTextLeft(kHudPadding, top, width(), line);
+			top += st::normalFont->height;
+		}
+	}
+
+private:
+	void refresh() {
+		auto period = base::take(Current);
+		_lines.clear();
+		if (!period.frames) {
+			_lines.push_back(qsl("No frames painted."));
+		} else {
+			_lines.push_back(qsl("Frames: %1, paint avg %2, max %3").arg(period.frames).arg(FormatMs(period.spent / period.frames)).arg(FormatMs(period.maxSpent)));
+			_lines.push_back(qsl("Slow frames (over 16.7 ms): %1").arg(period.slowFrames));
+			auto area = period.windowsArea ? (period.paintedArea * 100 / period.windowsArea) : 0;
+			_lines.push_back(qsl("Widget paints per frame: %1, painted area %2%").arg(QString::number(period.paints / double(period.frames), 'f', 1)).arg(area));
+
+			auto widgets = std::vector<std::pair<const char*, WidgetStats>>(period.widgets.begin(), period.widgets.end());
+			auto count = std::min(int(widgets.size()), kTopWidgetsCount);
+			std::partial_sort(widgets.begin(), widgets.begin() + count, widgets.end(), [](auto &a, auto &b) {
+				return a.second.spent > b.second.spent;
+			});
+			for (auto i = 0; i != count; ++i) {
+				auto &widget = widgets[i];
+				_lines.push_back(qsl("%1: %2 in %3 paints").arg(widget.first).arg(FormatMs(widget.second.spent)).arg(widget.second.paints));
+			}
+		}
+		updateGeometry();
+		update();
+	}
+
+	void updateGeometry() {
+		auto width = 0;
+		for (auto &line : _lines) {
+			accumulate_max(width, st::normalFont->width(line));
+		}
+		width += 2 * kHudPadding;
+		auto height = int(_lines.size()) * st::normalFont->height + 2 * kHudPadding;
+		setGeometry(parentWidget()->width() - width, 0, width, height);
+		raise();
+	}
+
+	base::Timer _timer;
+	std::vector<QString> _lines;
+
+};
+
+QPointer<Hud> Instance;
+base::lambda<void(int64 spent)> Observer;
+
+void RefreshEnabled() {
+	internal::Enabled = (Instance != nullptr) || Observer;
+}
+
+} // namespace
+
+namespace internal {
+
+void FrameStarted(QObject *window) {
+	if (FrameDepth++) {
+		return;
+	}
+	FrameStart = Now();
+	if (window->isWidgetType()) {
+		auto widget = static_cast<QWidget*>(window);
+		Current.windowsArea += int64(widget->width()) * widget->height();
+	}
+}
+
+void FrameFinished() {
+	if (--FrameDepth) {
+		return;
+	}
+	auto spent = Now() - FrameStart;
+	++Current.frames;
+	Current.spent += spent;
+	accumulate_max(Current.maxSpent, spent);
+	if (spent > kSlowFrameDuration) {
+		++Current.slowFrames;
+	}
+	if (Observer) {
+		Observer(spent);
+	}
+}
+
+void PaintFinished(QObject *widget, QEvent *e, int64 started) {
+	if (widget == Instance) {
+		return;
+	}
+	auto &stats = Current.widgets[widget->metaObject()->className()];
+	stats.spent += Now() - started;
+	++stats.paints;
+	++Current.paints;
+	Current.paintedArea += RegionArea(static_cast<QPaintEvent*>(e)->region());
+}
+
+} // namespace internal
+
+void Toggle() {
+	if (Instance) {
+		delete Instance.data();
+	} else if (auto window = App::wnd()) {
+		Current = Period();
+		Instance = new Hud(window);
+	}
+	RefreshEnabled();
+}
+
+bool Shown() {
+	return (Instance != nullptr);
+}
+
+void SetFrameObserver(base::lambda<void(int64 spent)> observer) {
+	Observer = std::move(observer);
+	RefreshEnabled();
+}
+
+} // namespace FrameStats
+} // namespace Ui
@@ -0,0 +1,93 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+namespace Ui {
+namespace FrameStats {
+
+// Hidden overlay with the frame times and the widgets that took
+// the most time to paint, toggled by the "framestats" debug code.
+//
+// Application::notify() wraps the window update requests in FrameScope
+// and the widget paint events in PaintScope. While the overlay is hidden
+// each of them costs one bool check.
+void Toggle();
+bool Shown();
+
+// The observer is called with the duration of each painted frame in mcs,
+// it enables the collection even while the overlay is hidden.
+void SetFrameObserver(base::lambda<void(int64 spent)> observer);
+
+namespace internal {
+
+extern bool Enabled;
+int64 Now(); // mcs
+void FrameStarted(QObject *window);
+void FrameFinished();
+void PaintFinished(QObject *widget, QEvent *e, int64 started);
+
+} // namespace internal
+
+class FrameScope {
+public:
+	explicit FrameScope(QObject *window) : _enabled(internal::Enabled) {
+		if (_enabled) {
+			internal::FrameStarted(window);
+		}
+	}
+	FrameScope(const FrameScope &other) = delete;
+	FrameScope &operator=(const FrameScope &other) = delete;
+	~FrameScope() {
+		if (_enabled) {
+			internal::FrameFinished();
+		}
+	}
+
+private:
+	bool _enabled;
+
+};
+
+class PaintScope {
+public:
+	PaintScope(QObject *widget, QEvent *e)
+	: _widget(internal::Enabled ? widget : nullptr)
+	, _event(e)
+	, _started(_widget ? internal::Now() : 0) {
+	}
+	PaintScope(const PaintScope &other) = delete;
+	PaintScope &operator=(const PaintScope &other) = delete;
+	~PaintScope() {
+		if (_widget) {
+			internal::PaintFinished(_widget, _event, _started);
+		}
+	}
+
+private:
+	QObject *_widget;
+	QEvent *_event;
+	int64 _started;
+
+};
+
+} // namespace FrameStats
+} // namespace Ui
@@ -21,7 +21,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/images.h"
 
 #include "mainwidget.h"
+#include "core/memory_stats.h"
 #include "storage/localstorage.h"
+#include "storage/file_download.h"
 #include "platform/platform_specific.h"
 #include "auth_session.h"
 
@@ -136,42 +138,41 @@ x++;
 				yw += stride;
 			}
 
+			// The vertical pass keeps the running sums of all the columns
+			// and goes through the rows, so that both rgb and pix are read
+			// and written sequentially instead of jumping by a whole row.
 			const int he = h - r1;
+			uint64 *rgbsums = new uint64[w * 2];
+			uint64 *rgballsums = rgbsums + w;
 			for (x = 0; x < w; x++) {
-				uint64 rgballsum = -radius * rgb[x];
-				uint64 rgbsum = rgb[x] * ((r1 * (r1 + 1)) >> 1);
-				for (i = 1; i <= radius; i++) {
-					rgbsum += rgb[i * w + x] * (r1 - i);
-					rgballsum += rgb[i * w + x];
-				}
-
-				y = 0;
-				int yi = x * 4;
-
-#define update(start, middle, end) \
-uint64 res = rgbsum >> 4; \
-pix[yi] = res & 0xFF; \
-pix[yi + 1] = (res >> 16) & 0xFF; \
-pix[yi + 2] = (res >> 32) & 0xFF; \
-pix[yi + 3] = (res >> 48) & 0xFF; \
-rgballsum += rgb[x + (start) * w] - 2 * rgb[x + (middle) * w] + rgb[x + (end) * w]; \
-rgbsum += rgballsum; \
-y++; \
-yi += stride;
-
-				while (y < r1) {
-					update(0, y, y + r1);
-				}
-				while (y < he) {
-					update(y - r1, y, y + r1);
+				rgballsums[x] = -radius * rgb[x];
+				rgbsums[x] = rgb[x] * ((r1 * (r1 + 1)) >> 1);
+			}
+			for (i = 1; i <= radius; i++) {
+				const uint64 *row = rgb + i * w;
+				for (x = 0; x < w; x++) {
+					rgbsums[x] += row[x] * (r1 - i);
+					rgballsums[x] += row[x];
 				}
-				while (y < h) {
-					update(y - r1, y, h - 1);
+			}
+			for (y = 0; y < h; y++) {
+				const uint64 *start = rgb + ((y < r1) ? 0 : (y - r1)) * w;
+				const uint64 *middle = rgb + y * w;
+				const uint64 *end = rgb + ((y < he) ? (y + r1) : (h - 1)) * w;
+				uchar *out = pix + y * stride;
+				for (x = 0; x < w; x++) {
+					uint64 res = rgbsums[x] >> 4;
+					out[0] = res & 0xFF;
+					out[1] = (res >> 16) & 0xFF;
+					out[2] = (res >> 32) & 0xFF;
+					out[3] = (res >> 48) & 0xFF;
+					out += 4;
+					rgballsums[x] += start[x] - 2 * middle[x] + end[x];
+					rgbsums[x] += rgballsums[x];
 				}
-
-#undef update
 			}
 
+			delete[] rgbsums;
 			delete[] rgb;
 		}
 	}
@@ -382,6 +383,63 @@ WebFileImages webFileImages;
 
 int64 globalAcquiredSize = 0;
 
+// Intrusive list of images with cached pixmaps, the most recently used first.
+const Image *CacheHead = nullptr;
+const Image *CacheTail = nullptr;
+int64 CacheLinkedSize = 0;
+int64 CacheLimitValue = 0;
+Images::CacheCounters CacheCountersValue;
+
+// Intrusive list of all the prepared pixmaps, the most recently used first.
+Images::PixmapVariant *VariantsHead = nullptr;
+Images::PixmapVariant *VariantsTail = nullptr;
+int64 VariantsSize = 0;
+int64 VariantsLimitValue = 0;
+
+int64 PixmapBytes(const QPixmap &pixmap) {
+	return int64(pixmap.width()) * pixmap.height() * 4;
+}
+
+void VariantLink(not_null<Images::PixmapVariant*> variant) {
+	variant->prev = nullptr;
+	variant->next = VariantsHead;
+	if (VariantsHead) {
+		VariantsHead->prev = variant;
+	} else {
+		VariantsTail = variant;
+	}
+	VariantsHead = variant;
+}
+
+void VariantUnlink(not_null<Images::PixmapVariant*> variant) {
+	if (variant->prev) {
+		variant->prev->next = variant->next;
+	} else {
+		VariantsHead = variant->next;
+	}
+	if (variant->next) {
+		variant->next->prev = variant->prev;
+	} else {
+		VariantsTail = variant->prev;
+	}
+	variant->prev = variant->next = nullptr;
+}
+
+void VariantTouch(not_null<Images::PixmapVariant*> variant) {
+	if (VariantsHead != variant) {
+		VariantUnlink(variant);
+		VariantLink(variant);
+	}
+}
+
+void VariantRelease(not_null<Images::PixmapVariant*> variant) {
+	VariantUnlink(variant);
+	auto bytes = PixmapBytes(variant->pixmap);
+	globalAcquiredSize -= bytes;
+	VariantsSize -= bytes;
+	MemoryStats::Released(MemoryStats::Kind::ImageCache, bytes);
+}
+
 uint64 PixKey(int width, int height, Images::Options options) {
 	return static_cast<uint64>(width) | (static_cast<uint64>(height) << 24) | (static_cast<uint64>(options) << 48);
 }
@@ -410,7 +468,7 @@ Image::Image(const QString &file, QByteArray fmt) : _forgot(false) {
 	_data = App::pixmapFromImageInPlace(App::readImage(file, &fmt, false, 0, &_saved));
 	_format = fmt;
 	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+		cacheAcquire(_data);
 	}
 }
 
@@ -419,13 +477,13 @@ Image::Image(const QByteArray &filecontent, QByteArray fmt) : _forgot(false) {
 	_format = fmt;
 	_saved = filecontent;
 	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+		cacheAcquire(_data);
 	}
 }
 
 Image::Image(const QPixmap &pixmap, QByteArray format) : _format(format), _forgot(false), _data(pixmap) {
 	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+		cacheAcquire(_data);
 	}
 }
 
@@ -434,7 +492,7 @@ Image::Image(const QByteArray &filecontent, QByteArray fmt, const QPixmap &pixma
 	_format = fmt;
 	_saved = filecontent;
 	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+		cacheAcquire(_data);
 	}
 }
 
@@ -449,16 +507,12 @@ const QPixmap &Image::pix(int32 w, int32 h) const {
     }
 	auto options = Images::Option::Smooth | Images::Option::None;
 	auto k = PixKey(w, h, options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
-        if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k)) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixNoCache(w, h, options);
+    if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixRounded(int32 w, int32 h, ImageRoundRadius radius, ImageRoundCorners corners) const {
@@ -485,16 +539,12 @@ const QPixmap &Image::pixRounded(int32 w, int32 h, ImageRoundRadius radius, Imag
 		options |= Images::Option::Circled | cornerOptions(corners);
 	}
 	auto k = PixKey(w, h, options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k)) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixNoCache(w, h, options);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixCircled(int32 w, int32 h) const {
@@ -508,16 +558,12 @@ const QPixmap &Image::pixCircled(int32 w, int32 h) const {
 	}
 	auto options = Images::Option::Smooth | Images::Option::Circled;
 	auto k = PixKey(w, h, options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k)) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixNoCache(w, h, options);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixBlurredCircled(int32 w, int32 h) const {
@@ -531,16 +577,12 @@ const QPixmap &Image::pixBlurredCircled(int32 w, int32 h) const {
 	}
 	auto options = Images::Option::Smooth | Images::Option::Circled | Images::Option::Blurred;
 	auto k = PixKey(w, h, options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k)) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixNoCache(w, h, options);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixBlurred(int32 w, int32 h) const {
@@ -554,16 +596,12 @@ const QPixmap &Image::pixBlurred(int32 w, int32 h) const {
 	}
 	auto options = Images::Option::Smooth | Images::Option::Blurred;
 	auto k = PixKey(w, h, options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k)) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixNoCache(w, h, options);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixColored(style::color add, int32 w, int32 h) const {
@@ -577,16 +615,12 @@ const QPixmap &Image::pixColored(style::color add, int32 w, int32 h) const {
 	}
 	auto options = Images::Option::Smooth | Images::Option::Colored;
 	auto k = PixKey(w, h, options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend()) {
-		auto p = pixColoredNoCache(add, w, h, true);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k)) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixColoredNoCache(add, w, h, true);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixBlurredColored(style::color add, int32 w, int32 h) const {
@@ -600,16 +634,12 @@ const QPixmap &Image::pixBlurredColored(style::color add, int32 w, int32 h) cons
 	}
 	auto options = Images::Option::Blurred | Images::Option::Smooth | Images::Option::Colored;
 	auto k = PixKey(w, h, options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend()) {
-		auto p = pixBlurredColoredNoCache(add, w, h);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k)) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixBlurredColoredNoCache(add, w, h);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixSingle(int32 w, int32 h, int32 outerw, int32 outerh, ImageRoundRadius radius, ImageRoundCorners corners, const style::color *colored) const {
@@ -641,19 +671,12 @@ const QPixmap &Image::pixSingle(int32 w, int32 h, int32 outerw, int32 outerh, Im
 	}
 
 	auto k = SinglePixKey(options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend() || i->width() != (outerw * cIntRetinaFactor()) || i->height() != (outerh * cIntRetinaFactor())) {
-		if (i != _sizesCache.cend()) {
-			globalAcquiredSize -= int64(i->width()) * i->height() * 4;
-		}
-		auto p = pixNoCache(w, h, options, outerw, outerh, colored);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k, QSize(outerw, outerh) * cIntRetinaFactor())) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixNoCache(w, h, options, outerw, outerh, colored);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 const QPixmap &Image::pixBlurredSingle(int w, int h, int32 outerw, int32 outerh, ImageRoundRadius radius, ImageRoundCorners corners) const {
@@ -682,19 +705,12 @@ const QPixmap &Image::pixBlurredSingle(int w, int h, int32 outerw, int32 outerh,
 	}
 
 	auto k = SinglePixKey(options);
-	auto i = _sizesCache.constFind(k);
-	if (i == _sizesCache.cend() || i->width() != (outerw * cIntRetinaFactor()) || i->height() != (outerh * cIntRetinaFactor())) {
-		if (i != _sizesCache.cend()) {
-			globalAcquiredSize -= int64(i->width()) * i->height() * 4;
-		}
-		auto p = pixNoCache(w, h, options, outerw, outerh);
-		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
-		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+	if (auto result = findVariant(k, QSize(outerw, outerh) * cIntRetinaFactor())) {
+		return *result;
 	}
-	return i.value();
+	auto p = pixNoCache(w, h, options, outerw, outerh);
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	return storeVariant(k, std::move(p));
 }
 
 QPixmap Image::pixNoCache(int w, int h, Images::Options options, int outerw, int outerh, const style::color *colored) const {
@@ -787,6 +803,12 @@ void Image::forget() const {
 	if (_data.isNull()) return;
 
 	invalidateSizeCache();
+	forgetData();
+}
+
+void Image::forgetData() const {
+	if (_forgot || _data.isNull()) return;
+
 	if (_saved.isEmpty()) {
 		QBuffer buffer(&_saved);
 		if (!_data.save(&buffer, _format)) {
@@ -797,7 +819,7 @@ void Image::forget() const {
 			}
 		}
 	}
-	globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
+	cacheRelease(_data);
 	_data = QPixmap();
 	_forgot = true;
 }
@@ -813,27 +835,177 @@ void Image::restore() const {
 	_data = QPixmap::fromImageReader(&reader, Qt::ColorOnly);
 
 	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+		cacheAcquire(_data);
 	}
 	_forgot = false;
 }
 
 void Image::invalidateSizeCache() const {
-	for (auto &pix : _sizesCache) {
-		if (!pix.isNull()) {
-			globalAcquiredSize -= int64(pix.width()) * pix.height() * 4;
-		}
+	for (auto &entry : _sizesCache) {
+		VariantRelease(&entry.second);
 	}
 	_sizesCache.clear();
 }
 
+const QPixmap *Image::findVariant(uint64 key, QSize size) const {
+	auto i = _sizesCache.find(key);
+	if (i == _sizesCache.end()) {
+		return nullptr;
+	}
+	auto &variant = i->second;
+	if (size.isValid() && variant.pixmap.size() != size) {
+		return nullptr;
+	}
+	++CacheCountersValue.hits;
+	VariantTouch(&variant);
+	cacheTouch();
+	return &variant.pixmap;
+}
+
+const QPixmap &Image::storeVariant(uint64 key, QPixmap &&pixmap) const {
+	++CacheCountersValue.misses;
+	auto i = _sizesCache.find(key);
+	if (i != _sizesCache.end()) {
+		VariantRelease(&i->second);
+	} else {
+		i = _sizesCache.emplace(key, Images::PixmapVariant()).first;
+	}
+	auto &variant = i->second;
+	variant.pixmap = std::move(pixmap);
+	variant.image = this;
+	variant.key = key;
+	VariantLink(&variant);
+
+	auto bytes = PixmapBytes(variant.pixmap);
+	globalAcquiredSize += bytes;
+	VariantsSize += bytes;
+	MemoryStats::Acquired(MemoryStats::Kind::ImageCache, bytes);
+	cacheTouch();
+	return variant.pixmap;
+}
+
+void Image::cacheAcquire(const QPixmap &pixmap) const {
+	if (pixmap.isNull()) return;
+
+	auto bytes = PixmapBytes(pixmap);
+	globalAcquiredSize += bytes;
+	_cacheSize += bytes;
+	MemoryStats::Acquired(MemoryStats::Kind::ImageCache, bytes);
+	if (cacheLinked()) {
+		CacheLinkedSize += bytes;
+	}
+	cacheTouch();
+}
+
+void Image::cacheRelease(const QPixmap &pixmap) const {
+	if (pixmap.isNull()) return;
+
+	auto bytes = PixmapBytes(pixmap);
+	globalAcquiredSize -= bytes;
+	_cacheSize -= bytes;
+	MemoryStats::Released(MemoryStats::Kind::ImageCache, bytes);
+	if (cacheLinked()) {
+		CacheLinkedSize -= bytes;
+	}
+}
+
+bool Image::cacheLinked() const {
+	return (_cachePrev != nullptr) || (CacheHead == this);
+}
+
+void Image::cacheTouch() const {
+	if (CacheHead == this) return;
+
+	cacheUnlink();
+	_cacheNext = CacheHead;
+	if (CacheHead) {
+		CacheHead->_cachePrev = this;
+	} else {
+		CacheTail = this;
+	}
+	CacheHead = this;
+	CacheLinkedSize += _cacheSize;
+}
+
+void Image::cacheUnlink() const {
+	if (!cacheLinked()) return;
+
+	if (_cachePrev) {
+		_cachePrev->_cacheNext = _cacheNext;
+	} else {
+		CacheHead = _cacheNext;
+	}
+	if (_cacheNext) {
+		_cacheNext->_cachePrev = _cachePrev;
+	} else {
+		CacheTail = _cachePrev;
+	}
+	_cachePrev = _cacheNext = nullptr;
+	CacheLinkedSize -= _cacheSize;
+}
+
 Image::~Image() {
 	invalidateSizeCache();
 	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
+		cacheRelease(_data);
 	}
+	cacheUnlink();
 }
 
+namespace Images {
+
+CacheCounters GetCacheCounters() {
+	auto result = CacheCountersValue;
+	result.imagesSize = CacheLinkedSize;
+	result.variantsSize = VariantsSize;
+	return result;
+}
+
+void SetCacheLimit(int64 limit) {
+	CacheLimitValue = limit;
+}
+
+int64 CacheLimit() {
+	if (CacheLimitValue > 0) {
+		return CacheLimitValue;
+	}
+	return int64(MemoryForImageCache) * cIntRetinaFactor() * cIntRetinaFactor();
+}
+
+void SetVariantsCacheLimit(int64 limit) {
+	VariantsLimitValue = limit;
+}
+
+int64 VariantsCacheLimit() {
+	if (VariantsLimitValue > 0) {
+		return VariantsLimitValue;
+	}
+	return int64(MemoryForImageVariantsCache) * cIntRetinaFactor() * cIntRetinaFactor();
+}
+
+void CheckCacheSize() {
+	ShrinkCache(CacheLimit(), VariantsCacheLimit());
+}
+
+void ShrinkCache(int64 limit, int64 variantsLimit) {
+	while (VariantsTail && VariantsSize > variantsLimit) {
+		auto variant = VariantsTail;
+		auto image = variant->image;
+		auto key = variant->key;
+		VariantRelease(variant);
+		image->_sizesCache.erase(key);
+		++CacheCountersValue.variantsEvicted;
+	}
+	while (CacheTail && CacheLinkedSize > limit) {
+		auto image = CacheTail;
+		image->cacheUnlink();
+		image->forgetData();
+		++CacheCountersValue.evicted;
+	}
+}
+
+} // namespace Images
+
 void clearStorageImages() {
 	for (auto image : base::take(storageImages)) {
 		delete image;
@@ -867,14 +1039,14 @@ void RemoteImage::doCheckload() const {
 	}
 
 	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
+		cacheRelease(_data);
 	}
 
 	_format = _loader->imageFormat(shrinkBox());
 	_data = data;
 	_saved = _loader->bytes();
 	const_cast<RemoteImage*>(this)->setInformation(_saved.size(), _data.width(), _data.height());
-	globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+	cacheAcquire(_data);
 
 	invalidateSizeCache();
 
@@ -900,12 +1072,12 @@ void RemoteImage::setData(QByteArray &bytes, const QByteArray &bytesFormat) {
 	QBuffer buffer(&bytes);
 
 	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
+		cacheRelease(_data);
 	}
 	QByteArray fmt(bytesFormat);
 	_data = App::pixmapFromImageInPlace(App::readImage(bytes, &fmt, false));
 	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+		cacheAcquire(_data);
 		setInformation(bytes.size(), _data.width(), _data.height());
 	}
 
@@ -926,15 +1098,13 @@ void RemoteImage::automaticLoad(const HistoryItem *item) {
 	if (loaded()) return;
 
 	if (_loader != CancelledFileLoader && item) {
-		bool loadFromCloud = false;
-		if (item->history()->peer->isUser()) {
-			loadFromCloud = !(cAutoDownloadPhoto() & dbiadNoPrivate);
-		} else {
-			loadFromCloud = !(cAutoDownloadPhoto() & dbiadNoGroups);
-		}
+		auto loadFromCloud = Storage::AutoDownloadAllowed(Storage::AutoDownloadType::Photo, item);
 
 		if (_loader) {
 			if (loadFromCloud) _loader->permitLoadFromCloud();
+
+			// Mark the loader visible again, automaticLoad() is called while painting.
+			if (_loader->loading()) _loader->start();
 		} else {
 			_loader = createLoader(loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true);
 			if (_loader) _loader->start();
@@ -960,13 +1130,13 @@ void RemoteImage::load(bool loadFirst, bool prior) {
 
 void RemoteImage::loadEvenCancelled(bool loadFirst, bool prior) {
 	if (_loader == CancelledFileLoader) _loader = 0;
-	return load(loadFirst, prior);
+	load(loadFirst, prior);
+	if (amLoading()) {
+		_loader->setUserInitiated();
+	}
 }
 
 RemoteImage::~RemoteImage() {
-	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
-	}
 	if (amLoading()) {
 		destroyLoaderDelayed();
 	}
@@ -1088,12 +1258,7 @@ void DelayedStorageImage::setStorageLocation(const StorageImageLocation location
 void DelayedStorageImage::automaticLoad(const HistoryItem *item) {
 	if (_location.isNull()) {
 		if (!_loadCancelled && item) {
-			bool loadFromCloud = false;
-			if (item->history()->peer->isUser()) {
-				loadFromCloud = !(cAutoDownloadPhoto() & dbiadNoPrivate);
-			} else {
-				loadFromCloud = !(cAutoDownloadPhoto() & dbiadNoGroups);
-			}
+			auto loadFromCloud = Storage::AutoDownloadAllowed(Storage::AutoDownloadType::Photo, item);
 
 			if (_loadRequested) {
 				if (loadFromCloud) _loadFromCloud = loadFromCloud;
@@ -1161,7 +1326,9 @@ void WebImage::setInformation(int32 size, int32 width, int32 height) {
 }
 
 FileLoader *WebImage::createLoader(LoadFromCloudSetting fromCloud, bool autoLoading) {
-	return new webFileLoader(_url, QString(), fromCloud, autoLoading);
+	auto loader = new webFileLoader(_url, QString(), fromCloud, autoLoading);
+	loader->setImageShrinkBox(_box);
+	return loader;
 }
 
 namespace internal {
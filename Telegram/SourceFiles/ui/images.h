@@ -178,6 +178,8 @@ inline bool operator!=(const WebFileImageLocation &a, const WebFileImageLocation
 	return !(a == b);
 }
 
+class Image;
+
 namespace Images {
 
 QImage prepareBlur(QImage image);
@@ -210,6 +212,41 @@ inline QPixmap pixmap(QImage img, int w, int h, Options options, int outerw, int
 	return QPixmap::fromImage(prepare(img, w, h, options, outerw, outerh, colored), Qt::ColorOnly);
 }
 
+struct CacheCounters {
+	int64 hits = 0;
+	int64 misses = 0;
+	int64 evicted = 0;
+	int64 variantsEvicted = 0;
+	int64 imagesSize = 0;
+	int64 variantsSize = 0;
+};
+CacheCounters GetCacheCounters();
+
+// Bytes of decoded images to keep in memory, a zero limit means
+// MemoryForImageCache scaled by the square of the retina factor.
+void SetCacheLimit(int64 limit);
+int64 CacheLimit();
+
+// Bytes of prepared (scaled, rounded, blurred, colored) pixmaps, a zero limit
+// means MemoryForImageVariantsCache scaled by the square of the retina factor.
+void SetVariantsCacheLimit(int64 limit);
+int64 VariantsCacheLimit();
+
+// Forgets the least recently painted variants and images until both fit.
+void CheckCacheSize();
+
+// Same as CheckCacheSize() for the given limits, used on memory pressure.
+void ShrinkCache(int64 limit, int64 variantsLimit);
+
+// A prepared pixmap of some image, linked in the global variants list.
+struct PixmapVariant {
+	QPixmap pixmap;
+	const Image *image = nullptr;
+	uint64 key = 0;
+	PixmapVariant *prev = nullptr;
+	PixmapVariant *next = nullptr;
+};
+
 } // namespace Images
 
 class DelayedStorageImage;
@@ -315,14 +352,33 @@ protected:
 		return _data.height();
 	}
 
+	// Accounts the pixmap memory and marks the image as recently used.
+	void cacheAcquire(const QPixmap &pixmap) const;
+	void cacheRelease(const QPixmap &pixmap) const;
+
 	mutable QByteArray _saved, _format;
 	mutable bool _forgot;
 	mutable QPixmap _data;
 
 private:
-	using Sizes = QMap<uint64, QPixmap>;
+	friend void Images::CheckCacheSize();
+
+	// Returns nullptr if there is no variant or it has a different size.
+	const QPixmap *findVariant(uint64 key, QSize size = QSize()) const;
+	const QPixmap &storeVariant(uint64 key, QPixmap &&pixmap) const;
+
+	void forgetData() const;
+	bool cacheLinked() const;
+	void cacheTouch() const;
+	void cacheUnlink() const;
+
+	using Sizes = std::map<uint64, Images::PixmapVariant>;
 	mutable Sizes _sizesCache;
 
+	mutable const Image *_cachePrev = nullptr;
+	mutable const Image *_cacheNext = nullptr;
+	mutable int64 _cacheSize = 0;
+
 };
 
 typedef QPair<uint64, uint64> StorageKey;
@@ -24,6 +24,11 @@ namespace style {
 namespace internal {
 namespace {
 
+// Icons painted with a color override are kept colorized for the recently
+// used colors: one icon is often painted in turn in a couple of colors,
+// like in selected and not selected rows, while animated colors pass by.
+constexpr auto kColorizedIconsLimit = 256;
+
 uint32 colorKey(QColor c) {
 	return (((((uint32(c.red()) << 8) | uint32(c.green())) << 8) | uint32(c.blue())) << 8) | uint32(c.alpha());
 }
@@ -31,9 +36,38 @@ uint32 colorKey(QColor c) {
 using IconMasks = QMap<const IconMask*, QImage>;
 using IconPixmaps = QMap<QPair<const IconMask*, uint32>, QPixmap>;
 using IconDatas = OrderedSet<IconData*>;
+struct ColorizedIcon {
+	QImage image;
+	uint64 lastUsed = 0;
+};
+using ColorizedIcons = QMap<QPair<const IconMask*, uint32>, ColorizedIcon>;
 NeverFreedPointer<IconMasks> iconMasks;
 NeverFreedPointer<IconPixmaps> iconPixmaps;
 NeverFreedPointer<IconDatas> iconData;
+NeverFreedPointer<ColorizedIcons> colorizedIcons;
+uint64 colorizedIconsUsed = 0;
+
+QImage colorizedIcon(const IconMask *mask, const QImage &maskImage, QColor color) {
+	colorizedIcons.createIfNull();
+	auto key = qMakePair(mask, colorKey(color));
+	auto i = colorizedIcons->find(key);
+	if (i == colorizedIcons->end()) {
+		if (colorizedIcons->size() >= kColorizedIconsLimit) {
+			auto oldest = colorizedIcons->begin();
+			for (auto j = colorizedIcons->begin(), e = colorizedIcons->end(); j != e; ++j) {
+				if (j.value().lastUsed < oldest.value().lastUsed) {
+					oldest = j;
+				}
+			}
+			colorizedIcons->erase(oldest);
+		}
+		auto image = QImage(maskImage.size(), QImage::Format_ARGB32_Premultiplied);
+		colorizeImage(maskImage, color, &image);
+		i = colorizedIcons->insert(key, { std::move(image) });
+	}
+	i.value().lastUsed = ++colorizedIconsUsed;
+	return i.value().image;
+}
 
 inline int pxAdjust(int value, int scale) {
 	if (value < 0) {
@@ -114,6 +148,7 @@ MonoIcon::MonoIcon(const IconMask *mask, Color color, QPoint offset)
 
 void MonoIcon::reset() const {
 	_pixmap = QPixmap();
+	_colorizedImage = QImage();
 	_size = QSize();
 }
 
@@ -169,8 +204,7 @@ void MonoIcon::paint(QPainter &p, const QPoint &pos, int outerw, QColor colorOve
 	if (_pixmap.isNull()) {
 		p.fillRect(partPosX, partPosY, w, h, colorOverride);
 	} else {
-		ensureColorizedImage(colorOverride);
-		p.drawImage(partPosX, partPosY, _colorizedImage);
+		p.drawImage(partPosX, partPosY, colorizedImage(colorOverride));
 	}
 }
 
@@ -179,8 +213,8 @@ void MonoIcon::fill(QPainter &p, const QRect &rect, QColor colorOverride) const
 	if (_pixmap.isNull()) {
 		p.fillRect(rect, colorOverride);
 	} else {
-		ensureColorizedImage(colorOverride);
-		p.drawImage(rect, _colorizedImage, _colorizedImage.rect());
+		auto &image = colorizedImage(colorOverride);
+		p.drawImage(rect, image, image.rect());
 	}
 }
 
@@ -194,8 +228,7 @@ void MonoIcon::paint(QPainter &p, const QPoint &pos, int outerw, const style::pa
 	if (_pixmap.isNull()) {
 		p.fillRect(partPosX, partPosY, w, h, _color[paletteOverride]);
 	} else {
-		ensureColorizedImage(_color[paletteOverride]->c);
-		p.drawImage(partPosX, partPosY, _colorizedImage);
+		p.drawImage(partPosX, partPosY, colorizedImage(_color[paletteOverride]->c));
 	}
 }
 
@@ -204,21 +237,20 @@ void MonoIcon::fill(QPainter &p, const QRect &rect, const style::palette &palett
 	if (_pixmap.isNull()) {
 		p.fillRect(rect, _color[paletteOverride]);
 	} else {
-		ensureColorizedImage(_color[paletteOverride]->c);
-		p.drawImage(rect, _colorizedImage, _colorizedImage.rect());
+		auto &image = colorizedImage(_color[paletteOverride]->c);
+		p.drawImage(rect, image, image.rect());
 	}
 }
 
 QImage MonoIcon::instance(QColor colorOverride, DBIScale scale) const {
 	if (scale == dbisAuto) {
 		ensureLoaded();
+		if (!_pixmap.isNull()) {
+			return colorizedImage(colorOverride);
+		}
 		auto result = QImage(size() * cIntRetinaFactor(), QImage::Format_ARGB32_Premultiplied);
 		result.setDevicePixelRatio(cRetinaFactor());
-		if (_pixmap.isNull()) {
-			result.fill(colorOverride);
-		} else {
-			colorizeImage(_maskImage, colorOverride, &result);
-		}
+		result.fill(colorOverride);
 		return result;
 	}
 	auto size = readGeneratedSize(_mask, scale);
@@ -257,9 +289,13 @@ void MonoIcon::ensureLoaded() const {
 	}
 }
 
-void MonoIcon::ensureColorizedImage(QColor color) const {
-	if (_colorizedImage.isNull()) _colorizedImage = QImage(_maskImage.size(), QImage::Format_ARGB32_Premultiplied);
-	colorizeImage(_maskImage, color, &_colorizedImage);
+const QImage &MonoIcon::colorizedImage(QColor color) const {
+	auto key = colorKey(color);
+	if (_colorizedImage.isNull() || _colorizedKey != key) {
+		_colorizedImage = colorizedIcon(_mask, _maskImage, color);
+		_colorizedKey = key;
+	}
+	return _colorizedImage;
 }
 
 void MonoIcon::createCachedPixmap() const {
@@ -330,6 +366,7 @@ int IconData::height() const {
 
 void resetIcons() {
 	iconPixmaps.clear();
+	colorizedIcons.clear();
 	if (iconData) {
 		for (auto data : *iconData) {
 			data->reset();
@@ -341,6 +378,7 @@ void destroyIcons() {
 	iconData.clear();
 	iconPixmaps.clear();
 	iconMasks.clear();
+	colorizedIcons.clear();
 }
 
 } // namespace internal
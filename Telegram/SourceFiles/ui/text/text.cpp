@@ -31,12 +31,179 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace {
 
+// Shaped lines are kept for the recently painted texts only.
+constexpr auto kShapedLinesLimit = 2048;
+constexpr auto kShapedLinesPerTextLimit = 256;
+
+TextShapedLines *ShapedLinesHead = nullptr; // Most recently painted.
+TextShapedLines *ShapedLinesTail = nullptr;
+int ShapedLinesCount = 0;
+
 inline int32 countBlockHeight(const ITextBlock *b, const style::TextStyle *st) {
 	return (b->type() == TextBlockTSkip) ? static_cast<const SkipBlock*>(b)->height() : (st->lineHeight > st->font->height) ? st->lineHeight : st->font->height;
 }
 
 } // namespace
 
+// Itemized and shaped lines of a single Text for a single width, so that
+// repainting the same text only does the bidi reordering and the drawing.
+// It also holds the item positions from the last layout for link lookups.
+class TextShapedLines {
+public:
+	struct Key {
+		uint16 from = 0;
+		uint16 till = 0;
+		int lineStart = 0;
+		int lineLength = 0;
+		Qt::LayoutDirection direction = Qt::LayoutDirectionAuto;
+		uint64 linksActive = 0;
+	};
+
+	struct HitItem {
+		QFixed left;
+		QFixed width;
+		uint16 lnkIndex = 0;
+		bool skip = false;
+	};
+	struct HitLine {
+		int top = 0;
+		int yDelta = 0;
+		QFixed left;
+		QFixed width;
+		uint16 lineStart = 0;
+		uint16 lineEnd = 0;
+		bool rtl = false;
+		int itemsFrom = 0;
+	};
+	struct HitMap {
+		style::align align = style::al_left;
+		bool breakEverywhere = false;
+		uint64 linksActive = 0;
+		std::vector<HitLine> lines;
+		std::vector<HitItem> items;
+	};
+
+	static TextShapedLines *Prepare(const Text *owner, int width) {
+		auto &result = owner->_shapedLines;
+		if (!result || result->_width != width || result->_font != owner->_st->font) {
+			result = std::make_unique<TextShapedLines>(owner, width);
+		}
+		result->touch();
+		return result.get();
+	}
+
+	TextShapedLines(const Text *owner, int width)
+	: _owner(owner)
+	, _width(width)
+	, _font(owner->_st->font) {
+	}
+	TextShapedLines(const TextShapedLines &other) = delete;
+	TextShapedLines &operator=(const TextShapedLines &other) = delete;
+
+	QTextEngine *find(const Key &key) const {
+		auto i = _lines.find(index(key));
+		if (i == _lines.cend()) {
+			return nullptr;
+		}
+		auto &line = i->second;
+		if (line.key.lineStart != key.lineStart
+			|| line.key.lineLength != key.lineLength
+			|| line.key.direction != key.direction
+			|| line.key.linksActive != key.linksActive) {
+			return nullptr;
+		}
+		return line.engine.get();
+	}
+
+	QTextEngine *store(const Key &key, std::unique_ptr<QTextEngine> engine) {
+		if (_lines.size() >= kShapedLinesPerTextLimit) {
+			ShapedLinesCount -= _lines.size();
+			_lines.clear();
+		}
+		auto &line = _lines[index(key)];
+		if (!line.engine) {
+			++ShapedLinesCount;
+		}
+		line.key = key;
+		line.engine = std::move(engine);
+		auto result = line.engine.get();
+
+		// Evicting other texts only, this one was just touched.
+		while (ShapedLinesCount > kShapedLinesLimit && ShapedLinesTail != this) {
+			ShapedLinesTail->_owner->_shapedLines = nullptr;
+		}
+		return result;
+	}
+
+	const HitMap *hitMap(style::align align, bool breakEverywhere, uint64 linksActive) const {
+		if (!_hitMap
+			|| _hitMap->align != align
+			|| _hitMap->breakEverywhere != breakEverywhere
+			|| _hitMap->linksActive != linksActive) {
+			return nullptr;
+		}
+		return _hitMap.get();
+	}
+
+	const HitMap *storeHitMap(std::unique_ptr<HitMap> map) {
+		_hitMap = std::move(map);
+		return _hitMap.get();
+	}
+
+	~TextShapedLines() {
+		ShapedLinesCount -= _lines.size();
+		unlink();
+	}
+
+private:
+	struct Line {
+		Key key;
+		std::unique_ptr<QTextEngine> engine;
+	};
+
+	static uint32 index(const Key &key) {
+		return (uint32(key.from) << 16) | uint32(key.till);
+	}
+
+	void touch() {
+		if (ShapedLinesHead == this) {
+			return;
+		}
+		unlink();
+		_next = ShapedLinesHead;
+		if (_next) {
+			_next->_prev = this;
+		} else {
+			ShapedLinesTail = this;
+		}
+		ShapedLinesHead = this;
+	}
+
+	void unlink() {
+		if (_prev) {
+			_prev->_next = _next;
+		} else if (ShapedLinesHead == this) {
+			ShapedLinesHead = _next;
+		}
+		if (_next) {
+			_next->_prev = _prev;
+		} else if (ShapedLinesTail == this) {
+			ShapedLinesTail = _prev;
+		}
+		_prev = _next = nullptr;
+	}
+
+	const Text *_owner = nullptr;
+	int _width = 0;
+	style::font _font;
+	std::map<uint32, Line> _lines;
+	std::unique_ptr<HitMap> _hitMap;
+
+	TextShapedLines *_prev = nullptr;
+	TextShapedLines *_next = nullptr;
+
+};
+
 QString textcmdSkipBlock(ushort w, ushort h) {
 	static QString cmd(5, TextCommand);
 	cmd[1] = QChar(TextCommandSkipBlock);
@@ -129,6 +296,11 @@ const QChar *textSkipCommand(const QChar *from, const QChar *end, bool canLink)
 	return (result < end && *result == TextCommand) ? (result + 1) : from;
 }
 
+// TextParser is not a pure parsing stage: it creates the text blocks (that
+// are shaped with the style fonts) while parsing, the block widths may stop
+// the parsing and the link texts are elided with the style font. The style
+// fonts and their QFontMetrics are shared and lazily modified, so the parser
+// can run only on the main thread.
 class TextParser {
 public:
 	static Qt::LayoutDirection stringDirection(const QString &str, int32 from, int32 to) {
@@ -178,13 +350,13 @@ public:
 			}
 			lastSkipped = false;
 			if (emoji) {
-				_t->_blocks.push_back(std::make_unique<EmojiBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex, emoji));
+				_t->_blocks.push_back(StoredTextBlock::Make<EmojiBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex, emoji));
 				emoji = 0;
 				lastSkipped = true;
 			} else if (newline) {
-				_t->_blocks.push_back(std::make_unique<NewlineBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex));
+				_t->_blocks.push_back(StoredTextBlock::Make<NewlineBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex));
 			} else {
-				_t->_blocks.push_back(std::make_unique<TextBlock>(_t->_st->font, _t->_text, _t->_minResizeWidth, blockStart, len, flags, lnkIndex));
+				_t->_blocks.push_back(StoredTextBlock::Make<TextBlock>(_t->_st->font, _t->_text, _t->_minResizeWidth, blockStart, len, flags, lnkIndex, _t->_words));
 			}
 			blockStart += len;
 			blockCreated();
@@ -194,7 +366,7 @@ public:
 	void createSkipBlock(int32 w, int32 h) {
 		createBlock();
 		_t->_text.push_back('_');
-		_t->_blocks.push_back(std::make_unique<SkipBlock>(_t->_st->font, _t->_text, blockStart++, w, h, lnkIndex));
+		_t->_blocks.push_back(StoredTextBlock::Make<SkipBlock>(_t->_st->font, _t->_text, blockStart++, w, h, lnkIndex));
 		blockCreated();
 	}
 
@@ -636,6 +808,7 @@ public:
 		}
 		_t->_links.squeeze();
 		_t->_blocks.shrink_to_fit();
+		_t->_words.shrink_to_fit();
 		_t->_text.squeeze();
 	}
 
@@ -905,7 +1078,7 @@ public:
 
 			if (_btype == TextBlockTText) {
 				auto t = static_cast<TextBlock*>(b);
-				if (t->_words.isEmpty()) { // no words in this block, spaces only => layout this block in the same line
+				if (!t->hasWords()) { // no words in this block, spaces only => layout this block in the same line
 					_last_rPadding += b->f_rpadding();
 
 					_lineHeight = qMax(_lineHeight, blockHeight);
@@ -916,7 +1089,7 @@ public:
 
 				auto f_wLeft = _wLeft; // vars for saving state of the last word start
 				auto f_lineHeight = _lineHeight; // f points to the last word-start element of t->_words
-				for (auto j = t->_words.cbegin(), en = t->_words.cend(), f = j; j != en; ++j) {
+				for (auto j = t->wordsBegin(_t->_words), en = t->wordsEnd(_t->_words), f = j; j != en; ++j) {
 					auto wordEndsHere = (j->f_width() >= 0);
 					auto j_width = wordEndsHere ? j->f_width() : -j->f_width();
 
@@ -1026,8 +1199,14 @@ public:
 			_breakEverywhere = (_lookupRequest.flags & Text::StateRequest::Flag::BreakEverywhere);
 			_lookupSymbol = (_lookupRequest.flags & Text::StateRequest::Flag::LookupSymbol);
 			_lookupLink = (_lookupRequest.flags & Text::StateRequest::Flag::LookupLink);
-			if (_lookupSymbol || (_lookupX >= 0 && _lookupX < w)) {
+			if (_lookupSymbol) {
 				draw(0, 0, w, _lookupRequest.align, _lookupY, _lookupY + 1);
+			} else if (_lookupX >= 0 && _lookupX < w) {
+				if (auto map = prepareHitMap(w)) {
+					lookupInHitMap(map);
+				} else {
+					draw(0, 0, w, _lookupRequest.align, _lookupY, _lookupY + 1);
+				}
 			}
 		}
 		return _lookupResult;
@@ -1056,6 +1235,89 @@ public:
 	}
 
 private:
+	// Link lookups without the symbol lookup are answered from the items
+	// of the last layout for this width, hover does not lay the text out.
+	const TextShapedLines::HitMap *prepareHitMap(int w) {
+		auto linksActive = uint64(0);
+		auto &st = _t->_st;
+		if (st->linkFont != st->linkFontOver) {
+			if (_t->_links.size() > 64) {
+				return nullptr;
+			}
+			for (auto i = 0, count = _t->_links.size(); i != count; ++i) {
+				if (ClickHandler::showAsActive(_t->_links.at(i))) {
+					linksActive |= (uint64(1) << i);
+				}
+			}
+		}
+		auto shaped = TextShapedLines::Prepare(_t, w);
+		if (auto result = shaped->hitMap(_lookupRequest.align, _breakEverywhere, linksActive)) {
+			return result;
+		}
+
+		auto map = std::make_unique<TextShapedLines::HitMap>();
+		map->align = _lookupRequest.align;
+		map->breakEverywhere = _breakEverywhere;
+		map->linksActive = linksActive;
+		_collect = map.get();
+		draw(0, 0, w, _lookupRequest.align, 0, -1);
+		_collect = nullptr;
+
+		// Drawing could not evict the shaped lines of the text being drawn.
+		Assert(_t->_shapedLines.get() == shaped);
+		return shaped->storeHitMap(std::move(map));
+	}
+
+	// Follows the !_p branches of drawLine() for the recorded lines.
+	void lookupInHitMap(const TextShapedLines::HitMap *map) {
+		auto fontHeight = _t->_st->font->height;
+		auto &lines = map->lines;
+		auto &items = map->items;
+		for (auto i = 0, count = int(lines.size()); i != count; ++i) {
+			auto &line = lines[i];
+			if (line.top + line.yDelta > _lookupY || line.top > _lookupY) {
+				return;
+			} else if (line.top + line.yDelta + fontHeight <= _lookupY) {
+				continue;
+			}
+			if (_lookupX < line.left) {
+				if (_lookupLink) {
+					_lookupResult.link.clear();
+				}
+				_lookupResult.uponSymbol = false;
+				return;
+			} else if (_lookupX >= line.left + line.width) {
+				if (line.rtl) {
+					_lookupResult.symbol = line.lineStart;
+					_lookupResult.afterSymbol = false;
+				} else {
+					_lookupResult.symbol = (line.lineEnd > line.lineStart) ? (line.lineEnd - 1) : line.lineStart;
+					_lookupResult.afterSymbol = (line.lineEnd > line.lineStart) ? true : false;
+				}
+				if (_lookupLink) {
+					_lookupResult.link.clear();
+				}
+				_lookupResult.uponSymbol = false;
+				return;
+			}
+			auto itemsTill = (i + 1 < count) ? lines[i + 1].itemsFrom : int(items.size());
+			for (auto j = line.itemsFrom; j != itemsTill; ++j) {
+				auto &item = items[j];
+				if (_lookupX >= item.left && _lookupX < item.left + item.width) {
+					if (_lookupLink) {
+						if (item.lnkIndex && _lookupY >= line.top + line.yDelta && _lookupY < line.top + line.yDelta + fontHeight) {
+							_lookupResult.link = _t->_links.at(item.lnkIndex - 1);
+						}
+					}
+					if (!item.skip) {
+						_lookupResult.uponSymbol = true;
+					}
+					return;
+				}
+			}
+		}
+	}
+
 	void initNextParagraph(Text::TextBlocks::const_iterator i) {
 		_parStartBlock = i;
 		Text::TextBlocks::const_iterator e = _t->_blocks.cend();
@@ -1177,7 +1439,18 @@ private:
 			x += _wLeft;
 		}
 
-		if (!_p) {
+		if (_collect) {
+			auto line = TextShapedLines::HitLine();
+			line.top = _y;
+			line.yDelta = _yDelta;
+			line.left = x;
+			line.width = _w - _wLeft;
+			line.lineStart = _lineStart;
+			line.lineEnd = _lineEnd;
+			line.rtl = (_parDirection == Qt::RightToLeft);
+			line.itemsFrom = int(_collect->items.size());
+			_collect->lines.push_back(line);
+		} else if (!_p) {
 			if (_lookupX < x) {
 				if (_lookupSymbol) {
 					if (_parDirection == Qt::RightToLeft) {
@@ -1233,16 +1506,32 @@ private:
 		if (!elidedLine) initParagraphBidi(); // if was not inited
 
 		_f = _t->_st->font;
-		QStackTextEngine engine(lineText, _f->f);
-		engine.option.setTextDirection(_parDirection);
-		_e = &engine;
-
-		eItemize();
 
 		QScriptLine line;
 		line.from = lineStart;
 		line.length = lineLength;
-		eShapeLine(line);
+
+		auto shapedKey = TextShapedLines::Key();
+		auto shapedLines = elidedLine ? nullptr : prepareShapedLineKey(lineEnd, lineStart, lineLength, &shapedKey);
+		auto shaped = shapedLines ? shapedLines->find(shapedKey) : nullptr;
+		auto created = std::unique_ptr<QTextEngine>();
+		if (shaped) {
+			_e = shaped;
+			_e->fnt = _f->f;
+			_e->resetFontEngineCache();
+		} else {
+			created = std::make_unique<QTextEngine>(lineText, _f->f);
+			created->option.setTextDirection(_parDirection);
+			_e = created.get();
+
+			eItemize();
+			eShapeLine(line);
+
+			if (shapedLines) {
+				_e = shapedLines->store(shapedKey, std::move(created));
+			}
+		}
+		auto &engine = *_e;
 
 		int firstItem = engine.findItem(line.from), lastItem = engine.findItem(line.from + line.length - 1);
 	    int nItems = (firstItem >= 0 && lastItem >= firstItem) ? (lastItem - firstItem + 1) : 0;
@@ -1305,7 +1594,9 @@ private:
 			}
 			if (si.analysis.flags >= QScriptAnalysis::TabOrObject) {
 				TextBlockType _type = currentBlock->type();
-				if (!_p && _lookupX >= x && _lookupX < x + si.width) { // _lookupRequest
+				if (_collect) {
+					collectItem(x, si.width, currentBlock);
+				} else if (!_p && _lookupX >= x && _lookupX < x + si.width) { // _lookupRequest
 					if (_lookupLink) {
 						if (currentBlock->lnkIndex() && _lookupY >= _y + _yDelta && _lookupY < _y + _yDelta + _fontHeight) {
 							_lookupResult.link = _t->_links.at(currentBlock->lnkIndex() - 1);
@@ -1406,7 +1697,9 @@ private:
 			for (int g = glyphsStart; g < glyphsEnd; ++g)
 				itemWidth += glyphs.effectiveAdvance(g);
 
-			if (!_p && _lookupX >= x && _lookupX < x + itemWidth) { // _lookupRequest
+			if (_collect) {
+				collectItem(x, itemWidth, currentBlock);
+			} else if (!_p && _lookupX >= x && _lookupX < x + itemWidth) { // _lookupRequest
 				if (_lookupLink) {
 					if (currentBlock->lnkIndex() && _lookupY >= _y + _yDelta && _lookupY < _y + _yDelta + _fontHeight) {
 						_lookupResult.link = _t->_links.at(currentBlock->lnkIndex() - 1);
@@ -1540,6 +1833,51 @@ private:
 		}
 		return true;
 	}
+	// Returns nullptr if the line should not be cached.
+	TextShapedLines *prepareShapedLineKey(int lineEnd, int lineStart, int lineLength, TextShapedLines::Key *key) {
+		if (_elideSaved || _localFrom < 0 || lineEnd > 0xFFFF) {
+			return nullptr;
+		}
+
+		// Link fonts depend on the hover state, it is a part of the key.
+		auto linksActive = uint64(0);
+		auto &st = _t->_st;
+		if (st->linkFont != st->linkFontOver) {
+			auto linkIndex = 0;
+			for (auto i = _lineStartBlock; i < _blocksSize; ++i) {
+				auto block = _t->_blocks[i].get();
+				if (block->from() >= lineEnd) {
+					break;
+				} else if (!block->lnkIndex()) {
+					continue;
+				} else if (linkIndex == 64) {
+					return nullptr;
+				}
+				if (ClickHandler::showAsActive(_t->_links.at(block->lnkIndex() - 1))) {
+					linksActive |= (uint64(1) << linkIndex);
+				}
+				++linkIndex;
+			}
+		}
+
+		key->from = static_cast<uint16>(_localFrom);
+		key->till = static_cast<uint16>(lineEnd);
+		key->lineStart = lineStart;
+		key->lineLength = lineLength;
+		key->direction = _parDirection;
+		key->linksActive = linksActive;
+		return TextShapedLines::Prepare(_t, _w.toInt());
+	}
+
+	void collectItem(QFixed left, QFixed width, const ITextBlock *block) {
+		auto item = TextShapedLines::HitItem();
+		item.left = left;
+		item.width = width;
+		item.lnkIndex = block->lnkIndex();
+		item.skip = (block->type() == TextBlockTSkip);
+		_collect->items.push_back(item);
+	}
+
 	void fillSelectRange(QFixed from, QFixed to) {
 		auto left = from.toInt();
 		auto width = to.toInt() - left;
@@ -1547,14 +1885,17 @@ private:
 	}
 
 	void elideSaveBlock(int32 blockIndex, ITextBlock *&_endBlock, int32 elideStart, int32 elideWidth) {
-		if (_elideSavedBlock) {
+		if (_elideSaved) {
 			restoreAfterElided();
 		}
 
 		_elideSavedIndex = blockIndex;
 		auto mutableText = const_cast<Text*>(_t);
-		_elideSavedBlock = std::move(mutableText->_blocks[blockIndex]);
-		mutableText->_blocks[blockIndex] = std::make_unique<TextBlock>(_t->_st->font, _t->_text, QFIXED_MAX, elideStart, 0, _elideSavedBlock->flags(), _elideSavedBlock->lnkIndex());
+		_elideSavedBlock = mutableText->_blocks[blockIndex];
+		_elideSaved = true;
+
+		// An empty block does not add any words to the shared buffer.
+		mutableText->_blocks[blockIndex] = StoredTextBlock::Make<TextBlock>(_t->_st->font, _t->_text, QFIXED_MAX, elideStart, 0, _elideSavedBlock->flags(), _elideSavedBlock->lnkIndex(), mutableText->_words);
 		_blocksSize = blockIndex + 1;
 		_endBlock = (blockIndex + 1 < _t->_blocks.size() ? _t->_blocks[blockIndex + 1].get() : nullptr);
 	}
@@ -1678,8 +2019,9 @@ private:
 	}
 
 	void restoreAfterElided() {
-		if (_elideSavedBlock) {
-			const_cast<Text*>(_t)->_blocks[_elideSavedIndex] = std::move(_elideSavedBlock);
+		if (_elideSaved) {
+			const_cast<Text*>(_t)->_blocks[_elideSavedIndex] = _elideSavedBlock;
+			_elideSaved = false;
 		}
 	}
 
@@ -2361,7 +2703,8 @@ private:
 	// elided hack support
 	int _blocksSize = 0;
 	int _elideSavedIndex = 0;
-	std::unique_ptr<ITextBlock> _elideSavedBlock;
+	StoredTextBlock _elideSavedBlock;
+	bool _elideSaved = false;
 
 	int _lineStart = 0;
 	int _localFrom = 0;
@@ -2374,6 +2717,7 @@ private:
 	bool _lookupLink = false;
 	Text::StateRequest _lookupRequest;
 	Text::StateResult _lookupResult;
+	TextShapedLines::HitMap *_collect = nullptr;
 
 };
 
@@ -2408,12 +2752,11 @@ Text::Text(const Text &other)
 , _minHeight(other._minHeight)
 , _text(other._text)
 , _st(other._st)
+, _blocks(other._blocks)
+, _words(other._words)
 , _links(other._links)
 , _startDir(other._startDir) {
-	_blocks.reserve(other._blocks.size());
-	for (auto &block : other._blocks) {
-		_blocks.push_back(block->clone());
-	}
+	updateMemoryUsage();
 }
 
 Text::Text(Text &&other)
@@ -2423,8 +2766,10 @@ Text::Text(Text &&other)
 , _text(other._text)
 , _st(other._st)
 , _blocks(std::move(other._blocks))
+, _words(std::move(other._words))
 , _links(other._links)
 , _startDir(other._startDir) {
+	updateMemoryUsage();
 	other.clearFields();
 }
 
@@ -2434,12 +2779,12 @@ Text &Text::operator=(const Text &other) {
 	_minHeight = other._minHeight;
 	_text = other._text;
 	_st = other._st;
-	_blocks = TextBlocks(other._blocks.size());
+	_blocks = other._blocks;
+	_words = other._words;
 	_links = other._links;
 	_startDir = other._startDir;
-	for (int32 i = 0, l = _blocks.size(); i < l; ++i) {
-		_blocks[i] = other._blocks.at(i)->clone();
-	}
+	clearShapedLines();
+	updateMemoryUsage();
 	return *this;
 }
 
@@ -2450,8 +2795,11 @@ Text &Text::operator=(Text &&other) {
 	_text = other._text;
 	_st = other._st;
 	_blocks = std::move(other._blocks);
+	_words = std::move(other._words);
 	_links = other._links;
 	_startDir = other._startDir;
+	clearShapedLines();
+	updateMemoryUsage();
 	other.clearFields();
 	return *this;
 }
@@ -2536,6 +2884,7 @@ void Text::recountNaturalSize(bool initial, Qt::LayoutDirection optionsDir) {
 		_minHeight += lineHeight;
 		accumulate_max(_maxWidth, _width);
 	}
+	updateMemoryUsage();
 }
 
 void Text::setMarkedText(const style::TextStyle &st, const TextWithEntities &textWithEntities, const TextParseOptions &options) {
@@ -2672,7 +3021,8 @@ void Text::setSkipBlock(int32 width, int32 height) {
 		_blocks.pop_back();
 	}
 	_text.push_back('_');
-	_blocks.push_back(std::make_unique<SkipBlock>(_st->font, _text, _text.size() - 1, width, height, 0));
+	_blocks.push_back(StoredTextBlock::Make<SkipBlock>(_st->font, _text, _text.size() - 1, width, height, 0));
+	clearShapedLines();
 	recountNaturalSize(false);
 }
 
@@ -2680,6 +3030,7 @@ void Text::removeSkipBlock() {
 	if (!_blocks.empty() && _blocks.back()->type() == TextBlockTSkip) {
 		_text.resize(_blocks.back()->from());
 		_blocks.pop_back();
+		clearShapedLines();
 		recountNaturalSize(false);
 	}
 }
@@ -2754,7 +3105,7 @@ void Text::enumerateLines(int w, Callback callback) const {
 
 		if (_btype == TextBlockTText) {
 			auto t = static_cast<TextBlock*>(b.get());
-			if (t->_words.isEmpty()) { // no words in this block, spaces only => layout this block in the same line
+			if (!t->hasWords()) { // no words in this block, spaces only => layout this block in the same line
 				last_rPadding += b->f_rpadding();
 
 				lineHeight = qMax(lineHeight, blockHeight);
@@ -2765,7 +3116,7 @@ void Text::enumerateLines(int w, Callback callback) const {
 
 			auto f_wLeft = widthLeft;
 			int f_lineHeight = lineHeight;
-			for (auto j = t->_words.cbegin(), e = t->_words.cend(), f = j; j != e; ++j) {
+			for (auto j = t->wordsBegin(_words), e = t->wordsEnd(_words), f = j; j != e; ++j) {
 				bool wordEndsHere = (j->f_width() >= 0);
 				auto j_width = wordEndsHere ? j->f_width() : -j->f_width();
 
@@ -3029,19 +3380,107 @@ QString Text::originalText(TextSelection selection, ExpandLinksMode mode) const
 }
 
 void Text::clear() {
-	clearFields();
 	_text.clear();
+	clearFields();
 }
 
 void Text::clearFields() {
 	_blocks.clear();
+	_words.clear();
 	_links.clear();
 	_maxWidth = _minHeight = 0;
 	_startDir = Qt::LayoutDirectionAuto;
+	clearShapedLines();
+	updateMemoryUsage();
+}
+
+void Text::clearShapedLines() const {
+	_shapedLines = nullptr;
+}
+
+void Text::updateMemoryUsage() {
+	_memory.setBytes(_text.capacity() * sizeof(QChar)
+		+ _blocks.capacity() * sizeof(TextBlocks::value_type)
+		+ _words.capacity() * sizeof(TextWords::value_type)
+		+ _links.size() * sizeof(TextLinks::value_type));
 }
 
 Text::~Text() = default;
 
+void SingleLineText::setText(const style::TextStyle &st, const QString &text, const TextParseOptions &options) {
+	_st = &st;
+	_text = text;
+	_elided = QString();
+	_elidedWidth = -1;
+	if (IsPlain(text)) {
+		_width = _st->font->width(_text);
+		_full = nullptr;
+	} else {
+		if (!_full) {
+			_full = std::make_unique<Text>();
+		}
+		_full->setText(st, text, options);
+		_width = 0;
+	}
+}
+
+void SingleLineText::drawElided(Painter &p, int left, int top, int width) const {
+	if (_full) {
+		_full->drawElided(p, left, top, width);
+		return;
+	} else if (_text.isEmpty() || width <= 0) {
+		return;
+	}
+	auto &font = _st->font;
+	if (_width > width && _elidedWidth != width) {
+		_elided = font->elided(_text, width);
+		_elidedWidth = width;
+	}
+
+	// Same baseline as in TextPainter::drawLine().
+	auto lineHeight = qMax(_st->lineHeight, font->height);
+	p.setFont(font);
+	p.drawText(left, top + (lineHeight - font->height) / 2 + font->ascent, (_width > width) ? _elided : _text);
+}
+
+bool SingleLineText::IsPlain(const QString &text) {
+	if (text.isEmpty()) {
+		return true;
+	} else if (chIsTrimmed(text.front()) || chIsTrimmed(text.back())) {
+		return false;
+	}
+	for (auto ch = text.constBegin(), end = text.constEnd(); ch != end; ++ch) {
+		auto code = ch->unicode();
+		if (code < 0x80) {
+			if (code < 0x20 || code == 0x7F) {
+				return false;
+			}
+			continue;
+		} else if (ch->isSurrogate() || ch->isMark() || chIsSpace(*ch) || chIsBad(*ch)) {
+			return false;
+		}
+		switch (ch->direction()) {
+		case QChar::DirR:
+		case QChar::DirAL:
+		case QChar::DirAN:
+		case QChar::DirLRE:
+		case QChar::DirLRO:
+		case QChar::DirRLE:
+		case QChar::DirRLO:
+		case QChar::DirPDF:
+		case QChar::DirLRI:
+		case QChar::DirRLI:
+		case QChar::DirFSI:
+		case QChar::DirPDI: return false;
+		default: break;
+		}
+		if (Ui::Emoji::Find(ch, end)) {
+			return false;
+		}
+	}
+	return true;
+}
+
 void emojiDraw(QPainter &p, EmojiPtr e, int x, int y) {
 	auto size = Ui::Emoji::Size();
 	p.drawPixmap(QPoint(x, y), App::emoji(), QRect(e->x() * size, e->y() * size, size, size));
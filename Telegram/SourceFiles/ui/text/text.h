@@ -23,6 +23,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "private/qfontengine_p.h"
 
 #include "core/click_handler.h"
+#include "core/memory_stats.h"
 #include "ui/text/text_entity.h"
 #include "ui/emoji_config.h"
 #include "base/flags.h"
@@ -81,7 +82,9 @@ static constexpr TextSelection AllTextSelection = { 0, 0xFFFF };
 typedef QPair<QString, QString> TextCustomTag; // open str and close str
 typedef QMap<QChar, TextCustomTag> TextCustomTagsMap;
 
-class ITextBlock;
+class StoredTextBlock;
+class TextWord;
+class TextShapedLines;
 class Text {
 public:
 	Text(int32 minResizeWidth = QFIXED_MAX);
@@ -197,6 +200,7 @@ public:
 		for (int32 j = from + dots; j < to; ++j) {
 			_text[j] = QChar(' ');
 		}
+		clearShapedLines();
 		return true;
 	}
 
@@ -204,7 +208,8 @@ public:
 	~Text();
 
 private:
-	using TextBlocks = std::vector<std::unique_ptr<ITextBlock>>;
+	using TextBlocks = std::vector<StoredTextBlock>;
+	using TextWords = std::vector<TextWord>;
 	using TextLinks = QVector<ClickHandlerPtr>;
 
 	uint16 countBlockEnd(const TextBlocks::const_iterator &i, const TextBlocks::const_iterator &e) const;
@@ -226,6 +231,12 @@ private:
 	// it is also called from move constructor / assignment operator
 	void clearFields();
 
+	// Drops the lines shaped by TextPainter, must be called on any _text or _blocks change.
+	void clearShapedLines() const;
+
+	// Estimates the memory held by the text and its blocks.
+	void updateMemoryUsage();
+
 	QFixed _minResizeWidth;
 	QFixed _maxWidth = 0;
 	int32 _minHeight = 0;
@@ -234,14 +245,59 @@ private:
 	const style::TextStyle *_st = nullptr;
 
 	TextBlocks _blocks;
+	TextWords _words; // of all the text blocks
 	TextLinks _links;
 
 	Qt::LayoutDirection _startDir = Qt::LayoutDirectionAuto;
 
+	mutable std::unique_ptr<TextShapedLines> _shapedLines;
+
+	MemoryStats::Tracker<MemoryStats::Kind::TextLayouts> _memory;
+
 	friend class TextParser;
 	friend class TextPainter;
+	friend class TextShapedLines;
 
 };
+
+// Short single line text without entities, like the peer names and phones.
+//
+// Most of them are plain strings: those are measured once and painted by a
+// single drawText() with a cached elision, without parsing any blocks. Strings
+// that need the full layout (emoji, right-to-left, marks) fall back to Text.
+class SingleLineText {
+public:
+	// The options are used only if the text falls back to Text.
+	void setText(const style::TextStyle &st, const QString &text, const TextParseOptions &options);
+
+	int maxWidth() const {
+		return _full ? _full->maxWidth() : _width;
+	}
+	bool isEmpty() const {
+		return _text.isEmpty();
+	}
+	const QString &toString() const {
+		return _text;
+	}
+
+	void drawElided(Painter &p, int left, int top, int width) const;
+	void drawLeftElided(Painter &p, int left, int top, int width, int outerw) const {
+		drawElided(p, rtl() ? (outerw - left - width) : left, top, width);
+	}
+
+private:
+	static bool IsPlain(const QString &text);
+
+	const style::TextStyle *_st = nullptr;
+	QString _text;
+	int _width = 0;
+	std::unique_ptr<Text> _full;
+
+	mutable QString _elided;
+	mutable int _elidedWidth = -1;
+
+};
+
 inline TextSelection snapSelection(int from, int to) {
 	return { static_cast<uint16>(snap(from, 0, 0xFFFF)), static_cast<uint16>(snap(to, 0, 0xFFFF)) };
 }
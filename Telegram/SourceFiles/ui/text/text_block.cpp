@@ -157,9 +157,17 @@ static inline void addNextCluster(int &pos, int end, ScriptLine &line, int &glyp
 class BlockParser {
 public:
 
-	BlockParser(QTextEngine *e, TextBlock *b, QFixed minResizeWidth, int32 blockFrom, const QString &str)
-		: block(b), eng(e), str(str) {
+	BlockParser(QTextEngine *e, TextBlock *b, TextWords &words, QFixed minResizeWidth, int32 blockFrom, const QString &str)
+		: block(b), words(words), wordsFrom(words.size()), eng(e), str(str) {
 		parseWords(minResizeWidth, blockFrom);
+
+		block->_wordsFrom = wordsFrom;
+		block->_wordsCount = words.size() - wordsFrom;
+		block->_rbearing = wordsEmpty() ? 0 : int16(words.back().f_rbearing().value());
+	}
+
+	bool wordsEmpty() const {
+		return (words.size() == wordsFrom);
 	}
 
 	void parseWords(QFixed minResizeWidth, int32 blockFrom) {
@@ -176,8 +184,6 @@ public:
 		int end = 0;
 		lbh.logClusters = eng->layoutData->logClustersPtr;
 
-		block->_words.clear();
-
 		int wordStart = lbh.currentPosition;
 
 		bool addingEachGrapheme = false;
@@ -210,10 +216,10 @@ public:
 					addNextCluster(lbh.currentPosition, end, lbh.spaceData, lbh.glyphCount,
 						current, lbh.logClusters, lbh.glyphs);
 
-				if (block->_words.isEmpty()) {
-					block->_words.push_back(TextWord(wordStart + blockFrom, lbh.tmpData.textWidth, -lbh.negativeRightBearing()));
+				if (wordsEmpty()) {
+					words.push_back(TextWord(wordStart + blockFrom, lbh.tmpData.textWidth, -lbh.negativeRightBearing()));
 				}
-				block->_words.back().add_rpadding(lbh.spaceData.textWidth);
+				words.back().add_rpadding(lbh.spaceData.textWidth);
 				block->_width += lbh.spaceData.textWidth;
 				lbh.spaceData.length = 0;
 				lbh.spaceData.textWidth = 0;
@@ -232,7 +238,7 @@ public:
 						|| attributes[lbh.currentPosition].whiteSpace
 						|| isLineBreak(attributes, lbh.currentPosition)) {
 						lbh.calculateRightBearing();
-						block->_words.push_back(TextWord(wordStart + blockFrom, lbh.tmpData.textWidth, -lbh.negativeRightBearing()));
+						words.push_back(TextWord(wordStart + blockFrom, lbh.tmpData.textWidth, -lbh.negativeRightBearing()));
 						block->_width += lbh.tmpData.textWidth;
 						lbh.tmpData.textWidth = 0;
 						lbh.tmpData.length = 0;
@@ -242,7 +248,7 @@ public:
 						if (!addingEachGrapheme && lbh.tmpData.textWidth > minResizeWidth) {
 							if (lastGraphemeBoundaryPosition >= 0) {
 								lbh.calculateRightBearingForPreviousGlyph();
-								block->_words.push_back(TextWord(wordStart + blockFrom, -lastGraphemeBoundaryLine.textWidth, -lbh.negativeRightBearing()));
+								words.push_back(TextWord(wordStart + blockFrom, -lastGraphemeBoundaryLine.textWidth, -lbh.negativeRightBearing()));
 								block->_width += lastGraphemeBoundaryLine.textWidth;
 								lbh.tmpData.textWidth -= lastGraphemeBoundaryLine.textWidth;
 								lbh.tmpData.length -= lastGraphemeBoundaryLine.length;
@@ -252,7 +258,7 @@ public:
 						}
 						if (addingEachGrapheme) {
 							lbh.calculateRightBearing();
-							block->_words.push_back(TextWord(wordStart + blockFrom, -lbh.tmpData.textWidth, -lbh.negativeRightBearing()));
+							words.push_back(TextWord(wordStart + blockFrom, -lbh.tmpData.textWidth, -lbh.negativeRightBearing()));
 							block->_width += lbh.tmpData.textWidth;
 							lbh.tmpData.textWidth = 0;
 							lbh.tmpData.length = 0;
@@ -268,10 +274,9 @@ public:
 			if (lbh.currentPosition == end)
 				newItem = item + 1;
 		}
-		if (!block->_words.isEmpty()) {
-			block->_rpadding = block->_words.back().f_rpadding();
+		if (!wordsEmpty()) {
+			block->_rpadding = words.back().f_rpadding();
 			block->_width -= block->_rpadding;
-			block->_words.squeeze();
 		}
 	}
 
@@ -286,6 +291,8 @@ public:
 private:
 
 	TextBlock *block;
+	TextWords &words;
+	TextWords::size_type wordsFrom = 0;
 	QTextEngine *eng;
 	const QString &str;
 
@@ -295,7 +302,7 @@ QFixed ITextBlock::f_rbearing() const {
 	return (type() == TextBlockTText) ? static_cast<const TextBlock*>(this)->real_f_rbearing() : 0;
 }
 
-TextBlock::TextBlock(const style::font &font, const QString &str, QFixed minResizeWidth, uint16 from, uint16 length, uchar flags, uint16 lnkIndex) : ITextBlock(font, str, from, length, flags, lnkIndex) {
+TextBlock::TextBlock(const style::font &font, const QString &str, QFixed minResizeWidth, uint16 from, uint16 length, uchar flags, uint16 lnkIndex, TextWords &words) : ITextBlock(font, str, from, length, flags, lnkIndex) {
 	_flags |= ((TextBlockTText & 0x0F) << 8);
 	if (length) {
 		style::font blockFont = font;
@@ -334,7 +341,7 @@ TextBlock::TextBlock(const style::font &font, const QString &str, QFixed minResi
 		layout.beginLayout();
 		layout.createLine();
 
-		BlockParser parser(&engine, this, minResizeWidth, _from, part);
+		BlockParser parser(&engine, this, words, minResizeWidth, _from, part);
 
 		layout.endLayout();
 
@@ -39,6 +39,11 @@ enum TextBlockFlags {
 	TextBlockFPre = 0x40,
 };
 
+class TextWord;
+using TextWords = std::vector<TextWord>;
+
+// Blocks are not polymorphic: the type is kept in the flags and all of them
+// are trivially copyable, so they are stored inline in StoredTextBlock.
 class ITextBlock {
 public:
 	ITextBlock(const style::font &font, const QString &str, uint16 from, uint16 length, uchar flags, uint16 lnkIndex) : _from(from), _flags((flags & 0xFF) | ((lnkIndex & 0xFFFF) << 12)) {
@@ -77,10 +82,6 @@ public:
 		return (_flags & 0xFF);
 	}
 
-	virtual std::unique_ptr<ITextBlock> clone() const = 0;
-	virtual ~ITextBlock() {
-	}
-
 protected:
 	uint16 _from = 0;
 
@@ -107,10 +108,6 @@ public:
 		return _nextDir;
 	}
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<NewlineBlock>(*this);
-	}
-
 private:
 	Qt::LayoutDirection _nextDir;
 
@@ -153,22 +150,30 @@ private:
 
 };
 
+// The words of all text blocks are appended to the buffer of the owning Text.
 class TextBlock : public ITextBlock {
 public:
-	TextBlock(const style::font &font, const QString &str, QFixed minResizeWidth, uint16 from, uint16 length, uchar flags, uint16 lnkIndex);
+	TextBlock(const style::font &font, const QString &str, QFixed minResizeWidth, uint16 from, uint16 length, uchar flags, uint16 lnkIndex, TextWords &words);
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<TextBlock>(*this);
+	bool hasWords() const {
+		return (_wordsCount > 0);
+	}
+	TextWords::const_iterator wordsBegin(const TextWords &words) const {
+		return words.cbegin() + _wordsFrom;
+	}
+	TextWords::const_iterator wordsEnd(const TextWords &words) const {
+		return words.cbegin() + _wordsFrom + _wordsCount;
 	}
 
 private:
 	friend class ITextBlock;
 	QFixed real_f_rbearing() const {
-		return _words.isEmpty() ? 0 : _words.back().f_rbearing();
+		return QFixed::fromFixed(_rbearing);
 	}
 
-	typedef QVector<TextWord> TextWords;
-	TextWords _words;
+	int32 _wordsFrom = 0;
+	uint16 _wordsCount = 0;
+	int16 _rbearing = 0; // of the last word
 
 	friend class Text;
 	friend class TextParser;
@@ -182,10 +187,6 @@ class EmojiBlock : public ITextBlock {
 public:
 	EmojiBlock(const style::font &font, const QString &str, uint16 from, uint16 length, uchar flags, uint16 lnkIndex, EmojiPtr emoji);
 
-	std::unique_ptr<ITextBlock> clone() const {
-		return std::make_unique<EmojiBlock>(*this);
-	}
-
 private:
 	EmojiPtr emoji = nullptr;
 
@@ -204,10 +205,6 @@ public:
 		return _height;
 	}
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<SkipBlock>(*this);
-	}
-
 private:
 	int32 _height;
 
@@ -217,3 +214,36 @@ private:
 	friend class TextPainter;
 
 };
+
+// Any of the blocks above, stored inline in the blocks vector of Text instead
+// of a separate heap allocation for each block. Has the pointer semantics of
+// the std::unique_ptr<ITextBlock> it replaced: get() is non-const.
+class StoredTextBlock {
+public:
+	template <typename Block, typename ...Args>
+	static StoredTextBlock Make(Args &&...args) {
+		static_assert(std::is_base_of<ITextBlock, Block>::value, "Bad text block type.");
+		static_assert(sizeof(Block) <= sizeof(Data) && alignof(Block) <= alignof(Data), "Text block is too large.");
+		static_assert(std::is_trivially_copyable<Block>::value && std::is_trivially_destructible<Block>::value, "Text block must be trivially copyable.");
+
+		auto result = StoredTextBlock();
+		new (&result._data) Block(std::forward<Args>(args)...);
+		return result;
+	}
+
+	ITextBlock *get() const {
+		return reinterpret_cast<ITextBlock*>(&_data);
+	}
+	ITextBlock *operator->() const {
+		return get();
+	}
+	ITextBlock &operator*() const {
+		return *get();
+	}
+
+private:
+	// Enough for the largest ones: TextBlock and EmojiBlock on 64 bit.
+	using Data = std::aligned_storage_t<24, alignof(void*)>;
+	mutable Data _data;
+
+};
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/text/text_entity.h"
 
 #include "auth_session.h"
+#include "base/flags.h"
 #include "lang/lang_tag.h"
 
 namespace TextUtilities {
@@ -1768,16 +1769,96 @@ void ParseMarkdown(TextWithEntities &result, bool rich) {
 }
 
 // Some code is duplicated in flattextarea.cpp!
+namespace {
+
+// Each entity expression can match only if the text has its marker char.
+enum class EntityMarker {
+	Dot     = 0x01, // domains and e-mails
+	Colon   = 0x02, // explicit domains, like "test://localhost"
+	Hash    = 0x04, // hashtags
+	At      = 0x08, // mentions
+	Slash   = 0x10, // bot commands
+};
+using EntityMarkers = base::flags<EntityMarker>;
+inline constexpr auto is_flag_type(EntityMarker) { return true; };
+
+EntityMarkers CollectEntityMarkers(const QString &text) {
+	constexpr auto kAll = EntityMarker::Dot
+		| EntityMarker::Colon
+		| EntityMarker::Hash
+		| EntityMarker::At
+		| EntityMarker::Slash;
+	auto result = EntityMarkers();
+	for (auto ch = text.constData(), end = ch + text.size(); ch != end; ++ch) {
+		switch (ch->unicode()) {
+		case '.': result |= EntityMarker::Dot; break;
+		case ':': result |= EntityMarker::Colon; break;
+		case '#': result |= EntityMarker::Hash; break;
+		case '@': result |= EntityMarker::At; break;
+		case '/': result |= EntityMarker::Slash; break;
+		default: continue;
+		}
+		if (result == kAll) {
+			break;
+		}
+	}
+	return result;
+}
+
+// The text is not changed while the entities are parsed and the search
+// offset mostly moves forward, so a found match stays valid until the
+// offset passes its start. This way each expression scans the text once.
+class EntityMatcher {
+public:
+	EntityMatcher(const QRegularExpression &expression, bool enabled)
+	: _expression(expression)
+	, _enabled(enabled) {
+	}
+
+	QRegularExpressionMatch match(const QString &text, int offset) {
+		if (!_enabled) {
+			return QRegularExpressionMatch();
+		}
+		if (_offset < 0
+			|| offset < _offset
+			|| (_match.hasMatch() && _match.capturedStart() < offset)) {
+			_match = _expression.match(text, offset);
+			_offset = offset;
+		}
+		return _match;
+	}
+
+private:
+	const QRegularExpression &_expression;
+	bool _enabled = false;
+	int _offset = -1;
+	QRegularExpressionMatch _match;
+
+};
+
+} // namespace
+
 void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 	if (flags & TextParseMarkdown) { // parse markdown entities (bold, italic, code and pre)
 		ParseMarkdown(result, rich);
 	}
 
+	auto markers = CollectEntityMarkers(result.text);
+	if (!markers) {
+		return;
+	}
+
 	auto newEntities = EntitiesInText();
 	bool withHashtags = (flags & TextParseHashtags);
 	bool withMentions = (flags & TextParseMentions);
 	bool withBotCommands = (flags & TextParseBotCommands);
 
+	auto domainMatcher = EntityMatcher(RegExpDomain(), markers & EntityMarker::Dot);
+	auto explicitDomainMatcher = EntityMatcher(RegExpDomainExplicit(), markers & EntityMarker::Colon);
+	auto hashtagMatcher = EntityMatcher(RegExpHashtag(), withHashtags && (markers & EntityMarker::Hash));
+	auto mentionMatcher = EntityMatcher(RegExpMention(), withMentions && (markers & EntityMarker::At));
+	auto botCommandMatcher = EntityMatcher(RegExpBotCommand(), withBotCommands && (markers & EntityMarker::Slash));
+
 	int existingEntityIndex = 0, existingEntitiesCount = result.entities.size();
 	int existingEntityEnd = 0;
 
@@ -1794,11 +1875,11 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				}
 			}
 		}
-		auto mDomain = RegExpDomain().match(result.text, matchOffset);
-		auto mExplicitDomain = RegExpDomainExplicit().match(result.text, matchOffset);
-		auto mHashtag = withHashtags ? RegExpHashtag().match(result.text, matchOffset) : QRegularExpressionMatch();
-		auto mMention = withMentions ? RegExpMention().match(result.text, qMax(mentionSkip, matchOffset)) : QRegularExpressionMatch();
-		auto mBotCommand = withBotCommands ? RegExpBotCommand().match(result.text, matchOffset) : QRegularExpressionMatch();
+		auto mDomain = domainMatcher.match(result.text, matchOffset);
+		auto mExplicitDomain = explicitDomainMatcher.match(result.text, matchOffset);
+		auto mHashtag = hashtagMatcher.match(result.text, matchOffset);
+		auto mMention = mentionMatcher.match(result.text, qMax(mentionSkip, matchOffset));
+		auto mBotCommand = botCommandMatcher.match(result.text, matchOffset);
 
 		EntityInTextType lnkType = EntityInTextUrl;
 		int32 lnkStart = 0, lnkLength = 0;
@@ -1829,7 +1910,7 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 			}
 			if (!(start + mentionStart + 1)->isLetter() || !(start + mentionEnd - 1)->isLetterOrNumber()) {
 				mentionSkip = mentionEnd;
-				mMention = RegExpMention().match(result.text, qMax(mentionSkip, matchOffset));
+				mMention = mentionMatcher.match(result.text, qMax(mentionSkip, matchOffset));
 				if (mMention.hasMatch()) {
 					mentionStart = mMention.capturedStart();
 					mentionEnd = mMention.capturedEnd();
@@ -20,6 +20,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "twidget.h"
 
+#include <qpa/qplatformbackingstore.h>
+
 #include "application.h"
 #include "mainwindow.h"
 
@@ -181,6 +183,30 @@ QImage myGrabImage(TWidget *target, QRect rect, QColor bg) {
 	return result;
 }
 
+QImage myGrabImageFromBackingStore(TWidget *target, QRect rect) {
+	myEnsureResized(target);
+	if (rect.isNull()) rect = target->rect();
+
+	auto window = target->window();
+	auto handle = window->windowHandle();
+	if (!target->isVisible() || !handle || !handle->isExposed()) {
+		return QImage();
+	}
+	auto store = window->backingStore();
+	if (!store || !store->handle()) {
+		return QImage();
+	}
+	auto image = store->handle()->toImage();
+	auto source = QRect(target->mapTo(window, rect.topLeft()) * cIntRetinaFactor(), rect.size() * cIntRetinaFactor());
+	if (image.isNull() || !image.rect().contains(source)) {
+		return QImage();
+	}
+
+	auto result = image.copy(source).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	result.setDevicePixelRatio(cRetinaFactor());
+	return result;
+}
+
 void sendSynteticMouseEvent(QWidget *widget, QEvent::Type type, Qt::MouseButton button, const QPoint &globalPoint) {
 	if (auto windowHandle = widget->window()->windowHandle()) {
 		auto localPoint = windowHandle->mapFromGlobal(globalPoint);
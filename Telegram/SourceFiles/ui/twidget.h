@@ -395,6 +395,11 @@ void myEnsureResized(QWidget *target);
 QPixmap myGrab(TWidget *target, QRect rect = QRect(), QColor bg = QColor(255, 255, 255, 0));
 QImage myGrabImage(TWidget *target, QRect rect = QRect(), QColor bg = QColor(255, 255, 255, 0));
 
+// Copies the already painted pixels from the window backing store instead of
+// rendering the widget again. Nothing should overlap the rect and the widget
+// should be painted already. Returns a null image if the store can't be read.
+QImage myGrabImageFromBackingStore(TWidget *target, QRect rect = QRect());
+
 class SingleQueuedInvokation : public QObject {
 public:
 	SingleQueuedInvokation(base::lambda<void()> callback) : _callback(callback) {
@@ -0,0 +1,117 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "ui/userpic_atlas.h"
+
+namespace Ui {
+namespace {
+
+constexpr auto kSlotsPerSide = 16;
+constexpr auto kSlotsPerPage = kSlotsPerSide * kSlotsPerSide;
+constexpr auto kMaxPages = 4;
+
+NeverFreedPointer<std::map<int, std::unique_ptr<UserpicAtlas>>> Atlases;
+
+} // namespace
+
+UserpicAtlas::UserpicAtlas(int size) : _size(size) {
+}
+
+UserpicAtlas &UserpicAtlas::ForSize(int size) {
+	Atlases.createIfNull();
+	auto &result = (*Atlases)[size];
+	if (!result) {
+		result = std::make_unique<UserpicAtlas>(size);
+	}
+	return *result;
+}
+
+void UserpicAtlas::paint(Painter &p, not_null<PeerData*> peer, int x, int y, int outerWidth) {
+	// Start loading the photo the same way PeerData::paintUserpic() does.
+	peer->currentUserpic();
+
+	auto index = slotFor(peer, peer->userpicUniqueKey());
+	auto source = slotRect(index);
+	auto target = rtlrect(x, y, _size, _size, outerWidth);
+	p.drawPixmap(target, _pages[index / kSlotsPerPage], source);
+}
+
+int UserpicAtlas::slotFor(not_null<PeerData*> peer, const StorageKey &key) {
+	auto i = _indices.constFind(key);
+	if (i != _indices.cend()) {
+		_slots[i.value()].used = ++_usedCounter;
+		return i.value();
+	}
+	auto index = chooseSlot();
+	auto &slot = _slots[index];
+	_indices.remove(slot.key);
+	slot.key = key;
+	slot.used = ++_usedCounter;
+	_indices.insert(key, index);
+	fillSlot(index, peer);
+	return index;
+}
+
+int UserpicAtlas::chooseSlot() {
+	auto count = int(_slots.size());
+	if (count < kSlotsPerPage * kMaxPages) {
+		if (count == int(_pages.size()) * kSlotsPerPage) {
+			auto page = QPixmap(QSize(_size, _size) * kSlotsPerSide * cIntRetinaFactor());
+			page.setDevicePixelRatio(cRetinaFactor());
+			_pages.push_back(std::move(page));
+		}
+		_slots.push_back(Slot());
+		return count;
+	}
+	auto result = 0;
+	for (auto i = 1; i != count; ++i) {
+		if (_slots[i].used < _slots[result].used) {
+			result = i;
+		}
+	}
+	return result;
+}
+
+void UserpicAtlas::fillSlot(int index, not_null<PeerData*> peer) {
+	auto column = (index % kSlotsPerPage) % kSlotsPerSide;
+	auto row = (index % kSlotsPerPage) / kSlotsPerSide;
+	auto left = column * _size;
+	auto top = row * _size;
+
+	Painter p(&_pages[index / kSlotsPerPage]);
+	p.setCompositionMode(QPainter::CompositionMode_Source);
+	p.fillRect(left, top, _size, _size, Qt::transparent);
+	p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+	p.setClipRect(left, top, _size, _size);
+	peer->paintUserpic(p, left, top, _size);
+}
+
+QRect UserpicAtlas::slotRect(int index) const {
+	auto column = (index % kSlotsPerPage) % kSlotsPerSide;
+	auto row = (index % kSlotsPerPage) / kSlotsPerSide;
+	auto size = _size * cIntRetinaFactor();
+	return QRect(column * size, row * size, size, size);
+}
+
+void ClearUserpicAtlases() {
+	Atlases.clear();
+}
+
+} // namespace Ui
@@ -0,0 +1,60 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+namespace Ui {
+
+// Keeps circled userpics of one size in a few large pixmaps, so that long
+// lists (dialogs, peer lists) paint them as sub-rect blits from a handful
+// of pixmaps instead of a separate pixmap for each peer. Slots are keyed by
+// PeerData::userpicUniqueKey() and the least recently painted one is reused.
+class UserpicAtlas {
+public:
+	explicit UserpicAtlas(int size);
+
+	// Shared atlas for all the lists painting userpics of that size.
+	static UserpicAtlas &ForSize(int size);
+
+	void paint(Painter &p, not_null<PeerData*> peer, int x, int y, int outerWidth);
+
+private:
+	struct Slot {
+		StorageKey key;
+		uint64 used = 0;
+	};
+
+	int slotFor(not_null<PeerData*> peer, const StorageKey &key);
+	int chooseSlot();
+	void fillSlot(int index, not_null<PeerData*> peer);
+	QRect slotRect(int index) const;
+
+	const int _size;
+	std::vector<QPixmap> _pages;
+	std::vector<Slot> _slots;
+	QHash<StorageKey, int> _indices;
+	uint64 _usedCounter = 0;
+
+};
+
+void ClearUserpicAtlases();
+
+} // namespace Ui
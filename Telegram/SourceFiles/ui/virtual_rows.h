@@ -0,0 +1,81 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+
+namespace Ui {
+
+// Vertical offsets of a list of rows with different heights.
+//
+// Keeps the bottom of every row so that row tops and the row under
+// some y coordinate are found without walking through all the rows.
+class VirtualRows {
+public:
+	void clear() {
+		_bottoms.clear();
+	}
+	void reserve(int count) {
+		_bottoms.reserve(count);
+	}
+	void push(int height) {
+		_bottoms.push_back(fullHeight() + height);
+	}
+
+	int count() const {
+		return int(_bottoms.size());
+	}
+	int top(int index) const {
+		return index ? _bottoms[index - 1] : 0;
+	}
+	int bottom(int index) const {
+		return _bottoms[index];
+	}
+	int height(int index) const {
+		return bottom(index) - top(index);
+	}
+	int fullHeight() const {
+		return _bottoms.empty() ? 0 : _bottoms.back();
+	}
+
+	// Returns the index of the row containing y or count() if y is below all rows.
+	int findByY(int y) const {
+		if (y < 0) {
+			return 0;
+		}
+		return int(std::upper_bound(_bottoms.begin(), _bottoms.end(), y) - _bottoms.begin());
+	}
+
+	// Returns [from, till) range of rows intersecting [top, bottom) interval.
+	std::pair<int, int> findRange(int top, int bottom) const {
+		if (bottom <= top) {
+			return { 0, 0 };
+		}
+		auto from = findByY(top);
+		auto till = (bottom > fullHeight()) ? count() : (findByY(bottom - 1) + 1);
+		return { from, qMax(from, till) };
+	}
+
+private:
+	std::vector<int> _bottoms;
+
+};
+
+} // namespace Ui
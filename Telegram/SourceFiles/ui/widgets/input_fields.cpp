@@ -31,6 +31,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 namespace Ui {
 namespace {
 
+// Inserted text longer than that has all its emoji replaced in one pass.
+constexpr auto kBulkEmojiReplaceLength = 1024;
+
 template <typename InputClass>
 class InputStyle : public QCommonStyle {
 public:
@@ -1072,7 +1075,71 @@ struct FormattingAction {
 
 } // namespace
 
+int FlatTextarea::replaceEmojiBulk(int insertPosition, int insertEnd) {
+	struct Replacement {
+		EmojiPtr emoji = nullptr;
+		int start = 0;
+		int length = 0;
+	};
+	auto replacements = std::vector<Replacement>();
+
+	auto doc = document();
+	auto fromBlock = doc->findBlock(insertPosition);
+	auto tillBlock = doc->findBlock(insertEnd);
+	if (tillBlock.isValid()) tillBlock = tillBlock.next();
+
+	for (auto block = fromBlock; block != tillBlock; block = block.next()) {
+		for (auto fragmentIt = block.begin(); !fragmentIt.atEnd(); ++fragmentIt) {
+			auto fragment = fragmentIt.fragment();
+			Assert(fragment.isValid());
+
+			auto fragmentPosition = fragment.position();
+			if (insertPosition >= fragmentPosition + fragment.length()) {
+				continue;
+			} else if (insertEnd <= fragmentPosition) {
+				break;
+			} else if (fragment.charFormat().isImageFormat()) {
+				continue;
+			}
+
+			auto fragmentText = fragment.text();
+			auto textStart = fragmentText.constData();
+			auto textEnd = textStart + fragmentText.size();
+			auto textTill = textStart + qMin(insertEnd - fragmentPosition, int(fragmentText.size()));
+			for (auto ch = textStart + qMax(insertPosition - fragmentPosition, 0); ch < textTill; ++ch) {
+				auto emojiLength = 0;
+				if (auto emoji = Ui::Emoji::Find(ch, textEnd, &emojiLength)) {
+					auto start = fragmentPosition + int(ch - textStart);
+					replacements.push_back({ emoji, start, emojiLength });
+					ch += emojiLength - 1;
+				}
+			}
+		}
+	}
+	if (replacements.empty()) {
+		return insertEnd;
+	}
+
+	prepareFormattingOptimization(doc);
+
+	// Replace from the end so that the collected positions stay valid.
+	QTextCursor c(doc->docHandle(), 0);
+	for (auto i = replacements.crbegin(), e = replacements.crend(); i != e; ++i) {
+		c.setPosition(i->start);
+		c.setPosition(i->start + i->length, QTextCursor::KeepAnchor);
+		insertEmoji(i->emoji, c);
+		insertEnd -= i->length - 1;
+	}
+	return insertEnd;
+}
+
 void FlatTextarea::processFormatting(int insertPosition, int insertEnd) {
+	// Large pastes without tags: replace all emoji at once, the loop
+	// below then has only the tilde and tag fixes left to do.
+	if (_insertedTags.isEmpty() && insertEnd - insertPosition > kBulkEmojiReplaceLength) {
+		insertEnd = replaceEmojiBulk(insertPosition, insertEnd);
+	}
+
 	// Tilde formatting.
 	auto tildeFormatting = !cRetina() && (font().pixelSize() == 13) && (font().family() == qstr("Open Sans"));
 	auto isTildeFragment = false;
@@ -168,6 +168,7 @@ private:
 	// 5. Applying tags from "_insertedTags" in case we pasted text with tags, not just text.
 	// Rule 4 applies only if we inserted chars not in the middle of a tag (but at the end).
 	void processFormatting(int changedPosition, int changedEnd);
+	int replaceEmojiBulk(int changedPosition, int changedEnd);
 
 	bool heightAutoupdated();
 
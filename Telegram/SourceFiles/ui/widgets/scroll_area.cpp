@@ -21,6 +21,15 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/widgets/scroll_area.h"
 
 namespace Ui {
+namespace {
+
+constexpr auto kSmoothScrollHalfLifeMs = 40; // the distance left to scroll halves every 40 ms
+constexpr auto kSmoothScrollMaxHeights = 3; // quick wheel turns scroll up to 3 screens ahead
+constexpr auto kPaintAheadMaxHeights = 1; // content is painted in advance up to 1 screen ahead
+
+auto PaintingAheadDepth = 0;
+
+} // namespace
 
 // flick scroll taken from http://qt-project.org/doc/qt-4.8/demos-embedded-anomaly-src-flickcharm-cpp.html
 
@@ -325,7 +334,8 @@ ScrollArea::ScrollArea(QWidget *parent, const style::ScrollArea &st, bool handle
 , _verticalBar(this, true, &_st)
 , _topShadow(this, &_st)
 , _bottomShadow(this, &_st)
-, _touchEnabled(handleTouch) {
+, _touchEnabled(handleTouch)
+, _a_smoothScroll(animation(this, &ScrollArea::step_smoothScroll)) {
 	setLayoutDirection(cLangDir());
 	setFocusPolicy(Qt::NoFocus);
 
@@ -378,6 +388,14 @@ void ScrollArea::onScrolled() {
 		if (_disabled) {
 			verticalScrollBar()->setValue(_verticalValue);
 		} else {
+			if (_a_smoothScroll.animating() && !_smoothScrollApplying) {
+				// Someone else moved the content, like when messages are added
+				// above, so keep scrolling relative to the new position.
+				auto shift = verticalValue - _verticalValue;
+				_smoothScrollTop += shift;
+				_smoothScrollTarget += shift;
+				_paintAheadFrom = _paintAheadTill = 0;
+			}
 			_verticalValue = verticalValue;
 			if (_st.hiding) {
 				_verticalBar->hideTimeout(_st.hiding);
@@ -513,6 +531,10 @@ bool ScrollArea::viewportEvent(QEvent *e) {
 			touchEvent(ev);
 			return true;
 		}
+	} else if (e->type() == QEvent::Wheel) {
+		if (smoothWheelScroll(static_cast<QWheelEvent*>(e))) {
+			return true;
+		}
 	}
 	return QScrollArea::viewportEvent(e);
 }
@@ -527,6 +549,7 @@ void ScrollArea::touchEvent(QTouchEvent *e) {
 	case QEvent::TouchBegin:
 		if (_touchPress || e->touchPoints().isEmpty()) return;
 		_touchPress = true;
+		stopSmoothScroll();
 		if (_touchScrollState == TouchScrollState::Auto) {
 			_touchScrollState = TouchScrollState::Acceleration;
 			_touchWaitingAcceleration = true;
@@ -615,6 +638,9 @@ void ScrollArea::touchScrollUpdated(const QPoint &screenPos) {
 
 void ScrollArea::disableScroll(bool dis) {
 	_disabled = dis;
+	if (_disabled) {
+		stopSmoothScroll();
+	}
 	if (_disabled && _st.hiding) {
 		_horizontalBar->hideTimeout(0);
 		_verticalBar->hideTimeout(0);
@@ -711,6 +737,7 @@ void ScrollArea::scrollToY(int toTop, int toBottom) {
 
 void ScrollArea::doSetOwnedWidget(object_ptr<TWidget> w) {
 	auto splitted = qobject_cast<SplittedWidget*>(w.data());
+	stopSmoothScroll();
 	if (widget() && _touchEnabled) {
 		widget()->removeEventFilter(this);
 		if (!_widgetAcceptsTouch) widget()->setAttribute(Qt::WA_AcceptTouchEvents, false);
@@ -747,6 +774,7 @@ void ScrollArea::doSetOwnedWidget(object_ptr<TWidget> w) {
 }
 
 object_ptr<TWidget> ScrollArea::doTakeWidget() {
+	stopSmoothScroll();
 	if (_other) {
 		_other.destroy();
 		disconnect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(onVerticalScroll()));
@@ -790,6 +818,130 @@ bool ScrollArea::focusNextPrevChild(bool next) {
 
 void ScrollArea::setMovingByScrollBar(bool movingByScrollBar) {
 	_movingByScrollBar = movingByScrollBar;
+	if (_movingByScrollBar) {
+		stopSmoothScroll();
+	}
+}
+
+bool ScrollArea::smoothWheelScroll(QWheelEvent *e) {
+	// Trackpads send pixel deltas that are smooth already. Horizontal
+	// wheels and wheels with modifiers keep the default handling.
+	auto angle = e->angleDelta();
+	if (_disabled || !e->pixelDelta().isNull() || !angle.y() || angle.x() || e->modifiers() != Qt::NoModifier) {
+		return false;
+	}
+	auto step = verticalScrollBar()->singleStep() * QApplication::wheelScrollLines();
+	auto distance = snap(-angle.y() * step / 120., -float64(height()), float64(height()));
+	if (!_a_smoothScroll.animating()) {
+		// Let the event propagate to the parent when there is nowhere to go.
+		auto top = scrollTop();
+		if ((distance < 0. && top <= 0) || (distance > 0. && top >= scrollTopMax())) {
+			return false;
+		}
+		_smoothScrollTop = _smoothScrollTarget = top;
+		_smoothScrollTime = getms();
+		_paintAheadFrom = _paintAheadTill = 0;
+	} else if ((distance > 0.) != (_smoothScrollTarget > _smoothScrollTop)) {
+		// Turning the wheel back stops the scroll before going the other way.
+		_smoothScrollTarget = _smoothScrollTop;
+		_paintAheadFrom = _paintAheadTill = 0;
+	}
+
+	// Each wheel turn adds to the distance left, so the scroll goes faster
+	// while the wheel turns quickly and slows down when it stops.
+	auto limit = float64(kSmoothScrollMaxHeights * height());
+	auto target = snap(_smoothScrollTarget + distance, _smoothScrollTop - limit, _smoothScrollTop + limit);
+	_smoothScrollTarget = snap(target, 0., float64(scrollTopMax()));
+	if (anim::Disabled()) {
+		stopSmoothScroll();
+		scrollToY(qRound(_smoothScrollTarget));
+	} else if (!_a_smoothScroll.animating()) {
+		_a_smoothScroll.start();
+	}
+	e->accept();
+	return true;
+}
+
+void ScrollArea::step_smoothScroll(TimeMs ms, bool timer) {
+	auto elapsed = ms - _smoothScrollTime;
+	_smoothScrollTime = ms;
+
+	// The position is fractional, only the applied scroll value is rounded.
+	_smoothScrollTarget = snap(_smoothScrollTarget, 0., float64(scrollTopMax()));
+	auto remaining = (_smoothScrollTarget - _smoothScrollTop) * std::pow(0.5, elapsed / float64(kSmoothScrollHalfLifeMs));
+	if (qAbs(remaining) < 0.5) {
+		remaining = 0.;
+	}
+	_smoothScrollTop = _smoothScrollTarget - remaining;
+
+	auto top = qRound(_smoothScrollTop);
+	_smoothScrollApplying = true;
+	verticalScrollBar()->setValue(top);
+	_smoothScrollApplying = false;
+
+	if (remaining == 0. || scrollTop() != top) {
+		stopSmoothScroll();
+	} else if (_paintAheadEnabled) {
+		paintAhead((remaining > 0.) ? qCeil(remaining) : qFloor(remaining));
+	}
+}
+
+void ScrollArea::stopSmoothScroll() {
+	_a_smoothScroll.stop();
+	_paintAheadFrom = _paintAheadTill = 0;
+	_paintAheadCache = QImage();
+}
+
+void ScrollArea::paintAhead(int remaining) {
+	auto inner = widget();
+	auto maxBand = kPaintAheadMaxHeights * height();
+	if (!inner || !remaining || maxBand <= 0 || inner->width() <= 0) {
+		return;
+	}
+
+	// Render the strip that the next frames will expose, skipping the
+	// part that was rendered already during this scroll.
+	auto band = qMin(qAbs(remaining), maxBand);
+	auto from = (remaining > 0) ? (scrollTop() + height()) : (scrollTop() - band);
+	auto till = qMin(from + band, inner->height());
+	from = qMax(from, 0);
+	if (_paintAheadTill > _paintAheadFrom) {
+		if (remaining > 0) {
+			from = qMax(from, _paintAheadTill);
+		} else {
+			till = qMin(till, _paintAheadFrom);
+		}
+	}
+	if (from >= till) {
+		return;
+	}
+	if (_paintAheadTill > _paintAheadFrom) {
+		_paintAheadFrom = qMin(_paintAheadFrom, from);
+		_paintAheadTill = qMax(_paintAheadTill, till);
+	} else {
+		_paintAheadFrom = from;
+		_paintAheadTill = till;
+	}
+
+	auto size = QSize(inner->width(), maxBand) * cIntRetinaFactor();
+	if (_paintAheadCache.size() != size) {
+		_paintAheadCache = QImage(size, QImage::Format_ARGB32_Premultiplied);
+		_paintAheadCache.setDevicePixelRatio(cRetinaFactor());
+	}
+	++PaintingAheadDepth;
+	inner->render(&_paintAheadCache, QPoint(), QRegion(0, from, inner->width(), till - from), QWidget::DrawChildren);
+	--PaintingAheadDepth;
+}
+
+void ScrollArea::setPaintAheadEnabled(bool enabled) {
+	_paintAheadEnabled = enabled;
+	if (!_paintAheadEnabled) {
+		_paintAheadCache = QImage();
+	}
+}
+
+bool ScrollArea::PaintingAhead() {
+	return (PaintingAheadDepth > 0);
 }
 
 } // namespace Ui
@@ -201,6 +201,14 @@ public:
 	bool focusNextPrevChild(bool next) override;
 	void setMovingByScrollBar(bool movingByScrollBar);
 
+	// Renders the content that the wheel scroll animation is about to
+	// expose in advance, so that its images and text layouts are ready.
+	void setPaintAheadEnabled(bool enabled);
+
+	// True while the content is rendered outside of the viewport in advance.
+	// Paint events should not treat the painted items as seen by the user.
+	static bool PaintingAhead();
+
 	bool viewportEvent(QEvent *e) override;
 	void keyPressEvent(QKeyEvent *e) override;
 
@@ -252,6 +260,11 @@ private:
 	void touchUpdateSpeed();
 	void touchDeaccelerate(int32 elapsed);
 
+	bool smoothWheelScroll(QWheelEvent *e);
+	void step_smoothScroll(TimeMs ms, bool timer);
+	void stopSmoothScroll();
+	void paintAhead(int remaining);
+
 	bool _disabled = false;
 	bool _movingByScrollBar = false;
 
@@ -278,6 +291,17 @@ private:
 
 	bool _widgetAcceptsTouch = false;
 
+	BasicAnimation _a_smoothScroll;
+	float64 _smoothScrollTop = 0.;
+	float64 _smoothScrollTarget = 0.;
+	TimeMs _smoothScrollTime = 0;
+	bool _smoothScrollApplying = false;
+
+	bool _paintAheadEnabled = false;
+	int _paintAheadFrom = 0;
+	int _paintAheadTill = 0;
+	QImage _paintAheadCache;
+
 	friend class SplittedWidgetOther;
 	object_ptr<SplittedWidgetOther> _other = { nullptr };
 
@@ -33,6 +33,12 @@ namespace Window {
 
 constexpr auto kInactivePressTimeout = 200;
 
+// Don't flap the background mode while the window is being minimized or restored.
+constexpr auto kBackgroundModeDelay = 1000;
+
+// The tray and taskbar icons are pushed to the system not more often than that.
+constexpr auto kUnreadCounterHookDelay = 200;
+
 QImage LoadLogo() {
 	return QImage(qsl(":/gui/art/logo_256.png"));
 }
@@ -71,12 +77,18 @@ MainWindow::MainWindow() : QWidget()
 		}
 	});
 	subscribe(Global::RefUnreadCounterUpdate(), [this] { updateUnreadCounter(); });
+	_unreadCounterHookTimer.setCallback([this] { updateUnreadCounter(); });
 	subscribe(Global::RefWorkMode(), [this](DBIWorkMode mode) { workmodeUpdated(mode); });
 	subscribe(Messenger::Instance().authSessionChanged(), [this] { checkAuthSession(); });
 	checkAuthSession();
 
 	_isActiveTimer.setCallback([this] { updateIsActive(0); });
 	_inactivePressTimer.setCallback([this] { setInactivePress(false); });
+	_backgroundModeTimer.setCallback([this] {
+		if (computeBackgroundMode()) {
+			setBackgroundMode(true);
+		}
+	});
 }
 
 bool MainWindow::hideNoQuit() {
@@ -116,6 +128,39 @@ bool MainWindow::computeIsActive() const {
 	return isActiveWindow() && isVisible() && !(windowState() & Qt::WindowMinimized);
 }
 
+void MainWindow::updateBackgroundMode() {
+	if (computeBackgroundMode()) {
+		if (!Global::BackgroundMode() && !_backgroundModeTimer.isActive()) {
+			_backgroundModeTimer.callOnce(kBackgroundModeDelay);
+		}
+	} else {
+		_backgroundModeTimer.cancel();
+		setBackgroundMode(false);
+	}
+}
+
+bool MainWindow::computeBackgroundMode() const {
+	if (isHidden() || (windowState() & Qt::WindowMinimized)) {
+		return true;
+	}
+	auto handle = windowHandle();
+	return !handle || !handle->isExposed();
+}
+
+void MainWindow::setBackgroundMode(bool background) {
+	if (Global::BackgroundMode() == background) {
+		return;
+	}
+	DEBUG_LOG(("Window: %1 background mode.").arg(background ? "entering" : "leaving"));
+	Global::SetBackgroundMode(background);
+	anim::SetBackground(background);
+	Global::RefBackgroundModeChanged().notify();
+	if (!background) {
+		// Everything that was skipped while in background is repainted at once.
+		update();
+	}
+}
+
 void MainWindow::onReActivate() {
 	if (auto w = App::wnd()) {
 		if (auto f = QApplication::focusWidget()) {
@@ -152,10 +197,12 @@ void MainWindow::init() {
 
 	initSize();
 	updateUnreadCounter();
+	updateBackgroundMode();
 }
 
 void MainWindow::handleStateChanged(Qt::WindowState state) {
 	stateChangedHook(state);
+	updateBackgroundMode();
 	updateIsActive((state == Qt::WindowMinimized) ? Global::OfflineBlurTimeout() : Global::OnlineFocusTimeout());
 	psUserActionDone();
 	if (state == Qt::WindowMinimized && Global::WorkMode().value() == dbiwmTrayOnly) {
@@ -274,6 +321,16 @@ void MainWindow::updateControlsGeometry() {
 void MainWindow::updateUnreadCounter() {
 	if (!Global::started() || App::quitting()) return;
 
+	auto now = getms(true);
+	if (_unreadCounterHookTime && now < _unreadCounterHookTime + kUnreadCounterHookDelay) {
+		if (!_unreadCounterHookTimer.isActive()) {
+			_unreadCounterHookTimer.callOnce(_unreadCounterHookTime + kUnreadCounterHookDelay - now);
+		}
+		return;
+	}
+	_unreadCounterHookTimer.cancel();
+	_unreadCounterHookTime = now;
+
 	auto counter = App::histories().unreadBadge();
 	_titleText = (counter > 0) ? qsl("Telegram (%1)").arg(counter) : qsl("Telegram");
 
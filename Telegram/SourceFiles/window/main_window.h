@@ -107,6 +107,9 @@ protected:
 
 	void savePosition(Qt::WindowState state = Qt::WindowActive);
 	void handleStateChanged(Qt::WindowState state);
+
+	// Called when the window is shown, hidden, exposed or occluded.
+	void updateBackgroundMode();
 	void handleActiveChanged();
 
 	virtual void initHook() {
@@ -166,6 +169,8 @@ private:
 	void initSize();
 
 	bool computeIsActive() const;
+	bool computeBackgroundMode() const;
+	void setBackgroundMode(bool background);
 
 	object_ptr<QTimer> _positionUpdatedTimer;
 	bool _positionInited = false;
@@ -182,6 +187,9 @@ private:
 	base::Timer _isActiveTimer;
 	bool _wasInactivePress = false;
 	base::Timer _inactivePressTimer;
+	base::Timer _backgroundModeTimer;
+	TimeMs _unreadCounterHookTime = 0;
+	base::Timer _unreadCounterHookTimer;
 
 	base::Observable<void> _dragFinished;
 	base::Observable<void> _widgetGrabbed;
@@ -40,6 +40,17 @@ namespace Notifications {
 namespace Default {
 namespace {
 
+// More notifications than that from one history in kFloodInterval are batched.
+constexpr auto kFloodInterval = TimeMs(10000);
+constexpr auto kFloodCount = 3;
+constexpr auto kFloodsPruneCount = 64;
+
+// Not more than kCreationLimit notifications are shown in kCreationInterval.
+constexpr auto kCreationInterval = TimeMs(1000);
+constexpr auto kCreationLimit = 3;
+
+constexpr auto kNotificationsPoolSize = 3;
+
 int notificationMaxHeight() {
 	return st::notifyMinHeight + st::notifyReplyArea.heightMax + st::notifyBorderWidth;
 }
@@ -74,6 +85,7 @@ Manager::Manager(System *system) : Notifications::Manager(system) {
 		settingsChanged(change);
 	});
 	_inputCheckTimer.setTimeoutHandler([this] { checkLastInput(); });
+	_showNextTimer.setTimeoutHandler([this] { showNextFromQueue(); });
 }
 
 QPixmap Manager::hiddenUserpicPlaceholder() const {
@@ -193,27 +205,111 @@ void Manager::showNextFromQueue() {
 		return;
 	}
 
+	auto ms = getms(true);
 	auto startPosition = notificationStartPosition();
 	auto startShift = 0;
 	auto shiftDirection = notificationShiftDirection();
+	auto created = false;
 	do {
+		if (!checkCreationLimit(ms)) {
+			break;
+		}
 		auto queued = _queuedNotifications.front();
 		_queuedNotifications.pop_front();
 
-		auto notification = std::make_unique<Notification>(
-			this,
-			queued.history,
-			queued.peer,
-			queued.author,
-			queued.item,
-			queued.forwardedCount,
-			startPosition, startShift, shiftDirection);
+		auto notification = takeFromPool();
+		if (notification) {
+			notification->reuse(
+				queued.history,
+				queued.peer,
+				queued.author,
+				queued.item,
+				queued.forwardedCount,
+				queued.batchedCount,
+				startPosition, startShift, shiftDirection);
+		} else {
+			notification = std::make_unique<Notification>(
+				this,
+				queued.history,
+				queued.peer,
+				queued.author,
+				queued.item,
+				queued.forwardedCount,
+				queued.batchedCount,
+				startPosition, startShift, shiftDirection);
+		}
 		_notifications.push_back(std::move(notification));
+		_createdTimes.push_back(ms);
+		created = true;
 		--count;
 	} while (count > 0 && !_queuedNotifications.empty());
 
-	_positionsOutdated = true;
-	checkLastInput();
+	if (created) {
+		_positionsOutdated = true;
+		checkLastInput();
+	}
+}
+
+bool Manager::checkCreationLimit(TimeMs ms) {
+	while (!_createdTimes.empty() && _createdTimes.front() + kCreationInterval <= ms) {
+		_createdTimes.pop_front();
+	}
+	if (int(_createdTimes.size()) < kCreationLimit) {
+		return true;
+	}
+	auto wait = _createdTimes.front() + kCreationInterval - ms;
+	if (!_showNextTimer.isActive() || _showNextTimer.remainingTime() > wait) {
+		_showNextTimer.start(wait);
+	}
+	return false;
+}
+
+bool Manager::checkFlood(History *history, TimeMs ms) {
+	if (int(_floods.size()) > kFloodsPruneCount) {
+		for (auto i = _floods.begin(); i != _floods.end();) {
+			if (i->second.started + kFloodInterval <= ms) {
+				i = _floods.erase(i);
+			} else {
+				++i;
+			}
+		}
+	}
+	auto &flood = _floods[history];
+	if (flood.started + kFloodInterval <= ms) {
+		flood.started = ms;
+		flood.count = 0;
+	}
+	return (++flood.count > kFloodCount);
+}
+
+bool Manager::batchNotification(History *history, PeerData *author, int count) {
+	for (auto &queued : _queuedNotifications) {
+		if (queued.history != history) continue;
+
+		queued.batchedCount = (queued.batchedCount ? queued.batchedCount : queued.forwardedCount) + count;
+		queued.item = nullptr;
+		if (queued.author != author) {
+			queued.author = nullptr;
+		}
+		return true;
+	}
+	for (auto i = _notifications.size(); i != 0;) {
+		auto &notification = _notifications[--i];
+		if (notification->history() != history || notification->isReplying()) continue;
+
+		notification->addBatched(author, count);
+		return true;
+	}
+	return false;
+}
+
+std::unique_ptr<Manager::Notification> Manager::takeFromPool() {
+	if (_notificationsPool.empty()) {
+		return nullptr;
+	}
+	auto result = std::move(_notificationsPool.back());
+	_notificationsPool.pop_back();
+	return result;
 }
 
 void Manager::moveWidgets() {
@@ -278,24 +374,36 @@ void Manager::removeWidget(internal::Widget *remove) {
 	if (remove == _hideAll.get()) {
 		_hideAll.reset();
 	} else if (remove) {
-		auto it = std::find_if(_notifications.cbegin(), _notifications.cend(), [remove](auto &item) {
+		auto it = std::find_if(_notifications.begin(), _notifications.end(), [remove](auto &item) {
 			return item.get() == remove;
 		});
-		if (it != _notifications.cend()) {
+		if (it != _notifications.end()) {
+			auto removed = std::move(*it);
 			_notifications.erase(it);
 			_positionsOutdated = true;
+			if (int(_notificationsPool.size()) < kNotificationsPoolSize) {
+				_notificationsPool.push_back(std::move(removed));
+			}
 		}
 	}
 	showNextFromQueue();
 }
 
 void Manager::doShowNotification(HistoryItem *item, int forwardedCount) {
+	auto history = item->history();
+	if (checkFlood(history, getms(true))) {
+		auto author = (item->hasFromName() && !item->isPost()) ? item->author() : nullptr;
+		if (batchNotification(history, author, forwardedCount)) {
+			return;
+		}
+	}
 	_queuedNotifications.push_back(QueuedNotification(item, forwardedCount));
 	showNextFromQueue();
 }
 
 void Manager::doClearAll() {
 	_queuedNotifications.clear();
+	_floods.clear();
 	for_const (auto &notification, _notifications) {
 		notification->unlinkHistory();
 	}
@@ -304,11 +412,14 @@ void Manager::doClearAll() {
 
 void Manager::doClearAllFast() {
 	_queuedNotifications.clear();
+	_floods.clear();
 	base::take(_notifications);
+	base::take(_notificationsPool);
 	base::take(_hideAll);
 }
 
 void Manager::doClearFromHistory(History *history) {
+	_floods.remove(history);
 	for (auto i = _queuedNotifications.begin(); i != _queuedNotifications.cend();) {
 		if (i->history == history) {
 			i = _queuedNotifications.erase(i);
@@ -419,6 +530,17 @@ void Widget::hideAnimated(float64 duration, const anim::transition &func) {
 	_a_opacity.start([this] { opacityAnimationCallback(); }, 1., 0., duration, func);
 }
 
+void Widget::restart(QPoint startPosition, int shift, Direction shiftDirection) {
+	_hiding = false;
+	_deleted = false;
+	_startPosition = startPosition;
+	_direction = shiftDirection;
+	_a_shift.stop();
+	a_shift = anim::value(shift);
+	setWindowOpacity(0.);
+	_a_opacity.start([this] { opacityAnimationCallback(); }, 0., 1., st::notifyFastAnim);
+}
+
 void Widget::updateOpacity() {
 	setWindowOpacity(_a_opacity.current(_hiding ? 0. : 1.) * _manager->demoMasterOpacity());
 }
@@ -476,12 +598,13 @@ void Background::paintEvent(QPaintEvent *e) {
 	p.fillRect(st::notifyBorderWidth, height() - st::notifyBorderWidth, width() - 2 * st::notifyBorderWidth, st::notifyBorderWidth, st::notifyBorder);
 }
 
-Notification::Notification(Manager *manager, History *history, PeerData *peer, PeerData *author, HistoryItem *msg, int forwardedCount, QPoint startPosition, int shift, Direction shiftDirection) : Widget(manager, startPosition, shift, shiftDirection)
+Notification::Notification(Manager *manager, History *history, PeerData *peer, PeerData *author, HistoryItem *msg, int forwardedCount, int batchedCount, QPoint startPosition, int shift, Direction shiftDirection) : Widget(manager, startPosition, shift, shiftDirection)
 , _history(history)
 , _peer(peer)
 , _author(author)
 , _item(msg)
 , _forwardedCount(forwardedCount)
+, _batchedCount(batchedCount)
 #ifdef Q_OS_WIN
 , _started(GetTickCount())
 #endif // Q_OS_WIN
@@ -489,11 +612,7 @@ Notification::Notification(Manager *manager, History *history, PeerData *peer, P
 , _reply(this, langFactory(lng_notification_reply), st::defaultBoxButton) {
 	subscribe(Lang::Current().updated(), [this] { refreshLang(); });
 
-	auto position = computePosition(st::notifyMinHeight);
-	updateGeometry(position.x(), position.y(), st::notifyWidth, st::notifyMinHeight);
-
-	_userpicLoaded = _peer ? _peer->userpicLoaded() : true;
-	updateNotifyDisplay();
+	startShowing();
 
 	_hideTimer.setSingleShot(true);
 	connect(&_hideTimer, SIGNAL(timeout()), this, SLOT(onHideByTimer()));
@@ -530,6 +649,60 @@ Notification::Notification(Manager *manager, History *history, PeerData *peer, P
 	show();
 }
 
+void Notification::startShowing() {
+	auto position = computePosition(st::notifyMinHeight);
+	updateGeometry(position.x(), position.y(), st::notifyWidth, st::notifyMinHeight);
+
+	_userpicLoaded = _peer ? _peer->userpicLoaded() : true;
+	updateNotifyDisplay();
+}
+
+void Notification::reuse(History *history, PeerData *peer, PeerData *author, HistoryItem *item, int forwardedCount, int batchedCount, QPoint startPosition, int shift, Direction shiftDirection) {
+	_history = history;
+	_peer = peer;
+	_author = author;
+	_item = item;
+	_forwardedCount = forwardedCount;
+	_batchedCount = batchedCount;
+#ifdef Q_OS_WIN
+	_started = GetTickCount();
+#endif // Q_OS_WIN
+	_waitingForInput = true;
+	_hideTimer.stop();
+
+	if (_replyArea) {
+		QCoreApplication::instance()->removeEventFilter(this);
+		_replyArea.destroy();
+		_replySend.destroy();
+	}
+	_actionsVisible = false;
+	a_actionsOpacity.finish();
+	_reply->clearState();
+	_reply->hide();
+	_close->clearState();
+
+	restart(startPosition, shift, shiftDirection);
+	startShowing();
+	updateReplyGeometry();
+
+	show();
+}
+
+void Notification::addBatched(PeerData *author, int count) {
+	_batchedCount = (_batchedCount ? _batchedCount : qMax(_forwardedCount, 1)) + count;
+	_item = nullptr;
+	if (_author != author) {
+		_author = nullptr;
+	}
+	updateNotifyDisplay();
+
+	// Keep the notification on the screen while the messages keep coming.
+	if (!_waitingForInput && !manager()->hasReplyingNotification()) {
+		_hideTimer.start(st::notifyWaitLongHide);
+	}
+	Widget::hideStop();
+}
+
 void Notification::updateReplyGeometry() {
 	_reply->moveToRight(_replyPadding, height() - _reply->height() - _replyPadding);
 }
@@ -624,7 +797,7 @@ void Notification::actionsOpacityCallback() {
 }
 
 void Notification::updateNotifyDisplay() {
-	if (!_history || !_peer || (!_item && _forwardedCount < 2)) return;
+	if (!_history || !_peer || (!_item && _forwardedCount < 2 && !_batchedCount)) return;
 
 	auto options = Manager::getNotificationOptions(_item);
 	_hideReplyButton = options.hideReplyButton;
@@ -665,6 +838,16 @@ void Notification::updateNotifyDisplay() {
 			if (_item) {
 				auto active = false, selected = false;
 				_item->drawInDialog(p, r, active, selected, textCachedFor, itemTextCache);
+			} else if (_batchedCount > 0) {
+				p.setFont(st::dialogsTextFont);
+				if (_author) {
+					itemTextCache.setText(st::dialogsTextStyle, _author->name);
+					p.setPen(st::dialogsTextFgService);
+					itemTextCache.drawElided(p, r.left(), r.top(), r.width(), st::dialogsTextFont->height);
+					r.setTop(r.top() + st::dialogsTextFont->height);
+				}
+				p.setPen(st::dialogsTextFg);
+				p.drawText(r.left(), r.top() + st::dialogsTextFont->ascent, lng_notification_messages(lt_count, _batchedCount));
 			} else if (_forwardedCount > 1) {
 				p.setFont(st::dialogsTextFont);
 				if (_author) {
@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "window/notifications_manager.h"
 #include "core/single_timer.h"
+#include "base/flat_map.h"
 
 namespace Ui {
 class IconButton;
@@ -71,6 +72,10 @@ private:
 	void doClearFromItem(HistoryItem *item) override;
 
 	void showNextFromQueue();
+	bool checkCreationLimit(TimeMs ms);
+	bool checkFlood(History *history, TimeMs ms);
+	bool batchNotification(History *history, PeerData *author, int count);
+	std::unique_ptr<Notification> takeFromPool();
 	void unlinkFromShown(Notification *remove);
 	void startAllHiding();
 	void stopAllHiding();
@@ -89,10 +94,21 @@ private:
 
 	std::vector<std::unique_ptr<Notification>> _notifications;
 
+	// Hidden widgets kept for reuse, so a flood doesn't create a top-level window per message.
+	std::vector<std::unique_ptr<Notification>> _notificationsPool;
+
 	std::unique_ptr<HideAllButton> _hideAll;
 
 	bool _positionsOutdated = false;
 	SingleTimer _inputCheckTimer;
+	SingleTimer _showNextTimer;
+
+	struct Flood {
+		TimeMs started = 0;
+		int count = 0;
+	};
+	base::flat_map<History*, Flood> _floods;
+	std::deque<TimeMs> _createdTimes;
 
 	struct QueuedNotification {
 		QueuedNotification(HistoryItem *item, int forwardedCount)
@@ -108,6 +124,7 @@ private:
 		PeerData *author;
 		HistoryItem *item;
 		int forwardedCount;
+		int batchedCount = 0;
 	};
 	std::deque<QueuedNotification> _queuedNotifications;
 
@@ -137,6 +154,7 @@ public:
 		return a_shift.current();
 	}
 	void updatePosition(QPoint startPosition, Direction shiftDirection);
+	void restart(QPoint startPosition, int shift, Direction shiftDirection);
 	void addToHeight(int add);
 	void addToShift(int add);
 
@@ -186,7 +204,7 @@ class Notification : public Widget {
 	Q_OBJECT
 
 public:
-	Notification(Manager *manager, History *history, PeerData *peer, PeerData *author, HistoryItem *item, int forwardedCount, QPoint startPosition, int shift, Direction shiftDirection);
+	Notification(Manager *manager, History *history, PeerData *peer, PeerData *author, HistoryItem *item, int forwardedCount, int batchedCount, QPoint startPosition, int shift, Direction shiftDirection);
 
 	void startHiding();
 	void stopHiding();
@@ -194,6 +212,15 @@ public:
 	void updateNotifyDisplay();
 	void updatePeerPhoto();
 
+	// Shows a hidden pooled widget again for another notification.
+	void reuse(History *history, PeerData *peer, PeerData *author, HistoryItem *item, int forwardedCount, int batchedCount, QPoint startPosition, int shift, Direction shiftDirection);
+
+	// Turns the notification into "N new messages", adding count more messages to it.
+	void addBatched(PeerData *author, int count);
+
+	History *history() const {
+		return _history;
+	}
 	bool isUnlinked() const {
 		return !_history;
 	}
@@ -220,6 +247,7 @@ private slots:
 	void onReplyCancel();
 
 private:
+	void startShowing();
 	void refreshLang();
 	void updateReplyGeometry();
 	bool canReply() const;
@@ -249,6 +277,7 @@ private:
 	PeerData *_author;
 	HistoryItem *_item;
 	int _forwardedCount;
+	int _batchedCount = 0;
 	object_ptr<Ui::IconButton> _close;
 	object_ptr<Ui::RoundButton> _reply;
 	object_ptr<Background> _background = { nullptr };
@@ -38,7 +38,7 @@ CachedUserpics::CachedUserpics(Type type) : _type(type) {
 	QDir().mkpath(cWorkingDir() + qsl("tdata/temp"));
 }
 
-QString CachedUserpics::get(const StorageKey &key, PeerData *peer) {
+QString CachedUserpics::get(const StorageKey &key, PeerData *peer, QImage *saveImage) {
 	auto ms = getms(true);
 	auto i = _images.find(key);
 	if (i != _images.cend()) {
@@ -55,14 +55,20 @@ QString CachedUserpics::get(const StorageKey &key, PeerData *peer) {
 			v.until = 0;
 		}
 		v.path = cWorkingDir() + qsl("tdata/temp/") + QString::number(rand_value<uint64>(), 16) + qsl(".png");
+		auto image = QImage();
 		if (key.first || key.second) {
 			if (_type == Type::Rounded) {
-				peer->saveUserpicRounded(v.path, st::notifyMacPhotoSize);
+				image = peer->genUserpicRounded(st::notifyMacPhotoSize).toImage();
 			} else {
-				peer->saveUserpic(v.path, st::notifyMacPhotoSize);
+				image = peer->genUserpic(st::notifyMacPhotoSize).toImage();
 			}
 		} else {
-			Messenger::Instance().logoNoMargin().save(v.path, "PNG");
+			image = Messenger::Instance().logoNoMargin();
+		}
+		if (saveImage) {
+			*saveImage = std::move(image);
+		} else {
+			image.save(v.path, "PNG");
 		}
 		i = _images.insert(key, v);
 		_someSavedFlag = true;
@@ -36,7 +36,9 @@ public:
 	};
 	CachedUserpics(Type type);
 
-	QString get(const StorageKey &key, PeerData *peer);
+	// If saveImage is passed the new image file is not written, the image is put to
+	// *saveImage instead and must be saved to the returned path (from any thread).
+	QString get(const StorageKey &key, PeerData *peer, QImage *saveImage = nullptr);
 
 	~CachedUserpics();
 
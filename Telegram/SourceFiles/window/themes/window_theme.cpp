@@ -46,8 +46,18 @@ struct Data {
 		Cached cached;
 	};
 
+	// Parsed night theme, so that toggling night mode does not
+	// unpack and parse the theme file and decode its background again.
+	struct Night {
+		QByteArray content;
+		Cached cached;
+		QImage background;
+		bool tiled = false;
+	};
+
 	ChatBackground background;
 	Applying applying;
+	Night night;
 };
 NeverFreedPointer<Data> instance;
 
@@ -674,14 +684,44 @@ bool Apply(const QString &filepath) {
 	return Apply(std::move(preview));
 }
 
+namespace {
+
+bool loadNightFromMemory(Preview *preview) {
+	auto &night = instance->night;
+	if (night.content.isEmpty() || night.cached.paletteChecksum != style::palette::Checksum()) {
+		return false;
+	}
+	if (!preview->instance.palette.load(night.cached.colors)) {
+		return false;
+	}
+	preview->content = night.content;
+	preview->instance.cached = night.cached;
+	preview->instance.background = night.background;
+	preview->instance.tiled = night.tiled;
+	return true;
+}
+
+void saveNightToMemory(const Preview &preview) {
+	auto &night = instance->night;
+	night.content = preview.content;
+	night.cached = preview.instance.cached;
+	night.background = preview.instance.background;
+	night.tiled = preview.instance.tiled;
+}
+
+} // namespace
+
 void SwitchNightTheme(bool enabled) {
 	if (enabled) {
+		instance.createIfNull();
 		auto preview = std::make_unique<Preview>();
 		preview->path = str_const_toString(kNightThemeFile);
-		if (!LoadFromFile(preview->path, &preview->instance, &preview->content)) {
-			return;
+		if (!loadNightFromMemory(preview.get())) {
+			if (!LoadFromFile(preview->path, &preview->instance, &preview->content)) {
+				return;
+			}
+			saveNightToMemory(*preview);
 		}
-		instance.createIfNull();
 		instance->applying.path = std::move(preview->path);
 		instance->applying.content = std::move(preview->content);
 		instance->applying.cached = std::move(preview->instance.cached);
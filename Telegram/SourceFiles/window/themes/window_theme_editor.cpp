@@ -246,6 +246,7 @@ private:
 		}
 	}
 	void applyEditing(const QString &name, const QString &copyOf, QColor value);
+	void applyPaletteContent();
 
 	EditorBlock::Context _context;
 
@@ -259,6 +260,7 @@ private:
 	object_ptr<EditorBlock> _newRows;
 
 	bool _applyingUpdate = false;
+	SingleQueuedInvokation _applyPalette;
 
 };
 
@@ -293,7 +295,8 @@ private:
 Editor::Inner::Inner(QWidget *parent, const QString &path) : TWidget(parent)
 , _path(path)
 , _existingRows(this, EditorBlock::Type::Existing, &_context)
-, _newRows(this, EditorBlock::Type::New, &_context) {
+, _newRows(this, EditorBlock::Type::New, &_context)
+, _applyPalette([this] { applyPaletteContent(); }) {
 	resize(st::windowMinWidth, st::windowMinHeight);
 	subscribe(_context.resized, [this] {
 		resizeToWidth(width());
@@ -530,13 +533,21 @@ void Editor::Inner::applyEditing(const QString &name, const QString &copyOf, QCo
 		auto addedline = (_paletteContent.endsWith('\n') ? "" : newline);
 		newContent = _paletteContent + addedline + plainName + ": " + plainValue + ";" + newline;
 	}
+	_paletteContent = newContent;
+
+	// Several edits in one event loop iteration (a new key with its copies)
+	// are written and applied once: each apply reloads the whole palette.
+	_applyPalette.call();
+}
+
+void Editor::Inner::applyPaletteContent() {
 	QFile f(_path);
 	if (!f.open(QIODevice::WriteOnly)) {
 		LOG(("Theme Error: could not open '%1' for writing a palette update.").arg(_path));
 		error();
 		return;
 	}
-	if (f.write(newContent) != newContent.size()) {
+	if (f.write(_paletteContent) != _paletteContent.size()) {
 		LOG(("Theme Error: could not write all content to '%1' while writing a palette update.").arg(_path));
 		error();
 		return;
@@ -544,14 +555,12 @@ void Editor::Inner::applyEditing(const QString &name, const QString &copyOf, QCo
 	f.close();
 
 	_applyingUpdate = true;
-	if (!ApplyEditedPalette(_path, newContent)) {
+	if (!ApplyEditedPalette(_path, _paletteContent)) {
 		LOG(("Theme Error: could not apply newly composed content :("));
 		error();
 		return;
 	}
 	_applyingUpdate = false;
-
-	_paletteContent = newContent;
 }
 
 void writeDefaultPalette(const QString &path) {
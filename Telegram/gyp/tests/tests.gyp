@@ -64,6 +64,25 @@
       '<(src_loc)/base/flat_map.h',
       '<(src_loc)/base/flat_map_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_flat_hash_map',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/flat_hash_map.h',
+      '<(src_loc)/base/flat_hash_map_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_dense_id_map',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/dense_id_map.h',
+      '<(src_loc)/base/flat_hash_map.h',
+      '<(src_loc)/base/dense_id_map_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_flat_set',
     'includes': [
@@ -73,6 +92,15 @@
       '<(src_loc)/base/flat_set.h',
       '<(src_loc)/base/flat_set_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_compact_set',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/compact_set.h',
+      '<(src_loc)/base/compact_set_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_flags',
     'includes': [
@@ -82,5 +110,32 @@
       '<(src_loc)/base/flags.h',
       '<(src_loc)/base/flags_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_spsc_ring',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/spsc_ring.h',
+      '<(src_loc)/base/spsc_ring_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_mpsc_ring',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/mpsc_ring.h',
+      '<(src_loc)/base/mpsc_ring_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_benchmark',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/benchmark.h',
+      '<(src_loc)/base/benchmark_tests.cpp',
+    ],
   }],
 }